@@ -110,6 +110,95 @@ void BM_DISTRIBUTED_GRAPH_MULTIPLE_NODES(benchmark::State &state)
     }
 }
 
+// Dense embeddings of 1024 floats, where copies of feature values dominate request time.
+void BM_DISTRIBUTED_GRAPH_LARGE_FEATURES(benchmark::State &state)
+{
+    const size_t large_num_nodes = 10000;
+    const size_t large_fv_size = 1024;
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < large_num_nodes; n++)
+    {
+        std::vector<float> vals(large_fv_size);
+        std::iota(std::begin(vals), std::end(vals), n);
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = snark::NodeId(n), .m_type = 0, .m_weight = 1.0f, .m_float_features = {std::move(vals)}});
+    }
+
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::GRPCServer server(std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                                             snark::PartitionStorageType::memory, ""),
+                             {}, "0.0.0.0:0", {}, {}, {});
+    snark::GRPCClient c({server.InProcessChannel()}, 1, 1);
+
+    std::vector<snark::NodeId> input_nodes(large_num_nodes);
+    std::iota(std::begin(input_nodes), std::end(input_nodes), 0);
+    snark::Xoroshiro128PlusGenerator gen(42);
+    std::shuffle(std::begin(input_nodes), std::end(input_nodes), gen);
+    const size_t batch_size = state.range(0);
+    std::vector<uint8_t> output(4 * large_fv_size * batch_size);
+    boost::random::uniform_int_distribution<size_t> distrib(0, large_num_nodes - batch_size - 1);
+    std::vector<snark::FeatureMeta> feature = {{0, 4 * large_fv_size}};
+    for (auto _ : state)
+    {
+        c.GetNodeFeature(std::span(std::begin(input_nodes) + distrib(gen), batch_size), std::span(feature),
+                         std::span(output));
+    }
+    state.SetBytesProcessed(state.iterations() * output.size());
+}
+
+// Many callers with small batches, like data loader threads sharing a client. Argument is the coalescing window in
+// microseconds.
+void BM_DISTRIBUTED_GRAPH_CONCURRENT_SMALL_BATCHES(benchmark::State &state)
+{
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < num_nodes; n++)
+    {
+        std::vector<float> vals(fv_size);
+        std::iota(std::begin(vals), std::end(vals), n);
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = snark::NodeId(n), .m_type = 0, .m_weight = 1.0f, .m_float_features = {std::move(vals)}});
+    }
+
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::GRPCServer server(std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                                             snark::PartitionStorageType::memory, ""),
+                             {}, "0.0.0.0:0", {}, {}, {});
+    snark::GRPCClient c({server.InProcessChannel()}, 2, 1,
+                        snark::ClientCallConfig{.m_coalesce_window = std::chrono::microseconds(state.range(0))});
+
+    const size_t caller_count = 16;
+    const size_t batch_size = 64;
+    const size_t calls_per_caller = 50;
+    std::vector<snark::FeatureMeta> feature = {{0, 4 * fv_size}};
+    for (auto _ : state)
+    {
+        std::vector<std::thread> callers;
+        for (size_t t = 0; t < caller_count; ++t)
+        {
+            callers.emplace_back([&c, &feature, t]() {
+                snark::Xoroshiro128PlusGenerator gen(t);
+                boost::random::uniform_int_distribution<snark::NodeId> distrib(0, num_nodes - 1);
+                std::vector<snark::NodeId> input_nodes(batch_size);
+                std::vector<uint8_t> output(4 * fv_size * batch_size);
+                for (size_t call = 0; call < calls_per_caller; ++call)
+                {
+                    std::generate(std::begin(input_nodes), std::end(input_nodes), [&]() { return distrib(gen); });
+                    c.GetNodeFeature(std::span(input_nodes), std::span(feature), std::span(output));
+                }
+            });
+        }
+        for (auto &caller : callers)
+        {
+            caller.join();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * caller_count * calls_per_caller * batch_size);
+    state.counters["requests"] =
+        benchmark::Counter(double(c.CallStats().m_requests), benchmark::Counter::kAvgIterations);
+}
+
 static void BM_REGULAR_GRAPH(benchmark::State &state)
 {
     TestGraph::MemoryGraph m;
@@ -215,6 +304,12 @@ BENCHMARK(BM_DISTRIBUTED_GRAPH_MULTIPLE_NODES)
     ->RangeMultiplier(4)
     ->Range(min_batch_size, max_batch_size)
     ->Iterations(10000);
+BENCHMARK(BM_DISTRIBUTED_GRAPH_LARGE_FEATURES)
+    ->RangeMultiplier(4)
+    ->Range(1 << 4, 1 << 9)
+    ->Iterations(1000)
+    ->UseRealTime();
+BENCHMARK(BM_DISTRIBUTED_GRAPH_CONCURRENT_SMALL_BATCHES)->Arg(0)->Arg(100)->Arg(500)->Iterations(20)->UseRealTime();
 BENCHMARK(BM_DISTRIBUTED_SAMPLER_MULTIPLE_SERVERS)
     ->RangeMultiplier(4)
     ->Range(min_batch_size, max_batch_size)
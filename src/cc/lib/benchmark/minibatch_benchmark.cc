@@ -0,0 +1,442 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// End to end GNN minibatch benchmark: concurrent clients sample multi hop neighborhoods of random seeds and fetch
+// features of all sampled nodes from a synthetic graph with power law degrees. Every workload runs against a local
+// graph, servers in the same process and servers behind loopback TCP. Graph and deployment shape are set with flags,
+// e.g. minibatch_benchmark --nodes=1000000 --servers=4 --fanouts=25,10 --benchmark_format=json
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "src/cc/lib/distributed/client.h"
+#include "src/cc/lib/distributed/graph_engine.h"
+#include "src/cc/lib/distributed/server.h"
+#include "src/cc/lib/graph/graph.h"
+#include "src/cc/lib/graph/metadata.h"
+#include "src/cc/lib/graph/xoroshiro.h"
+
+#include "boost/random/uniform_int_distribution.hpp"
+#include "boost/random/uniform_real_distribution.hpp"
+#include "grpcpp/create_channel.h"
+#include "src/cc/tests/mocks.h"
+#include <benchmark/benchmark.h>
+
+#ifdef SNARK_PLATFORM_LINUX
+#include <mimalloc-override.h>
+#endif
+
+namespace
+{
+struct Options
+{
+    size_t m_nodes = 100000;
+    double m_degree = 10;   // Average out degree.
+    double m_exponent = 2.1; // P(degree = k) ~ k^-exponent, must be larger than 2 for a finite average.
+    size_t m_feature_dim = 64;
+    size_t m_partitions = 4;
+    size_t m_servers = 2;
+    size_t m_clients = 4;
+    size_t m_batch_size = 512;
+    std::vector<uint32_t> m_fanouts = {15, 10};
+
+    // Minibatches every client runs per benchmark iteration.
+    size_t m_batches = 4;
+};
+
+template <typename T> bool parse_number(std::string_view value, T &output)
+{
+    const auto result = std::from_chars(value.data(), value.data() + value.size(), output);
+    return result.ec == std::errc() && result.ptr == value.data() + value.size();
+}
+
+bool parse_fanouts(std::string_view value, std::vector<uint32_t> &output)
+{
+    output.clear();
+    while (!value.empty())
+    {
+        const auto comma = std::min(value.find(','), value.size());
+        if (!parse_number(value.substr(0, comma), output.emplace_back()))
+        {
+            return false;
+        }
+
+        value.remove_prefix(std::min(comma + 1, value.size()));
+    }
+
+    return !output.empty();
+}
+
+// Parse --name=value flags of the benchmark, return false if the argument is not one of them.
+bool parse_option(std::string_view arg, Options &options)
+{
+    const auto equal = arg.find('=');
+    if (!arg.starts_with("--") || equal == std::string_view::npos)
+    {
+        return false;
+    }
+
+    const auto name = arg.substr(2, equal - 2);
+    const auto value = arg.substr(equal + 1);
+    bool parsed = true;
+    if (name == "nodes")
+        parsed = parse_number(value, options.m_nodes);
+    else if (name == "degree")
+        parsed = parse_number(value, options.m_degree);
+    else if (name == "exponent")
+        parsed = parse_number(value, options.m_exponent);
+    else if (name == "feature_dim")
+        parsed = parse_number(value, options.m_feature_dim);
+    else if (name == "partitions")
+        parsed = parse_number(value, options.m_partitions);
+    else if (name == "servers")
+        parsed = parse_number(value, options.m_servers);
+    else if (name == "clients")
+        parsed = parse_number(value, options.m_clients);
+    else if (name == "batch_size")
+        parsed = parse_number(value, options.m_batch_size);
+    else if (name == "fanouts")
+        parsed = parse_fanouts(value, options.m_fanouts);
+    else if (name == "batches")
+        parsed = parse_number(value, options.m_batches);
+    else
+        return false;
+
+    if (!parsed)
+    {
+        std::fprintf(stderr, "Invalid value of --%.*s: %.*s\n", int(name.size()), name.data(), int(value.size()),
+                     value.data());
+        std::exit(1);
+    }
+
+    return true;
+}
+
+// Write a graph with one node and edge type where degrees follow a Pareto distribution scaled to the average
+// degree and neighbors are uniform random nodes. Node n is stored in partition n % partitions.
+void write_graph(const Options &options, const std::filesystem::path &path)
+{
+    snark::Xoroshiro128PlusGenerator gen(42);
+    boost::random::uniform_real_distribution<double> toss(0, 1);
+    boost::random::uniform_real_distribution<float> feature(-1, 1);
+    boost::random::uniform_int_distribution<snark::NodeId> neighbor(0, options.m_nodes - 1);
+    const double shape = options.m_exponent - 1;
+    const double min_degree = options.m_degree * (shape - 1) / shape;
+
+    std::vector<size_t> node_counts(options.m_partitions);
+    std::vector<size_t> edge_counts(options.m_partitions);
+    for (size_t partition = 0; partition < options.m_partitions; ++partition)
+    {
+        TestGraph::MemoryGraph graph;
+        for (size_t node = partition; node < options.m_nodes; node += options.m_partitions)
+        {
+            const auto degree =
+                std::min<size_t>(options.m_nodes - 1, size_t(min_degree * std::pow(1 - toss(gen), -1 / shape)));
+            std::vector<TestGraph::NeighborRecord> neighbors;
+            neighbors.reserve(degree);
+            for (size_t edge = 0; edge < degree; ++edge)
+            {
+                neighbors.emplace_back(neighbor(gen), 0, 1.0f);
+            }
+
+            std::sort(std::begin(neighbors), std::end(neighbors));
+            std::vector<float> values(options.m_feature_dim);
+            std::generate(std::begin(values), std::end(values), [&feature, &gen]() { return feature(gen); });
+
+            edge_counts[partition] += degree;
+            ++node_counts[partition];
+            graph.m_nodes.push_back(TestGraph::Node{.m_id = snark::NodeId(node),
+                                                    .m_type = 0,
+                                                    .m_weight = 1.0f,
+                                                    .m_float_features = {std::move(values)},
+                                                    .m_neighbors = std::move(neighbors)});
+        }
+
+        TestGraph::convert(path, std::to_string(partition) + "_0", std::move(graph), 1);
+    }
+
+    // Every conversion wrote metadata for a single partition, replace it with the one for all of them.
+    const auto edges = std::accumulate(std::begin(edge_counts), std::end(edge_counts), size_t(0));
+    std::ofstream meta(path / "meta.txt");
+    meta << "v" << snark::MINIMUM_SUPPORTED_VERSION << "\n";
+    meta << options.m_nodes << "\n";
+    meta << edges << "\n";
+    meta << 1 << "\n"; // node_types_count
+    meta << 1 << "\n"; // edge_types_count
+    meta << 1 << "\n"; // node_features_count
+    meta << 0 << "\n"; // edge_features_count
+    meta << options.m_partitions << "\n";
+    for (size_t partition = 0; partition < options.m_partitions; ++partition)
+    {
+        meta << partition << "\n";
+        meta << node_counts[partition] << "\n"; // partition node weight
+        meta << edge_counts[partition] << "\n"; // partition edge weight
+    }
+
+    meta << options.m_nodes << "\n"; // node type count
+    meta << edges << "\n";           // edge type count
+}
+
+// Graph on disk and its deployments, created on first use and shared by all benchmarks.
+class Environment
+{
+  public:
+    explicit Environment(Options options)
+        : m_options(std::move(options)), m_path(std::filesystem::temp_directory_path() / "minibatch_benchmark")
+    {
+        std::filesystem::remove_all(m_path);
+        std::filesystem::create_directories(m_path);
+        write_graph(m_options, m_path);
+    }
+
+    ~Environment()
+    {
+        std::ranges::fill(m_clients, nullptr);
+        m_servers.clear();
+        m_graph.reset();
+        std::filesystem::remove_all(m_path);
+    }
+
+    const Options &options() const
+    {
+        return m_options;
+    }
+
+    const snark::Graph &graph()
+    {
+        if (!m_graph)
+        {
+            std::vector<uint32_t> partitions(m_options.m_partitions);
+            std::iota(std::begin(partitions), std::end(partitions), 0);
+            m_graph = std::make_unique<snark::Graph>(m_path.string(), std::move(partitions),
+                                                     snark::PartitionStorageType::memory, "");
+        }
+
+        return *m_graph;
+    }
+
+    // Client of servers reached with in process channels if loopback is false, or over TCP otherwise.
+    snark::GRPCClient &client(bool loopback)
+    {
+        auto &client = m_clients[loopback];
+        if (!client)
+        {
+            start_servers();
+            std::vector<std::shared_ptr<grpc::Channel>> channels;
+            for (auto &server : m_servers)
+            {
+                channels.emplace_back(loopback ? grpc::CreateChannel("localhost:" + std::to_string(server->Port()),
+                                                                     grpc::InsecureChannelCredentials())
+                                               : server->InProcessChannel());
+            }
+
+            const auto threads = uint32_t(std::max<size_t>(1, m_options.m_servers));
+            client = std::make_unique<snark::GRPCClient>(std::move(channels), threads, 1);
+        }
+
+        return *client;
+    }
+
+  private:
+    // Server s stores partitions p with p % servers == s.
+    void start_servers()
+    {
+        for (size_t server = m_servers.size(); server < m_options.m_servers; ++server)
+        {
+            std::vector<uint32_t> partitions;
+            for (size_t partition = server; partition < m_options.m_partitions; partition += m_options.m_servers)
+            {
+                partitions.emplace_back(uint32_t(partition));
+            }
+
+            m_servers.emplace_back(std::make_unique<snark::GRPCServer>(
+                std::make_shared<snark::GraphEngineServiceImpl>(m_path.string(), std::move(partitions),
+                                                                snark::PartitionStorageType::memory, ""),
+                std::shared_ptr<snark::GraphSamplerServiceImpl>{}, "localhost:0", "", "", ""));
+        }
+    }
+
+    Options m_options;
+    std::filesystem::path m_path;
+    std::unique_ptr<snark::Graph> m_graph;
+    std::vector<std::unique_ptr<snark::GRPCServer>> m_servers;
+    std::array<std::unique_ptr<snark::GRPCClient>, 2> m_clients;
+};
+
+// Buffers of a single client reused between minibatches.
+struct Minibatch
+{
+    // Seeds followed by sampled neighbors of every hop.
+    std::vector<snark::NodeId> m_nodes;
+    std::vector<snark::Type> m_types;
+    std::vector<uint64_t> m_counts;
+    std::vector<uint8_t> m_features;
+    snark::Subgraph m_subgraph;
+};
+
+std::vector<snark::Type> edge_types = {0};
+
+// Graph and client APIs take slightly different arguments, adapters below make workloads generic.
+void sample_neighbors(const snark::Graph &graph, int64_t seed, std::span<const snark::NodeId> nodes, size_t count,
+                      std::span<snark::NodeId> output, Minibatch &batch)
+{
+    batch.m_counts.resize(nodes.size());
+    graph.UniformSampleNeighbor(false, seed, nodes, edge_types, count, output,
+                                std::span(batch.m_types).first(output.size()), batch.m_counts, -1, -1);
+}
+
+void sample_neighbors(snark::GRPCClient &client, int64_t seed, std::span<const snark::NodeId> nodes, size_t count,
+                      std::span<snark::NodeId> output, Minibatch &batch)
+{
+    client.UniformSampleNeighbor(false, seed, nodes, edge_types, count, output,
+                                 std::span(batch.m_types).first(output.size()), -1, -1);
+}
+
+template <typename Backend>
+void sample_minibatch(Backend &backend, bool subgraph, snark::Xoroshiro128PlusGenerator &gen, const Options &options,
+                      Minibatch &batch)
+{
+    boost::random::uniform_int_distribution<snark::NodeId> node(0, options.m_nodes - 1);
+    size_t total = options.m_batch_size;
+    size_t layer = options.m_batch_size;
+    for (auto fanout : options.m_fanouts)
+    {
+        layer *= fanout;
+        total += layer;
+    }
+
+    batch.m_nodes.resize(total);
+    batch.m_types.resize(total);
+    std::generate_n(std::begin(batch.m_nodes), options.m_batch_size, [&node, &gen]() { return node(gen); });
+    std::vector<snark::FeatureMeta> features = {{0, options.m_feature_dim * sizeof(float)}};
+    if (subgraph)
+    {
+        backend.SampleSubgraph(false, gen(), std::span(batch.m_nodes).first(options.m_batch_size), options.m_fanouts,
+                               edge_types, features, batch.m_subgraph);
+        return;
+    }
+
+    // Expand every hop from the previous layer, duplicates are kept like in GraphSAGE minibatches.
+    size_t begin = 0;
+    layer = options.m_batch_size;
+    for (auto fanout : options.m_fanouts)
+    {
+        const auto inputs = std::span(batch.m_nodes).subspan(begin, layer);
+        const auto outputs = std::span(batch.m_nodes).subspan(begin + layer, layer * fanout);
+        sample_neighbors(backend, gen(), inputs, fanout, outputs, batch);
+        begin += layer;
+        layer *= fanout;
+    }
+
+    batch.m_features.resize(total * features.front().second);
+    backend.GetNodeFeature(batch.m_nodes, features, batch.m_features);
+}
+
+// Clients run options.m_batches minibatches concurrently in every iteration. Throughput is reported in seeds per
+// second and minibatches per second, latencies of single minibatches as percentiles in microseconds.
+template <typename Backend> void run_minibatches(benchmark::State &state, Backend &backend, const Options &options)
+{
+    const bool subgraph = state.range(0) != 0;
+    std::vector<Minibatch> batches(options.m_clients);
+    std::vector<std::vector<double>> latencies(options.m_clients);
+    int64_t seed = 0;
+    for (auto _ : state)
+    {
+        std::vector<std::thread> clients;
+        for (size_t client = 0; client < options.m_clients; ++client)
+        {
+            clients.emplace_back([&, client, client_seed = seed++]() {
+                snark::Xoroshiro128PlusGenerator gen(client_seed);
+                for (size_t minibatch = 0; minibatch < options.m_batches; ++minibatch)
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    sample_minibatch(backend, subgraph, gen, options, batches[client]);
+                    const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+                    latencies[client].emplace_back(elapsed.count());
+                }
+            });
+        }
+
+        for (auto &client : clients)
+        {
+            client.join();
+        }
+    }
+
+    std::vector<double> all;
+    for (auto &client : latencies)
+    {
+        all.insert(std::end(all), std::begin(client), std::end(client));
+    }
+
+    std::sort(std::begin(all), std::end(all));
+    const auto percentile = [&all](double rank) {
+        return all.empty() ? 0.0 : all[std::min(all.size() - 1, size_t(rank * all.size()))];
+    };
+
+    state.SetItemsProcessed(int64_t(all.size() * options.m_batch_size));
+    state.counters["minibatches"] = benchmark::Counter(double(all.size()), benchmark::Counter::kIsRate);
+    state.counters["p50_us"] = percentile(0.5);
+    state.counters["p99_us"] = percentile(0.99);
+    state.counters["p999_us"] = percentile(0.999);
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    Options options;
+    int kept = 1;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (!parse_option(argv[arg], options))
+        {
+            argv[kept++] = argv[arg];
+        }
+    }
+
+    argc = kept;
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+
+    if (options.m_nodes < 2 || options.m_exponent <= 2 || options.m_partitions == 0 || options.m_servers == 0 ||
+        options.m_clients == 0 || options.m_batch_size == 0)
+    {
+        std::fprintf(stderr, "Graph needs at least 2 nodes, exponent above 2 and positive partitions, servers, "
+                             "clients and batch size\n");
+        return 1;
+    }
+
+    Environment environment(options);
+    const auto configure = [](benchmark::internal::Benchmark *benchmark) {
+        benchmark->ArgName("subgraph")->Arg(0)->Arg(1)->MeasureProcessCPUTime()->UseRealTime();
+    };
+
+    configure(benchmark::RegisterBenchmark("BM_MINIBATCH_LOCAL", [&environment](benchmark::State &state) {
+        run_minibatches(state, environment.graph(), environment.options());
+    }));
+    configure(benchmark::RegisterBenchmark("BM_MINIBATCH_IN_PROCESS", [&environment](benchmark::State &state) {
+        run_minibatches(state, environment.client(false), environment.options());
+    }));
+    configure(benchmark::RegisterBenchmark("BM_MINIBATCH_LOOPBACK", [&environment](benchmark::State &state) {
+        run_minibatches(state, environment.client(true), environment.options());
+    }));
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
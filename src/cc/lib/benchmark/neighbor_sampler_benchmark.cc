@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 #include <algorithm>
+#include <cmath>
 #include <filesystem>
 #include <fstream>
 #include <random>
@@ -13,6 +14,7 @@
 #include "src/cc/lib/graph/xoroshiro.h"
 
 #include "boost/random/exponential_distribution.hpp"
+#include "boost/random/uniform_real_distribution.hpp"
 #include <benchmark/benchmark.h>
 #ifdef SNARK_PLATFORM_LINUX
 #include <mimalloc-override.h>
@@ -93,7 +95,32 @@ std::pair<size_t, size_t> create_partition(MemoryGraph t, std::filesystem::path
     return {counter, nb_index.size()};
 }
 
-snark::Graph create_graph(size_t num_types, size_t num_nodes_per_partition, size_t num_partitions)
+void write_meta(std::filesystem::path path, const std::vector<size_t> &partition_num_nodes, size_t num_nodes,
+                size_t num_edges)
+{
+    std::ofstream meta(path / "meta.txt");
+    meta << "v" << snark::MINIMUM_SUPPORTED_VERSION << "\n";
+    meta << num_nodes << "\n";
+    meta << num_edges << "\n";
+
+    meta << 1 << "\n";                          // node_types_count
+    meta << 1 << "\n";                          // edge_types_count
+    meta << 0 << "\n";                          // node_features_count
+    meta << 0 << "\n";                          // edge_features_count
+    meta << partition_num_nodes.size() << "\n"; // partition_count
+    for (size_t partition_id = 0; partition_id < partition_num_nodes.size(); ++partition_id)
+    {
+        meta << partition_id << "\n";                      // partition id
+        meta << partition_num_nodes[partition_id] << "\n"; // partition node weight
+        meta << 1 << "\n";                                 // partition edge weight
+    }
+    meta << num_nodes << "\n";
+    meta << num_edges << "\n";
+    meta.close();
+}
+
+snark::Graph create_graph(size_t num_types, size_t num_nodes_per_partition, size_t num_partitions,
+                          bool compressed_edges = false)
 {
     snark::Xoroshiro128PlusGenerator gen(42);
     auto path = std::filesystem::temp_directory_path();
@@ -132,35 +159,43 @@ snark::Graph create_graph(size_t num_types, size_t num_nodes_per_partition, size
         partitions.emplace_back(p);
     }
 
+    write_meta(path, partition_num_nodes, num_nodes, num_edges);
+    return snark::Graph(path, partitions, snark::PartitionStorageType::memory, "", {}, false, compressed_edges);
+}
+
+// Power law graph where a few hubs hold most of the edges with exponentially distributed weights.
+snark::Graph create_hub_graph(size_t num_nodes, size_t alias_threshold)
+{
+    snark::Xoroshiro128PlusGenerator gen(42);
+    auto path = std::filesystem::temp_directory_path();
+    boost::random::exponential_distribution<float> weight(1.0f);
+    MemoryGraph mem_graph;
+    size_t num_edges = 0;
+    for (size_t n = 0; n < num_nodes; ++n)
     {
-        std::ofstream meta(path / "meta.txt");
-        meta << "v" << snark::MINIMUM_SUPPORTED_VERSION << "\n";
-        meta << num_nodes << "\n";
-        meta << num_edges << "\n";
-
-        meta << 1 << "\n";              // node_types_count
-        meta << 1 << "\n";              // edge_types_count
-        meta << 0 << "\n";              // node_features_count
-        meta << 0 << "\n";              // edge_features_count
-        meta << num_partitions << "\n"; // partition_count
-        for (size_t partition_id = 0; partition_id < num_partitions; ++partition_id)
+        // Node n has about num_nodes / (n + 1) neighbors.
+        const size_t num_neighbors = std::max<size_t>(1, num_nodes / (n + 1));
+        std::vector<NeighborRecord> nbs;
+        nbs.reserve(num_neighbors);
+        for (size_t i = 0; i < num_neighbors; ++i)
         {
-            meta << partition_id << "\n";                      // partition id
-            meta << partition_num_nodes[partition_id] << "\n"; // partition node weight
-            meta << 1 << "\n";                                 // partition edge weight
+            nbs.emplace_back((n + i + 1) % num_nodes, snark::Type(0), weight(gen));
         }
-        meta << num_nodes << "\n";
-        meta << num_edges << "\n";
-        meta.close();
+        std::sort(std::begin(nbs), std::end(nbs));
+        num_edges += nbs.size();
+        mem_graph.m_nodes.emplace_back(int64_t(n), std::move(nbs));
     }
-    return snark::Graph(path, partitions, snark::PartitionStorageType::memory, "");
+
+    auto partition_nodes_edges = create_partition(std::move(mem_graph), path, "0_0");
+    write_meta(path, {partition_nodes_edges.first}, partition_nodes_edges.first, num_edges);
+    return snark::Graph(path, {0}, snark::PartitionStorageType::memory, "", {}, false, false, {}, alias_threshold);
 }
 
-static void BM_ONE_NODE_TYPE_WEIGHTED(benchmark::State &state)
+static void BM_WEIGHTED_NEIGHBORS(benchmark::State &state, bool compressed_edges)
 {
     const size_t num_partitions = 10;
     const size_t num_nodes_per_partition = 100000;
-    auto s = create_graph(1, num_nodes_per_partition, num_partitions);
+    auto s = create_graph(1, num_nodes_per_partition, num_partitions, compressed_edges);
     const auto total_nodes = num_nodes_per_partition * num_partitions;
     std::vector<snark::NodeId> input_nodes(total_nodes);
     std::iota(std::begin(input_nodes), std::end(input_nodes), 0);
@@ -191,5 +226,62 @@ static void BM_ONE_NODE_TYPE_WEIGHTED(benchmark::State &state)
     }
 }
 
+static void BM_ONE_NODE_TYPE_WEIGHTED(benchmark::State &state)
+{
+    BM_WEIGHTED_NEIGHBORS(state, false);
+}
+
+static void BM_ONE_NODE_TYPE_WEIGHTED_COMPRESSED(benchmark::State &state)
+{
+    BM_WEIGHTED_NEIGHBORS(state, true);
+}
+
+static void BM_HUB_WEIGHTED_NEIGHBORS(benchmark::State &state, size_t alias_threshold)
+{
+    const size_t num_nodes = 300000;
+    auto s = create_hub_graph(num_nodes, alias_threshold);
+
+    // Source nodes are picked proportionally to their degrees, like sources of random edges.
+    const size_t max_count = 1 << 16;
+    std::vector<snark::NodeId> input_nodes(max_count);
+    snark::Xoroshiro128PlusGenerator gen(23);
+    boost::random::uniform_real_distribution<double> rank(0, std::log(double(num_nodes)));
+    std::generate(std::begin(input_nodes), std::end(input_nodes),
+                  [&]() { return snark::NodeId(std::exp(rank(gen))) - 1; });
+    const size_t batch_size = state.range(0);
+    const size_t num_neighbors_to_sample = 10;
+    std::vector<snark::Type> edge_types({0});
+    std::vector<float> weight_holder(num_neighbors_to_sample * batch_size);
+    std::vector<snark::Type> type_holder(num_neighbors_to_sample * batch_size);
+    std::vector<snark::NodeId> node_holder(num_neighbors_to_sample * batch_size);
+    std::vector<float> total_neighbor_weight(batch_size);
+    int64_t seed = 42;
+    size_t offset = 0;
+    for (auto _ : state)
+    {
+        s.SampleNeighbor(++seed, std::span(input_nodes).subspan(offset, batch_size), std::span(edge_types),
+                         num_neighbors_to_sample, std::span(node_holder), std::span(type_holder),
+                         std::span(weight_holder), std::span(total_neighbor_weight), 0, 0, -1);
+        offset += batch_size;
+        if (offset + batch_size > max_count)
+        {
+            offset = 0;
+        }
+    }
+}
+
+static void BM_HUB_WEIGHTED(benchmark::State &state)
+{
+    BM_HUB_WEIGHTED_NEIGHBORS(state, 0);
+}
+
+static void BM_HUB_WEIGHTED_ALIAS(benchmark::State &state)
+{
+    BM_HUB_WEIGHTED_NEIGHBORS(state, 64);
+}
+
 BENCHMARK(BM_ONE_NODE_TYPE_WEIGHTED)->RangeMultiplier(2)->Range(1 << 3, 1 << 12);
+BENCHMARK(BM_ONE_NODE_TYPE_WEIGHTED_COMPRESSED)->RangeMultiplier(2)->Range(1 << 3, 1 << 12);
+BENCHMARK(BM_HUB_WEIGHTED)->RangeMultiplier(4)->Range(1 << 4, 1 << 12);
+BENCHMARK(BM_HUB_WEIGHTED_ALIAS)->RangeMultiplier(4)->Range(1 << 4, 1 << 12);
 BENCHMARK_MAIN();
@@ -2,13 +2,20 @@
 // Licensed under the MIT License.
 
 #include <algorithm>
+#include <cstdio>
 #include <filesystem>
 #include <fstream>
 #include <random>
 
 #include <string>
 
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
 #include "src/cc/lib/graph/graph.h"
+#include "src/cc/lib/graph/locator.h"
+#include "src/cc/lib/graph/node_index.h"
 #include "src/cc/lib/graph/xoroshiro.h"
 #include "src/cc/tests/mocks.h"
 #include <benchmark/benchmark.h>
@@ -39,7 +46,8 @@ std::string create_features_graph(const size_t num_nodes, const size_t fv_size)
     return path;
 }
 
-static void BM_NODE_FEATURES(benchmark::State &state, snark::PartitionStorageType storage_type)
+static void BM_NODE_FEATURES(benchmark::State &state, snark::PartitionStorageType storage_type,
+                             snark::FeatureCacheConfig feature_cache = {})
 {
     const size_t num_nodes = 100000;
     const size_t fv_size = 602;
@@ -48,7 +56,7 @@ static void BM_NODE_FEATURES(benchmark::State &state, snark::PartitionStorageTyp
     if (state.thread_index() == 0)
     {
         path = create_features_graph(num_nodes, fv_size);
-        g_client = std::make_shared<snark::Graph>(snark::Graph(path, {0}, storage_type, ""));
+        g_client = std::make_shared<snark::Graph>(snark::Graph(path, {0}, storage_type, "", feature_cache));
     }
     const auto total_nodes = num_nodes;
     std::vector<snark::NodeId> input_nodes(total_nodes);
@@ -76,6 +84,142 @@ static void BM_NODE_FEATURES(benchmark::State &state, snark::PartitionStorageTyp
     }
 }
 
+// Graph with feature_count dense features of fv_size floats per node.
+std::string create_wide_features_graph(const size_t num_nodes, const size_t feature_count, const size_t fv_size)
+{
+    std::string path = std::filesystem::temp_directory_path() / "benchmark_wide_features";
+    std::filesystem::create_directory(path);
+
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < num_nodes; n++)
+    {
+        std::vector<std::vector<float>> features(feature_count, std::vector<float>(fv_size));
+        for (size_t feature = 0; feature < feature_count; ++feature)
+        {
+            std::iota(std::begin(features[feature]), std::end(features[feature]), float(n + feature));
+        }
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = snark::NodeId(n), .m_type = 0, .m_weight = 1.0f, .m_float_features = std::move(features)});
+    }
+
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+
+    return path;
+}
+
+// Fetch a single feature out of many stored for every node from row or columnar layout.
+static void BM_WIDE_NODE_FEATURES(benchmark::State &state, bool columnar)
+{
+    const size_t num_nodes = 100000;
+    const size_t feature_count = 20;
+    const size_t fv_size = 16;
+    const snark::FeatureId requested = 7;
+    std::vector<snark::FeatureMeta> features = {{requested, fv_size * 4}};
+    const auto path = create_wide_features_graph(num_nodes, feature_count, fv_size);
+    snark::Graph graph(path, {0}, snark::PartitionStorageType::memory, "", {}, false, false, {}, 0,
+                       columnar ? std::vector<snark::FeatureId>{requested} : std::vector<snark::FeatureId>{});
+    std::vector<snark::NodeId> input_nodes(num_nodes);
+    std::iota(std::begin(input_nodes), std::end(input_nodes), 0);
+    std::shuffle(std::begin(input_nodes), std::end(input_nodes), snark::Xoroshiro128PlusGenerator(23));
+    const size_t batch_size = state.range(0);
+    std::vector<float> output(fv_size * batch_size);
+    size_t offset = 0;
+    for (auto _ : state)
+    {
+        graph.GetNodeFeature(std::span(input_nodes).subspan(offset, batch_size), std::span(features),
+                             std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+        offset += batch_size;
+        if (offset + batch_size > num_nodes)
+        {
+            offset = 0;
+        }
+    }
+    std::filesystem::remove_all(path);
+}
+
+// Look up batches of random nodes in an index much larger than CPU caches one by one or in a pipelined batch.
+static void BM_NODE_INDEX_LOOKUP(benchmark::State &state, bool compact, bool batched)
+{
+    const size_t num_nodes = 1 << 22;
+    snark::Xoroshiro128PlusGenerator gen(23);
+    std::vector<std::vector<snark::NodeId>> node_ids(1);
+    node_ids.front().reserve(num_nodes);
+    for (size_t n = 0; n < num_nodes; ++n)
+    {
+        node_ids.front().emplace_back(snark::NodeId(gen() >> 1));
+    }
+    std::vector<snark::NodeId> input_nodes = node_ids.front();
+    std::shuffle(std::begin(input_nodes), std::end(input_nodes), gen);
+    std::vector<uint32_t> partitions_indices;
+    std::vector<uint64_t> internal_indices;
+    std::vector<uint32_t> counts;
+    const snark::NodeIndex index(std::move(node_ids), partitions_indices, internal_indices, counts, compact);
+
+    const size_t batch_size = state.range(0);
+    std::vector<uint64_t> output(batch_size);
+    size_t offset = 0;
+    for (auto _ : state)
+    {
+        const auto batch = std::span(input_nodes).subspan(offset, batch_size);
+        if (batched)
+        {
+            index.Find(batch, output);
+        }
+        else
+        {
+            std::transform(std::begin(batch), std::end(batch), std::begin(output),
+                           [&index](snark::NodeId node) { return index.Find(node); });
+        }
+        benchmark::DoNotOptimize(output.data());
+        offset += batch_size;
+        if (offset + batch_size > num_nodes)
+        {
+            offset = 0;
+        }
+    }
+}
+
+// Read batches of random ranges from a file evicted from page cache with requests sent one after another or
+// concurrently.
+static void BM_PREAD_RANGES(benchmark::State &state, size_t concurrent_reads)
+{
+    const size_t file_size = 1 << 28;
+    const size_t range_size = 2408;
+    const auto path = std::filesystem::temp_directory_path() / "benchmark_pread_ranges";
+    {
+        std::ofstream out(path, std::ios::binary);
+        std::vector<char> block(1 << 20, 1);
+        for (size_t written = 0; written < file_size; written += block.size())
+        {
+            out.write(block.data(), block.size());
+        }
+    }
+
+    auto file = snark::open_file(path, "rb");
+    snark::Xoroshiro128PlusGenerator gen(23);
+    const size_t batch_size = state.range(0);
+    std::vector<uint8_t> output(batch_size * range_size);
+    std::vector<snark::FileRange> ranges(batch_size);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+#ifdef __linux__
+        posix_fadvise(fileno(file), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+        for (size_t index = 0; index < batch_size; ++index)
+        {
+            ranges[index] = snark::FileRange{.offset = gen() % (file_size - range_size),
+                                             .size = range_size,
+                                             .output = output.data() + index * range_size};
+        }
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(snark::platform_pread(file, std::span(ranges), concurrent_reads));
+    }
+    fclose(file);
+    std::filesystem::remove(path);
+}
+
 static void BM_NODE_STRING_FEATURES(benchmark::State &state, snark::PartitionStorageType storage_type)
 {
     const size_t num_nodes = 100000;
@@ -118,23 +262,87 @@ static void BM_NODE_FEATURES_DISK(benchmark::State &state)
     BM_NODE_FEATURES(state, snark::PartitionStorageType::disk);
 }
 
+static void BM_NODE_FEATURES_DISK_CACHE(benchmark::State &state)
+{
+    BM_NODE_FEATURES(state, snark::PartitionStorageType::disk, snark::FeatureCacheConfig{.m_capacity = 1 << 26});
+}
+
 static void BM_NODE_FEATURES_MEMORY(benchmark::State &state)
 {
     BM_NODE_FEATURES(state, snark::PartitionStorageType::memory);
 }
 
+static void BM_NODE_FEATURES_MMAP(benchmark::State &state)
+{
+    BM_NODE_FEATURES(state, snark::PartitionStorageType::mmap);
+}
+
+static void BM_WIDE_NODE_FEATURES_ROWS(benchmark::State &state)
+{
+    BM_WIDE_NODE_FEATURES(state, false);
+}
+
+static void BM_WIDE_NODE_FEATURES_COLUMNAR(benchmark::State &state)
+{
+    BM_WIDE_NODE_FEATURES(state, true);
+}
+
 static void BM_NODE_STRING_FEATURES_MEMORY(benchmark::State &state)
 {
     BM_NODE_STRING_FEATURES(state, snark::PartitionStorageType::memory);
 }
 
+static void BM_PREAD_RANGES_SERIAL(benchmark::State &state)
+{
+    BM_PREAD_RANGES(state, 1);
+}
+
+static void BM_PREAD_RANGES_CONCURRENT(benchmark::State &state)
+{
+    BM_PREAD_RANGES(state, snark::default_concurrent_reads);
+}
+
+static void BM_NODE_INDEX_HASH_SINGLE(benchmark::State &state)
+{
+    BM_NODE_INDEX_LOOKUP(state, false, false);
+}
+
+static void BM_NODE_INDEX_HASH_BATCH(benchmark::State &state)
+{
+    BM_NODE_INDEX_LOOKUP(state, false, true);
+}
+
+static void BM_NODE_INDEX_COMPACT_SINGLE(benchmark::State &state)
+{
+    BM_NODE_INDEX_LOOKUP(state, true, false);
+}
+
+static void BM_NODE_INDEX_COMPACT_BATCH(benchmark::State &state)
+{
+    BM_NODE_INDEX_LOOKUP(state, true, true);
+}
+
 BENCHMARK(BM_NODE_FEATURES_DISK)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(1);
+BENCHMARK(BM_NODE_FEATURES_DISK_CACHE)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(1);
 BENCHMARK(BM_NODE_FEATURES_MEMORY)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(1);
+BENCHMARK(BM_NODE_FEATURES_MMAP)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(1);
 BENCHMARK(BM_NODE_FEATURES_DISK)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(2);
+BENCHMARK(BM_NODE_FEATURES_DISK_CACHE)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(2);
 BENCHMARK(BM_NODE_FEATURES_MEMORY)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(2);
+BENCHMARK(BM_NODE_FEATURES_MMAP)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(2);
 BENCHMARK(BM_NODE_FEATURES_DISK)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(4);
+BENCHMARK(BM_NODE_FEATURES_DISK_CACHE)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(4);
 BENCHMARK(BM_NODE_FEATURES_MEMORY)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(4);
+BENCHMARK(BM_NODE_FEATURES_MMAP)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(4);
 BENCHMARK(BM_NODE_STRING_FEATURES_MEMORY)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(1);
 BENCHMARK(BM_NODE_STRING_FEATURES_MEMORY)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(2);
 BENCHMARK(BM_NODE_STRING_FEATURES_MEMORY)->RangeMultiplier(2)->Range(1 << 3, 1 << 10)->Threads(4);
+BENCHMARK(BM_WIDE_NODE_FEATURES_ROWS)->RangeMultiplier(4)->Range(1 << 4, 1 << 12);
+BENCHMARK(BM_WIDE_NODE_FEATURES_COLUMNAR)->RangeMultiplier(4)->Range(1 << 4, 1 << 12);
+BENCHMARK(BM_PREAD_RANGES_SERIAL)->RangeMultiplier(4)->Range(1 << 2, 1 << 10);
+BENCHMARK(BM_PREAD_RANGES_CONCURRENT)->RangeMultiplier(4)->Range(1 << 2, 1 << 10);
+BENCHMARK(BM_NODE_INDEX_HASH_SINGLE)->RangeMultiplier(8)->Range(1 << 6, 1 << 15);
+BENCHMARK(BM_NODE_INDEX_HASH_BATCH)->RangeMultiplier(8)->Range(1 << 6, 1 << 15);
+BENCHMARK(BM_NODE_INDEX_COMPACT_SINGLE)->RangeMultiplier(8)->Range(1 << 6, 1 << 15);
+BENCHMARK(BM_NODE_INDEX_COMPACT_BATCH)->RangeMultiplier(8)->Range(1 << 6, 1 << 15);
 BENCHMARK_MAIN();
@@ -16,9 +16,15 @@ CallData::CallData(grpc::ServerCompletionQueue &cq) : m_cq(cq), m_status(CREATE)
 {
 }
 
-NodeFeaturesCallData::NodeFeaturesCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+bool CallData::Finished() const
+{
+    return m_status == FINISH;
+}
+
+NodeFeaturesCallData::NodeFeaturesCallData(GraphEngineAsyncService &service, grpc::ServerCompletionQueue &cq,
                                            snark::GraphEngine::Service &service_impl)
-    : CallData(cq), m_responder(&m_ctx), m_service_impl(service_impl), m_service(service)
+    : CallData(cq), m_responder(&m_ctx), m_service_impl(service_impl),
+      m_raw_service_impl(dynamic_cast<snark::GraphEngineServiceImpl *>(&service_impl)), m_service(service)
 {
     Proceed();
 }
@@ -34,7 +40,27 @@ void NodeFeaturesCallData::Proceed()
     {
         // All new objects will be deleted when we drain the request queue.
         new NodeFeaturesCallData(m_service, m_cq, m_service_impl);
-        const auto status = m_service_impl.GetNodeFeatures(&m_ctx, &m_request, &m_reply);
+        NodeFeaturesRequest request;
+        grpc::Status status;
+        {
+            StageTimer timer(RequestStage::decode);
+            status = grpc::SerializationTraits<NodeFeaturesRequest>::Deserialize(&m_request, &request);
+        }
+        if (status.ok() && m_raw_service_impl != nullptr)
+        {
+            status = m_raw_service_impl->GetNodeFeaturesRaw(&m_ctx, &request, &m_reply);
+        }
+        else if (status.ok())
+        {
+            NodeFeaturesReply reply;
+            status = m_service_impl.GetNodeFeatures(&m_ctx, &request, &reply);
+            bool own_buffer = false;
+            if (status.ok())
+            {
+                StageTimer timer(RequestStage::serialize);
+                status = grpc::SerializationTraits<NodeFeaturesReply>::Serialize(reply, &m_reply, &own_buffer);
+            }
+        }
         m_status = FINISH;
         m_responder.Finish(m_reply, status, this);
     }
@@ -187,6 +213,91 @@ void UniformSampleNeighborsCallData::Proceed()
     }
 }
 
+SampleSubgraphCallData::SampleSubgraphCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                                               snark::GraphEngine::Service &service_impl)
+    : CallData(cq), m_responder(&m_ctx), m_service_impl(service_impl), m_service(service)
+{
+    Proceed();
+}
+
+void SampleSubgraphCallData::Proceed()
+{
+    if (m_status == CREATE)
+    {
+        m_status = PROCESS;
+        m_service.RequestSampleSubgraph(&m_ctx, &m_request, &m_responder, &m_cq, &m_cq, this);
+    }
+    else if (m_status == PROCESS)
+    {
+        new SampleSubgraphCallData(m_service, m_cq, m_service_impl);
+        const auto status = m_service_impl.SampleSubgraph(&m_ctx, &m_request, &m_reply);
+        m_status = FINISH;
+        m_responder.Finish(m_reply, status, this);
+    }
+    else
+    {
+        GPR_ASSERT(m_status == FINISH);
+        delete this;
+    }
+}
+
+RandomWalkCallData::RandomWalkCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                                       snark::GraphEngine::Service &service_impl)
+    : CallData(cq), m_responder(&m_ctx), m_service_impl(service_impl), m_service(service)
+{
+    Proceed();
+}
+
+void RandomWalkCallData::Proceed()
+{
+    if (m_status == CREATE)
+    {
+        m_status = PROCESS;
+        m_service.RequestRandomWalk(&m_ctx, &m_request, &m_responder, &m_cq, &m_cq, this);
+    }
+    else if (m_status == PROCESS)
+    {
+        new RandomWalkCallData(m_service, m_cq, m_service_impl);
+        const auto status = m_service_impl.RandomWalk(&m_ctx, &m_request, &m_reply);
+        m_status = FINISH;
+        m_responder.Finish(m_reply, status, this);
+    }
+    else
+    {
+        GPR_ASSERT(m_status == FINISH);
+        delete this;
+    }
+}
+
+NeighborCandidatesCallData::NeighborCandidatesCallData(GraphEngine::AsyncService &service,
+                                                       grpc::ServerCompletionQueue &cq,
+                                                       snark::GraphEngine::Service &service_impl)
+    : CallData(cq), m_responder(&m_ctx), m_service_impl(service_impl), m_service(service)
+{
+    Proceed();
+}
+
+void NeighborCandidatesCallData::Proceed()
+{
+    if (m_status == CREATE)
+    {
+        m_status = PROCESS;
+        m_service.RequestGetNeighborCandidates(&m_ctx, &m_request, &m_responder, &m_cq, &m_cq, this);
+    }
+    else if (m_status == PROCESS)
+    {
+        new NeighborCandidatesCallData(m_service, m_cq, m_service_impl);
+        const auto status = m_service_impl.GetNeighborCandidates(&m_ctx, &m_request, &m_reply);
+        m_status = FINISH;
+        m_responder.Finish(m_reply, status, this);
+    }
+    else
+    {
+        GPR_ASSERT(m_status == FINISH);
+        delete this;
+    }
+}
+
 CreateSamplerCallData::CreateSamplerCallData(GraphSampler::AsyncService &service, grpc::ServerCompletionQueue &cq,
                                              snark::GraphSampler::Service &service_impl)
     : CallData(cq), m_responder(&m_ctx), m_service_impl(service_impl), m_service(service)
@@ -243,6 +354,69 @@ void SampleElementsCallData::Proceed()
     }
 }
 
+SampleStreamCallData::SampleStreamCallData(GraphSampler::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                                           snark::GraphSampler::Service &service_impl)
+    : CallData(cq), m_writer(&m_ctx), m_service_impl(service_impl), m_service(service)
+{
+    Proceed();
+}
+
+void SampleStreamCallData::Proceed()
+{
+    if (m_status == CREATE)
+    {
+        m_status = PROCESS;
+        m_service.RequestSampleStream(&m_ctx, &m_request, &m_writer, &m_cq, &m_cq, this);
+    }
+    else if (m_status == PROCESS)
+    {
+        if (m_batch == 0)
+        {
+            new SampleStreamCallData(m_service, m_cq, m_service_impl);
+            m_counts.resize(m_request.sampler_ids_size());
+            m_seeds.resize(m_request.sampler_ids_size());
+        }
+        if (m_request.shard() >= m_counts.size() || m_request.weights_size() != m_request.sampler_ids_size())
+        {
+            m_status = FINISH;
+            m_writer.Finish(grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid shard for a sample stream"),
+                            this);
+            return;
+        }
+        if (m_request.batches() > 0 && m_batch == m_request.batches())
+        {
+            m_status = FINISH;
+            m_writer.Finish(grpc::Status::OK, this);
+            return;
+        }
+
+        SplitSampleBatch(m_request.is_edge(), m_request.seed() + m_batch, m_request.count(),
+                         std::span(m_request.sampler_ids().data(), m_request.sampler_ids_size()),
+                         std::span(m_request.weights().data(), m_request.weights_size()), m_counts, m_seeds);
+        SampleRequest request;
+        request.set_sampler_id(m_request.sampler_ids(m_request.shard()));
+        request.set_seed(m_seeds[m_request.shard()]);
+        request.set_count(m_counts[m_request.shard()]);
+        request.set_is_edge(m_request.is_edge());
+        m_reply.Clear();
+        const auto status = m_service_impl.Sample(&m_ctx, &request, &m_reply);
+        if (!status.ok())
+        {
+            m_status = FINISH;
+            m_writer.Finish(status, this);
+            return;
+        }
+
+        ++m_batch;
+        m_writer.Write(m_reply, this);
+    }
+    else
+    {
+        GPR_ASSERT(m_status == FINISH);
+        delete this;
+    }
+}
+
 GetMetadataCallData::GetMetadataCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
                                          snark::GraphEngine::Service &service_impl)
     : CallData(cq), m_responder(&m_ctx), m_service_impl(service_impl), m_service(service)
@@ -299,6 +473,62 @@ void NodeTypesCallData::Proceed()
     }
 }
 
+NodeIdsCallData::NodeIdsCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                                 snark::GraphEngine::Service &service_impl)
+    : CallData(cq), m_responder(&m_ctx), m_service_impl(service_impl), m_service(service)
+{
+    Proceed();
+}
+
+void NodeIdsCallData::Proceed()
+{
+    if (m_status == CREATE)
+    {
+        m_status = PROCESS;
+        m_service.RequestGetNodeIds(&m_ctx, &m_request, &m_responder, &m_cq, &m_cq, this);
+    }
+    else if (m_status == PROCESS)
+    {
+        new NodeIdsCallData(m_service, m_cq, m_service_impl);
+        const auto status = m_service_impl.GetNodeIds(&m_ctx, &m_request, &m_reply);
+        m_status = FINISH;
+        m_responder.Finish(m_reply, status, this);
+    }
+    else
+    {
+        GPR_ASSERT(m_status == FINISH);
+        delete this;
+    }
+}
+
+GetStatsCallData::GetStatsCallData(GraphEngineAsyncService &service, grpc::ServerCompletionQueue &cq,
+                                   const ServerMetrics &metrics)
+    : CallData(cq), m_responder(&m_ctx), m_metrics(metrics), m_service(service)
+{
+    Proceed();
+}
+
+void GetStatsCallData::Proceed()
+{
+    if (m_status == CREATE)
+    {
+        m_status = PROCESS;
+        m_service.RequestGetStats(&m_ctx, &m_request, &m_responder, &m_cq, &m_cq, this);
+    }
+    else if (m_status == PROCESS)
+    {
+        new GetStatsCallData(m_service, m_cq, m_metrics);
+        m_metrics.Snapshot(m_reply);
+        m_status = FINISH;
+        m_responder.Finish(m_reply, grpc::Status::OK, this);
+    }
+    else
+    {
+        GPR_ASSERT(m_status == FINISH);
+        delete this;
+    }
+}
+
 NodeSparseFeaturesCallData::NodeSparseFeaturesCallData(GraphEngine::AsyncService &service,
                                                        grpc::ServerCompletionQueue &cq,
                                                        snark::GraphEngine::Service &service_impl)
@@ -9,6 +9,7 @@
 
 #include "src/cc/lib/distributed/graph_engine.h"
 #include "src/cc/lib/distributed/graph_sampler.h"
+#include "src/cc/lib/distributed/metrics.h"
 #include "src/cc/lib/distributed/service.grpc.pb.h"
 
 #include <grpc/grpc.h>
@@ -26,6 +27,9 @@ class CallData
     virtual void Proceed() = 0;
     virtual ~CallData() = default;
 
+    // Reply was sent and the next Proceed call deletes the object.
+    bool Finished() const;
+
   protected:
     grpc::ServerCompletionQueue &m_cq;
     grpc::ServerContext m_ctx;
@@ -39,20 +43,23 @@ class CallData
     CallStatus m_status;
 };
 
+// Node features are handled as raw buffers: replies of GraphEngineServiceImpl are written without an intermediate
+// protobuf message, other implementations are serialized as usual.
 class NodeFeaturesCallData final : public CallData
 {
   public:
-    NodeFeaturesCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+    NodeFeaturesCallData(GraphEngineAsyncService &service, grpc::ServerCompletionQueue &cq,
                          snark::GraphEngine::Service &service_impl);
 
     void Proceed() override;
 
   private:
-    NodeFeaturesRequest m_request;
-    NodeFeaturesReply m_reply;
-    grpc::ServerAsyncResponseWriter<NodeFeaturesReply> m_responder;
+    grpc::ByteBuffer m_request;
+    grpc::ByteBuffer m_reply;
+    grpc::ServerAsyncResponseWriter<grpc::ByteBuffer> m_responder;
     snark::GraphEngine::Service &m_service_impl;
-    GraphEngine::AsyncService &m_service;
+    snark::GraphEngineServiceImpl *m_raw_service_impl;
+    GraphEngineAsyncService &m_service;
 };
 
 class EdgeFeaturesCallData final : public CallData
@@ -135,6 +142,54 @@ class UniformSampleNeighborsCallData final : public CallData
     GraphEngine::AsyncService &m_service;
 };
 
+class SampleSubgraphCallData final : public CallData
+{
+  public:
+    SampleSubgraphCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                           snark::GraphEngine::Service &service_impl);
+
+    void Proceed() override;
+
+  private:
+    SampleSubgraphRequest m_request;
+    SampleSubgraphReply m_reply;
+    grpc::ServerAsyncResponseWriter<SampleSubgraphReply> m_responder;
+    snark::GraphEngine::Service &m_service_impl;
+    GraphEngine::AsyncService &m_service;
+};
+
+class RandomWalkCallData final : public CallData
+{
+  public:
+    RandomWalkCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                       snark::GraphEngine::Service &service_impl);
+
+    void Proceed() override;
+
+  private:
+    RandomWalkRequest m_request;
+    RandomWalkReply m_reply;
+    grpc::ServerAsyncResponseWriter<RandomWalkReply> m_responder;
+    snark::GraphEngine::Service &m_service_impl;
+    GraphEngine::AsyncService &m_service;
+};
+
+class NeighborCandidatesCallData final : public CallData
+{
+  public:
+    NeighborCandidatesCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                               snark::GraphEngine::Service &service_impl);
+
+    void Proceed() override;
+
+  private:
+    NeighborCandidatesRequest m_request;
+    NeighborCandidatesReply m_reply;
+    grpc::ServerAsyncResponseWriter<NeighborCandidatesReply> m_responder;
+    snark::GraphEngine::Service &m_service_impl;
+    GraphEngine::AsyncService &m_service;
+};
+
 class CreateSamplerCallData final : public CallData
 {
   public:
@@ -167,6 +222,27 @@ class SampleElementsCallData final : public CallData
     GraphSampler::AsyncService &m_service;
 };
 
+// Server side of a sampling stream: every completed write produces the next batch until the requested number of
+// batches is written or the client cancels the call.
+class SampleStreamCallData final : public CallData
+{
+  public:
+    SampleStreamCallData(GraphSampler::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                         snark::GraphSampler::Service &service_impl);
+
+    void Proceed() override;
+
+  private:
+    SampleStreamRequest m_request;
+    SampleReply m_reply;
+    grpc::ServerAsyncWriter<SampleReply> m_writer;
+    snark::GraphSampler::Service &m_service_impl;
+    GraphSampler::AsyncService &m_service;
+    uint64_t m_batch = 0;
+    std::vector<size_t> m_counts;
+    std::vector<int64_t> m_seeds;
+};
+
 class GetMetadataCallData final : public CallData
 {
   public:
@@ -199,6 +275,37 @@ class NodeTypesCallData final : public CallData
     GraphEngine::AsyncService &m_service;
 };
 
+class NodeIdsCallData final : public CallData
+{
+  public:
+    NodeIdsCallData(GraphEngine::AsyncService &service, grpc::ServerCompletionQueue &cq,
+                    snark::GraphEngine::Service &service_impl);
+
+    void Proceed() override;
+
+  private:
+    NodeIdsRequest m_request;
+    NodeIdsReply m_reply;
+    grpc::ServerAsyncResponseWriter<NodeIdsReply> m_responder;
+    snark::GraphEngine::Service &m_service_impl;
+    GraphEngine::AsyncService &m_service;
+};
+
+class GetStatsCallData final : public CallData
+{
+  public:
+    GetStatsCallData(GraphEngineAsyncService &service, grpc::ServerCompletionQueue &cq, const ServerMetrics &metrics);
+
+    void Proceed() override;
+
+  private:
+    EmptyMessage m_request;
+    StatsReply m_reply;
+    grpc::ServerAsyncResponseWriter<StatsReply> m_responder;
+    const ServerMetrics &m_metrics;
+    GraphEngineAsyncService &m_service;
+};
+
 class NodeSparseFeaturesCallData final : public CallData
 {
   public:
@@ -6,17 +6,27 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdio>
+#include <deque>
 #include <exception>
 #include <functional>
 #include <future>
 #include <limits>
 #include <numeric>
+#include <optional>
+#include <queue>
 #include <random>
+#include <stdexcept>
 #include <thread>
+#include <tuple>
 #include <type_traits>
 
 #include "src/cc/lib/distributed/call_data.h"
+#include "src/cc/lib/distributed/feature_encoding.h"
+#include "src/cc/lib/distributed/graph_engine.h"
+#include "src/cc/lib/graph/negative_sampling.h"
+#include "src/cc/lib/graph/random_walk.h"
 #include "src/cc/lib/graph/xoroshiro.h"
 
 // Use raw log to avoid possible initialization conflicts with glog from other libraries.
@@ -26,28 +36,340 @@
 #include "boost/random/binomial_distribution.hpp"
 #include "boost/random/uniform_int_distribution.hpp"
 #include "boost/random/uniform_real_distribution.hpp"
+#include <grpcpp/alarm.h>
 #include <grpcpp/client_context.h>
 #include <grpcpp/create_channel.h>
+#include <grpcpp/support/byte_buffer.h>
 
 namespace
 {
-using grpc::ClientContext;
-using grpc::Status;
-// Client queue item with information about request.
-struct AsyncClientCall
+// Client queue item, every operation added to client completion queues is a tag.
+struct CompletionTag
+{
+    virtual ~CompletionTag() = default;
+
+    // Process a finished operation, ok is false only for cancelled alarms.
+    virtual void Complete(bool ok) = 0;
+};
+
+// Parse a reply received as a raw buffer, empty messages might arrive without a buffer.
+void parse_reply(grpc::ByteBuffer &buffer, google::protobuf::MessageLite &reply)
+{
+    if (!buffer.Valid())
+    {
+        reply.Clear();
+        return;
+    }
+
+    const auto status = grpc::SerializationTraits<google::protobuf::MessageLite>::Deserialize(&buffer, &reply);
+    if (!status.ok())
+    {
+        throw std::runtime_error("Failed to parse reply: " + status.error_message());
+    }
+}
+
+std::vector<std::vector<std::shared_ptr<grpc::Channel>>> single_replica_shards(
+    std::vector<std::shared_ptr<grpc::Channel>> channels)
+{
+    std::vector<std::vector<std::shared_ptr<grpc::Channel>>> shards;
+    shards.reserve(channels.size());
+    for (auto &c : channels)
+    {
+        shards.emplace_back(1, std::move(c));
+    }
+
+    return shards;
+}
+
+// Split of a request batch between shards. Without a routing index every shard receives the full batch, otherwise
+// shards receive only nodes they own and nodes missing from the index.
+class ShardBatches
+{
+  public:
+    ShardBatches(const snark::NodeRoutes &node_shards, std::span<const snark::NodeId> node_ids, size_t shard_count)
+        : m_size(node_ids.size()), m_shard_count(shard_count)
+    {
+        if (node_shards.Empty())
+        {
+            return;
+        }
+
+        m_positions.resize(shard_count);
+        for (size_t position = 0; position < node_ids.size(); ++position)
+        {
+            const auto shard = node_shards.Find(node_ids[position]);
+            if (shard != snark::NodeRoutes::all_shards)
+            {
+                m_positions[shard].emplace_back(position);
+                continue;
+            }
+
+            for (auto &positions : m_positions)
+            {
+                positions.emplace_back(position);
+            }
+        }
+    }
+
+    // Number of shards to send requests to.
+    size_t Count() const
+    {
+        if (m_positions.empty())
+        {
+            return m_shard_count;
+        }
+
+        return std::count_if(std::begin(m_positions), std::end(m_positions),
+                             [](const auto &positions) { return !positions.empty(); });
+    }
+
+    bool Contains(size_t shard) const
+    {
+        return m_positions.empty() || !m_positions[shard].empty();
+    }
+
+    // Number of items sent to a shard.
+    size_t Size(size_t shard) const
+    {
+        return m_positions.empty() ? m_size : m_positions[shard].size();
+    }
+
+    // Position in the original batch of an item from a shard request.
+    size_t Position(size_t shard, size_t index) const
+    {
+        return m_positions.empty() ? index : m_positions[shard][index];
+    }
+
+    // Replace items in a request field with the ones sent to a shard. Full batches are kept intact.
+    // Returns false if shard doesn't own any items and can be skipped.
+    template <typename T, typename Field> bool Select(size_t shard, std::span<const T> items, Field &field) const
+    {
+        if (m_positions.empty())
+        {
+            return true;
+        }
+        if (m_positions[shard].empty())
+        {
+            return false;
+        }
+
+        field.Clear();
+        Append(shard, items, field);
+        return true;
+    }
+
+    // Edges are routed with source nodes, node_ids field contains sources followed by destinations.
+    template <typename EdgeRequest>
+    bool SelectEdges(size_t shard, std::span<const snark::NodeId> edge_src_ids,
+                     std::span<const snark::NodeId> edge_dst_ids, std::span<const snark::Type> edge_types,
+                     EdgeRequest &request) const
+    {
+        if (!Select(shard, edge_src_ids, *request.mutable_node_ids()))
+        {
+            return false;
+        }
+        if (m_positions.empty())
+        {
+            return true;
+        }
+
+        Append(shard, edge_dst_ids, *request.mutable_node_ids());
+        request.clear_types();
+        Append(shard, edge_types, *request.mutable_types());
+        return true;
+    }
+
+  private:
+    template <typename T, typename Field> void Append(size_t shard, std::span<const T> items, Field &field) const
+    {
+        const auto &positions = m_positions[shard];
+        field.Reserve(field.size() + int(positions.size()));
+        for (auto position : positions)
+        {
+            field.AddAlreadyReserved(items[position]);
+        }
+    }
+
+    size_t m_size;
+    size_t m_shard_count;
+    std::vector<std::vector<size_t>> m_positions;
+};
+
+// Sequential reader of a reply split into slices by transport.
+class SliceReader
 {
-    ClientContext context;
+  public:
+    explicit SliceReader(const std::vector<grpc::Slice> &slices) : m_slices(slices)
+    {
+        SkipEmpty();
+    }
+
+    bool Done() const
+    {
+        return m_slice == m_slices.size();
+    }
+
+    // Number of bytes read so far.
+    size_t Consumed() const
+    {
+        return m_consumed;
+    }
+
+    bool ReadVarint(uint64_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && !Done(); shift += 7)
+        {
+            const uint8_t byte = m_slices[m_slice].begin()[m_position];
+            Advance(1);
+            value |= uint64_t(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool Read(uint8_t *output, size_t count)
+    {
+        while (count > 0 && !Done())
+        {
+            const auto &slice = m_slices[m_slice];
+            const size_t step = std::min(count, slice.size() - m_position);
+            output = std::copy_n(slice.begin() + m_position, step, output);
+            count -= step;
+            Advance(step);
+        }
+
+        return count == 0;
+    }
 
-    // Status is shared accross all types of requests
-    Status status;
+  private:
+    void Advance(size_t count)
+    {
+        m_position += count;
+        m_consumed += count;
+        SkipEmpty();
+    }
 
-    // Callback to execute after recieving response from the server.
-    std::function<void()> callback;
+    void SkipEmpty()
+    {
+        while (!Done() && m_position == m_slices[m_slice].size())
+        {
+            ++m_slice;
+            m_position = 0;
+        }
+    }
 
-    // Promise set by the client after executing callback.
-    std::promise<void> promise;
+    const std::vector<grpc::Slice> &m_slices;
+    size_t m_slice = 0;
+    size_t m_position = 0;
+    size_t m_consumed = 0;
 };
 
+// Copy node features from a reply with offsets before feature values straight to the output. Returns false if
+// the reply has a different layout, e.g. it was serialized from a NodeFeaturesReply message.
+bool ScatterNodeFeatures(const grpc::ByteBuffer &reply, std::span<const snark::FeatureMeta> features, size_t fv_size,
+                         size_t shard, const ShardBatches &batches, std::span<uint8_t> output, bool *found)
+{
+    // Empty messages might be received without a buffer.
+    std::vector<grpc::Slice> slices;
+    if (!reply.Valid())
+    {
+        return true;
+    }
+    if (!reply.Dump(&slices).ok())
+    {
+        return false;
+    }
+
+    SliceReader reader(slices);
+    if (reader.Done())
+    {
+        return true;
+    }
+
+    const uint64_t values_tag = (snark::NodeFeaturesReply::kFeatureValuesFieldNumber << 3) | 2;
+    const uint64_t offsets_tag = (snark::NodeFeaturesReply::kOffsetsFieldNumber << 3) | 2;
+    const uint64_t encoding_tag = snark::NodeFeaturesReply::kEncodingFieldNumber << 3;
+    uint64_t tag = 0;
+    uint64_t length = 0;
+    uint64_t encoding = snark::FEATURE_ENCODING_RAW;
+    if (!reader.ReadVarint(tag) || (tag == encoding_tag && (!reader.ReadVarint(encoding) || !reader.ReadVarint(tag))) ||
+        tag != offsets_tag || !reader.ReadVarint(length) || !snark::FeatureEncoding_IsValid(int(encoding)))
+    {
+        return false;
+    }
+
+    std::vector<uint64_t> offsets;
+    const size_t offsets_end = reader.Consumed() + length;
+    while (reader.Consumed() < offsets_end)
+    {
+        if (!reader.ReadVarint(offsets.emplace_back()))
+        {
+            return false;
+        }
+    }
+
+    const auto reply_encoding = snark::FeatureEncoding(encoding);
+    const size_t row_size = snark::EncodedFeaturesSize(reply_encoding, features);
+    length = 0;
+    if (reader.Consumed() != offsets_end ||
+        (!reader.Done() && (!reader.ReadVarint(tag) || tag != values_tag || !reader.ReadVarint(length))) ||
+        length != offsets.size() * row_size)
+    {
+        return false;
+    }
+
+    // Encoded values are read to a buffer and decoded to the output.
+    std::vector<uint8_t> row(reply_encoding == snark::FEATURE_ENCODING_RAW ? 0 : row_size);
+    for (auto offset : offsets)
+    {
+        const auto index = batches.Position(shard, offset);
+        auto *destination = output.data() + fv_size * index;
+        if (!reader.Read(row.empty() ? destination : row.data(), row_size))
+        {
+            return false;
+        }
+        if (!row.empty())
+        {
+            snark::DecodeFeatures(reply_encoding, features, row, std::span(destination, fv_size));
+        }
+        found[index] = true;
+    }
+
+    return reader.Done();
+}
+
+// Copy dense feature values from a parsed reply to positions of their nodes or edges in the output.
+template <typename Reply>
+void copy_feature_values(const Reply &reply, std::span<const snark::FeatureMeta> features, size_t fv_size,
+                         size_t shard, const ShardBatches &batches, std::span<uint8_t> output, bool *found)
+{
+    if (!snark::FeatureEncoding_IsValid(reply.encoding()))
+    {
+        throw std::runtime_error("Unknown feature encoding in a reply: " + std::to_string(reply.encoding()));
+    }
+
+    const size_t row_size = snark::EncodedFeaturesSize(reply.encoding(), features);
+    if (size_t(reply.feature_values().size()) != row_size * reply.offsets().size())
+    {
+        throw std::runtime_error("Feature values in a reply don't match requested features");
+    }
+
+    auto values = reinterpret_cast<const uint8_t *>(reply.feature_values().data());
+    for (auto offset : reply.offsets())
+    {
+        const auto index = batches.Position(shard, offset);
+        snark::DecodeFeatures(reply.encoding(), features, std::span(values, row_size),
+                              output.subspan(fv_size * index, fv_size));
+        values += row_size;
+        found[index] = true;
+    }
+}
+
 // Index to look up feature coordinates to return them in sorted order.
 // shard, index offset, index count, value offset, value count
 using SparseFeatureIndex = std::tuple<size_t, int, int, int, int>;
@@ -59,28 +381,79 @@ void WaitForFutures(std::vector<std::future<void>> &futures)
         f.get();
     }
 }
-void ExtractFeatures(const std::vector<std::vector<SparseFeatureIndex>> &response_index,
-                     const std::vector<snark::SparseFeaturesReply> &replies, std::span<int64_t> out_dimensions,
-                     std::vector<std::vector<int64_t>> &out_indices, std::vector<std::vector<uint8_t>> &out_values,
+
+using CacheKey = std::function<std::tuple<const void *, uint64_t, uint64_t>(size_t)>;
+
+// Copy cached values of count items into the output and return positions of items missing from the cache. Every
+// item has fv_size bytes of values and key(i) returns the storage tag and identifiers of item i in the cache.
+std::vector<size_t> read_cached(snark::FeatureCache &cache, size_t count, size_t fv_size, std::span<uint8_t> output,
+                                const CacheKey &key)
+{
+    std::vector<size_t> missed;
+    for (size_t index = 0; index < count; ++index)
+    {
+        const auto [storage, offset, secondary] = key(index);
+        if (!cache.Get(storage, offset, secondary, output.subspan(index * fv_size, fv_size)))
+        {
+            missed.emplace_back(index);
+        }
+    }
+
+    return missed;
+}
+
+// Copy values fetched for missed items to the output and add them to the cache.
+void write_fetched(snark::FeatureCache &cache, size_t fv_size, std::span<const size_t> missed,
+                   std::span<const uint8_t> fetched, std::span<uint8_t> output, const CacheKey &key)
+{
+    for (size_t position = 0; position < missed.size(); ++position)
+    {
+        const auto values = fetched.subspan(position * fv_size, fv_size);
+        std::copy(std::begin(values), std::end(values), std::begin(output) + missed[position] * fv_size);
+        const auto [storage, offset, secondary] = key(missed[position]);
+        cache.Put(storage, offset, secondary, values);
+    }
+}
+
+// Copy cached values of count items into the output and fetch the rest with fetch(missed positions, missed
+// values), fetched values are added to the cache.
+void fetch_through_cache(snark::FeatureCache &cache, size_t count, size_t fv_size, std::span<uint8_t> output,
+                         const CacheKey &key,
+                         const std::function<void(std::span<const size_t>, std::span<uint8_t>)> &fetch)
+{
+    const auto missed = read_cached(cache, count, fv_size, output, key);
+    if (missed.empty())
+    {
+        return;
+    }
+
+    std::vector<uint8_t> fetched(missed.size() * fv_size);
+    fetch(missed, fetched);
+    write_fetched(cache, fv_size, missed, fetched, output, key);
+}
+void ExtractFeatures(const std::vector<SparseFeatureIndex> &response_index,
+                     const std::vector<snark::SparseFeaturesReply> &replies, snark::SparseFeatureBatch &output,
                      size_t node_count)
 {
-    for (size_t feature_index = 0; feature_index < out_dimensions.size(); ++feature_index)
+    const size_t feature_count = output.FeatureCount();
+    for (size_t feature_index = 0; feature_index < feature_count; ++feature_index)
     {
         for (size_t node_index = 0; node_index < node_count; ++node_index)
         {
             size_t shard;
             int index_start, index_count, value_start, value_count;
             std::tie(shard, index_start, index_count, value_start, value_count) =
-                response_index[node_index][feature_index];
-            if (replies[shard].indices().empty())
+                response_index[node_index * feature_count + feature_index];
+            if (index_count == 0)
             {
                 continue;
             }
-            std::copy_n(std::begin(replies[shard].indices()) + index_start, index_count,
-                        std::back_inserter(out_indices[feature_index]));
-            std::copy_n(std::begin(replies[shard].values()) + value_start, value_count,
-                        std::back_inserter(out_values[feature_index]));
+            output.m_indices.insert(std::end(output.m_indices), std::begin(replies[shard].indices()) + index_start,
+                                    std::begin(replies[shard].indices()) + index_start + index_count);
+            output.m_values.insert(std::end(output.m_values), std::begin(replies[shard].values()) + value_start,
+                                   std::begin(replies[shard].values()) + value_start + value_count);
         }
+        output.EndFeature();
     }
 }
 
@@ -98,39 +471,41 @@ void ExtractStringFeatures(const std::vector<std::pair<size_t, size_t>> &respons
     }
 }
 
-template <typename SparseRequest, typename NextCompletionQueue>
-void GetSparseFeature(const SparseRequest &request,
-                      std::vector<std::unique_ptr<snark::GraphEngine::Stub>> &engine_stubs, size_t input_size,
-                      size_t feature_count, std::span<int64_t> out_dimensions,
-                      std::vector<std::vector<int64_t>> &out_indices, std::vector<std::vector<uint8_t>> &out_values,
-                      NextCompletionQueue next_completion_queue)
+template <typename SparseRequest, typename SelectShard, typename SendRequest>
+void GetSparseFeature(const SparseRequest &request, const ShardBatches &batches, SelectShard select_shard,
+                      size_t shard_count, size_t input_size, snark::SparseFeatureBatch &output,
+                      SendRequest send_request)
 {
     std::vector<std::future<void>> futures;
-    futures.reserve(engine_stubs.size());
-    std::vector<snark::SparseFeaturesReply> replies(engine_stubs.size());
-    std::vector<std::vector<SparseFeatureIndex>> response_index(input_size,
-                                                                std::vector<SparseFeatureIndex>(feature_count));
+    futures.reserve(batches.Count());
+    std::vector<snark::SparseFeaturesReply> replies(shard_count);
+    const size_t feature_count = output.FeatureCount();
+    std::vector<SparseFeatureIndex> response_index(input_size * feature_count);
+    const auto out_dimensions = std::span(output.m_dimensions);
 
-    for (size_t shard = 0; shard < engine_stubs.size(); ++shard)
+    for (size_t shard = 0; shard < shard_count; ++shard)
     {
-        auto *call = new AsyncClientCall();
-        std::unique_ptr<grpc::ClientAsyncResponseReader<snark::SparseFeaturesReply>> response_reader;
+        if (!select_shard(shard))
+        {
+            continue;
+        }
+
+        const char *method = nullptr;
         if constexpr (std::is_same<SparseRequest, snark::NodeSparseFeaturesRequest>::value)
         {
-            response_reader = engine_stubs[shard]->PrepareAsyncGetNodeSparseFeatures(&call->context, request,
-                                                                                     next_completion_queue());
+            method = "/snark.GraphEngine/GetNodeSparseFeatures";
         }
         else if constexpr (std::is_same<SparseRequest, snark::EdgeSparseFeaturesRequest>::value)
         {
-            response_reader = engine_stubs[shard]->PrepareAsyncGetEdgeSparseFeatures(&call->context, request,
-                                                                                     next_completion_queue());
+            method = "/snark.GraphEngine/GetEdgeSparseFeatures";
         }
         else
         {
             throw std::runtime_error("Unknown request type for GetSparseFeature");
         }
 
-        call->callback = [&reply = replies[shard], &response_index, shard, out_dimensions]() {
+        auto callback = [&reply = replies[shard], &response_index, &batches, shard, feature_count,
+                         out_dimensions]() {
             if (reply.indices().empty())
             {
                 return;
@@ -163,62 +538,62 @@ void GetSparseFeature(const SparseRequest &request,
                 for (; node_offset < node_cummulative_count;
                      node_offset += feature_dim, value_offset += value_increment)
                 {
-                    const auto item_index = reply.indices(node_offset);
-                    int64_t count = std::get<2>(response_index[item_index][feature_index]);
-                    if (count == 0)
+                    const auto item_index = batches.Position(shard, reply.indices(node_offset));
+
+                    // Extracted indices should refer to the original batch rather than the shard request.
+                    reply.mutable_indices()->Set(node_offset, item_index);
+                    auto &index = response_index[item_index * feature_count + feature_index];
+                    if (std::get<2>(index) == 0)
                     {
-                        std::get<0>(response_index[item_index][feature_index]) = shard;
-                        std::get<1>(response_index[item_index][feature_index]) = node_offset;
-                        std::get<3>(response_index[item_index][feature_index]) = value_offset;
+                        std::get<0>(index) = shard;
+                        std::get<1>(index) = node_offset;
+                        std::get<3>(index) = value_offset;
                     }
-                    std::get<2>(response_index[item_index][feature_index]) += feature_dim;
-                    std::get<4>(response_index[item_index][feature_index]) += value_increment;
+                    std::get<2>(index) += feature_dim;
+                    std::get<4>(index) += value_increment;
                 }
             }
         };
 
-        // Order is important: call variable can be deleted before futures can be
-        // obtained.
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
+        futures.emplace_back(send_request(shard, method, request, replies[shard], std::move(callback)));
     }
 
     WaitForFutures(futures);
-    ExtractFeatures(response_index, replies, out_dimensions, out_indices, out_values, input_size);
+    ExtractFeatures(response_index, replies, output, input_size);
 }
 
-template <typename SparseRequest, typename NextCompletionQueue>
-void GetStringFeature(const SparseRequest &request,
-                      std::vector<std::unique_ptr<snark::GraphEngine::Stub>> &engine_stubs, size_t input_size,
-                      size_t feature_count, std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_values,
-                      NextCompletionQueue next_completion_queue)
+template <typename SparseRequest, typename SelectShard, typename SendRequest>
+void GetStringFeature(const SparseRequest &request, const ShardBatches &batches, SelectShard select_shard,
+                      size_t shard_count, size_t input_size, size_t feature_count, std::span<int64_t> out_dimensions,
+                      std::vector<uint8_t> &out_values, SendRequest send_request)
 {
     std::vector<std::future<void>> futures;
-    futures.reserve(engine_stubs.size());
-    std::vector<snark::StringFeaturesReply> replies(engine_stubs.size());
+    futures.reserve(batches.Count());
+    std::vector<snark::StringFeaturesReply> replies(shard_count);
     std::vector<std::pair<size_t, size_t>> response_index(input_size * feature_count);
 
-    for (size_t shard = 0; shard < engine_stubs.size(); ++shard)
+    for (size_t shard = 0; shard < shard_count; ++shard)
     {
-        auto *call = new AsyncClientCall();
-        std::unique_ptr<grpc::ClientAsyncResponseReader<snark::StringFeaturesReply>> response_reader;
+        if (!select_shard(shard))
+        {
+            continue;
+        }
+
+        const char *method = nullptr;
         if constexpr (std::is_same<SparseRequest, snark::NodeSparseFeaturesRequest>::value)
         {
-            response_reader = engine_stubs[shard]->PrepareAsyncGetNodeStringFeatures(&call->context, request,
-                                                                                     next_completion_queue());
+            method = "/snark.GraphEngine/GetNodeStringFeatures";
         }
         else if constexpr (std::is_same<SparseRequest, snark::EdgeSparseFeaturesRequest>::value)
         {
-            response_reader = engine_stubs[shard]->PrepareAsyncGetEdgeStringFeatures(&call->context, request,
-                                                                                     next_completion_queue());
+            method = "/snark.GraphEngine/GetEdgeStringFeatures";
         }
         else
         {
             throw std::runtime_error("Unknown request type for GetStringFeature");
         }
 
-        call->callback = [&reply = replies[shard], &response_index, shard, out_dimensions]() {
+        auto callback = [&reply = replies[shard], &response_index, &batches, shard, feature_count, out_dimensions]() {
             if (reply.values().empty())
             {
                 return;
@@ -232,18 +607,17 @@ void GetStringFeature(const SparseRequest &request,
                     continue;
                 }
 
+                const auto position = batches.Position(shard, feature_index / feature_count) * feature_count +
+                                      feature_index % feature_count;
+
                 // it is ok to not to synchronize here, because feature data is the same across shards.
-                response_index[feature_index] = {shard, value_offset};
-                out_dimensions[feature_index] = dim;
+                response_index[position] = {shard, value_offset};
+                out_dimensions[position] = dim;
                 value_offset += dim;
             }
         };
 
-        // Order is important: call variable can be deleted before futures can be
-        // obtained.
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
+        futures.emplace_back(send_request(shard, method, request, replies[shard], std::move(callback)));
     }
 
     WaitForFutures(futures);
@@ -261,194 +635,1224 @@ using grpc::ClientReaderWriter;
 using grpc::ClientWriter;
 using grpc::Status;
 
-GRPCClient::GRPCClient(std::vector<std::shared_ptr<grpc::Channel>> channels, uint32_t num_threads,
-                       uint32_t num_threads_per_cq)
+void ClientRequest::Wait()
 {
-    num_threads = std::max(uint32_t(1), num_threads);
-    num_threads_per_cq = std::max(uint32_t(1), num_threads_per_cq);
-    uint32_t num_cqs = (num_threads + num_threads_per_cq - 1) / num_threads_per_cq;
-    m_completion_queue = std::vector<grpc::CompletionQueue>(num_cqs);
-    for (auto c : channels)
+    std::unique_lock lock(m_mutex);
+    m_finished.wait(lock, [this]() { return m_done; });
+    if (m_error)
     {
-        m_engine_stubs.emplace_back(snark::GraphEngine::NewStub(c));
-        m_sampler_stubs.emplace_back(snark::GraphSampler::NewStub(c));
+        std::rethrow_exception(m_error);
     }
+}
 
-    for (uint32_t i = 0; i < num_threads; ++i)
+bool ClientRequest::Done() const
+{
+    std::lock_guard lock(m_mutex);
+    return m_done;
+}
+
+void ClientRequest::Cancel()
+{
+    std::vector<std::function<void()>> cancels;
     {
-        m_reply_threads.emplace_back(AsyncCompleteRpc(i % m_completion_queue.size()));
+        std::lock_guard lock(m_mutex);
+        if (m_done)
+        {
+            return;
+        }
+
+        m_cancel_requested = true;
+        cancels = m_cancels;
+    }
+
+    for (auto &cancel : cancels)
+    {
+        cancel();
     }
 }
 
-std::function<void()> GRPCClient::AsyncCompleteRpc(size_t index)
+bool ClientRequest::Cancelled() const
 {
-    return [&queue = m_completion_queue[index]]() {
-        void *got_tag;
-        bool ok = false;
+    std::lock_guard lock(m_mutex);
+    return m_done && m_cancel_requested && m_error != nullptr;
+}
 
-        while (queue.Next(&got_tag, &ok))
-        {
-            GPR_ASSERT(ok);
-            auto call = static_cast<AsyncClientCall *>(got_tag);
+void ClientRequest::OnDone(std::function<void(std::exception_ptr)> callback)
+{
+    std::unique_lock lock(m_mutex);
+    if (!m_done)
+    {
+        m_callbacks.emplace_back(std::move(callback));
+        return;
+    }
 
-            if (call->status.ok())
+    const auto error = m_error;
+    lock.unlock();
+    callback(error);
+}
+
+void ClientRequest::Run(std::function<void()> round)
+{
+    Continue({std::move(round)});
+}
+
+void ClientRequest::Continue(std::vector<std::function<void()>> next)
+{
+    while (!next.empty())
+    {
+        for (auto &continuation : next)
+        {
+            try
             {
-                try
-                {
-                    call->callback();
-                    call->promise.set_value();
-                }
-                catch (const std::exception &e)
-                {
-                    RAW_LOG_ERROR("Client failed to process request. Exception: %s", e.what());
-                    call->promise.set_exception(std::current_exception());
-                }
+                continuation();
             }
-            else
+            catch (const std::exception &e)
             {
-                RAW_LOG_ERROR("Request failed, code: %d. Message: %s", call->status.error_code(),
-                              call->status.error_message().c_str());
-                try
-                {
-                    throw std::runtime_error(std::string("Request failed. Message: ") + call->status.error_message());
-                }
-                catch (std::exception &e)
+                RAW_LOG_ERROR("Client failed to process request. Exception: %s", e.what());
+                std::lock_guard lock(m_mutex);
+                if (!m_error)
                 {
-                    call->promise.set_exception(std::current_exception());
+                    m_error = std::current_exception();
                 }
+                break;
             }
+        }
 
-            // Once we're complete, deallocate the call object.
-            delete call;
+        std::unique_lock lock(m_mutex);
+        if (--m_pending > 0)
+        {
+            return;
         }
-    };
+
+        next = Next(lock);
+    }
 }
 
-void GRPCClient::GetNodeType(std::span<const NodeId> node_ids, std::span<Type> output, Type default_type)
+void ClientRequest::Then(std::function<void()> next)
 {
-    assert(node_ids.size() == output.size());
-
-    NodeTypesRequest request;
-    const auto node_len = node_ids.size();
-    *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
-    std::vector<std::future<void>> futures;
-    futures.reserve(m_engine_stubs.size());
-    std::vector<NodeTypesReply> replies(m_engine_stubs.size());
+    std::lock_guard lock(m_mutex);
+    m_next.emplace_back(std::move(next));
+}
 
-    // Vector<bool> is not thread safe for our use case, because it's storage is not contiguous
-    auto found = std::make_unique<bool[]>(node_len);
-    for (size_t shard = 0; shard < m_engine_stubs.size(); ++shard)
+void ClientRequest::Add(std::function<void()> cancel)
+{
+    std::unique_lock lock(m_mutex);
+    ++m_pending;
+    if (!m_cancel_requested)
     {
-        auto *call = new AsyncClientCall();
-
-        auto response_reader =
-            m_engine_stubs[shard]->PrepareAsyncGetNodeTypes(&call->context, request, NextCompletionQueue());
+        m_cancels.emplace_back(std::move(cancel));
+        return;
+    }
 
-        call->callback = [&reply = replies[shard], output, &found]() {
-            if (reply.offsets().empty())
-            {
-                return;
-            }
+    // Requests sent by a continuation running while the request is cancelled.
+    lock.unlock();
+    cancel();
+}
 
-            auto curr_type_reply = std::begin(reply.types());
-            for (auto index : reply.offsets())
-            {
-                output[index] = *curr_type_reply;
-                found[index] = true;
-                ++curr_type_reply;
-            }
-        };
+void ClientRequest::Complete(std::exception_ptr error)
+{
+    std::unique_lock lock(m_mutex);
+    if (error && !m_error)
+    {
+        m_error = std::move(error);
+    }
 
-        // Order is important: call variable can be deleted before futures can be
-        // obtained.
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
+    if (--m_pending > 0)
+    {
+        return;
     }
 
-    WaitForFutures(futures);
-    for (size_t i = 0; i < node_len; ++i)
+    auto next = Next(lock);
+    if (lock.owns_lock())
     {
-        if (!found[i])
-        {
-            output[i] = default_type;
-        }
+        lock.unlock();
+        Continue(std::move(next));
     }
 }
 
-void GRPCClient::GetNodeFeature(std::span<const NodeId> node_ids, std::span<FeatureMeta> features,
-                                std::span<uint8_t> output)
+std::vector<std::function<void()>> ClientRequest::Next(std::unique_lock<std::mutex> &lock)
 {
-    assert(std::accumulate(std::begin(features), std::end(features), size_t(0),
-                           [](size_t val, const auto &f) { return val + f.second; }) *
-               node_ids.size() ==
-           output.size());
+    m_cancels.clear();
+    if (!m_error && m_cancel_requested && !m_next.empty())
+    {
+        m_error = std::make_exception_ptr(std::runtime_error("Request was cancelled"));
+    }
 
-    NodeFeaturesRequest request;
-    const auto node_len = node_ids.size();
-    *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
-    for (const auto &feature : features)
+    std::vector<std::function<void()>> next;
+    next.swap(m_next);
+    if (!m_error && !next.empty())
+    {
+        m_pending = 1;
+        return next;
+    }
+
+    m_done = true;
+    auto callbacks = std::move(m_callbacks);
+    const auto error = m_error;
+    lock.unlock();
+    m_finished.notify_all();
+    for (auto &callback : callbacks)
+    {
+        callback(error);
+    }
+
+    return {};
+}
+
+// Client side of a sampling stream, a reader thread per shard buffers batches pushed by the server.
+class GRPCClient::SampleStream
+{
+  public:
+    SampleStream(bool is_edge, size_t batch_size, size_t prefetch)
+        : m_is_edge(is_edge), m_batch_size(batch_size), m_prefetch(std::max<size_t>(1, prefetch))
+    {
+    }
+
+    void Open(GraphSampler::Stub &stub, const SampleStreamRequest &request)
+    {
+        auto &shard = m_shards.emplace_back(std::make_unique<Shard>());
+        shard->m_reader = stub.SampleStream(&shard->m_context, request);
+        shard->m_thread = std::thread(&SampleStream::Read, this, std::ref(*shard));
+    }
+
+    void Next(std::span<NodeId> out_src_node_ids, std::span<Type> out_types, std::span<NodeId> out_dst_node_ids)
+    {
+        if (out_types.size() != m_batch_size || out_src_node_ids.size() != m_batch_size ||
+            (m_is_edge && out_dst_node_ids.size() != m_batch_size))
+        {
+            throw std::invalid_argument("Output size doesn't match sample stream batch size");
+        }
+
+        // Batches of a stream have to be taken from every shard at once.
+        std::lock_guard next_lock(m_next_mutex);
+        std::vector<SampleReply> replies;
+        {
+            std::unique_lock lock(m_mutex);
+            for (auto &shard : m_shards)
+            {
+                m_batch_ready.wait(lock, [&shard]() { return !shard->m_batches.empty() || shard->m_done; });
+                if (shard->m_batches.empty())
+                {
+                    throw std::runtime_error("Sample stream ended: " + shard->m_status.error_message());
+                }
+
+                replies.emplace_back(std::move(shard->m_batches.front()));
+                shard->m_batches.pop_front();
+            }
+        }
+        m_batch_taken.notify_all();
+
+        size_t position = 0;
+        for (const auto &reply : replies)
+        {
+            const size_t count = reply.types_size();
+            if (position + count > m_batch_size)
+            {
+                throw std::runtime_error("Sample stream batch is larger than requested");
+            }
+
+            std::copy(std::begin(reply.types()), std::end(reply.types()), std::begin(out_types) + position);
+            std::copy_n(std::begin(reply.node_ids()), count, std::begin(out_src_node_ids) + position);
+            if (m_is_edge)
+            {
+                std::copy_n(std::begin(reply.node_ids()) + count, count, std::begin(out_dst_node_ids) + position);
+            }
+            position += count;
+        }
+    }
+
+    ~SampleStream()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_closed = true;
+        }
+        m_batch_taken.notify_all();
+        for (auto &shard : m_shards)
+        {
+            shard->m_context.TryCancel();
+        }
+        for (auto &shard : m_shards)
+        {
+            shard->m_thread.join();
+        }
+    }
+
+  private:
+    struct Shard
+    {
+        grpc::ClientContext m_context;
+        std::unique_ptr<grpc::ClientReader<SampleReply>> m_reader;
+        std::deque<SampleReply> m_batches;
+        grpc::Status m_status;
+        bool m_done = false;
+        std::thread m_thread;
+    };
+
+    void Read(Shard &shard)
+    {
+        SampleReply reply;
+        while (shard.m_reader->Read(&reply))
+        {
+            std::unique_lock lock(m_mutex);
+            m_batch_taken.wait(lock, [this, &shard]() { return m_closed || shard.m_batches.size() < m_prefetch; });
+            if (m_closed)
+            {
+                break;
+            }
+
+            shard.m_batches.emplace_back(std::move(reply));
+            lock.unlock();
+            m_batch_ready.notify_all();
+        }
+
+        // Cancelled calls have to be drained before finishing.
+        while (shard.m_reader->Read(&reply))
+        {
+        }
+        auto status = shard.m_reader->Finish();
+        {
+            std::lock_guard lock(m_mutex);
+            shard.m_status = std::move(status);
+            shard.m_done = true;
+        }
+        m_batch_ready.notify_all();
+    }
+
+    bool m_is_edge;
+    size_t m_batch_size;
+    size_t m_prefetch;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::mutex m_next_mutex;
+    std::mutex m_mutex;
+    std::condition_variable m_batch_ready;
+    std::condition_variable m_batch_taken;
+    bool m_closed = false;
+};
+
+// Unary request to a shard. If the shard doesn't reply within the hedge delay, the request is sent again to
+// another replica if there is one and the first successful reply is processed, the other attempt is cancelled then.
+// Requests to unavailable replicas are sent to replicas not tried yet. Requests of a client request report their
+// completion to it instead of the future.
+class GRPCClient::UnaryCall : public std::enable_shared_from_this<UnaryCall>
+{
+  public:
+    UnaryCall(GRPCClient &client, size_t shard, size_t replica, size_t *served_by, const char *method,
+              grpc::ByteBuffer request, std::function<void(grpc::ByteBuffer &)> process,
+              std::shared_ptr<ClientRequest> call)
+        : m_client(client), m_shard(shard), m_replica(replica), m_served_by(served_by), m_method(method),
+          m_request(std::move(request)), m_process(std::move(process)), m_call(std::move(call)),
+          m_metrics(client.m_metrics.Get(m_method))
+    {
+    }
+
+    // Cancel attempts in flight and skip hedging and failover, the call completes with a cancelled status.
+    void Cancel()
+    {
+        std::lock_guard lock(m_mutex);
+        m_cancelled = true;
+        for (auto *attempt : m_attempts)
+        {
+            attempt->m_context.TryCancel();
+        }
+    }
+
+    std::future<void> Start()
+    {
+        m_start = std::chrono::steady_clock::now();
+        m_metrics.m_requests.fetch_add(1, std::memory_order_relaxed);
+        const auto &config = m_client.m_call_config;
+        const auto now = std::chrono::system_clock::now();
+        if (config.m_deadline.count() > 0)
+        {
+            m_deadline = now + config.m_deadline;
+        }
+
+        auto future = m_promise.get_future();
+        std::lock_guard lock(m_mutex);
+        Send(false);
+
+        // Hedged requests go to another replica, calls pinned to a replica or to a shard without replicas would
+        // only load the same server twice.
+        if (config.m_hedge_delay.count() > 0 && m_replica == any_replica && m_client.m_replicas[m_shard].size() > 1)
+        {
+            m_timer = new HedgeTimer(shared_from_this());
+            m_timer->m_alarm.Set(m_client.NextCompletionQueue(), now + config.m_hedge_delay,
+                                 static_cast<CompletionTag *>(m_timer));
+        }
+
+        return future;
+    }
+
+  private:
+    struct Attempt final : CompletionTag
+    {
+        Attempt(std::shared_ptr<UnaryCall> call, size_t replica_index, Replica &replica, bool hedged)
+            : m_call(std::move(call)), m_replica_index(replica_index), m_replica(replica), m_hedged(hedged)
+        {
+        }
+
+        void Complete(bool ok) override
+        {
+            m_call->Finish(*this);
+            delete this;
+        }
+
+        std::shared_ptr<UnaryCall> m_call;
+        size_t m_replica_index;
+        Replica &m_replica;
+        bool m_hedged;
+        grpc::ClientContext m_context;
+        grpc::Status m_status;
+        grpc::ByteBuffer m_reply;
+        std::unique_ptr<grpc::GenericClientAsyncResponseReader> m_reader;
+    };
+
+    struct HedgeTimer final : CompletionTag
+    {
+        explicit HedgeTimer(std::shared_ptr<UnaryCall> call) : m_call(std::move(call))
+        {
+        }
+
+        void Complete(bool ok) override
+        {
+            m_call->Hedge(ok);
+            delete this;
+        }
+
+        std::shared_ptr<UnaryCall> m_call;
+        grpc::Alarm m_alarm;
+    };
+
+    // Has to be called with the mutex locked.
+    void Send(bool hedged)
+    {
+        const size_t replica_index = m_replica == any_replica ? m_client.PickReplica(m_shard, m_tried) : m_replica;
+        m_tried.emplace_back(replica_index);
+        auto &replica = *m_client.m_replicas[m_shard][replica_index];
+        auto *attempt = new Attempt(shared_from_this(), replica_index, replica, hedged);
+        if (m_deadline)
+        {
+            attempt->m_context.set_deadline(*m_deadline);
+        }
+
+        attempt->m_reader =
+            replica.m_stub->PrepareUnaryCall(&attempt->m_context, m_method, m_request, m_client.NextCompletionQueue());
+        m_attempts.emplace_back(attempt);
+        ++replica.m_outstanding;
+        ++m_client.m_requests;
+        attempt->m_reader->StartCall();
+        attempt->m_reader->Finish(&attempt->m_reply, &attempt->m_status, static_cast<CompletionTag *>(attempt));
+        if (m_cancelled)
+        {
+            attempt->m_context.TryCancel();
+        }
+    }
+
+    void Hedge(bool ok)
+    {
+        std::lock_guard lock(m_mutex);
+        m_timer = nullptr;
+        if (ok && !m_done && !m_cancelled)
+        {
+            ++m_client.m_hedged;
+            Send(true);
+        }
+    }
+
+    void Finish(Attempt &attempt)
+    {
+        --attempt.m_replica.m_outstanding;
+        const bool unavailable = attempt.m_status.error_code() == grpc::StatusCode::UNAVAILABLE;
+        if (unavailable)
+        {
+            const auto backoff = std::chrono::steady_clock::now() + m_client.m_call_config.m_replica_backoff;
+            attempt.m_replica.m_down_until = backoff.time_since_epoch().count();
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_attempts.erase(std::find(std::begin(m_attempts), std::end(m_attempts), &attempt));
+            if (m_done)
+            {
+                return;
+            }
+
+            // Wait for the other attempt if this one failed.
+            if (!attempt.m_status.ok() && !m_attempts.empty())
+            {
+                return;
+            }
+
+            if (unavailable && !m_cancelled && m_replica == any_replica &&
+                m_tried.size() < m_client.m_replicas[m_shard].size())
+            {
+                ++m_client.m_failovers;
+                Send(false);
+                return;
+            }
+
+            m_done = true;
+            for (auto *other : m_attempts)
+            {
+                other->m_context.TryCancel();
+            }
+            if (m_timer != nullptr)
+            {
+                m_timer->m_alarm.Cancel();
+            }
+        }
+
+        m_metrics.m_stages[size_t(RequestStage::roundtrip)].Record(std::chrono::steady_clock::now() - m_start);
+
+        if (!attempt.m_status.ok())
+        {
+            if (attempt.m_status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED)
+            {
+                ++m_client.m_deadline_exceeded;
+            }
+            else
+            {
+                ++m_client.m_failed;
+            }
+
+            RAW_LOG_ERROR("Request failed, code: %d. Message: %s", attempt.m_status.error_code(),
+                          attempt.m_status.error_message().c_str());
+            Resolve(std::make_exception_ptr(
+                std::runtime_error(std::string("Request failed. Message: ") + attempt.m_status.error_message())));
+            return;
+        }
+
+        if (attempt.m_hedged)
+        {
+            ++m_client.m_hedge_wins;
+        }
+        const auto &trailers = attempt.m_context.GetServerTrailingMetadata();
+        if (auto version = trailers.find(engine_version_key); version != std::end(trailers))
+        {
+            m_client.ObserveEngineVersion(attempt.m_replica,
+                                          std::stoull(std::string(version->second.data(), version->second.size())));
+        }
+        if (m_served_by != nullptr)
+        {
+            *m_served_by = attempt.m_replica_index;
+        }
+        m_metrics.m_bytes.fetch_add(attempt.m_reply.Length(), std::memory_order_relaxed);
+        try
+        {
+            m_process(attempt.m_reply);
+        }
+        catch (const std::exception &e)
+        {
+            RAW_LOG_ERROR("Client failed to process request. Exception: %s", e.what());
+            Resolve(std::current_exception());
+            return;
+        }
+
+        Resolve(nullptr);
+    }
+
+    void Resolve(std::exception_ptr error)
+    {
+        if (m_call != nullptr)
+        {
+            m_call->Complete(std::move(error));
+        }
+        else if (error)
+        {
+            m_promise.set_exception(std::move(error));
+        }
+        else
+        {
+            m_promise.set_value();
+        }
+    }
+
+    GRPCClient &m_client;
+    size_t m_shard;
+    size_t m_replica;
+    size_t *m_served_by;
+    std::string m_method;
+    grpc::ByteBuffer m_request;
+    std::function<void(grpc::ByteBuffer &)> m_process;
+    std::shared_ptr<ClientRequest> m_call;
+    MethodMetrics &m_metrics;
+    std::chrono::steady_clock::time_point m_start;
+    std::promise<void> m_promise;
+    std::optional<std::chrono::system_clock::time_point> m_deadline;
+
+    std::mutex m_mutex;
+    std::vector<Attempt *> m_attempts;
+    std::vector<size_t> m_tried;
+    HedgeTimer *m_timer = nullptr;
+    bool m_done = false;
+    bool m_cancelled = false;
+};
+
+// Node feature lookups of concurrent callers merged into one. The first caller waits for others to join during the
+// coalescing window, fetches features of unique nodes and copies them to outputs of every caller.
+class GRPCClient::FeatureBatch
+{
+  public:
+    // Add caller nodes to the batch and return the number of unique nodes in it.
+    size_t Add(std::span<const NodeId> node_ids, std::span<uint8_t> output)
+    {
+        auto &caller = m_callers.emplace_back(Caller{.m_output = output});
+        caller.m_positions.reserve(node_ids.size());
+        for (auto node : node_ids)
+        {
+            auto [position, inserted] = m_positions.try_emplace(node, m_node_ids.size());
+            if (inserted)
+            {
+                m_node_ids.emplace_back(node);
+            }
+            caller.m_positions.emplace_back(position->second);
+        }
+
+        return m_node_ids.size();
+    }
+
+    void Fetch(GRPCClient &client, std::span<FeatureMeta> features, size_t fv_size, FeatureEncoding encoding)
+    {
+        std::vector<uint8_t> values(fv_size * m_node_ids.size());
+        try
+        {
+            client.FetchNodeFeature(m_node_ids, features, values, encoding);
+        }
+        catch (const std::exception &e)
+        {
+            m_error = std::current_exception();
+            return;
+        }
+
+        for (auto &caller : m_callers)
+        {
+            auto output = std::begin(caller.m_output);
+            for (auto position : caller.m_positions)
+            {
+                output = std::copy_n(std::begin(values) + fv_size * position, fv_size, output);
+            }
+        }
+    }
+
+    std::condition_variable m_full;
+    std::condition_variable m_fetched;
+    bool m_closed = false;
+    bool m_done = false;
+    std::exception_ptr m_error;
+
+  private:
+    struct Caller
+    {
+        std::span<uint8_t> m_output;
+        std::vector<size_t> m_positions;
+    };
+
+    std::vector<NodeId> m_node_ids;
+    absl::flat_hash_map<NodeId, size_t> m_positions;
+    std::vector<Caller> m_callers;
+};
+
+GRPCClient::GRPCClient(std::vector<std::shared_ptr<grpc::Channel>> channels, uint32_t num_threads,
+                       uint32_t num_threads_per_cq, ClientCallConfig call_config)
+    : GRPCClient(single_replica_shards(std::move(channels)), num_threads, num_threads_per_cq, call_config)
+{
+}
+
+GRPCClient::GRPCClient(std::vector<std::vector<std::shared_ptr<grpc::Channel>>> shards, uint32_t num_threads,
+                       uint32_t num_threads_per_cq, ClientCallConfig call_config)
+    : m_call_config(call_config)
+{
+    num_threads = std::max(uint32_t(1), num_threads);
+    num_threads_per_cq = std::max(uint32_t(1), num_threads_per_cq);
+    uint32_t num_cqs = (num_threads + num_threads_per_cq - 1) / num_threads_per_cq;
+    m_completion_queue = std::vector<grpc::CompletionQueue>(num_cqs);
+    for (auto &channels : shards)
+    {
+        if (channels.empty())
+        {
+            throw std::invalid_argument("Every shard needs at least one replica");
+        }
+
+        auto &replicas = m_replicas.emplace_back();
+        for (auto &c : channels)
+        {
+            auto &replica = replicas.emplace_back(std::make_unique<Replica>());
+            replica->m_stub = std::make_unique<grpc::GenericStub>(c);
+            replica->m_sampler_stub = snark::GraphSampler::NewStub(c);
+        }
+    }
+
+    if (m_call_config.m_feature_cache_size > 0)
+    {
+        m_feature_cache =
+            std::make_unique<FeatureCache>(m_call_config.m_feature_cache_size, FeatureCacheConfig{}.m_shard_count);
+    }
+
+    for (uint32_t i = 0; i < num_threads; ++i)
+    {
+        m_reply_threads.emplace_back(AsyncCompleteRpc(i % m_completion_queue.size()));
+    }
+}
+
+std::function<void()> GRPCClient::AsyncCompleteRpc(size_t index)
+{
+    return [&queue = m_completion_queue[index]]() {
+        void *got_tag;
+        bool ok = false;
+
+        while (queue.Next(&got_tag, &ok))
+        {
+            static_cast<CompletionTag *>(got_tag)->Complete(ok);
+        }
+    };
+}
+
+std::shared_ptr<GRPCClient::UnaryCall> GRPCClient::NewCall(size_t shard, const char *method,
+                                                           const google::protobuf::MessageLite &request,
+                                                           std::function<void(grpc::ByteBuffer &)> process,
+                                                           size_t replica, size_t *served_by,
+                                                           std::shared_ptr<ClientRequest> call)
+{
+    grpc::ByteBuffer buffer;
+    bool own_buffer = false;
+    const auto status =
+        grpc::SerializationTraits<google::protobuf::MessageLite>::Serialize(request, &buffer, &own_buffer);
+    if (!status.ok())
+    {
+        throw std::runtime_error("Failed to serialize request: " + status.error_message());
+    }
+
+    return std::make_shared<UnaryCall>(*this, shard, replica, served_by, method, std::move(buffer), std::move(process),
+                                       std::move(call));
+}
+
+std::future<void> GRPCClient::SendRequest(size_t shard, const char *method,
+                                          const google::protobuf::MessageLite &request,
+                                          std::function<void(grpc::ByteBuffer &)> process, size_t replica,
+                                          size_t *served_by)
+{
+    return NewCall(shard, method, request, std::move(process), replica, served_by, nullptr)->Start();
+}
+
+template <typename Reply>
+std::future<void> GRPCClient::SendRequest(size_t shard, const char *method,
+                                          const google::protobuf::MessageLite &request, Reply &reply,
+                                          std::function<void()> callback, size_t replica, size_t *served_by)
+{
+    return SendRequest(
+        shard, method, request,
+        [&reply, callback = std::move(callback)](grpc::ByteBuffer &buffer) {
+            parse_reply(buffer, reply);
+            callback();
+        },
+        replica, served_by);
+}
+
+void GRPCClient::SendRequest(ClientRequest &call, size_t shard, const char *method,
+                             const google::protobuf::MessageLite &request,
+                             std::function<void(grpc::ByteBuffer &)> process, size_t replica)
+{
+    auto unary = NewCall(shard, method, request, std::move(process), replica, nullptr, call.shared_from_this());
+    call.Add([weak = std::weak_ptr<UnaryCall>(unary)]() {
+        if (auto unary = weak.lock())
+        {
+            unary->Cancel();
+        }
+    });
+    unary->Start();
+}
+
+template <typename Reply>
+void GRPCClient::SendRequest(ClientRequest &call, size_t shard, const char *method,
+                             const google::protobuf::MessageLite &request, Reply &reply,
+                             std::function<void()> callback, size_t replica)
+{
+    SendRequest(
+        call, shard, method, request,
+        [&reply, callback = std::move(callback)](grpc::ByteBuffer &buffer) {
+            parse_reply(buffer, reply);
+            callback();
+        },
+        replica);
+}
+
+std::shared_ptr<ClientRequest> GRPCClient::StartRequest(const std::function<void(ClientRequest &)> &method)
+{
+    auto request = std::make_shared<ClientRequest>();
+    request->Run([&request = *request, &method]() { method(request); });
+    return request;
+}
+
+size_t GRPCClient::PickReplica(size_t shard, std::span<const size_t> excluded)
+{
+    const auto &replicas = m_replicas[shard];
+    if (replicas.size() == 1)
+    {
+        return 0;
+    }
+
+    const int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+    std::vector<size_t> candidates;
+    for (size_t replica = 0; replica < replicas.size(); ++replica)
+    {
+        if (replicas[replica]->m_down_until <= now &&
+            std::find(std::begin(excluded), std::end(excluded), replica) == std::end(excluded))
+        {
+            candidates.emplace_back(replica);
+        }
+    }
+
+    // Prefer replicas that weren't tried yet even if they are down, they might be back.
+    if (candidates.empty())
+    {
+        for (size_t replica = 0; replica < replicas.size(); ++replica)
+        {
+            if (std::find(std::begin(excluded), std::end(excluded), replica) == std::end(excluded))
+            {
+                candidates.emplace_back(replica);
+            }
+        }
+    }
+    if (candidates.empty())
+    {
+        candidates.resize(replicas.size());
+        std::iota(std::begin(candidates), std::end(candidates), 0);
+    }
+    if (candidates.size() == 1)
+    {
+        return candidates.front();
+    }
+
+    thread_local snark::Xoroshiro128PlusGenerator engine(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    const size_t first = boost::random::uniform_int_distribution<size_t>(0, candidates.size() - 1)(engine);
+    const size_t offset = boost::random::uniform_int_distribution<size_t>(1, candidates.size() - 1)(engine);
+    const size_t first_replica = candidates[first];
+    const size_t second_replica = candidates[(first + offset) % candidates.size()];
+    return replicas[first_replica]->m_outstanding <= replicas[second_replica]->m_outstanding ? first_replica
+                                                                                             : second_replica;
+}
+
+ClientCallStats GRPCClient::CallStats() const
+{
+    ClientCallStats stats;
+    for (const auto &replicas : m_replicas)
+    {
+        size_t outstanding = 0;
+        for (const auto &replica : replicas)
+        {
+            outstanding += replica->m_outstanding;
+        }
+        stats.m_outstanding.emplace_back(outstanding);
+    }
+    stats.m_requests = m_requests;
+    stats.m_hedged = m_hedged;
+    stats.m_hedge_wins = m_hedge_wins;
+    stats.m_failovers = m_failovers;
+    stats.m_coalesced = m_coalesced;
+    stats.m_deadline_exceeded = m_deadline_exceeded;
+    stats.m_failed = m_failed;
+    if (m_feature_cache != nullptr)
+    {
+        stats.m_feature_cache_hits = m_feature_cache->Hits();
+        stats.m_feature_cache_misses = m_feature_cache->Misses();
+    }
+    return stats;
+}
+
+StatsReply GRPCClient::LatencyStats() const
+{
+    StatsReply stats;
+    m_metrics.Snapshot(stats);
+    return stats;
+}
+
+std::vector<std::vector<StatsReply>> GRPCClient::ServerStats()
+{
+    EmptyMessage request;
+    std::vector<std::future<void>> futures;
+    std::vector<std::vector<StatsReply>> replies(m_replicas.size());
+    for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+    {
+        replies[shard].resize(m_replicas[shard].size());
+        for (size_t replica = 0; replica < m_replicas[shard].size(); ++replica)
+        {
+            futures.emplace_back(SendRequest(shard, "/snark.GraphEngine/GetStats", request, replies[shard][replica],
+                                             []() {}, replica));
+        }
+    }
+
+    WaitForFutures(futures);
+    return replies;
+}
+
+void GRPCClient::GetNodeType(std::span<const NodeId> node_ids, std::span<Type> output, Type default_type)
+{
+    GetNodeTypeAsync(node_ids, output, default_type)->Wait();
+}
+
+std::shared_ptr<ClientRequest> GRPCClient::GetNodeTypeAsync(std::span<const NodeId> node_ids, std::span<Type> output,
+                                                            Type default_type)
+{
+    assert(node_ids.size() == output.size());
+
+    return StartRequest([this, node_ids, output, default_type](ClientRequest &call) {
+        NodeTypesRequest request;
+        const auto node_len = node_ids.size();
+        *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
+        const auto &batches = call.Keep<const ShardBatches>(*Routes(), node_ids, m_replicas.size());
+        auto &replies = call.Keep<std::vector<NodeTypesReply>>(m_replicas.size());
+
+        // Vector<bool> is not thread safe for our use case, because it's storage is not contiguous
+        auto &found = call.Keep<std::unique_ptr<bool[]>>(std::make_unique<bool[]>(node_len));
+        for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+        {
+            if (!batches.Select(shard, node_ids, *request.mutable_node_ids()))
+            {
+                continue;
+            }
+
+            auto callback = [&reply = replies[shard], output, &found, &batches, shard]() {
+                if (reply.offsets().empty())
+                {
+                    return;
+                }
+
+                auto curr_type_reply = std::begin(reply.types());
+                for (auto offset : reply.offsets())
+                {
+                    const auto index = batches.Position(shard, offset);
+                    output[index] = *curr_type_reply;
+                    found[index] = true;
+                    ++curr_type_reply;
+                }
+            };
+
+            SendRequest(call, shard, "/snark.GraphEngine/GetNodeTypes", request, replies[shard], std::move(callback));
+        }
+
+        call.Then([output, &found, node_len, default_type]() {
+            for (size_t i = 0; i < node_len; ++i)
+            {
+                if (!found[i])
+                {
+                    output[i] = default_type;
+                }
+            }
+        });
+    });
+}
+
+void GRPCClient::GetNodeFeature(std::span<const NodeId> node_ids, std::span<FeatureMeta> features,
+                                std::span<uint8_t> output, FeatureEncoding encoding)
+{
+    if (m_feature_cache == nullptr || node_ids.empty() || output.empty())
+    {
+        LookupNodeFeature(node_ids, features, output, encoding);
+        return;
+    }
+
+    std::string key(reinterpret_cast<const char *>(features.data()), features.size_bytes());
+    key.push_back(char(encoding));
+    const auto tag = FeatureCacheTag("n" + key);
+    const size_t fv_size = output.size() / node_ids.size();
+    fetch_through_cache(
+        *m_feature_cache, node_ids.size(), fv_size, output,
+        [node_ids, tag](size_t index) { return std::make_tuple(tag, uint64_t(node_ids[index]), uint64_t(0)); },
+        [this, node_ids, features, encoding](std::span<const size_t> missed, std::span<uint8_t> values) {
+            std::vector<NodeId> missed_ids;
+            missed_ids.reserve(missed.size());
+            for (auto index : missed)
+            {
+                missed_ids.emplace_back(node_ids[index]);
+            }
+            LookupNodeFeature(missed_ids, features, values, encoding);
+        });
+}
+
+std::shared_ptr<ClientRequest> GRPCClient::GetNodeFeatureAsync(std::span<const NodeId> node_ids,
+                                                               std::span<FeatureMeta> features,
+                                                               std::span<uint8_t> output, FeatureEncoding encoding)
+{
+    if (m_feature_cache == nullptr || node_ids.empty() || output.empty())
+    {
+        return StartRequest(
+            [&](ClientRequest &call) { FetchNodeFeature(call, node_ids, features, output, encoding); });
+    }
+
+    std::string key(reinterpret_cast<const char *>(features.data()), features.size_bytes());
+    key.push_back(char(encoding));
+    const auto tag = FeatureCacheTag("n" + key);
+    const size_t fv_size = output.size() / node_ids.size();
+    return StartRequest([&](ClientRequest &call) {
+        const CacheKey cache_key = [node_ids, tag](size_t index) {
+            return std::make_tuple(tag, uint64_t(node_ids[index]), uint64_t(0));
+        };
+        auto &missed =
+            call.Keep<std::vector<size_t>>(read_cached(*m_feature_cache, node_ids.size(), fv_size, output, cache_key));
+        if (missed.empty())
+        {
+            return;
+        }
+
+        auto &missed_ids = call.Keep<std::vector<NodeId>>();
+        missed_ids.reserve(missed.size());
+        for (auto index : missed)
+        {
+            missed_ids.emplace_back(node_ids[index]);
+        }
+
+        auto &fetched = call.Keep<std::vector<uint8_t>>(missed.size() * fv_size);
+        FetchNodeFeature(call, missed_ids, features, fetched, encoding);
+        call.Then([this, &missed, &fetched, fv_size, output, cache_key]() {
+            write_fetched(*m_feature_cache, fv_size, missed, fetched, output, cache_key);
+        });
+    });
+}
+
+void GRPCClient::LookupNodeFeature(std::span<const NodeId> node_ids, std::span<FeatureMeta> features,
+                                   std::span<uint8_t> output, FeatureEncoding encoding)
+{
+    const auto &config = m_call_config;
+    if (config.m_coalesce_window.count() == 0 || node_ids.empty())
+    {
+        FetchNodeFeature(node_ids, features, output, encoding);
+        return;
+    }
+
+    std::string key(reinterpret_cast<const char *>(features.data()), features.size_bytes());
+    key.push_back(char(encoding));
+    std::unique_lock lock(m_feature_batch_mutex);
+    auto &open_batch = m_feature_batches[key];
+    const bool leader = open_batch == nullptr;
+    if (leader)
+    {
+        open_batch = std::make_shared<FeatureBatch>();
+    }
+
+    auto batch = open_batch;
+    if (batch->Add(node_ids, output) >= config.m_coalesce_max_nodes)
+    {
+        batch->m_closed = true;
+        m_feature_batches.erase(key);
+        batch->m_full.notify_one();
+    }
+
+    if (!leader)
+    {
+        ++m_coalesced;
+        batch->m_fetched.wait(lock, [&batch]() { return batch->m_done; });
+        if (batch->m_error)
+        {
+            std::rethrow_exception(batch->m_error);
+        }
+        return;
+    }
+
+    batch->m_full.wait_for(lock, config.m_coalesce_window, [&batch]() { return batch->m_closed; });
+    if (!batch->m_closed)
+    {
+        batch->m_closed = true;
+        m_feature_batches.erase(key);
+    }
+
+    lock.unlock();
+    batch->Fetch(*this, features, output.size() / node_ids.size(), encoding);
+    lock.lock();
+    batch->m_done = true;
+    batch->m_fetched.notify_all();
+    if (batch->m_error)
+    {
+        std::rethrow_exception(batch->m_error);
+    }
+}
+
+void GRPCClient::FetchNodeFeature(std::span<const NodeId> node_ids, std::span<FeatureMeta> features,
+                                  std::span<uint8_t> output, FeatureEncoding encoding)
+{
+    StartRequest([&](ClientRequest &call) { FetchNodeFeature(call, node_ids, features, output, encoding); })->Wait();
+}
+
+void GRPCClient::FetchNodeFeature(ClientRequest &call, std::span<const NodeId> node_ids,
+                                  std::span<FeatureMeta> features, std::span<uint8_t> output,
+                                  FeatureEncoding encoding)
+{
+    assert(std::accumulate(std::begin(features), std::end(features), size_t(0),
+                           [](size_t val, const auto &f) { return val + f.second; }) *
+               node_ids.size() ==
+           output.size());
+
+    NodeFeaturesRequest request;
+    const auto node_len = node_ids.size();
+    *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
+    for (const auto &feature : features)
     {
         auto wire_feature = request.add_features();
         wire_feature->set_id(feature.first);
         wire_feature->set_size(feature.second);
     }
+    request.set_encoding(encoding);
     const size_t fv_size = output.size() / node_len;
-    std::vector<std::future<void>> futures;
-    futures.reserve(m_engine_stubs.size());
-    std::vector<NodeFeaturesReply> replies(m_engine_stubs.size());
+    const auto &batches = call.Keep<const ShardBatches>(*Routes(), node_ids, m_replicas.size());
 
     // Vector<bool> is not thread safe for our use case, because it's storage is not contiguous
-    auto found = std::make_unique<bool[]>(node_len);
-    for (size_t shard = 0; shard < m_engine_stubs.size(); ++shard)
+    auto &found = call.Keep<std::unique_ptr<bool[]>>(std::make_unique<bool[]>(node_len));
+    for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+    {
+        if (!batches.Select(shard, node_ids, *request.mutable_node_ids()))
+        {
+            continue;
+        }
+
+        // Replies are parsed manually to copy feature values from the received slices straight to the output.
+        auto process = [output, features, &found, fv_size, &batches, shard](grpc::ByteBuffer &reply) {
+            if (ScatterNodeFeatures(reply, features, fv_size, shard, batches, output, found.get()))
+            {
+                return;
+            }
+
+            NodeFeaturesReply message;
+            parse_reply(reply, message);
+            copy_feature_values(message, features, fv_size, shard, batches, output, found.get());
+        };
+
+        SendRequest(call, shard, "/snark.GraphEngine/GetNodeFeatures", request, std::move(process));
+    }
+
+    call.Then([output, &found, node_len, fv_size]() {
+        auto values = std::begin(output);
+        for (size_t i = 0; i < node_len; ++i)
+        {
+            if (found[i])
+            {
+                values += fv_size;
+            }
+            else
+            {
+                values = std::fill_n(values, fv_size, 0);
+            }
+        }
+    });
+}
+
+void GRPCClient::GetEdgeFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
+                                std::span<const Type> edge_types, std::span<FeatureMeta> features,
+                                std::span<uint8_t> output, FeatureEncoding encoding)
+{
+    if (m_feature_cache == nullptr || edge_types.empty() || output.empty())
     {
-        auto *call = new AsyncClientCall();
+        FetchEdgeFeature(edge_src_ids, edge_dst_ids, edge_types, features, output, encoding);
+        return;
+    }
 
-        auto response_reader =
-            m_engine_stubs[shard]->PrepareAsyncGetNodeFeatures(&call->context, request, NextCompletionQueue());
+    // Edges are identified by their endpoints in the cache and types are a part of their feature sets.
+    std::string key(reinterpret_cast<const char *>(features.data()), features.size_bytes());
+    key.push_back(char(encoding));
+    absl::flat_hash_map<Type, const void *> tags;
+    for (auto type : edge_types)
+    {
+        if (!tags.contains(type))
+        {
+            tags[type] =
+                FeatureCacheTag("e" + std::string(reinterpret_cast<const char *>(&type), sizeof(type)) + key);
+        }
+    }
 
-        call->callback = [&reply = replies[shard], output, &found, fv_size]() {
-            if (reply.offsets().empty())
+    const size_t fv_size = output.size() / edge_types.size();
+    fetch_through_cache(
+        *m_feature_cache, edge_types.size(), fv_size, output,
+        [edge_src_ids, edge_dst_ids, edge_types, &tags](size_t index) {
+            return std::make_tuple(tags.at(edge_types[index]), uint64_t(edge_src_ids[index]),
+                                   uint64_t(edge_dst_ids[index]));
+        },
+        [&](std::span<const size_t> missed, std::span<uint8_t> values) {
+            std::vector<NodeId> sources, destinations;
+            std::vector<Type> types;
+            for (auto index : missed)
             {
-                return;
+                sources.emplace_back(edge_src_ids[index]);
+                destinations.emplace_back(edge_dst_ids[index]);
+                types.emplace_back(edge_types[index]);
             }
+            FetchEdgeFeature(sources, destinations, types, features, values, encoding);
+        });
+}
+
+std::shared_ptr<ClientRequest> GRPCClient::GetEdgeFeatureAsync(std::span<const NodeId> edge_src_ids,
+                                                               std::span<const NodeId> edge_dst_ids,
+                                                               std::span<const Type> edge_types,
+                                                               std::span<FeatureMeta> features,
+                                                               std::span<uint8_t> output, FeatureEncoding encoding)
+{
+    if (m_feature_cache == nullptr || edge_types.empty() || output.empty())
+    {
+        return StartRequest([&](ClientRequest &call) {
+            FetchEdgeFeature(call, edge_src_ids, edge_dst_ids, edge_types, features, output, encoding);
+        });
+    }
 
-            auto curr_feature_out = std::begin(output);
-            // Use c_str since string iterators can process wide charachters on windows.
-            auto curr_feature_reply = reply.feature_values().c_str();
-            for (auto index : reply.offsets())
+    std::string key(reinterpret_cast<const char *>(features.data()), features.size_bytes());
+    key.push_back(char(encoding));
+    const size_t fv_size = output.size() / edge_types.size();
+    return StartRequest([&](ClientRequest &call) {
+        auto &tags = call.Keep<absl::flat_hash_map<Type, const void *>>();
+        for (auto type : edge_types)
+        {
+            if (!tags.contains(type))
             {
-                std::copy(curr_feature_reply, curr_feature_reply + fv_size, curr_feature_out + fv_size * index);
-                curr_feature_reply += fv_size;
-                found[index] = true;
+                tags[type] =
+                    FeatureCacheTag("e" + std::string(reinterpret_cast<const char *>(&type), sizeof(type)) + key);
             }
-        };
-
-        // Order is important: call variable can be deleted before futures can be
-        // obtained.
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
-    }
+        }
 
-    WaitForFutures(futures);
-    auto values = std::begin(output);
-    for (size_t i = 0; i < node_len; ++i)
-    {
-        if (found[i])
+        const CacheKey cache_key = [edge_src_ids, edge_dst_ids, edge_types, &tags](size_t index) {
+            return std::make_tuple(tags.at(edge_types[index]), uint64_t(edge_src_ids[index]),
+                                   uint64_t(edge_dst_ids[index]));
+        };
+        auto &missed = call.Keep<std::vector<size_t>>(
+            read_cached(*m_feature_cache, edge_types.size(), fv_size, output, cache_key));
+        if (missed.empty())
         {
-            values += fv_size;
+            return;
         }
-        else
+
+        auto &sources = call.Keep<std::vector<NodeId>>();
+        auto &destinations = call.Keep<std::vector<NodeId>>();
+        auto &types = call.Keep<std::vector<Type>>();
+        for (auto index : missed)
         {
-            values = std::fill_n(values, fv_size, 0);
+            sources.emplace_back(edge_src_ids[index]);
+            destinations.emplace_back(edge_dst_ids[index]);
+            types.emplace_back(edge_types[index]);
         }
-    }
+
+        auto &fetched = call.Keep<std::vector<uint8_t>>(missed.size() * fv_size);
+        FetchEdgeFeature(call, sources, destinations, types, features, fetched, encoding);
+        call.Then([this, &missed, &fetched, fv_size, output, cache_key]() {
+            write_fetched(*m_feature_cache, fv_size, missed, fetched, output, cache_key);
+        });
+    });
 }
 
-void GRPCClient::GetEdgeFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
-                                std::span<const Type> edge_types, std::span<FeatureMeta> features,
-                                std::span<uint8_t> output)
+const void *GRPCClient::FeatureCacheTag(std::string key)
+{
+    std::lock_guard lock(m_feature_cache_mutex);
+    return &*m_feature_cache_tags.emplace(std::move(key)).first;
+}
+
+void GRPCClient::FetchEdgeFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
+                                  std::span<const Type> edge_types, std::span<FeatureMeta> features,
+                                  std::span<uint8_t> output, FeatureEncoding encoding)
+{
+    StartRequest([&](ClientRequest &call) {
+        FetchEdgeFeature(call, edge_src_ids, edge_dst_ids, edge_types, features, output, encoding);
+    })->Wait();
+}
+
+void GRPCClient::FetchEdgeFeature(ClientRequest &call, std::span<const NodeId> edge_src_ids,
+                                  std::span<const NodeId> edge_dst_ids, std::span<const Type> edge_types,
+                                  std::span<FeatureMeta> features, std::span<uint8_t> output,
+                                  FeatureEncoding encoding)
 {
     const auto len = edge_types.size();
     assert(std::accumulate(std::begin(features), std::end(features), size_t(0),
@@ -469,58 +1873,42 @@ void GRPCClient::GetEdgeFeature(std::span<const NodeId> edge_src_ids, std::span<
         wire_feature->set_id(feature.first);
         wire_feature->set_size(feature.second);
     }
+    request.set_encoding(encoding);
 
     const size_t fv_size = output.size() / len;
-    std::vector<std::future<void>> futures;
-    futures.reserve(m_engine_stubs.size());
-    std::vector<EdgeFeaturesReply> replies(m_engine_stubs.size());
+    const auto &batches = call.Keep<const ShardBatches>(*Routes(), edge_src_ids, m_replicas.size());
+    auto &replies = call.Keep<std::vector<EdgeFeaturesReply>>(m_replicas.size());
 
     // Vector<bool> is not thread safe for our use case, because it's storage is not contiguous
-    auto found = std::make_unique<bool[]>(len);
-    for (size_t shard = 0; shard < m_engine_stubs.size(); ++shard)
+    auto &found = call.Keep<std::unique_ptr<bool[]>>(std::make_unique<bool[]>(len));
+    for (size_t shard = 0; shard < m_replicas.size(); ++shard)
     {
-        auto *call = new AsyncClientCall();
-
-        auto response_reader =
-            m_engine_stubs[shard]->PrepareAsyncGetEdgeFeatures(&call->context, request, NextCompletionQueue());
-
-        call->callback = [&reply = replies[shard], output, fv_size, &found]() {
-            if (reply.offsets().empty())
-            {
-                return;
-            }
+        if (!batches.SelectEdges(shard, edge_src_ids, edge_dst_ids, edge_types, request))
+        {
+            continue;
+        }
 
-            auto curr_feature_out = std::begin(output);
-            // Use c_str since string iterators can process wide charachters on windows.
-            auto curr_feature_reply = reply.feature_values().c_str();
-            for (auto index : reply.offsets())
-            {
-                std::copy(curr_feature_reply, curr_feature_reply + fv_size, curr_feature_out + fv_size * index);
-                curr_feature_reply += fv_size;
-                found[index] = true;
-            }
+        auto callback = [&reply = replies[shard], output, features, fv_size, &found, &batches, shard]() {
+            copy_feature_values(reply, features, fv_size, shard, batches, output, found.get());
         };
 
-        // Order is important: call variable can be deleted before futures can be
-        // obtained.
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
+        SendRequest(call, shard, "/snark.GraphEngine/GetEdgeFeatures", request, replies[shard], std::move(callback));
     }
 
-    WaitForFutures(futures);
-    auto values = std::begin(output);
-    for (size_t i = 0; i < len; ++i)
-    {
-        if (found[i])
-        {
-            values += fv_size;
-        }
-        else
+    call.Then([output, &found, len, fv_size]() {
+        auto values = std::begin(output);
+        for (size_t i = 0; i < len; ++i)
         {
-            values = std::fill_n(values, fv_size, 0);
+            if (found[i])
+            {
+                values += fv_size;
+            }
+            else
+            {
+                values = std::fill_n(values, fv_size, 0);
+            }
         }
-    }
+    });
 }
 
 void GRPCClient::GetNodeSparseFeature(std::span<const NodeId> node_ids, std::span<const FeatureId> features,
@@ -530,43 +1918,85 @@ void GRPCClient::GetNodeSparseFeature(std::span<const NodeId> node_ids, std::spa
     assert(out_indices.size() == features.size());
     assert(out_dimensions.size() == features.size());
 
-    // Fill out_dimensions in case nodes don't have some features.
-    std::fill(std::begin(out_dimensions), std::end(out_dimensions), 0);
+    auto &batch = SparseFeatureBatch::ThreadLocal();
+    GetNodeSparseFeature(node_ids, features, batch);
+    batch.CopyTo(out_dimensions, out_indices, out_values);
+}
+
+void GRPCClient::GetNodeSparseFeature(std::span<const NodeId> node_ids, std::span<const FeatureId> features,
+                                      SparseFeatureBatch &output)
+{
+    // Reset dimensions in case nodes don't have some features.
+    output.Reset(features.size());
     NodeSparseFeaturesRequest request;
+    request.set_compress(m_call_config.m_compress_sparse_features);
     *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
     *request.mutable_feature_ids() = {std::begin(features), std::end(features)};
-
-    GetSparseFeature(request, m_engine_stubs, node_ids.size(), features.size(), out_dimensions, out_indices, out_values,
-                     std::bind(&GRPCClient::NextCompletionQueue, this));
+    const ShardBatches batches(*Routes(), node_ids, m_replicas.size());
+
+    GetSparseFeature(
+        request, batches,
+        [&request, &batches, node_ids](size_t shard) {
+            return batches.Select(shard, node_ids, *request.mutable_node_ids());
+        },
+        m_replicas.size(), node_ids.size(), output,
+        [this](auto &&...args) { return SendRequest(std::forward<decltype(args)>(args)...); });
 }
 
 void GRPCClient::GetEdgeSparseFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
                                       std::span<const Type> edge_types, std::span<const FeatureId> features,
                                       std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
                                       std::vector<std::vector<uint8_t>> &out_values)
+{
+    assert(out_indices.size() == features.size());
+    assert(out_dimensions.size() == features.size());
+
+    auto &batch = SparseFeatureBatch::ThreadLocal();
+    GetEdgeSparseFeature(edge_src_ids, edge_dst_ids, edge_types, features, batch);
+    batch.CopyTo(out_dimensions, out_indices, out_values);
+}
+
+void GRPCClient::GetEdgeSparseFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
+                                      std::span<const Type> edge_types, std::span<const FeatureId> features,
+                                      SparseFeatureBatch &output)
 {
     const auto len = edge_types.size();
     assert(len == edge_src_ids.size());
     assert(len == edge_dst_ids.size());
 
+    output.Reset(features.size());
     EdgeSparseFeaturesRequest request;
+    request.set_compress(m_call_config.m_compress_sparse_features);
     *request.mutable_node_ids() = {std::begin(edge_src_ids), std::end(edge_src_ids)};
     request.mutable_node_ids()->Add(std::begin(edge_dst_ids), std::end(edge_dst_ids));
     request.mutable_types()->Add(std::begin(edge_types), std::end(edge_types));
     *request.mutable_feature_ids() = {std::begin(features), std::end(features)};
-
-    GetSparseFeature(request, m_engine_stubs, len, features.size(), out_dimensions, out_indices, out_values,
-                     std::bind(&GRPCClient::NextCompletionQueue, this));
+    const ShardBatches batches(*Routes(), edge_src_ids, m_replicas.size());
+
+    GetSparseFeature(
+        request, batches,
+        [&request, &batches, edge_src_ids, edge_dst_ids, edge_types](size_t shard) {
+            return batches.SelectEdges(shard, edge_src_ids, edge_dst_ids, edge_types, request);
+        },
+        m_replicas.size(), len, output,
+        [this](auto &&...args) { return SendRequest(std::forward<decltype(args)>(args)...); });
 }
 
 void GRPCClient::GetNodeStringFeature(std::span<const NodeId> node_ids, std::span<const FeatureId> features,
                                       std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_values)
 {
     NodeSparseFeaturesRequest request;
+    request.set_compress(m_call_config.m_compress_sparse_features);
     *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
     *request.mutable_feature_ids() = {std::begin(features), std::end(features)};
-    GetStringFeature(request, m_engine_stubs, node_ids.size(), features.size(), out_dimensions, out_values,
-                     std::bind(&GRPCClient::NextCompletionQueue, this));
+    const ShardBatches batches(*Routes(), node_ids, m_replicas.size());
+    GetStringFeature(
+        request, batches,
+        [&request, &batches, node_ids](size_t shard) {
+            return batches.Select(shard, node_ids, *request.mutable_node_ids());
+        },
+        m_replicas.size(), node_ids.size(), features.size(), out_dimensions, out_values,
+        [this](auto &&...args) { return SendRequest(std::forward<decltype(args)>(args)...); });
 }
 
 void GRPCClient::GetEdgeStringFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
@@ -578,63 +2008,74 @@ void GRPCClient::GetEdgeStringFeature(std::span<const NodeId> edge_src_ids, std:
     assert(len == edge_dst_ids.size());
 
     EdgeSparseFeaturesRequest request;
+    request.set_compress(m_call_config.m_compress_sparse_features);
     *request.mutable_node_ids() = {std::begin(edge_src_ids), std::end(edge_src_ids)};
     request.mutable_node_ids()->Add(std::begin(edge_dst_ids), std::end(edge_dst_ids));
     request.mutable_types()->Add(std::begin(edge_types), std::end(edge_types));
     *request.mutable_feature_ids() = {std::begin(features), std::end(features)};
-
-    GetStringFeature(request, m_engine_stubs, len, features.size(), out_dimensions, out_values,
-                     std::bind(&GRPCClient::NextCompletionQueue, this));
+    const ShardBatches batches(*Routes(), edge_src_ids, m_replicas.size());
+
+    GetStringFeature(
+        request, batches,
+        [&request, &batches, edge_src_ids, edge_dst_ids, edge_types](size_t shard) {
+            return batches.SelectEdges(shard, edge_src_ids, edge_dst_ids, edge_types, request);
+        },
+        m_replicas.size(), len, features.size(), out_dimensions, out_values,
+        [this](auto &&...args) { return SendRequest(std::forward<decltype(args)>(args)...); });
 }
 
 void GRPCClient::NeighborCount(std::span<const NodeId> node_ids, std::span<const Type> edge_types,
                                std::span<uint64_t> output_neighbor_counts)
 {
-    GetNeighborsRequest request;
+    NeighborCountAsync(node_ids, edge_types, output_neighbor_counts)->Wait();
+}
 
-    *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
-    *request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
+std::shared_ptr<ClientRequest> GRPCClient::NeighborCountAsync(std::span<const NodeId> node_ids,
+                                                              std::span<const Type> edge_types,
+                                                              std::span<uint64_t> output_neighbor_counts)
+{
+    return StartRequest([&](ClientRequest &call) {
+        GetNeighborsRequest request;
 
-    std::vector<std::future<void>> futures;
-    std::vector<GetNeighborCountsReply> replies(std::size(m_engine_stubs));
-    std::atomic<size_t> responses_left{std::size(m_engine_stubs)};
+        *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
+        *request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
 
-    size_t len = node_ids.size();
-    std::fill_n(std::begin(output_neighbor_counts), len, 0);
+        const auto &batches = call.Keep<const ShardBatches>(*Routes(), node_ids, m_replicas.size());
+        auto &replies = call.Keep<std::vector<GetNeighborCountsReply>>(std::size(m_replicas));
 
-    for (size_t shard = 0; shard < m_engine_stubs.size(); ++shard)
-    {
-        auto *call = new AsyncClientCall();
-        auto response_reader =
-            m_engine_stubs[shard]->PrepareAsyncGetNeighborCounts(&call->context, request, NextCompletionQueue());
+        size_t len = node_ids.size();
+        std::fill_n(std::begin(output_neighbor_counts), len, 0);
 
-        call->callback = [&responses_left, &replies, &output_neighbor_counts]() {
-            // Skip processing until all responses arrived. All responses are stored in the `replies` variable,
-            // so we can safely return.
-            if (responses_left.fetch_sub(1) > 1)
+        for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+        {
+            if (!batches.Select(shard, node_ids, *request.mutable_node_ids()))
             {
-                return;
+                continue;
             }
 
+            SendRequest(call, shard, "/snark.GraphEngine/GetNeighborCounts", request, replies[shard], []() {});
+        }
+
+        // Counts of nodes stored on multiple shards are summed after all responses arrived.
+        call.Then([&replies, output_neighbor_counts, &batches]() {
             for (size_t reply_index = 0; reply_index < std::size(replies); ++reply_index)
             {
                 const auto &reply = replies[reply_index];
                 auto output_len = output_neighbor_counts.size();
-                auto reply_len = reply.neighbor_counts().size();
+                auto reply_len = size_t(reply.neighbor_counts().size());
 
                 // Mismatch in lengths of output and reply vectors
-                std::transform(std::begin(reply.neighbor_counts()),
-                               std::begin(reply.neighbor_counts()) + std::min(output_len, size_t(reply_len)),
-                               std::begin(output_neighbor_counts), std::begin(output_neighbor_counts),
-                               std::plus<uint64_t>());
+                for (size_t offset = 0; offset < reply_len; ++offset)
+                {
+                    const auto index = batches.Position(reply_index, offset);
+                    if (index < output_len)
+                    {
+                        output_neighbor_counts[index] += reply.neighbor_counts(offset);
+                    }
+                }
             }
-        };
-
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
-    }
-    WaitForFutures(futures);
+        });
+    });
 }
 
 void GRPCClient::FullNeighbor(std::span<const NodeId> node_ids, std::span<const Type> edge_types,
@@ -645,23 +2086,27 @@ void GRPCClient::FullNeighbor(std::span<const NodeId> node_ids, std::span<const
 
     *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
     *request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
+    const ShardBatches batches(*Routes(), node_ids, m_replicas.size());
     std::vector<std::future<void>> futures;
-    std::vector<GetNeighborsReply> replies(std::size(m_engine_stubs));
-    std::vector<size_t> reply_offsets(std::size(m_engine_stubs));
+    std::vector<GetNeighborsReply> replies(std::size(m_replicas));
+    std::vector<size_t> reply_offsets(std::size(m_replicas));
+
+    // Position of the next node in every shard request.
+    std::vector<size_t> reply_nodes(std::size(m_replicas));
 
     // Algorithm is to wait until all responses arive and then merge them in
     // the last callback.
-    std::atomic<size_t> responses_left{std::size(m_engine_stubs)};
+    std::atomic<size_t> responses_left{batches.Count()};
 
-    for (size_t shard = 0; shard < m_engine_stubs.size(); ++shard)
+    for (size_t shard = 0; shard < m_replicas.size(); ++shard)
     {
-        auto *call = new AsyncClientCall();
-
-        auto response_reader =
-            m_engine_stubs[shard]->PrepareAsyncGetNeighbors(&call->context, request, NextCompletionQueue());
+        if (!batches.Select(shard, node_ids, *request.mutable_node_ids()))
+        {
+            continue;
+        }
 
-        call->callback = [&responses_left, &replies, &output_nodes, &output_types, &output_weights,
-                          &output_neighbor_counts, &reply_offsets]() {
+        auto callback = [&responses_left, &replies, &output_nodes, &output_types, &output_weights,
+                         &output_neighbor_counts, &reply_offsets, &reply_nodes, &batches]() {
             // Skip processing until all responses arrived. All responses are stored in the `replies` variable,
             // so we can safely return.
             if (responses_left.fetch_sub(1) > 1)
@@ -672,8 +2117,16 @@ void GRPCClient::FullNeighbor(std::span<const NodeId> node_ids, std::span<const
             {
                 for (size_t reply_index = 0; reply_index < std::size(replies); ++reply_index)
                 {
+                    const auto reply_node = reply_nodes[reply_index];
+                    if (reply_node >= batches.Size(reply_index) ||
+                        batches.Position(reply_index, reply_node) != curr_node)
+                    {
+                        continue;
+                    }
+
+                    ++reply_nodes[reply_index];
                     const auto &reply = replies[reply_index];
-                    if (size_t(reply.neighbor_counts().size()) <= curr_node)
+                    if (size_t(reply.neighbor_counts().size()) <= reply_node)
                     {
                         auto expected = std::to_string(output_neighbor_counts.size());
                         auto received = std::to_string(reply.neighbor_counts().size());
@@ -684,7 +2137,7 @@ void GRPCClient::FullNeighbor(std::span<const NodeId> node_ids, std::span<const
                         continue;
                     }
 
-                    const auto count = reply.neighbor_counts(curr_node);
+                    const auto count = reply.neighbor_counts(reply_node);
                     if (count == 0)
                     {
                         continue;
@@ -704,9 +2157,8 @@ void GRPCClient::FullNeighbor(std::span<const NodeId> node_ids, std::span<const
             }
         };
 
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
+        futures.emplace_back(SendRequest(shard, "/snark.GraphEngine/GetNeighbors", request, replies[shard],
+                                         std::move(callback)));
     }
     WaitForFutures(futures);
 }
@@ -716,243 +2168,760 @@ void GRPCClient::WeightedSampleNeighbor(int64_t seed, std::span<const NodeId> no
                                         std::span<NodeId> output_neighbors, std::span<Type> output_types,
                                         std::span<float> output_weights, NodeId default_node_id, float default_weight,
                                         Type default_edge_type)
+{
+    WeightedSampleNeighborAsync(seed, node_ids, edge_types, count, output_neighbors, output_types, output_weights,
+                                default_node_id, default_weight, default_edge_type)
+        ->Wait();
+}
+
+std::shared_ptr<ClientRequest> GRPCClient::WeightedSampleNeighborAsync(
+    int64_t seed, std::span<const NodeId> node_ids, std::span<const Type> edge_types, size_t count,
+    std::span<NodeId> output_neighbors, std::span<Type> output_types, std::span<float> output_weights,
+    NodeId default_node_id, float default_weight, Type default_edge_type)
+{
+    return StartRequest([&](ClientRequest &call) {
+        auto &engine = call.Keep<snark::Xoroshiro128PlusGenerator>(seed);
+        boost::random::uniform_int_distribution<int64_t> subseed(std::numeric_limits<int64_t>::min(),
+                                                                 std::numeric_limits<int64_t>::max());
+
+        WeightedSampleNeighborsRequest request;
+        *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
+        *request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
+        request.set_count(count);
+        request.set_default_node_id(default_node_id);
+        request.set_default_node_weight(default_weight);
+        request.set_default_edge_type(default_edge_type);
+        auto &replies = call.Keep<std::vector<WeightedSampleNeighborsReply>>(m_replicas.size());
+
+        // Cummulative total neighbor weights for each node.
+        // We it to organize bernulli trials to merge node
+        // neighbors that are split across shards.
+        auto &shard_weights = call.Keep<std::vector<float>>(node_ids.size());
+
+        // The first reply for a node claims it and writes neighbors directly to the outputs, so callbacks don't
+        // need locks. Replies for nodes claimed by another shard are merged after all of them arrive.
+        auto &claimed = call.Keep<std::vector<std::atomic<bool>>>(node_ids.size());
+        auto &merges = call.Keep<std::vector<std::vector<std::pair<int, size_t>>>>(m_replicas.size());
+        const auto &batches = call.Keep<const ShardBatches>(*Routes(), node_ids, m_replicas.size());
+        for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+        {
+            // Draw seeds for skipped shards to keep sampling results independent of routing.
+            request.set_seed(subseed(engine));
+            if (!batches.Select(shard, node_ids, *request.mutable_node_ids()))
+            {
+                continue;
+            }
+
+            auto callback = [&reply = replies[shard], &merges = merges[shard], &batches, &claimed, &shard_weights,
+                             shard, count, output_neighbors, output_types, output_weights, default_node_id,
+                             default_weight, default_edge_type]() {
+                for (int index = 0; index < reply.offsets_size(); ++index)
+                {
+                    const size_t position = batches.Position(shard, reply.offsets(index));
+                    if (claimed[position].exchange(true, std::memory_order_relaxed))
+                    {
+                        merges.emplace_back(index, position);
+                        continue;
+                    }
+
+                    shard_weights[position] = reply.shard_weights(index);
+                    if (shard_weights[position] == 0)
+                    {
+                        std::fill_n(std::begin(output_neighbors) + position * count, count, default_node_id);
+                        std::fill_n(std::begin(output_weights) + position * count, count, default_weight);
+                        std::fill_n(std::begin(output_types) + position * count, count, default_edge_type);
+                        continue;
+                    }
+
+                    std::copy_n(std::begin(reply.neighbor_ids()) + index * count, count,
+                                std::begin(output_neighbors) + position * count);
+                    std::copy_n(std::begin(reply.neighbor_weights()) + index * count, count,
+                                std::begin(output_weights) + position * count);
+                    std::copy_n(std::begin(reply.neighbor_types()) + index * count, count,
+                                std::begin(output_types) + position * count);
+                }
+            };
+
+            SendRequest(call, shard, "/snark.GraphEngine/WeightedSampleNeighbors", request, replies[shard],
+                        std::move(callback));
+        }
+
+        // Nodes with neighbors on multiple shards(super nodes with lots of neighbors) replace every neighbor with
+        // a probability of the shard weight in the total weight of shards merged so far.
+        call.Then([&engine, &replies, &merges, &shard_weights, count, output_neighbors, output_types,
+                   output_weights]() {
+            boost::random::uniform_real_distribution<float> selector(0, 1);
+            for (size_t shard = 0; shard < merges.size(); ++shard)
+            {
+                const auto &reply = replies[shard];
+                for (const auto [index, position] : merges[shard])
+                {
+                    shard_weights[position] += reply.shard_weights(index);
+                    if (shard_weights[position] == 0)
+                    {
+                        continue;
+                    }
+
+                    const float overwrite_rate = reply.shard_weights(index) / shard_weights[position];
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        if (overwrite_rate < 1.0f && selector(engine) > overwrite_rate)
+                        {
+                            continue;
+                        }
+
+                        output_neighbors[position * count + i] = reply.neighbor_ids(index * count + i);
+                        output_types[position * count + i] = reply.neighbor_types(index * count + i);
+                        output_weights[position * count + i] = reply.neighbor_weights(index * count + i);
+                    }
+                }
+            }
+        });
+    });
+}
+
+void GRPCClient::UniformSampleNeighbor(bool without_replacement, int64_t seed, std::span<const NodeId> node_ids,
+                                       std::span<const Type> edge_types, size_t count,
+                                       std::span<NodeId> output_neighbors, std::span<Type> output_types,
+                                       NodeId default_node_id, Type default_type)
+{
+    UniformSampleNeighborAsync(without_replacement, seed, node_ids, edge_types, count, output_neighbors, output_types,
+                               default_node_id, default_type)
+        ->Wait();
+}
+
+std::shared_ptr<ClientRequest> GRPCClient::UniformSampleNeighborAsync(
+    bool without_replacement, int64_t seed, std::span<const NodeId> node_ids, std::span<const Type> edge_types,
+    size_t count, std::span<NodeId> output_neighbors, std::span<Type> output_types, NodeId default_node_id,
+    Type default_type)
+{
+    return StartRequest([&](ClientRequest &call) {
+        auto &engine = call.Keep<snark::Xoroshiro128PlusGenerator>(seed);
+        boost::random::uniform_int_distribution<int64_t> subseed(std::numeric_limits<int64_t>::min(),
+                                                                 std::numeric_limits<int64_t>::max());
+
+        UniformSampleNeighborsRequest request;
+        *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
+        *request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
+        request.set_count(count);
+        request.set_default_node_id(default_node_id);
+        request.set_default_edge_type(default_type);
+        request.set_without_replacement(without_replacement);
+        auto &replies = call.Keep<std::vector<UniformSampleNeighborsReply>>(m_replicas.size());
+
+        // Cummulative total neighbor weights for each node.
+        // We it to organize bernulli trials to merge node
+        // neighbors that are split across shards.
+        auto &shard_counts = call.Keep<std::vector<size_t>>(node_ids.size());
+
+        // Replies are merged in the same way as in WeightedSampleNeighbor.
+        auto &claimed = call.Keep<std::vector<std::atomic<bool>>>(node_ids.size());
+        auto &merges = call.Keep<std::vector<std::vector<std::pair<int, size_t>>>>(m_replicas.size());
+        const auto &batches = call.Keep<const ShardBatches>(*Routes(), node_ids, m_replicas.size());
+        for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+        {
+            // Draw seeds for skipped shards to keep sampling results independent of routing.
+            request.set_seed(subseed(engine));
+            if (!batches.Select(shard, node_ids, *request.mutable_node_ids()))
+            {
+                continue;
+            }
+
+            auto callback = [&reply = replies[shard], &merges = merges[shard], &batches, &claimed, &shard_counts,
+                             shard, count, output_neighbors, output_types, default_node_id, default_type]() {
+                for (int index = 0; index < reply.offsets_size(); ++index)
+                {
+                    const size_t position = batches.Position(shard, reply.offsets(index));
+                    if (claimed[position].exchange(true, std::memory_order_relaxed))
+                    {
+                        merges.emplace_back(index, position);
+                        continue;
+                    }
+
+                    shard_counts[position] = reply.shard_counts(index);
+                    if (shard_counts[position] == 0)
+                    {
+                        std::fill_n(std::begin(output_neighbors) + position * count, count, default_node_id);
+                        std::fill_n(std::begin(output_types) + position * count, count, default_type);
+                        continue;
+                    }
+
+                    std::copy_n(std::begin(reply.neighbor_ids()) + index * count, count,
+                                std::begin(output_neighbors) + position * count);
+                    std::copy_n(std::begin(reply.neighbor_types()) + index * count, count,
+                                std::begin(output_types) + position * count);
+                }
+            };
+
+            SendRequest(call, shard, "/snark.GraphEngine/UniformSampleNeighbors", request, replies[shard],
+                        std::move(callback));
+        }
+
+        call.Then([&engine, &replies, &merges, &shard_counts, count, output_neighbors, output_types]() {
+            boost::random::uniform_real_distribution<float> selector(0, 1);
+            for (size_t shard = 0; shard < merges.size(); ++shard)
+            {
+                const auto &reply = replies[shard];
+                for (const auto [index, position] : merges[shard])
+                {
+                    shard_counts[position] += reply.shard_counts(index);
+                    if (shard_counts[position] == 0)
+                    {
+                        continue;
+                    }
+
+                    const float overwrite_rate = float(reply.shard_counts(index)) / shard_counts[position];
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        if (overwrite_rate < 1.0f && selector(engine) > overwrite_rate)
+                        {
+                            continue;
+                        }
+
+                        output_neighbors[position * count + i] = reply.neighbor_ids(index * count + i);
+                        output_types[position * count + i] = reply.neighbor_types(index * count + i);
+                    }
+                }
+            }
+        });
+    });
+}
+
+void GRPCClient::SampleSubgraph(bool without_replacement, int64_t seed, std::span<const NodeId> seeds,
+                                std::span<const uint32_t> fanouts, std::span<const Type> edge_types,
+                                std::span<FeatureMeta> features, Subgraph &output)
 {
     snark::Xoroshiro128PlusGenerator engine(seed);
     boost::random::uniform_int_distribution<int64_t> subseed(std::numeric_limits<int64_t>::min(),
                                                              std::numeric_limits<int64_t>::max());
 
-    WeightedSampleNeighborsRequest request;
-    *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
+    SampleSubgraphRequest request;
+    *request.mutable_fanouts() = {std::begin(fanouts), std::end(fanouts)};
     *request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
-    request.set_count(count);
-    request.set_default_node_id(default_node_id);
-    request.set_default_node_weight(default_weight);
-    request.set_default_edge_type(default_edge_type);
-    std::vector<std::future<void>> futures;
-    std::vector<WeightedSampleNeighborsReply> replies(m_engine_stubs.size());
+    request.set_without_replacement(without_replacement);
+    size_t feature_size = 0;
+    for (const auto &feature : features)
+    {
+        auto wire_feature = request.add_features();
+        wire_feature->set_id(feature.first);
+        wire_feature->set_size(feature.second);
+        feature_size += feature.second;
+    }
+
+    // Nodes are expanded once by the first shard returning them, so nodes stored on multiple shards get
+    // neighbors only from one of them. Queued nodes not returned by any shard are missing in the graph.
+    enum NodeState : uint8_t
+    {
+        unknown,
+        queued,
+        expanded
+    };
+    std::vector<NodeState> states;
+    absl::flat_hash_map<NodeId, uint64_t> positions;
+    output = {};
+    auto add_node = [&output, &positions, &states](NodeId node, uint32_t hop) {
+        auto [it, inserted] = positions.emplace(node, output.m_nodes.size());
+        if (inserted)
+        {
+            output.m_nodes.emplace_back(node);
+            output.m_hops.emplace_back(hop);
+            states.emplace_back(unknown);
+        }
+        return it->second;
+    };
+    for (auto node : seeds)
+    {
+        states[add_node(node, 0)] = queued;
+    }
+
+    std::vector<NodeId> pending_ids(std::begin(output.m_nodes), std::end(output.m_nodes));
+    std::vector<uint32_t> pending_hops(pending_ids.size(), 0);
+    std::vector<SampleSubgraphReply> replies(m_replicas.size());
+    const auto routes = Routes();
+    while (!pending_ids.empty())
+    {
+        *request.mutable_node_ids() = {std::begin(pending_ids), std::end(pending_ids)};
+        *request.mutable_hops() = {std::begin(pending_hops), std::end(pending_hops)};
+        std::vector<std::future<void>> futures;
+        const ShardBatches batches(*routes, pending_ids, m_replicas.size());
+        for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+        {
+            request.set_seed(subseed(engine));
+            replies[shard].Clear();
+            if (!batches.Select(shard, std::span<const NodeId>(pending_ids), *request.mutable_node_ids()))
+            {
+                continue;
+            }
+            batches.Select(shard, std::span<const uint32_t>(pending_hops), *request.mutable_hops());
+
+            futures.emplace_back(SendRequest(shard, "/snark.GraphEngine/SampleSubgraph", request, replies[shard],
+                                             []() {}));
+        }
+
+        WaitForFutures(futures);
+
+        // Merge replies in shard order to keep results deterministic.
+        for (const auto &reply : replies)
+        {
+            int edge_offset = 0;
+            for (int index = 0; index < reply.node_ids().size(); ++index)
+            {
+                const auto hop = reply.hops()[index];
+                const auto position = add_node(reply.node_ids()[index], hop);
+                const int edge_end = edge_offset + int(reply.edge_counts()[index]);
+                if (states[position] == expanded)
+                {
+                    edge_offset = edge_end;
+                    continue;
+                }
+
+                states[position] = expanded;
+                output.m_hops[position] = hop;
+                if (feature_size > 0)
+                {
+                    output.m_features.resize(output.m_nodes.size() * feature_size);
+                    std::copy_n(reply.feature_values().data() + index * feature_size, feature_size,
+                                output.m_features.data() + position * feature_size);
+                }
+                for (; edge_offset < edge_end; ++edge_offset)
+                {
+                    output.m_edge_src.emplace_back(position);
+                    output.m_edge_dst.emplace_back(add_node(reply.neighbor_ids()[edge_offset], hop + 1));
+                    output.m_edge_types.emplace_back(reply.neighbor_types()[edge_offset]);
+                }
+            }
+        }
+
+        for (auto node : pending_ids)
+        {
+            states[positions[node]] = expanded;
+        }
+
+        pending_ids.clear();
+        pending_hops.clear();
+        for (const auto &reply : replies)
+        {
+            for (int index = 0; index < reply.frontier_ids().size(); ++index)
+            {
+                const auto node = reply.frontier_ids()[index];
+                const auto hop = reply.frontier_hops()[index];
+                const auto position = add_node(node, hop);
+                if (states[position] == unknown)
+                {
+                    states[position] = queued;
+                    pending_ids.emplace_back(node);
+                    pending_hops.emplace_back(hop);
+                }
+            }
+        }
+    }
+
+    output.m_features.resize(output.m_nodes.size() * feature_size);
+}
+
+void GRPCClient::RandomWalk(int64_t seed, float p, float q, NodeId default_node_id, std::span<const NodeId> node_ids,
+                            std::span<const Type> edge_types, size_t walk_length, std::span<NodeId> output)
+{
+    RandomWalkAsync(seed, p, q, default_node_id, node_ids, edge_types, walk_length, output)->Wait();
+}
+
+std::shared_ptr<ClientRequest> GRPCClient::RandomWalkAsync(int64_t seed, float p, float q, NodeId default_node_id,
+                                                           std::span<const NodeId> node_ids,
+                                                           std::span<const Type> edge_types, size_t walk_length,
+                                                           std::span<NodeId> output)
+{
+    return StartRequest([&](ClientRequest &call) {
+        const size_t walk_size = walk_length + 1;
+        std::fill(std::begin(output), std::end(output), default_node_id);
+        for (size_t walk = 0; walk < node_ids.size(); ++walk)
+        {
+            output[walk * walk_size] = node_ids[walk];
+        }
+        if (walk_length == 0)
+        {
+            return;
+        }
+
+        // Walks moving between shards are sent to their owners in rounds, every round continues after all
+        // replies of the previous one arrived.
+        struct Walks
+        {
+            // Walk seeds are picked the same way as in Graph::RandomWalk to get the same walks from servers.
+            std::vector<uint64_t> m_seeds;
+            RandomWalkRequest m_request;
+
+            // Number of visited nodes and sorted neighbors of the previous node for walks moving between shards.
+            std::vector<size_t> m_lengths;
+            std::vector<std::vector<NodeId>> m_previous_neighbors;
+            std::vector<size_t> m_pending;
+            std::vector<NodeId> m_current_ids;
+            std::vector<bool> m_handled;
+            std::vector<RandomWalkRequest> m_requests;
+            std::vector<RandomWalkReply> m_replies;
+            std::shared_ptr<const NodeRoutes> m_routes;
+            std::optional<ShardBatches> m_batches;
+            std::function<void()> m_round;
+        };
+
+        auto &walks = call.Keep<Walks>();
+        walks.m_routes = Routes();
+        snark::Xoroshiro128PlusGenerator engine(seed);
+        walks.m_seeds.resize(node_ids.size());
+        std::generate(std::begin(walks.m_seeds), std::end(walks.m_seeds), engine);
+        walks.m_request.set_p(p);
+        walks.m_request.set_q(q);
+        walks.m_request.set_walk_length(walk_length);
+        *walks.m_request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
+        walks.m_lengths.assign(node_ids.size(), 1);
+        walks.m_previous_neighbors.resize(node_ids.size());
+        walks.m_pending.resize(node_ids.size());
+        std::iota(std::begin(walks.m_pending), std::end(walks.m_pending), 0);
+        walks.m_requests.resize(m_replicas.size());
+        walks.m_replies.resize(m_replicas.size());
+
+        // Rounds run on threads receiving replies and hold a pointer to the request kept alive by shard calls.
+        walks.m_round = [this, &call, &walks, walk_size, output]() {
+            walks.m_current_ids.clear();
+            for (auto walk : walks.m_pending)
+            {
+                walks.m_current_ids.emplace_back(output[walk * walk_size + walks.m_lengths[walk] - 1]);
+            }
+
+            const auto &batches = walks.m_batches.emplace(*walks.m_routes, walks.m_current_ids, m_replicas.size());
+            for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+            {
+                walks.m_replies[shard].Clear();
+                if (!batches.Contains(shard))
+                {
+                    continue;
+                }
+
+                auto &shard_request = walks.m_requests[shard];
+                shard_request = walks.m_request;
+                for (size_t index = 0; index < batches.Size(shard); ++index)
+                {
+                    const auto walk = walks.m_pending[batches.Position(shard, index)];
+                    const auto length = walks.m_lengths[walk];
+                    const auto *path = output.data() + walk * walk_size;
+                    const auto &previous_neighbors = walks.m_previous_neighbors[walk];
+                    shard_request.add_seeds(walks.m_seeds[walk]);
+                    shard_request.add_node_ids(path[length - 1]);
+                    shard_request.add_previous_ids(path[length > 1 ? length - 2 : 0]);
+                    shard_request.add_steps(length - 1);
+                    shard_request.add_neighbor_counts(previous_neighbors.size());
+                    shard_request.mutable_neighbor_ids()->Add(std::begin(previous_neighbors),
+                                                              std::end(previous_neighbors));
+                }
+
+                SendRequest(call, shard, "/snark.GraphEngine/RandomWalk", shard_request, walks.m_replies[shard],
+                            []() {});
+            }
+
+            call.Then([this, &walks, walk_size, output]() {
+                // Walks continue from the first shard storing their current node in shard order to keep results
+                // deterministic. Walks not found on any shard reached a node missing in the graph.
+                const auto &batches = *walks.m_batches;
+                walks.m_handled.assign(walks.m_pending.size(), false);
+                std::vector<size_t> next_pending;
+                for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+                {
+                    const auto &reply = walks.m_replies[shard];
+                    int node_offset = 0;
+                    int neighbor_offset = 0;
+                    for (int index = 0; index < reply.statuses().size(); ++index)
+                    {
+                        const int step_count = reply.step_counts()[index];
+                        const int neighbor_count = reply.neighbor_counts()[index];
+                        const auto nodes = reply.node_ids().data() + node_offset;
+                        const auto neighbors = reply.neighbor_ids().data() + neighbor_offset;
+                        node_offset += step_count;
+                        neighbor_offset += neighbor_count;
+
+                        const auto position = batches.Position(shard, index);
+                        const auto status = WalkStatus(reply.statuses()[index]);
+                        if (walks.m_handled[position] || status == WalkStatus::missing)
+                        {
+                            continue;
+                        }
+
+                        walks.m_handled[position] = true;
+                        const auto walk = walks.m_pending[position];
+                        std::copy_n(nodes, step_count, output.data() + walk * walk_size + walks.m_lengths[walk]);
+                        walks.m_lengths[walk] += step_count;
+                        walks.m_previous_neighbors[walk].assign(neighbors, neighbors + neighbor_count);
+                        if (status == WalkStatus::moved)
+                        {
+                            next_pending.emplace_back(walk);
+                        }
+                    }
+                }
+
+                walks.m_pending.swap(next_pending);
+                if (!walks.m_pending.empty())
+                {
+                    walks.m_round();
+                }
+            });
+        };
 
-    // Cummulative total neighbor weights for each node.
-    // We it to organize bernulli trials to merge node
-    // neighbors that are split across shards.
-    std::vector<float> shard_weights(node_ids.size());
-    std::mutex mtx;
-    for (size_t shard = 0; shard < m_engine_stubs.size(); ++shard)
-    {
-        request.set_seed(subseed(engine));
+        walks.m_round();
+    });
+}
 
-        auto *call = new AsyncClientCall();
+void GRPCClient::NegativeSample(int64_t seed, NodeId default_node_id, std::span<const NodeId> node_ids,
+                                std::span<const Type> edge_types, size_t count, std::span<NodeId> output)
+{
+    NegativeSampleAsync(seed, default_node_id, node_ids, edge_types, count, output)->Wait();
+}
 
-        auto response_reader =
-            m_engine_stubs[shard]->PrepareAsyncWeightedSampleNeighbors(&call->context, request, NextCompletionQueue());
+std::shared_ptr<ClientRequest> GRPCClient::NegativeSampleAsync(int64_t seed, NodeId default_node_id,
+                                                               std::span<const NodeId> node_ids,
+                                                               std::span<const Type> edge_types, size_t count,
+                                                               std::span<NodeId> output)
+{
+    return StartRequest([&](ClientRequest &call) {
+        std::fill(std::begin(output), std::end(output), default_node_id);
+        if (count == 0 || node_ids.empty())
+        {
+            return;
+        }
 
-        call->callback = [&reply = replies[shard], count, output_neighbors, output_types, output_weights, node_ids,
-                          &mtx, &engine, &shard_weights, default_node_id, default_weight, default_edge_type]() {
-            if (reply.node_ids().empty())
+        // Rounds alternate between drawing candidates for sources short of negatives and checking them, every
+        // round continues after all replies of the previous one arrived.
+        struct Negatives
+        {
+            explicit Negatives(int64_t seed) : m_engine(seed)
             {
-                return;
             }
 
-            auto curr_nodes = std::begin(node_ids);
-            auto curr_out_neighbor = std::begin(output_neighbors);
-            auto curr_out_type = std::begin(output_types);
-            auto curr_out_weight = std::begin(output_weights);
-            auto curr_shard_weight = std::begin(shard_weights);
-
-            auto curr_reply_neighbor = std::begin(reply.neighbor_ids());
-            auto curr_reply_type = std::begin(reply.neighbor_types());
-            auto curr_reply_weight = std::begin(reply.neighbor_weights());
-            auto curr_reply_shard_weight = std::begin(reply.shard_weights());
-            boost::random::uniform_real_distribution<float> selector(0, 1);
+            snark::Xoroshiro128PlusGenerator m_engine;
+            NeighborCandidatesRequest m_request;
+            std::vector<size_t> m_filled;
+            std::vector<size_t> m_attempts;
+
+            // Sources waiting for candidates and their candidates in the order they were drawn.
+            std::vector<size_t> m_pending;
+            std::vector<NodeId> m_pending_ids;
+            std::vector<std::vector<NodeId>> m_candidates;
+            std::vector<std::vector<bool>> m_rejected;
+            std::vector<size_t> m_slot_counts;
+            std::vector<uint32_t> m_slot_shards;
+            bool m_counted = false;
+
+            std::vector<NeighborCandidatesRequest> m_requests;
+            std::vector<NeighborCandidatesReply> m_replies;
+            std::shared_ptr<const NodeRoutes> m_routes;
+            std::optional<ShardBatches> m_batches;
+            std::function<void()> m_draw;
+            std::function<void()> m_check;
+        };
 
-            // We need to lock the merge in case some nodes are present in multiple
-            // servers(a super node with lots of neighbors). To keep contention low
-            // we'll use a global lock per response instead of per node.
-            std::lock_guard guard(mtx);
+        auto &negatives = call.Keep<Negatives>(seed);
+        negatives.m_routes = Routes();
+        *negatives.m_request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
+        negatives.m_filled.assign(node_ids.size(), 0);
+        negatives.m_attempts.assign(node_ids.size(), 0);
+        negatives.m_requests.resize(m_replicas.size());
+        negatives.m_replies.resize(m_replicas.size());
+
+        // Rounds run on threads receiving replies and hold a pointer to the request kept alive by shard calls.
+        negatives.m_draw = [this, &call, &negatives, node_ids, count]() {
+            std::vector<uint64_t> node_counts;
+            {
+                std::lock_guard lock(m_node_counts_mutex);
+                node_counts = m_shard_node_counts;
+            }
 
-            // The strategy is to zip nodes from server response matching to the input
-            // nodes.
-            for (const auto &reply_node_id : reply.node_ids())
+            // Node counts are fetched by the first call of a client and refreshed by every reply with draws.
+            node_counts.resize(m_replicas.size(), 0);
+            std::vector<uint64_t> count_sums(node_counts.size());
+            std::partial_sum(std::begin(node_counts), std::end(node_counts), std::begin(count_sums));
+            const auto total = count_sums.empty() ? 0 : count_sums.back();
+            negatives.m_counted = negatives.m_counted || total > 0;
+
+            negatives.m_pending.clear();
+            negatives.m_slot_counts.clear();
+            negatives.m_slot_shards.clear();
+            // Rounds draw at most max_negative_draws nodes, so no shard is asked for more, sources left out are
+            // drawn for in the next rounds.
+            std::vector<uint32_t> draw_counts(m_replicas.size(), negatives.m_counted ? 0 : 1);
+            size_t round_draws = 0;
+            for (size_t source = 0; source < node_ids.size() && total > 0 && round_draws < max_negative_draws;
+                 ++source)
             {
-                // Loop until we find a match
-                for (; curr_nodes != std::end(node_ids) && *curr_nodes != reply_node_id; ++curr_nodes)
+                const auto missing = std::min({count - negatives.m_filled[source],
+                                               NegativeSampleAttempts(count) - negatives.m_attempts[source],
+                                               max_negative_draws - round_draws});
+                if (missing == 0)
                 {
-                    curr_out_neighbor += count;
-                    curr_out_weight += count;
-                    curr_out_type += count;
-                    ++curr_shard_weight;
+                    continue;
                 }
 
-                *curr_shard_weight += *curr_reply_shard_weight;
-                if (*curr_shard_weight == 0)
+                round_draws += missing;
+
+                negatives.m_pending.emplace_back(source);
+                negatives.m_slot_counts.emplace_back(missing);
+                negatives.m_attempts[source] += missing;
+                boost::random::uniform_int_distribution<uint64_t> position(0, total - 1);
+                for (size_t slot = 0; slot < missing; ++slot)
                 {
-                    ++curr_shard_weight;
-                    ++curr_reply_shard_weight;
+                    const auto shard =
+                        std::upper_bound(std::begin(count_sums), std::end(count_sums), position(negatives.m_engine)) -
+                        std::begin(count_sums);
+                    negatives.m_slot_shards.emplace_back(shard);
+                    ++draw_counts[shard];
+                }
+            }
 
-                    curr_out_neighbor = std::fill_n(curr_out_neighbor, count, default_node_id);
-                    curr_out_weight = std::fill_n(curr_out_weight, count, default_weight);
-                    curr_out_type = std::fill_n(curr_out_type, count, default_edge_type);
+            if (negatives.m_counted && negatives.m_pending.empty())
+            {
+                return;
+            }
 
-                    curr_reply_neighbor += count;
-                    curr_reply_type += count;
-                    curr_reply_weight += count;
-                    ++curr_nodes;
+            // Requests without draws before node counts are known only return the counts, they don't use the engine
+            // to draw the same candidates as calls with known counts.
+            for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+            {
+                negatives.m_replies[shard].Clear();
+                if (draw_counts[shard] == 0)
+                {
                     continue;
                 }
 
-                float overwrite_rate = *curr_reply_shard_weight / *curr_shard_weight;
-                for (size_t i = 0; i < count; ++i)
+                auto &shard_request = negatives.m_requests[shard];
+                shard_request.Clear();
+                if (negatives.m_counted)
+                {
+                    shard_request.set_draw_count(draw_counts[shard]);
+                    shard_request.set_seed(negatives.m_engine());
+                }
+                SendRequest(call, shard, "/snark.GraphEngine/GetNeighborCandidates", shard_request,
+                            negatives.m_replies[shard], []() {});
+            }
+
+            call.Then([this, &negatives, node_ids, draw_counts]() {
                 {
-                    // Perf optimization for the most common scenario: every node has its
-                    // neighbors in one partition.
-                    if (overwrite_rate < 1.0f && selector(engine) > overwrite_rate)
+                    std::lock_guard lock(m_node_counts_mutex);
+                    m_shard_node_counts.resize(m_replicas.size(), 0);
+                    for (size_t shard = 0; shard < m_replicas.size(); ++shard)
                     {
-                        ++curr_reply_weight;
-                        ++curr_reply_neighbor;
-                        ++curr_reply_type;
-                        ++curr_out_neighbor;
-                        ++curr_out_type;
-                        ++curr_out_weight;
-                        continue;
+                        if (draw_counts[shard] > 0)
+                        {
+                            m_shard_node_counts[shard] = negatives.m_replies[shard].node_count();
+                        }
                     }
+                }
 
-                    *(curr_out_neighbor++) = *(curr_reply_neighbor++);
-                    *(curr_out_type++) = *(curr_reply_type++);
-                    *(curr_out_weight++) = *(curr_reply_weight++);
+                if (!negatives.m_counted)
+                {
+                    negatives.m_counted = true;
+                    negatives.m_draw();
+                    return;
                 }
 
-                ++curr_reply_shard_weight;
-                ++curr_shard_weight;
-                ++curr_nodes;
-            }
+                // Slots take nodes drawn by their shards in order, shards returning fewer nodes than requested after
+                // a reload leave their slots empty.
+                std::vector<int> cursors(m_replicas.size(), 0);
+                negatives.m_pending_ids.clear();
+                negatives.m_candidates.assign(negatives.m_pending.size(), {});
+                size_t slot = 0;
+                for (size_t pending = 0; pending < negatives.m_pending.size(); ++pending)
+                {
+                    negatives.m_pending_ids.emplace_back(node_ids[negatives.m_pending[pending]]);
+                    for (size_t index = 0; index < negatives.m_slot_counts[pending]; ++index, ++slot)
+                    {
+                        const auto shard = negatives.m_slot_shards[slot];
+                        const auto &drawn = negatives.m_replies[shard].drawn_ids();
+                        if (cursors[shard] < drawn.size())
+                        {
+                            negatives.m_candidates[pending].emplace_back(drawn[cursors[shard]++]);
+                        }
+                    }
+                }
 
-            assert(curr_reply_weight == std::end(reply.neighbor_weights()));
-            assert(curr_reply_neighbor == std::end(reply.neighbor_ids()));
-            assert(curr_reply_type == std::end(reply.neighbor_types()));
-            assert(curr_reply_shard_weight == std::end(reply.shard_weights()));
+                negatives.m_check();
+            });
         };
 
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
-    }
-
-    WaitForFutures(futures);
-}
-
-void GRPCClient::UniformSampleNeighbor(bool without_replacement, int64_t seed, std::span<const NodeId> node_ids,
-                                       std::span<const Type> edge_types, size_t count,
-                                       std::span<NodeId> output_neighbors, std::span<Type> output_types,
-                                       NodeId default_node_id, Type default_type)
-{
-    snark::Xoroshiro128PlusGenerator engine(seed);
-    boost::random::uniform_int_distribution<int64_t> subseed(std::numeric_limits<int64_t>::min(),
-                                                             std::numeric_limits<int64_t>::max());
-
-    UniformSampleNeighborsRequest request;
-    *request.mutable_node_ids() = {std::begin(node_ids), std::end(node_ids)};
-    *request.mutable_edge_types() = {std::begin(edge_types), std::end(edge_types)};
-    request.set_count(count);
-    request.set_default_node_id(default_node_id);
-    request.set_default_edge_type(default_type);
-    request.set_without_replacement(without_replacement);
-    std::vector<std::future<void>> futures;
-    std::vector<UniformSampleNeighborsReply> replies(m_engine_stubs.size());
-
-    // Cummulative total neighbor weights for each node.
-    // We it to organize bernulli trials to merge node
-    // neighbors that are split across shards.
-    std::vector<size_t> shard_counts(node_ids.size());
-    std::mutex mtx;
-    for (size_t shard = 0; shard < m_engine_stubs.size(); ++shard)
-    {
-        request.set_seed(subseed(engine));
-
-        auto *call = new AsyncClientCall();
-
-        auto response_reader =
-            m_engine_stubs[shard]->PrepareAsyncUniformSampleNeighbors(&call->context, request, NextCompletionQueue());
-        call->callback = [&reply = replies[shard], count, output_types, node_ids, &mtx, &engine, &shard_counts,
-                          output_neighbors, default_node_id, default_type]() {
-            if (reply.node_ids().empty())
-            {
-                return;
-            }
-
-            auto curr_nodes = std::begin(node_ids);
-            auto curr_out_neighbor = std::begin(output_neighbors);
-            auto curr_out_type = std::begin(output_types);
-            auto curr_shard_weight = std::begin(shard_counts);
-            auto curr_reply_neighbor = std::begin(reply.neighbor_ids());
-            auto curr_reply_type = std::begin(reply.neighbor_types());
-            auto curr_reply_shard_weight = std::begin(reply.shard_counts());
-            boost::random::uniform_real_distribution<float> selector(0, 1);
-
-            // We need to lock the merge in case some nodes are present in multiple
-            // servers(a super node with lots of neighbors). To keep contention low
-            // we'll use a global lock per response instead of per node.
-            std::lock_guard guard(mtx);
-
-            // The strategy is to zip nodes from server response matching to the input
-            // nodes.
-            for (const auto &reply_node_id : reply.node_ids())
+        negatives.m_check = [this, &call, &negatives, node_ids, count, output]() {
+            const auto &batches =
+                negatives.m_batches.emplace(*negatives.m_routes, negatives.m_pending_ids, m_replicas.size());
+            for (size_t shard = 0; shard < m_replicas.size(); ++shard)
             {
-                // Loop until we find a match
-                for (; curr_nodes != std::end(node_ids) && *curr_nodes != reply_node_id; ++curr_nodes)
+                negatives.m_replies[shard].Clear();
+                if (!batches.Contains(shard))
                 {
-                    curr_out_neighbor += count;
-                    curr_out_type += count;
-                    ++curr_shard_weight;
+                    continue;
                 }
 
-                *curr_shard_weight += *curr_reply_shard_weight;
-                if (*curr_shard_weight == 0)
+                auto &shard_request = negatives.m_requests[shard];
+                shard_request = negatives.m_request;
+                for (size_t index = 0; index < batches.Size(shard); ++index)
                 {
-                    ++curr_shard_weight;
-                    ++curr_reply_shard_weight;
+                    const auto pending = batches.Position(shard, index);
+                    const auto &candidates = negatives.m_candidates[pending];
+                    shard_request.add_node_ids(negatives.m_pending_ids[pending]);
+                    shard_request.add_candidate_counts(candidates.size());
+                    shard_request.mutable_candidates()->Add(std::begin(candidates), std::end(candidates));
+                }
 
-                    curr_out_neighbor = std::fill_n(curr_out_neighbor, count, default_node_id);
-                    curr_out_type = std::fill_n(curr_out_type, count, default_type);
+                SendRequest(call, shard, "/snark.GraphEngine/GetNeighborCandidates", shard_request,
+                            negatives.m_replies[shard], []() {});
+            }
 
-                    curr_reply_neighbor += count;
-                    curr_reply_type += count;
-                    ++curr_nodes;
-                    continue;
+            call.Then([this, &negatives, node_ids, count, output]() {
+                // Edges of a node can be split between shards, candidates rejected by any of them are dropped.
+                const auto &batches = *negatives.m_batches;
+                negatives.m_rejected.resize(negatives.m_candidates.size());
+                for (size_t pending = 0; pending < negatives.m_candidates.size(); ++pending)
+                {
+                    negatives.m_rejected[pending].assign(negatives.m_candidates[pending].size(), false);
                 }
 
-                float overwrite_rate = float(*curr_reply_shard_weight) / *curr_shard_weight;
-                for (size_t i = 0; i < count; ++i)
+                for (size_t shard = 0; shard < m_replicas.size(); ++shard)
                 {
-                    // Perf optimization for the most common scenario: every node has its
-                    // neighbors in one partition.
-                    if (overwrite_rate < 1.0f && selector(engine) > overwrite_rate)
+                    const auto &reply = negatives.m_replies[shard];
+                    if (!batches.Contains(shard))
                     {
-                        ++curr_reply_neighbor;
-                        ++curr_reply_type;
-                        ++curr_out_neighbor;
-                        ++curr_out_type;
                         continue;
                     }
 
-                    *(curr_out_neighbor++) = *(curr_reply_neighbor++);
-                    *(curr_out_type++) = *(curr_reply_type++);
+                    // Positions are ascending, so they are merged with candidate groups of the shard request.
+                    int position = 0;
+                    size_t offset = 0;
+                    for (size_t index = 0; index < batches.Size(shard); ++index)
+                    {
+                        const auto pending = batches.Position(shard, index);
+                        const auto group_size = negatives.m_candidates[pending].size();
+                        for (; position < reply.positions_size() && reply.positions(position) < offset + group_size;
+                             ++position)
+                        {
+                            negatives.m_rejected[pending][reply.positions(position) - offset] = true;
+                        }
+                        offset += group_size;
+                    }
                 }
 
-                ++curr_reply_shard_weight;
-                ++curr_shard_weight;
-                ++curr_nodes;
-            }
+                for (size_t pending = 0; pending < negatives.m_pending.size(); ++pending)
+                {
+                    const auto source = negatives.m_pending[pending];
+                    auto &filled = negatives.m_filled[source];
+                    for (size_t index = 0; index < negatives.m_candidates[pending].size() && filled < count; ++index)
+                    {
+                        if (!negatives.m_rejected[pending][index] &&
+                            negatives.m_candidates[pending][index] != node_ids[source])
+                        {
+                            output[source * count + filled++] = negatives.m_candidates[pending][index];
+                        }
+                    }
+                }
 
-            assert(curr_reply_neighbor == std::end(reply.neighbor_ids()));
-            assert(curr_reply_type == std::end(reply.neighbor_types()));
-            assert(curr_reply_shard_weight == std::end(reply.shard_counts()));
+                negatives.m_draw();
+            });
         };
 
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
-    }
-
-    WaitForFutures(futures);
+        negatives.m_draw();
+    });
 }
 
 uint64_t GRPCClient::CreateSampler(bool is_edge, CreateSamplerRequest_Category category, std::span<Type> types)
@@ -963,26 +2932,21 @@ uint64_t GRPCClient::CreateSampler(bool is_edge, CreateSamplerRequest_Category c
     request.set_category(category);
 
     std::vector<std::future<void>> futures;
-    std::vector<CreateSamplerReply> replies(m_sampler_stubs.size());
+    std::vector<CreateSamplerReply> replies(m_replicas.size());
 
-    std::vector<uint64_t> sub_sampler_ids(m_sampler_stubs.size());
-    std::vector<float> sub_sampler_weights(m_sampler_stubs.size());
-    for (size_t shard = 0; shard < m_sampler_stubs.size(); ++shard)
+    std::vector<uint64_t> sub_sampler_ids(m_replicas.size());
+    std::vector<float> sub_sampler_weights(m_replicas.size());
+    std::vector<size_t> sub_sampler_replicas(m_replicas.size());
+    for (size_t shard = 0; shard < m_replicas.size(); ++shard)
     {
-        auto *call = new AsyncClientCall();
-
-        auto response_reader =
-            m_sampler_stubs[shard]->PrepareAsyncCreate(&call->context, request, NextCompletionQueue());
-
-        call->callback = [&reply = replies[shard], &sub_sampler_id = sub_sampler_ids[shard],
-                          &sub_sampler_weight = sub_sampler_weights[shard]]() {
+        auto callback = [&reply = replies[shard], &sub_sampler_id = sub_sampler_ids[shard],
+                         &sub_sampler_weight = sub_sampler_weights[shard]]() {
             sub_sampler_id = reply.sampler_id();
             sub_sampler_weight = reply.weight();
         };
 
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
+        futures.emplace_back(SendRequest(shard, "/snark.GraphSampler/Create", request, replies[shard],
+                                         std::move(callback), any_replica, &sub_sampler_replicas[shard]));
     }
 
     WaitForFutures(futures);
@@ -993,125 +2957,208 @@ uint64_t GRPCClient::CreateSampler(bool is_edge, CreateSamplerRequest_Category c
     uint64_t sampler_id = m_sampler_ids.size();
     m_sampler_ids.emplace_back(std::move(sub_sampler_ids));
     m_sampler_weights.emplace_back(std::move(sub_sampler_weights));
+    m_sampler_replicas.emplace_back(std::move(sub_sampler_replicas));
     return sampler_id;
 }
 
 void GRPCClient::SampleNodes(int64_t seed, uint64_t sampler_id, std::span<NodeId> out_node_ids,
                              std::span<Type> out_types)
 {
-    snark::SampleRequest request;
-    request.set_is_edge(false);
-
-    std::vector<std::future<void>> futures;
-    std::vector<SampleReply> replies(m_sampler_stubs.size());
-
-    std::span<const float> weights;
-    std::span<const uint64_t> sampler_ids;
-    {
-        std::lock_guard l(m_sampler_mutex);
-        weights = std::span(m_sampler_weights[sampler_id].data(), m_sampler_stubs.size());
+    SampleNodesAsync(seed, sampler_id, out_node_ids, out_types)->Wait();
+}
 
-        sampler_ids = std::span(m_sampler_ids[sampler_id].data(), m_sampler_stubs.size());
-    }
+std::shared_ptr<ClientRequest> GRPCClient::SampleNodesAsync(int64_t seed, uint64_t sampler_id,
+                                                            std::span<NodeId> out_node_ids, std::span<Type> out_types)
+{
+    return StartRequest([&](ClientRequest &call) {
+        snark::SampleRequest request;
+        request.set_is_edge(false);
 
-    snark::Xoroshiro128PlusGenerator gen(seed);
-    boost::random::uniform_int_distribution<int64_t> subseed;
-    size_t left = out_types.size();
-    size_t position = 0;
+        auto &replies = call.Keep<std::vector<SampleReply>>(m_replicas.size());
 
-    for (size_t shard = 0; shard < m_sampler_stubs.size(); ++shard)
-    {
-        if (sampler_ids[shard] == empty_sampler_id)
+        std::span<const float> weights;
+        std::span<const uint64_t> sampler_ids;
+        std::span<const size_t> sampler_replicas;
         {
-            continue;
-        }
+            std::lock_guard l(m_sampler_mutex);
+            weights = std::span(m_sampler_weights[sampler_id].data(), m_replicas.size());
 
-        auto *call = new AsyncClientCall();
-        const size_t element_count = boost::random::binomial_distribution<int32_t>(left, weights[shard])(gen);
-        left -= element_count;
+            sampler_ids = std::span(m_sampler_ids[sampler_id].data(), m_replicas.size());
+            sampler_replicas = std::span(m_sampler_replicas[sampler_id].data(), m_replicas.size());
+        }
 
-        request.set_seed(subseed(gen));
-        request.set_sampler_id(sampler_ids[shard]);
-        request.set_count(element_count);
-        auto response_reader =
-            m_sampler_stubs[shard]->PrepareAsyncSample(&call->context, request, NextCompletionQueue());
-        call->callback = [&reply = replies[shard], types = out_types.subspan(position, element_count),
-                          nodes = out_node_ids.subspan(position, element_count)]() {
-            std::copy(std::begin(reply.types()), std::end(reply.types()), std::begin(types));
+        std::vector<size_t> counts(m_replicas.size());
+        std::vector<int64_t> seeds(m_replicas.size());
+        SplitSampleBatch(false, seed, out_types.size(), sampler_ids, weights, counts, seeds);
+        size_t position = 0;
+        for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+        {
+            if (counts[shard] == 0)
+            {
+                continue;
+            }
 
-            std::copy(std::begin(reply.node_ids()), std::end(reply.node_ids()), std::begin(nodes));
-        };
+            const size_t element_count = counts[shard];
+            request.set_seed(seeds[shard]);
+            request.set_sampler_id(sampler_ids[shard]);
+            request.set_count(element_count);
+            auto callback = [&reply = replies[shard], types = out_types.subspan(position, element_count),
+                             nodes = out_node_ids.subspan(position, element_count)]() {
+                std::copy(std::begin(reply.types()), std::end(reply.types()), std::begin(types));
 
-        position += element_count;
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
-    }
+                std::copy(std::begin(reply.node_ids()), std::end(reply.node_ids()), std::begin(nodes));
+            };
 
-    WaitForFutures(futures);
+            position += element_count;
+            SendRequest(call, shard, "/snark.GraphSampler/Sample", request, replies[shard], std::move(callback),
+                        sampler_replicas[shard]);
+        }
+    });
 }
 
 void GRPCClient::SampleEdges(int64_t seed, uint64_t sampler_id, std::span<NodeId> out_src_node_ids,
                              std::span<Type> out_types, std::span<NodeId> out_dst_node_ids)
 {
-    snark::SampleRequest request;
-    request.set_is_edge(true);
+    SampleEdgesAsync(seed, sampler_id, out_src_node_ids, out_types, out_dst_node_ids)->Wait();
+}
 
-    std::vector<std::future<void>> futures;
-    std::vector<SampleReply> replies(m_sampler_stubs.size());
+std::shared_ptr<ClientRequest> GRPCClient::SampleEdgesAsync(int64_t seed, uint64_t sampler_id,
+                                                            std::span<NodeId> out_src_node_ids,
+                                                            std::span<Type> out_types,
+                                                            std::span<NodeId> out_dst_node_ids)
+{
+    return StartRequest([&](ClientRequest &call) {
+        snark::SampleRequest request;
+        request.set_is_edge(true);
+
+        auto &replies = call.Keep<std::vector<SampleReply>>(m_replicas.size());
+
+        std::span<const float> weights;
+        std::span<const uint64_t> sampler_ids;
+        std::span<const size_t> sampler_replicas;
+        {
+            std::lock_guard l(m_sampler_mutex);
+            weights = std::span(m_sampler_weights[sampler_id].data(), m_replicas.size());
+
+            sampler_ids = std::span(m_sampler_ids[sampler_id].data(), m_replicas.size());
+            sampler_replicas = std::span(m_sampler_replicas[sampler_id].data(), m_replicas.size());
+        }
 
-    std::span<const float> weights;
-    std::span<const uint64_t> sampler_ids;
+        std::vector<size_t> counts(m_replicas.size());
+        std::vector<int64_t> seeds(m_replicas.size());
+        SplitSampleBatch(true, seed, out_types.size(), sampler_ids, weights, counts, seeds);
+        size_t position = 0;
+        for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+        {
+            if (counts[shard] == 0)
+            {
+                continue;
+            }
+
+            const size_t shard_count = counts[shard];
+            request.set_seed(seeds[shard]);
+            request.set_sampler_id(sampler_ids[shard]);
+            request.set_count(shard_count);
+
+            auto callback = [&reply = replies[shard], shard_count, types = out_types.subspan(position, shard_count),
+                             src_nodes = out_src_node_ids.subspan(position, shard_count),
+                             dst_nodes = out_dst_node_ids.subspan(position, shard_count)]() {
+                std::copy(std::begin(reply.types()), std::end(reply.types()), std::begin(types));
+                std::copy_n(std::begin(reply.node_ids()), shard_count, std::begin(src_nodes));
+                std::copy_n(std::begin(reply.node_ids()) + shard_count, shard_count, std::begin(dst_nodes));
+            };
+
+            position += shard_count;
+            SendRequest(call, shard, "/snark.GraphSampler/Sample", request, replies[shard], std::move(callback),
+                        sampler_replicas[shard]);
+        }
+    });
+}
+
+uint64_t GRPCClient::CreateSampleStream(int64_t seed, uint64_t sampler_id, bool is_edge, size_t batch_size,
+                                        size_t prefetch, uint64_t batches)
+{
+    snark::SampleStreamRequest request;
+    request.set_seed(seed);
+    request.set_count(batch_size);
+    request.set_is_edge(is_edge);
+    request.set_batches(batches);
+    std::vector<size_t> sampler_replicas;
     {
         std::lock_guard l(m_sampler_mutex);
-        weights = std::span(m_sampler_weights[sampler_id].data(), m_sampler_stubs.size());
+        const auto &sampler_ids = m_sampler_ids[sampler_id];
+        const auto &weights = m_sampler_weights[sampler_id];
+        *request.mutable_sampler_ids() = {std::begin(sampler_ids), std::end(sampler_ids)};
+        *request.mutable_weights() = {std::begin(weights), std::end(weights)};
+        sampler_replicas = m_sampler_replicas[sampler_id];
+    }
+
+    auto stream = std::make_shared<SampleStream>(is_edge, batch_size, prefetch);
+    for (size_t shard = 0; shard < m_replicas.size(); ++shard)
+    {
+        if (request.sampler_ids(shard) == empty_sampler_id)
+        {
+            continue;
+        }
 
-        sampler_ids = std::span(m_sampler_ids[sampler_id].data(), m_sampler_stubs.size());
+        request.set_shard(shard);
+        stream->Open(*m_replicas[shard][sampler_replicas[shard]]->m_sampler_stub, request);
     }
 
-    snark::Xoroshiro128PlusGenerator gen(seed);
-    boost::random::uniform_int_distribution<int64_t> subseed;
-    size_t left = out_types.size();
-    size_t position = 0;
+    std::lock_guard l(m_sampler_mutex);
+    auto slot = std::find(std::begin(m_sample_streams), std::end(m_sample_streams), nullptr);
+    if (slot != std::end(m_sample_streams))
+    {
+        *slot = std::move(stream);
+        return uint64_t(slot - std::begin(m_sample_streams));
+    }
+
+    m_sample_streams.emplace_back(std::move(stream));
+    return m_sample_streams.size() - 1;
+}
 
-    for (size_t shard = 0; shard < m_sampler_stubs.size() && left > 0; ++shard)
+std::shared_ptr<GRPCClient::SampleStream> GRPCClient::FindSampleStream(uint64_t stream_id)
+{
+    std::lock_guard l(m_sampler_mutex);
+    if (stream_id >= m_sample_streams.size() || !m_sample_streams[stream_id])
     {
-        auto *call = new AsyncClientCall();
-        const size_t shard_count = boost::random::binomial_distribution<int32_t>(left, weights[shard])(gen);
-        left -= shard_count;
+        throw std::invalid_argument("Sample stream is closed");
+    }
 
-        request.set_seed(subseed(gen));
-        request.set_sampler_id(sampler_ids[shard]);
-        request.set_count(shard_count);
+    return m_sample_streams[stream_id];
+}
 
-        auto response_reader =
-            m_sampler_stubs[shard]->PrepareAsyncSample(&call->context, request, NextCompletionQueue());
-        call->callback = [&reply = replies[shard], shard_count, types = out_types.subspan(position, shard_count),
-                          src_nodes = out_src_node_ids.subspan(position, shard_count),
-                          dst_nodes = out_dst_node_ids.subspan(position, shard_count)]() {
-            std::copy(std::begin(reply.types()), std::end(reply.types()), std::begin(types));
-            std::copy_n(std::begin(reply.node_ids()), shard_count, std::begin(src_nodes));
-            std::copy_n(std::begin(reply.node_ids()) + shard_count, shard_count, std::begin(dst_nodes));
-        };
+void GRPCClient::NextSampledNodes(uint64_t stream_id, std::span<NodeId> out_node_ids, std::span<Type> out_types)
+{
+    FindSampleStream(stream_id)->Next(out_node_ids, out_types, {});
+}
 
-        position += shard_count;
-        futures.emplace_back(call->promise.get_future());
-        response_reader->StartCall();
-        response_reader->Finish(&replies[shard], &call->status, static_cast<void *>(call));
-    }
+void GRPCClient::NextSampledEdges(uint64_t stream_id, std::span<NodeId> out_src_node_ids, std::span<Type> out_types,
+                                  std::span<NodeId> out_dst_node_ids)
+{
+    FindSampleStream(stream_id)->Next(out_src_node_ids, out_types, out_dst_node_ids);
+}
 
-    WaitForFutures(futures);
+void GRPCClient::CloseSampleStream(uint64_t stream_id)
+{
+    std::shared_ptr<SampleStream> stream;
+    {
+        std::lock_guard l(m_sampler_mutex);
+        if (stream_id >= m_sample_streams.size())
+        {
+            throw std::invalid_argument("Sample stream is closed");
+        }
+
+        // Join reader threads outside of the lock, slot can be reused by the next stream.
+        stream.swap(m_sample_streams[stream_id]);
+    }
 }
 
 void GRPCClient::WriteMetadata(std::filesystem::path path)
 {
     EmptyMessage request;
     MetadataReply reply;
-    auto *call = new AsyncClientCall();
-    auto response_reader =
-        m_engine_stubs.front()->PrepareAsyncGetMetadata(&call->context, request, NextCompletionQueue());
-
-    call->callback = [&reply, &path]() {
+    auto callback = [&reply, &path]() {
         Metadata meta;
         meta.m_version = reply.version();
         meta.m_node_count = reply.nodes();
@@ -1146,21 +3193,246 @@ void GRPCClient::WriteMetadata(std::filesystem::path path)
         meta.Write(path.string().c_str());
     };
 
-    // Order is important: call variable can be deleted before futures can be
-    // obtained.
-    auto future = call->promise.get_future();
-    response_reader->StartCall();
-    response_reader->Finish(&reply, &call->status, static_cast<void *>(call));
+    auto future = SendRequest(0, "/snark.GraphEngine/GetMetadata", request, reply, std::move(callback));
     future.get();
 }
 
+void GRPCClient::LoadNodeRoutes()
+{
+    auto routes = std::make_shared<const NodeRoutes>(FetchNodeRoutes());
+    std::lock_guard lock(m_routes_mutex);
+    m_node_shards = std::move(routes);
+    m_routes_loaded = true;
+}
+
+NodeRoutes GRPCClient::FetchNodeRoutes()
+{
+    // Node ids are fetched in pages to keep replies under message size limits, every round requests the next
+    // page from all shards with remaining ids. Pages of a server reloaded between rounds may skip or repeat ids.
+    std::vector<NodeIdsRequest> requests(m_replicas.size());
+    std::vector<NodeIdsReply> replies(m_replicas.size());
+    std::vector<size_t> pending(m_replicas.size());
+    std::iota(std::begin(pending), std::end(pending), size_t(0));
+    std::vector<std::future<void>> futures;
+    futures.reserve(m_replicas.size());
+    std::vector<std::vector<NodeId>> shard_node_ids(m_replicas.size());
+    while (!pending.empty())
+    {
+        futures.clear();
+        for (auto shard : pending)
+        {
+            futures.emplace_back(
+                SendRequest(shard, "/snark.GraphEngine/GetNodeIds", requests[shard], replies[shard], []() {}));
+        }
+
+        WaitForFutures(futures);
+        std::vector<size_t> next_pending;
+        for (auto shard : pending)
+        {
+            const auto &node_ids = replies[shard].node_ids();
+            shard_node_ids[shard].insert(std::end(shard_node_ids[shard]), std::begin(node_ids), std::end(node_ids));
+
+            if (replies[shard].next_offset() != 0)
+            {
+                requests[shard].set_offset(replies[shard].next_offset());
+                next_pending.emplace_back(shard);
+            }
+        }
+
+        pending = std::move(next_pending);
+    }
+
+    return NodeRoutes(std::move(shard_node_ids));
+}
+
+void GRPCClient::Refresh()
+{
+    if (m_feature_cache != nullptr)
+    {
+        m_feature_cache->Clear();
+    }
+
+    bool routes_loaded;
+    {
+        std::lock_guard lock(m_routes_mutex);
+        routes_loaded = m_routes_loaded;
+    }
+    if (routes_loaded)
+    {
+        LoadNodeRoutes();
+    }
+}
+
+std::shared_ptr<const NodeRoutes> GRPCClient::Routes() const
+{
+    std::lock_guard lock(m_routes_mutex);
+    return m_node_shards;
+}
+
+void GRPCClient::ObserveEngineVersion(Replica &replica, uint64_t version)
+{
+    // The first reply of a replica only sets its version, routes are fetched after the client is created.
+    auto seen = replica.m_engine_version.load();
+    do
+    {
+        if (seen != Replica::unknown_version && seen >= version)
+        {
+            return;
+        }
+    } while (!replica.m_engine_version.compare_exchange_weak(seen, version));
+    if (seen == Replica::unknown_version)
+    {
+        return;
+    }
+
+    if (m_feature_cache != nullptr)
+    {
+        m_feature_cache->Clear();
+    }
+
+    // Stale routes would send nodes only to the shards they were on before the reload, all shards get requests
+    // until routes are fetched again. Fetching can't block completion queue threads, so it runs on its own thread.
+    std::lock_guard lock(m_routes_mutex);
+    if (!m_routes_loaded || m_closing)
+    {
+        return;
+    }
+
+    m_node_shards = std::make_shared<const NodeRoutes>();
+    ++m_routes_generation;
+    if (m_routes_loading)
+    {
+        return;
+    }
+
+    m_routes_loading = true;
+    if (m_routes_thread.joinable())
+    {
+        m_routes_thread.join();
+    }
+    m_routes_thread = std::thread(&GRPCClient::ReloadNodeRoutes, this);
+}
+
+void GRPCClient::ReloadNodeRoutes()
+{
+    for (;;)
+    {
+        uint64_t generation;
+        {
+            std::lock_guard lock(m_routes_mutex);
+            generation = m_routes_generation;
+        }
+
+        std::shared_ptr<const NodeRoutes> routes;
+        try
+        {
+            routes = std::make_shared<const NodeRoutes>(FetchNodeRoutes());
+        }
+        catch (const std::exception &e)
+        {
+            RAW_LOG_ERROR("Failed to fetch node routes after a server reload, requests are sent to all shards: %s",
+                          e.what());
+        }
+
+        std::lock_guard lock(m_routes_mutex);
+        if (routes != nullptr && generation != m_routes_generation && !m_closing)
+        {
+            // Another replica was reloaded while routes were fetched.
+            continue;
+        }
+        if (routes != nullptr && generation == m_routes_generation)
+        {
+            m_node_shards = std::move(routes);
+        }
+        m_routes_loading = false;
+        return;
+    }
+}
+
 grpc::CompletionQueue *GRPCClient::NextCompletionQueue()
 {
     return &m_completion_queue[m_counter++ % m_completion_queue.size()];
 }
 
+NodeRoutes::NodeRoutes(std::vector<std::vector<NodeId>> shard_node_ids)
+{
+    if (shard_node_ids.size() >= all_shards)
+    {
+        RAW_LOG_ERROR("Node routes support up to %d shards, requests are sent to all shards", int(all_shards) - 1);
+        return;
+    }
+
+    size_t total = 0;
+    for (auto &ids : shard_node_ids)
+    {
+        // Pages of a shard are sorted unless the shard was reloaded while they were fetched.
+        std::sort(std::begin(ids), std::end(ids));
+        ids.erase(std::unique(std::begin(ids), std::end(ids)), std::end(ids));
+        total += ids.size();
+    }
+
+    // Merge sorted ids of all shards, nodes found in several shards get a single all_shards record.
+    m_ids.reserve(total);
+    m_shards.reserve(total);
+    using Cursor = std::pair<NodeId, uint16_t>;
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heads;
+    std::vector<size_t> positions(shard_node_ids.size(), 0);
+    for (uint16_t shard = 0; shard < shard_node_ids.size(); ++shard)
+    {
+        if (!shard_node_ids[shard].empty())
+        {
+            heads.emplace(shard_node_ids[shard].front(), shard);
+        }
+    }
+    while (!heads.empty())
+    {
+        const auto [node, shard] = heads.top();
+        heads.pop();
+        if (!m_ids.empty() && m_ids.back() == node)
+        {
+            m_shards.back() = all_shards;
+        }
+        else
+        {
+            m_ids.emplace_back(node);
+            m_shards.emplace_back(shard);
+        }
+
+        const auto &ids = shard_node_ids[shard];
+        if (++positions[shard] < ids.size())
+        {
+            heads.emplace(ids[positions[shard]], shard);
+        }
+    }
+    m_ids.shrink_to_fit();
+    m_shards.shrink_to_fit();
+}
+
+bool NodeRoutes::Empty() const
+{
+    return m_ids.empty();
+}
+
+uint16_t NodeRoutes::Find(NodeId node) const
+{
+    const auto it = std::lower_bound(std::begin(m_ids), std::end(m_ids), node);
+    return it == std::end(m_ids) || *it != node ? all_shards : m_shards[it - std::begin(m_ids)];
+}
+
 GRPCClient::~GRPCClient()
 {
+    std::thread routes_thread;
+    {
+        std::lock_guard lock(m_routes_mutex);
+        m_closing = true;
+        routes_thread.swap(m_routes_thread);
+    }
+    if (routes_thread.joinable())
+    {
+        routes_thread.join();
+    }
+
+    m_sample_streams.clear();
     for (auto &q : m_completion_queue)
     {
         q.Shutdown();
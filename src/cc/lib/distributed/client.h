@@ -5,41 +5,225 @@
 #define SNARK_CLIENT_H
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
 #include <filesystem>
 #include <functional>
+#include <future>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <span>
+#include <string>
 #include <thread>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include <grpc/grpc.h>
 #include <grpcpp/channel.h>
 #include <grpcpp/completion_queue.h>
+#include <grpcpp/generic/generic_stub.h>
 
+#include "src/cc/lib/distributed/metrics.h"
 #include "src/cc/lib/distributed/service.grpc.pb.h"
+#include "src/cc/lib/graph/feature_cache.h"
 #include "src/cc/lib/graph/graph.h"
 
 namespace snark
 {
 
+struct ClientCallConfig
+{
+    // Time to wait for a reply from a shard, requests fail with a deadline exceeded error after it. 0 waits
+    // indefinitely. Sample streams are not limited by the deadline.
+    std::chrono::milliseconds m_deadline{0};
+
+    // Send a duplicate request to a shard if it doesn't reply in this time and process whichever reply comes first.
+    // Delays close to the 95th percentile of request latency cut the tail for a few percent more requests.
+    // 0 disables hedging.
+    std::chrono::microseconds m_hedge_delay{0};
+
+    // Replicas failing with unavailable status are skipped by load balancing for this time, requests to them are
+    // sent to other replicas of the shard.
+    std::chrono::milliseconds m_replica_backoff{1000};
+
+    // Merge node feature lookups of concurrent callers asking for the same features within this window into a
+    // single request to every shard, nodes requested by several callers are fetched once. 0 disables coalescing.
+    std::chrono::microseconds m_coalesce_window{0};
+
+    // Send merged lookups before the end of the window once they have this many unique nodes.
+    size_t m_coalesce_max_nodes = 4096;
+
+    // Ask servers to compress replies with sparse and string features with gzip. Dense features are usually better
+    // served by quantization, see GetNodeFeature.
+    bool m_compress_sparse_features = false;
+
+    // Memory budget in bytes for dense feature values of nodes and edges cached by the client, only values missing
+    // from the cache are requested from servers. Features are expected to stay the same while the client is alive.
+    // 0 disables the cache.
+    size_t m_feature_cache_size = 0;
+};
+
+// Counters of requests sent by a client since it was created.
+struct ClientCallStats
+{
+    // Requests waiting for replies from every shard, summed over shard replicas.
+    std::vector<size_t> m_outstanding;
+
+    // Requests sent to shards, including duplicate requests.
+    size_t m_requests = 0;
+
+    // Duplicate requests sent after the hedge delay and how many of them replied first.
+    size_t m_hedged = 0;
+    size_t m_hedge_wins = 0;
+
+    // Requests sent again to another replica after a replica was unavailable.
+    size_t m_failovers = 0;
+
+    // Feature lookups merged into lookups of other callers.
+    size_t m_coalesced = 0;
+
+    // Failed requests.
+    size_t m_deadline_exceeded = 0;
+    size_t m_failed = 0;
+
+    // Nodes and edges with dense features found in the client feature cache and requested from servers.
+    size_t m_feature_cache_hits = 0;
+    size_t m_feature_cache_misses = 0;
+};
+
+// Shards storing nodes: sorted node ids with a packed shard id for each of them, ~10 bytes per node instead of
+// a hash map entry.
+class NodeRoutes
+{
+  public:
+    // Nodes stored in several shards or missing from routes are sent to all shards.
+    static constexpr uint16_t all_shards = std::numeric_limits<uint16_t>::max();
+
+    NodeRoutes() = default;
+
+    // Build routes from node ids of every shard. Clients with all_shards or more shards get empty routes.
+    explicit NodeRoutes(std::vector<std::vector<NodeId>> shard_node_ids);
+
+    bool Empty() const;
+
+    // Shard owning a node or all_shards.
+    uint16_t Find(NodeId node) const;
+
+  private:
+    std::vector<NodeId> m_ids;
+    std::vector<uint16_t> m_shards;
+};
+
+class GRPCClient;
+
+// Client method in flight. Replies to shard requests of the method are processed on client completion queue
+// threads and the last reply of a round runs the rest of the method there, so callers don't need a thread to
+// wait for servers.
+class ClientRequest final : public std::enable_shared_from_this<ClientRequest>
+{
+  public:
+    // Block until the method finishes, rethrows the error of a failed or cancelled request.
+    void Wait();
+
+    bool Done() const;
+
+    // Cancel shard requests in flight with grpc::ClientContext::TryCancel. Requests finishing after that fail with
+    // a cancelled error instead of running the rest of the method.
+    void Cancel();
+
+    // Request finished with an error after it was cancelled.
+    bool Cancelled() const;
+
+    // Call callback with the error of the request, null on success, after it finishes. Callbacks run on the thread
+    // finishing the request or right away if it is done already.
+    void OnDone(std::function<void(std::exception_ptr)> callback);
+
+  private:
+    friend class GRPCClient;
+
+    // Run the first round of a method on the calling thread and the following rounds on threads receiving their
+    // last replies.
+    void Run(std::function<void()> round);
+    void Continue(std::vector<std::function<void()>> next);
+
+    // Objects used by reply callbacks and continuations of the method, they live as long as the request.
+    template <typename T, typename... Args> T &Keep(Args &&...args)
+    {
+        auto value = std::make_shared<T>(std::forward<Args>(args)...);
+        auto &result = *value;
+        m_state.emplace_back(std::move(value));
+        return result;
+    }
+
+    // Continuations added in a round run in order after all shard requests of the round completed. Requests sent
+    // by continuations start the next round.
+    void Then(std::function<void()> next);
+
+    // Register a shard request of the current round, Complete is called once it finished.
+    void Add(std::function<void()> cancel);
+    void Complete(std::exception_ptr error);
+
+    // Return continuations of the next round with the lock held or finish the request and release the lock if there
+    // are none left.
+    std::vector<std::function<void()>> Next(std::unique_lock<std::mutex> &lock);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_finished;
+
+    // Shard requests in flight and a hold of the round being run.
+    size_t m_pending = 1;
+    std::vector<std::function<void()>> m_next;
+    std::vector<std::function<void()>> m_cancels;
+    std::vector<std::function<void(std::exception_ptr)>> m_callbacks;
+    std::vector<std::shared_ptr<const void>> m_state;
+    std::exception_ptr m_error;
+    bool m_cancel_requested = false;
+    bool m_done = false;
+};
+
 class GRPCClient final
 {
   public:
-    GRPCClient(std::vector<std::shared_ptr<grpc::Channel>> channels, uint32_t num_threads, uint32_t num_threads_per_cq);
+    // Every channel is a separate shard.
+    GRPCClient(std::vector<std::shared_ptr<grpc::Channel>> channels, uint32_t num_threads, uint32_t num_threads_per_cq,
+               ClientCallConfig call_config = {});
+
+    // Channels of every shard are replicas serving the same partitions. Requests to a shard are balanced between
+    // its replicas by picking the one with fewer outstanding requests out of two random replicas.
+    GRPCClient(std::vector<std::vector<std::shared_ptr<grpc::Channel>>> shards, uint32_t num_threads,
+               uint32_t num_threads_per_cq, ClientCallConfig call_config = {});
     void GetNodeType(std::span<const NodeId> node_ids, std::span<Type> output, Type default_type);
-    void GetNodeFeature(std::span<const NodeId> node_ids, std::span<FeatureMeta> features, std::span<uint8_t> output);
+    // Features can be sent with a quantized encoding only if all of them are float32 arrays, servers encode values
+    // and they are decoded back to float32 in the output. Servers don't know feature types and quantize any features
+    // with sizes divisible by 4, so features of other types are corrupted. Servers not supporting the encoding reply
+    // with raw values.
+    void GetNodeFeature(std::span<const NodeId> node_ids, std::span<FeatureMeta> features, std::span<uint8_t> output,
+                        FeatureEncoding encoding = FEATURE_ENCODING_RAW);
 
     void GetEdgeFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
-                        std::span<const Type> edge_types, std::span<FeatureMeta> features, std::span<uint8_t> output);
+                        std::span<const Type> edge_types, std::span<FeatureMeta> features, std::span<uint8_t> output,
+                        FeatureEncoding encoding = FEATURE_ENCODING_RAW);
 
     void GetNodeSparseFeature(std::span<const NodeId> node_ids, std::span<const FeatureId> features,
                               std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
                               std::vector<std::vector<uint8_t>> &out_values);
 
+    // Sparse features in a flat batch reused between calls, indices refer to positions of nodes in node_ids.
+    void GetNodeSparseFeature(std::span<const NodeId> node_ids, std::span<const FeatureId> features,
+                              SparseFeatureBatch &output);
+
     void GetEdgeSparseFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
                               std::span<const Type> edge_types, std::span<const FeatureId> features,
                               std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
                               std::vector<std::vector<uint8_t>> &out_values);
 
+    void GetEdgeSparseFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
+                              std::span<const Type> edge_types, std::span<const FeatureId> features,
+                              SparseFeatureBatch &output);
+
     void GetNodeStringFeature(std::span<const NodeId> node_ids, std::span<const FeatureId> features,
                               std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_values);
 
@@ -63,29 +247,243 @@ class GRPCClient final
                                std::span<const Type> edge_types, size_t count, std::span<NodeId> output_nodes,
                                std::span<Type> output_types, NodeId default_node_id, Type default_type);
 
+    // Servers expand all hops over nodes they store in a single request, sampled neighbors stored on other
+    // shards are sent to their owners in following rounds. See Graph::SampleSubgraph for the output format.
+    void SampleSubgraph(bool without_replacement, int64_t seed, std::span<const NodeId> seeds,
+                        std::span<const uint32_t> fanouts, std::span<const Type> edge_types,
+                        std::span<FeatureMeta> features, Subgraph &output);
+
+    // Servers continue walks while they stay on nodes stored there, walks moving to nodes stored on other shards
+    // are sent to their owners in following rounds. See Graph::RandomWalk for the output format.
+    void RandomWalk(int64_t seed, float p, float q, NodeId default_node_id, std::span<const NodeId> node_ids,
+                    std::span<const Type> edge_types, size_t walk_length, std::span<NodeId> output);
+
+    // Servers draw candidates from nodes they store in proportion to their node counts, candidates of a source are
+    // checked only by shards storing it. Rounds repeat for sources short of negatives until they run out of
+    // NegativeSampleAttempts. Nodes stored on several shards are drawn more often. See Graph::NegativeSample for
+    // the output format.
+    void NegativeSample(int64_t seed, NodeId default_node_id, std::span<const NodeId> node_ids,
+                        std::span<const Type> edge_types, size_t count, std::span<NodeId> output);
+
     uint64_t CreateSampler(bool is_edge, CreateSamplerRequest_Category category, std::span<Type> types);
 
     void SampleNodes(int64_t seed, uint64_t sampler_id, std::span<NodeId> out_node_ids, std::span<Type> output_types);
 
     void SampleEdges(int64_t seed, uint64_t sampler_id, std::span<NodeId> out_src_node_ids,
                      std::span<Type> output_types, std::span<NodeId> out_dst_node_ids);
+
+    // Asynchronous versions of the methods above return once requests are sent to shards. Inputs and outputs have
+    // to stay valid until the returned request is done. Asynchronous node feature lookups skip coalescing, so they
+    // never wait for other callers.
+    std::shared_ptr<ClientRequest> GetNodeTypeAsync(std::span<const NodeId> node_ids, std::span<Type> output,
+                                                    Type default_type);
+    std::shared_ptr<ClientRequest> GetNodeFeatureAsync(std::span<const NodeId> node_ids,
+                                                       std::span<FeatureMeta> features, std::span<uint8_t> output,
+                                                       FeatureEncoding encoding = FEATURE_ENCODING_RAW);
+    std::shared_ptr<ClientRequest> GetEdgeFeatureAsync(std::span<const NodeId> edge_src_ids,
+                                                       std::span<const NodeId> edge_dst_ids,
+                                                       std::span<const Type> edge_types,
+                                                       std::span<FeatureMeta> features, std::span<uint8_t> output,
+                                                       FeatureEncoding encoding = FEATURE_ENCODING_RAW);
+    std::shared_ptr<ClientRequest> NeighborCountAsync(std::span<const NodeId> node_ids,
+                                                      std::span<const Type> edge_types,
+                                                      std::span<uint64_t> output_neighbor_counts);
+    std::shared_ptr<ClientRequest> WeightedSampleNeighborAsync(int64_t seed, std::span<const NodeId> node_ids,
+                                                               std::span<const Type> edge_types, size_t count,
+                                                               std::span<NodeId> output_nodes,
+                                                               std::span<Type> output_types,
+                                                               std::span<float> output_weights,
+                                                               NodeId default_node_id, float default_weight,
+                                                               Type default_edge_type);
+    std::shared_ptr<ClientRequest> UniformSampleNeighborAsync(bool without_replacement, int64_t seed,
+                                                              std::span<const NodeId> node_ids,
+                                                              std::span<const Type> edge_types, size_t count,
+                                                              std::span<NodeId> output_nodes,
+                                                              std::span<Type> output_types, NodeId default_node_id,
+                                                              Type default_type);
+    std::shared_ptr<ClientRequest> RandomWalkAsync(int64_t seed, float p, float q, NodeId default_node_id,
+                                                   std::span<const NodeId> node_ids, std::span<const Type> edge_types,
+                                                   size_t walk_length, std::span<NodeId> output);
+    std::shared_ptr<ClientRequest> NegativeSampleAsync(int64_t seed, NodeId default_node_id,
+                                                       std::span<const NodeId> node_ids,
+                                                       std::span<const Type> edge_types, size_t count,
+                                                       std::span<NodeId> output);
+    std::shared_ptr<ClientRequest> SampleNodesAsync(int64_t seed, uint64_t sampler_id, std::span<NodeId> out_node_ids,
+                                                    std::span<Type> output_types);
+    std::shared_ptr<ClientRequest> SampleEdgesAsync(int64_t seed, uint64_t sampler_id,
+                                                    std::span<NodeId> out_src_node_ids, std::span<Type> output_types,
+                                                    std::span<NodeId> out_dst_node_ids);
+
+    // Subscribe to batches of batch_size elements from a sampler. Servers push batches ahead of reads and the
+    // client buffers up to prefetch batches per server. Batch i is the same as SampleNodes or SampleEdges output
+    // with seed + i. Streams end after batches batches or run until they are closed if batches is 0.
+    uint64_t CreateSampleStream(int64_t seed, uint64_t sampler_id, bool is_edge, size_t batch_size, size_t prefetch,
+                                uint64_t batches = 0);
+
+    // Read the next batch of a stream, output sizes must be equal to the stream batch size.
+    void NextSampledNodes(uint64_t stream_id, std::span<NodeId> out_node_ids, std::span<Type> out_types);
+    void NextSampledEdges(uint64_t stream_id, std::span<NodeId> out_src_node_ids, std::span<Type> out_types,
+                          std::span<NodeId> out_dst_node_ids);
+    void CloseSampleStream(uint64_t stream_id);
     void WriteMetadata(std::filesystem::path path);
 
+    // Fetch node ids from every shard to send requests only to shards that own nodes.
+    // Nodes missing from the index or stored in multiple shards are sent to all shards. Routes are replaced
+    // as a whole, so it can run concurrently with requests, they keep the routes they started with.
+    void LoadNodeRoutes();
+
+    // Drop cached feature values and load node routes again if they were loaded, so the client sees features and
+    // node records changed by a server reload. Clients do the same on their own once replies show a replica was
+    // reloaded: feature caches are cleared, requests are sent to all shards until routes are fetched again on
+    // a background thread.
+    void Refresh();
+
+    ClientCallStats CallStats() const;
+
+    // Round trip latencies, request counts and reply sizes of RPCs sent by the client.
+    StatsReply LatencyStats() const;
+
+    // Fetch server side metrics from every replica of every shard.
+    std::vector<std::vector<StatsReply>> ServerStats();
+
     ~GRPCClient();
 
   private:
+    class SampleStream;
+    class UnaryCall;
+    class FeatureBatch;
+
+    void LookupNodeFeature(std::span<const NodeId> node_ids, std::span<FeatureMeta> features,
+                           std::span<uint8_t> output, FeatureEncoding encoding);
+    void FetchNodeFeature(std::span<const NodeId> node_ids, std::span<FeatureMeta> features,
+                          std::span<uint8_t> output, FeatureEncoding encoding);
+    void FetchEdgeFeature(std::span<const NodeId> edge_src_ids, std::span<const NodeId> edge_dst_ids,
+                          std::span<const Type> edge_types, std::span<FeatureMeta> features,
+                          std::span<uint8_t> output, FeatureEncoding encoding);
+
+    // Send shard requests of a feature fetch in the current round of a request, missing values are filled with
+    // zeros by a continuation.
+    void FetchNodeFeature(ClientRequest &request, std::span<const NodeId> node_ids, std::span<FeatureMeta> features,
+                          std::span<uint8_t> output, FeatureEncoding encoding);
+    void FetchEdgeFeature(ClientRequest &request, std::span<const NodeId> edge_src_ids,
+                          std::span<const NodeId> edge_dst_ids, std::span<const Type> edge_types,
+                          std::span<FeatureMeta> features, std::span<uint8_t> output, FeatureEncoding encoding);
+
+    // Create a request and run its first round with method(request) on the calling thread.
+    std::shared_ptr<ClientRequest> StartRequest(const std::function<void(ClientRequest &)> &method);
+
+    // Stable address of a feature set to tell apart cached values of the same node or edge.
+    const void *FeatureCacheTag(std::string key);
+
+    struct Replica
+    {
+        std::unique_ptr<grpc::GenericStub> m_stub;
+        std::unique_ptr<GraphSampler::Stub> m_sampler_stub;
+        std::atomic<size_t> m_outstanding = 0;
+
+        // Steady clock time in nanoseconds until which the replica is skipped.
+        std::atomic<int64_t> m_down_until = 0;
+
+        // Last server engine version seen in replies, see GraphEngineServiceImpl::Reload.
+        static constexpr uint64_t unknown_version = std::numeric_limits<uint64_t>::max();
+        std::atomic<uint64_t> m_engine_version = unknown_version;
+    };
+
+    static constexpr size_t any_replica = std::numeric_limits<size_t>::max();
+
+    // Send a request to a shard, process is called with the reply on a completion queue thread. Returned future
+    // is set after that or holds an exception if the request failed. Requests to a specific replica are not sent
+    // to other replicas of the shard, served_by is set to the replica that replied before calling process.
+    std::future<void> SendRequest(size_t shard, const char *method, const google::protobuf::MessageLite &request,
+                                  std::function<void(grpc::ByteBuffer &)> process, size_t replica = any_replica,
+                                  size_t *served_by = nullptr);
+
+    // Same as above with a reply parsed from a message before calling callback.
+    template <typename Reply>
+    std::future<void> SendRequest(size_t shard, const char *method, const google::protobuf::MessageLite &request,
+                                  Reply &reply, std::function<void()> callback, size_t replica = any_replica,
+                                  size_t *served_by = nullptr);
+
+    // Send a shard request in the current round of a client request instead of returning a future, the request
+    // fails if any shard request fails.
+    void SendRequest(ClientRequest &call, size_t shard, const char *method,
+                     const google::protobuf::MessageLite &request, std::function<void(grpc::ByteBuffer &)> process,
+                     size_t replica = any_replica);
+    template <typename Reply>
+    void SendRequest(ClientRequest &call, size_t shard, const char *method,
+                     const google::protobuf::MessageLite &request, Reply &reply, std::function<void()> callback,
+                     size_t replica = any_replica);
+
+    // Shard request ready to start, completions go to call if it is set or to the future returned by Start.
+    std::shared_ptr<UnaryCall> NewCall(size_t shard, const char *method, const google::protobuf::MessageLite &request,
+                                       std::function<void(grpc::ByteBuffer &)> process, size_t replica,
+                                       size_t *served_by, std::shared_ptr<ClientRequest> call);
+
+    // Pick a replica of a shard to send a request to, skipping unavailable replicas and replicas in excluded
+    // unless there are no other replicas.
+    size_t PickReplica(size_t shard, std::span<const size_t> excluded = {});
+
+    // Stream with a given id, throws std::invalid_argument if the id was never returned or the stream is closed.
+    std::shared_ptr<SampleStream> FindSampleStream(uint64_t stream_id);
+
+    // Current node routes, empty if they are not loaded or stale.
+    std::shared_ptr<const NodeRoutes> Routes() const;
+    NodeRoutes FetchNodeRoutes();
+
+    // Record engine version from a reply of a replica, drop state derived from previous server partitions if the
+    // replica was reloaded since its last reply. Called on completion queue threads.
+    void ObserveEngineVersion(Replica &replica, uint64_t version);
+
+    // Fetch node routes until no reload is observed while they are fetched, runs on m_routes_thread.
+    void ReloadNodeRoutes();
+
     std::mutex m_sampler_mutex;
     std::vector<std::vector<uint64_t>> m_sampler_ids;
     std::vector<std::vector<float>> m_sampler_weights;
 
+    // Samplers are created on a single replica of every shard and sample requests are sent only there.
+    std::vector<std::vector<size_t>> m_sampler_replicas;
+    // Slots of closed streams are reused by new streams.
+    std::vector<std::shared_ptr<SampleStream>> m_sample_streams;
+
     std::function<void()> AsyncCompleteRpc(size_t i);
     grpc::CompletionQueue *NextCompletionQueue();
 
-    std::vector<std::unique_ptr<GraphEngine::Stub>> m_engine_stubs;
-    std::vector<std::unique_ptr<GraphSampler::Stub>> m_sampler_stubs;
+    std::vector<std::vector<std::unique_ptr<Replica>>> m_replicas;
+
+    // Open feature batches waiting for more callers, keyed by requested features.
+    std::mutex m_feature_batch_mutex;
+    absl::flat_hash_map<std::string, std::shared_ptr<FeatureBatch>> m_feature_batches;
+
+    std::unique_ptr<FeatureCache> m_feature_cache;
+    std::mutex m_feature_cache_mutex;
+    std::set<std::string> m_feature_cache_tags;
     std::vector<grpc::CompletionQueue> m_completion_queue;
+
+    // Routes are replaced under the mutex and requests copy the pointer once.
+    mutable std::mutex m_routes_mutex;
+    std::shared_ptr<const NodeRoutes> m_node_shards = std::make_shared<const NodeRoutes>();
+    bool m_routes_loaded = false;
+    bool m_routes_loading = false;
+    bool m_closing = false;
+    uint64_t m_routes_generation = 0;
+    std::thread m_routes_thread;
+
+    // Number of nodes stored on every shard from the last negative sampling replies.
+    std::mutex m_node_counts_mutex;
+    std::vector<uint64_t> m_shard_node_counts;
     std::vector<std::thread> m_reply_threads;
     std::atomic<size_t> m_counter;
+
+    ClientCallConfig m_call_config;
+    ClientMetrics m_metrics;
+    std::atomic<size_t> m_requests = 0;
+    std::atomic<size_t> m_hedged = 0;
+    std::atomic<size_t> m_hedge_wins = 0;
+    std::atomic<size_t> m_failovers = 0;
+    std::atomic<size_t> m_coalesced = 0;
+    std::atomic<size_t> m_deadline_exceeded = 0;
+    std::atomic<size_t> m_failed = 0;
 };
 
 } // namespace snark
@@ -0,0 +1,232 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "src/cc/lib/distributed/feature_encoding.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+float bits_float(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Round to nearest even like hardware conversions: values too large for half precision become infinities and small
+// ones become subnormals.
+uint16_t to_float16(float value)
+{
+    uint32_t bits = float_bits(value);
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    bits &= 0x7fffffffu;
+
+    uint32_t result;
+    if (bits >= (127u + 16u) << 23)
+    {
+        // Infinities and NaNs, everything above 65536 overflows.
+        result = bits > 0x7f800000u ? 0x7e00u : 0x7c00u;
+    }
+    else if (bits < 113u << 23)
+    {
+        // Adding 0.5 aligns half subnormal mantissa to the bottom of float mantissa, the addition rounds it.
+        const uint32_t magic = 126u << 23;
+        result = float_bits(bits_float(bits) + bits_float(magic)) - magic;
+    }
+    else
+    {
+        const uint32_t odd = (bits >> 13) & 1u;
+        bits += ((15u - 127u) << 23) + 0xfffu + odd;
+        result = bits >> 13;
+    }
+
+    return uint16_t(result | sign);
+}
+
+float from_float16(uint16_t value)
+{
+    const uint32_t exponent_mask = 0x7c00u << 13;
+    uint32_t bits = uint32_t(value & 0x7fffu) << 13;
+    const uint32_t exponent = bits & exponent_mask;
+    bits += (127u - 15u) << 23;
+    if (exponent == exponent_mask)
+    {
+        bits += (128u - 16u) << 23;
+    }
+    else if (exponent == 0)
+    {
+        bits = float_bits(bits_float(bits + (1u << 23)) - bits_float(113u << 23));
+    }
+
+    return bits_float(bits | (uint32_t(value & 0x8000u) << 16));
+}
+
+uint16_t to_bfloat16(float value)
+{
+    const uint32_t bits = float_bits(value);
+    if ((bits & 0x7fffffffu) > 0x7f800000u)
+    {
+        // Keep NaNs quiet, rounding could turn them into infinities.
+        return uint16_t((bits >> 16) | 0x40u);
+    }
+
+    return uint16_t((bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16);
+}
+
+float from_bfloat16(uint16_t value)
+{
+    return bits_float(uint32_t(value) << 16);
+}
+
+size_t encoded_size(snark::FeatureEncoding encoding, size_t size)
+{
+    switch (encoding)
+    {
+    case snark::FEATURE_ENCODING_FLOAT16:
+    case snark::FEATURE_ENCODING_BFLOAT16:
+        return size / 2;
+    case snark::FEATURE_ENCODING_INT8:
+        return sizeof(float) + size / sizeof(float);
+    default:
+        return size;
+    }
+}
+} // namespace
+
+namespace snark
+{
+
+bool CanEncodeFeatures(FeatureEncoding encoding, std::span<const FeatureMeta> features)
+{
+    if (encoding == FEATURE_ENCODING_RAW)
+    {
+        return true;
+    }
+    if (!FeatureEncoding_IsValid(encoding))
+    {
+        return false;
+    }
+
+    // Values of every node have to be non empty to split batches into nodes.
+    return EncodedFeaturesSize(FEATURE_ENCODING_RAW, features) > 0 &&
+           std::all_of(std::begin(features), std::end(features),
+                       [](const FeatureMeta &feature) { return feature.second % sizeof(float) == 0; });
+}
+
+size_t EncodedFeaturesSize(FeatureEncoding encoding, std::span<const FeatureMeta> features)
+{
+    size_t size = 0;
+    for (const auto &feature : features)
+    {
+        size += encoded_size(encoding, feature.second);
+    }
+
+    return size;
+}
+
+void EncodeFeatures(FeatureEncoding encoding, std::span<const FeatureMeta> features, std::span<const uint8_t> values,
+                    std::span<uint8_t> output)
+{
+    if (encoding == FEATURE_ENCODING_RAW)
+    {
+        std::copy(std::begin(values), std::end(values), std::begin(output));
+        return;
+    }
+
+    auto out = output.data();
+    std::vector<float> floats;
+    for (auto input = values.data(); input < values.data() + values.size();)
+    {
+        for (const auto &feature : features)
+        {
+            floats.resize(feature.second / sizeof(float));
+            std::memcpy(floats.data(), input, floats.size() * sizeof(float));
+            input += feature.second;
+            if (encoding == FEATURE_ENCODING_INT8)
+            {
+                // Every feature gets its own scale, so features with different ranges keep their precision.
+                float max_value = 0;
+                for (auto value : floats)
+                {
+                    max_value = std::isfinite(value) ? std::max(max_value, std::abs(value)) : max_value;
+                }
+
+                const float scale = max_value / 127.0f;
+                std::memcpy(out, &scale, sizeof(scale));
+                out += sizeof(scale);
+                for (auto value : floats)
+                {
+                    const float scaled =
+                        scale > 0 && !std::isnan(value) ? std::clamp(value / scale, -127.0f, 127.0f) : 0.0f;
+                    *out++ = uint8_t(int8_t(std::lrint(scaled)));
+                }
+
+                continue;
+            }
+
+            for (auto value : floats)
+            {
+                const uint16_t half = encoding == FEATURE_ENCODING_FLOAT16 ? to_float16(value) : to_bfloat16(value);
+                std::memcpy(out, &half, sizeof(half));
+                out += sizeof(half);
+            }
+        }
+    }
+}
+
+void DecodeFeatures(FeatureEncoding encoding, std::span<const FeatureMeta> features, std::span<const uint8_t> encoded,
+                    std::span<uint8_t> output)
+{
+    if (encoding == FEATURE_ENCODING_RAW)
+    {
+        std::copy(std::begin(encoded), std::end(encoded), std::begin(output));
+        return;
+    }
+
+    auto out = output.data();
+    for (auto input = encoded.data(); input < encoded.data() + encoded.size();)
+    {
+        for (const auto &feature : features)
+        {
+            const size_t count = feature.second / sizeof(float);
+            float scale = 0;
+            if (encoding == FEATURE_ENCODING_INT8)
+            {
+                std::memcpy(&scale, input, sizeof(scale));
+                input += sizeof(scale);
+            }
+
+            for (size_t index = 0; index < count; ++index)
+            {
+                float value;
+                if (encoding == FEATURE_ENCODING_INT8)
+                {
+                    value = float(int8_t(*input++)) * scale;
+                }
+                else
+                {
+                    uint16_t half;
+                    std::memcpy(&half, input, sizeof(half));
+                    input += sizeof(half);
+                    value = encoding == FEATURE_ENCODING_FLOAT16 ? from_float16(half) : from_bfloat16(half);
+                }
+
+                std::memcpy(out, &value, sizeof(value));
+                out += sizeof(value);
+            }
+        }
+    }
+}
+
+} // namespace snark
@@ -0,0 +1,37 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_FEATURE_ENCODING_H
+#define SNARK_FEATURE_ENCODING_H
+
+#include <cstdint>
+#include <span>
+
+#include "src/cc/lib/distributed/service.pb.h"
+#include "src/cc/lib/graph/types.h"
+
+namespace snark
+{
+
+// Dense features are encoded separately for every node or edge: values of all requested features are stored one
+// after another as they are in raw replies. Quantized encodings treat feature values as float32 arrays.
+
+// Check if features can be sent with encoding, quantized encodings require feature sizes to be multiples of 4.
+// Feature types are not known here, callers request quantized encodings only for float32 features.
+bool CanEncodeFeatures(FeatureEncoding encoding, std::span<const FeatureMeta> features);
+
+// Number of bytes of encoded values of all features of a node or an edge.
+size_t EncodedFeaturesSize(FeatureEncoding encoding, std::span<const FeatureMeta> features);
+
+// Encode raw values of all features for one or more nodes or edges, output has EncodedFeaturesSize bytes for every
+// one of them.
+void EncodeFeatures(FeatureEncoding encoding, std::span<const FeatureMeta> features, std::span<const uint8_t> values,
+                    std::span<uint8_t> output);
+
+// Decode values produced by EncodeFeatures back to raw float32 values.
+void DecodeFeatures(FeatureEncoding encoding, std::span<const FeatureMeta> features, std::span<const uint8_t> encoded,
+                    std::span<uint8_t> output);
+
+} // namespace snark
+
+#endif // SNARK_FEATURE_ENCODING_H
@@ -4,29 +4,98 @@
 #include "src/cc/lib/distributed/server.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
 #include <span>
 
 #include "absl/container/flat_hash_set.h"
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
+#include <google/protobuf/io/coded_stream.h>
 
+#include "src/cc/lib/distributed/feature_encoding.h"
+#include "src/cc/lib/distributed/metrics.h"
 #include "src/cc/lib/graph/locator.h"
+#include "src/cc/lib/graph/negative_sampling.h"
+#include "src/cc/lib/graph/numa.h"
+#include "src/cc/lib/graph/parallel.h"
+#include "src/cc/lib/graph/random_walk.h"
+#include "src/cc/lib/graph/xoroshiro.h"
 
 namespace
 {
 static const std::string neighbors_prefix = "neighbors_";
 static const size_t neighbors_prefix_len = neighbors_prefix.size();
 
+// Largest GetNodeIds page, 2MB of ids keeps replies under the default 4MB message size limit.
+static const size_t node_ids_page_size = size_t(1) << 18;
+
+// Time for workers of NUMA nodes to pick up partition reads before the request thread reads them itself.
+constexpr auto numa_read_delay = std::chrono::microseconds(50);
+
+void FillSparseFeaturesReply(const snark::SparseFeatureBatch &batch, snark::SparseFeaturesReply &response)
+{
+    response.mutable_dimensions()->Assign(std::begin(batch.m_dimensions), std::end(batch.m_dimensions));
+    response.mutable_indices()->Assign(std::begin(batch.m_indices), std::end(batch.m_indices));
+    response.mutable_values()->assign(std::begin(batch.m_values), std::end(batch.m_values));
+    for (size_t feature = 0; feature < batch.FeatureCount(); ++feature)
+    {
+        response.add_indices_counts(batch.Indices(feature).size());
+        response.add_values_counts(batch.Values(feature).size());
+    }
+}
+
+std::vector<snark::FeatureMeta> request_features(
+    const google::protobuf::RepeatedPtrField<snark::FeatureInfo> &request_features)
+{
+    std::vector<snark::FeatureMeta> features;
+    features.reserve(request_features.size());
+    for (const auto &feature : request_features)
+    {
+        features.emplace_back(feature.id(), feature.size());
+    }
+
+    return features;
+}
+
+// Encoding of the reply, servers fall back to raw values for features that can't be encoded.
+snark::FeatureEncoding reply_encoding(snark::FeatureEncoding requested, std::span<const snark::FeatureMeta> features)
+{
+    return snark::CanEncodeFeatures(requested, features) ? requested : snark::FEATURE_ENCODING_RAW;
+}
+
+// Compress replies with gzip if a client asked for it, gRPC skips compression for clients that don't support it.
+void compress_reply(grpc::ServerContext *context, bool compress)
+{
+    if (context != nullptr && compress)
+    {
+        context->set_compression_algorithm(GRPC_COMPRESS_GZIP);
+    }
+}
 } // namespace
 
 namespace snark
 {
 
-GraphEngineServiceImpl::GraphEngineServiceImpl(std::string path, std::vector<uint32_t> partitions,
-                                               PartitionStorageType storage_type, std::string config_path)
-    : m_metadata(path, config_path)
+GraphEngineSnapshot::GraphEngineSnapshot(std::string path, std::vector<uint32_t> partitions,
+                                         PartitionStorageType storage_type, std::string config_path,
+                                         FeatureCacheConfig feature_cache, bool compact_node_index,
+                                         bool compressed_edges, size_t alias_threshold,
+                                         std::vector<FeatureId> columnar_features, bool numa_placement,
+                                         size_t edge_index_threshold, HDFSReadOptions hdfs_read,
+                                         const GraphEngineSnapshot *previous, std::shared_ptr<NodeWorkers> node_workers)
+    : m_node_workers(std::move(node_workers)), m_metadata(path, config_path)
 {
+    m_metadata.m_hdfs_read = hdfs_read;
+
     std::vector<std::string> suffixes;
     absl::flat_hash_set<uint32_t> partition_set(std::begin(partitions), std::end(partitions));
     // Go through the path folder with graph binary files.
@@ -61,33 +130,168 @@ GraphEngineServiceImpl::GraphEngineServiceImpl(std::string path, std::vector<uin
         }
     }
     std::sort(std::begin(suffixes), std::end(suffixes));
-    m_partitions.reserve(suffixes.size());
+    m_suffixes = suffixes;
+    m_partition_versions.resize(suffixes.size());
+    for (size_t i = 0; i < suffixes.size(); ++i)
+    {
+        m_partition_versions[i] = partition_version(path, suffixes[i]);
+    }
+
+    // Partitions with unchanged files are taken from the previous snapshot, so a reload only keeps two copies
+    // of replaced partitions in memory. Partitions read feature values through the cache they were loaded with
+    // and the cache is keyed by storage addresses, which may be reused by new partitions once replaced ones are
+    // released, so everything is loaded again with a new cache if any partition of a cached graph is dropped.
+    const auto not_reused = std::numeric_limits<size_t>::max();
+    m_partitions.resize(suffixes.size());
+    std::vector<size_t> reused(suffixes.size(), not_reused);
+    if (previous != nullptr && previous->m_metadata.m_node_feature_count == m_metadata.m_node_feature_count &&
+        previous->m_metadata.m_edge_feature_count == m_metadata.m_edge_feature_count)
+    {
+        absl::flat_hash_map<std::string, size_t> previous_suffixes;
+        for (size_t i = 0; i < previous->m_suffixes.size(); ++i)
+        {
+            previous_suffixes.emplace(previous->m_suffixes[i], i);
+        }
+
+        size_t reused_count = 0;
+        for (size_t i = 0; i < suffixes.size(); ++i)
+        {
+            auto it = previous_suffixes.find(suffixes[i]);
+            if (it != std::end(previous_suffixes) && !m_partition_versions[i].empty() &&
+                previous->m_partition_versions[it->second] == m_partition_versions[i])
+            {
+                reused[i] = it->second;
+                ++reused_count;
+            }
+        }
+
+        if (previous->m_feature_cache == nullptr || reused_count == previous->m_suffixes.size())
+        {
+            m_feature_cache = previous->m_feature_cache;
+        }
+        else
+        {
+            std::fill(std::begin(reused), std::end(reused), not_reused);
+        }
+    }
+    if (m_feature_cache == nullptr && feature_cache.m_capacity > 0 && storage_type == PartitionStorageType::disk)
+    {
+        m_feature_cache = std::make_shared<FeatureCache>(feature_cache.m_capacity, feature_cache.m_shard_count);
+    }
+
+    // Partitions are independent, so they are loaded concurrently. Node index keeps records
+    // in the order of suffixes to get deterministic node lookups and sampling results.
+    std::vector<size_t> pending;
     for (size_t i = 0; i < suffixes.size(); ++i)
     {
-        m_partitions.emplace_back(path, suffixes[i], storage_type);
-        ReadNodeMap(path, suffixes[i], i);
+        if (reused[i] == not_reused)
+        {
+            pending.emplace_back(i);
+        }
+        else
+        {
+            m_partitions[i] = previous->m_partitions[reused[i]];
+            ++m_reused_partitions;
+        }
+    }
+    std::vector<std::vector<NodeId>> node_ids(suffixes.size());
+    const auto load = [&](size_t j) {
+        const auto i = pending[j];
+        m_partitions[i] =
+            std::make_shared<const Partition>(path, suffixes[i], storage_type, m_feature_cache, compressed_edges,
+                                              alias_threshold, columnar_features, nullptr, edge_index_threshold,
+                                              hdfs_read);
+    };
+    if (numa_placement)
+    {
+        // Memory is allocated on the node of the thread touching it first. Mmap storage reads pages on request
+        // threads instead, so only partitions copied to memory are placed.
+        const auto nodes = numa_nodes();
+        numa_parallel_for(pending.size(), nodes, load);
+        if (nodes.size() > 1)
+        {
+            // Reused partitions stay on the node they were loaded on.
+            m_partition_nodes.resize(suffixes.size());
+            for (size_t i = 0; i < suffixes.size(); ++i)
+            {
+                if (reused[i] != not_reused && reused[i] < previous->m_partition_nodes.size())
+                {
+                    m_partition_nodes[i] = previous->m_partition_nodes[reused[i]] % nodes.size();
+                }
+            }
+            for (size_t j = 0; j < pending.size(); ++j)
+            {
+                m_partition_nodes[pending[j]] = j % nodes.size();
+            }
+        }
+    }
+    else
+    {
+        parallel_for(pending.size(), load);
+    }
+    parallel_for(suffixes.size(), [&](size_t i) { node_ids[i] = ReadNodeIds(path, suffixes[i]); });
+    m_node_map =
+        NodeIndex(std::move(node_ids), m_partitions_indices, m_internal_indices, m_counts, compact_node_index);
+
+    if (m_feature_cache != nullptr && feature_cache.m_warm)
+    {
+        WarmFeatureCache(partitions);
     }
 }
 
-grpc::Status GraphEngineServiceImpl::GetNodeTypes(::grpc::ServerContext *context,
-                                                  const snark::NodeTypesRequest *request,
-                                                  snark::NodeTypesReply *response)
+size_t GraphEngineSnapshot::ReusedPartitions() const
+{
+    return m_reused_partitions;
+}
+
+void GraphEngineSnapshot::WarmFeatureCache(std::span<const uint32_t> partitions)
+{
+    // Leave space for uneven distribution of features between cache shards.
+    uint64_t budget = m_feature_cache->Capacity() / 10 * 9;
+    for (auto node : NodesByWeight(m_metadata, partitions))
+    {
+        auto index = m_node_map.Find(node);
+        if (index == NodeIndex::npos)
+        {
+            continue;
+        }
+
+        const size_t partition_count = m_counts[index];
+        for (size_t partition = 0; partition < partition_count; ++partition, ++index)
+        {
+            const auto &p = *m_partitions[m_partitions_indices[index]];
+            if (p.HasNodeFeatures(m_internal_indices[index]))
+            {
+                if (!p.WarmNodeFeatureCache(m_internal_indices[index], budget))
+                {
+                    return;
+                }
+                break;
+            }
+        }
+    }
+}
+
+grpc::Status GraphEngineSnapshot::GetNodeTypes(::grpc::ServerContext *context, const snark::NodeTypesRequest *request,
+                                               snark::NodeTypesReply *response) const
 {
+    count_request_nodes(request->node_ids_size());
+    const auto indices = FindNodes(request->node_ids());
     for (int curr_offset = 0; curr_offset < request->node_ids().size(); ++curr_offset)
     {
-        auto elem = m_node_map.find(request->node_ids()[curr_offset]);
-        if (elem == std::end(m_node_map))
+        PrefetchRecord(indices, curr_offset + prefetch_distance);
+        auto index = indices[curr_offset];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
 
-        auto index = elem->second;
         const size_t partition_count = m_counts[index];
         Type result = snark::PLACEHOLDER_NODE_TYPE;
         for (size_t partition = 0; partition < partition_count && result == snark::PLACEHOLDER_NODE_TYPE;
              ++partition, ++index)
         {
-            result = m_partitions[m_partitions_indices[index]].GetNodeType(m_internal_indices[index]);
+            result = m_partitions[m_partitions_indices[index]]->GetNodeType(m_internal_indices[index]);
         }
         if (result == snark::PLACEHOLDER_NODE_TYPE)
             continue;
@@ -98,54 +302,267 @@ grpc::Status GraphEngineServiceImpl::GetNodeTypes(::grpc::ServerContext *context
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::GetNodeFeatures(::grpc::ServerContext *context,
+grpc::Status GraphEngineSnapshot::GetNodeFeatures(::grpc::ServerContext *context,
+                                                  const snark::NodeFeaturesRequest *request,
+                                                  snark::NodeFeaturesReply *response) const
+{
+    std::vector<std::vector<uint64_t>> internal_ids(m_partitions.size());
+    std::vector<std::vector<size_t>> output_offsets(m_partitions.size());
+    std::vector<uint32_t> node_offsets;
+    const size_t values_size = LocateNodeFeatures(*request, internal_ids, output_offsets, node_offsets);
+    response->mutable_offsets()->Add(std::begin(node_offsets), std::end(node_offsets));
+    const auto features = request_features(request->features());
+    const auto encoding = reply_encoding(request->encoding(), features);
+    const size_t encoded_size = node_offsets.size() * EncodedFeaturesSize(encoding, features);
+    response->set_encoding(encoding);
+    response->mutable_feature_values()->resize(encoded_size);
+    auto data = std::span(reinterpret_cast<uint8_t *>(response->mutable_feature_values()->data()), encoded_size);
+    if (encoding == FEATURE_ENCODING_RAW)
+    {
+        FetchNodeFeatures(*request, internal_ids, output_offsets, data);
+    }
+    else
+    {
+        std::vector<uint8_t> values(values_size);
+        FetchNodeFeatures(*request, internal_ids, output_offsets, values);
+        EncodeFeatures(encoding, features, values, data);
+    }
+    count_request_bytes(values_size);
+    count_reply_bytes(encoded_size);
+
+    return grpc::Status::OK;
+}
+
+grpc::Status GraphEngineSnapshot::GetNodeFeaturesRaw(::grpc::ServerContext *context,
                                                      const snark::NodeFeaturesRequest *request,
-                                                     snark::NodeFeaturesReply *response)
+                                                     grpc::ByteBuffer *response) const
 {
-    std::vector<snark::FeatureMeta> features;
+    using google::protobuf::io::CodedOutputStream;
+
+    std::vector<std::vector<uint64_t>> internal_ids(m_partitions.size());
+    std::vector<std::vector<size_t>> output_offsets(m_partitions.size());
+    std::vector<uint32_t> node_offsets;
+    const size_t values_size = LocateNodeFeatures(*request, internal_ids, output_offsets, node_offsets);
+    if (node_offsets.empty())
+    {
+        grpc::ByteBuffer(nullptr, 0).Swap(response);
+        return grpc::Status::OK;
+    }
+    if (values_size > std::numeric_limits<uint32_t>::max())
+    {
+        return grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "Node features don't fit in a single reply");
+    }
+
+    // Field tags of NodeFeaturesReply with length delimited wire type, encoding is a varint sent before offsets.
+    const uint8_t values_tag = (NodeFeaturesReply::kFeatureValuesFieldNumber << 3) | 2;
+    const uint8_t offsets_tag = (NodeFeaturesReply::kOffsetsFieldNumber << 3) | 2;
+    const uint8_t encoding_tag = NodeFeaturesReply::kEncodingFieldNumber << 3;
+    const auto features = request_features(request->features());
+    const auto encoding = reply_encoding(request->encoding(), features);
+    const size_t encoded_size = node_offsets.size() * EncodedFeaturesSize(encoding, features);
+    uint32_t offsets_size = 0;
+    for (auto offset : node_offsets)
+    {
+        offsets_size += CodedOutputStream::VarintSize32(offset);
+    }
+
+    StageTimer serialize_timer(RequestStage::serialize);
+    const auto values_length = uint32_t(encoded_size);
+    const size_t encoding_size = encoding == FEATURE_ENCODING_RAW ? 0 : 2;
+    grpc_slice header = grpc_slice_malloc(2 + encoding_size + CodedOutputStream::VarintSize32(offsets_size) +
+                                          offsets_size + CodedOutputStream::VarintSize32(values_length));
+    auto header_end = GRPC_SLICE_START_PTR(header);
+    if (encoding != FEATURE_ENCODING_RAW)
+    {
+        *header_end++ = encoding_tag;
+        *header_end++ = uint8_t(encoding);
+    }
+    *header_end++ = offsets_tag;
+    header_end = CodedOutputStream::WriteVarint32ToArray(offsets_size, header_end);
+    for (auto offset : node_offsets)
+    {
+        header_end = CodedOutputStream::WriteVarint32ToArray(offset, header_end);
+    }
+    *header_end++ = values_tag;
+    CodedOutputStream::WriteVarint32ToArray(values_length, header_end);
+    serialize_timer.Stop();
+
+    grpc_slice values = grpc_slice_malloc(encoded_size);
+    const auto values_data = std::span(GRPC_SLICE_START_PTR(values), encoded_size);
+    if (encoding == FEATURE_ENCODING_RAW)
+    {
+        FetchNodeFeatures(*request, internal_ids, output_offsets, values_data);
+    }
+    else
+    {
+        std::vector<uint8_t> raw_values(values_size);
+        FetchNodeFeatures(*request, internal_ids, output_offsets, raw_values);
+        EncodeFeatures(encoding, features, raw_values, values_data);
+    }
+    const grpc::Slice slices[] = {grpc::Slice(header, grpc::Slice::STEAL_REF),
+                                  grpc::Slice(values, grpc::Slice::STEAL_REF)};
+    grpc::ByteBuffer(slices, std::size(slices)).Swap(response);
+    count_request_bytes(values_size);
+    count_reply_bytes(encoded_size);
+
+    return grpc::Status::OK;
+}
+
+size_t GraphEngineSnapshot::LocateNodeFeatures(const snark::NodeFeaturesRequest &request,
+                                               std::vector<std::vector<uint64_t>> &internal_ids,
+                                               std::vector<std::vector<size_t>> &output_offsets,
+                                               std::vector<uint32_t> &node_offsets) const
+{
+    StageTimer timer(RequestStage::lookup);
+    count_request_nodes(request.node_ids_size());
     size_t fv_size = 0;
-    for (const auto &feature : request->features())
+    for (const auto &feature : request.features())
     {
-        features.emplace_back(feature.id(), feature.size());
         fv_size += feature.size();
     }
 
     size_t feature_offset = 0;
-    for (int node_offset = 0; node_offset < request->node_ids().size(); ++node_offset)
+    const auto indices = FindNodes(request.node_ids());
+    for (int node_offset = 0; node_offset < request.node_ids().size(); ++node_offset)
     {
-        auto internal_id = m_node_map.find(request->node_ids()[node_offset]);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_offset + prefetch_distance);
+        auto index = indices[node_offset];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
 
-        response->mutable_feature_values()->resize(feature_offset + fv_size);
-        auto index = internal_id->second;
         const size_t partition_count = m_counts[index];
-        auto data = reinterpret_cast<uint8_t *>(response->mutable_feature_values()->data());
-        auto data_span = std::span(data + feature_offset, fv_size);
         for (size_t partition = 0; partition < partition_count; ++partition, ++index)
         {
-            if (m_partitions[m_partitions_indices[index]].HasNodeFeatures(m_internal_indices[index]))
+            const auto partition_index = m_partitions_indices[index];
+            if (m_partitions[partition_index]->HasNodeFeatures(m_internal_indices[index]))
             {
-                response->mutable_feature_values()->resize(feature_offset + fv_size);
-                m_partitions[m_partitions_indices[index]].GetNodeFeature(m_internal_indices[index], features,
-                                                                         data_span);
+                internal_ids[partition_index].emplace_back(m_internal_indices[index]);
+                output_offsets[partition_index].emplace_back(feature_offset);
                 feature_offset += fv_size;
-                response->add_offsets(node_offset);
+                node_offsets.emplace_back(node_offset);
                 break;
             }
         }
     }
 
-    return grpc::Status::OK;
+    return feature_offset;
 }
 
-grpc::Status GraphEngineServiceImpl::GetEdgeFeatures(::grpc::ServerContext *context,
-                                                     const snark::EdgeFeaturesRequest *request,
-                                                     snark::EdgeFeaturesReply *response)
+void GraphEngineSnapshot::FetchNodeFeatures(const snark::NodeFeaturesRequest &request,
+                                            const std::vector<std::vector<uint64_t>> &internal_ids,
+                                            const std::vector<std::vector<size_t>> &output_offsets,
+                                            std::span<uint8_t> data) const
+{
+    StageTimer timer(RequestStage::read);
+    auto features = request_features(request.features());
+    const auto read = [&](size_t partition) {
+        m_partitions[partition]->GetNodeFeature(internal_ids[partition], output_offsets[partition], features, data);
+    };
+    std::shared_lock<std::shared_mutex> workers_lock;
+    if (m_node_workers != nullptr && !m_partition_nodes.empty())
+    {
+        workers_lock = std::shared_lock(m_node_workers->m_mutex);
+    }
+    if (!workers_lock.owns_lock() || m_node_workers->m_pools.empty())
+    {
+        for (size_t partition = 0; partition < m_partitions.size(); ++partition)
+        {
+            if (!internal_ids[partition].empty())
+            {
+                read(partition);
+            }
+        }
+        return;
+    }
+
+    // Partitions write features of their nodes to separate parts of the output, so they are read concurrently by
+    // workers of their NUMA nodes. Workers also process requests and might be busy or waiting for reads of their
+    // own, so after a short delay the request thread reads partitions no worker has taken. Workers taking a read
+    // after that only touch the shared state.
+    struct Reads
+    {
+        explicit Reads(size_t count) : m_taken(count)
+        {
+        }
+
+        std::vector<std::atomic<bool>> m_taken;
+        size_t m_remaining = 0;
+        std::exception_ptr m_error;
+        std::mutex m_mutex;
+        std::condition_variable m_done;
+    };
+    auto reads = std::make_shared<Reads>(m_partitions.size());
+    const auto take = [&read](Reads &reads, size_t partition) {
+        if (reads.m_taken[partition].exchange(true))
+        {
+            return;
+        }
+
+        std::exception_ptr error;
+        try
+        {
+            read(partition);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        // Notify under the lock to keep the request thread waiting until the last read is done with the state.
+        std::lock_guard lock(reads.m_mutex);
+        if (error && !reads.m_error)
+        {
+            reads.m_error = error;
+        }
+        if (--reads.m_remaining == 0)
+        {
+            reads.m_done.notify_one();
+        }
+    };
+    for (const auto &ids : internal_ids)
+    {
+        reads->m_remaining += ids.empty() ? 0 : 1;
+    }
+
+    const auto &pools = m_node_workers->m_pools;
+    for (size_t partition = 0; partition < m_partitions.size(); ++partition)
+    {
+        if (!internal_ids[partition].empty())
+        {
+            pools[m_partition_nodes[partition] % pools.size()]->Submit(
+                [take, reads, partition]() { take(*reads, partition); });
+        }
+    }
+
+    const auto done = [&reads]() { return reads->m_remaining == 0; };
+    std::unique_lock lock(reads->m_mutex);
+    if (!reads->m_done.wait_for(lock, numa_read_delay, done))
+    {
+        lock.unlock();
+        for (size_t partition = 0; partition < m_partitions.size(); ++partition)
+        {
+            if (!internal_ids[partition].empty())
+            {
+                take(*reads, partition);
+            }
+        }
+        lock.lock();
+        reads->m_done.wait(lock, done);
+    }
+    if (reads->m_error)
+    {
+        std::rethrow_exception(reads->m_error);
+    }
+}
+
+grpc::Status GraphEngineSnapshot::GetEdgeFeatures(::grpc::ServerContext *context,
+                                                  const snark::EdgeFeaturesRequest *request,
+                                                  snark::EdgeFeaturesReply *response) const
 {
     const size_t len = request->types().size();
+    count_request_nodes(len);
 
     // First part is source, second is destination
     assert(2 * len == size_t(request->node_ids().size()));
@@ -157,130 +574,132 @@ grpc::Status GraphEngineServiceImpl::GetEdgeFeatures(::grpc::ServerContext *cont
         fv_size += feature.size();
     }
 
+    const auto locations = LocateEdges(request->node_ids(), request->types());
+    size_t found_count = 0;
+    for (const auto &location : locations)
+    {
+        found_count += location.m_edge != Partition::npos;
+    }
+
     size_t feature_offset = 0;
+    response->mutable_feature_values()->resize(found_count * fv_size);
+    auto data = reinterpret_cast<uint8_t *>(response->mutable_feature_values()->data());
     for (size_t node_offset = 0; node_offset < len; ++node_offset)
     {
-        auto internal_id = m_node_map.find(request->node_ids()[node_offset]);
-        if (internal_id == std::end(m_node_map))
+        const auto &location = locations[node_offset];
+        if (location.m_edge == Partition::npos)
         {
             continue;
         }
 
-        response->mutable_feature_values()->resize(feature_offset + fv_size);
-        auto index = internal_id->second;
-        const size_t partition_count = m_counts[index];
-        auto data = reinterpret_cast<uint8_t *>(response->mutable_feature_values()->data());
-        bool found_edge = false;
-        for (size_t partition = 0; partition < partition_count && !found_edge; ++partition, ++index)
-        {
-            found_edge = m_partitions[m_partitions_indices[index]].GetEdgeFeature(
-                m_internal_indices[index], request->node_ids()[len + node_offset], request->types()[node_offset],
-                features, std::span(data + feature_offset, fv_size));
-        }
-        if (found_edge)
-        {
-            response->add_offsets(node_offset);
-            feature_offset += fv_size;
-        }
-        else
-        {
-            response->mutable_feature_values()->resize(feature_offset);
-        }
+        m_partitions[location.m_partition]->GetEdgeFeature(location.m_edge, features,
+                                                           std::span(data + feature_offset, fv_size));
+        response->add_offsets(node_offset);
+        feature_offset += fv_size;
+    }
+
+    count_request_bytes(feature_offset);
+    const auto encoding = reply_encoding(request->encoding(), features);
+    if (encoding != FEATURE_ENCODING_RAW)
+    {
+        std::string encoded(response->offsets().size() * EncodedFeaturesSize(encoding, features), '\0');
+        EncodeFeatures(encoding, features,
+                       std::span(reinterpret_cast<const uint8_t *>(response->feature_values().data()), feature_offset),
+                       std::span(reinterpret_cast<uint8_t *>(encoded.data()), encoded.size()));
+        response->set_feature_values(std::move(encoded));
+        response->set_encoding(encoding);
     }
+    count_reply_bytes(response->feature_values().size());
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::GetNodeSparseFeatures(::grpc::ServerContext *context,
-                                                           const snark::NodeSparseFeaturesRequest *request,
-                                                           snark::SparseFeaturesReply *response)
+grpc::Status GraphEngineSnapshot::GetNodeSparseFeatures(::grpc::ServerContext *context,
+                                                        const snark::NodeSparseFeaturesRequest *request,
+                                                        snark::SparseFeaturesReply *response) const
 {
+    compress_reply(context, request->compress());
     std::span<const snark::FeatureId> features =
         std::span(std::begin(request->feature_ids()), std::end(request->feature_ids()));
-    auto *reply_dimensions = response->mutable_dimensions();
-    reply_dimensions->Resize(int(features.size()), 0);
-    auto dimensions = std::span(reply_dimensions->begin(), reply_dimensions->end());
-    std::vector<std::vector<int64_t>> indices(features.size());
-    std::vector<std::vector<uint8_t>> values(features.size());
+    count_request_nodes(request->node_ids_size());
 
+    // Nodes are located once and features are filled one by one to keep values of every feature contiguous.
+    std::vector<std::tuple<int64_t, uint32_t, uint64_t>> locations;
+    locations.reserve(request->node_ids().size());
+    const auto indices = FindNodes(request->node_ids());
     for (int node_offset = 0; node_offset < request->node_ids().size(); ++node_offset)
     {
-        auto internal_id = m_node_map.find(request->node_ids()[node_offset]);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_offset + prefetch_distance);
+        auto index = indices[node_offset];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
 
-        auto index = internal_id->second;
         const size_t partition_count = m_counts[index];
-        bool found = false;
-        for (size_t partition = 0; partition < partition_count && !found; ++partition, ++index)
+        for (size_t partition = 0; partition < partition_count; ++partition, ++index)
         {
-            found = m_partitions[m_partitions_indices[index]].GetNodeSparseFeature(
-                m_internal_indices[index], features, int64_t(node_offset), dimensions, indices, values);
+            if (m_partitions[m_partitions_indices[index]]->HasNodeFeatures(m_internal_indices[index]))
+            {
+                locations.emplace_back(node_offset, m_partitions_indices[index], m_internal_indices[index]);
+                break;
+            }
         }
     }
 
-    for (size_t i = 0; i < features.size(); ++i)
+    auto &batch = SparseFeatureBatch::ThreadLocal();
+    batch.Reset(features.size());
+    for (const auto feature : features)
     {
-        response->mutable_indices()->Add(std::begin(indices[i]), std::end(indices[i]));
-        response->mutable_values()->append(std::begin(values[i]), std::end(values[i]));
-        response->mutable_indices_counts()->Add(indices[i].size());
-        response->mutable_values_counts()->Add(values[i].size());
+        for (const auto &[node_offset, partition, internal_id] : locations)
+        {
+            m_partitions[partition]->GetNodeSparseFeature(internal_id, feature, node_offset, batch);
+        }
+        batch.EndFeature();
     }
 
+    FillSparseFeaturesReply(batch, *response);
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::GetEdgeSparseFeatures(::grpc::ServerContext *context,
-                                                           const snark::EdgeSparseFeaturesRequest *request,
-                                                           snark::SparseFeaturesReply *response)
+grpc::Status GraphEngineSnapshot::GetEdgeSparseFeatures(::grpc::ServerContext *context,
+                                                        const snark::EdgeSparseFeaturesRequest *request,
+                                                        snark::SparseFeaturesReply *response) const
 {
+    compress_reply(context, request->compress());
     const size_t len = request->types().size();
+    count_request_nodes(len);
 
     // First part is source, second is destination
     assert(2 * len == size_t(request->node_ids().size()));
     std::span<const snark::FeatureId> features =
         std::span(std::begin(request->feature_ids()), std::end(request->feature_ids()));
-    auto *reply_dimensions = response->mutable_dimensions();
-    reply_dimensions->Resize(int(features.size()), 0);
-    auto dimensions = std::span(reply_dimensions->begin(), reply_dimensions->end());
 
-    std::vector<std::vector<int64_t>> indices(features.size());
-    std::vector<std::vector<uint8_t>> values(features.size());
-    for (size_t node_offset = 0; node_offset < len; ++node_offset)
+    const auto locations = LocateEdges(request->node_ids(), request->types());
+    auto &batch = SparseFeatureBatch::ThreadLocal();
+    batch.Reset(features.size());
+    for (const auto feature : features)
     {
-        auto internal_id = m_node_map.find(request->node_ids()[node_offset]);
-        if (internal_id == std::end(m_node_map))
-        {
-            continue;
-        }
-
-        auto index = internal_id->second;
-        const size_t partition_count = m_counts[index];
-        bool found_edge = false;
-        for (size_t partition = 0; partition < partition_count && !found_edge; ++partition, ++index)
+        for (int64_t node_offset = 0; node_offset < int64_t(len); ++node_offset)
         {
-            found_edge = m_partitions[m_partitions_indices[index]].GetEdgeSparseFeature(
-                m_internal_indices[index], request->node_ids()[len + node_offset], request->types()[node_offset],
-                features, int64_t(node_offset), dimensions, indices, values);
+            const auto &location = locations[node_offset];
+            if (location.m_edge != Partition::npos)
+            {
+                m_partitions[location.m_partition]->GetEdgeSparseFeature(location.m_edge, feature, node_offset,
+                                                                         batch);
+            }
         }
+        batch.EndFeature();
     }
 
-    for (size_t i = 0; i < features.size(); ++i)
-    {
-        response->mutable_indices()->Add(std::begin(indices[i]), std::end(indices[i]));
-        response->mutable_values()->append(std::begin(values[i]), std::end(values[i]));
-        response->mutable_indices_counts()->Add(indices[i].size());
-        response->mutable_values_counts()->Add(values[i].size());
-    }
-
+    FillSparseFeaturesReply(batch, *response);
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::GetNodeStringFeatures(::grpc::ServerContext *context,
-                                                           const snark::NodeSparseFeaturesRequest *request,
-                                                           snark::StringFeaturesReply *response)
+grpc::Status GraphEngineSnapshot::GetNodeStringFeatures(::grpc::ServerContext *context,
+                                                        const snark::NodeSparseFeaturesRequest *request,
+                                                        snark::StringFeaturesReply *response) const
 {
+    compress_reply(context, request->compress());
     std::span<const snark::FeatureId> features =
         std::span(std::begin(request->feature_ids()), std::end(request->feature_ids()));
     const auto features_size = features.size();
@@ -291,23 +710,24 @@ grpc::Status GraphEngineServiceImpl::GetNodeStringFeatures(::grpc::ServerContext
     auto dimensions = std::span(reply_dimensions->begin(), reply_dimensions->end());
     std::vector<uint8_t> values;
 
+    const auto indices = FindNodes(request->node_ids());
     for (int node_offset = 0; node_offset < request->node_ids().size(); ++node_offset)
     {
-        auto internal_id = m_node_map.find(request->node_ids()[node_offset]);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_offset + prefetch_distance);
+        auto index = indices[node_offset];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
 
         auto dims_span = dimensions.subspan(features_size * node_offset, features_size);
 
-        auto index = internal_id->second;
         const size_t partition_count = m_counts[index];
         bool found = false;
         for (size_t partition = 0; partition < partition_count && !found; ++partition, ++index)
         {
-            found = m_partitions[m_partitions_indices[index]].GetNodeStringFeature(m_internal_indices[index], features,
-                                                                                   dims_span, values);
+            found = m_partitions[m_partitions_indices[index]]->GetNodeStringFeature(m_internal_indices[index], features,
+                                                                                    dims_span, values);
         }
     }
 
@@ -315,10 +735,11 @@ grpc::Status GraphEngineServiceImpl::GetNodeStringFeatures(::grpc::ServerContext
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::GetEdgeStringFeatures(::grpc::ServerContext *context,
-                                                           const snark::EdgeSparseFeaturesRequest *request,
-                                                           snark::StringFeaturesReply *response)
+grpc::Status GraphEngineSnapshot::GetEdgeStringFeatures(::grpc::ServerContext *context,
+                                                        const snark::EdgeSparseFeaturesRequest *request,
+                                                        snark::StringFeaturesReply *response) const
 {
+    compress_reply(context, request->compress());
     const size_t len = request->types().size();
 
     // First part is source, second is destination
@@ -331,22 +752,14 @@ grpc::Status GraphEngineServiceImpl::GetEdgeStringFeatures(::grpc::ServerContext
     auto dimensions = std::span(reply_dimensions->begin(), reply_dimensions->end());
     std::vector<uint8_t> values;
 
+    const auto locations = LocateEdges(request->node_ids(), request->types());
     for (size_t edge_offset = 0; edge_offset < len; ++edge_offset)
     {
-        auto internal_id = m_node_map.find(request->node_ids()[edge_offset]);
-        if (internal_id == std::end(m_node_map))
+        const auto &location = locations[edge_offset];
+        if (location.m_edge != Partition::npos)
         {
-            continue;
-        }
-
-        auto index = internal_id->second;
-        const size_t partition_count = m_counts[index];
-        bool found_edge = false;
-        for (size_t partition = 0; partition < partition_count && !found_edge; ++partition, ++index)
-        {
-            found_edge = m_partitions[m_partitions_indices[index]].GetEdgeStringFeature(
-                m_internal_indices[index], request->node_ids()[len + edge_offset], request->types()[edge_offset],
-                features, dimensions.subspan(features_size * edge_offset, features_size), values);
+            m_partitions[location.m_partition]->GetEdgeStringFeature(
+                location.m_edge, features, dimensions.subspan(features_size * edge_offset, features_size), values);
         }
     }
 
@@ -354,30 +767,32 @@ grpc::Status GraphEngineServiceImpl::GetEdgeStringFeatures(::grpc::ServerContext
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::GetNeighborCounts(::grpc::ServerContext *context,
-                                                       const snark::GetNeighborsRequest *request,
-                                                       snark::GetNeighborCountsReply *response)
+grpc::Status GraphEngineSnapshot::GetNeighborCounts(::grpc::ServerContext *context,
+                                                    const snark::GetNeighborsRequest *request,
+                                                    snark::GetNeighborCountsReply *response) const
 {
+    count_request_nodes(request->node_ids_size());
     const auto node_count = request->node_ids().size();
     response->mutable_neighbor_counts()->Resize(node_count, 0);
     auto input_edge_types = std::span(std::begin(request->edge_types()), std::end(request->edge_types()));
 
+    const auto indices = FindNodes(request->node_ids());
     for (int node_index = 0; node_index < node_count; ++node_index)
     {
-        auto internal_id = m_node_map.find(request->node_ids()[node_index]);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_index + prefetch_distance);
+        auto index = indices[node_index];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
         else
         {
-            auto index = internal_id->second;
             size_t partition_count = m_counts[index];
             for (size_t partition = 0; partition < partition_count; ++partition, ++index)
             {
                 response->mutable_neighbor_counts()->at(node_index) +=
-                    m_partitions[m_partitions_indices[index]].NeighborCount(m_internal_indices[index],
-                                                                            input_edge_types);
+                    m_partitions[m_partitions_indices[index]]->NeighborCount(m_internal_indices[index],
+                                                                             input_edge_types);
             }
         }
     }
@@ -385,33 +800,35 @@ grpc::Status GraphEngineServiceImpl::GetNeighborCounts(::grpc::ServerContext *co
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::GetNeighbors(::grpc::ServerContext *context,
-                                                  const snark::GetNeighborsRequest *request,
-                                                  snark::GetNeighborsReply *response)
+grpc::Status GraphEngineSnapshot::GetNeighbors(::grpc::ServerContext *context,
+                                               const snark::GetNeighborsRequest *request,
+                                               snark::GetNeighborsReply *response) const
 {
+    count_request_nodes(request->node_ids_size());
     const auto node_count = request->node_ids().size();
     response->mutable_neighbor_counts()->Resize(node_count, 0);
     auto input_edge_types = std::span(std::begin(request->edge_types()), std::end(request->edge_types()));
     std::vector<NodeId> output_neighbor_ids;
     std::vector<Type> output_neighbor_types;
     std::vector<float> output_neighbors_weights;
+    const auto indices = FindNodes(request->node_ids());
     for (int node_index = 0; node_index < node_count; ++node_index)
     {
-        auto internal_id = m_node_map.find(request->node_ids()[node_index]);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_index + prefetch_distance);
+        auto index = indices[node_index];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
         else
         {
-            auto index = internal_id->second;
             const size_t partition_count = m_counts[index];
             for (size_t partition = 0; partition < partition_count; ++partition, ++index)
             {
                 response->mutable_neighbor_counts()->at(node_index) +=
-                    m_partitions[m_partitions_indices[index]].FullNeighbor(m_internal_indices[index], input_edge_types,
-                                                                           output_neighbor_ids, output_neighbor_types,
-                                                                           output_neighbors_weights);
+                    m_partitions[m_partitions_indices[index]]->FullNeighbor(m_internal_indices[index], input_edge_types,
+                                                                            output_neighbor_ids, output_neighbor_types,
+                                                                            output_neighbors_weights);
                 response->mutable_node_ids()->Add(std::begin(output_neighbor_ids), std::end(output_neighbor_ids));
                 response->mutable_edge_types()->Add(std::begin(output_neighbor_types), std::end(output_neighbor_types));
                 response->mutable_edge_weights()->Add(std::begin(output_neighbors_weights),
@@ -425,10 +842,11 @@ grpc::Status GraphEngineServiceImpl::GetNeighbors(::grpc::ServerContext *context
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::WeightedSampleNeighbors(::grpc::ServerContext *context,
-                                                             const snark::WeightedSampleNeighborsRequest *request,
-                                                             snark::WeightedSampleNeighborsReply *response)
+grpc::Status GraphEngineSnapshot::WeightedSampleNeighbors(::grpc::ServerContext *context,
+                                                          const snark::WeightedSampleNeighborsRequest *request,
+                                                          snark::WeightedSampleNeighborsReply *response) const
 {
+    count_request_nodes(request->node_ids_size());
     assert(std::is_sorted(std::begin(request->edge_types()), std::end(request->edge_types())));
 
     size_t count = request->count();
@@ -436,19 +854,21 @@ grpc::Status GraphEngineServiceImpl::WeightedSampleNeighbors(::grpc::ServerConte
     auto input_edge_types = std::span(std::begin(request->edge_types()), std::end(request->edge_types()));
     auto seed = request->seed();
 
+    const auto indices = FindNodes(request->node_ids());
     for (int node_index = 0; node_index < request->node_ids().size(); ++node_index)
     {
         const auto node_id = request->node_ids()[node_index];
-        auto internal_id = m_node_map.find(node_id);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_index + prefetch_distance);
+        auto index = indices[node_index];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
         size_t offset = nodes_found * count;
         ++nodes_found;
-        const auto index = internal_id->second;
         const size_t partition_count = m_counts[index];
         response->add_node_ids(node_id);
+        response->add_offsets(node_index);
         response->mutable_shard_weights()->Resize(nodes_found, {});
         auto &last_shard_weight = response->mutable_shard_weights()->at(nodes_found - 1);
         response->mutable_neighbor_ids()->Resize(nodes_found * count, request->default_node_id());
@@ -456,7 +876,7 @@ grpc::Status GraphEngineServiceImpl::WeightedSampleNeighbors(::grpc::ServerConte
         response->mutable_neighbor_weights()->Resize(nodes_found * count, request->default_node_weight());
         for (size_t partition = 0; partition < partition_count; ++partition)
         {
-            m_partitions[m_partitions_indices[index + partition]].SampleNeighbor(
+            m_partitions[m_partitions_indices[index + partition]]->SampleNeighbor(
                 seed++, m_internal_indices[index + partition], input_edge_types, count,
                 std::span(response->mutable_neighbor_ids()->mutable_data() + offset, count),
                 std::span(response->mutable_neighbor_types()->mutable_data() + offset, count),
@@ -467,10 +887,11 @@ grpc::Status GraphEngineServiceImpl::WeightedSampleNeighbors(::grpc::ServerConte
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::UniformSampleNeighbors(::grpc::ServerContext *context,
-                                                            const snark::UniformSampleNeighborsRequest *request,
-                                                            snark::UniformSampleNeighborsReply *response)
+grpc::Status GraphEngineSnapshot::UniformSampleNeighbors(::grpc::ServerContext *context,
+                                                         const snark::UniformSampleNeighborsRequest *request,
+                                                         snark::UniformSampleNeighborsReply *response) const
 {
+    count_request_nodes(request->node_ids_size());
     assert(std::is_sorted(std::begin(request->edge_types()), std::end(request->edge_types())));
 
     size_t count = request->count();
@@ -479,26 +900,28 @@ grpc::Status GraphEngineServiceImpl::UniformSampleNeighbors(::grpc::ServerContex
     auto input_edge_types = std::span(std::begin(request->edge_types()), std::end(request->edge_types()));
     auto seed = request->seed();
 
+    const auto indices = FindNodes(request->node_ids());
     for (int node_index = 0; node_index < request->node_ids().size(); ++node_index)
     {
         const auto node_id = request->node_ids()[node_index];
-        auto internal_id = m_node_map.find(node_id);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_index + prefetch_distance);
+        auto index = indices[node_index];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
         size_t offset = nodes_found * count;
         ++nodes_found;
-        const auto index = internal_id->second;
         const size_t partition_count = m_counts[index];
         response->add_node_ids(node_id);
+        response->add_offsets(node_index);
         response->mutable_shard_counts()->Resize(nodes_found, {});
         auto &last_shard_weight = response->mutable_shard_counts()->at(nodes_found - 1);
         response->mutable_neighbor_ids()->Resize(nodes_found * count, request->default_node_id());
         response->mutable_neighbor_types()->Resize(nodes_found * count, request->default_edge_type());
         for (size_t partition = 0; partition < partition_count; ++partition)
         {
-            m_partitions[m_partitions_indices[index + partition]].UniformSampleNeighbor(
+            m_partitions[m_partitions_indices[index + partition]]->UniformSampleNeighbor(
                 without_replacement, seed++, m_internal_indices[index + partition], input_edge_types, count,
                 std::span(response->mutable_neighbor_ids()->mutable_data() + offset, count),
                 std::span(response->mutable_neighbor_types()->mutable_data() + offset, count), last_shard_weight,
@@ -508,8 +931,225 @@ grpc::Status GraphEngineServiceImpl::UniformSampleNeighbors(::grpc::ServerContex
     return grpc::Status::OK;
 }
 
-grpc::Status GraphEngineServiceImpl::GetMetadata(::grpc::ServerContext *context, const snark::EmptyMessage *request,
-                                                 snark::MetadataReply *response)
+grpc::Status GraphEngineSnapshot::SampleSubgraph(::grpc::ServerContext *context,
+                                                 const snark::SampleSubgraphRequest *request,
+                                                 snark::SampleSubgraphReply *response) const
+{
+    if (request->hops_size() != request->node_ids_size())
+    {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Hops and node ids have different sizes");
+    }
+
+    count_request_nodes(request->node_ids_size());
+    const uint32_t hop_count = request->fanouts().size();
+    const bool fetch_features = !request->features().empty();
+
+    // Nodes stored locally for every hop. Requested nodes missing on the server are expanded by their owners,
+    // sampled ones are returned to the client as a frontier.
+    std::vector<std::vector<NodeId>> hops(hop_count + 1);
+    absl::flat_hash_set<NodeId> visited;
+    for (int index = 0; index < request->node_ids().size(); ++index)
+    {
+        const auto node = request->node_ids()[index];
+        const auto hop = request->hops()[index];
+        if (hop <= hop_count && visited.insert(node).second && m_node_map.Find(node) != NodeIndex::npos)
+        {
+            hops[hop].emplace_back(node);
+        }
+    }
+
+    Xoroshiro128PlusGenerator engine(request->seed());
+    UniformSampleNeighborsRequest sample_request;
+    UniformSampleNeighborsReply sample_reply;
+    *sample_request.mutable_edge_types() = request->edge_types();
+    sample_request.set_default_edge_type(PLACEHOLDER_EDGE_TYPE);
+    sample_request.set_without_replacement(request->without_replacement());
+    for (uint32_t hop = 0; hop <= hop_count; ++hop)
+    {
+        const auto &nodes = hops[hop];
+        for (auto node : nodes)
+        {
+            response->add_node_ids(node);
+            response->add_hops(hop);
+        }
+        if (hop == hop_count)
+        {
+            response->mutable_edge_counts()->Resize(response->node_ids().size(), 0);
+            break;
+        }
+
+        const size_t count = request->fanouts()[hop];
+        *sample_request.mutable_node_ids() = {std::begin(nodes), std::end(nodes)};
+        sample_request.set_count(count);
+        sample_request.set_seed(int64_t(engine()));
+        sample_reply.Clear();
+        UniformSampleNeighbors(context, &sample_request, &sample_reply);
+
+        // Every node is stored locally, so sampled neighbors are aligned with the nodes.
+        for (size_t index = 0; index < nodes.size(); ++index)
+        {
+            uint32_t edge_count = 0;
+            for (size_t offset = index * count; offset < (index + 1) * count; ++offset)
+            {
+                const auto type = sample_reply.neighbor_types()[offset];
+                if (type == PLACEHOLDER_EDGE_TYPE)
+                {
+                    continue;
+                }
+
+                const auto neighbor = sample_reply.neighbor_ids()[offset];
+                response->add_neighbor_ids(neighbor);
+                response->add_neighbor_types(type);
+                ++edge_count;
+                if (!visited.insert(neighbor).second)
+                {
+                    continue;
+                }
+                if (m_node_map.Find(neighbor) != NodeIndex::npos)
+                {
+                    hops[hop + 1].emplace_back(neighbor);
+                }
+                else if (hop + 1 < hop_count || fetch_features)
+                {
+                    response->add_frontier_ids(neighbor);
+                    response->add_frontier_hops(hop + 1);
+                }
+            }
+            response->add_edge_counts(edge_count);
+        }
+    }
+
+    if (!fetch_features || response->node_ids().empty())
+    {
+        return grpc::Status::OK;
+    }
+
+    NodeFeaturesRequest features_request;
+    NodeFeaturesReply features_reply;
+    *features_request.mutable_node_ids() = response->node_ids();
+    *features_request.mutable_features() = request->features();
+    GetNodeFeatures(context, &features_request, &features_reply);
+    size_t feature_size = 0;
+    for (const auto &feature : request->features())
+    {
+        feature_size += feature.size();
+    }
+
+    auto &values = *response->mutable_feature_values();
+    values.resize(feature_size * response->node_ids().size(), 0);
+    for (int index = 0; index < features_reply.offsets().size(); ++index)
+    {
+        std::copy_n(features_reply.feature_values().data() + index * feature_size, feature_size,
+                    values.data() + features_reply.offsets()[index] * feature_size);
+    }
+
+    return grpc::Status::OK;
+}
+
+grpc::Status GraphEngineSnapshot::RandomWalk(::grpc::ServerContext *context, const snark::RandomWalkRequest *request,
+                                             snark::RandomWalkReply *response) const
+{
+    const int walk_count = request->node_ids_size();
+    if (request->seeds_size() != walk_count || request->steps_size() != walk_count ||
+        request->previous_ids_size() != walk_count || request->neighbor_counts_size() != walk_count)
+    {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "Seeds, steps, previous ids, neighbor counts and node ids have different sizes");
+    }
+
+    uint64_t neighbors_left = request->neighbor_ids_size();
+    for (auto neighbor_count : request->neighbor_counts())
+    {
+        if (neighbor_count > neighbors_left)
+        {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Neighbor counts exceed neighbor ids");
+        }
+        neighbors_left -= neighbor_count;
+    }
+
+    count_request_nodes(walk_count);
+    std::vector<Type> edge_types(std::begin(request->edge_types()), std::end(request->edge_types()));
+    std::sort(std::begin(edge_types), std::end(edge_types));
+    edge_types.erase(std::unique(std::begin(edge_types), std::end(edge_types)), std::end(edge_types));
+    const Node2VecWalker walker(m_partitions, m_node_map, m_partitions_indices, m_internal_indices, m_counts,
+                                request->p(), request->q(), edge_types);
+
+    std::vector<NodeId> path;
+    std::vector<NodeId> last_neighbors;
+    size_t neighbor_offset = 0;
+    for (int index = 0; index < walk_count; ++index)
+    {
+        const size_t neighbor_count = request->neighbor_counts()[index];
+        const auto previous_neighbors =
+            std::span(request->neighbor_ids().data() + neighbor_offset, neighbor_count);
+        neighbor_offset += neighbor_count;
+
+        path.clear();
+        last_neighbors.clear();
+        const auto status =
+            walker.Walk(request->seeds()[index], request->walk_length(), request->steps()[index],
+                        request->previous_ids()[index], request->node_ids()[index], previous_neighbors, path,
+                        last_neighbors);
+        response->add_statuses(uint32_t(status));
+        response->add_step_counts(path.size());
+        response->mutable_node_ids()->Add(std::begin(path), std::end(path));
+        response->add_neighbor_counts(last_neighbors.size());
+        response->mutable_neighbor_ids()->Add(std::begin(last_neighbors), std::end(last_neighbors));
+    }
+
+    return grpc::Status::OK;
+}
+
+grpc::Status GraphEngineSnapshot::GetNeighborCandidates(::grpc::ServerContext *context,
+                                                        const snark::NeighborCandidatesRequest *request,
+                                                        snark::NeighborCandidatesReply *response) const
+{
+    if (request->candidate_counts_size() != request->node_ids_size())
+    {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                            "Candidate counts and node ids have different sizes");
+    }
+    if (request->draw_count() > max_negative_draws)
+    {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Draw count exceeds max_negative_draws");
+    }
+
+    count_request_nodes(request->node_ids_size());
+    std::vector<Type> edge_types(std::begin(request->edge_types()), std::end(request->edge_types()));
+    std::sort(std::begin(edge_types), std::end(edge_types));
+    edge_types.erase(std::unique(std::begin(edge_types), std::end(edge_types)), std::end(edge_types));
+
+    const auto indices = FindNodes(request->node_ids());
+    int candidate = 0;
+    for (int node_index = 0; node_index < request->node_ids().size(); ++node_index)
+    {
+        PrefetchRecord(indices, node_index + prefetch_distance);
+        const auto index = indices[node_index];
+        const auto node = request->node_ids(node_index);
+        const int last = std::min<int>(candidate + request->candidate_counts(node_index), request->candidates_size());
+        for (; candidate < last; ++candidate)
+        {
+            if (index == NodeIndex::npos ? request->candidates(candidate) == node
+                                         : IsNeighbor(m_partitions, m_partitions_indices, m_internal_indices,
+                                                      m_counts, index, node, request->candidates(candidate),
+                                                      edge_types))
+            {
+                response->add_positions(candidate);
+            }
+        }
+    }
+
+    const auto &sorted_ids = SortedNodeIds();
+    response->set_node_count(sorted_ids.size());
+    response->mutable_drawn_ids()->Resize(sorted_ids.empty() ? 0 : request->draw_count(), 0);
+    DrawNodes(request->seed(), sorted_ids,
+              std::span(response->mutable_drawn_ids()->mutable_data(), response->drawn_ids_size()));
+
+    return grpc::Status::OK;
+}
+
+grpc::Status GraphEngineSnapshot::GetMetadata(::grpc::ServerContext *context, const snark::EmptyMessage *request,
+                                              snark::MetadataReply *response) const
 {
     response->set_version(m_metadata.m_version);
     response->set_nodes(m_metadata.m_node_count);
@@ -541,7 +1181,68 @@ grpc::Status GraphEngineServiceImpl::GetMetadata(::grpc::ServerContext *context,
     return grpc::Status::OK;
 }
 
-void GraphEngineServiceImpl::ReadNodeMap(std::filesystem::path path, std::string suffix, uint32_t index)
+grpc::Status GraphEngineSnapshot::GetNodeIds(::grpc::ServerContext *context, const snark::NodeIdsRequest *request,
+                                             snark::NodeIdsReply *response) const
+{
+    // Pages are positions in the sorted ids, so clients can resume them with the offset of the next page.
+    const auto &sorted_ids = SortedNodeIds();
+    const auto offset = std::min(size_t(request->offset()), sorted_ids.size());
+    const size_t limit =
+        request->limit() == 0 ? node_ids_page_size : std::min(size_t(request->limit()), node_ids_page_size);
+    const auto end = std::min(offset + limit, sorted_ids.size());
+    *response->mutable_node_ids() = {std::begin(sorted_ids) + offset, std::begin(sorted_ids) + end};
+    response->set_next_offset(end < sorted_ids.size() ? end : 0);
+
+    return grpc::Status::OK;
+}
+
+const std::vector<NodeId> &GraphEngineSnapshot::SortedNodeIds() const
+{
+    std::call_once(m_sorted_ids_flag, [this]() {
+        m_sorted_ids.reserve(m_node_map.Size());
+        m_node_map.ForEach([this](NodeId node) { m_sorted_ids.emplace_back(node); });
+        std::sort(std::begin(m_sorted_ids), std::end(m_sorted_ids));
+    });
+
+    return m_sorted_ids;
+}
+
+std::vector<uint64_t> GraphEngineSnapshot::FindNodes(const google::protobuf::RepeatedField<int64_t> &node_ids,
+                                                     size_t count) const
+{
+    StageTimer timer(RequestStage::lookup);
+    count = std::min(count, size_t(node_ids.size()));
+    std::vector<uint64_t> indices(count);
+    m_node_map.Find(std::span(node_ids.data(), count), indices);
+    return indices;
+}
+
+std::vector<EdgeLocation> GraphEngineSnapshot::LocateEdges(const google::protobuf::RepeatedField<int64_t> &node_ids,
+                                                           const google::protobuf::RepeatedField<int32_t> &types) const
+{
+    StageTimer timer(RequestStage::lookup);
+    const size_t len = types.size();
+    const auto indices = FindNodes(node_ids, len);
+    std::vector<EdgeLocation> locations(len);
+    snark::LocateEdges(m_partitions, m_partitions_indices, m_internal_indices, m_counts, indices,
+                       std::span(node_ids.data() + len, len), std::span(types.data(), len), locations);
+    return locations;
+}
+
+void GraphEngineSnapshot::PrefetchRecord(std::span<const uint64_t> indices, size_t position) const
+{
+    if (position >= indices.size() || indices[position] == NodeIndex::npos)
+    {
+        return;
+    }
+
+    const auto index = indices[position];
+    prefetch(&m_counts[index]);
+    prefetch(&m_partitions_indices[index]);
+    prefetch(&m_internal_indices[index]);
+}
+
+std::vector<NodeId> GraphEngineSnapshot::ReadNodeIds(std::filesystem::path path, std::string suffix) const
 {
     std::shared_ptr<BaseStorage<uint8_t>> node_map;
     if (!is_hdfs_path(path))
@@ -551,14 +1252,13 @@ void GraphEngineServiceImpl::ReadNodeMap(std::filesystem::path path, std::string
     else
     {
         auto full_path = path / ("node_" + suffix + ".map");
-        node_map = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path);
+        node_map = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path,
+                                                                m_metadata.m_hdfs_read);
     }
     auto node_map_ptr = node_map->start();
-    size_t size = node_map->size() / 20;
-    m_node_map.reserve(size);
-    m_partitions_indices.reserve(size);
-    m_internal_indices.reserve(size);
-    m_counts.reserve(size);
+    size_t size = node_map->size() / 20; // 20 = 8(node_id) + 8(internal_id) + 4(node_type)
+    std::vector<NodeId> node_ids;
+    node_ids.reserve(size);
     for (size_t i = 0; i < size; ++i)
     {
         uint64_t pair[2];
@@ -567,38 +1267,206 @@ void GraphEngineServiceImpl::ReadNodeMap(std::filesystem::path path, std::string
             RAW_LOG_FATAL("Failed to read pair in a node maping");
         }
 
-        auto el = m_node_map.find(pair[0]);
-        if (el == std::end(m_node_map))
-        {
-            m_node_map[pair[0]] = m_internal_indices.size();
-            m_internal_indices.emplace_back(pair[1]);
-            // TODO: compress vectors below?
-            m_partitions_indices.emplace_back(index);
-            m_counts.emplace_back(1);
-        }
-        else
-        {
-            auto old_offset = el->second;
-            auto old_count = m_counts[old_offset];
-            m_node_map[pair[0]] = m_internal_indices.size();
-
-            std::copy_n(std::begin(m_internal_indices) + old_offset, old_count, std::back_inserter(m_internal_indices));
-            m_internal_indices.emplace_back(pair[1]);
-
-            std::copy_n(std::begin(m_partitions_indices) + old_offset, old_count,
-                        std::back_inserter(m_partitions_indices));
-            m_partitions_indices.emplace_back(index);
-
-            std::fill_n(std::back_inserter(m_counts), old_count + 1, old_count + 1);
-        }
-
         assert(pair[1] == i);
+        node_ids.emplace_back(pair[0]);
         Type node_type;
         if (node_map->read(&node_type, sizeof(Type), 1, node_map_ptr) != 1)
         {
             RAW_LOG_FATAL("Failed to read node type in a node maping");
         }
     }
+
+    return node_ids;
+}
+
+GraphEngineServiceImpl::GraphEngineServiceImpl(std::string path, std::vector<uint32_t> partitions,
+                                               PartitionStorageType storage_type, std::string config_path,
+                                               FeatureCacheConfig feature_cache, bool compact_node_index,
+                                               bool compressed_edges, size_t alias_threshold,
+                                               std::vector<FeatureId> columnar_features, bool numa_placement,
+                                               size_t edge_index_threshold, HDFSReadOptions hdfs_read)
+    : m_load([=, node_workers = m_node_workers](const GraphEngineSnapshot *previous) {
+          return std::make_shared<const GraphEngineSnapshot>(
+              path, partitions, storage_type, config_path, feature_cache, compact_node_index, compressed_edges,
+              alias_threshold, columnar_features, numa_placement, edge_index_threshold, hdfs_read, previous,
+              node_workers);
+      })
+{
+    m_snapshot = m_load(nullptr);
+}
+
+void GraphEngineServiceImpl::Reload()
+{
+    // Concurrent reloads would load the same files twice, the later one wins anyway.
+    std::lock_guard reload_lock(m_reload_mutex);
+    const auto previous = Snapshot();
+    auto snapshot = m_load(previous.get());
+    {
+        std::lock_guard lock(m_snapshot_mutex);
+        std::swap(m_snapshot, snapshot);
+        ++m_version;
+    }
+
+    // Previous partitions are released here or by the last request using them, not under the lock.
+}
+
+uint64_t GraphEngineServiceImpl::Version() const
+{
+    std::lock_guard lock(m_snapshot_mutex);
+    return m_version;
+}
+
+void GraphEngineServiceImpl::SetNodeWorkers(std::vector<ThreadPool *> pools)
+{
+    std::unique_lock lock(m_node_workers->m_mutex);
+    m_node_workers->m_pools = std::move(pools);
+}
+
+std::shared_ptr<const GraphEngineSnapshot> GraphEngineServiceImpl::Snapshot() const
+{
+    std::lock_guard lock(m_snapshot_mutex);
+    return m_snapshot;
+}
+
+std::shared_ptr<const GraphEngineSnapshot> GraphEngineServiceImpl::Snapshot(grpc::ServerContext *context,
+                                                                            uint64_t *version) const
+{
+    std::shared_ptr<const GraphEngineSnapshot> snapshot;
+    uint64_t snapshot_version;
+    {
+        std::lock_guard lock(m_snapshot_mutex);
+        snapshot = m_snapshot;
+        snapshot_version = m_version;
+    }
+
+    if (context != nullptr)
+    {
+        context->AddTrailingMetadata(engine_version_key, std::to_string(snapshot_version));
+    }
+    if (version != nullptr)
+    {
+        *version = snapshot_version;
+    }
+    return snapshot;
+}
+
+grpc::Status GraphEngineServiceImpl::GetNodeTypes(::grpc::ServerContext *context,
+                                                  const snark::NodeTypesRequest *request,
+                                                  snark::NodeTypesReply *response)
+{
+    return Snapshot(context)->GetNodeTypes(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetNodeFeatures(::grpc::ServerContext *context,
+                                                     const snark::NodeFeaturesRequest *request,
+                                                     snark::NodeFeaturesReply *response)
+{
+    return Snapshot(context)->GetNodeFeatures(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetNodeFeaturesRaw(::grpc::ServerContext *context,
+                                                        const snark::NodeFeaturesRequest *request,
+                                                        grpc::ByteBuffer *response)
+{
+    return Snapshot(context)->GetNodeFeaturesRaw(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetEdgeFeatures(::grpc::ServerContext *context,
+                                                     const snark::EdgeFeaturesRequest *request,
+                                                     snark::EdgeFeaturesReply *response)
+{
+    return Snapshot(context)->GetEdgeFeatures(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetNodeSparseFeatures(::grpc::ServerContext *context,
+                                                           const snark::NodeSparseFeaturesRequest *request,
+                                                           snark::SparseFeaturesReply *response)
+{
+    return Snapshot(context)->GetNodeSparseFeatures(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetEdgeSparseFeatures(::grpc::ServerContext *context,
+                                                           const snark::EdgeSparseFeaturesRequest *request,
+                                                           snark::SparseFeaturesReply *response)
+{
+    return Snapshot(context)->GetEdgeSparseFeatures(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetNodeStringFeatures(::grpc::ServerContext *context,
+                                                           const snark::NodeSparseFeaturesRequest *request,
+                                                           snark::StringFeaturesReply *response)
+{
+    return Snapshot(context)->GetNodeStringFeatures(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetEdgeStringFeatures(::grpc::ServerContext *context,
+                                                           const snark::EdgeSparseFeaturesRequest *request,
+                                                           snark::StringFeaturesReply *response)
+{
+    return Snapshot(context)->GetEdgeStringFeatures(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetNeighborCounts(::grpc::ServerContext *context,
+                                                       const snark::GetNeighborsRequest *request,
+                                                       snark::GetNeighborCountsReply *response)
+{
+    return Snapshot(context)->GetNeighborCounts(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetNeighbors(::grpc::ServerContext *context,
+                                                  const snark::GetNeighborsRequest *request,
+                                                  snark::GetNeighborsReply *response)
+{
+    return Snapshot(context)->GetNeighbors(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::WeightedSampleNeighbors(::grpc::ServerContext *context,
+                                                             const snark::WeightedSampleNeighborsRequest *request,
+                                                             snark::WeightedSampleNeighborsReply *response)
+{
+    return Snapshot(context)->WeightedSampleNeighbors(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::UniformSampleNeighbors(::grpc::ServerContext *context,
+                                                            const snark::UniformSampleNeighborsRequest *request,
+                                                            snark::UniformSampleNeighborsReply *response)
+{
+    return Snapshot(context)->UniformSampleNeighbors(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::SampleSubgraph(::grpc::ServerContext *context,
+                                                    const snark::SampleSubgraphRequest *request,
+                                                    snark::SampleSubgraphReply *response)
+{
+    return Snapshot(context)->SampleSubgraph(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::RandomWalk(::grpc::ServerContext *context, const snark::RandomWalkRequest *request,
+                                                snark::RandomWalkReply *response)
+{
+    return Snapshot(context)->RandomWalk(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetNeighborCandidates(::grpc::ServerContext *context,
+                                                           const snark::NeighborCandidatesRequest *request,
+                                                           snark::NeighborCandidatesReply *response)
+{
+    return Snapshot(context)->GetNeighborCandidates(context, request, response);
+}
+
+grpc::Status GraphEngineServiceImpl::GetMetadata(::grpc::ServerContext *context, const snark::EmptyMessage *request,
+                                                 snark::MetadataReply *response)
+{
+    uint64_t version = 0;
+    const auto status = Snapshot(context, &version)->GetMetadata(context, request, response);
+    response->set_engine_version(version);
+    return status;
+}
+
+grpc::Status GraphEngineServiceImpl::GetNodeIds(::grpc::ServerContext *context, const snark::NodeIdsRequest *request,
+                                                snark::NodeIdsReply *response)
+{
+    return Snapshot(context)->GetNodeIds(context, request, response);
 }
 
 } // namespace snark
@@ -4,9 +4,18 @@
 #ifndef SNARK_SERVICE_H
 #define SNARK_SERVICE_H
 
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <vector>
+
 #include "absl/container/flat_hash_map.h"
 #include <grpc/grpc.h>
 #include <grpcpp/channel.h>
+#include <grpcpp/support/byte_buffer.h>
 
 #include "src/cc/lib/distributed/service.grpc.pb.h"
 #include "src/cc/lib/graph/graph.h"
@@ -14,16 +23,154 @@
 namespace snark
 {
 
+// Node features are sent as raw byte buffers to serialize replies directly from partition storage.
+using GraphEngineAsyncService = GraphEngine::WithRawMethod_GetNodeFeatures<GraphEngine::AsyncService>;
+
+// Trailing metadata key with the number of server reloads in replies of every GraphEngine method.
+inline constexpr char engine_version_key[] = "snark-engine-version";
+
+// Worker pools of a server lent to its graph engine, pool i runs threads pinned to node i of numa_nodes().
+// Snapshots read node features of partitions placed on NUMA nodes with pools of their nodes, see GRPCServer.
+struct NodeWorkers
+{
+    std::shared_mutex m_mutex;
+    std::vector<ThreadPool *> m_pools;
+};
+
+// Immutable view of the partitions loaded by a server, see GraphEngineServiceImpl::Reload.
+class GraphEngineSnapshot
+{
+  public:
+    // Partitions of the previous snapshot with unchanged files are shared instead of loaded again.
+    GraphEngineSnapshot(std::string path, std::vector<uint32_t> partitions, PartitionStorageType storage_type,
+                        std::string config_path, FeatureCacheConfig feature_cache, bool compact_node_index,
+                        bool compressed_edges, size_t alias_threshold, std::vector<FeatureId> columnar_features,
+                        bool numa_placement, size_t edge_index_threshold, HDFSReadOptions hdfs_read,
+                        const GraphEngineSnapshot *previous = nullptr,
+                        std::shared_ptr<NodeWorkers> node_workers = nullptr);
+
+    // Number of partitions taken from the previous snapshot.
+    size_t ReusedPartitions() const;
+
+    grpc::Status GetNodeTypes(::grpc::ServerContext *context, const snark::NodeTypesRequest *request,
+                              snark::NodeTypesReply *response) const;
+
+    grpc::Status GetNodeFeatures(::grpc::ServerContext *context, const snark::NodeFeaturesRequest *request,
+                                 snark::NodeFeaturesReply *response) const;
+
+    // Same reply as GetNodeFeatures encoded in a buffer with offsets before feature values. Values are written
+    // from the partitions straight into the buffer slice, so clients can scatter them to the output right away.
+    grpc::Status GetNodeFeaturesRaw(::grpc::ServerContext *context, const snark::NodeFeaturesRequest *request,
+                                    grpc::ByteBuffer *response) const;
+    grpc::Status GetEdgeFeatures(::grpc::ServerContext *context, const snark::EdgeFeaturesRequest *request,
+                                 snark::EdgeFeaturesReply *response) const;
+    grpc::Status GetNodeSparseFeatures(::grpc::ServerContext *context, const snark::NodeSparseFeaturesRequest *request,
+                                       snark::SparseFeaturesReply *response) const;
+    grpc::Status GetEdgeSparseFeatures(::grpc::ServerContext *context, const snark::EdgeSparseFeaturesRequest *request,
+                                       snark::SparseFeaturesReply *response) const;
+    grpc::Status GetNodeStringFeatures(::grpc::ServerContext *context, const snark::NodeSparseFeaturesRequest *request,
+                                       snark::StringFeaturesReply *response) const;
+    grpc::Status GetEdgeStringFeatures(::grpc::ServerContext *context, const snark::EdgeSparseFeaturesRequest *request,
+                                       snark::StringFeaturesReply *response) const;
+    grpc::Status GetNeighborCounts(::grpc::ServerContext *context, const snark::GetNeighborsRequest *request,
+                                   snark::GetNeighborCountsReply *response) const;
+    grpc::Status GetNeighbors(::grpc::ServerContext *context, const snark::GetNeighborsRequest *request,
+                              snark::GetNeighborsReply *response) const;
+    grpc::Status WeightedSampleNeighbors(::grpc::ServerContext *context,
+                                         const snark::WeightedSampleNeighborsRequest *request,
+                                         snark::WeightedSampleNeighborsReply *response) const;
+    grpc::Status UniformSampleNeighbors(::grpc::ServerContext *context,
+                                        const snark::UniformSampleNeighborsRequest *request,
+                                        snark::UniformSampleNeighborsReply *response) const;
+    grpc::Status SampleSubgraph(::grpc::ServerContext *context, const snark::SampleSubgraphRequest *request,
+                                snark::SampleSubgraphReply *response) const;
+    grpc::Status RandomWalk(::grpc::ServerContext *context, const snark::RandomWalkRequest *request,
+                            snark::RandomWalkReply *response) const;
+    grpc::Status GetNeighborCandidates(::grpc::ServerContext *context, const snark::NeighborCandidatesRequest *request,
+                                       snark::NeighborCandidatesReply *response) const;
+    grpc::Status GetMetadata(::grpc::ServerContext *context, const snark::EmptyMessage *request,
+                             snark::MetadataReply *response) const;
+    grpc::Status GetNodeIds(::grpc::ServerContext *context, const snark::NodeIdsRequest *request,
+                            snark::NodeIdsReply *response) const;
+
+  private:
+    std::vector<NodeId> ReadNodeIds(std::filesystem::path path, std::string suffix) const;
+    void WarmFeatureCache(std::span<const uint32_t> partitions);
+
+    // Group nodes with features by partitions to fetch them from each partition in a single batch. Positions
+    // of found nodes in the request are appended to node_offsets, returns the size of their feature values.
+    size_t LocateNodeFeatures(const snark::NodeFeaturesRequest &request,
+                              std::vector<std::vector<uint64_t>> &internal_ids,
+                              std::vector<std::vector<size_t>> &output_offsets,
+                              std::vector<uint32_t> &node_offsets) const;
+    void FetchNodeFeatures(const snark::NodeFeaturesRequest &request,
+                           const std::vector<std::vector<uint64_t>> &internal_ids,
+                           const std::vector<std::vector<size_t>> &output_offsets, std::span<uint8_t> data) const;
+
+    // Find records of the first count nodes with pipelined index lookups, see NodeIndex::Find.
+    std::vector<uint64_t> FindNodes(const google::protobuf::RepeatedField<int64_t> &node_ids,
+                                    size_t count = std::numeric_limits<size_t>::max()) const;
+
+    // Prefetch partition records of indices[position] if it is a found node. Request loops call it for the node
+    // prefetch_distance ahead of the current one.
+    void PrefetchRecord(std::span<const uint64_t> indices, size_t position) const;
+
+    // Unique node ids of the snapshot in ascending order, built by the first call.
+    const std::vector<NodeId> &SortedNodeIds() const;
+
+    // Locate edges of a request with sources followed by destinations in node_ids, see snark::LocateEdges.
+    std::vector<EdgeLocation> LocateEdges(const google::protobuf::RepeatedField<int64_t> &node_ids,
+                                          const google::protobuf::RepeatedField<int32_t> &types) const;
+
+    PartitionList m_partitions;
+
+    // Suffixes of partitions and versions of their files to find unchanged partitions on reload.
+    std::vector<std::string> m_suffixes;
+    std::vector<std::string> m_partition_versions;
+    size_t m_reused_partitions = 0;
+
+    // With NUMA placement partition i is loaded on node m_partition_nodes[i], empty on hosts with a single node.
+    // Dense node features of the partition are read by the pool of its node from m_node_workers if the server
+    // lent them. Other requests walk neighbor lists of a few nodes per partition, so they are processed on
+    // request threads without hand offs to other nodes.
+    std::vector<size_t> m_partition_nodes;
+    std::shared_ptr<NodeWorkers> m_node_workers;
+    NodeIndex m_node_map;
+    std::vector<uint32_t> m_partitions_indices;
+    std::vector<uint64_t> m_internal_indices;
+    std::vector<uint32_t> m_counts;
+    Metadata m_metadata;
+    std::shared_ptr<FeatureCache> m_feature_cache;
+
+    // Unique node ids in ascending order for GetNodeIds pages and negative sampling draws.
+    mutable std::once_flag m_sorted_ids_flag;
+    mutable std::vector<NodeId> m_sorted_ids;
+};
+
 class GraphEngineServiceImpl final : public snark::GraphEngine::Service
 {
   public:
+    // With numa_placement partitions are loaded by threads pinned to NUMA nodes in turn, so memory of every
+    // partition is allocated on a single node, and node features of a partition are read by threads of its node
+    // once a server lends its workers with SetNodeWorkers.
+    // Edges of runs with at least edge_index_threshold edges are found with hash tables, see Partition.
+    // Files on HDFS are read in hdfs_read ranges, see Graph.
     GraphEngineServiceImpl(std::string path, std::vector<uint32_t> partitions, PartitionStorageType storage_type,
-                           std::string config_path);
+                           std::string config_path, FeatureCacheConfig feature_cache = {},
+                           bool compact_node_index = false, bool compressed_edges = false,
+                           size_t alias_threshold = 0, std::vector<FeatureId> columnar_features = {},
+                           bool numa_placement = false, size_t edge_index_threshold = 0,
+                           HDFSReadOptions hdfs_read = {});
     grpc::Status GetNodeTypes(::grpc::ServerContext *context, const snark::NodeTypesRequest *request,
                               snark::NodeTypesReply *response) override;
 
     grpc::Status GetNodeFeatures(::grpc::ServerContext *context, const snark::NodeFeaturesRequest *request,
                                  snark::NodeFeaturesReply *response) override;
+
+    // Same reply as GetNodeFeatures encoded in a buffer with offsets before feature values. Values are written
+    // from the partitions straight into the buffer slice, so clients can scatter them to the output right away.
+    grpc::Status GetNodeFeaturesRaw(::grpc::ServerContext *context, const snark::NodeFeaturesRequest *request,
+                                    grpc::ByteBuffer *response);
     grpc::Status GetEdgeFeatures(::grpc::ServerContext *context, const snark::EdgeFeaturesRequest *request,
                                  snark::EdgeFeaturesReply *response) override;
     grpc::Status GetNodeSparseFeatures(::grpc::ServerContext *context, const snark::NodeSparseFeaturesRequest *request,
@@ -44,18 +191,52 @@ class GraphEngineServiceImpl final : public snark::GraphEngine::Service
     grpc::Status UniformSampleNeighbors(::grpc::ServerContext *context,
                                         const snark::UniformSampleNeighborsRequest *request,
                                         snark::UniformSampleNeighborsReply *response) override;
+    grpc::Status SampleSubgraph(::grpc::ServerContext *context, const snark::SampleSubgraphRequest *request,
+                                snark::SampleSubgraphReply *response) override;
+    grpc::Status RandomWalk(::grpc::ServerContext *context, const snark::RandomWalkRequest *request,
+                            snark::RandomWalkReply *response) override;
+    grpc::Status GetNeighborCandidates(::grpc::ServerContext *context, const snark::NeighborCandidatesRequest *request,
+                                       snark::NeighborCandidatesReply *response) override;
     grpc::Status GetMetadata(::grpc::ServerContext *context, const snark::EmptyMessage *request,
                              snark::MetadataReply *response) override;
+    grpc::Status GetNodeIds(::grpc::ServerContext *context, const snark::NodeIdsRequest *request,
+                            snark::NodeIdsReply *response) override;
+
+    // Load partitions from the graph path again and swap them in once they are loaded, requests started before
+    // the swap finish with the previous partitions. New edges of existing nodes can be shipped as a delta partition
+    // with a new suffix, e.g. node_0_1.map, neighbors_0_1.index and other files of a converted partition 0_1.
+    // Only new partitions and partitions with replaced files are loaded, others are shared with the previous
+    // snapshot. To remove edges or change features, convert the partition again and rename its files over the old
+    // ones, so partitions mapped from previous files stay valid until their last request finishes; removed files
+    // drop the partition. The node index is always built again.
+    //
+    // Clients keep state derived from the previous partitions: cached feature values and node routes, which send
+    // requests for a node only to the shard it was on. Replies carry the snapshot version in engine_version_key
+    // trailing metadata, so clients drop that state once they see a new version.
+    void Reload();
+
+    // Number of completed reloads.
+    uint64_t Version() const;
+
+    // Read node features of partitions on NUMA nodes with pools pinned to the nodes, indexed as numa_nodes().
+    // Pools are shared with request processing, an empty list detaches them and waits for reads in flight.
+    void SetNodeWorkers(std::vector<ThreadPool *> pools);
 
   private:
-    void ReadNodeMap(std::filesystem::path path, std::string suffix, uint32_t index);
+    std::shared_ptr<const GraphEngineSnapshot> Snapshot() const;
 
-    std::vector<Partition> m_partitions;
-    absl::flat_hash_map<NodeId, uint64_t> m_node_map;
-    std::vector<uint32_t> m_partitions_indices;
-    std::vector<uint64_t> m_internal_indices;
-    std::vector<uint32_t> m_counts;
-    Metadata m_metadata;
+    // Snapshot for a request, its version is added to the reply trailing metadata.
+    std::shared_ptr<const GraphEngineSnapshot> Snapshot(grpc::ServerContext *context,
+                                                        uint64_t *version = nullptr) const;
+
+    std::shared_ptr<NodeWorkers> m_node_workers = std::make_shared<NodeWorkers>();
+    std::function<std::shared_ptr<const GraphEngineSnapshot>(const GraphEngineSnapshot *previous)> m_load;
+
+    // Requests hold a reference to the snapshot they started with, the mutex only guards the pointer swap.
+    mutable std::mutex m_snapshot_mutex;
+    std::shared_ptr<const GraphEngineSnapshot> m_snapshot;
+    uint64_t m_version = 0;
+    std::mutex m_reload_mutex;
 };
 
 } // namespace snark
@@ -3,44 +3,100 @@
 
 #include "src/cc/lib/distributed/graph_sampler.h"
 #include "src/cc/lib/graph/sampler.h"
+#include "src/cc/lib/graph/xoroshiro.h"
+#include <algorithm>
 #include <cstdio>
 #include <thread>
 
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 
+#include "boost/random/binomial_distribution.hpp"
+#include "boost/random/uniform_int_distribution.hpp"
+
 namespace snark
 {
 
+void SplitSampleBatch(bool is_edge, int64_t seed, size_t count, std::span<const uint64_t> sampler_ids,
+                      std::span<const float> weights, std::span<size_t> out_counts, std::span<int64_t> out_seeds)
+{
+    std::fill(std::begin(out_counts), std::end(out_counts), 0);
+    std::fill(std::begin(out_seeds), std::end(out_seeds), 0);
+    snark::Xoroshiro128PlusGenerator gen(seed);
+    boost::random::uniform_int_distribution<int64_t> subseed;
+    size_t left = count;
+    for (size_t shard = 0; shard < sampler_ids.size() && (!is_edge || left > 0); ++shard)
+    {
+        if (!is_edge && sampler_ids[shard] == empty_sampler_id)
+        {
+            continue;
+        }
+
+        out_counts[shard] = boost::random::binomial_distribution<int32_t>(left, weights[shard])(gen);
+        left -= out_counts[shard];
+        out_seeds[shard] = subseed(gen);
+    }
+}
+
 GraphSamplerServiceImpl::GraphSamplerServiceImpl(std::string path, std::set<size_t> partitions)
-    : m_partitions(std::move(partitions))
+    : m_path(std::move(path)), m_node_sampler_factory(NodeSamplerFactories(m_path)),
+      m_edge_sampler_factory(EdgeSamplerFactories(m_path)), m_partitions(std::move(partitions))
+{
+}
+
+GraphSamplerServiceImpl::SamplerFactories GraphSamplerServiceImpl::NodeSamplerFactories(const std::string &path)
 {
-    m_node_sampler_factory[snark::CreateSamplerRequest_Category_WEIGHTED] =
-        std::make_shared<WeightedNodeSamplerFactory>(path);
-    m_node_sampler_factory[snark::CreateSamplerRequest_Category_UNIFORM_WITH_REPLACEMENT] =
+    SamplerFactories factories;
+    factories[snark::CreateSamplerRequest_Category_WEIGHTED] = std::make_shared<WeightedNodeSamplerFactory>(path);
+    factories[snark::CreateSamplerRequest_Category_UNIFORM_WITH_REPLACEMENT] =
         std::make_shared<UniformNodeSamplerFactory>(path);
-    m_node_sampler_factory[snark::CreateSamplerRequest_Category_UNIFORM_WITHOUT_REPLACEMENT] =
+    factories[snark::CreateSamplerRequest_Category_UNIFORM_WITHOUT_REPLACEMENT] =
         std::make_shared<UniformNodeSamplerFactoryWithoutReplacement>(path);
-    m_edge_sampler_factory[snark::CreateSamplerRequest_Category_WEIGHTED] =
-        std::make_shared<WeightedEdgeSamplerFactory>(path);
-    m_edge_sampler_factory[snark::CreateSamplerRequest_Category_UNIFORM_WITH_REPLACEMENT] =
+    return factories;
+}
+
+GraphSamplerServiceImpl::SamplerFactories GraphSamplerServiceImpl::EdgeSamplerFactories(const std::string &path)
+{
+    SamplerFactories factories;
+    factories[snark::CreateSamplerRequest_Category_WEIGHTED] = std::make_shared<WeightedEdgeSamplerFactory>(path);
+    factories[snark::CreateSamplerRequest_Category_UNIFORM_WITH_REPLACEMENT] =
         std::make_shared<UniformEdgeSamplerFactory>(path);
-    m_edge_sampler_factory[snark::CreateSamplerRequest_Category_UNIFORM_WITHOUT_REPLACEMENT] =
+    factories[snark::CreateSamplerRequest_Category_UNIFORM_WITHOUT_REPLACEMENT] =
         std::make_shared<UniformEdgeSamplerFactoryWithoutReplacement>(path);
+    return factories;
+}
+
+void GraphSamplerServiceImpl::Reload()
+{
+    // Factories cache sampler records loaded from partitions, new ones read updated files.
+    auto node_factories = NodeSamplerFactories(m_path);
+    auto edge_factories = EdgeSamplerFactories(m_path);
+    std::lock_guard l(m_mutex);
+    std::swap(m_node_sampler_factory, node_factories);
+    std::swap(m_edge_sampler_factory, edge_factories);
 }
 
 grpc::Status GraphSamplerServiceImpl::Create(::grpc::ServerContext *context, const snark::CreateSamplerRequest *request,
                                              snark::CreateSamplerReply *response)
 {
-    auto &factory = request->is_edge() ? m_edge_sampler_factory : m_node_sampler_factory;
-    auto it = factory.find(request->category());
-    if (it == std::end(factory))
+    std::shared_ptr<snark::SamplerFactory> factory;
+    {
+        std::lock_guard l(m_mutex);
+        const auto &factories = request->is_edge() ? m_edge_sampler_factory : m_node_sampler_factory;
+        auto it = factories.find(request->category());
+        if (it != std::end(factories))
+        {
+            factory = it->second;
+        }
+    }
+
+    if (!factory)
     {
         RAW_LOG_ERROR("Failed to find sampler in path");
         return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Failed to find sampler in path");
     }
 
-    auto sampler = it->second->Create(
+    auto sampler = factory->Create(
         std::set<Type>(std::begin(request->enitity_types()), std::end(request->enitity_types())), m_partitions);
     if (!sampler)
     {
@@ -5,6 +5,7 @@
 #define SNARK_GRAPH_SAMPLER_SERVICE_H
 
 #include <mutex>
+#include <span>
 
 #include "absl/container/flat_hash_map.h"
 #include <grpc/grpc.h>
@@ -20,6 +21,12 @@ namespace snark
 // and client is safe to skip requests to such shards.
 const uint64_t empty_sampler_id = std::numeric_limits<uint64_t>::max();
 
+// Split a client batch of count elements between sampler shards with conditional shard weights. Every shard gets
+// a number of elements and a seed for its sampler, so clients and streaming servers produce the same batches.
+// Node batches skip shards with empty samplers, edge batches stop once all elements are assigned.
+void SplitSampleBatch(bool is_edge, int64_t seed, size_t count, std::span<const uint64_t> sampler_ids,
+                      std::span<const float> weights, std::span<size_t> out_counts, std::span<int64_t> out_seeds);
+
 class GraphSamplerServiceImpl final : public snark::GraphSampler::Service
 {
   public:
@@ -31,11 +38,18 @@ class GraphSamplerServiceImpl final : public snark::GraphSampler::Service
     grpc::Status Sample(::grpc::ServerContext *context, const snark::SampleRequest *request,
                         snark::SampleReply *response) override;
 
+    // Read sampler data from the graph path again for new samplers, samplers created before keep their records.
+    void Reload();
+
   private:
-    absl::flat_hash_map<snark::CreateSamplerRequest_Category, std::shared_ptr<snark::SamplerFactory>>
-        m_node_sampler_factory;
-    absl::flat_hash_map<snark::CreateSamplerRequest_Category, std::shared_ptr<snark::SamplerFactory>>
-        m_edge_sampler_factory;
+    using SamplerFactories =
+        absl::flat_hash_map<snark::CreateSamplerRequest_Category, std::shared_ptr<snark::SamplerFactory>>;
+    static SamplerFactories NodeSamplerFactories(const std::string &path);
+    static SamplerFactories EdgeSamplerFactories(const std::string &path);
+
+    std::string m_path;
+    SamplerFactories m_node_sampler_factory;
+    SamplerFactories m_edge_sampler_factory;
     std::vector<std::unique_ptr<snark::Sampler>> m_samplers;
     std::set<size_t> m_partitions;
     std::mutex m_mutex;
@@ -0,0 +1,202 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "src/cc/lib/distributed/metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace
+{
+const char *stage_names[] = {"queue", "process", "decode", "lookup", "read", "serialize", "roundtrip"};
+static_assert(std::size(stage_names) == size_t(snark::RequestStage::count));
+
+thread_local snark::MethodMetrics *current_method = nullptr;
+
+// Bit per stage timed on the current thread.
+thread_local uint32_t active_stages = 0;
+} // namespace
+
+namespace snark
+{
+
+void Histogram::Record(std::chrono::nanoseconds latency)
+{
+    const int64_t count = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    const auto us = uint64_t(std::max<int64_t>(0, count));
+    const size_t bucket = std::min<size_t>(std::bit_width(us), bucket_count - 1);
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum_us.fetch_add(us, std::memory_order_relaxed);
+}
+
+bool Histogram::Empty() const
+{
+    return m_count.load(std::memory_order_relaxed) == 0;
+}
+
+void Histogram::Snapshot(LatencyHistogram &output) const
+{
+    output.clear_buckets();
+    for (const auto &bucket : m_buckets)
+    {
+        output.add_buckets(bucket.load(std::memory_order_relaxed));
+    }
+    output.set_count(m_count.load(std::memory_order_relaxed));
+    output.set_sum_us(m_sum_us.load(std::memory_order_relaxed));
+}
+
+uint64_t latency_quantile(const LatencyHistogram &histogram, double quantile)
+{
+    const auto target = uint64_t(std::ceil(quantile * double(histogram.count())));
+    uint64_t seen = 0;
+    for (int bucket = 0; bucket < histogram.buckets_size(); ++bucket)
+    {
+        seen += histogram.buckets(bucket);
+        if (seen >= target && seen > 0)
+        {
+            return uint64_t(1) << bucket;
+        }
+    }
+
+    return 0;
+}
+
+MethodMetrics::MethodMetrics(std::string name) : m_name(std::move(name))
+{
+}
+
+void MethodMetrics::Snapshot(MethodStats &output) const
+{
+    output.set_method(m_name);
+    output.set_requests(m_requests.load(std::memory_order_relaxed));
+    output.set_nodes(m_nodes.load(std::memory_order_relaxed));
+    output.set_bytes(m_bytes.load(std::memory_order_relaxed));
+    output.set_reply_bytes(m_reply_bytes.load(std::memory_order_relaxed));
+    for (size_t stage = 0; stage < m_stages.size(); ++stage)
+    {
+        // Skip stages methods never go through.
+        if (m_stages[stage].Empty())
+        {
+            continue;
+        }
+
+        auto stage_stats = output.add_stages();
+        stage_stats->set_stage(stage_names[stage]);
+        m_stages[stage].Snapshot(*stage_stats->mutable_latency());
+    }
+}
+
+void ServerMetrics::Add(std::type_index call, std::string name)
+{
+    if (m_calls.contains(call))
+    {
+        return;
+    }
+
+    m_methods.emplace_back(std::make_unique<MethodMetrics>(std::move(name)));
+    m_calls.emplace(call, m_methods.back().get());
+}
+
+MethodMetrics *ServerMetrics::Find(std::type_index call) const
+{
+    auto method = m_calls.find(call);
+    return method == std::end(m_calls) ? nullptr : method->second;
+}
+
+void ServerMetrics::Snapshot(StatsReply &output) const
+{
+    output.clear_methods();
+    for (const auto &method : m_methods)
+    {
+        method->Snapshot(*output.add_methods());
+    }
+}
+
+MethodMetrics &ClientMetrics::Get(const std::string &method)
+{
+    std::lock_guard lock(m_mutex);
+    auto &metrics = m_methods[method];
+    if (!metrics)
+    {
+        metrics = std::make_unique<MethodMetrics>(method);
+    }
+
+    return *metrics;
+}
+
+void ClientMetrics::Snapshot(StatsReply &output) const
+{
+    output.clear_methods();
+    std::lock_guard lock(m_mutex);
+    for (const auto &method : m_methods)
+    {
+        method.second->Snapshot(*output.add_methods());
+    }
+}
+
+RequestScope::RequestScope(MethodMetrics *method) : m_previous(current_method)
+{
+    current_method = method;
+}
+
+RequestScope::~RequestScope()
+{
+    current_method = m_previous;
+}
+
+StageTimer::StageTimer(RequestStage stage) : m_method(current_method), m_stage(stage)
+{
+    const uint32_t bit = 1u << size_t(m_stage);
+    if (m_method != nullptr && (active_stages & bit) != 0)
+    {
+        m_method = nullptr;
+    }
+    if (m_method != nullptr)
+    {
+        active_stages |= bit;
+        m_start = std::chrono::steady_clock::now();
+    }
+}
+
+StageTimer::~StageTimer()
+{
+    Stop();
+}
+
+void StageTimer::Stop()
+{
+    if (m_method != nullptr)
+    {
+        m_method->m_stages[size_t(m_stage)].Record(std::chrono::steady_clock::now() - m_start);
+        active_stages &= ~(1u << size_t(m_stage));
+        m_method = nullptr;
+    }
+}
+
+void count_request_nodes(size_t count)
+{
+    if (current_method != nullptr)
+    {
+        current_method->m_nodes.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+void count_request_bytes(size_t count)
+{
+    if (current_method != nullptr)
+    {
+        current_method->m_bytes.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+void count_reply_bytes(size_t count)
+{
+    if (current_method != nullptr)
+    {
+        current_method->m_reply_bytes.fetch_add(count, std::memory_order_relaxed);
+    }
+}
+
+} // namespace snark
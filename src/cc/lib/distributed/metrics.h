@@ -0,0 +1,136 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_METRICS_H
+#define SNARK_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <typeindex>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+#include "src/cc/lib/distributed/service.pb.h"
+
+namespace snark
+{
+
+// Latency histogram with power of 2 microsecond buckets, safe to update from multiple threads.
+class Histogram
+{
+  public:
+    static constexpr size_t bucket_count = 32;
+
+    void Record(std::chrono::nanoseconds latency);
+    bool Empty() const;
+    void Snapshot(LatencyHistogram &output) const;
+
+  private:
+    std::array<std::atomic<uint64_t>, bucket_count> m_buckets = {};
+    std::atomic<uint64_t> m_count = 0;
+    std::atomic<uint64_t> m_sum_us = 0;
+};
+
+// Upper bound in microseconds of the bucket containing the given quantile of latencies.
+uint64_t latency_quantile(const LatencyHistogram &histogram, double quantile);
+
+enum class RequestStage
+{
+    // Waiting for a worker thread after a request was taken from a completion queue.
+    queue,
+    // Processing of a request by a call data, includes all stages below.
+    process,
+    // Parsing requests. Decode and serialize stages are only recorded by GetNodeFeatures, which handles raw
+    // buffers, gRPC parses and writes messages of other methods outside of their handlers.
+    decode,
+    // Node index lookups and edge searches in partitions of their sources.
+    lookup,
+    // Reading features from partitions.
+    read,
+    // Writing replies.
+    serialize,
+    // Client time from sending a request to processing the reply, includes hedged and failed over attempts.
+    roundtrip,
+    count
+};
+
+struct MethodMetrics
+{
+    explicit MethodMetrics(std::string name);
+
+    void Snapshot(MethodStats &output) const;
+
+    std::string m_name;
+    std::atomic<uint64_t> m_requests = 0;
+    std::atomic<uint64_t> m_nodes = 0;
+    std::atomic<uint64_t> m_bytes = 0;
+    std::atomic<uint64_t> m_reply_bytes = 0;
+    std::array<Histogram, size_t(RequestStage::count)> m_stages;
+};
+
+// Metrics of server methods keyed by types of call data handling them. Methods have to be added before requests
+// are handled.
+class ServerMetrics
+{
+  public:
+    void Add(std::type_index call, std::string name);
+    MethodMetrics *Find(std::type_index call) const;
+    void Snapshot(StatsReply &output) const;
+
+  private:
+    std::vector<std::unique_ptr<MethodMetrics>> m_methods;
+    absl::flat_hash_map<std::type_index, MethodMetrics *, std::hash<std::type_index>> m_calls;
+};
+
+// Metrics of client methods keyed by RPC names, methods are added on first use.
+class ClientMetrics
+{
+  public:
+    MethodMetrics &Get(const std::string &method);
+    void Snapshot(StatsReply &output) const;
+
+  private:
+    mutable std::mutex m_mutex;
+    absl::flat_hash_map<std::string, std::unique_ptr<MethodMetrics>> m_methods;
+};
+
+// Set metrics of the request handled by the current thread. Stages and counters recorded on threads without
+// a request scope are ignored, so services don't need to know if they run inside of a server.
+class RequestScope
+{
+  public:
+    explicit RequestScope(MethodMetrics *method);
+    ~RequestScope();
+
+  private:
+    MethodMetrics *m_previous;
+};
+
+// Record time until the end of a scope in a stage histogram of the current request. Timers nested in a timer of the
+// same stage are ignored, so helpers time their stage no matter if callers do.
+class StageTimer
+{
+  public:
+    explicit StageTimer(RequestStage stage);
+    ~StageTimer();
+
+    // Record the stage before the end of a scope.
+    void Stop();
+
+  private:
+    MethodMetrics *m_method;
+    RequestStage m_stage;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+void count_request_nodes(size_t count);
+void count_request_bytes(size_t count);
+void count_reply_bytes(size_t count);
+
+} // namespace snark
+#endif // SNARK_METRICS_H
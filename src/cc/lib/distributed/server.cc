@@ -3,8 +3,11 @@
 
 #include "server.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <limits>
+#include <mutex>
+#include <typeinfo>
 
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
@@ -12,6 +15,13 @@
 
 #include "src/cc/lib/distributed/call_data.h"
 
+namespace
+{
+// Calls in flight are cancelled after the timeout, e.g. streams accepted by the transport while the server shuts down
+// are never matched to calls waiting for requests.
+static const auto shutdown_timeout = std::chrono::seconds(5);
+} // namespace
+
 namespace snark
 {
 
@@ -108,12 +118,19 @@ class EmptyGraphEngine final : public snark::GraphEngine::Service
     {
         return grpc::Status::OK;
     }
+
+    grpc::Status GetNodeIds(::grpc::ServerContext *context, const snark::NodeIdsRequest *request,
+                            snark::NodeIdsReply *response) override
+    {
+        return grpc::Status::OK;
+    }
 };
 
 GRPCServer::GRPCServer(std::shared_ptr<snark::GraphEngineServiceImpl> engine_service_impl,
                        std::shared_ptr<snark::GraphSamplerServiceImpl> sampler_service_impl, std::string host_name,
-                       std::string ssl_key, std::string ssl_cert, std::string ssl_root)
-    : m_engine_service_impl(std::move(engine_service_impl)), m_sampler_service_impl(std::move(sampler_service_impl))
+                       std::string ssl_key, std::string ssl_cert, std::string ssl_root, ServerThreadsConfig threads)
+    : m_threads_config(std::move(threads)), m_engine_service_impl(std::move(engine_service_impl)),
+      m_sampler_service_impl(std::move(sampler_service_impl))
 {
     if (!m_engine_service_impl && !m_sampler_service_impl)
     {
@@ -131,7 +148,7 @@ GRPCServer::GRPCServer(std::shared_ptr<snark::GraphEngineServiceImpl> engine_ser
         creds = grpc::SslServerCredentials(opts);
     }
 
-    builder.AddListeningPort(host_name, std::move(creds));
+    builder.AddListeningPort(host_name, std::move(creds), &m_port);
     if (!m_engine_service_impl)
     {
         m_engine_service_impl = std::make_shared<EmptyGraphEngine>();
@@ -144,21 +161,79 @@ GRPCServer::GRPCServer(std::shared_ptr<snark::GraphEngineServiceImpl> engine_ser
     }
     builder.RegisterService(&m_sampler_service);
 
-    for (size_t thread_num = 0; thread_num < std::thread::hardware_concurrency(); ++thread_num)
+    size_t queue_count = m_threads_config.m_queue_count;
+    if (queue_count == 0)
+    {
+        queue_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (m_threads_config.m_numa)
+    {
+        m_numa_nodes = numa_nodes();
+        queue_count = std::max(queue_count, m_numa_nodes.size());
+    }
+    for (size_t queue = 0; queue < queue_count; ++queue)
     {
         m_cqs.emplace_back(builder.AddCompletionQueue());
     }
+    if (m_threads_config.m_worker_count > 0)
+    {
+        const size_t total_workers = m_threads_config.m_worker_count;
+        const size_t pool_count = std::max<size_t>(1, m_numa_nodes.size());
+        for (size_t pool = 0; pool < pool_count; ++pool)
+        {
+            const size_t extra_worker = pool < total_workers % pool_count ? 1 : 0;
+            const size_t worker_count = std::max<size_t>(1, total_workers / pool_count + extra_worker);
+            std::function<void()> init;
+            if (!m_numa_nodes.empty())
+            {
+                init = [node = m_numa_nodes[pool]]() { pin_thread(node); };
+            }
+
+            // Thread pool counts the calling thread, but polling threads never process requests.
+            m_workers.emplace_back(std::make_unique<ThreadPool>(worker_count + 1, std::move(init)));
+        }
+
+        // Pinned workers also read node features of partitions placed on their nodes.
+        auto engine = dynamic_cast<GraphEngineServiceImpl *>(m_engine_service_impl.get());
+        if (engine != nullptr && m_numa_nodes.size() > 1)
+        {
+            std::vector<ThreadPool *> pools;
+            for (const auto &pool : m_workers)
+            {
+                pools.emplace_back(pool.get());
+            }
+            engine->SetNodeWorkers(std::move(pools));
+        }
+    }
 
     m_server = builder.BuildAndStart();
-    for (size_t thread_num = 0; thread_num < std::thread::hardware_concurrency(); ++thread_num)
+    for (auto &queue : m_cqs)
     {
-        m_runner_threads.emplace_back(&GRPCServer::HandleRpcs, this, thread_num);
+        AddCalls(*queue);
+    }
+
+    const size_t thread_count = std::max(queue_count, m_threads_config.m_thread_count);
+    for (size_t thread_num = 0; thread_num < thread_count; ++thread_num)
+    {
+        m_runner_threads.emplace_back(&GRPCServer::HandleRpcs, this, thread_num % queue_count);
     }
 }
 
 GRPCServer::~GRPCServer()
 {
-    m_server->Shutdown();
+    // Server shutdown waits for calls in flight and cancels calls waiting for new requests. Queues stay open until
+    // workers finish their tasks, because processing a request starts a new call on the queue of the request.
+    m_server->Shutdown(std::chrono::system_clock::now() + shutdown_timeout);
+    {
+        std::unique_lock lock(m_workers_mutex);
+        m_workers_stopped = true;
+    }
+    if (auto engine = dynamic_cast<GraphEngineServiceImpl *>(m_engine_service_impl.get()))
+    {
+        engine->SetNodeWorkers({});
+    }
+    m_workers.clear();
+
     for (auto &queue : m_cqs)
     {
         queue->Shutdown();
@@ -169,35 +244,99 @@ GRPCServer::~GRPCServer()
     }
 }
 
+int GRPCServer::Port() const
+{
+    return m_port;
+}
+
 std::shared_ptr<grpc::Channel> GRPCServer::InProcessChannel()
 {
     return m_server->InProcessChannel(grpc::ChannelArguments());
 }
 
-void GRPCServer::HandleRpcs(size_t index)
+void GRPCServer::GetStats(StatsReply &output) const
+{
+    m_metrics.Snapshot(output);
+}
+
+uint64_t GRPCServer::Reload()
+{
+    // Stub services of servers without partitions have nothing to reload.
+    if (auto sampler = dynamic_cast<GraphSamplerServiceImpl *>(m_sampler_service_impl.get()))
+    {
+        sampler->Reload();
+    }
+
+    auto engine = dynamic_cast<GraphEngineServiceImpl *>(m_engine_service_impl.get());
+    if (engine == nullptr)
+    {
+        return 0;
+    }
+
+    engine->Reload();
+    return engine->Version();
+}
+
+size_t GRPCServer::MethodCalls(const std::string &method) const
+{
+    auto calls = m_threads_config.m_method_calls.find(method);
+    return calls == std::end(m_threads_config.m_method_calls) ? m_threads_config.m_calls_per_method : calls->second;
+}
+
+void GRPCServer::AddCalls(grpc::ServerCompletionQueue &queue)
 {
-    auto &queue = *m_cqs[index];
     if (m_engine_service_impl)
     {
-        new GetNeighborsCallData(m_engine_service, queue, *m_engine_service_impl);
-        new GetNeighborCountCallData(m_engine_service, queue, *m_engine_service_impl);
-        new SampleNeighborsCallData(m_engine_service, queue, *m_engine_service_impl);
-        new UniformSampleNeighborsCallData(m_engine_service, queue, *m_engine_service_impl);
-        new NodeFeaturesCallData(m_engine_service, queue, *m_engine_service_impl);
-        new EdgeFeaturesCallData(m_engine_service, queue, *m_engine_service_impl);
-        new NodeSparseFeaturesCallData(m_engine_service, queue, *m_engine_service_impl);
-        new EdgeSparseFeaturesCallData(m_engine_service, queue, *m_engine_service_impl);
-        new NodeStringFeaturesCallData(m_engine_service, queue, *m_engine_service_impl);
-        new EdgeStringFeaturesCallData(m_engine_service, queue, *m_engine_service_impl);
-        new GetMetadataCallData(m_engine_service, queue, *m_engine_service_impl);
-        new NodeTypesCallData(m_engine_service, queue, *m_engine_service_impl);
+        auto &engine = *m_engine_service_impl;
+        AddCalls<GetNeighborsCallData>("GetNeighbors", m_engine_service, queue, engine);
+        AddCalls<GetNeighborCountCallData>("GetNeighborCounts", m_engine_service, queue, engine);
+        AddCalls<SampleNeighborsCallData>("WeightedSampleNeighbors", m_engine_service, queue, engine);
+        AddCalls<UniformSampleNeighborsCallData>("UniformSampleNeighbors", m_engine_service, queue, engine);
+        AddCalls<SampleSubgraphCallData>("SampleSubgraph", m_engine_service, queue, engine);
+        AddCalls<RandomWalkCallData>("RandomWalk", m_engine_service, queue, engine);
+        AddCalls<NeighborCandidatesCallData>("GetNeighborCandidates", m_engine_service, queue, engine);
+        AddCalls<NodeFeaturesCallData>("GetNodeFeatures", m_engine_service, queue, engine);
+        AddCalls<EdgeFeaturesCallData>("GetEdgeFeatures", m_engine_service, queue, engine);
+        AddCalls<NodeSparseFeaturesCallData>("GetNodeSparseFeatures", m_engine_service, queue, engine);
+        AddCalls<EdgeSparseFeaturesCallData>("GetEdgeSparseFeatures", m_engine_service, queue, engine);
+        AddCalls<NodeStringFeaturesCallData>("GetNodeStringFeatures", m_engine_service, queue, engine);
+        AddCalls<EdgeStringFeaturesCallData>("GetEdgeStringFeatures", m_engine_service, queue, engine);
+        AddCalls<GetMetadataCallData>("GetMetadata", m_engine_service, queue, engine);
+        AddCalls<NodeTypesCallData>("GetNodeTypes", m_engine_service, queue, engine);
+        AddCalls<NodeIdsCallData>("GetNodeIds", m_engine_service, queue, engine);
     }
     if (m_sampler_service_impl)
     {
-        new CreateSamplerCallData(m_sampler_service, queue, *m_sampler_service_impl);
-        new SampleElementsCallData(m_sampler_service, queue, *m_sampler_service_impl);
+        auto &sampler = *m_sampler_service_impl;
+        AddCalls<CreateSamplerCallData>("Create", m_sampler_service, queue, sampler);
+        AddCalls<SampleElementsCallData>("Sample", m_sampler_service, queue, sampler);
+        AddCalls<SampleStreamCallData>("SampleStream", m_sampler_service, queue, sampler);
+    }
+    AddCalls<GetStatsCallData>("GetStats", m_engine_service, queue, m_metrics);
+}
+
+template <typename Call, typename Service, typename ServiceImpl>
+void GRPCServer::AddCalls(const std::string &method, Service &service, grpc::ServerCompletionQueue &queue,
+                          ServiceImpl &service_impl)
+{
+    m_metrics.Add(typeid(Call), method);
+
+    // All new objects will be deleted when we drain the request queue.
+    for (size_t call = 0; call < std::max<size_t>(1, MethodCalls(method)); ++call)
+    {
+        new Call(service, queue, service_impl);
+    }
+}
+
+void GRPCServer::HandleRpcs(size_t index)
+{
+    if (!m_numa_nodes.empty())
+    {
+        pin_thread(m_numa_nodes[index % m_numa_nodes.size()]);
     }
 
+    auto &queue = *m_cqs[index];
+    auto *workers = m_workers.empty() ? nullptr : m_workers[index % m_workers.size()].get();
     void *tag;
     bool ok;
     while (queue.Next(&tag, &ok))
@@ -209,8 +348,45 @@ void GRPCServer::HandleRpcs(size_t index)
             continue;
         }
 
-        static_cast<CallData *>(tag)->Proceed();
+        auto &call = *static_cast<CallData *>(tag);
+        if (workers != nullptr)
+        {
+            // Events left in queues after workers are stopped are processed by polling threads.
+            std::shared_lock lock(m_workers_mutex);
+            if (!m_workers_stopped)
+            {
+                workers->Submit([this, &call, queued = std::chrono::steady_clock::now()]() {
+                    Proceed(call, std::chrono::steady_clock::now() - queued);
+                });
+                continue;
+            }
+        }
+
+        Proceed(call, std::nullopt);
     }
 }
 
+void GRPCServer::Proceed(CallData &call, std::optional<std::chrono::nanoseconds> queue_time)
+{
+    // Finished calls are deleted after sending replies.
+    auto *method = call.Finished() ? nullptr : m_metrics.Find(typeid(call));
+    if (method == nullptr)
+    {
+        call.Proceed();
+        return;
+    }
+
+    if (queue_time)
+    {
+        method->m_stages[size_t(RequestStage::queue)].Record(*queue_time);
+    }
+    method->m_requests.fetch_add(1, std::memory_order_relaxed);
+
+    // Call might be deleted by other threads as soon as it starts sending a reply, so only method metrics are
+    // updated after it.
+    RequestScope scope(method);
+    StageTimer timer(RequestStage::process);
+    call.Proceed();
+}
+
 } // namespace snark
@@ -4,33 +4,93 @@
 #ifndef SNARK_SERVER_H
 #define SNARK_SERVER_H
 
+#include <chrono>
 #include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
 #include <thread>
 
 #include <grpc/grpc.h>
 #include <grpcpp/create_channel.h>
 #include <grpcpp/grpcpp.h>
 
+#include "absl/container/flat_hash_map.h"
+
 #include "src/cc/lib/distributed/graph_engine.h"
 #include "src/cc/lib/distributed/graph_sampler.h"
+#include "src/cc/lib/distributed/metrics.h"
 #include "src/cc/lib/graph/graph.h"
+#include "src/cc/lib/graph/numa.h"
+#include "src/cc/lib/graph/parallel.h"
 
 namespace snark
 {
+class CallData;
+
+struct ServerThreadsConfig
+{
+    // Number of completion queues, 0 creates one per hardware thread.
+    size_t m_queue_count = 0;
+
+    // Threads polling completion queues, spread evenly between them. At least one thread polls every queue.
+    size_t m_thread_count = 0;
+
+    // Calls of every method waiting for new requests in each queue, limits how many requests of a single method
+    // a queue processes concurrently.
+    size_t m_calls_per_method = 1;
+
+    // Per method overrides of m_calls_per_method, keys are names of RPC methods, e.g. "GetNodeFeatures".
+    absl::flat_hash_map<std::string, size_t> m_method_calls;
+
+    // Threads to process requests separately from polling threads, 0 processes requests on polling threads.
+    size_t m_worker_count = 0;
+
+    // Pin threads to NUMA nodes detected on the host. Queues are assigned to nodes in turn, every queue gets at
+    // least one, and workers are split evenly between nodes. Requests taken from a queue are processed by threads
+    // of its node. Workers of a node also read node features of partitions the engine placed on the node.
+    bool m_numa = false;
+};
+
 class GRPCServer final
 {
   public:
     GRPCServer(std::shared_ptr<snark::GraphEngineServiceImpl> engine_service_impl,
                std::shared_ptr<snark::GraphSamplerServiceImpl> sampler_service_impl, std::string host_name,
-               std::string ssl_key, std::string ssl_cert, std::string ssl_root);
+               std::string ssl_key, std::string ssl_cert, std::string ssl_root, ServerThreadsConfig threads = {});
 
     ~GRPCServer();
 
     std::shared_ptr<grpc::Channel> InProcessChannel();
 
+    // Port the server listens on, e.g. the one picked by the OS for host names with port 0.
+    int Port() const;
+
     void HandleRpcs(size_t index);
 
+    // Counters and latencies of requests handled by the server, same as the GetStats reply.
+    void GetStats(StatsReply &output) const;
+
+    // Reload partitions and samplers of the services without interrupting requests in flight. Returns the number
+    // of completed engine reloads, 0 for servers without a graph engine.
+    uint64_t Reload();
+
   private:
+    // Number of calls of a method waiting for requests in each queue.
+    size_t MethodCalls(const std::string &method) const;
+
+    // Start calls of all methods waiting for requests in a queue.
+    void AddCalls(grpc::ServerCompletionQueue &queue);
+
+    template <typename Call, typename Service, typename ServiceImpl>
+    void AddCalls(const std::string &method, Service &service, grpc::ServerCompletionQueue &queue,
+                  ServiceImpl &service_impl);
+
+    // Process a completed call operation and record metrics of its method. Queue time is set for requests
+    // processed by workers.
+    void Proceed(CallData &call, std::optional<std::chrono::nanoseconds> queue_time);
+
+    ServerThreadsConfig m_threads_config;
     std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> m_cqs;
 
     // Sampler/Engine split helps us to manage runtime:
@@ -38,12 +98,25 @@ class GRPCServer final
     // * Adding new server side samplers doesn't require to restart a service
     //   and interrupt existing clients, new clients can connect to old and new
     //   endpoints.
-    snark::GraphEngine::AsyncService m_engine_service;
+    snark::GraphEngineAsyncService m_engine_service;
     std::shared_ptr<snark::GraphEngine::Service> m_engine_service_impl;
     snark::GraphSampler::AsyncService m_sampler_service;
     std::shared_ptr<snark::GraphSampler::Service> m_sampler_service_impl;
     std::unique_ptr<grpc::Server> m_server;
     std::vector<std::thread> m_runner_threads;
+
+    // Nodes to pin threads of queue i to m_numa_nodes[i % size], empty if threads are not pinned.
+    std::vector<NumaNode> m_numa_nodes;
+
+    // Worker pools, one for every NUMA node or a single one for all queues.
+    std::vector<std::unique_ptr<ThreadPool>> m_workers;
+
+    // Polling threads submit requests to workers until the server is destroyed.
+    std::shared_mutex m_workers_mutex;
+    bool m_workers_stopped = false;
+
+    ServerMetrics m_metrics;
+    int m_port = 0;
 };
 } // namespace snark
 #endif // SNARK_SERVER_H
@@ -0,0 +1,387 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "compressed_adjacency.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+
+namespace snark
+{
+namespace
+{
+void write_varint(uint64_t value, std::vector<uint8_t> &output)
+{
+    while (value >= 0x80)
+    {
+        output.emplace_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    output.emplace_back(uint8_t(value));
+}
+
+uint64_t read_varint(const uint8_t *&input)
+{
+    uint64_t result = 0;
+    for (uint32_t shift = 0;; shift += 7)
+    {
+        const uint8_t byte = *input++;
+        result |= uint64_t(byte & 0x7f) << shift;
+        if (byte < 0x80)
+        {
+            return result;
+        }
+    }
+}
+
+uint64_t zigzag_encode(uint64_t delta)
+{
+    return (delta << 1) ^ uint64_t(int64_t(delta) >> 63);
+}
+
+uint64_t zigzag_decode(uint64_t value)
+{
+    return (value >> 1) ^ (~(value & 1) + 1);
+}
+
+// Convert value to half precision if it can be done without losing precision.
+bool to_half(float value, uint16_t &output)
+{
+    const auto bits = std::bit_cast<uint32_t>(value);
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const int32_t exponent = int32_t((bits >> 23) & 0xff) - 127;
+    const uint32_t mantissa = bits & 0x7fffff;
+    if ((bits & 0x7fffffff) == 0)
+    {
+        output = sign;
+        return true;
+    }
+    if (exponent >= -14 && exponent <= 15)
+    {
+        if ((mantissa & 0x1fff) != 0)
+        {
+            return false;
+        }
+        output = sign | uint16_t((exponent + 15) << 10) | uint16_t(mantissa >> 13);
+        return true;
+    }
+    if (exponent >= -24 && exponent < -14)
+    {
+        // Subnormal half precision numbers: value = mantissa * 2^-24.
+        const uint32_t shift = -1 - exponent;
+        const uint32_t full_mantissa = mantissa | 0x800000;
+        if ((full_mantissa & ((1u << shift) - 1)) != 0)
+        {
+            return false;
+        }
+        output = sign | uint16_t(full_mantissa >> shift);
+        return true;
+    }
+
+    return false;
+}
+
+float from_half(uint16_t value)
+{
+    const uint32_t sign = uint32_t(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1f;
+    const uint32_t mantissa = value & 0x3ff;
+    if (exponent == 0)
+    {
+        const float result = std::ldexp(float(mantissa), -24);
+        return sign ? -result : result;
+    }
+
+    return std::bit_cast<float>(sign | ((exponent + 127 - 15) << 23) | (mantissa << 13));
+}
+
+template <typename T> T read_value(const uint8_t *data)
+{
+    T result;
+    std::memcpy(&result, data, sizeof(T));
+    return result;
+}
+
+template <typename T> void write_value(T value, std::vector<uint8_t> &output)
+{
+    const auto *data = reinterpret_cast<const uint8_t *>(&value);
+    output.insert(std::end(output), data, data + sizeof(T));
+}
+} // namespace
+
+void CompressedAdjacency::Append(NodeId destination, float weight, bool run_start)
+{
+    if (m_size % block_size == 0)
+    {
+        FlushWeights();
+        m_blocks.emplace_back(Block{.m_destinations = m_destination_data.size(),
+                                    .m_weights = 0,
+                                    .m_first = destination,
+                                    .m_weight_sum = m_weight_sum,
+                                    .m_encoding = WeightEncoding::constant});
+    }
+    else
+    {
+        write_varint(zigzag_encode(uint64_t(destination) - uint64_t(m_last_destination)), m_destination_data);
+    }
+
+    m_last_destination = destination;
+    m_weight_sum = run_start ? weight : m_weight_sum + weight;
+    m_pending_weights.emplace_back(weight);
+    ++m_size;
+}
+
+void CompressedAdjacency::FlushWeights()
+{
+    if (m_pending_weights.empty())
+    {
+        return;
+    }
+
+    auto &block = m_blocks.back();
+    block.m_weights = m_weight_data.size();
+    const auto first_bits = std::bit_cast<uint32_t>(m_pending_weights.front());
+    if (std::all_of(std::begin(m_pending_weights), std::end(m_pending_weights),
+                    [first_bits](float weight) { return std::bit_cast<uint32_t>(weight) == first_bits; }))
+    {
+        block.m_encoding = WeightEncoding::constant;
+        write_value(m_pending_weights.front(), m_weight_data);
+    }
+    else if (uint16_t half; std::all_of(std::begin(m_pending_weights), std::end(m_pending_weights),
+                                        [&half](float weight) { return to_half(weight, half); }))
+    {
+        block.m_encoding = WeightEncoding::half;
+        for (auto weight : m_pending_weights)
+        {
+            to_half(weight, half);
+            write_value(half, m_weight_data);
+        }
+    }
+    else
+    {
+        block.m_encoding = WeightEncoding::single;
+        for (auto weight : m_pending_weights)
+        {
+            write_value(weight, m_weight_data);
+        }
+    }
+
+    m_pending_weights.clear();
+}
+
+void CompressedAdjacency::Finish()
+{
+    FlushWeights();
+    m_pending_weights.shrink_to_fit();
+    m_blocks.shrink_to_fit();
+    m_destination_data.shrink_to_fit();
+    m_weight_data.shrink_to_fit();
+}
+
+size_t CompressedAdjacency::Size() const
+{
+    return m_size;
+}
+
+size_t CompressedAdjacency::MemoryUsage() const
+{
+    return m_blocks.capacity() * sizeof(Block) + m_destination_data.capacity() + m_weight_data.capacity();
+}
+
+template <typename F> void CompressedAdjacency::ForEachDestination(size_t first, size_t last, F func) const
+{
+    const auto *data = m_destination_data.data();
+    NodeId value = 0;
+    for (size_t position = first - first % block_size; position < last; ++position)
+    {
+        if (position % block_size == 0)
+        {
+            const auto &block = m_blocks[position / block_size];
+            value = block.m_first;
+            data = m_destination_data.data() + block.m_destinations;
+        }
+        else
+        {
+            value = NodeId(uint64_t(value) + zigzag_decode(read_varint(data)));
+        }
+
+        if (position >= first && !func(position, value))
+        {
+            return;
+        }
+    }
+}
+
+NodeId CompressedAdjacency::Destination(size_t position) const
+{
+    NodeId result = 0;
+    ForEachDestination(position, position + 1, [&result](size_t, NodeId value) {
+        result = value;
+        return false;
+    });
+
+    return result;
+}
+
+void CompressedAdjacency::Destinations(size_t first, size_t last, std::vector<NodeId> &output) const
+{
+    ForEachDestination(first, last, [&output](size_t, NodeId value) {
+        output.emplace_back(value);
+        return true;
+    });
+}
+
+size_t CompressedAdjacency::FindDestination(size_t first, size_t last, NodeId value) const
+{
+    if (first >= last)
+    {
+        return last;
+    }
+
+    // Skip blocks starting inside the range with first destination less than value.
+    const size_t first_block = first / block_size + 1;
+    const size_t last_block = std::max(first_block, (last - 1) / block_size + 1);
+    const auto block = std::partition_point(std::begin(m_blocks) + first_block, std::begin(m_blocks) + last_block,
+                                            [value](const Block &block) { return block.m_first < value; }) -
+                       std::begin(m_blocks);
+    const size_t start = size_t(block) == first_block ? first : (block - 1) * block_size;
+
+    size_t result = last;
+    ForEachDestination(start, last, [&result, value](size_t position, NodeId destination) {
+        if (destination < value)
+        {
+            return true;
+        }
+
+        result = position;
+        return false;
+    });
+
+    return result;
+}
+
+template <typename F> void CompressedAdjacency::ForEachWeight(size_t first, size_t last, F func) const
+{
+    for (size_t position = first; position < last;)
+    {
+        const auto &block = m_blocks[position / block_size];
+        const auto *data = m_weight_data.data() + block.m_weights;
+        const size_t block_last = std::min(last, position - position % block_size + block_size);
+        switch (block.m_encoding)
+        {
+        case WeightEncoding::constant: {
+            const auto weight = read_value<float>(data);
+            for (; position < block_last; ++position)
+            {
+                if (!func(position, weight))
+                {
+                    return;
+                }
+            }
+            break;
+        }
+        case WeightEncoding::half:
+            for (; position < block_last; ++position)
+            {
+                if (!func(position, from_half(read_value<uint16_t>(data + 2 * (position % block_size)))))
+                {
+                    return;
+                }
+            }
+            break;
+        default:
+            for (; position < block_last; ++position)
+            {
+                if (!func(position, read_value<float>(data + 4 * (position % block_size))))
+                {
+                    return;
+                }
+            }
+            break;
+        }
+    }
+}
+
+float CompressedAdjacency::Weight(size_t position) const
+{
+    float result = 0;
+    ForEachWeight(position, position + 1, [&result](size_t, float weight) {
+        result = weight;
+        return false;
+    });
+
+    return result;
+}
+
+float CompressedAdjacency::WeightSum(size_t run_first, size_t position) const
+{
+    const size_t block_start = position - position % block_size;
+    size_t start = run_first;
+    float result = 0;
+    if (run_first < block_start)
+    {
+        start = block_start;
+        result = m_blocks[block_start / block_size].m_weight_sum;
+    }
+
+    ForEachWeight(start, position + 1, [&result](size_t, float weight) {
+        result += weight;
+        return true;
+    });
+
+    return result;
+}
+
+void CompressedAdjacency::WeightSums(size_t run_first, size_t last, std::vector<float> &output) const
+{
+    float sum = 0;
+    ForEachWeight(run_first, last, [&sum, &output](size_t, float weight) {
+        sum += weight;
+        output.emplace_back(sum);
+        return true;
+    });
+}
+
+size_t CompressedAdjacency::FindWeightSum(size_t run_first, size_t last, float value, float &weight) const
+{
+    weight = 0;
+    if (run_first >= last)
+    {
+        return last;
+    }
+
+    // Weight sums are non decreasing within a run, skip blocks with weight sum before them less than value.
+    const size_t first_block = run_first / block_size + 1;
+    const size_t last_block = std::max(first_block, (last - 1) / block_size + 1);
+    const auto block = std::partition_point(std::begin(m_blocks) + first_block, std::begin(m_blocks) + last_block,
+                                            [value](const Block &block) { return block.m_weight_sum < value; }) -
+                       std::begin(m_blocks);
+    size_t start = run_first;
+    float sum = 0;
+    if (size_t(block) != first_block)
+    {
+        start = (block - 1) * block_size;
+        sum = m_blocks[block - 1].m_weight_sum;
+    }
+
+    size_t result = last;
+    ForEachWeight(start, last, [&](size_t position, float edge_weight) {
+        const auto previous = sum;
+        sum += edge_weight;
+        if (sum < value)
+        {
+            return true;
+        }
+
+        // Match weights computed from cumulative sums in uncompressed storage.
+        weight = position == run_first ? sum : sum - previous;
+        result = position;
+        return false;
+    });
+
+    return result;
+}
+
+} // namespace snark
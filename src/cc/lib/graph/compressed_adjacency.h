@@ -0,0 +1,95 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_COMPRESSED_ADJACENCY_H
+#define SNARK_COMPRESSED_ADJACENCY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+namespace snark
+{
+
+// Edge destinations and weights of a partition split in blocks of block_size edges. Destinations are stored as
+// zigzag varint encoded deltas to the previous edge, which is usually a few bytes for sorted neighbor lists.
+// Weights are stored losslessly: a single value if all weights in a block are the same, half precision if every
+// weight is representable as one, full precision otherwise. Every block keeps its first destination and the
+// running weight sum of the preceding edge, so any edge is decoded with at most a block worth of work.
+//
+// Edges are grouped in runs, where cumulative weights start from 0: a run is a list of neighbors of a node with
+// the same edge type and destinations are sorted within a run.
+class CompressedAdjacency
+{
+  public:
+    static constexpr size_t block_size = 32;
+
+    // Edges are appended in storage order, run_start marks the first edge of a run.
+    void Append(NodeId destination, float weight, bool run_start);
+
+    // Finish encoding and release unused memory, must be called before reading edges.
+    void Finish();
+
+    size_t Size() const;
+    size_t MemoryUsage() const;
+
+    NodeId Destination(size_t position) const;
+
+    // Append destinations of edges in [first, last) to the output.
+    void Destinations(size_t first, size_t last, std::vector<NodeId> &output) const;
+
+    // Return first position in [first, last) with destination not less than value or last if there is none.
+    size_t FindDestination(size_t first, size_t last, NodeId value) const;
+
+    float Weight(size_t position) const;
+
+    // Cumulative weight of edges in [run_first, position], where run_first is the start of a run.
+    float WeightSum(size_t run_first, size_t position) const;
+
+    // Append cumulative weights of edges in [run_first, last) to the output, run_first is the start of a run.
+    void WeightSums(size_t run_first, size_t last, std::vector<float> &output) const;
+
+    // Return first position in [run_first, last) with cumulative weight not less than value or last. Weight of the
+    // found edge is computed as a difference of cumulative weights.
+    size_t FindWeightSum(size_t run_first, size_t last, float value, float &weight) const;
+
+  private:
+    enum class WeightEncoding : uint8_t
+    {
+        constant,
+        half,
+        single
+    };
+
+    struct Block
+    {
+        // Offset of the second destination in m_destination_data, the first one is stored in m_first.
+        uint64_t m_destinations;
+        uint64_t m_weights;
+        NodeId m_first;
+
+        // Running weight sum of the edge preceding the block.
+        float m_weight_sum;
+        WeightEncoding m_encoding;
+    };
+
+    void FlushWeights();
+
+    template <typename F> void ForEachDestination(size_t first, size_t last, F func) const;
+    template <typename F> void ForEachWeight(size_t first, size_t last, F func) const;
+
+    std::vector<Block> m_blocks;
+    std::vector<uint8_t> m_destination_data;
+    std::vector<uint8_t> m_weight_data;
+    size_t m_size = 0;
+
+    // Encoder state.
+    NodeId m_last_destination = 0;
+    float m_weight_sum = 0;
+    std::vector<float> m_pending_weights;
+};
+
+} // namespace snark
+
+#endif // SNARK_COMPRESSED_ADJACENCY_H
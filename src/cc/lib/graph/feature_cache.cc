@@ -0,0 +1,278 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "feature_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+
+#include "hdfs_wrap.h"
+#include "locator.h"
+#include "storage.h"
+
+namespace snark
+{
+FeatureCache::FeatureCache(size_t capacity, size_t shard_count)
+    : m_shards(std::max<size_t>(shard_count, 1)), m_shard_capacity(capacity / m_shards.size())
+{
+}
+
+FeatureCache::Shard &FeatureCache::GetShard(const Key &key)
+{
+    return m_shards[absl::Hash<Key>{}(key) % m_shards.size()];
+}
+
+bool FeatureCache::Get(const void *storage, uint64_t offset, std::span<uint8_t> output)
+{
+    return Get(storage, offset, 0, output);
+}
+
+void FeatureCache::Put(const void *storage, uint64_t offset, std::span<const uint8_t> value)
+{
+    Put(storage, offset, 0, value);
+}
+
+bool FeatureCache::Get(const void *storage, uint64_t offset, uint64_t secondary, std::span<uint8_t> output)
+{
+    const Key key{.m_storage = storage, .m_offset = offset, .m_secondary = secondary};
+    auto &shard = GetShard(key);
+    std::lock_guard lock(shard.m_mutex);
+    auto it = shard.m_index.find(key);
+    if (it == std::end(shard.m_index) || shard.m_entries[it->second].m_value.size() < output.size())
+    {
+        ++shard.m_misses;
+        return false;
+    }
+
+    auto &entry = shard.m_entries[it->second];
+    std::copy_n(std::begin(entry.m_value), output.size(), std::begin(output));
+    entry.m_referenced = true;
+    ++shard.m_hits;
+    return true;
+}
+
+void FeatureCache::Put(const void *storage, uint64_t offset, uint64_t secondary, std::span<const uint8_t> value)
+{
+    const auto required = EntrySize(value.size());
+    if (required > m_shard_capacity)
+    {
+        return;
+    }
+
+    const Key key{.m_storage = storage, .m_offset = offset, .m_secondary = secondary};
+    auto &shard = GetShard(key);
+    std::lock_guard lock(shard.m_mutex);
+    auto it = shard.m_index.find(key);
+    if (it != std::end(shard.m_index))
+    {
+        // Keep the longest value, shorter requests for the same feature are served from it.
+        auto &entry = shard.m_entries[it->second];
+        if (entry.m_value.size() >= value.size())
+        {
+            return;
+        }
+
+        // Make room for the longer value first, the clock hand skips the entry once because it is referenced.
+        const auto delta = value.size() - entry.m_value.size();
+        entry.m_referenced = true;
+        Evict(shard, delta);
+        it = shard.m_index.find(key);
+        if (it != std::end(shard.m_index))
+        {
+            auto &grown = shard.m_entries[it->second];
+            shard.m_size += delta;
+            grown.m_value.assign(std::begin(value), std::end(value));
+            grown.m_referenced = true;
+            return;
+        }
+    }
+
+    Evict(shard, required);
+    shard.m_index.emplace(key, shard.m_entries.size());
+    shard.m_entries.emplace_back(Entry{
+        .m_key = key, .m_value = std::vector<uint8_t>(std::begin(value), std::end(value)), .m_referenced = false});
+    shard.m_size += required;
+}
+
+void FeatureCache::Evict(Shard &shard, size_t required)
+{
+    while (!shard.m_entries.empty() && shard.m_size + required > m_shard_capacity)
+    {
+        if (shard.m_hand >= shard.m_entries.size())
+        {
+            shard.m_hand = 0;
+        }
+
+        auto &entry = shard.m_entries[shard.m_hand];
+        if (entry.m_referenced)
+        {
+            entry.m_referenced = false;
+            ++shard.m_hand;
+            continue;
+        }
+
+        shard.m_size -= EntrySize(entry.m_value.size());
+        shard.m_index.erase(entry.m_key);
+
+        // Fill the gap with the last entry to keep entries contiguous.
+        if (shard.m_hand + 1 != shard.m_entries.size())
+        {
+            entry = std::move(shard.m_entries.back());
+            shard.m_index[entry.m_key] = shard.m_hand;
+        }
+        shard.m_entries.pop_back();
+    }
+}
+
+void FeatureCache::Clear()
+{
+    for (auto &shard : m_shards)
+    {
+        std::lock_guard lock(shard.m_mutex);
+        shard.m_entries.clear();
+        shard.m_index.clear();
+        shard.m_size = 0;
+        shard.m_hand = 0;
+    }
+}
+
+uint64_t FeatureCache::Hits() const
+{
+    uint64_t result = 0;
+    for (const auto &shard : m_shards)
+    {
+        std::lock_guard lock(shard.m_mutex);
+        result += shard.m_hits;
+    }
+
+    return result;
+}
+
+uint64_t FeatureCache::Misses() const
+{
+    uint64_t result = 0;
+    for (const auto &shard : m_shards)
+    {
+        std::lock_guard lock(shard.m_mutex);
+        result += shard.m_misses;
+    }
+
+    return result;
+}
+
+size_t FeatureCache::Size() const
+{
+    size_t result = 0;
+    for (const auto &shard : m_shards)
+    {
+        std::lock_guard lock(shard.m_mutex);
+        result += shard.m_size;
+    }
+
+    return result;
+}
+
+size_t FeatureCache::Capacity() const
+{
+    return m_shard_capacity * m_shards.size();
+}
+
+size_t FeatureCache::EntrySize(size_t value_size)
+{
+    // Account for bookkeeping, so the budget is close to the actual memory usage for small features.
+    return value_size + 64;
+}
+
+std::vector<NodeId> NodesByWeight(const Metadata &metadata, std::span<const uint32_t> partitions)
+{
+    absl::flat_hash_map<NodeId, float> weights;
+    for (auto partition : partitions)
+    {
+        if (partition >= metadata.m_partition_node_weights.size())
+        {
+            continue;
+        }
+
+        for (Type tp = 0; tp < Type(metadata.m_node_type_count); ++tp)
+        {
+            const float partition_weight = metadata.m_partition_node_weights[partition][tp];
+            if (partition_weight <= 0)
+            {
+                continue;
+            }
+
+            std::shared_ptr<BaseStorage<uint8_t>> node_weights;
+            if (!is_hdfs_path(metadata.m_path))
+            {
+                node_weights = std::make_shared<DiskStorage<uint8_t>>(metadata.m_path, partition, tp, open_node_alias);
+            }
+            else
+            {
+                auto full_path = std::filesystem::path(metadata.m_path) /
+                                 ("node_" + std::to_string(tp) + "_" + std::to_string(partition) + ".alias");
+                node_weights = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), metadata.m_config_path,
+                                                                            metadata.m_hdfs_read);
+            }
+
+            auto node_weights_ptr = node_weights->start();
+            size_t record_size = node_weights->size() / (2 * sizeof(NodeId) + sizeof(float));
+            if (record_size == 0)
+            {
+                continue;
+            }
+
+            // Every record in alias table is picked with equal probability
+            // and then splits it between left and right nodes.
+            const float record_weight = partition_weight / record_size;
+            for (size_t i = 0; i < record_size; ++i)
+            {
+                NodeId left, right;
+                float threshold;
+                if (1 != node_weights->read(&left, sizeof(NodeId), 1, node_weights_ptr))
+                {
+                    RAW_LOG_FATAL("Failed to read node from alias table");
+                }
+                if (1 != node_weights->read(&right, sizeof(NodeId), 1, node_weights_ptr))
+                {
+                    RAW_LOG_FATAL("Failed to read alias from alias table");
+                }
+                if (1 != node_weights->read(&threshold, sizeof(float), 1, node_weights_ptr))
+                {
+                    RAW_LOG_FATAL("Failed to read probability from alias table");
+                }
+
+                weights[left] += threshold * record_weight;
+                if (threshold < 1.0f)
+                {
+                    weights[right] += (1.0f - threshold) * record_weight;
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<float, NodeId>> ordered;
+    ordered.reserve(weights.size());
+    for (const auto &[node, weight] : weights)
+    {
+        ordered.emplace_back(weight, node);
+    }
+    std::sort(std::begin(ordered), std::end(ordered), [](const auto &left, const auto &right) {
+        return left.first > right.first || (left.first == right.first && left.second < right.second);
+    });
+
+    std::vector<NodeId> result;
+    result.reserve(ordered.size());
+    for (const auto &item : ordered)
+    {
+        result.emplace_back(item.second);
+    }
+
+    return result;
+}
+
+} // namespace snark
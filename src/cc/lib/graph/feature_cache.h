@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_FEATURE_CACHE_H
+#define SNARK_FEATURE_CACHE_H
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+
+#include "metadata.h"
+#include "types.h"
+
+namespace snark
+{
+
+struct FeatureCacheConfig
+{
+    // Memory budget for cached features in bytes, 0 disables caching.
+    size_t m_capacity = 0;
+    size_t m_shard_count = 64;
+
+    // Fill cache on startup with features of nodes that have the highest sampling weights.
+    bool m_warm = false;
+};
+
+// Thread safe cache for feature values read from slow storage. Entries are split between shards
+// with independent locks and evicted with CLOCK algorithm once a shard exceeds its part of the budget.
+class FeatureCache
+{
+  public:
+    FeatureCache(size_t capacity, size_t shard_count);
+
+    // Copy cached value into the output if it's at least as large as the output.
+    bool Get(const void *storage, uint64_t offset, std::span<uint8_t> output);
+    void Put(const void *storage, uint64_t offset, std::span<const uint8_t> value);
+
+    // Same as above for values identified by two numbers, e.g. edges by their source and destination.
+    bool Get(const void *storage, uint64_t offset, uint64_t secondary, std::span<uint8_t> output);
+    void Put(const void *storage, uint64_t offset, uint64_t secondary, std::span<const uint8_t> value);
+
+    // Drop all entries, hit and miss counts are kept.
+    void Clear();
+
+    uint64_t Hits() const;
+    uint64_t Misses() const;
+
+    // Memory used by entries in bytes.
+    size_t Size() const;
+    size_t Capacity() const;
+
+    // Memory used by an entry with a value of value_size bytes.
+    static size_t EntrySize(size_t value_size);
+
+  private:
+    struct Key
+    {
+        const void *m_storage;
+        uint64_t m_offset;
+        uint64_t m_secondary;
+
+        bool operator==(const Key &other) const = default;
+
+        template <typename H> friend H AbslHashValue(H h, const Key &key)
+        {
+            return H::combine(std::move(h), key.m_storage, key.m_offset, key.m_secondary);
+        }
+    };
+
+    struct Entry
+    {
+        Key m_key;
+        std::vector<uint8_t> m_value;
+        bool m_referenced;
+    };
+
+    struct Shard
+    {
+        mutable std::mutex m_mutex;
+        absl::flat_hash_map<Key, size_t> m_index;
+        std::vector<Entry> m_entries;
+        size_t m_hand = 0;
+        size_t m_size = 0;
+        uint64_t m_hits = 0;
+        uint64_t m_misses = 0;
+    };
+
+    Shard &GetShard(const Key &key);
+    void Evict(Shard &shard, size_t required);
+
+    std::vector<Shard> m_shards;
+    size_t m_shard_capacity;
+};
+
+// Return nodes stored in partitions ordered by descending sampling weight from node alias tables.
+std::vector<NodeId> NodesByWeight(const Metadata &metadata, std::span<const uint32_t> partitions);
+
+} // namespace snark
+
+#endif // SNARK_FEATURE_CACHE_H
@@ -14,7 +14,13 @@
 #include <glog/raw_logging.h>
 
 #include "locator.h"
+#include "negative_sampling.h"
+#include "parallel.h"
+#include "random_walk.h"
 #include "types.h"
+#include "xoroshiro.h"
+
+#include "boost/random/uniform_int_distribution.hpp"
 
 namespace snark
 {
@@ -36,12 +42,45 @@ bool check_sorted_unique_types(const Type *in_edge_types, size_t count)
     return true;
 }
 
+// Describe everything arrays built at load time depend on, so a shared index is replaced if any of it changes.
+std::string shared_index_key(const std::string &path, std::span<const std::string> suffixes, size_t alias_threshold,
+                             std::span<const FeatureId> columnar_features)
+{
+    std::string key = "path: " + path + "\nalias_threshold: " + std::to_string(alias_threshold) + "\ncolumns:";
+    for (const auto feature : columnar_features)
+    {
+        key += " " + std::to_string(feature);
+    }
+    key += "\n";
+    // Columnar features are built from feature files, so every file of a partition is a part of its version.
+    for (const auto &suffix : suffixes)
+    {
+        key += "partition: " + suffix + partition_version(path, suffix) + "\n";
+    }
+
+    return key;
+}
+
 } // namespace
 
 Graph::Graph(std::string path, std::vector<uint32_t> partitions, PartitionStorageType storage_type,
-             std::string config_path)
-    : m_metadata(path, config_path)
+             std::string config_path, FeatureCacheConfig feature_cache, bool compact_node_index,
+             bool compressed_edges, ThreadPoolConfig thread_pool, size_t alias_threshold,
+             std::vector<FeatureId> columnar_features, std::string shared_index, size_t edge_index_threshold,
+             HDFSReadOptions hdfs_read)
+    : m_metadata(path, config_path), m_min_chunk_size(std::max<size_t>(1, thread_pool.m_min_chunk_size))
 {
+    m_metadata.m_hdfs_read = hdfs_read;
+    if (thread_pool.m_thread_count > 1)
+    {
+        m_thread_pool = std::make_shared<ThreadPool>(thread_pool.m_thread_count);
+    }
+
+    if (feature_cache.m_capacity > 0 && storage_type == PartitionStorageType::disk)
+    {
+        m_feature_cache = std::make_shared<FeatureCache>(feature_cache.m_capacity, feature_cache.m_shard_count);
+    }
+
     std::vector<std::string> suffixes;
     absl::flat_hash_set<uint32_t> partition_set(std::begin(partitions), std::end(partitions));
     // Go through the path folder with graph binary files.
@@ -78,32 +117,118 @@ Graph::Graph(std::string path, std::vector<uint32_t> partitions, PartitionStorag
 
     // Fix loading order to obtain deterministic results for sampling.
     std::sort(std::begin(suffixes), std::end(suffixes));
-    m_partitions.reserve(suffixes.size());
-    for (size_t i = 0; i < suffixes.size(); ++i)
+
+    std::unique_ptr<SharedIndex> shared;
+    if (!shared_index.empty() && compressed_edges)
+    {
+        RAW_LOG_ERROR("Compressed edges can't be shared between processes, graph is loaded without shared index");
+    }
+    else if (!shared_index.empty() && is_hdfs_path(path))
+    {
+        RAW_LOG_ERROR("Versions of HDFS files can't be checked, graph is loaded without shared index");
+    }
+    else if (!shared_index.empty())
+    {
+        shared = std::make_unique<SharedIndex>(
+            shared_index, shared_index_key(path, suffixes, alias_threshold, columnar_features));
+        compact_node_index = true;
+    }
+    const bool attached = shared != nullptr && shared->Attached();
+
+    // Partitions are independent, so they are loaded concurrently. Node index keeps records
+    // in the order of suffixes to get deterministic node lookups and sampling results.
+    m_partitions.resize(suffixes.size());
+    std::vector<std::vector<NodeId>> node_ids(suffixes.size());
+    parallel_for(suffixes.size(), [&](size_t i) {
+        m_partitions[i] =
+            std::make_shared<const Partition>(path, suffixes[i], storage_type, m_feature_cache, compressed_edges,
+                                              alias_threshold, columnar_features, shared.get(), edge_index_threshold,
+                                              hdfs_read);
+        if (!attached)
+        {
+            node_ids[i] = ReadNodeIds(path, suffixes[i]);
+        }
+    });
+    if (attached)
+    {
+        m_node_map = NodeIndex(*shared);
+        m_partitions_indices = shared->Map<uint32_t>("partitions_indices", m_index_buffers);
+        m_internal_indices = shared->Map<uint64_t>("internal_indices", m_index_buffers);
+        m_counts = shared->Map<uint32_t>("counts", m_index_buffers);
+    }
+    else
+    {
+        std::vector<uint32_t> partitions_indices;
+        std::vector<uint64_t> internal_indices;
+        std::vector<uint32_t> counts;
+        m_node_map = NodeIndex(std::move(node_ids), partitions_indices, internal_indices, counts, compact_node_index);
+        m_partitions_indices = keep_buffer(std::move(partitions_indices), m_index_buffers);
+        m_internal_indices = keep_buffer(std::move(internal_indices), m_index_buffers);
+        m_counts = keep_buffer(std::move(counts), m_index_buffers);
+    }
+    if (shared != nullptr && !attached)
+    {
+        m_node_map.Publish(*shared);
+        shared->Publish("partitions_indices", m_partitions_indices);
+        shared->Publish("internal_indices", m_internal_indices);
+        shared->Publish("counts", m_counts);
+        shared->Commit();
+    }
+
+    if (m_feature_cache != nullptr && feature_cache.m_warm)
     {
-        m_partitions.emplace_back(path, suffixes[i], storage_type);
-        ReadNodeMap(path, suffixes[i], i);
+        WarmFeatureCache(partitions);
+    }
+}
+
+void Graph::WarmFeatureCache(std::span<const uint32_t> partitions)
+{
+    // Leave space for uneven distribution of features between cache shards.
+    uint64_t budget = m_feature_cache->Capacity() / 10 * 9;
+    for (auto node : NodesByWeight(m_metadata, partitions))
+    {
+        auto index = m_node_map.Find(node);
+        if (index == NodeIndex::npos)
+        {
+            continue;
+        }
+
+        const size_t partition_count = m_counts[index];
+        for (size_t partition = 0; partition < partition_count; ++partition, ++index)
+        {
+            const auto &p = *m_partitions[m_partitions_indices[index]];
+            if (p.HasNodeFeatures(m_internal_indices[index]))
+            {
+                if (!p.WarmNodeFeatureCache(m_internal_indices[index], budget))
+                {
+                    return;
+                }
+                break;
+            }
+        }
     }
 }
 
 void Graph::GetNodeType(std::span<const NodeId> node_ids, std::span<Type> output, Type default_type) const
 {
     assert(output.size() == node_ids.size());
+    std::vector<uint64_t> indices(node_ids.size());
+    m_node_map.Find(node_ids, indices);
     auto curr_type = std::begin(output);
-    for (auto node : node_ids)
+    for (size_t node_index = 0; node_index < node_ids.size(); ++node_index)
     {
-        auto internal_id = m_node_map.find(node);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_index + prefetch_distance);
+        auto index = indices[node_index];
+        if (index == NodeIndex::npos)
         {
             *curr_type = default_type;
         }
         else
         {
-            auto index = internal_id->second;
             size_t partition_count = m_counts[index];
             for (size_t partition = 0; partition < partition_count; ++partition, ++index)
             {
-                *curr_type = m_partitions[m_partitions_indices[index]].GetNodeType(m_internal_indices[index]);
+                *curr_type = m_partitions[m_partitions_indices[index]]->GetNodeType(m_internal_indices[index]);
                 if (*curr_type != snark::PLACEHOLDER_NODE_TYPE)
                     break;
             }
@@ -119,87 +244,144 @@ void Graph::GetNodeFeature(std::span<const NodeId> node_ids, std::span<snark::Fe
                            [](size_t val, const auto &f) { return val + f.second; }) *
                node_ids.size() ==
            output.size());
+    if (node_ids.empty())
+    {
+        return;
+    }
 
     const size_t feature_size = output.size() / node_ids.size();
-    size_t feature_offset = 0;
-    for (auto node : node_ids)
-    {
-        auto internal_id = m_node_map.find(node);
-        if (internal_id == std::end(m_node_map))
+    ForEachChunk(node_ids.size(), ChunkSize(node_ids.size()), [&](size_t begin, size_t end) {
+        auto chunk_output = output.subspan(begin * feature_size, (end - begin) * feature_size);
+
+        // Group nodes by partitions to fetch features from each partition in a single batch.
+        std::vector<std::vector<uint64_t>> internal_ids(m_partitions.size());
+        std::vector<std::vector<size_t>> output_offsets(m_partitions.size());
+        std::vector<uint64_t> indices(end - begin);
+        m_node_map.Find(node_ids.subspan(begin, end - begin), indices);
+        size_t feature_offset = 0;
+        for (size_t node_index = 0; node_index < indices.size(); ++node_index)
         {
-            std::fill_n(std::begin(output) + feature_offset, feature_size, 0);
+            PrefetchRecord(indices, node_index + prefetch_distance);
+            auto index = indices[node_index];
+            if (index == NodeIndex::npos)
+            {
+                std::fill_n(std::begin(chunk_output) + feature_offset, feature_size, 0);
+            }
+            else
+            {
+                size_t partition_count = m_counts[index];
+                for (size_t partition = 0; partition < partition_count; ++partition, ++index)
+                {
+                    const auto partition_index = m_partitions_indices[index];
+                    if (m_partitions[partition_index]->HasNodeFeatures(m_internal_indices[index]))
+                    {
+                        internal_ids[partition_index].emplace_back(m_internal_indices[index]);
+                        output_offsets[partition_index].emplace_back(feature_offset);
+                        break;
+                    }
+                }
+            }
+            feature_offset += feature_size;
         }
-        else
-        {
-            auto output_span = output.subspan(feature_offset, feature_size);
 
-            auto index = internal_id->second;
-            size_t partition_count = m_counts[index];
-            bool found = false;
-            for (size_t partition = 0; partition < partition_count && !found; ++partition, ++index)
+        for (size_t partition = 0; partition < m_partitions.size(); ++partition)
+        {
+            if (!internal_ids[partition].empty())
             {
-                found = m_partitions[m_partitions_indices[index]].GetNodeFeature(m_internal_indices[index], features,
-                                                                                 output_span);
+                m_partitions[partition]->GetNodeFeature(internal_ids[partition], output_offsets[partition], features,
+                                                        chunk_output);
             }
         }
-        feature_offset += feature_size;
-    }
+    });
 }
 
 void Graph::GetNodeSparseFeature(std::span<const NodeId> node_ids, std::span<const snark::FeatureId> features,
-                                 std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
-                                 std::vector<std::vector<uint8_t>> &out_data) const
+                                 SparseFeatureBatch &output) const
 {
-    assert(features.size() == out_dimensions.size());
-    assert(features.size() == out_indices.size());
-    assert(features.size() == out_data.size());
+    output.Reset(features.size());
 
-    // Fill out_dimensions in case nodes don't have some features.
-    std::fill(std::begin(out_dimensions), std::end(out_dimensions), 0);
+    // Features are filled one by one to keep values of every feature contiguous, so nodes are located once.
+    struct Location
+    {
+        int64_t m_node_index;
+        uint32_t m_partition;
+        uint64_t m_internal_id;
+    };
+    std::vector<Location> locations;
+    locations.reserve(node_ids.size());
+    std::vector<uint64_t> indices(node_ids.size());
+    m_node_map.Find(node_ids, indices);
     const int64_t len = node_ids.size();
     for (int64_t node_index = 0; node_index < len; ++node_index)
     {
-        auto internal_id = m_node_map.find(node_ids[node_index]);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_index + prefetch_distance);
+        auto index = indices[node_index];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
 
-        auto index = internal_id->second;
         size_t partition_count = m_counts[index];
-        bool found = false;
-        for (size_t partition = 0; partition < partition_count && !found; ++partition, ++index)
+        for (size_t partition = 0; partition < partition_count; ++partition, ++index)
+        {
+            if (m_partitions[m_partitions_indices[index]]->HasNodeFeatures(m_internal_indices[index]))
+            {
+                locations.emplace_back(Location{node_index, m_partitions_indices[index], m_internal_indices[index]});
+                break;
+            }
+        }
+    }
+
+    for (const auto feature : features)
+    {
+        for (const auto &location : locations)
         {
-            found = m_partitions[m_partitions_indices[index]].GetNodeSparseFeature(
-                m_internal_indices[index], features, node_index, out_dimensions, out_indices, out_data);
+            m_partitions[location.m_partition]->GetNodeSparseFeature(location.m_internal_id, feature,
+                                                                     location.m_node_index, output);
         }
+        output.EndFeature();
     }
 }
 
+void Graph::GetNodeSparseFeature(std::span<const NodeId> node_ids, std::span<const snark::FeatureId> features,
+                                 std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
+                                 std::vector<std::vector<uint8_t>> &out_data) const
+{
+    assert(features.size() == out_dimensions.size());
+    assert(features.size() == out_indices.size());
+    assert(features.size() == out_data.size());
+
+    auto &batch = SparseFeatureBatch::ThreadLocal();
+    GetNodeSparseFeature(node_ids, features, batch);
+    batch.CopyTo(out_dimensions, out_indices, out_data);
+}
+
 void Graph::GetNodeStringFeature(std::span<const NodeId> node_ids, std::span<const snark::FeatureId> features,
                                  std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_data) const
 {
     const auto features_size = features.size();
     assert(out_dimensions.size() == features_size * node_ids.size());
 
+    std::vector<uint64_t> indices(node_ids.size());
+    m_node_map.Find(node_ids, indices);
     const int64_t len = node_ids.size();
     for (int64_t node_index = 0; node_index < len; ++node_index)
     {
-        auto internal_id = m_node_map.find(node_ids[node_index]);
-        if (internal_id == std::end(m_node_map))
+        PrefetchRecord(indices, node_index + prefetch_distance);
+        auto index = indices[node_index];
+        if (index == NodeIndex::npos)
         {
             continue;
         }
 
         auto dims_span = out_dimensions.subspan(features_size * node_index, features_size);
 
-        auto index = internal_id->second;
         size_t partition_count = m_counts[index];
         bool found = false;
         for (size_t partition = 0; partition < partition_count && !found; ++partition, ++index)
         {
-            found = m_partitions[m_partitions_indices[index]].GetNodeStringFeature(m_internal_indices[index], features,
-                                                                                   dims_span, out_data);
+            found = m_partitions[m_partitions_indices[index]]->GetNodeStringFeature(m_internal_indices[index], features,
+                                                                                    dims_span, out_data);
         }
     }
 }
@@ -214,69 +396,60 @@ void Graph::GetEdgeFeature(std::span<const NodeId> input_edge_src, std::span<con
            output.size());
 
     const size_t feature_size = output.size() / input_edge_src.size();
+    const auto locations = LocateEdges(input_edge_src, input_edge_dst, input_edge_type);
     size_t feature_offset = 0;
-    size_t edge_offset = 0;
-    for (auto src_node : input_edge_src)
+    for (const auto &location : locations)
     {
-        auto internal_id = m_node_map.find(src_node);
-        if (internal_id == std::end(m_node_map))
+        if (location.m_edge == Partition::npos)
         {
             std::fill_n(std::begin(output) + feature_offset, feature_size, 0);
         }
         else
         {
-            auto index = internal_id->second;
-            size_t partition_count = m_counts[index];
-            for (size_t partition = 0; partition < partition_count; ++partition, ++index)
-            {
-                auto found = m_partitions[m_partitions_indices[index]].GetEdgeFeature(
-                    m_internal_indices[index], input_edge_dst[edge_offset], input_edge_type[edge_offset], features,
-                    output.subspan(feature_offset, feature_size));
-                if (found)
-                {
-                    break;
-                }
-            }
+            m_partitions[location.m_partition]->GetEdgeFeature(location.m_edge, features,
+                                                               output.subspan(feature_offset, feature_size));
         }
 
         feature_offset += feature_size;
-        ++edge_offset;
     }
 }
 
 void Graph::GetEdgeSparseFeature(std::span<const NodeId> input_edge_src, std::span<const NodeId> input_edge_dst,
                                  std::span<const Type> input_edge_type, std::span<const snark::FeatureId> features,
-                                 std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
-                                 std::vector<std::vector<uint8_t>> &out_values) const
+                                 SparseFeatureBatch &output) const
 {
-    assert(features.size() == out_dimensions.size());
-    assert(features.size() == out_indices.size());
-    assert(features.size() == out_values.size());
+    output.Reset(features.size());
 
-    int64_t edge_offset = 0;
-    for (auto src_node : input_edge_src)
+    const auto locations = LocateEdges(input_edge_src, input_edge_dst, input_edge_type);
+    for (const auto feature : features)
     {
-        auto internal_id = m_node_map.find(src_node);
-        if (internal_id != std::end(m_node_map))
+        for (int64_t edge_index = 0; edge_index < int64_t(locations.size()); ++edge_index)
         {
-            auto index = internal_id->second;
-            size_t partition_count = m_counts[index];
-            for (size_t partition = 0; partition < partition_count; ++partition, ++index)
+            const auto &location = locations[edge_index];
+            if (location.m_edge != Partition::npos)
             {
-                auto found = m_partitions[m_partitions_indices[index]].GetEdgeSparseFeature(
-                    m_internal_indices[index], input_edge_dst[edge_offset], input_edge_type[edge_offset], features,
-                    edge_offset, out_dimensions, out_indices, out_values);
-                if (found)
-                {
-                    break;
-                }
+                m_partitions[location.m_partition]->GetEdgeSparseFeature(location.m_edge, feature, edge_index,
+                                                                         output);
             }
         }
-
-        ++edge_offset;
+        output.EndFeature();
     }
 }
 
+void Graph::GetEdgeSparseFeature(std::span<const NodeId> input_edge_src, std::span<const NodeId> input_edge_dst,
+                                 std::span<const Type> input_edge_type, std::span<const snark::FeatureId> features,
+                                 std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
+                                 std::vector<std::vector<uint8_t>> &out_values) const
+{
+    assert(features.size() == out_dimensions.size());
+    assert(features.size() == out_indices.size());
+    assert(features.size() == out_values.size());
+
+    auto &batch = SparseFeatureBatch::ThreadLocal();
+    GetEdgeSparseFeature(input_edge_src, input_edge_dst, input_edge_type, features, batch);
+    batch.CopyTo(out_dimensions, out_indices, out_values);
+}
+
 void Graph::GetEdgeStringFeature(std::span<const NodeId> input_edge_src, std::span<const NodeId> input_edge_dst,
                                  std::span<const Type> input_edge_type, std::span<const snark::FeatureId> features,
                                  std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_values) const
@@ -284,30 +457,31 @@ void Graph::GetEdgeStringFeature(std::span<const NodeId> input_edge_src, std::sp
     const auto features_size = features.size();
     assert(features_size * input_edge_src.size() == out_dimensions.size());
 
-    int64_t edge_offset = 0;
-    for (auto src_node : input_edge_src)
+    const auto locations = LocateEdges(input_edge_src, input_edge_dst, input_edge_type);
+    for (size_t edge_offset = 0; edge_offset < locations.size(); ++edge_offset)
     {
-        auto internal_id = m_node_map.find(src_node);
-        if (internal_id != std::end(m_node_map))
+        const auto &location = locations[edge_offset];
+        if (location.m_edge != Partition::npos)
         {
-            auto index = internal_id->second;
-            size_t partition_count = m_counts[index];
-            for (size_t partition = 0; partition < partition_count; ++partition, ++index)
-            {
-                auto found = m_partitions[m_partitions_indices[index]].GetEdgeStringFeature(
-                    m_internal_indices[index], input_edge_dst[edge_offset], input_edge_type[edge_offset], features,
-                    out_dimensions.subspan(edge_offset * features_size, features_size), out_values);
-                if (found)
-                {
-                    break;
-                }
-            }
+            m_partitions[location.m_partition]->GetEdgeStringFeature(
+                location.m_edge, features, out_dimensions.subspan(edge_offset * features_size, features_size),
+                out_values);
         }
-
-        ++edge_offset;
     }
 }
 
+std::vector<EdgeLocation> Graph::LocateEdges(std::span<const NodeId> input_edge_src,
+                                             std::span<const NodeId> input_edge_dst,
+                                             std::span<const Type> input_edge_type) const
+{
+    std::vector<uint64_t> indices(input_edge_src.size());
+    m_node_map.Find(input_edge_src, indices);
+    std::vector<EdgeLocation> locations(input_edge_src.size());
+    snark::LocateEdges(m_partitions, m_partitions_indices, m_internal_indices, m_counts, indices, input_edge_dst,
+                       input_edge_type, locations);
+    return locations;
+}
+
 void Graph::NeighborCount(std::span<const NodeId> input_node_ids, std::span<const Type> input_edge_types,
                           std::span<uint64_t> output_neighbors_counts) const
 
@@ -315,26 +489,26 @@ void Graph::NeighborCount(std::span<const NodeId> input_node_ids, std::span<cons
     size_t num_nodes = input_node_ids.size();
     std::fill_n(std::begin(output_neighbors_counts), num_nodes, 0);
 
-    for (size_t idx = 0; idx < num_nodes; ++idx)
-    {
-        auto internal_id = m_node_map.find(input_node_ids[idx]);
-
-        if (internal_id == std::end(m_node_map))
-        {
-            continue;
-        }
-        else
+    ForEachChunk(num_nodes, ChunkSize(num_nodes), [&](size_t begin, size_t end) {
+        std::vector<uint64_t> indices(end - begin);
+        m_node_map.Find(input_node_ids.subspan(begin, end - begin), indices);
+        for (size_t idx = begin; idx < end; ++idx)
         {
-            auto index = internal_id->second;
-            size_t partition_count = m_counts[index];
+            PrefetchRecord(indices, idx - begin + prefetch_distance);
+            auto index = indices[idx - begin];
+            if (index == NodeIndex::npos)
+            {
+                continue;
+            }
 
+            size_t partition_count = m_counts[index];
             for (size_t partition = 0; partition < partition_count; ++partition, ++index)
             {
-                output_neighbors_counts[idx] += m_partitions[m_partitions_indices[index]].NeighborCount(
+                output_neighbors_counts[idx] += m_partitions[m_partitions_indices[index]]->NeighborCount(
                     m_internal_indices[index], input_edge_types);
             }
         }
-    }
+    });
 }
 
 void Graph::FullNeighbor(std::span<const NodeId> input_node_ids, std::span<const Type> input_edge_types,
@@ -342,25 +516,65 @@ void Graph::FullNeighbor(std::span<const NodeId> input_node_ids, std::span<const
                          std::vector<float> &output_neighbors_weights,
                          std::span<uint64_t> output_neighbors_counts) const
 {
-    for (size_t node_index = 0; node_index < input_node_ids.size(); ++node_index)
-    {
-        auto internal_id = m_node_map.find(input_node_ids[node_index]);
-        if (internal_id == std::end(m_node_map))
-        {
-            continue;
-        }
-        else
+    auto full_neighbor = [&](size_t begin, size_t end, std::vector<NodeId> &neighbor_ids,
+                             std::vector<Type> &neighbor_types, std::vector<float> &neighbor_weights) {
+        std::vector<uint64_t> indices(end - begin);
+        m_node_map.Find(input_node_ids.subspan(begin, end - begin), indices);
+        for (size_t node_index = begin; node_index < end; ++node_index)
         {
-            auto index = internal_id->second;
+            PrefetchRecord(indices, node_index - begin + prefetch_distance);
+            auto index = indices[node_index - begin];
+            if (index == NodeIndex::npos)
+            {
+                continue;
+            }
+
             size_t partition_count = m_counts[index];
             for (size_t partition = 0; partition < partition_count; ++partition, ++index)
             {
-                output_neighbors_counts[node_index] += m_partitions[m_partitions_indices[index]].FullNeighbor(
-                    m_internal_indices[index], input_edge_types, output_neighbor_ids, output_neighbor_types,
-                    output_neighbors_weights);
+                output_neighbors_counts[node_index] += m_partitions[m_partitions_indices[index]]->FullNeighbor(
+                    m_internal_indices[index], input_edge_types, neighbor_ids, neighbor_types, neighbor_weights);
             }
         }
+    };
+
+    const size_t chunk_size = ChunkSize(input_node_ids.size());
+    if (!m_thread_pool || input_node_ids.size() <= chunk_size)
+    {
+        full_neighbor(0, input_node_ids.size(), output_neighbor_ids, output_neighbor_types, output_neighbors_weights);
+        return;
     }
+
+    // Collect neighbors of every chunk separately, then copy them to the outputs at offsets from a prefix sum
+    // of chunk sizes to keep neighbors in the order of input nodes.
+    const size_t chunk_count = (input_node_ids.size() + chunk_size - 1) / chunk_size;
+    std::vector<std::vector<NodeId>> chunk_ids(chunk_count);
+    std::vector<std::vector<Type>> chunk_types(chunk_count);
+    std::vector<std::vector<float>> chunk_weights(chunk_count);
+    ForEachChunk(input_node_ids.size(), chunk_size, [&](size_t begin, size_t end) {
+        const size_t chunk = begin / chunk_size;
+        full_neighbor(begin, end, chunk_ids[chunk], chunk_types[chunk], chunk_weights[chunk]);
+    });
+
+    std::vector<size_t> offsets(chunk_count + 1, output_neighbor_ids.size());
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk)
+    {
+        offsets[chunk + 1] = offsets[chunk] + chunk_ids[chunk].size();
+    }
+    output_neighbor_ids.resize(offsets.back());
+    output_neighbor_types.resize(offsets.back());
+    output_neighbors_weights.resize(offsets.back());
+    ForEachChunk(chunk_count, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+        {
+            std::copy(std::begin(chunk_ids[chunk]), std::end(chunk_ids[chunk]),
+                      std::begin(output_neighbor_ids) + offsets[chunk]);
+            std::copy(std::begin(chunk_types[chunk]), std::end(chunk_types[chunk]),
+                      std::begin(output_neighbor_types) + offsets[chunk]);
+            std::copy(std::begin(chunk_weights[chunk]), std::end(chunk_weights[chunk]),
+                      std::begin(output_neighbors_weights) + offsets[chunk]);
+        }
+    });
 }
 
 void Graph::SampleNeighbor(int64_t seed, std::span<const NodeId> input_node_ids, std::span<Type> input_edge_types,
@@ -375,30 +589,36 @@ void Graph::SampleNeighbor(int64_t seed, std::span<const NodeId> input_node_ids,
         input_edge_types = input_edge_types.subspan(0, last - std::begin(input_edge_types));
     }
 
-    for (size_t node_index = 0; node_index < input_node_ids.size(); ++node_index)
-    {
-        auto internal_id = m_node_map.find(input_node_ids[node_index]);
-        if (internal_id == std::end(m_node_map))
+    // Every partition record gets the next seed, chunks start from seeds after records of the previous chunks.
+    std::vector<uint64_t> indices;
+    const size_t chunk_size = ChunkSize(input_node_ids.size());
+    const auto chunk_seeds = FindNodes(input_node_ids, chunk_size, indices);
+    ForEachChunk(input_node_ids.size(), chunk_size, [&](size_t begin, size_t end) {
+        int64_t chunk_seed = seed + int64_t(chunk_seeds[begin / chunk_size]);
+        for (size_t node_index = begin; node_index < end; ++node_index)
         {
-            std::fill_n(std::begin(output_neighbor_ids) + count * node_index, count, default_node_id);
-            std::fill_n(std::begin(output_neighbor_types) + count * node_index, count, default_edge_type);
-            std::fill_n(std::begin(neighbors_weights) + count * node_index, count, default_weight);
-        }
-        else
-        {
-            const auto index = internal_id->second;
+            PrefetchRecord(indices, node_index + prefetch_distance);
+            const auto index = indices[node_index];
+            if (index == NodeIndex::npos)
+            {
+                std::fill_n(std::begin(output_neighbor_ids) + count * node_index, count, default_node_id);
+                std::fill_n(std::begin(output_neighbor_types) + count * node_index, count, default_edge_type);
+                std::fill_n(std::begin(neighbors_weights) + count * node_index, count, default_weight);
+                continue;
+            }
+
             size_t partition_count = m_counts[index];
             for (size_t partition = 0; partition < partition_count; ++partition)
             {
-                m_partitions[m_partitions_indices[index + partition]].SampleNeighbor(
-                    seed++, m_internal_indices[index + partition], input_edge_types, count,
+                m_partitions[m_partitions_indices[index + partition]]->SampleNeighbor(
+                    chunk_seed++, m_internal_indices[index + partition], input_edge_types, count,
                     output_neighbor_ids.subspan(count * node_index, count),
                     output_neighbor_types.subspan(count * node_index, count),
                     neighbors_weights.subspan(count * node_index, count), neighbors_total_weights[node_index],
                     default_node_id, default_weight, default_edge_type);
             }
         }
-    }
+    });
 }
 
 void Graph::UniformSampleNeighbor(bool without_replacement, int64_t seed, std::span<const NodeId> input_node_ids,
@@ -413,27 +633,240 @@ void Graph::UniformSampleNeighbor(bool without_replacement, int64_t seed, std::s
         input_edge_types = input_edge_types.subspan(0, last - std::begin(input_edge_types));
     }
 
-    for (size_t node_index = 0; node_index < input_node_ids.size(); ++node_index)
-    {
-        auto internal_id = m_node_map.find(input_node_ids[node_index]);
-        if (internal_id == std::end(m_node_map))
-        {
-            std::fill_n(std::begin(output_neighbor_ids) + count * node_index, count, default_node_id);
-            std::fill_n(std::begin(output_neighbor_types) + count * node_index, count, default_edge_type);
-        }
-        else
+    std::vector<uint64_t> indices;
+    const size_t chunk_size = ChunkSize(input_node_ids.size());
+    const auto chunk_seeds = FindNodes(input_node_ids, chunk_size, indices);
+    ForEachChunk(input_node_ids.size(), chunk_size, [&](size_t begin, size_t end) {
+        int64_t chunk_seed = seed + int64_t(chunk_seeds[begin / chunk_size]);
+        for (size_t node_index = begin; node_index < end; ++node_index)
         {
-            const auto index = internal_id->second;
+            PrefetchRecord(indices, node_index + prefetch_distance);
+            const auto index = indices[node_index];
+            if (index == NodeIndex::npos)
+            {
+                std::fill_n(std::begin(output_neighbor_ids) + count * node_index, count, default_node_id);
+                std::fill_n(std::begin(output_neighbor_types) + count * node_index, count, default_edge_type);
+                continue;
+            }
+
             for (size_t partition = 0; partition < m_counts[index]; ++partition)
             {
-                m_partitions[m_partitions_indices[index + partition]].UniformSampleNeighbor(
-                    without_replacement, seed++, m_internal_indices[index + partition], input_edge_types, count,
+                m_partitions[m_partitions_indices[index + partition]]->UniformSampleNeighbor(
+                    without_replacement, chunk_seed++, m_internal_indices[index + partition], input_edge_types, count,
                     output_neighbor_ids.subspan(count * node_index, count),
                     output_neighbor_types.subspan(count * node_index, count), neighbors_total_count[node_index],
                     default_node_id, default_edge_type);
             }
         }
+    });
+}
+
+void Graph::SampleSubgraph(bool without_replacement, int64_t seed, std::span<const NodeId> seeds,
+                           std::span<const uint32_t> fanouts, std::span<Type> edge_types,
+                           std::span<snark::FeatureMeta> features, Subgraph &output) const
+{
+    output = {};
+    absl::flat_hash_map<NodeId, uint64_t> positions;
+    auto add_node = [&output, &positions](NodeId node, uint32_t hop) {
+        auto [it, inserted] = positions.emplace(node, output.m_nodes.size());
+        if (inserted)
+        {
+            output.m_nodes.emplace_back(node);
+            output.m_hops.emplace_back(hop);
+        }
+        return it->second;
+    };
+    for (auto node : seeds)
+    {
+        add_node(node, 0);
+    }
+
+    Xoroshiro128PlusGenerator engine(seed);
+    std::vector<NodeId> frontier;
+    std::vector<NodeId> neighbors;
+    std::vector<Type> types;
+    std::vector<uint64_t> total_counts;
+    size_t hop_start = 0;
+    for (uint32_t hop = 0; hop < fanouts.size(); ++hop)
+    {
+        // Nodes reached at this hop are the ones added during the previous one.
+        frontier.assign(std::begin(output.m_nodes) + hop_start, std::end(output.m_nodes));
+        const size_t count = fanouts[hop];
+        neighbors.assign(frontier.size() * count, 0);
+        types.assign(frontier.size() * count, PLACEHOLDER_EDGE_TYPE);
+        total_counts.assign(frontier.size(), 0);
+        UniformSampleNeighbor(without_replacement, int64_t(engine()), frontier, edge_types, count, neighbors, types,
+                              total_counts, 0, PLACEHOLDER_EDGE_TYPE);
+        for (size_t index = 0; index < neighbors.size(); ++index)
+        {
+            if (types[index] == PLACEHOLDER_EDGE_TYPE)
+            {
+                continue;
+            }
+
+            output.m_edge_src.emplace_back(hop_start + index / count);
+            output.m_edge_dst.emplace_back(add_node(neighbors[index], hop + 1));
+            output.m_edge_types.emplace_back(types[index]);
+        }
+
+        hop_start += frontier.size();
+    }
+
+    const size_t feature_size = std::accumulate(std::begin(features), std::end(features), size_t(0),
+                                                [](size_t val, const auto &f) { return val + f.second; });
+    if (feature_size > 0 && !output.m_nodes.empty())
+    {
+        output.m_features.resize(feature_size * output.m_nodes.size());
+        GetNodeFeature(output.m_nodes, features, output.m_features);
+    }
+}
+
+void Graph::RandomWalk(int64_t seed, float p, float q, NodeId default_node_id, std::span<const NodeId> node_ids,
+                       std::span<Type> edge_types, size_t walk_length, std::span<NodeId> output) const
+{
+    if (!check_sorted_unique_types(edge_types.data(), edge_types.size()))
+    {
+        std::sort(std::begin(edge_types), std::end(edge_types));
+        auto last = std::unique(std::begin(edge_types), std::end(edge_types));
+        edge_types = edge_types.subspan(0, last - std::begin(edge_types));
+    }
+
+    // Walks are independent, so every one of them gets its own seed to split them between threads.
+    Xoroshiro128PlusGenerator engine(seed);
+    std::vector<uint64_t> walk_seeds(node_ids.size());
+    std::generate(std::begin(walk_seeds), std::end(walk_seeds), engine);
+    const Node2VecWalker walker(m_partitions, m_node_map, m_partitions_indices, m_internal_indices, m_counts, p, q,
+                                edge_types);
+    const size_t chunk_size = ChunkSize(node_ids.size());
+    ForEachChunk(node_ids.size(), chunk_size, [&](size_t begin, size_t end) {
+        std::vector<NodeId> path;
+        std::vector<NodeId> last_neighbors;
+        for (size_t index = begin; index < end; ++index)
+        {
+            path.assign(1, node_ids[index]);
+            walker.Walk(walk_seeds[index], walk_length, 0, node_ids[index], node_ids[index], {}, path,
+                        last_neighbors);
+            auto walk = output.subspan(index * (walk_length + 1), walk_length + 1);
+            std::fill(std::copy(std::begin(path), std::end(path), std::begin(walk)), std::end(walk),
+                      default_node_id);
+        }
+    });
+}
+
+void Graph::NegativeSample(int64_t seed, NodeId default_node_id, std::span<const NodeId> node_ids,
+                           std::span<Type> edge_types, size_t count, std::span<NodeId> output) const
+{
+    if (!check_sorted_unique_types(edge_types.data(), edge_types.size()))
+    {
+        std::sort(std::begin(edge_types), std::end(edge_types));
+        auto last = std::unique(std::begin(edge_types), std::end(edge_types));
+        edge_types = edge_types.subspan(0, last - std::begin(edge_types));
+    }
+
+    auto &sorted_ids = m_sorted_ids->m_ids;
+    std::call_once(m_sorted_ids->m_flag, [this, &sorted_ids]() {
+        sorted_ids.reserve(m_node_map.Size());
+        m_node_map.ForEach([&sorted_ids](NodeId node) { sorted_ids.emplace_back(node); });
+        std::sort(std::begin(sorted_ids), std::end(sorted_ids));
+    });
+    if (sorted_ids.empty())
+    {
+        std::fill(std::begin(output), std::end(output), default_node_id);
+        return;
+    }
+
+    Xoroshiro128PlusGenerator engine(seed);
+    std::vector<uint64_t> node_seeds(node_ids.size());
+    std::generate(std::begin(node_seeds), std::end(node_seeds), engine);
+    ForEachChunk(node_ids.size(), ChunkSize(node_ids.size()), [&](size_t begin, size_t end) {
+        std::vector<uint64_t> indices(end - begin);
+        m_node_map.Find(node_ids.subspan(begin, end - begin), indices);
+        boost::random::uniform_int_distribution<size_t> position(0, sorted_ids.size() - 1);
+        for (size_t node_index = begin; node_index < end; ++node_index)
+        {
+            PrefetchRecord(indices, node_index - begin + prefetch_distance);
+            const auto source = node_ids[node_index];
+            const auto index = indices[node_index - begin];
+            auto negatives = output.subspan(node_index * count, count);
+            Xoroshiro128PlusGenerator node_engine(node_seeds[node_index]);
+            size_t filled = 0;
+            for (size_t attempt = 0; attempt < NegativeSampleAttempts(count) && filled < count; ++attempt)
+            {
+                const auto candidate = sorted_ids[position(node_engine)];
+                if (index == NodeIndex::npos ? candidate != source
+                                             : !IsNeighbor(m_partitions, m_partitions_indices, m_internal_indices,
+                                                           m_counts, index, source, candidate, edge_types))
+                {
+                    negatives[filled++] = candidate;
+                }
+            }
+
+            std::fill(std::begin(negatives) + filled, std::end(negatives), default_node_id);
+        }
+    });
+}
+
+size_t Graph::ChunkSize(size_t count) const
+{
+    if (!m_thread_pool)
+    {
+        return std::max<size_t>(1, count);
     }
+
+    // A few chunks per thread to balance uneven work between nodes.
+    const size_t chunks = 4 * m_thread_pool->Size();
+    return std::max(m_min_chunk_size, (count + chunks - 1) / chunks);
+}
+
+void Graph::ForEachChunk(size_t count, size_t chunk_size, const std::function<void(size_t, size_t)> &func) const
+{
+    if (count == 0)
+    {
+        return;
+    }
+    if (!m_thread_pool || count <= chunk_size)
+    {
+        func(0, count);
+        return;
+    }
+
+    m_thread_pool->ParallelFor(count, chunk_size, func);
+}
+
+std::vector<uint64_t> Graph::FindNodes(std::span<const NodeId> node_ids, size_t chunk_size,
+                                       std::vector<uint64_t> &indices) const
+{
+    indices.resize(node_ids.size());
+    const size_t chunk_count = (node_ids.size() + chunk_size - 1) / chunk_size;
+    std::vector<uint64_t> records(chunk_count + 1, 0);
+    ForEachChunk(node_ids.size(), chunk_size, [&](size_t begin, size_t end) {
+        m_node_map.Find(node_ids.subspan(begin, end - begin), std::span(indices).subspan(begin, end - begin));
+        uint64_t chunk_records = 0;
+        for (size_t node_index = begin; node_index < end; ++node_index)
+        {
+            chunk_records += indices[node_index] == NodeIndex::npos ? 0 : m_counts[indices[node_index]];
+        }
+        records[begin / chunk_size + 1] = chunk_records;
+    });
+
+    for (size_t chunk = 1; chunk <= chunk_count; ++chunk)
+    {
+        records[chunk] += records[chunk - 1];
+    }
+    return records;
+}
+
+void Graph::PrefetchRecord(std::span<const uint64_t> indices, size_t position) const
+{
+    if (position >= indices.size() || indices[position] == NodeIndex::npos)
+    {
+        return;
+    }
+
+    const auto index = indices[position];
+    prefetch(&m_counts[index]);
+    prefetch(&m_partitions_indices[index]);
+    prefetch(&m_internal_indices[index]);
 }
 
 Metadata Graph::GetMetadata() const
@@ -441,7 +874,12 @@ Metadata Graph::GetMetadata() const
     return m_metadata;
 }
 
-void Graph::ReadNodeMap(std::filesystem::path path, std::string suffix, uint32_t index)
+std::shared_ptr<const FeatureCache> Graph::GetFeatureCache() const
+{
+    return m_feature_cache;
+}
+
+std::vector<NodeId> Graph::ReadNodeIds(std::filesystem::path path, std::string suffix) const
 {
     std::shared_ptr<BaseStorage<uint8_t>> node_map;
     if (!is_hdfs_path(path))
@@ -451,14 +889,13 @@ void Graph::ReadNodeMap(std::filesystem::path path, std::string suffix, uint32_t
     else
     {
         auto full_path = path / ("node_" + suffix + ".map");
-        node_map = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path);
+        node_map = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path,
+                                                                m_metadata.m_hdfs_read);
     }
     auto node_map_ptr = node_map->start();
     size_t size = node_map->size() / 20; // 20 = 8(node_id) + 8(internal_id) + 4(node_type)
-    m_node_map.reserve(size);
-    m_partitions_indices.reserve(size);
-    m_internal_indices.reserve(size);
-    m_counts.reserve(size);
+    std::vector<NodeId> node_ids;
+    node_ids.reserve(size);
     for (size_t i = 0; i < size; ++i)
     {
         uint64_t pair[2];
@@ -467,36 +904,16 @@ void Graph::ReadNodeMap(std::filesystem::path path, std::string suffix, uint32_t
             RAW_LOG_FATAL("Failed to read pair in a node maping");
         }
 
-        auto el = m_node_map.find(pair[0]);
-        if (el == std::end(m_node_map))
-        {
-            m_node_map[pair[0]] = m_internal_indices.size();
-            m_internal_indices.emplace_back(pair[1]);
-            m_partitions_indices.emplace_back(index);
-            m_counts.emplace_back(1);
-        }
-        else
-        {
-            auto old_offset = el->second;
-            auto old_count = m_counts[old_offset];
-            m_node_map[pair[0]] = m_internal_indices.size();
-
-            std::copy_n(std::begin(m_internal_indices) + old_offset, old_count, std::back_inserter(m_internal_indices));
-            m_internal_indices.emplace_back(pair[1]);
-            std::copy_n(std::begin(m_partitions_indices) + old_offset, old_count,
-                        std::back_inserter(m_partitions_indices));
-            m_partitions_indices.emplace_back(index);
-
-            std::fill_n(std::back_inserter(m_counts), old_count + 1, old_count + 1);
-        }
-
         assert(pair[1] == i);
+        node_ids.emplace_back(pair[0]);
         Type node_type;
         if (node_map->read(&node_type, sizeof(Type), 1, node_map_ptr) != 1)
         {
             RAW_LOG_FATAL("Failed to read node type in a node maping");
         }
     }
+
+    return node_ids;
 }
 
 } // namespace snark
@@ -5,6 +5,9 @@
 #define SNARK_GRAPH_H
 
 #include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <span>
 #include <string>
@@ -13,24 +16,63 @@
 
 #include "absl/container/flat_hash_map.h"
 
+#include "node_index.h"
+#include "parallel.h"
 #include "partition.h"
 #include "sampler.h"
+#include "shared_index.h"
 #include "types.h"
 
 namespace snark
 {
 
+// Neighborhood of seed nodes returned by SampleSubgraph.
+struct Subgraph
+{
+    // Unique nodes: seeds in the input order followed by sampled neighbors.
+    std::vector<NodeId> m_nodes;
+
+    // Number of hops from seeds to reach every node.
+    std::vector<uint32_t> m_hops;
+
+    // Sampled edges as positions of source and destination nodes in m_nodes.
+    std::vector<uint64_t> m_edge_src;
+    std::vector<uint64_t> m_edge_dst;
+    std::vector<Type> m_edge_types;
+
+    // Features of every node in m_nodes order, missing nodes have zero features.
+    std::vector<uint8_t> m_features;
+};
+
 class Graph
 {
   public:
+    // Features of disk partitions are cached if feature_cache has positive capacity. Compact node index and
+    // compressed edges trade slower lookups for less memory, see NodeIndex and CompressedAdjacency. Batches
+    // larger than a chunk are split between thread_pool threads with the same results as sequential calls.
+    // Weighted neighbor sampling uses alias tables for edge runs of at least alias_threshold edges, 0 disables them.
+    // Dense node features in columnar_features are gathered from per feature arrays, see Partition.
+    // Processes on the same host can share arrays built at load time through a shared_index directory: the first
+    // process publishes them and the others map them read only, see SharedIndex. Shared graphs always use compact
+    // node index, compressed edges and HDFS paths, whose file versions are unknown, disable sharing.
+    // Edges of runs with at least edge_index_threshold edges are found with hash tables, 0 disables them.
+    // Files on HDFS are read in hdfs_read ranges, every streamed file keeps its ranges in flight in memory.
     Graph(std::string path, std::vector<uint32_t> partitions, PartitionStorageType storage_type,
-          std::string config_path);
+          std::string config_path, FeatureCacheConfig feature_cache = {}, bool compact_node_index = false,
+          bool compressed_edges = false, ThreadPoolConfig thread_pool = {}, size_t alias_threshold = 0,
+          std::vector<FeatureId> columnar_features = {}, std::string shared_index = {},
+          size_t edge_index_threshold = 0, HDFSReadOptions hdfs_read = {});
 
     void GetNodeType(std::span<const NodeId> node_ids, std::span<Type> output, Type default_type) const;
 
     void GetNodeFeature(std::span<const NodeId> node_ids, std::span<snark::FeatureMeta> features,
                         std::span<uint8_t> output) const;
 
+    // Fill output with sparse features of nodes, first index of every value is the node position in node_ids.
+    void GetNodeSparseFeature(std::span<const NodeId> node_ids, std::span<const snark::FeatureId> features,
+                              SparseFeatureBatch &output) const;
+
+    // Same as above with features copied to per feature vectors.
     void GetNodeSparseFeature(std::span<const NodeId> node_ids, std::span<const snark::FeatureId> features,
                               std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
                               std::vector<std::vector<uint8_t>> &out_data) const;
@@ -42,6 +84,11 @@ class Graph
                         std::span<const Type> input_edge_type, std::span<snark::FeatureMeta> features,
                         std::span<uint8_t> output) const;
 
+    // Fill output with sparse features of edges, first index of every value is the edge position in input_edge_src.
+    void GetEdgeSparseFeature(std::span<const NodeId> input_edge_src, std::span<const NodeId> input_edge_dst,
+                              std::span<const Type> input_edge_type, std::span<const snark::FeatureId> features,
+                              SparseFeatureBatch &output) const;
+
     void GetEdgeSparseFeature(std::span<const NodeId> input_edge_src, std::span<const NodeId> input_edge_dst,
                               std::span<const Type> input_edge_type, std::span<const snark::FeatureId> features,
                               std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
@@ -68,17 +115,72 @@ class Graph
                                std::span<Type> output_neighbor_types, std::span<uint64_t> neighbors_total_count,
                                NodeId default_node_id, Type default_edge_type) const;
 
+    // Sample a subgraph around seed nodes: every node reached in h hops is expanded once with fanouts[h]
+    // uniformly sampled neighbors, nodes reached in fanouts.size() hops are leaves.
+    void SampleSubgraph(bool without_replacement, int64_t seed, std::span<const NodeId> seeds,
+                        std::span<const uint32_t> fanouts, std::span<Type> edge_types,
+                        std::span<snark::FeatureMeta> features, Subgraph &output) const;
+
+    // Node2vec random walks with walk_length steps from every node, see Node2VecWalker. Output has walk_length + 1
+    // nodes per walk starting with the input node, walks are padded with default_node_id after nodes without
+    // neighbors.
+    void RandomWalk(int64_t seed, float p, float q, NodeId default_node_id, std::span<const NodeId> node_ids,
+                    std::span<Type> edge_types, size_t walk_length, std::span<NodeId> output) const;
+
+    // Draw count negatives per source uniformly from nodes of the graph, skipping the source and its neighbors
+    // connected with one of edge_types. Output has count nodes per source, negatives not found within
+    // NegativeSampleAttempts draws are set to default_node_id.
+    void NegativeSample(int64_t seed, NodeId default_node_id, std::span<const NodeId> node_ids,
+                        std::span<Type> edge_types, size_t count, std::span<NodeId> output) const;
+
     Metadata GetMetadata() const;
 
-  private:
-    void ReadNodeMap(std::filesystem::path path, std::string suffix, uint32_t index);
+    // Return feature cache shared by partitions, nullptr if caching is disabled.
+    std::shared_ptr<const FeatureCache> GetFeatureCache() const;
 
-    std::vector<Partition> m_partitions;
-    absl::flat_hash_map<NodeId, uint64_t> m_node_map;
-    std::vector<uint32_t> m_partitions_indices;
-    std::vector<uint64_t> m_internal_indices;
-    std::vector<uint32_t> m_counts;
+  private:
+    std::vector<NodeId> ReadNodeIds(std::filesystem::path path, std::string suffix) const;
+    void WarmFeatureCache(std::span<const uint32_t> partitions);
+
+    // Call func(begin, end) for chunks of [0, count) with chunk_size from ChunkSize, in parallel if there is a pool.
+    size_t ChunkSize(size_t count) const;
+    void ForEachChunk(size_t count, size_t chunk_size, const std::function<void(size_t, size_t)> &func) const;
+
+    // Find node records for a batch and return the number of partition records per chunk, they are used to
+    // derive sampling seeds of every chunk.
+    std::vector<uint64_t> FindNodes(std::span<const NodeId> node_ids, size_t chunk_size,
+                                    std::vector<uint64_t> &indices) const;
+
+    // Prefetch partition records of indices[position] if it is a found node. Loops over batches call it for the
+    // node prefetch_distance ahead of the current one.
+    void PrefetchRecord(std::span<const uint64_t> indices, size_t position) const;
+
+    // Find source records of a batch of edges and locate the edges in partitions, see snark::LocateEdges.
+    std::vector<EdgeLocation> LocateEdges(std::span<const NodeId> input_edge_src,
+                                          std::span<const NodeId> input_edge_dst,
+                                          std::span<const Type> input_edge_type) const;
+
+    PartitionList m_partitions;
+    NodeIndex m_node_map;
+    std::span<const uint32_t> m_partitions_indices;
+    std::span<const uint64_t> m_internal_indices;
+    std::span<const uint32_t> m_counts;
     Metadata m_metadata;
+    std::shared_ptr<FeatureCache> m_feature_cache;
+    std::shared_ptr<ThreadPool> m_thread_pool;
+    size_t m_min_chunk_size;
+
+    // Owners of node records referenced by spans above: vectors or files mapped from a shared index.
+    std::vector<std::shared_ptr<const void>> m_index_buffers;
+
+    // Sorted ids of all nodes to draw negatives from, built by the first NegativeSample call. Kept on the heap,
+    // so graphs stay movable.
+    struct SortedIds
+    {
+        std::once_flag m_flag;
+        std::vector<NodeId> m_ids;
+    };
+    std::unique_ptr<SortedIds> m_sorted_ids = std::make_unique<SortedIds>();
 };
 
 } // namespace snark
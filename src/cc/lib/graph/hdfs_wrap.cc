@@ -2,17 +2,19 @@
 // Licensed under the MIT License.
 
 #include "hdfs_wrap.h"
+#include "parallel.h"
 #include "types.h"
+#include <algorithm>
+#include <cstring>
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
+#include <limits>
 #include <stdlib.h>
 
 #ifdef SNARK_PLATFORM_LINUX
 #include <dlfcn.h>
 #include <fcntl.h>
 
-const int32_t BUFFER_SIZE = 4096;
-
 void check_dlsym_error(const char *symbol)
 {
     const char *dlsym_error = dlerror();
@@ -114,6 +116,8 @@ class hdfsBindings
         check_dlsym_error("hdfsFreeFileInfo");
         hdfsRead_so = reinterpret_cast<hdfsRead_t>(dlsym(hdfs_handle, "hdfsRead"));
         check_dlsym_error("hdfsRead");
+        hdfsPread_so = reinterpret_cast<hdfsPread_t>(dlsym(hdfs_handle, "hdfsPread"));
+        check_dlsym_error("hdfsPread");
         hdfsCloseFile_so = reinterpret_cast<hdfsCloseFile_t>(dlsym(hdfs_handle, "hdfsCloseFile"));
         check_dlsym_error("hdfsCloseFile");
         hdfsDisconnect_so = reinterpret_cast<hdfsDisconnect_t>(dlsym(hdfs_handle, "hdfsDisconnect"));
@@ -133,6 +137,7 @@ class hdfsBindings
     typedef hdfs_int (*hdfsFreeFileInfo_t)(hdfsFileInfo_so *, hdfs_int);
     typedef hdfsFile_so (*hdfsOpenFile_t)(hdfsFS_so, const char *, hdfs_int, hdfs_int, short, int32_t);
     typedef int32_t (*hdfsRead_t)(hdfsFS_so, hdfsFile_so, void *, int32_t);
+    typedef int32_t (*hdfsPread_t)(hdfsFS_so, hdfsFile_so, int64_t, void *, int32_t);
     typedef void (*hdfsCloseFile_t)(hdfsFS_so, hdfsFile_so);
     typedef hdfs_int (*hdfsDisconnect_t)(hdfsFS_so);
     typedef hdfsFileInfo_so *(*hdfsListDirectory_t)(hdfsFS_so, const char *, hdfs_int *);
@@ -143,6 +148,7 @@ class hdfsBindings
     hdfsFreeFileInfo_t hdfsFreeFileInfo_so = nullptr;
     hdfsOpenFile_t hdfsOpenFile_so = nullptr;
     hdfsRead_t hdfsRead_so = nullptr;
+    hdfsPread_t hdfsPread_so = nullptr;
     hdfsCloseFile_t hdfsCloseFile_so = nullptr;
     hdfsDisconnect_t hdfsDisconnect_so = nullptr;
     hdfsListDirectory_t hdfsListDirectory_so = nullptr;
@@ -206,41 +212,31 @@ hdfsFile_so HDFSConnection::open_file(const char *path)
     if (!readFile)
         RAW_LOG_FATAL("Failed to open %s for reading", path);
 
-    m_buffer = malloc(BUFFER_SIZE);
-
     return readFile;
 }
 
 void HDFSConnection::close_file(hdfsFile_so readFile)
 {
     hdfs_bindings->hdfsCloseFile_so(fs, readFile);
-    free(m_buffer);
-    m_buffer = nullptr;
 }
 
-void HDFSConnection::read(hdfsFile_so readFile, int64_t read_size, void *output)
+void HDFSConnection::pread(hdfsFile_so readFile, int64_t offset, int64_t read_size, void *output) const
 {
     if (readFile == nullptr)
         RAW_LOG_FATAL("Read input file not open!");
 
-    uint8_t *src = static_cast<uint8_t *>(m_buffer);
-    uint8_t *dst = static_cast<uint8_t *>(output);
-
-    int32_t read_size_curr;
-    int32_t curr_read = 0;
+    auto dst = static_cast<char *>(output);
     int64_t acc_read = 0;
     while (read_size > acc_read)
     {
-        read_size_curr = static_cast<int32_t>(std::min(read_size - acc_read, static_cast<int64_t>(BUFFER_SIZE)));
-        curr_read = hdfs_bindings->hdfsRead_so(fs, readFile, m_buffer, read_size_curr);
-        if (curr_read < read_size_curr)
-            curr_read +=
-                hdfs_bindings->hdfsRead_so(fs, readFile, static_cast<void *>(static_cast<char *>(m_buffer) + curr_read),
-                                           read_size_curr - curr_read);
-        if (curr_read != read_size_curr)
-            RAW_LOG_FATAL("file %s : Stopped reading after %li bytes, expected %li bytes!", m_data_path.c_str(),
-                          acc_read, read_size);
-        memcpy(dst, src, read_size_curr);
+        const auto read_size_curr =
+            static_cast<int32_t>(std::min<int64_t>(read_size - acc_read, std::numeric_limits<int32_t>::max()));
+
+        // Reads might return less bytes than requested, e.g. at block boundaries.
+        const auto curr_read = hdfs_bindings->hdfsPread_so(fs, readFile, offset + acc_read, dst, read_size_curr);
+        if (curr_read <= 0)
+            RAW_LOG_FATAL("file %s : Stopped reading at offset %li after %li bytes, expected %li bytes!",
+                          m_data_path.c_str(), offset, acc_read, read_size);
         dst += curr_read;
         acc_read += curr_read;
     }
@@ -258,7 +254,8 @@ std::vector<std::string> hdfs_list_directory(std::string full_path, std::string
     return connection.list_directory(data_path);
 }
 
-template <typename T> std::vector<T> read_hdfs(std::string full_path, std::string config_path)
+template <typename T>
+std::vector<T> read_hdfs(std::string full_path, std::string config_path, HDFSReadOptions options)
 {
     std::string data_path_str;
     std::string host_str;
@@ -271,7 +268,9 @@ template <typename T> std::vector<T> read_hdfs(std::string full_path, std::strin
     auto read_size = connection.get_file_size(data_path, host, port);
     std::vector<T> output(read_size / sizeof(T));
     auto file = connection.open_file(data_path);
-    connection.read(file, read_size, static_cast<void *>(output.data()));
+    HDFSRangeReader(output.size() * sizeof(T), options, [&connection, file](int64_t offset, int64_t size, void *range) {
+        connection.pread(file, offset, size, range);
+    }).read_all(output.data());
     connection.close_file(file);
     return output;
 }
@@ -287,7 +286,6 @@ HDFSConnection::HDFSConnection(std::string data_path, std::string config_path)
     m_data_path = data_path;
     hdfs_bindings = nullptr;
     fs = nullptr;
-    m_buffer = nullptr;
 }
 
 int64_t HDFSConnection::get_file_size(const char *path, const char *host, int port)
@@ -309,7 +307,7 @@ void HDFSConnection::close_file(hdfsFile_so readFile)
 {
 }
 
-void HDFSConnection::read(hdfsFile_so readFile, int64_t read_size, void *output)
+void HDFSConnection::pread(hdfsFile_so readFile, int64_t offset, int64_t read_size, void *output) const
 {
 }
 
@@ -323,7 +321,8 @@ std::vector<std::string> hdfs_list_directory(std::string full_path, std::string
     return std::vector<std::string>();
 }
 
-template <typename T> std::vector<T> read_hdfs(std::string full_path, std::string config_path)
+template <typename T>
+std::vector<T> read_hdfs(std::string full_path, std::string config_path, HDFSReadOptions options)
 {
     RAW_LOG_FATAL("HDFS only supported for linux!");
     return std::vector<T>();
@@ -331,14 +330,108 @@ template <typename T> std::vector<T> read_hdfs(std::string full_path, std::strin
 
 #endif
 
+HDFSRangeReader::HDFSRangeReader(int64_t size, HDFSReadOptions options, Fetch fetch)
+    : m_size(size), m_options(options), m_fetch(std::move(fetch))
+{
+    m_options.m_buffer_size = std::max<int64_t>(1, m_options.m_buffer_size);
+    m_options.m_parallelism = std::max<size_t>(1, m_options.m_parallelism);
+}
+
+HDFSRangeReader::~HDFSRangeReader()
+{
+    for (auto &range : m_ranges)
+    {
+        range.wait();
+    }
+}
+
+int64_t HDFSRangeReader::size() const
+{
+    return m_size;
+}
+
+void HDFSRangeReader::read_all(void *output) const
+{
+    const auto buffer_size = m_options.m_buffer_size;
+    const size_t range_count = (m_size + buffer_size - 1) / buffer_size;
+    snark::parallel_for(range_count, m_options.m_parallelism, [&](size_t range) {
+        const int64_t offset = range * buffer_size;
+        m_fetch(offset, std::min(buffer_size, m_size - offset), static_cast<char *>(output) + offset);
+    });
+}
+
+bool HDFSRangeReader::read(int64_t size, void *output)
+{
+    if (size > m_size - m_position)
+    {
+        return false;
+    }
+
+    auto dst = static_cast<char *>(output);
+    m_position += size;
+    while (size > 0)
+    {
+        if (m_current_offset == m_current.size())
+        {
+            read_ahead();
+            m_current = m_ranges.front().get();
+            m_ranges.pop_front();
+            m_current_offset = 0;
+        }
+
+        const auto count = std::min<size_t>(size, m_current.size() - m_current_offset);
+        std::memcpy(dst, m_current.data() + m_current_offset, count);
+        m_current_offset += count;
+        dst += count;
+        size -= count;
+    }
+
+    read_ahead();
+    return true;
+}
+
+void HDFSRangeReader::rewind()
+{
+    if (m_position == 0)
+    {
+        return;
+    }
+
+    for (auto &range : m_ranges)
+    {
+        range.wait();
+    }
+
+    m_ranges.clear();
+    m_current.clear();
+    m_current_offset = 0;
+    m_next_range = 0;
+    m_position = 0;
+}
+
+void HDFSRangeReader::read_ahead()
+{
+    while (m_ranges.size() < m_options.m_parallelism && m_next_range < m_size)
+    {
+        const auto offset = m_next_range;
+        const auto size = std::min(m_options.m_buffer_size, m_size - offset);
+        m_ranges.emplace_back(std::async(std::launch::async, [this, offset, size]() {
+            std::vector<char> range(size);
+            m_fetch(offset, size, range.data());
+            return range;
+        }));
+        m_next_range += size;
+    }
+}
+
 bool is_hdfs_path(std::filesystem::path path)
 {
     return path.string().find("adl://") == 0 || path.string().find("hdfs://") == 0 ||
            path.string().find("file:///") == 0;
 }
 
-template std::vector<uint8_t> read_hdfs(std::string full_path, std::string config_path);
-template std::vector<uint16_t> read_hdfs(std::string full_path, std::string config_path);
-template std::vector<uint32_t> read_hdfs(std::string full_path, std::string config_path);
-template std::vector<uint64_t> read_hdfs(std::string full_path, std::string config_path);
-template std::vector<char> read_hdfs(std::string full_path, std::string config_path);
+template std::vector<uint8_t> read_hdfs(std::string full_path, std::string config_path, HDFSReadOptions options);
+template std::vector<uint16_t> read_hdfs(std::string full_path, std::string config_path, HDFSReadOptions options);
+template std::vector<uint32_t> read_hdfs(std::string full_path, std::string config_path, HDFSReadOptions options);
+template std::vector<uint64_t> read_hdfs(std::string full_path, std::string config_path, HDFSReadOptions options);
+template std::vector<char> read_hdfs(std::string full_path, std::string config_path, HDFSReadOptions options);
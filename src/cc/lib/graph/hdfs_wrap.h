@@ -4,7 +4,13 @@
 #ifndef SNARK_HDFS_WRAP_H
 #define SNARK_HDFS_WRAP_H
 
+#include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
 #include <vector>
 
 typedef int32_t hdfs_int;
@@ -60,20 +66,74 @@ class HDFSConnection
 
     hdfsFile_so open_file(const char *path);
     void close_file(hdfsFile_so readFile);
-    void read(hdfsFile_so readFile, int64_t read_size, void *output);
+
+    // Positional read of read_size bytes starting at offset, doesn't move the file position and is safe to call
+    // from multiple threads.
+    void pread(hdfsFile_so readFile, int64_t offset, int64_t read_size, void *output) const;
 
   private:
     std::shared_ptr<hdfsBindings> hdfs_bindings;
     hdfsFS_so fs = nullptr;
     std::string m_data_path = "";
-    void *m_buffer = nullptr;
+};
+
+// Size of ranges and number of concurrent reads used to load HDFS files. Every streamed file keeps up to
+// m_parallelism ranges in memory, graphs and servers load partition files concurrently, so defaults are small.
+struct HDFSReadOptions
+{
+    int64_t m_buffer_size = 4 << 20;
+    size_t m_parallelism = 4;
+};
+
+// Reader of a file split in ranges of m_buffer_size bytes fetched concurrently with positional reads. Every read
+// is a round trip to a data node, so keeping multiple large ranges in flight makes loading bound by bandwidth
+// instead of latency.
+class HDFSRangeReader
+{
+  public:
+    // Positional read of size bytes at offset to output, called from multiple threads at once.
+    using Fetch = std::function<void(int64_t offset, int64_t size, void *output)>;
+
+    HDFSRangeReader(int64_t size, HDFSReadOptions options, Fetch fetch);
+
+    // Wait for ranges fetched ahead, fetch might use resources released after the reader.
+    ~HDFSRangeReader();
+
+    HDFSRangeReader(const HDFSRangeReader &) = delete;
+    HDFSRangeReader &operator=(const HDFSRangeReader &) = delete;
+
+    // Read the whole file to output.
+    void read_all(void *output) const;
+
+    // Copy the next size bytes to output, while up to m_parallelism ranges after them are fetched in background.
+    // Returns false without reading anything if less than size bytes are left.
+    bool read(int64_t size, void *output);
+
+    // Start sequential reads from the beginning of the file.
+    void rewind();
+
+    int64_t size() const;
+
+  private:
+    void read_ahead();
+
+    int64_t m_size;
+    HDFSReadOptions m_options;
+    Fetch m_fetch;
+
+    std::deque<std::future<std::vector<char>>> m_ranges;
+    std::vector<char> m_current;
+    size_t m_current_offset = 0;
+    int64_t m_next_range = 0;
+    int64_t m_position = 0;
 };
 
 void parse_hdfs_path(std::string full_path, std::string &data_path, std::string &host, int &port);
 
 std::vector<std::string> hdfs_list_directory(std::string full_path, std::string config_path);
 
-template <typename T> std::vector<T> read_hdfs(std::string full_path, std::string config_path);
+template <typename T>
+std::vector<T> read_hdfs(std::string full_path, std::string config_path, HDFSReadOptions options = {});
 
 bool is_hdfs_path(std::filesystem::path path);
 
@@ -2,7 +2,23 @@
 // Licensed under the MIT License.
 
 #include "locator.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <vector>
+
+#ifdef SNARK_PLATFORM_WINDOWS
+#include <io.h>
+#include <windows.h>
+#else
+#include <climits>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
@@ -76,6 +92,35 @@ FILE *open_node_alias(std::filesystem::path path, size_t partition, Type type)
     return open_file(path / ("node_" + std::to_string(type) + "_" + std::to_string(partition) + ".alias"), "rb");
 }
 
+FILE *open_shared_array(std::filesystem::path path, std::string name)
+{
+    return open_file(path / (name + ".bin"), "rb");
+}
+
+std::string partition_version(std::filesystem::path path, std::string suffix)
+{
+    if (is_hdfs_path(path))
+    {
+        return {};
+    }
+
+    std::string version;
+    for (const auto &name : {"node_" + suffix + ".map", "node_" + suffix + ".index",
+                             "node_features_" + suffix + ".index", "node_features_" + suffix + ".data",
+                             "neighbors_" + suffix + ".index", "edge_" + suffix + ".index",
+                             "edge_features_" + suffix + ".index", "edge_features_" + suffix + ".data"})
+    {
+        // Optional files, e.g. features of graphs without them, are marked as missing.
+        std::error_code error;
+        const auto file = path / name;
+        const auto size = std::filesystem::file_size(file, error);
+        const auto time = std::filesystem::last_write_time(file, error);
+        version += error ? " -" : " " + std::to_string(size) + ":" + std::to_string(time.time_since_epoch().count());
+    }
+
+    return version;
+}
+
 void platform_fseek(FILE *f, int offset, int origin)
 {
     // To work with large files on windows we need 64bit versions of fseek/ftell
@@ -95,4 +140,199 @@ size_t platform_ftell(FILE *f)
 #endif
 }
 
+const void *platform_mmap(FILE *f, size_t size)
+{
+#ifdef SNARK_PLATFORM_WINDOWS
+    auto file_handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(f)));
+    auto mapping = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        RAW_LOG_FATAL("Failed to create file mapping with error code: %lu", GetLastError());
+    }
+    auto addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    // View keeps a reference to the mapping object, so it is safe to close the handle.
+    CloseHandle(mapping);
+    if (addr == NULL)
+    {
+        RAW_LOG_FATAL("Failed to map view of file with error code: %lu", GetLastError());
+    }
+    return addr;
+#else
+    auto addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    if (addr == MAP_FAILED)
+    {
+        RAW_LOG_FATAL("Failed to map file to memory: %s", strerror(errno));
+    }
+    return addr;
+#endif
+}
+
+void platform_munmap(const void *addr, size_t size)
+{
+#ifdef SNARK_PLATFORM_WINDOWS
+    UnmapViewOfFile(addr);
+#else
+    ::munmap(const_cast<void *>(addr), size);
+#endif
+}
+
+void platform_lock_file(FILE *f)
+{
+#ifdef SNARK_PLATFORM_WINDOWS
+    auto file_handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(f)));
+    OVERLAPPED overlapped = {};
+    if (!LockFileEx(file_handle, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped))
+    {
+        RAW_LOG_FATAL("Failed to lock file with error code: %lu", GetLastError());
+    }
+#else
+    int result;
+    do
+    {
+        result = ::flock(fileno(f), LOCK_EX);
+    } while (result != 0 && errno == EINTR);
+    if (result != 0)
+    {
+        RAW_LOG_FATAL("Failed to lock file: %s", strerror(errno));
+    }
+#endif
+}
+
+size_t platform_pread(FILE *f, void *output, size_t size, uint64_t offset)
+{
+    auto curr = static_cast<char *>(output);
+    size_t total = 0;
+#ifdef SNARK_PLATFORM_WINDOWS
+    auto file_handle = reinterpret_cast<HANDLE>(_get_osfhandle(_fileno(f)));
+    while (total < size)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset & 0xFFFFFFFF);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+        DWORD read = 0;
+        const auto chunk = DWORD(std::min<size_t>(size - total, MAXDWORD));
+        if (!ReadFile(file_handle, curr, chunk, &read, &overlapped) || read == 0)
+        {
+            break;
+        }
+        total += read;
+        curr += read;
+        offset += read;
+    }
+#else
+    const auto fd = fileno(f);
+    while (total < size)
+    {
+        const auto read = ::pread(fd, curr, size - total, off_t(offset));
+        if (read < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (read <= 0)
+        {
+            break;
+        }
+        total += read;
+        curr += read;
+        offset += read;
+    }
+#endif
+    return total;
+}
+
+namespace
+{
+// IO threads shared by all batched reads, calling threads also take part in reading their own ranges.
+ThreadPool &read_pool()
+{
+    static ThreadPool pool(default_concurrent_reads);
+    return pool;
+}
+
+// Read consecutive ranges of a file with a single request.
+bool read_adjacent(FILE *f, std::span<FileRange> ranges)
+{
+    bool result = true;
+#ifdef SNARK_PLATFORM_WINDOWS
+    for (const auto &range : ranges)
+    {
+        result &= platform_pread(f, range.output, range.size, range.offset) == range.size;
+    }
+#else
+    std::vector<iovec> buffers;
+    buffers.reserve(ranges.size());
+    uint64_t total = 0;
+    for (const auto &range : ranges)
+    {
+        buffers.push_back(iovec{.iov_base = range.output, .iov_len = range.size});
+        total += range.size;
+    }
+
+    ssize_t read;
+    do
+    {
+        read = ::preadv(fileno(f), buffers.data(), int(buffers.size()), off_t(ranges.front().offset));
+    } while (read < 0 && errno == EINTR);
+
+    // Short vectored reads are rare, finish them one range at a time.
+    if (read < 0 || uint64_t(read) != total)
+    {
+        for (const auto &range : ranges)
+        {
+            result &= platform_pread(f, range.output, range.size, range.offset) == range.size;
+        }
+    }
+#endif
+    return result;
+}
+} // namespace
+
+bool platform_pread(FILE *f, std::span<FileRange> ranges, size_t max_concurrent_reads)
+{
+    std::sort(std::begin(ranges), std::end(ranges),
+              [](const FileRange &left, const FileRange &right) { return left.offset < right.offset; });
+
+    // Split ranges into runs of adjacent ones, every run is read with a single vectored request.
+    std::vector<size_t> runs;
+    for (size_t start = 0; start < ranges.size();)
+    {
+        runs.emplace_back(start);
+        uint64_t end_offset = ranges[start].offset + ranges[start].size;
+        size_t end = start + 1;
+#ifndef SNARK_PLATFORM_WINDOWS
+        for (; end < ranges.size() && end - start < IOV_MAX && ranges[end].offset == end_offset; ++end)
+        {
+            end_offset += ranges[end].size;
+        }
+#endif
+        start = end;
+    }
+    runs.emplace_back(ranges.size());
+
+    const size_t run_count = runs.size() - 1;
+    auto read_runs = [f, ranges, &runs](size_t begin, size_t end) {
+        bool result = true;
+        for (size_t run = begin; run < end; ++run)
+        {
+            result &= read_adjacent(f, ranges.subspan(runs[run], runs[run + 1] - runs[run]));
+        }
+        return result;
+    };
+    if (run_count < 2 || max_concurrent_reads <= 1)
+    {
+        return read_runs(0, run_count);
+    }
+
+    // Runs are split in at most max_concurrent_reads chunks to limit number of requests in flight, chunks are
+    // read in order by the calling thread and idle IO threads.
+    std::atomic<bool> result = true;
+    const size_t concurrency = std::min({max_concurrent_reads, run_count, read_pool().Size()});
+    read_pool().ParallelFor(run_count, (run_count + concurrency - 1) / concurrency, [&](size_t begin, size_t end) {
+        if (!read_runs(begin, end))
+        {
+            result = false;
+        }
+    });
+    return result;
+}
 } // namespace snark
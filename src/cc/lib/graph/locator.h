@@ -5,6 +5,7 @@
 #define SNARK_LOCATOR_H
 
 #include <filesystem>
+#include <span>
 #include <string>
 
 #include "hdfs_wrap.h"
@@ -24,9 +25,42 @@ FILE *open_edge_features_index(std::filesystem::path path, std::string suffix);
 FILE *open_edge_features_data(std::filesystem::path path, std::string suffix);
 FILE *open_edge_alias(std::filesystem::path path, size_t partition, Type type);
 FILE *open_node_alias(std::filesystem::path path, size_t partition, Type type);
+FILE *open_shared_array(std::filesystem::path path, std::string name);
+
+// Sizes and modification times of the files of a partition, it changes if any of them is replaced. Empty for HDFS
+// paths, their files are not checked.
+std::string partition_version(std::filesystem::path path, std::string suffix);
 
 void platform_fseek(FILE *f, int offset, int origin);
 size_t platform_ftell(FILE *f);
+
+// Map first size bytes of an open file to memory in read only mode. Mapping stays valid after the file is closed.
+const void *platform_mmap(FILE *f, size_t size);
+void platform_munmap(const void *addr, size_t size);
+
+// Block until the process holds an exclusive lock of an open file, the lock is released when the file is closed.
+void platform_lock_file(FILE *f);
+
+// Read size bytes at offset from an open file without moving its position.
+// Safe to call from multiple threads on the same file. Returns number of bytes read.
+size_t platform_pread(FILE *f, void *output, size_t size, uint64_t offset);
+
+// Part of a file to read into an output buffer.
+struct FileRange
+{
+    uint64_t offset;
+    uint64_t size;
+    uint8_t *output;
+};
+
+// Requests in flight for a single batch of ranges by default.
+const size_t default_concurrent_reads = 16;
+
+// Read all ranges from an open file. Adjacent ranges are merged to read them with a single vectored request and
+// requests for non-adjacent ones are spread across shared IO threads to keep up to max_concurrent_reads of them in
+// flight, 1 issues requests one after another. Ranges are reordered in place. Returns false if any of the ranges
+// wasn't read completely.
+bool platform_pread(FILE *f, std::span<FileRange> ranges, size_t max_concurrent_reads = default_concurrent_reads);
 }; // namespace snark
 
 #endif // SNARK_LOCATOR_H
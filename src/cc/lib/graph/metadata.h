@@ -8,6 +8,8 @@
 #include <string>
 #include <vector>
 
+#include "hdfs_wrap.h"
+
 namespace snark
 {
 
@@ -33,6 +35,9 @@ struct Metadata
     std::string m_path;
     std::string m_config_path;
 
+    // Read ahead of HDFS files set by loaders, not stored in meta files.
+    HDFSReadOptions m_hdfs_read;
+
     std::vector<std::vector<float>> m_partition_node_weights;
     std::vector<std::vector<float>> m_partition_edge_weights;
     std::vector<size_t> m_node_count_per_type;
@@ -0,0 +1,53 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "negative_sampling.h"
+
+#include <algorithm>
+
+#include "xoroshiro.h"
+
+#include "boost/random/uniform_int_distribution.hpp"
+
+namespace snark
+{
+
+size_t NegativeSampleAttempts(size_t count)
+{
+    return 4 * count + 16;
+}
+
+bool IsNeighbor(const PartitionList &partitions, std::span<const uint32_t> partitions_indices,
+                std::span<const uint64_t> internal_indices, std::span<const uint32_t> counts, uint64_t index,
+                NodeId node, NodeId candidate, std::span<const Type> edge_types)
+{
+    if (candidate == node)
+    {
+        return true;
+    }
+
+    for (size_t partition = 0; partition < counts[index]; ++partition)
+    {
+        if (partitions[partitions_indices[index + partition]]->HasEdge(internal_indices[index + partition], candidate,
+                                                                         edge_types))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void DrawNodes(uint64_t seed, std::span<const NodeId> nodes, std::span<NodeId> output)
+{
+    if (nodes.empty())
+    {
+        return;
+    }
+
+    Xoroshiro128PlusGenerator engine(seed);
+    boost::random::uniform_int_distribution<size_t> position(0, nodes.size() - 1);
+    std::generate(std::begin(output), std::end(output), [&]() { return nodes[position(engine)]; });
+}
+
+} // namespace snark
@@ -0,0 +1,36 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_NEGATIVE_SAMPLING_H
+#define SNARK_NEGATIVE_SAMPLING_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "partition.h"
+#include "types.h"
+
+namespace snark
+{
+
+// Upper bound of candidates drawn for a source before the rest of its negatives are set to the default node id.
+// Candidates are drawn uniformly from all nodes, so rejections are rare unless the source is connected to most of
+// the graph.
+size_t NegativeSampleAttempts(size_t count);
+
+// Upper bound of nodes drawn by a server for one request, clients split larger draws between rounds.
+constexpr uint32_t max_negative_draws = 1 << 20;
+
+// Check if candidate is the node with record index or connected to it by an edge of one of sorted and unique
+// edge_types. Sorted adjacency lists of every partition storing the node are searched.
+bool IsNeighbor(const PartitionList &partitions, std::span<const uint32_t> partitions_indices,
+                std::span<const uint64_t> internal_indices, std::span<const uint32_t> counts, uint64_t index,
+                NodeId node, NodeId candidate, std::span<const Type> edge_types);
+
+// Fill output with nodes drawn uniformly with replacement, the same seed gives the same nodes.
+void DrawNodes(uint64_t seed, std::span<const NodeId> nodes, std::span<NodeId> output);
+
+} // namespace snark
+
+#endif // SNARK_NEGATIVE_SAMPLING_H
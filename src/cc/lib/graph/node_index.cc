@@ -0,0 +1,260 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "node_index.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <numeric>
+#include <queue>
+#include <utility>
+
+#include "parallel.h"
+
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+
+namespace snark
+{
+
+NodeIndex::NodeIndex(std::vector<std::vector<NodeId>> partition_node_ids, std::vector<uint32_t> &partitions_indices,
+                     std::vector<uint64_t> &internal_indices, std::vector<uint32_t> &counts, bool compact)
+    : m_compact(compact)
+{
+    // Sort internal ids of every partition by node ids and merge them in a single list, partition order
+    // for duplicate nodes is preserved to keep results deterministic.
+    std::vector<std::vector<std::pair<NodeId, uint64_t>>> sorted(partition_node_ids.size());
+    parallel_for(partition_node_ids.size(), [&](size_t partition) {
+        auto &ids = partition_node_ids[partition];
+        auto &records = sorted[partition];
+        records.reserve(ids.size());
+        for (uint64_t internal_id = 0; internal_id < ids.size(); ++internal_id)
+        {
+            records.emplace_back(ids[internal_id], internal_id);
+        }
+        ids = {};
+        std::sort(std::begin(records), std::end(records));
+    });
+
+    size_t total = 0;
+    for (const auto &records : sorted)
+    {
+        total += records.size();
+    }
+    std::vector<NodeId> ids;
+    ids.reserve(total);
+    partitions_indices.reserve(total);
+    internal_indices.reserve(total);
+    counts.reserve(total);
+
+    using Cursor = std::pair<NodeId, uint32_t>;
+    std::priority_queue<Cursor, std::vector<Cursor>, std::greater<Cursor>> heads;
+    std::vector<size_t> positions(sorted.size(), 0);
+    for (uint32_t partition = 0; partition < sorted.size(); ++partition)
+    {
+        if (!sorted[partition].empty())
+        {
+            heads.emplace(sorted[partition].front().first, partition);
+        }
+    }
+    while (!heads.empty())
+    {
+        const auto [node, partition] = heads.top();
+        heads.pop();
+        const auto &records = sorted[partition];
+        auto &position = positions[partition];
+        ids.emplace_back(node);
+        internal_indices.emplace_back(records[position].second);
+        partitions_indices.emplace_back(partition);
+        if (++position < records.size())
+        {
+            heads.emplace(records[position].first, partition);
+        }
+    }
+    sorted.clear();
+
+    for (size_t start = 0; start < ids.size();)
+    {
+        size_t end = start + 1;
+        while (end < ids.size() && ids[end] == ids[start])
+        {
+            ++end;
+        }
+        std::fill_n(std::back_inserter(counts), end - start, uint32_t(end - start));
+        ++m_size;
+        start = end;
+    }
+
+    if (!m_compact)
+    {
+        m_map.reserve(m_size);
+        for (size_t position = 0; position < ids.size(); position += counts[position])
+        {
+            m_map.emplace(ids[position], position);
+        }
+        return;
+    }
+
+    if (ids.empty())
+    {
+        return;
+    }
+
+    // Pick bucket width to have on average at most 8 records per bucket if ids are distributed uniformly.
+    m_min = ids.front();
+    m_max = ids.back();
+    const uint64_t range = uint64_t(m_max) - uint64_t(m_min);
+    const uint64_t target_buckets = std::max<uint64_t>(1, ids.size() / 8);
+
+    // Ranges of hashed ids can span more than 2^63, shifts are capped to stay defined.
+    while (m_shift < 63 && (range >> m_shift) >= target_buckets)
+    {
+        ++m_shift;
+    }
+
+    const uint64_t bucket_count = (range >> m_shift) + 1;
+    std::vector<uint64_t> buckets;
+    buckets.reserve(bucket_count + 1);
+    uint64_t position = 0;
+    for (uint64_t bucket = 0; bucket <= bucket_count; ++bucket)
+    {
+        while (position < ids.size() && ((uint64_t(ids[position]) - uint64_t(m_min)) >> m_shift) < bucket)
+        {
+            ++position;
+        }
+        buckets.emplace_back(position);
+    }
+
+    m_ids = keep_buffer(std::move(ids), m_buffers);
+    m_buckets = keep_buffer(std::move(buckets), m_buffers);
+}
+
+NodeIndex::NodeIndex(const SharedIndex &shared) : m_compact(true)
+{
+    const auto header = shared.Map<uint64_t>("node_index_header", m_buffers);
+    if (header.size() != 4)
+    {
+        RAW_LOG_FATAL("Shared node index header is corrupted");
+    }
+
+    m_min = NodeId(header[0]);
+    m_max = NodeId(header[1]);
+    m_shift = uint32_t(header[2]);
+    m_size = size_t(header[3]);
+    m_ids = shared.Map<NodeId>("node_index_ids", m_buffers);
+    m_buckets = shared.Map<uint64_t>("node_index_buckets", m_buffers);
+}
+
+void NodeIndex::Publish(const SharedIndex &shared) const
+{
+    if (!m_compact)
+    {
+        RAW_LOG_FATAL("Only compact node index can be shared");
+    }
+
+    const uint64_t header[] = {uint64_t(m_min), uint64_t(m_max), m_shift, m_size};
+    shared.Publish<uint64_t>("node_index_header", header);
+    shared.Publish("node_index_ids", m_ids);
+    shared.Publish("node_index_buckets", m_buckets);
+}
+
+uint64_t NodeIndex::Find(NodeId node) const
+{
+    if (!m_compact)
+    {
+        auto it = m_map.find(node);
+        return it == std::end(m_map) ? npos : it->second;
+    }
+
+    if (node < m_min || node > m_max)
+    {
+        return npos;
+    }
+
+    const auto bucket = (uint64_t(node) - uint64_t(m_min)) >> m_shift;
+    uint64_t position = m_buckets[bucket];
+    uint64_t length = m_buckets[bucket + 1] - position;
+    if (length == 0)
+    {
+        return npos;
+    }
+
+    // Branchless binary search, buckets are short and comparisons are hard to predict.
+    while (length > 1)
+    {
+        const auto half = length / 2;
+        position = m_ids[position + half - 1] < node ? position + half : position;
+        length -= half;
+    }
+
+    return m_ids[position] == node ? position : npos;
+}
+
+void NodeIndex::Find(std::span<const NodeId> nodes, std::span<uint64_t> output) const
+{
+    assert(nodes.size() == output.size());
+    const size_t count = nodes.size();
+    if (!m_compact)
+    {
+        for (size_t index = 0; index < std::min(count, prefetch_distance); ++index)
+        {
+            m_map.prefetch(nodes[index]);
+        }
+        for (size_t index = 0; index < count; ++index)
+        {
+            if (index + prefetch_distance < count)
+            {
+                m_map.prefetch(nodes[index + prefetch_distance]);
+            }
+            output[index] = Find(nodes[index]);
+        }
+        return;
+    }
+
+    // Compact index has two dependent loads: bucket boundaries are prefetched twice as far ahead as the ids
+    // they point to.
+    auto bucket = [this](NodeId node) {
+        return node < m_min || node > m_max ? npos : (uint64_t(node) - uint64_t(m_min)) >> m_shift;
+    };
+    auto prefetch_bucket = [&](size_t index) {
+        if (index < count)
+        {
+            if (const auto b = bucket(nodes[index]); b != npos)
+            {
+                prefetch(&m_buckets[b]);
+            }
+        }
+    };
+    auto prefetch_ids = [&](size_t index) {
+        if (index < count)
+        {
+            if (const auto b = bucket(nodes[index]); b != npos && m_buckets[b] < m_ids.size())
+            {
+                prefetch(&m_ids[m_buckets[b]]);
+            }
+        }
+    };
+
+    for (size_t index = 0; index < std::min(count, 2 * prefetch_distance); ++index)
+    {
+        prefetch_bucket(index);
+    }
+    for (size_t index = 0; index < std::min(count, prefetch_distance); ++index)
+    {
+        prefetch_ids(index);
+    }
+    for (size_t index = 0; index < count; ++index)
+    {
+        prefetch_bucket(index + 2 * prefetch_distance);
+        prefetch_ids(index + prefetch_distance);
+        output[index] = Find(nodes[index]);
+    }
+}
+
+size_t NodeIndex::Size() const
+{
+    return m_size;
+}
+
+} // namespace snark
@@ -0,0 +1,109 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_NODE_INDEX_H
+#define SNARK_NODE_INDEX_H
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#endif
+
+#include "absl/container/flat_hash_map.h"
+
+#include "shared_index.h"
+#include "types.h"
+
+namespace snark
+{
+
+// Number of items ahead of the current one to prefetch memory for in batched lookups.
+constexpr size_t prefetch_distance = 8;
+
+// Hint the CPU to load the cache line with an address, used to overlap independent cache misses.
+inline void prefetch(const void *address)
+{
+#ifdef _MSC_VER
+    _mm_prefetch(static_cast<const char *>(address), _MM_HINT_T0);
+#else
+    __builtin_prefetch(address);
+#endif
+}
+
+// Static index from node ids to positions of node records. Records of all loaded partitions are sorted by
+// node id with records of the same node next to each other. By default positions are looked up in a hash map,
+// compact index finds them with a bucket lookup and a binary search in a short range of sorted ids instead:
+// it uses ~10 bytes per record compared to ~28 bytes for a hash map, but lookups are about 2x slower. Both keep
+// 16 bytes per record of partition and internal ids and counts, so totals are ~26 and ~44 bytes per record.
+class NodeIndex
+{
+  public:
+    static constexpr uint64_t npos = std::numeric_limits<uint64_t>::max();
+
+    NodeIndex() = default;
+
+    // Build index from node ids of every partition, where the position of a node in a partition list is its
+    // internal id. Output vectors are filled with a record for every node in a partition ordered by node id
+    // and then by partition. Counts contain the number of partitions storing the node.
+    NodeIndex(std::vector<std::vector<NodeId>> partition_node_ids, std::vector<uint32_t> &partitions_indices,
+              std::vector<uint64_t> &internal_indices, std::vector<uint32_t> &counts, bool compact);
+
+    // Map a compact index written with Publish.
+    explicit NodeIndex(const SharedIndex &shared);
+
+    // Write compact index to a shared index, hash maps can't be mapped by other processes.
+    void Publish(const SharedIndex &shared) const;
+
+    // Return position of the first record of a node or npos if the node is not present.
+    uint64_t Find(NodeId node) const;
+
+    // Find positions for a batch of nodes. Index memory of nodes prefetch_distance ahead is prefetched before
+    // the current node is resolved, so cache misses of different nodes overlap instead of following each other.
+    void Find(std::span<const NodeId> nodes, std::span<uint64_t> output) const;
+
+    // Number of unique nodes.
+    size_t Size() const;
+
+    // Call func for every unique node id, compact index visits nodes in ascending order.
+    template <typename F> void ForEach(F func) const
+    {
+        for (const auto &item : m_map)
+        {
+            func(item.first);
+        }
+        for (size_t i = 0; i < m_ids.size(); ++i)
+        {
+            if (i == 0 || m_ids[i] != m_ids[i - 1])
+            {
+                func(m_ids[i]);
+            }
+        }
+    }
+
+  private:
+    absl::flat_hash_map<NodeId, uint64_t> m_map;
+    bool m_compact = false;
+
+    // Sorted node ids for compact index.
+    std::span<const NodeId> m_ids;
+
+    // Records of nodes with ids in [m_min + (b << m_shift), m_min + ((b + 1) << m_shift)) are located between
+    // m_buckets[b] and m_buckets[b + 1].
+    std::span<const uint64_t> m_buckets;
+    NodeId m_min = 0;
+    NodeId m_max = -1;
+    uint32_t m_shift = 0;
+    size_t m_size = 0;
+
+    // Owners of memory referenced by spans above: vectors or mapped files.
+    std::vector<std::shared_ptr<const void>> m_buffers;
+};
+
+} // namespace snark
+
+#endif // SNARK_NODE_INDEX_H
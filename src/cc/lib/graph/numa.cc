@@ -0,0 +1,197 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef SNARK_PLATFORM_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+
+#include "parallel.h"
+
+namespace snark
+{
+namespace
+{
+#ifdef SNARK_PLATFORM_LINUX
+// Parse lists of processors like "0-3,8,10-11".
+std::vector<size_t> parse_cpu_list(const std::string &list)
+{
+    std::vector<size_t> cpus;
+    std::stringstream input(list);
+    std::string range;
+    while (std::getline(input, range, ','))
+    {
+        if (range.empty() || !std::isdigit(range.front()))
+        {
+            continue;
+        }
+
+        const auto dash = range.find('-');
+        const size_t first = std::stoul(range.substr(0, dash));
+        const size_t last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+        for (size_t cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.emplace_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+std::vector<NumaNode> detect_nodes()
+{
+    cpu_set_t available;
+    CPU_ZERO(&available);
+    if (sched_getaffinity(0, sizeof(available), &available) != 0)
+    {
+        return {};
+    }
+
+    std::vector<NumaNode> nodes;
+    std::error_code error;
+    for (const auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", error))
+    {
+        const auto name = entry.path().filename().string();
+        if (!name.starts_with("node") || name.size() == 4 || !std::isdigit(name[4]))
+        {
+            continue;
+        }
+
+        std::ifstream cpulist(entry.path() / "cpulist");
+        std::string list;
+        std::getline(cpulist, list);
+        NumaNode node{.m_id = std::stoul(name.substr(4))};
+        for (auto cpu : parse_cpu_list(list))
+        {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &available))
+            {
+                node.m_cpus.emplace_back(cpu);
+            }
+        }
+
+        if (!node.m_cpus.empty())
+        {
+            nodes.emplace_back(std::move(node));
+        }
+    }
+
+    std::sort(std::begin(nodes), std::end(nodes),
+              [](const NumaNode &left, const NumaNode &right) { return left.m_id < right.m_id; });
+    return nodes;
+}
+#endif
+} // namespace
+
+std::vector<NumaNode> numa_nodes()
+{
+    std::vector<NumaNode> nodes;
+#ifdef SNARK_PLATFORM_LINUX
+    nodes = detect_nodes();
+#endif
+    if (nodes.empty())
+    {
+        nodes.emplace_back();
+        nodes.back().m_cpus.resize(std::max(1u, std::thread::hardware_concurrency()));
+        for (size_t cpu = 0; cpu < nodes.back().m_cpus.size(); ++cpu)
+        {
+            nodes.back().m_cpus[cpu] = cpu;
+        }
+    }
+
+    return nodes;
+}
+
+bool pin_thread(const NumaNode &node)
+{
+#ifdef SNARK_PLATFORM_LINUX
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (auto cpu : node.m_cpus)
+    {
+        if (cpu < CPU_SETSIZE)
+        {
+            CPU_SET(cpu, &cpus);
+        }
+    }
+
+    if (const auto error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus); error != 0)
+    {
+        RAW_LOG_ERROR("Failed to pin thread to NUMA node %zu: %d", node.m_id, error);
+        return false;
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void numa_parallel_for(size_t count, std::span<const NumaNode> nodes, const std::function<void(size_t)> &func)
+{
+    if (nodes.empty())
+    {
+        parallel_for(count, func);
+        return;
+    }
+
+    // Indices of a node are taken in order by up to one thread per processor of the node.
+    std::vector<std::atomic<size_t>> next(nodes.size());
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    std::vector<std::thread> threads;
+    for (size_t node = 0; node < nodes.size() && node < count; ++node)
+    {
+        const size_t node_count = (count - node + nodes.size() - 1) / nodes.size();
+        const size_t thread_count = std::min(node_count, std::max<size_t>(1, nodes[node].m_cpus.size()));
+        for (size_t thread = 0; thread < thread_count; ++thread)
+        {
+            threads.emplace_back([&, node]() {
+                pin_thread(nodes[node]);
+                for (size_t index = node + next[node]++ * nodes.size(); index < count;
+                     index = node + next[node]++ * nodes.size())
+                {
+                    try
+                    {
+                        func(index);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard lock(error_mutex);
+                        if (!error)
+                        {
+                            error = std::current_exception();
+                        }
+                    }
+                }
+            });
+        }
+    }
+
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace snark
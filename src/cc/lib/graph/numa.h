@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_NUMA_H
+#define SNARK_NUMA_H
+
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace snark
+{
+
+struct NumaNode
+{
+    size_t m_id = 0;
+
+    // Processors of the node available to the process.
+    std::vector<size_t> m_cpus;
+};
+
+// NUMA nodes with processors the process can run on, detected from sysfs on Linux. Memory only nodes are skipped.
+// Other platforms and hosts without topology information get a single node with all processors.
+std::vector<NumaNode> numa_nodes();
+
+// Restrict the calling thread to processors of a node. Threads allocate memory on the node they run on by
+// default, so pinned threads keep both their data and computations local. Returns false if the thread can't be
+// pinned, e.g. on platforms other than Linux.
+bool pin_thread(const NumaNode &node);
+
+// Call func for every index in [0, count) on a thread pinned to node index % nodes.size() and wait for all calls to
+// finish. Every node runs at most one thread per processor of the node. The first exception thrown by func is
+// rethrown to the caller after all threads are joined.
+void numa_parallel_for(size_t count, std::span<const NumaNode> nodes, const std::function<void(size_t)> &func);
+
+} // namespace snark
+
+#endif // SNARK_NUMA_H
@@ -0,0 +1,203 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace snark
+{
+
+void parallel_for(size_t count, const std::function<void(size_t)> &func)
+{
+    parallel_for(count, std::max(1u, std::thread::hardware_concurrency()), func);
+}
+
+void parallel_for(size_t count, size_t thread_count, const std::function<void(size_t)> &func)
+{
+    thread_count = std::min(count, thread_count);
+    if (thread_count <= 1)
+    {
+        for (size_t index = 0; index < count; ++index)
+        {
+            func(index);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next = 0;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    auto worker = [&]() {
+        for (size_t index = next++; index < count; index = next++)
+        {
+            try
+            {
+                func(index);
+            }
+            catch (...)
+            {
+                std::lock_guard lock(error_mutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+ThreadPool::ThreadPool(size_t thread_count, std::function<void()> init)
+{
+    for (size_t i = 1; i < thread_count; ++i)
+    {
+        m_threads.emplace_back([this, init]() { Run(init); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto &t : m_threads)
+    {
+        t.join();
+    }
+}
+
+size_t ThreadPool::Size() const
+{
+    return m_threads.size() + 1;
+}
+
+void ThreadPool::Run(const std::function<void()> &init)
+{
+    if (init)
+    {
+        init();
+    }
+
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock lock(m_mutex);
+            m_condition.wait(lock, [this] { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty())
+            {
+                return;
+            }
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    if (m_threads.empty())
+    {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_tasks.emplace_back(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t chunk_size, const std::function<void(size_t, size_t)> &func)
+{
+    chunk_size = std::max<size_t>(1, chunk_size);
+    const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+    if (chunk_count <= 1 || m_threads.empty())
+    {
+        for (size_t begin = 0; begin < count; begin += chunk_size)
+        {
+            func(begin, std::min(count, begin + chunk_size));
+        }
+        return;
+    }
+
+    // Workers may pick up a task after all chunks are done, so the loop state outlives the call.
+    struct Loop
+    {
+        std::atomic<size_t> m_next = 0;
+        size_t m_completed = 0;
+        std::exception_ptr m_error;
+        std::mutex m_mutex;
+        std::condition_variable m_done;
+    };
+    auto loop = std::make_shared<Loop>();
+    auto work = [loop, count, chunk_size, chunk_count, &func]() {
+        for (size_t chunk = loop->m_next++; chunk < chunk_count; chunk = loop->m_next++)
+        {
+            std::exception_ptr error;
+            try
+            {
+                func(chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            std::lock_guard lock(loop->m_mutex);
+            if (error && !loop->m_error)
+            {
+                loop->m_error = error;
+            }
+            if (++loop->m_completed == chunk_count)
+            {
+                loop->m_done.notify_all();
+            }
+        }
+    };
+
+    {
+        std::lock_guard lock(m_mutex);
+        for (size_t i = 1; i < std::min(Size(), chunk_count); ++i)
+        {
+            m_tasks.emplace_back(work);
+        }
+    }
+    m_condition.notify_all();
+    work();
+
+    std::unique_lock lock(loop->m_mutex);
+    loop->m_done.wait(lock, [&loop, chunk_count] { return loop->m_completed == chunk_count; });
+    if (loop->m_error)
+    {
+        std::rethrow_exception(loop->m_error);
+    }
+}
+
+} // namespace snark
@@ -0,0 +1,69 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_PARALLEL_H
+#define SNARK_PARALLEL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace snark
+{
+
+// Call func for every index in [0, count) on up to hardware_concurrency threads and wait for all calls to finish.
+// The first exception thrown by func is rethrown to the caller after all threads are joined.
+void parallel_for(size_t count, const std::function<void(size_t)> &func);
+
+// Same as above with up to thread_count threads, e.g. for IO bound calls.
+void parallel_for(size_t count, size_t thread_count, const std::function<void(size_t)> &func);
+
+struct ThreadPoolConfig
+{
+    // Number of threads processing a batch including the calling one, 1 processes batches sequentially.
+    size_t m_thread_count = 1;
+
+    // Batches are split in chunks of at least this many items.
+    size_t m_min_chunk_size = 1024;
+};
+
+// Persistent threads to split large batches between. Chunks are taken in order by whichever thread is idle,
+// including the calling thread, so nested loops and busy workers can't block a caller.
+class ThreadPool
+{
+  public:
+    // Start thread_count - 1 worker threads, every worker calls init before processing tasks, e.g. to pin itself.
+    explicit ThreadPool(size_t thread_count, std::function<void()> init = {});
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Number of threads including the calling one.
+    size_t Size() const;
+
+    // Call func(begin, end) for consecutive chunks of chunk_size items covering [0, count) and wait for all of
+    // them to finish. The first exception thrown by func is rethrown after all chunks are processed.
+    void ParallelFor(size_t count, size_t chunk_size, const std::function<void(size_t, size_t)> &func);
+
+    // Run a task on one of the worker threads without waiting for it, tasks without workers run on the calling
+    // thread. Pending tasks are finished before the pool is destroyed.
+    void Submit(std::function<void()> task);
+
+  private:
+    void Run(const std::function<void()> &init);
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+};
+
+} // namespace snark
+
+#endif // SNARK_PARALLEL_H
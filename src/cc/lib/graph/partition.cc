@@ -1,17 +1,21 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 #include <algorithm>
+#include <bit>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
 #include <limits>
+#include <numeric>
 #include <string>
+#include <tuple>
 
 #include "boost/random/binomial_distribution.hpp"
 #include "boost/random/uniform_real_distribution.hpp"
 #include "locator.h"
 #include "partition.h"
 #include "sampler.h"
+#include "uniform.h"
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 namespace snark
@@ -25,29 +29,65 @@ struct EdgeRecord
     Type m_type;
     float m_weight;
 };
+
+// Compressed runs up to this size are decoded once for sampling instead of decoding every sampled edge.
+constexpr size_t decoded_run_limit = 8 * CompressedAdjacency::block_size;
+
+// Edge types of a node are kept in a 64 bit mask if every type of the partition is below this value.
+constexpr Type edge_type_mask_bits = 64;
 } // namespace
-Partition::Partition(std::filesystem::path path, std::string suffix, PartitionStorageType storage_type)
-    : m_metadata(path), m_storage_type(storage_type)
+Partition::Partition(std::filesystem::path path, std::string suffix, PartitionStorageType storage_type,
+                     std::shared_ptr<FeatureCache> feature_cache, bool compressed_edges, size_t alias_threshold,
+                     std::vector<FeatureId> columnar_features, const SharedIndex *shared_index,
+                     size_t edge_index_threshold, HDFSReadOptions hdfs_read)
+    : m_use_compressed_edges(compressed_edges), m_metadata(path), m_storage_type(storage_type),
+      m_feature_cache(std::move(feature_cache))
 {
-    ReadNodeMap(path, suffix);
+    m_metadata.m_hdfs_read = hdfs_read;
+    if (shared_index != nullptr && m_use_compressed_edges)
+    {
+        RAW_LOG_FATAL("Compressed edges can't be shared between processes");
+    }
+
     ReadNodeFeatures(path, suffix);
-    ReadEdges(std::move(path), std::move(suffix));
-}
-void Partition::ReadNodeMap(std::filesystem::path path, std::string suffix)
-{
-    std::shared_ptr<BaseStorage<uint8_t>> node_map;
-    if (!is_hdfs_path(path))
+    if (shared_index != nullptr && shared_index->Attached())
     {
-        node_map = std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), open_node_map);
+        ReadEdgeFeatures(std::move(path), suffix);
+        Attach(*shared_index, suffix);
+        if (edge_index_threshold > 0)
+        {
+            BuildEdgeIndex(edge_index_threshold);
+        }
+        return;
     }
-    else
+
+    ReadNodeMap(path, suffix);
+    if (!columnar_features.empty())
+    {
+        BuildFeatureColumns(columnar_features);
+    }
+    ReadEdges(std::move(path), suffix);
+    BuildEdgeTypeMasks();
+    if (alias_threshold > 0)
+    {
+        BuildAliasTables(alias_threshold);
+    }
+    if (edge_index_threshold > 0)
     {
-        auto full_path = path / ("node_" + suffix + ".map");
-        node_map = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path);
+        BuildEdgeIndex(edge_index_threshold);
     }
+    if (shared_index != nullptr)
+    {
+        Publish(*shared_index, suffix);
+    }
+}
+void Partition::ReadNodeMap(std::filesystem::path path, std::string suffix)
+{
+    auto node_map = OpenFile(path, suffix, open_node_map, "node_" + suffix + ".map");
     auto node_map_ptr = node_map->start();
     size_t size = node_map->size() / 20;
-    m_node_types.reserve(size);
+    std::vector<Type> node_types;
+    node_types.reserve(size);
     for (size_t i = 0; i < size; ++i)
     {
         uint64_t pair[2];
@@ -60,13 +100,18 @@ void Partition::ReadNodeMap(std::filesystem::path path, std::string suffix)
         {
             RAW_LOG_FATAL("Failed to read node type in a node maping");
         }
-        m_node_types.emplace_back(node_type);
+        node_types.emplace_back(node_type);
     }
+    m_node_types = keep_buffer(std::move(node_types), m_index_buffers);
 }
 void Partition::ReadEdges(std::filesystem::path path, std::string suffix)
 {
-    ReadNeighborsIndex(path, suffix);
-    ReadEdgeIndex(path, suffix);
+    auto neighbors_index = ReadNeighborsIndex(path, suffix);
+    ReadEdgeIndex(path, suffix, std::move(neighbors_index));
+    ReadEdgeFeatures(std::move(path), std::move(suffix));
+}
+void Partition::ReadEdgeFeatures(std::filesystem::path path, std::string suffix)
+{
     if (m_metadata.m_edge_feature_count > 0)
     {
         ReadEdgeFeaturesIndex(path, suffix);
@@ -77,49 +122,44 @@ void Partition::ReadEdges(std::filesystem::path path, std::string suffix)
         m_edge_features = std::make_shared<MemoryStorage<uint8_t>>(path, suffix, nullptr);
     }
 }
-void Partition::ReadNeighborsIndex(std::filesystem::path path, std::string suffix)
+std::vector<uint64_t> Partition::ReadNeighborsIndex(std::filesystem::path path, std::string suffix)
 {
-    std::shared_ptr<BaseStorage<uint8_t>> neighbors_index;
-    if (!is_hdfs_path(path))
-    {
-        neighbors_index =
-            std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), open_neighbor_index);
-    }
-    else
-    {
-        auto full_path = path / ("neighbors_" + suffix + ".index");
-        neighbors_index = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path);
-    }
+    // Neighbors index is rewritten in ReadEdgeIndex, so we always keep a copy in memory.
+    auto neighbors_index = OpenFile(path, suffix, open_neighbor_index, "neighbors_" + suffix + ".index");
     auto neighbors_index_ptr = neighbors_index->start();
     size_t size_64 = neighbors_index->size() / 8;
-    m_neighbors_index.resize(size_64);
-    if (size_64 != neighbors_index->read(m_neighbors_index.data(), 8, size_64, neighbors_index_ptr))
+    std::vector<uint64_t> result(size_64);
+    if (size_64 != neighbors_index->read(result.data(), 8, size_64, neighbors_index_ptr))
     {
         RAW_LOG_FATAL("Failed to read neighbor index file");
     }
+    return result;
 }
-void Partition::ReadEdgeIndex(std::filesystem::path path, std::string suffix)
+void Partition::ReadEdgeIndex(std::filesystem::path path, std::string suffix, std::vector<uint64_t> neighbors_index)
 {
     assert(sizeof(EdgeRecord) == (sizeof(NodeId) + sizeof(uint64_t) + sizeof(Type) + sizeof(float)));
-    std::shared_ptr<BaseStorage<uint8_t>> edge_index;
-    if (!is_hdfs_path(path))
-    {
-        edge_index = std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), open_edge_index);
-    }
-    else
-    {
-        auto full_path = path / ("edge_" + suffix + ".index");
-        edge_index = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path);
-    }
+    // Edge records are converted to per type destinations and cumulative weights, so the
+    // data is copied regardless of storage type, mmap avoids a syscall per record.
+    auto edge_index = OpenFile(path, suffix, open_edge_index, "edge_" + suffix + ".index");
     auto edge_index_ptr = edge_index->start();
     size_t num_edges = edge_index->size() / sizeof(EdgeRecord);
-    m_edge_weights.reserve(num_edges);
+    std::vector<Type> edge_types;
+    std::vector<uint64_t> edge_type_offset;
+    std::vector<NodeId> edge_destination;
+    std::vector<float> edge_weights;
+    std::vector<uint64_t> edge_feature_offset;
+    if (!m_use_compressed_edges)
+    {
+        edge_destination.reserve(num_edges);
+        edge_weights.reserve(num_edges);
+    }
+    size_t edge_count = 0;
     size_t next = 1;
-    for (size_t curr_src = 0; next < m_neighbors_index.size(); ++curr_src, ++next)
+    for (size_t curr_src = 0; next < neighbors_index.size(); ++curr_src, ++next)
     {
-        size_t start_offset = m_neighbors_index[curr_src];
-        size_t end_offset = m_neighbors_index[next];
-        m_neighbors_index[curr_src] = m_edge_types.size();
+        size_t start_offset = neighbors_index[curr_src];
+        size_t end_offset = neighbors_index[next];
+        neighbors_index[curr_src] = edge_types.size();
         size_t nb_count = end_offset - start_offset;
         if (nb_count == 0)
         {
@@ -135,19 +175,28 @@ void Partition::ReadEdgeIndex(std::filesystem::path path, std::string suffix)
             {
                 RAW_LOG_FATAL("Failed to read edge index file");
             }
-            if (edge.m_type != curr_type)
+            const bool run_start = edge.m_type != curr_type;
+            if (run_start)
             {
                 curr_type = edge.m_type;
-                m_edge_types.emplace_back(curr_type);
-                m_edge_type_offset.emplace_back(m_edge_destination.size());
+                edge_types.emplace_back(curr_type);
+                edge_type_offset.emplace_back(edge_count);
                 acc_weight = 0;
             }
-            m_edge_destination.push_back(edge.m_dst);
-            acc_weight += edge.m_weight;
-            m_edge_weights.push_back(acc_weight);
+            ++edge_count;
+            if (m_use_compressed_edges)
+            {
+                m_compressed_edges.Append(edge.m_dst, edge.m_weight, run_start);
+            }
+            else
+            {
+                edge_destination.push_back(edge.m_dst);
+                acc_weight += edge.m_weight;
+                edge_weights.push_back(acc_weight);
+            }
             if (m_metadata.m_edge_feature_count > 0)
             {
-                m_edge_feature_offset.push_back(edge.m_feature_offset);
+                edge_feature_offset.push_back(edge.m_feature_offset);
             }
         }
     }
@@ -157,67 +206,254 @@ void Partition::ReadEdgeIndex(std::filesystem::path path, std::string suffix)
         RAW_LOG_FATAL("Failed to read edge index file");
     }
     // Extra padding to simplify edge type count calculations.
-    m_neighbors_index.back() = m_edge_types.size();
-    m_edge_types.push_back(edge.m_type);
-    m_edge_type_offset.push_back(m_edge_destination.size());
-    m_edge_destination.push_back(edge.m_dst);
+    neighbors_index.back() = edge_types.size();
+    edge_types.push_back(edge.m_type);
+    edge_type_offset.push_back(edge_count);
+    if (m_use_compressed_edges)
+    {
+        m_compressed_edges.Append(edge.m_dst, edge.m_weight, true);
+        m_compressed_edges.Finish();
+    }
+    else
+    {
+        edge_destination.push_back(edge.m_dst);
+    }
     if (m_metadata.m_edge_feature_count > 0)
     {
-        m_edge_feature_offset.push_back(edge.m_feature_offset);
+        edge_feature_offset.push_back(edge.m_feature_offset);
     }
+
+    m_neighbors_index = keep_buffer(std::move(neighbors_index), m_index_buffers);
+    m_edge_types = keep_buffer(std::move(edge_types), m_index_buffers);
+    m_edge_type_offset = keep_buffer(std::move(edge_type_offset), m_index_buffers);
+    m_edge_destination = keep_buffer(std::move(edge_destination), m_index_buffers);
+    m_edge_weights = keep_buffer(std::move(edge_weights), m_index_buffers);
+    m_edge_feature_offset = keep_buffer(std::move(edge_feature_offset), m_index_buffers);
 }
-void Partition::ReadNodeFeatures(std::filesystem::path path, std::string suffix)
+
+void Partition::BuildAliasTables(size_t alias_threshold)
 {
-    ReadNodeIndex(path, suffix);
-    if (m_metadata.m_node_feature_count == 0)
+    std::vector<float> weight_sums;
+    std::vector<double> scaled;
+    std::vector<uint32_t> small;
+    std::vector<uint32_t> large;
+    std::vector<AliasColumn> alias_table;
+
+    // The last run is a padding for edge type count calculations.
+    for (size_t run = 0; run + 1 < m_edge_types.size(); ++run)
+    {
+        const auto first = m_edge_type_offset[run];
+        const size_t size = m_edge_type_offset[run + 1] - first;
+        if (size < alias_threshold)
+        {
+            continue;
+        }
+
+        weight_sums.clear();
+        if (m_use_compressed_edges)
+        {
+            m_compressed_edges.WeightSums(first, first + size, weight_sums);
+        }
+        else
+        {
+            weight_sums.assign(std::begin(m_edge_weights) + first, std::begin(m_edge_weights) + first + size);
+        }
+        const double total_weight = weight_sums.back();
+        if (!(total_weight > 0))
+        {
+            continue;
+        }
+
+        const auto offset = alias_table.size();
+        m_alias_offsets.emplace(run, offset);
+        alias_table.resize(offset + size);
+        auto table = std::span(alias_table).subspan(offset, size);
+        scaled.resize(size);
+        small.clear();
+        large.clear();
+        for (uint32_t index = 0; index < size; ++index)
+        {
+            const double weight = index == 0 ? weight_sums[0] : weight_sums[index] - weight_sums[index - 1];
+            scaled[index] = weight * size / total_weight;
+            table[index] = AliasColumn{.m_probability = 1.0f, .m_alias = index};
+            (scaled[index] < 1 ? small : large).emplace_back(index);
+        }
+
+        // Pair every underfull column with an overfull one, columns left after that are full up to rounding.
+        while (!small.empty() && !large.empty())
+        {
+            const auto less = small.back();
+            const auto more = large.back();
+            small.pop_back();
+            table[less] = AliasColumn{.m_probability = float(scaled[less]), .m_alias = more};
+            scaled[more] -= 1 - scaled[less];
+            if (scaled[more] < 1)
+            {
+                large.pop_back();
+                small.emplace_back(more);
+            }
+        }
+    }
+
+    m_alias_table = keep_buffer(std::move(alias_table), m_index_buffers);
+}
+
+void Partition::Publish(const SharedIndex &shared_index, const std::string &suffix) const
+{
+    shared_index.Publish(suffix + "_node_types", m_node_types);
+    shared_index.Publish(suffix + "_neighbors_index", m_neighbors_index);
+    shared_index.Publish(suffix + "_edge_types", m_edge_types);
+    shared_index.Publish(suffix + "_edge_type_offset", m_edge_type_offset);
+    shared_index.Publish(suffix + "_edge_destination", m_edge_destination);
+    shared_index.Publish(suffix + "_edge_weights", m_edge_weights);
+    shared_index.Publish(suffix + "_edge_feature_offset", m_edge_feature_offset);
+    shared_index.Publish(suffix + "_edge_type_masks", m_edge_type_masks);
+
+    // Hash maps are published as pairs of keys and values.
+    std::vector<uint64_t> alias_runs;
+    for (const auto &[run, offset] : m_alias_offsets)
+    {
+        alias_runs.emplace_back(run);
+        alias_runs.emplace_back(offset);
+    }
+    shared_index.Publish<uint64_t>(suffix + "_alias_runs", alias_runs);
+    shared_index.Publish(suffix + "_alias_table", m_alias_table);
+
+    std::vector<uint64_t> columns;
+    for (const auto &[feature, column] : m_feature_columns)
+    {
+        const auto name = suffix + "_column_" + std::to_string(feature);
+        columns.emplace_back(feature);
+        columns.emplace_back(column.m_size);
+        shared_index.Publish(name + "_values", column.m_values);
+        shared_index.Publish(name + "_present", column.m_present);
+    }
+    shared_index.Publish<uint64_t>(suffix + "_columns", columns);
+}
+
+void Partition::Attach(const SharedIndex &shared_index, const std::string &suffix)
+{
+    m_node_types = shared_index.Map<Type>(suffix + "_node_types", m_index_buffers);
+    m_neighbors_index = shared_index.Map<uint64_t>(suffix + "_neighbors_index", m_index_buffers);
+    m_edge_types = shared_index.Map<Type>(suffix + "_edge_types", m_index_buffers);
+    m_edge_type_offset = shared_index.Map<uint64_t>(suffix + "_edge_type_offset", m_index_buffers);
+    m_edge_destination = shared_index.Map<NodeId>(suffix + "_edge_destination", m_index_buffers);
+    m_edge_weights = shared_index.Map<float>(suffix + "_edge_weights", m_index_buffers);
+    m_edge_feature_offset = shared_index.Map<uint64_t>(suffix + "_edge_feature_offset", m_index_buffers);
+    m_edge_type_masks = shared_index.Map<uint64_t>(suffix + "_edge_type_masks", m_index_buffers);
+
+    const auto alias_runs = shared_index.Map<uint64_t>(suffix + "_alias_runs", m_index_buffers);
+    for (size_t index = 0; index + 1 < alias_runs.size(); index += 2)
     {
-        // It's ok to miss files if there are no features.
-        m_node_features = std::make_shared<MemoryStorage<uint8_t>>(path, suffix, nullptr);
-        return;
+        m_alias_offsets.emplace(alias_runs[index], alias_runs[index + 1]);
+    }
+    m_alias_table = shared_index.Map<AliasColumn>(suffix + "_alias_table", m_index_buffers);
+
+    const auto columns = shared_index.Map<uint64_t>(suffix + "_columns", m_index_buffers);
+    for (size_t index = 0; index + 1 < columns.size(); index += 2)
+    {
+        const auto name = suffix + "_column_" + std::to_string(columns[index]);
+        auto &column = m_feature_columns[FeatureId(columns[index])];
+        column.m_size = FeatureSize(columns[index + 1]);
+        column.m_values = shared_index.Map<uint8_t>(name + "_values", m_index_buffers);
+        column.m_present = shared_index.Map<uint64_t>(name + "_present", m_index_buffers);
     }
-    ReadNodeFeaturesIndex(path, suffix);
-    ReadNodeFeaturesData(path, suffix);
 }
-void Partition::ReadNodeIndex(std::filesystem::path path, std::string suffix)
+
+NodeId Partition::EdgeDestination(size_t position) const
 {
-    std::shared_ptr<BaseStorage<uint8_t>> node_index;
-    if (!is_hdfs_path(path))
+    return m_use_compressed_edges ? m_compressed_edges.Destination(position) : m_edge_destination[position];
+}
+
+float Partition::EdgeWeightSum(size_t run_first, size_t position) const
+{
+    return m_use_compressed_edges ? m_compressed_edges.WeightSum(run_first, position) : m_edge_weights[position];
+}
+
+float Partition::RunWeightSum(size_t run) const
+{
+    return m_use_compressed_edges ? m_run_weight_sums[run] : m_edge_weights[m_edge_type_offset[run + 1] - 1];
+}
+
+bool Partition::HasEdgeType(uint64_t mask, Type type)
+{
+    return type >= 0 && type < edge_type_mask_bits && ((mask >> type) & 1) != 0;
+}
+
+size_t Partition::MaskedEdgeRun(uint64_t internal_id, uint64_t mask, Type type) const
+{
+    // Runs of a node are sorted by type, so the run of a type follows runs of the types present before it.
+    return m_neighbors_index[internal_id] + std::popcount(mask & ((uint64_t(1) << type) - 1));
+}
+
+float Partition::EdgeWeight(size_t run_first, size_t position) const
+{
+    const auto weight_sum = EdgeWeightSum(run_first, position);
+    return position == run_first ? weight_sum : weight_sum - EdgeWeightSum(run_first, position - 1);
+}
+
+size_t Partition::FindEdgeDestination(size_t first, size_t last, NodeId value) const
+{
+    if (m_use_compressed_edges)
     {
-        node_index = std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), open_node_index);
+        return m_compressed_edges.FindDestination(first, last, value);
     }
-    else
+
+    const auto begin = std::begin(m_edge_destination);
+    return std::lower_bound(begin + first, begin + last, value) - begin;
+}
+
+std::span<const NodeId> Partition::RunDestinations(size_t first, size_t last, std::vector<NodeId> &buffer) const
+{
+    if (!m_use_compressed_edges)
     {
-        auto full_path = path / ("node_" + suffix + ".index");
-        node_index = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path);
+        return std::span(m_edge_destination).subspan(first, last - first);
     }
-    auto node_index_ptr = node_index->start();
-    size_t size = node_index->size() / 8;
-    m_node_index.resize(size);
-    if (size != node_index->read(m_node_index.data(), 8, size, node_index_ptr))
+    if (last - first > decoded_run_limit)
     {
-        RAW_LOG_FATAL("Failed to read node index file");
+        return {};
     }
+
+    buffer.clear();
+    m_compressed_edges.Destinations(first, last, buffer);
+    return buffer;
 }
-void Partition::ReadNodeFeaturesIndex(std::filesystem::path path, std::string suffix)
+
+std::span<const float> Partition::RunWeightSums(size_t first, size_t last, std::vector<float> &buffer) const
 {
-    std::shared_ptr<BaseStorage<uint8_t>> node_features_index;
-    if (!is_hdfs_path(path))
+    if (!m_use_compressed_edges)
     {
-        node_features_index =
-            std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), open_node_features_index);
+        return std::span(m_edge_weights).subspan(first, last - first);
     }
-    else
+    if (last - first > decoded_run_limit)
     {
-        auto full_path = path / ("node_features_" + suffix + ".index");
-        node_features_index = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path);
+        return {};
     }
-    auto node_features_index_ptr = node_features_index->start();
-    size_t size = node_features_index->size() / 8;
-    m_node_feature_index.resize(size);
-    if (size != node_features_index->read(m_node_feature_index.data(), 8, size, node_features_index_ptr))
+
+    buffer.clear();
+    m_compressed_edges.WeightSums(first, last, buffer);
+    return buffer;
+}
+void Partition::ReadNodeFeatures(std::filesystem::path path, std::string suffix)
+{
+    ReadNodeIndex(path, suffix);
+    if (m_metadata.m_node_feature_count == 0)
     {
-        RAW_LOG_FATAL("Failed to read node feature index file");
+        // It's ok to miss files if there are no features.
+        m_node_features = std::make_shared<MemoryStorage<uint8_t>>(path, suffix, nullptr);
+        return;
     }
+    ReadNodeFeaturesIndex(path, suffix);
+    ReadNodeFeaturesData(path, suffix);
+}
+void Partition::ReadNodeIndex(std::filesystem::path path, std::string suffix)
+{
+    m_node_index = ReadIndexFile(path, suffix, open_node_index, "node_" + suffix + ".index");
+}
+void Partition::ReadNodeFeaturesIndex(std::filesystem::path path, std::string suffix)
+{
+    m_node_feature_index =
+        ReadIndexFile(path, suffix, open_node_features_index, "node_features_" + suffix + ".index");
 }
 void Partition::ReadNodeFeaturesData(std::filesystem::path path, std::string suffix)
 {
@@ -225,7 +461,8 @@ void Partition::ReadNodeFeaturesData(std::filesystem::path path, std::string suf
     {
         auto full_path = path / ("node_features_" + suffix + ".data");
         m_node_features = std::make_shared<HDFSStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path,
-                                                                 std::move(suffix), &open_node_features_data);
+                                                                 std::move(suffix), &open_node_features_data,
+                                                                 m_metadata.m_hdfs_read);
     }
     else if (m_storage_type == PartitionStorageType::memory)
     {
@@ -236,37 +473,155 @@ void Partition::ReadNodeFeaturesData(std::filesystem::path path, std::string suf
     {
         m_node_features =
             std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), &open_node_features_data);
+        if (m_feature_cache != nullptr)
+        {
+            m_node_features = std::make_shared<CachedStorage<uint8_t>>(std::move(m_node_features), m_feature_cache);
+        }
+    }
+    else if (m_storage_type == PartitionStorageType::mmap)
+    {
+        m_node_features =
+            std::make_shared<MmapStorage<uint8_t>>(std::move(path), std::move(suffix), &open_node_features_data);
     }
 }
-void Partition::ReadEdgeFeaturesIndex(std::filesystem::path path, std::string suffix)
+
+void Partition::BuildEdgeTypeMasks()
 {
-    std::shared_ptr<BaseStorage<uint8_t>> edge_features_index;
-    if (!is_hdfs_path(path))
+    if (m_use_compressed_edges)
     {
-        edge_features_index =
-            std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), open_edge_features_index);
+        // The last run is a padding for edge type count calculations.
+        std::vector<float> weight_sums(m_edge_types.empty() ? 0 : m_edge_types.size() - 1);
+        for (size_t run = 0; run < weight_sums.size(); ++run)
+        {
+            weight_sums[run] = m_compressed_edges.WeightSum(m_edge_type_offset[run], m_edge_type_offset[run + 1] - 1);
+        }
+        m_run_weight_sums = keep_buffer(std::move(weight_sums), m_index_buffers);
     }
-    else
+
+    std::vector<uint64_t> masks(m_neighbors_index.empty() ? 0 : m_neighbors_index.size() - 1);
+    for (size_t node = 0; node < masks.size(); ++node)
     {
-        auto full_path = path / ("edge_features_" + suffix + ".index");
-        edge_features_index = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path);
+        for (auto run = m_neighbors_index[node]; run < m_neighbors_index[node + 1]; ++run)
+        {
+            const auto type = m_edge_types[run];
+            // Masks can't locate runs of large or unsorted types, lists are searched for every node then.
+            if (type < 0 || type >= edge_type_mask_bits || (masks[node] >> type) != 0)
+            {
+                return;
+            }
+            masks[node] |= uint64_t(1) << type;
+        }
     }
-    auto edge_features_index_ptr = edge_features_index->start();
-    size_t size = edge_features_index->size();
-    size_t size_64 = size / 8;
-    m_edge_feature_index.resize(size_64);
-    if (size != edge_features_index->read(m_edge_feature_index.data(), 1, size, edge_features_index_ptr))
+    m_edge_type_masks = keep_buffer(std::move(masks), m_index_buffers);
+}
+
+void Partition::BuildEdgeIndex(size_t edge_index_threshold)
+{
+    m_edge_index_threshold = edge_index_threshold;
+    std::vector<NodeId> buffer;
+
+    // The last run is a padding for edge type count calculations.
+    for (size_t run = 0; run + 1 < m_edge_types.size(); ++run)
     {
-        RAW_LOG_FATAL("Failed to read node feature index file");
+        const auto first = m_edge_type_offset[run];
+        const auto last = m_edge_type_offset[run + 1];
+        if (last - first < edge_index_threshold)
+        {
+            continue;
+        }
+
+        std::span<const NodeId> destinations;
+        if (m_use_compressed_edges)
+        {
+            buffer.clear();
+            m_compressed_edges.Destinations(first, last, buffer);
+            destinations = buffer;
+        }
+        else
+        {
+            destinations = m_edge_destination.subspan(first, last - first);
+        }
+
+        // Keep the first of parallel edges to match searches in the run.
+        for (size_t position = 0; position < destinations.size(); ++position)
+        {
+            m_edge_index.try_emplace(std::pair(uint64_t(run), destinations[position]), first + position);
+        }
+    }
+}
+
+void Partition::BuildFeatureColumns(std::span<const FeatureId> features)
+{
+    if (m_node_feature_index.empty())
+    {
+        return;
+    }
+
+    const size_t node_count = m_node_types.size();
+    for (const auto feature : features)
+    {
+        if (feature < 0 || m_feature_columns.contains(feature))
+        {
+            continue;
+        }
+
+        auto stored_range = [this, feature](uint64_t internal_id) {
+            const auto feature_index_offset = m_node_index[internal_id];
+            if (!HasNodeFeatures(internal_id) ||
+                m_node_index[internal_id + 1] - feature_index_offset <= uint64_t(feature))
+            {
+                return std::pair<uint64_t, uint64_t>(0, 0);
+            }
+
+            const auto data_offset = m_node_feature_index[feature_index_offset + feature];
+            return std::pair(data_offset, m_node_feature_index[feature_index_offset + feature + 1] - data_offset);
+        };
+
+        uint64_t column_size = 0;
+        for (uint64_t internal_id = 0; internal_id < node_count; ++internal_id)
+        {
+            column_size = std::max(column_size, stored_range(internal_id).second);
+        }
+        if (column_size == 0 || column_size > std::numeric_limits<FeatureSize>::max())
+        {
+            continue;
+        }
+
+        auto &column = m_feature_columns[feature];
+        column.m_size = FeatureSize(column_size);
+        std::vector<uint8_t> values(node_count * column_size);
+        std::vector<uint64_t> present((node_count + 63) / 64);
+        std::vector<FileRange> ranges;
+        for (uint64_t internal_id = 0; internal_id < node_count; ++internal_id)
+        {
+            const auto [data_offset, stored_size] = stored_range(internal_id);
+            if (stored_size == 0)
+            {
+                continue;
+            }
+
+            present[internal_id / 64] |= uint64_t(1) << (internal_id % 64);
+            auto *output = values.data() + internal_id * column_size;
+            ranges.emplace_back(FileRange{.offset = data_offset, .size = stored_size, .output = output});
+        }
+        m_node_features->read_batch(ranges);
+        column.m_values = keep_buffer(std::move(values), m_index_buffers);
+        column.m_present = keep_buffer(std::move(present), m_index_buffers);
     }
 }
+void Partition::ReadEdgeFeaturesIndex(std::filesystem::path path, std::string suffix)
+{
+    m_edge_feature_index =
+        ReadIndexFile(path, suffix, open_edge_features_index, "edge_features_" + suffix + ".index");
+}
 void Partition::ReadEdgeFeaturesData(std::filesystem::path path, std::string suffix)
 {
     if (is_hdfs_path(path))
     {
         auto full_path = path / ("edge_features_" + suffix + ".data");
         m_edge_features = std::make_shared<HDFSStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path,
-                                                                 std::move(suffix), &open_edge_features_data);
+                                                                 std::move(suffix), &open_edge_features_data,
+                                                                 m_metadata.m_hdfs_read);
     }
     else if (m_storage_type == PartitionStorageType::memory)
     {
@@ -277,8 +632,56 @@ void Partition::ReadEdgeFeaturesData(std::filesystem::path path, std::string suf
     {
         m_edge_features =
             std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), &open_edge_features_data);
+        if (m_feature_cache != nullptr)
+        {
+            m_edge_features = std::make_shared<CachedStorage<uint8_t>>(std::move(m_edge_features), m_feature_cache);
+        }
+    }
+    else if (m_storage_type == PartitionStorageType::mmap)
+    {
+        m_edge_features =
+            std::make_shared<MmapStorage<uint8_t>>(std::move(path), std::move(suffix), &open_edge_features_data);
     }
 }
+std::shared_ptr<BaseStorage<uint8_t>> Partition::OpenFile(std::filesystem::path path, std::string suffix,
+                                                          open_file_ptr open_file, std::string file_name) const
+{
+    if (is_hdfs_path(path))
+    {
+        auto full_path = path / file_name;
+        return std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), m_metadata.m_config_path,
+                                                            m_metadata.m_hdfs_read);
+    }
+    if (m_storage_type == PartitionStorageType::mmap)
+    {
+        return std::make_shared<MmapStorage<uint8_t>>(std::move(path), std::move(suffix), open_file);
+    }
+
+    return std::make_shared<DiskStorage<uint8_t>>(std::move(path), std::move(suffix), open_file);
+}
+std::span<const uint64_t> Partition::ReadIndexFile(std::filesystem::path path, std::string suffix,
+                                                   open_file_ptr open_file, std::string file_name)
+{
+    if (m_storage_type == PartitionStorageType::mmap && !is_hdfs_path(path))
+    {
+        auto storage = std::make_shared<MmapStorage<uint64_t>>(std::move(path), std::move(suffix), open_file);
+        const auto data = storage->data();
+        m_index_buffers.emplace_back(std::move(storage));
+        return data;
+    }
+
+    auto index = OpenFile(std::move(path), std::move(suffix), open_file, file_name);
+    auto index_ptr = index->start();
+    auto buffer = std::make_shared<std::vector<uint64_t>>(index->size() / 8);
+    if (buffer->size() != index->read(buffer->data(), 8, buffer->size(), index_ptr))
+    {
+        RAW_LOG_FATAL("Failed to read %s file", file_name.c_str());
+    }
+
+    const auto data = std::span<const uint64_t>(*buffer);
+    m_index_buffers.emplace_back(std::move(buffer));
+    return data;
+}
 Type Partition::GetNodeType(uint64_t internal_node_id) const
 {
     return m_node_types[internal_node_id];
@@ -295,104 +698,180 @@ bool Partition::GetNodeFeature(uint64_t internal_id, std::span<snark::FeatureMet
     if (!HasNodeFeatures(internal_id))
         return false;
 
-    auto file_ptr = m_node_features->start();
-    auto curr = std::begin(output);
-    auto feature_index_offset = m_node_index[internal_id];
-    auto next_offset = m_node_index[internal_id + 1];
-    for (const auto &feature : features)
+    const size_t output_offset = 0;
+    GetNodeFeature(std::span(&internal_id, 1), std::span(&output_offset, 1), features, output);
+    return true;
+}
+
+void Partition::GetNodeFeature(std::span<const uint64_t> internal_node_ids, std::span<const size_t> output_offsets,
+                               std::span<snark::FeatureMeta> features, std::span<uint8_t> output) const
+{
+    assert(internal_node_ids.size() == output_offsets.size());
+
+    std::vector<const FeatureColumn *> columns(features.size());
+    for (size_t feature = 0; feature < features.size() && !m_feature_columns.empty(); ++feature)
     {
-        const auto feature_id = feature.first;
-        const auto feature_size = feature.second;
-        // Requested feature_id is larger than known features, fill with 0s.
-        if (next_offset - feature_index_offset <= uint64_t(feature_id) || m_node_feature_index.empty())
+        auto column = m_feature_columns.find(features[feature].first);
+        if (column != std::end(m_feature_columns))
         {
-            curr = std::fill_n(curr, feature_size, 0);
-            continue;
+            columns[feature] = &column->second;
         }
-        const auto data_offset = m_node_feature_index[feature_index_offset + feature_id];
-        const auto stored_size = m_node_feature_index[feature_index_offset + feature_id + 1] - data_offset;
-        curr = m_node_features->read(data_offset, std::min<uint64_t>(feature_size, stored_size), curr, file_ptr);
-        if (stored_size < feature_size)
+    }
+
+    std::vector<FileRange> ranges;
+    ranges.reserve(internal_node_ids.size() * features.size());
+    for (size_t node_index = 0; node_index < internal_node_ids.size(); ++node_index)
+    {
+        const auto internal_id = internal_node_ids[node_index];
+        auto curr = std::begin(output) + output_offsets[node_index];
+        auto feature_index_offset = m_node_index[internal_id];
+        auto next_offset = m_node_index[internal_id + 1];
+        for (size_t feature = 0; feature < features.size(); ++feature)
         {
-            curr = std::fill_n(curr, feature_size - stored_size, 0);
+            const auto feature_id = features[feature].first;
+            const auto feature_size = features[feature].second;
+            if (const auto *column = columns[feature]; column != nullptr)
+            {
+                const auto read_size = std::min(feature_size, column->m_size);
+                if (column->Present(internal_id))
+                {
+                    curr = std::copy_n(std::begin(column->m_values) + internal_id * column->m_size, read_size, curr);
+                }
+                else
+                {
+                    curr = std::fill_n(curr, read_size, 0);
+                }
+                curr = std::fill_n(curr, feature_size - read_size, 0);
+                continue;
+            }
+
+            // Requested feature_id is larger than known features, fill with 0s.
+            if (next_offset - feature_index_offset <= uint64_t(feature_id) || m_node_feature_index.empty())
+            {
+                curr = std::fill_n(curr, feature_size, 0);
+                continue;
+            }
+            const auto data_offset = m_node_feature_index[feature_index_offset + feature_id];
+            const auto stored_size = m_node_feature_index[feature_index_offset + feature_id + 1] - data_offset;
+            const auto read_size = std::min<uint64_t>(feature_size, stored_size);
+            if (read_size > 0)
+            {
+                ranges.emplace_back(FileRange{.offset = data_offset, .size = read_size, .output = &(*curr)});
+            }
+            curr += read_size;
+            if (stored_size < feature_size)
+            {
+                curr = std::fill_n(curr, feature_size - stored_size, 0);
+            }
+        }
+    }
+
+    m_node_features->read_batch(ranges);
+}
+
+bool Partition::WarmNodeFeatureCache(uint64_t internal_id, uint64_t &budget) const
+{
+    if (!HasNodeFeatures(internal_id) || m_node_feature_index.empty())
+        return true;
+
+    const auto feature_index_offset = m_node_index[internal_id];
+    const auto next_offset = m_node_index[internal_id + 1];
+    const auto data_offset = m_node_feature_index[feature_index_offset];
+    std::vector<uint8_t> buffer(m_node_feature_index[next_offset] - data_offset);
+    std::vector<FileRange> ranges;
+    ranges.reserve(next_offset - feature_index_offset);
+    uint64_t required = 0;
+    for (auto index = feature_index_offset; index < next_offset; ++index)
+    {
+        const auto offset = m_node_feature_index[index];
+        const auto size = m_node_feature_index[index + 1] - offset;
+        if (size > 0)
+        {
+            ranges.emplace_back(
+                FileRange{.offset = offset, .size = size, .output = buffer.data() + offset - data_offset});
+            required += FeatureCache::EntrySize(size);
         }
     }
 
+    if (required > budget)
+        return false;
+
+    m_node_features->read_batch(ranges);
+    budget -= required;
     return true;
 }
 
-bool Partition::GetNodeSparseFeature(uint64_t internal_node_id, std::span<const snark::FeatureId> features,
-                                     int64_t prefix, std::span<int64_t> out_dimensions,
-                                     std::vector<std::vector<int64_t>> &out_indices,
-                                     std::vector<std::vector<uint8_t>> &out_values) const
+bool Partition::GetNodeSparseFeature(uint64_t internal_node_id, snark::FeatureId feature, int64_t prefix,
+                                     SparseFeatureBatch &output) const
 {
     if (!HasNodeFeatures(internal_node_id))
         return false;
 
-    assert(features.size() == out_dimensions.size());
-    auto file_ptr = m_node_features->start();
     auto feature_index_offset = m_node_index[internal_node_id];
     auto next_offset = m_node_index[internal_node_id + 1];
-    for (size_t feature_index = 0; feature_index < features.size(); ++feature_index)
+    // Requested feature_id is larger than known features, skip.
+    if (next_offset - feature_index_offset <= uint64_t(feature) || m_node_feature_index.empty())
     {
-        const auto feature = features[feature_index];
-        // Requested feature_id is larger than known features, skip.
-        if (next_offset - feature_index_offset <= uint64_t(feature) || m_node_feature_index.empty())
-        {
-            continue;
-        }
-        const auto data_offset = m_node_feature_index[feature_index_offset + feature];
-        const auto stored_size = m_node_feature_index[feature_index_offset + feature + 1] - data_offset;
-        // Check if the feature is empty
-        if (stored_size == 0)
-        {
-            continue;
-        }
-        if (stored_size <=
-            12) // minimum is 4 bytes to record there is a single index, actual index (8 bytes) and some data(>0 bytes).
-                // Something went wrong in binary converter, we'll log a warning instead of crashing.
-        {
-            // Use std::to_string, since format specifiers vary for different compilers.
-            auto feature_string = std::to_string(feature);
-            auto node_id_string = std::to_string(internal_node_id);
-            RAW_LOG_WARNING("Invalid feature request: sparse feature size is less than 12 bytes for feature %s and "
-                            "node internal id %s",
-                            feature_string.c_str(), node_id_string.c_str());
-            continue;
-        }
-        uint32_t indices_size = 0;
-        auto indices_size_output = std::span(reinterpret_cast<uint8_t *>(&indices_size), 4);
-        m_node_features->read(data_offset, indices_size_output.size(), std::begin(indices_size_output), file_ptr);
-        uint32_t indices_dim = 0;
-        auto indices_dim_output = std::span(reinterpret_cast<uint8_t *>(&indices_dim), 4);
-        m_node_features->read(data_offset + 4, indices_dim_output.size(), std::begin(indices_dim_output), file_ptr);
-        out_dimensions[feature_index] = int64_t(indices_dim);
-        assert(indices_size % indices_dim == 0);
-        size_t num_values = indices_size / indices_dim;
-        const auto old_len = out_indices[feature_index].size();
-        out_indices[feature_index].resize(old_len + indices_size + num_values, prefix);
-        auto output = std::span(reinterpret_cast<uint8_t *>(out_indices[feature_index].data()) + old_len * 8,
-                                (indices_size + num_values) * 8);
-        // Read expected feature_dim indices in bytes
-        size_t indices_offset = data_offset + 8;
-        auto curr = std::begin(output);
-        for (size_t i = 0; i < num_values; ++i)
-        {
-            curr += 8;
-            curr = m_node_features->read(indices_offset, indices_dim * 8, curr, file_ptr);
-            indices_offset += 8 * indices_dim;
-        }
-        // Read values
-        const auto values_length = stored_size - indices_size * 8 - 8;
-        const auto old_values_length = out_values[feature_index].size();
-        out_values[feature_index].resize(old_values_length + values_length);
-        auto out_values_span = std::span(out_values[feature_index]).subspan(old_values_length);
-        m_node_features->read(indices_offset, values_length, std::begin(out_values_span), file_ptr);
+        return true;
+    }
+    const auto data_offset = m_node_feature_index[feature_index_offset + feature];
+    const auto stored_size = m_node_feature_index[feature_index_offset + feature + 1] - data_offset;
+    // Check if the feature is empty
+    if (stored_size == 0)
+    {
+        return true;
+    }
+    if (stored_size <=
+        12) // minimum is 4 bytes to record there is a single index, actual index (8 bytes) and some data(>0 bytes).
+            // Something went wrong in binary converter, we'll log a warning instead of crashing.
+    {
+        // Use std::to_string, since format specifiers vary for different compilers.
+        auto feature_string = std::to_string(feature);
+        auto node_id_string = std::to_string(internal_node_id);
+        RAW_LOG_WARNING("Invalid feature request: sparse feature size is less than 12 bytes for feature %s and "
+                        "node internal id %s",
+                        feature_string.c_str(), node_id_string.c_str());
+        return true;
     }
 
+    ReadSparseFeature(*m_node_features, data_offset, stored_size, prefix, output);
     return true;
 }
 
+void Partition::ReadSparseFeature(const BaseStorage<uint8_t> &storage, uint64_t data_offset, uint64_t stored_size,
+                                  int64_t prefix, SparseFeatureBatch &output) const
+{
+    // Header has the number of indices followed by their dimension.
+    uint32_t header[2] = {0, 0};
+    auto header_output = std::span(reinterpret_cast<uint8_t *>(header), sizeof(header));
+    storage.read(data_offset, header_output.size(), std::begin(header_output), nullptr);
+    const auto [indices_size, indices_dim] = header;
+    output.m_dimensions[output.CurrentFeature()] = int64_t(indices_dim);
+    assert(indices_size % indices_dim == 0);
+    const size_t num_values = indices_size / indices_dim;
+
+    // Read all indices at the end of the output and spread them apart to insert prefixes in front of every value.
+    auto &indices = output.m_indices;
+    const auto old_len = indices.size();
+    indices.resize(old_len + indices_size + num_values);
+    auto stored_indices = std::span(reinterpret_cast<uint8_t *>(indices.data() + old_len + num_values),
+                                    size_t(indices_size) * 8);
+    storage.read(data_offset + 8, stored_indices.size(), std::begin(stored_indices), nullptr);
+    for (size_t i = 0; i < num_values; ++i)
+    {
+        auto *value_indices = indices.data() + old_len + i * (indices_dim + 1);
+        std::memmove(value_indices + 1, indices.data() + old_len + num_values + i * indices_dim, indices_dim * 8);
+        *value_indices = prefix;
+    }
+
+    // Read values
+    const auto values_length = stored_size - uint64_t(indices_size) * 8 - 8;
+    const auto old_values_length = output.m_values.size();
+    output.m_values.resize(old_values_length + values_length);
+    auto out_values_span = std::span(output.m_values).subspan(old_values_length);
+    storage.read(data_offset + 8 + uint64_t(indices_size) * 8, values_length, std::begin(out_values_span), nullptr);
+}
+
 bool Partition::GetNodeStringFeature(uint64_t internal_node_id, std::span<const snark::FeatureId> features,
                                      std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_values) const
 {
@@ -400,7 +879,6 @@ bool Partition::GetNodeStringFeature(uint64_t internal_node_id, std::span<const
         return false;
 
     assert(features.size() == out_dimensions.size());
-    auto file_ptr = m_node_features->start();
     auto feature_index_offset = m_node_index[internal_node_id];
     auto next_offset = m_node_index[internal_node_id + 1];
     for (size_t feature_index = 0; feature_index < features.size(); ++feature_index)
@@ -423,53 +901,56 @@ bool Partition::GetNodeStringFeature(uint64_t internal_node_id, std::span<const
         const auto old_values_length = out_values.size();
         out_values.resize(old_values_length + stored_size);
         auto out_values_span = std::span(out_values).subspan(old_values_length);
-        m_node_features->read(data_offset, stored_size, std::begin(out_values_span), file_ptr);
+        m_node_features->read(data_offset, stored_size, std::begin(out_values_span), nullptr);
     }
 
     return true;
 }
 
-template <class F>
-size_t NeighborIndexIterator(uint64_t internal_id, std::span<const Type> edge_types, F func,
-                             const std::vector<uint64_t> &m_neighbors_index, const std::vector<Type> &m_edge_types,
-                             const std::vector<uint64_t> &m_edge_type_offset)
-
+template <typename F>
+size_t Partition::ForEachTypeRun(uint64_t internal_id, std::span<const Type> edge_types, F func) const
 {
-    const auto offset = m_neighbors_index[internal_id];
-    const auto nb_count = m_neighbors_index[internal_id + 1] - offset;
+    size_t result = 0;
+    const auto visit = [&](size_t run) {
+        const auto start = m_edge_type_offset[run];
+        const auto last = m_edge_type_offset[run + 1];
+        result += last - start;
+        func(start, last, run);
+    };
 
-    // Check if node doesn't have any neighbors
-    if (nb_count == 0)
+    if (!m_edge_type_masks.empty())
     {
-        return 0;
+        // Neighbor lists are read only for nodes with requested types.
+        const auto mask = m_edge_type_masks[internal_id];
+        for (size_t index = 0; index < edge_types.size() && mask != 0; ++index)
+        {
+            const auto type = edge_types[index];
+            if (HasEdgeType(mask, type) && (index == 0 || edge_types[index - 1] != type))
+            {
+                visit(MaskedEdgeRun(internal_id, mask, type));
+            }
+        }
+        return result;
     }
 
-    size_t result = 0;
+    // Merge sorted types of the node runs with requested types.
     size_t curr_type = 0;
-    for (size_t i = offset; i < offset + nb_count; ++i)
+    const auto last_type = m_neighbors_index[internal_id + 1];
+    for (auto i = m_neighbors_index[internal_id]; i < last_type && curr_type < edge_types.size();)
     {
-        for (; curr_type < edge_types.size() && edge_types[curr_type] < m_edge_types[i]; ++curr_type)
-        {
-        }
-        if (curr_type == edge_types.size())
+        if (m_edge_types[i] < edge_types[curr_type])
         {
-            break;
+            ++i;
         }
-        for (; i < offset + nb_count && edge_types[curr_type] > m_edge_types[i]; ++i)
+        else if (m_edge_types[i] > edge_types[curr_type])
         {
+            ++curr_type;
         }
-        if (i == offset + nb_count)
-        {
-            break;
-        }
-        // Find satisfying edge type, if exists
-        if (m_edge_types[i] == edge_types[curr_type])
+        else
         {
-            const auto start = m_edge_type_offset[i];
-            const auto last = m_edge_type_offset[i + 1];
-
-            result += last - start;
-            func(start, last, i);
+            visit(i);
+            ++i;
+            ++curr_type;
         }
     }
     return result;
@@ -477,10 +958,7 @@ size_t NeighborIndexIterator(uint64_t internal_id, std::span<const Type> edge_ty
 
 size_t Partition::NeighborCount(uint64_t internal_id, std::span<const Type> edge_types) const
 {
-    auto lambda = [](const auto start, const auto last, const auto i) {};
-
-    return NeighborIndexIterator(internal_id, edge_types, std::move(lambda), m_neighbors_index, m_edge_types,
-                                 m_edge_type_offset);
+    return ForEachTypeRun(internal_id, edge_types, [](auto start, auto last, auto i) {});
 }
 
 size_t Partition::FullNeighbor(uint64_t internal_id, std::span<const Type> edge_types,
@@ -488,6 +966,19 @@ size_t Partition::FullNeighbor(uint64_t internal_id, std::span<const Type> edge_
                                std::vector<float> &out_edge_weights) const
 {
     auto lambda = [&out_neighbors_ids, &out_edge_types, &out_edge_weights, this](auto start, auto last, int i) {
+        if (m_use_compressed_edges)
+        {
+            m_compressed_edges.Destinations(start, last, out_neighbors_ids);
+            out_edge_types.resize(out_edge_types.size() + last - start, m_edge_types[i]);
+            const auto original_weights_size = out_edge_weights.size();
+            m_compressed_edges.WeightSums(start, last, out_edge_weights);
+            for (size_t index = out_edge_weights.size() - 1; index > original_weights_size; --index)
+            {
+                out_edge_weights[index] -= out_edge_weights[index - 1];
+            }
+            return;
+        }
+
         // m_edge_destination[last-1]+1 - take the last element and then advance the pointer
         // to imitate std::end, otherwise we'll have an out of range exception.
         out_neighbors_ids.insert(std::end(out_neighbors_ids), &m_edge_destination[start],
@@ -502,56 +993,49 @@ size_t Partition::FullNeighbor(uint64_t internal_id, std::span<const Type> edge_
         }
     };
 
-    return NeighborIndexIterator(internal_id, edge_types, std::move(lambda), m_neighbors_index, m_edge_types,
-                                 m_edge_type_offset);
+    return ForEachTypeRun(internal_id, edge_types, std::move(lambda));
 }
 
-bool Partition::GetEdgeFeature(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type,
-                               std::span<snark::FeatureMeta> features, std::span<uint8_t> output) const
+bool Partition::HasEdge(uint64_t internal_node_id, NodeId destination, std::span<const Type> edge_types) const
 {
-    auto file_ptr = m_edge_features->start();
-    auto curr = std::begin(output);
-
-    const auto offset = m_neighbors_index[internal_src_node_id];
-    const auto nb_count = m_neighbors_index[internal_src_node_id + 1] - offset;
-
-    // Check if node doesn't have any neighbors
-    if (nb_count == 0)
-    {
-        return false;
-    }
-
-    auto type_offset = std::numeric_limits<size_t>::max();
-    for (size_t i = offset; i < offset + nb_count; ++i)
-    {
-        if (m_edge_types[i] == input_edge_type)
+    bool found = false;
+    auto lambda = [&found, destination, this](auto start, auto last, auto i) {
+        if (!found)
         {
-            type_offset = i;
-            break;
+            const auto position = FindEdgeDestination(start, last, destination);
+            found = position != last && EdgeDestination(position) == destination;
         }
-    }
-    if (type_offset == std::numeric_limits<size_t>::max())
-    {
-        return false;
-    }
-    const auto tp_count = m_edge_type_offset[type_offset + 1] - m_edge_type_offset[type_offset];
-    auto fst = std::begin(m_edge_destination) + m_edge_type_offset[type_offset];
-    auto lst = fst + tp_count;
-    auto it = std::lower_bound(fst, lst, input_edge_dst);
-    if (it == lst)
+    };
+
+    ForEachTypeRun(internal_node_id, edge_types, std::move(lambda));
+    return found;
+}
+
+bool Partition::GetEdgeFeature(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type,
+                               std::span<snark::FeatureMeta> features, std::span<uint8_t> output) const
+{
+    const auto edge = FindEdge(internal_src_node_id, input_edge_dst, input_edge_type);
+    if (edge == npos)
     {
         // Edge was not found in this partition.
         return false;
     }
+
+    GetEdgeFeature(edge, features, output);
+    return true;
+}
+
+void Partition::GetEdgeFeature(size_t edge, std::span<snark::FeatureMeta> features, std::span<uint8_t> output) const
+{
     if (m_edge_feature_offset.empty() || m_edge_feature_index.empty())
     {
         std::fill(std::begin(output), std::end(output), 0);
-        return true;
+        return;
     }
 
-    auto edge_offset = it - std::begin(m_edge_destination);
-    auto feature_index_offset = m_edge_feature_offset[edge_offset];
-    auto next_offset = m_edge_feature_offset[edge_offset + 1];
+    auto curr = std::begin(output);
+    auto feature_index_offset = m_edge_feature_offset[edge];
+    auto next_offset = m_edge_feature_offset[edge + 1];
 
     for (const auto &feature : features)
     {
@@ -567,191 +1051,184 @@ bool Partition::GetEdgeFeature(uint64_t internal_src_node_id, NodeId input_edge_
 
         const auto data_offset = m_edge_feature_index[feature_index_offset + f_id];
         const auto stored_size = m_edge_feature_index[feature_index_offset + f_id + 1] - data_offset;
-        curr = m_edge_features->read(data_offset, std::min<uint64_t>(f_size, stored_size), curr, file_ptr);
+        curr = m_edge_features->read(data_offset, std::min<uint64_t>(f_size, stored_size), curr, nullptr);
         if (stored_size < f_size)
         {
-            const auto f_id = feature.first;
-            const auto f_size = feature.second;
-
-            // Requested feature_id is larger than known features, fill with 0s.
-            if (next_offset - feature_index_offset <= uint64_t(f_id))
-            {
-                curr = std::fill_n(curr, f_size, 0);
-                continue;
-            }
-
-            const auto data_offset = m_edge_feature_index[feature_index_offset + f_id];
-            const auto stored_size = m_edge_feature_index[feature_index_offset + f_id + 1] - data_offset;
-
-            curr = m_edge_features->read(data_offset, std::min<uint64_t>(f_size, stored_size), curr, file_ptr);
-            if (stored_size < f_size)
-            {
-                curr = std::fill_n(curr, f_size - stored_size, 0);
-            }
+            curr = std::fill_n(curr, f_size - stored_size, 0);
         }
     }
-
-    return true;
 }
 
-bool Partition::GetEdgeSparseFeature(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type,
-                                     std::span<const snark::FeatureId> features, int64_t prefix,
-                                     std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
-                                     std::vector<std::vector<uint8_t>> &out_values) const
+size_t Partition::FindEdgeRun(uint64_t internal_src_node_id, Type type) const
 {
-    assert(features.size() == out_dimensions.size());
-    auto file_ptr = m_edge_features->start();
-    const auto offset = m_neighbors_index[internal_src_node_id];
-    const auto nb_count = m_neighbors_index[internal_src_node_id + 1] - offset;
-    // Check if node doesn't have any neighbors
-    if (nb_count == 0)
+    if (!m_edge_type_masks.empty())
     {
-        return false;
+        const auto mask = m_edge_type_masks[internal_src_node_id];
+        return HasEdgeType(mask, type) ? MaskedEdgeRun(internal_src_node_id, mask, type) : npos;
     }
-    auto type_offset = std::numeric_limits<size_t>::max();
+
+    const auto offset = m_neighbors_index[internal_src_node_id];
+    const auto nb_count = m_neighbors_index[internal_src_node_id + 1] - offset;
     for (size_t i = offset; i < offset + nb_count; ++i)
     {
-        if (m_edge_types[i] == input_edge_type)
+        if (m_edge_types[i] == type)
         {
-            type_offset = i;
-            break;
+            return i;
         }
     }
-    if (type_offset == std::numeric_limits<size_t>::max())
-    {
-        return false;
-    }
-    const auto tp_count = m_edge_type_offset[type_offset + 1] - m_edge_type_offset[type_offset];
-    auto fst = std::begin(m_edge_destination) + m_edge_type_offset[type_offset];
-    auto lst = fst + tp_count;
-    auto it = std::lower_bound(fst, lst, input_edge_dst);
-    if (it == lst)
+
+    return npos;
+}
+
+size_t Partition::FindRunEdge(size_t run, size_t &cursor, size_t last, NodeId destination) const
+{
+    if (m_edge_index_threshold > 0 && last - m_edge_type_offset[run] >= m_edge_index_threshold)
     {
-        // Edge was not found in this partition.
-        return false;
+        const auto edge = m_edge_index.find(std::pair(uint64_t(run), destination));
+        return edge == std::end(m_edge_index) ? npos : edge->second;
     }
-    if (m_edge_feature_offset.empty() || m_edge_feature_index.empty())
+
+    if (m_use_compressed_edges)
     {
-        return true;
+        cursor = m_compressed_edges.FindDestination(cursor, last, destination);
     }
-    auto edge_offset = it - std::begin(m_edge_destination);
-    auto feature_index_offset = m_edge_feature_offset[edge_offset];
-    auto next_offset = m_edge_feature_offset[edge_offset + 1];
-    for (size_t feature_index = 0; feature_index < features.size(); ++feature_index)
+    else
     {
-        const auto feature = features[feature_index];
-        // Requested feature_id is larger than known features, fill with 0s.
-        if (next_offset - feature_index_offset <= uint64_t(feature))
+        // Gallop from the cursor to a window with the destination, edges of a batch are often close to each other.
+        auto low = cursor;
+        auto high = std::min(last, low + 1);
+        for (size_t step = 2; high < last && m_edge_destination[high] < destination; step *= 2)
         {
-            continue;
+            low = high + 1;
+            high = std::min(last, low + step);
         }
-        const auto data_offset = m_edge_feature_index[feature_index_offset + feature];
-        const auto stored_size = m_edge_feature_index[feature_index_offset + feature + 1] - data_offset;
-        // Check if the feature is empty
-        if (stored_size == 0)
+        const auto begin = std::begin(m_edge_destination);
+        cursor = std::lower_bound(begin + low, begin + high, destination) - begin;
+    }
+
+    return cursor != last && EdgeDestination(cursor) == destination ? cursor : npos;
+}
+
+size_t Partition::FindEdge(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type) const
+{
+    const auto run = FindEdgeRun(internal_src_node_id, input_edge_type);
+    if (run == npos)
+    {
+        return npos;
+    }
+
+    auto cursor = m_edge_type_offset[run];
+    return FindRunEdge(run, cursor, m_edge_type_offset[run + 1], input_edge_dst);
+}
+
+void Partition::FindEdges(std::span<const uint64_t> internal_src_node_ids, std::span<const NodeId> input_edge_dst,
+                          std::span<const Type> input_edge_type, std::span<size_t> out_edges) const
+{
+    assert(internal_src_node_ids.size() == input_edge_dst.size());
+    assert(internal_src_node_ids.size() == input_edge_type.size());
+    assert(internal_src_node_ids.size() == out_edges.size());
+
+    std::vector<size_t> order(internal_src_node_ids.size());
+    std::iota(std::begin(order), std::end(order), size_t(0));
+    std::sort(std::begin(order), std::end(order), [&](size_t left, size_t right) {
+        return std::tie(internal_src_node_ids[left], input_edge_type[left], input_edge_dst[left]) <
+               std::tie(internal_src_node_ids[right], input_edge_type[right], input_edge_dst[right]);
+    });
+
+    for (size_t group = 0; group < order.size();)
+    {
+        const auto source = internal_src_node_ids[order[group]];
+        const auto type = input_edge_type[order[group]];
+        auto group_end = group + 1;
+        while (group_end < order.size() && internal_src_node_ids[order[group_end]] == source &&
+               input_edge_type[order[group_end]] == type)
         {
-            continue;
+            ++group_end;
         }
 
-        if (stored_size <=
-            12) // minimum is 4 bytes to record there is a single index, actual index (8 bytes) and some data(>0 bytes).
-                // Something went wrong in binary converter, we'll log a warning instead of crashing.
+        const auto run = FindEdgeRun(source, type);
+        if (run == npos)
         {
-            auto feature_string = std::to_string(feature);
-            auto src_id_string = std::to_string(internal_src_node_id);
-            auto type_string = std::to_string(input_edge_type);
-            auto dst_id_str = std::to_string(input_edge_dst);
-            RAW_LOG_WARNING("Invalid feature request: sparse feature size is less than 12 bytes for feature %s and "
-                            "edge internal src id %s, type %s and dst id %s",
-                            feature_string.c_str(), src_id_string.c_str(), type_string.c_str(), dst_id_str.c_str());
+            for (; group < group_end; ++group)
+            {
+                out_edges[order[group]] = npos;
+            }
             continue;
         }
 
-        assert(stored_size > 12); // minimum is 4 bytes to record there is a single index, actual index (8 bytes)
-                                  // and some data(>0 bytes).
-        uint32_t indices_size = 0;
-        auto indices_size_output = std::span(reinterpret_cast<uint8_t *>(&indices_size), 4);
-        m_edge_features->read(data_offset, indices_size_output.size(), std::begin(indices_size_output), file_ptr);
-
-        uint32_t indices_dim = 0;
-        auto indices_dim_output = std::span(reinterpret_cast<uint8_t *>(&indices_dim), 4);
-        m_edge_features->read(data_offset + 4, indices_dim_output.size(), std::begin(indices_dim_output), file_ptr);
-        out_dimensions[feature_index] = int64_t(indices_dim);
-
-        assert(indices_size % indices_dim == 0);
-        size_t num_values = indices_size / indices_dim;
-        const auto old_len = out_indices[feature_index].size();
-        out_indices[feature_index].resize(old_len + indices_size + num_values, prefix);
-        auto output = std::span(reinterpret_cast<uint8_t *>(out_indices[feature_index].data()) + old_len * 8,
-                                (indices_size + num_values) * 8);
-
-        // Read expected feature_dim indices in bytes
-        size_t indices_offset = data_offset + 8;
-        auto curr = std::begin(output);
-        for (size_t i = 0; i < num_values; ++i)
+        // Destinations of a group are sorted, so searches for the next one start from the last found position.
+        auto cursor = m_edge_type_offset[run];
+        const auto last = m_edge_type_offset[run + 1];
+        for (; group < group_end; ++group)
         {
-            curr += 8;
-            curr = m_edge_features->read(indices_offset, indices_dim * 8, curr, file_ptr);
-            indices_offset += 8 * indices_dim;
+            out_edges[order[group]] = FindRunEdge(run, cursor, last, input_edge_dst[order[group]]);
         }
-
-        // Read values
-        const auto values_length = stored_size - indices_size * 8 - 8;
-        const auto old_values_length = out_values[feature_index].size();
-        out_values[feature_index].resize(old_values_length + values_length);
-        auto out_values_span = std::span(out_values[feature_index]).subspan(old_values_length);
-        m_edge_features->read(indices_offset, values_length, std::begin(out_values_span), file_ptr);
     }
-
-    return true;
 }
 
-bool Partition::GetEdgeStringFeature(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type,
-                                     std::span<const snark::FeatureId> features, std::span<int64_t> out_dimensions,
-                                     std::vector<uint8_t> &out_values) const
+void Partition::GetEdgeSparseFeature(size_t edge, snark::FeatureId feature, int64_t prefix,
+                                     SparseFeatureBatch &output) const
 {
-    assert(features.size() == out_dimensions.size());
-
-    auto file_ptr = m_edge_features->start();
-    const auto offset = m_neighbors_index[internal_src_node_id];
-    const auto nb_count = m_neighbors_index[internal_src_node_id + 1] - offset;
-
-    // Check if node doesn't have any neighbors
-    if (nb_count == 0)
+    if (m_edge_feature_offset.empty() || m_edge_feature_index.empty())
     {
-        return false;
+        return;
     }
-
-    auto type_offset = std::numeric_limits<size_t>::max();
-    for (size_t i = offset; i < offset + nb_count; ++i)
+    auto feature_index_offset = m_edge_feature_offset[edge];
+    auto next_offset = m_edge_feature_offset[edge + 1];
+    // Requested feature_id is larger than known features, skip.
+    if (next_offset - feature_index_offset <= uint64_t(feature))
     {
-        if (m_edge_types[i] == input_edge_type)
-        {
-            type_offset = i;
-            break;
-        }
+        return;
     }
-    if (type_offset == std::numeric_limits<size_t>::max())
+    const auto data_offset = m_edge_feature_index[feature_index_offset + feature];
+    const auto stored_size = m_edge_feature_index[feature_index_offset + feature + 1] - data_offset;
+    // Check if the feature is empty
+    if (stored_size == 0)
     {
-        return false;
+        return;
+    }
+
+    if (stored_size <=
+        12) // minimum is 4 bytes to record there is a single index, actual index (8 bytes) and some data(>0 bytes).
+            // Something went wrong in binary converter, we'll log a warning instead of crashing.
+    {
+        auto feature_string = std::to_string(feature);
+        auto edge_string = std::to_string(edge);
+        RAW_LOG_WARNING("Invalid feature request: sparse feature size is less than 12 bytes for feature %s and "
+                        "edge %s",
+                        feature_string.c_str(), edge_string.c_str());
+        return;
     }
-    const auto tp_count = m_edge_type_offset[type_offset + 1] - m_edge_type_offset[type_offset];
-    auto fst = std::begin(m_edge_destination) + m_edge_type_offset[type_offset];
-    auto lst = fst + tp_count;
-    auto it = std::lower_bound(fst, lst, input_edge_dst);
-    if (it == lst)
+
+    ReadSparseFeature(*m_edge_features, data_offset, stored_size, prefix, output);
+}
+
+bool Partition::GetEdgeStringFeature(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type,
+                                     std::span<const snark::FeatureId> features, std::span<int64_t> out_dimensions,
+                                     std::vector<uint8_t> &out_values) const
+{
+    const auto edge = FindEdge(internal_src_node_id, input_edge_dst, input_edge_type);
+    if (edge == npos)
     {
         // Edge was not found in this partition.
         return false;
     }
+
+    GetEdgeStringFeature(edge, features, out_dimensions, out_values);
+    return true;
+}
+
+void Partition::GetEdgeStringFeature(size_t edge, std::span<const snark::FeatureId> features,
+                                     std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_values) const
+{
+    assert(features.size() == out_dimensions.size());
     if (m_edge_feature_offset.empty() || m_edge_feature_index.empty())
     {
-        return true;
+        return;
     }
 
-    auto edge_offset = it - std::begin(m_edge_destination);
-    auto feature_index_offset = m_edge_feature_offset[edge_offset];
-    auto next_offset = m_edge_feature_offset[edge_offset + 1];
+    auto feature_index_offset = m_edge_feature_offset[edge];
+    auto next_offset = m_edge_feature_offset[edge + 1];
 
     for (size_t feature_index = 0; feature_index < features.size(); ++feature_index)
     {
@@ -775,10 +1252,8 @@ bool Partition::GetEdgeStringFeature(uint64_t internal_src_node_id, NodeId input
         const auto old_values_length = out_values.size();
         out_values.resize(old_values_length + stored_size);
         auto out_values_span = std::span(out_values).subspan(old_values_length);
-        m_edge_features->read(data_offset, stored_size, std::begin(out_values_span), file_ptr);
+        m_edge_features->read(data_offset, stored_size, std::begin(out_values_span), nullptr);
     }
-
-    return true;
 }
 
 void Partition::SampleNeighbor(int64_t seed, uint64_t internal_node_id, std::span<const Type> in_edge_types,
@@ -790,48 +1265,10 @@ void Partition::SampleNeighbor(int64_t seed, uint64_t internal_node_id, std::spa
     snark::Xoroshiro128PlusGenerator gen(seed);
     boost::random::uniform_real_distribution<float> real(0, 1.0f);
 
-    const auto offset = m_neighbors_index[internal_node_id];
-    const auto nb_count = m_neighbors_index[internal_node_id + 1] - offset;
-
-    // Check if node doesn't have any neighbors
-    if (nb_count == 0)
-    {
-        if (out_partition == 0)
-        {
-            std::fill_n(std::begin(out_nodes) + pos, count, default_node_id);
-            std::fill_n(std::begin(out_types) + pos, count, default_edge_type);
-            std::fill_n(std::begin(out_weights) + pos, count, default_weight);
-        }
-
-        pos += count;
-        return;
-    }
-
+    // Nodes without edges of requested types have zero weight.
     float total_weight = 0;
-    size_t curr_type = 0;
-    const auto last_type = offset + nb_count;
-    for (size_t i = offset; i < last_type; ++i)
-    {
-        for (; curr_type < in_edge_types.size() && in_edge_types[curr_type] < m_edge_types[i]; ++curr_type)
-        {
-        }
-        if (curr_type == in_edge_types.size())
-        {
-            break;
-        }
-        for (; i < last_type && in_edge_types[curr_type] > m_edge_types[i]; ++i)
-        {
-        }
-        if (i == last_type)
-        {
-            break;
-        }
-        if (m_edge_types[i] == in_edge_types[curr_type])
-        {
-            auto last = m_edge_type_offset[i + 1] - 1;
-            total_weight += m_edge_weights[last];
-        }
-    }
+    ForEachTypeRun(internal_node_id, in_edge_types,
+                   [&](auto first, auto last, auto i) { total_weight += RunWeightSum(i); });
 
     out_partition += total_weight;
     if (total_weight == 0)
@@ -848,37 +1285,26 @@ void Partition::SampleNeighbor(int64_t seed, uint64_t internal_node_id, std::spa
     }
 
     size_t left_over_neighbors = count;
-    curr_type = 0;
+    std::vector<NodeId> destination_buffer;
+    std::vector<float> weight_buffer;
     const auto overwrite_rate = total_weight / out_partition;
-    for (size_t i = offset; i < offset + nb_count; ++i)
-    {
-        for (; curr_type < in_edge_types.size() && in_edge_types[curr_type] < m_edge_types[i]; ++curr_type)
-        {
-        }
-        if (curr_type == in_edge_types.size())
-        {
-            break;
-        }
-        for (; i < last_type && in_edge_types[curr_type] > m_edge_types[i]; ++i)
-        {
-        }
-        if (i == last_type)
-        {
-            break;
-        }
+    ForEachTypeRun(internal_node_id, in_edge_types, [&](size_t first, size_t run_last, size_t i) {
         if (total_weight == 0 || left_over_neighbors == 0)
         {
-            break;
+            return;
         }
-        if (m_edge_types[i] == in_edge_types[curr_type])
-        {
-            const auto first = m_edge_type_offset[i];
-            const auto last = m_edge_type_offset[i + 1] - 1;
-            const auto type_weight = m_edge_weights[last];
 
-            boost::random::binomial_distribution<int32_t> d(left_over_neighbors, type_weight / total_weight);
-            size_t type_count = type_weight == total_weight ? left_over_neighbors : d(gen);
-            total_weight -= type_weight;
+        const auto last = run_last - 1;
+        const auto type_weight = RunWeightSum(i);
+
+        boost::random::binomial_distribution<int32_t> d(left_over_neighbors, type_weight / total_weight);
+        size_t type_count = type_weight == total_weight ? left_over_neighbors : d(gen);
+        total_weight -= type_weight;
+        left_over_neighbors -= type_count;
+        if (const auto alias = m_alias_offsets.find(i); alias != std::end(m_alias_offsets))
+        {
+            const auto table = std::span(m_alias_table).subspan(alias->second, last - first + 1);
+            boost::random::uniform_real_distribution<double> column(0, double(table.size()));
             for (size_t j = 0; j < type_count; ++j)
             {
                 if (overwrite_rate < 1.0f && real(gen) > overwrite_rate)
@@ -886,22 +1312,48 @@ void Partition::SampleNeighbor(int64_t seed, uint64_t internal_node_id, std::spa
                     continue;
                 }
 
-                float rnd = type_weight * real(gen);
-                auto fst_nb = std::begin(m_edge_weights) + first;
-                auto lst_nb =
-                    m_edge_weights.size() == last ? std::end(m_edge_weights) : std::begin(m_edge_weights) + last + 1;
-                auto nb_pos = std::lower_bound(fst_nb, lst_nb, rnd);
-                size_t nb_offset = std::distance(fst_nb, nb_pos);
-                out_nodes[pos] = m_edge_destination[first + nb_offset];
+                // Integer part of a single draw picks a column and the fractional part is the coin toss.
+                const double draw = column(gen);
+                size_t position = std::min(size_t(draw), table.size() - 1);
+                if (draw - double(position) >= table[position].m_probability)
+                {
+                    position = table[position].m_alias;
+                }
+                out_nodes[pos] = EdgeDestination(first + position);
+                out_weights[pos] = EdgeWeight(first, first + position);
                 out_types[pos] = m_edge_types[i];
-                out_weights[pos] = nb_offset == 0
-                                       ? m_edge_weights[first]
-                                       : m_edge_weights[first + nb_offset] - m_edge_weights[first + nb_offset - 1];
                 ++pos;
             }
-            left_over_neighbors -= type_count;
+            return;
         }
-    }
+
+        const auto destinations = RunDestinations(first, last + 1, destination_buffer);
+        const auto weight_sums = RunWeightSums(first, last + 1, weight_buffer);
+        for (size_t j = 0; j < type_count; ++j)
+        {
+            if (overwrite_rate < 1.0f && real(gen) > overwrite_rate)
+            {
+                continue;
+            }
+
+            float rnd = type_weight * real(gen);
+            if (destinations.empty())
+            {
+                const auto nb_position = m_compressed_edges.FindWeightSum(first, last + 1, rnd, out_weights[pos]);
+                out_nodes[pos] = m_compressed_edges.Destination(nb_position);
+            }
+            else
+            {
+                auto nb_pos = std::lower_bound(std::begin(weight_sums), std::end(weight_sums), rnd);
+                size_t nb_offset = std::distance(std::begin(weight_sums), nb_pos);
+                out_nodes[pos] = destinations[nb_offset];
+                out_weights[pos] =
+                    nb_offset == 0 ? weight_sums[0] : weight_sums[nb_offset] - weight_sums[nb_offset - 1];
+            }
+            out_types[pos] = m_edge_types[i];
+            ++pos;
+        }
+    });
 }
 
 // in_edge_types has to have types in strictly increasing order.
@@ -922,33 +1374,6 @@ void Partition::UniformSampleNeighbor(bool without_replacement, int64_t seed, ui
     }
 }
 
-// Advance neighbor_type_index(for edges coming out of the current node) and in_edge_type_index(requested edge
-// types) until underlying types match.
-bool advance_edge_types(size_t &in_edge_type_index, size_t &neighbor_type_index,
-                        const std::span<const Type> &in_edge_types, const std::vector<Type> &neighbor_types,
-                        size_t last_type)
-{
-    for (; in_edge_type_index < in_edge_types.size() &&
-           in_edge_types[in_edge_type_index] < neighbor_types[neighbor_type_index];
-         ++in_edge_type_index)
-    {
-    }
-    if (in_edge_type_index == in_edge_types.size())
-    {
-        return false;
-    }
-    for (; neighbor_type_index < last_type && in_edge_types[in_edge_type_index] > neighbor_types[neighbor_type_index];
-         ++neighbor_type_index)
-    {
-    }
-    if (neighbor_type_index >= last_type)
-    {
-        return false;
-    }
-
-    return neighbor_types[neighbor_type_index] == in_edge_types[in_edge_type_index];
-}
-
 void Partition::UniformSampleNeighborWithReplacement(int64_t seed, uint64_t internal_id,
                                                      std::span<const Type> in_edge_types, uint64_t count,
                                                      std::span<NodeId> out_nodes, std::span<Type> out_types,
@@ -959,21 +1384,12 @@ void Partition::UniformSampleNeighborWithReplacement(int64_t seed, uint64_t inte
     // It is important to use a good generator, because we use it to pick a number and merge results from multiple
     // partitions. E.g. rand_48 engine will produce correlated samples.
     snark::Xoroshiro128PlusGenerator gen(seed);
-    boost::random::uniform_real_distribution<float> toss(0, 1);
-
-    const auto offset = m_neighbors_index[internal_id];
-    const auto nb_count = m_neighbors_index[internal_id + 1] - offset;
-
-    size_t in_edge_type_index = 0;
-    const auto last_type = offset + nb_count;
-    for (size_t neighbor_type_index = offset; neighbor_type_index < last_type; ++neighbor_type_index)
-    {
-        if (!advance_edge_types(in_edge_type_index, neighbor_type_index, in_edge_types, m_edge_types, last_type))
-        {
-            continue;
-        }
+    snark::UniformReals toss(gen);
 
-        const auto curr_weight = m_edge_type_offset[neighbor_type_index + 1] - m_edge_type_offset[neighbor_type_index];
+    std::vector<NodeId> destination_buffer;
+    ForEachTypeRun(internal_id, in_edge_types, [&](size_t first, size_t last, size_t neighbor_type_index) {
+        const auto curr_weight = last - first;
+        const auto destinations = RunDestinations(first, last, destination_buffer);
         out_partition_count += curr_weight;
         // Probabilities to select correct types will converge to right values:
         // E.g. we have 3 neighbor types with 5, 9 and 11 elements, then probability
@@ -981,14 +1397,14 @@ void Partition::UniformSampleNeighborWithReplacement(int64_t seed, uint64_t inte
         const auto merge_rate = float(curr_weight) / out_partition_count;
         for (size_t nb = 0; nb < count; ++nb)
         {
-            if (merge_rate == 1.0f || toss(gen) < merge_rate)
+            if (merge_rate == 1.0f || toss() < merge_rate)
             {
-                size_t pick = toss(gen) * curr_weight;
-                out_nodes[pos + nb] = m_edge_destination[m_edge_type_offset[neighbor_type_index] + pick];
+                size_t pick = toss() * curr_weight;
+                out_nodes[pos + nb] = destinations.empty() ? EdgeDestination(first + pick) : destinations[pick];
                 out_types[pos + nb] = m_edge_types[neighbor_type_index];
             }
         }
-    }
+    });
 
     if (out_partition_count == 0)
     {
@@ -1094,7 +1510,7 @@ void Partition::UniformSampleMergeWithoutReplacement(
             out_edge_types[out_pos] = type_values[type_offset];
             size_t prev_type = type_offset == 0 ? 0 : type_counts[type_offset - 1];
             out_neighbors[out_pos] =
-                m_edge_destination[destination_offsets[type_offset] + interim_neighbors[right_pos] - prev_type];
+                EdgeDestination(destination_offsets[type_offset] + interim_neighbors[right_pos] - prev_type);
             ++right_pos;
             --right_weight;
         }
@@ -1134,12 +1550,6 @@ void Partition::UniformSampleNeighborWithoutReplacement(int64_t seed, uint64_t i
     std::vector<Type> prev_types;
     prev_types.reserve(count);
 
-    const auto offset = m_neighbors_index[internal_id];
-    const auto nb_count = m_neighbors_index[internal_id + 1] - offset;
-
-    size_t curr_type = 0;
-    const auto last_type = offset + nb_count;
-
     // In order to avoid storing all node neighbors we'll find the total number of neighbors for given types
     // and then sample from a continuous range of elements from 1..#neighbors.
     // We store `type_counts`, `type_values` and `destination_offsets` to recover destination node ids later
@@ -1148,20 +1558,11 @@ void Partition::UniformSampleNeighborWithoutReplacement(int64_t seed, uint64_t i
     type_values.clear();
     destination_offsets.clear();
     interim_neighbors.clear();
-    size_t partition_weight = 0;
-    for (size_t i = offset; i < last_type; ++i)
-    {
-        if (!advance_edge_types(curr_type, i, in_edge_types, m_edge_types, last_type))
-        {
-            continue;
-        }
-
-        const auto curr_weight = m_edge_type_offset[i + 1] - m_edge_type_offset[i];
-        partition_weight += curr_weight;
-        type_counts.emplace_back(partition_weight);
+    const size_t partition_weight = ForEachTypeRun(internal_id, in_edge_types, [&](auto first, auto last, auto i) {
+        type_counts.emplace_back((type_counts.empty() ? 0 : type_counts.back()) + last - first);
         type_values.emplace_back(m_edge_types[i]);
-        destination_offsets.emplace_back(m_edge_type_offset[i]);
-    }
+        destination_offsets.emplace_back(first);
+    });
 
     contiguous_uniform_sample_helper(partition_weight, count, interim_neighbors, toss, gen);
 
@@ -1182,4 +1583,78 @@ Metadata Partition::GetMetadata() const
 {
     return m_metadata;
 }
+void LocateEdges(const PartitionList &partitions, std::span<const uint32_t> partitions_indices,
+                 std::span<const uint64_t> internal_indices, std::span<const uint32_t> counts,
+                 std::span<const uint64_t> records, std::span<const NodeId> destinations,
+                 std::span<const Type> types, std::span<EdgeLocation> out_locations)
+{
+    assert(records.size() == destinations.size());
+    assert(records.size() == types.size());
+    assert(records.size() == out_locations.size());
+
+    std::fill(std::begin(out_locations), std::end(out_locations), EdgeLocation{});
+    std::vector<size_t> pending;
+    pending.reserve(records.size());
+    for (size_t edge = 0; edge < records.size(); ++edge)
+    {
+        if (records[edge] != Partition::npos)
+        {
+            pending.emplace_back(edge);
+        }
+    }
+
+    // Most sources are stored in a single partition: round k looks for edges not found yet in the k-th partition
+    // of their source, so every partition gets one batch per round.
+    std::vector<std::vector<size_t>> batches(partitions.size());
+    std::vector<uint64_t> batch_sources;
+    std::vector<NodeId> batch_destinations;
+    std::vector<Type> batch_types;
+    std::vector<size_t> batch_edges;
+    for (size_t round = 0; !pending.empty(); ++round)
+    {
+        for (const auto edge : pending)
+        {
+            const auto record = records[edge];
+            if (round < counts[record])
+            {
+                batches[partitions_indices[record + round]].emplace_back(edge);
+            }
+        }
+        pending.clear();
+
+        for (uint32_t partition = 0; partition < partitions.size(); ++partition)
+        {
+            auto &batch = batches[partition];
+            if (batch.empty())
+            {
+                continue;
+            }
+
+            batch_sources.clear();
+            batch_destinations.clear();
+            batch_types.clear();
+            for (const auto edge : batch)
+            {
+                batch_sources.emplace_back(internal_indices[records[edge] + round]);
+                batch_destinations.emplace_back(destinations[edge]);
+                batch_types.emplace_back(types[edge]);
+            }
+            batch_edges.resize(batch.size());
+            partitions[partition]->FindEdges(batch_sources, batch_destinations, batch_types, batch_edges);
+            for (size_t index = 0; index < batch.size(); ++index)
+            {
+                if (batch_edges[index] == Partition::npos)
+                {
+                    pending.emplace_back(batch[index]);
+                }
+                else
+                {
+                    out_locations[batch[index]] = EdgeLocation{partition, batch_edges[index]};
+                }
+            }
+            batch.clear();
+        }
+    }
+}
+
 } // namespace snark
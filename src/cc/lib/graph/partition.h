@@ -5,13 +5,21 @@
 #define SNARK_PARTITION_H
 #include <cstdlib>
 #include <filesystem>
+#include <limits>
+#include <memory>
 #include <random>
 #include <span>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+
+#include "compressed_adjacency.h"
+#include "feature_cache.h"
 #include "metadata.h"
+#include "shared_index.h"
+#include "sparse_features.h"
 #include "storage.h"
 #include "types.h"
 #include "xoroshiro.h"
@@ -23,15 +31,41 @@ namespace snark
 struct Partition
 {
     Partition() = default;
-    Partition(std::filesystem::path path, std::string suffix, PartitionStorageType storage_type);
+    // Node and edge features stored on disk are read through feature_cache if it is provided.
+    // Edge destinations and weights are kept in CompressedAdjacency if compressed_edges is set.
+    // Runs of edges with the same source and type with at least alias_threshold edges get alias tables to
+    // sample weighted neighbors in constant time, 0 disables them.
+    // Dense node features in columnar_features are copied to arrays indexed by internal node id to gather them
+    // without walking per node feature offsets.
+    // Arrays built at load time are mapped from shared_index if it is attached and published to it otherwise,
+    // compressed edges can't be shared.
+    // Runs with at least edge_index_threshold edges get hash tables of destinations to find edges of hub nodes
+    // without searching the run, 0 disables them. The tables are always built in process memory.
+    // Files on HDFS are read with hdfs_read ranges.
+    Partition(std::filesystem::path path, std::string suffix, PartitionStorageType storage_type,
+              std::shared_ptr<FeatureCache> feature_cache = nullptr, bool compressed_edges = false,
+              size_t alias_threshold = 0, std::vector<FeatureId> columnar_features = {},
+              const SharedIndex *shared_index = nullptr, size_t edge_index_threshold = 0,
+              HDFSReadOptions hdfs_read = {});
 
     Type GetNodeType(uint64_t internal_node_id) const;
     bool HasNodeFeatures(uint64_t internal_node_id) const;
     bool GetNodeFeature(uint64_t internal_node_id, std::span<snark::FeatureMeta> features,
                         std::span<uint8_t> output) const;
-    bool GetNodeSparseFeature(uint64_t internal_node_id, std::span<const snark::FeatureId> features, int64_t prefix,
-                              std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
-                              std::vector<std::vector<uint8_t>> &out_values) const;
+
+    // Fetch features for a batch of nodes with a single storage request. All nodes must have features in this
+    // partition, features for internal_node_ids[i] are written to output starting at output_offsets[i].
+    void GetNodeFeature(std::span<const uint64_t> internal_node_ids, std::span<const size_t> output_offsets,
+                        std::span<snark::FeatureMeta> features, std::span<uint8_t> output) const;
+
+    // Load all features of a node into the feature cache if they fit in the budget, budget is reduced by
+    // the size of loaded features. Returns false if features are larger than the budget.
+    bool WarmNodeFeatureCache(uint64_t internal_node_id, uint64_t &budget) const;
+
+    // Append a sparse feature of a node to the current feature of output, the first index of every value is prefix.
+    // Returns false if the node doesn't have features in the partition.
+    bool GetNodeSparseFeature(uint64_t internal_node_id, snark::FeatureId feature, int64_t prefix,
+                              SparseFeatureBatch &output) const;
 
     bool GetNodeStringFeature(uint64_t internal_node_id, std::span<const snark::FeatureId> features,
                               std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_values) const;
@@ -40,15 +74,30 @@ struct Partition
     bool GetEdgeFeature(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type,
                         std::span<snark::FeatureMeta> features, std::span<uint8_t> output) const;
 
-    bool GetEdgeSparseFeature(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type,
-                              std::span<const snark::FeatureId> features, int64_t prefix,
-                              std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
-                              std::vector<std::vector<uint8_t>> &out_values) const;
+    // Position of an edge in the partition or npos if the partition doesn't have it.
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+    size_t FindEdge(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type) const;
+
+    // Same as FindEdge for a batch of edges. Edges are grouped by source and type, so every run is searched once
+    // with increasing destinations instead of a binary search over the whole run for every edge.
+    void FindEdges(std::span<const uint64_t> internal_src_node_ids, std::span<const NodeId> input_edge_dst,
+                   std::span<const Type> input_edge_type, std::span<size_t> out_edges) const;
+
+    // Same as GetEdgeFeature for an edge position returned by FindEdge.
+    void GetEdgeFeature(size_t edge, std::span<snark::FeatureMeta> features, std::span<uint8_t> output) const;
+
+    // Same as GetNodeSparseFeature for an edge position returned by FindEdge.
+    void GetEdgeSparseFeature(size_t edge, snark::FeatureId feature, int64_t prefix,
+                              SparseFeatureBatch &output) const;
 
     bool GetEdgeStringFeature(uint64_t internal_src_node_id, NodeId input_edge_dst, Type input_edge_type,
                               std::span<const snark::FeatureId> features, std::span<int64_t> out_dimensions,
                               std::vector<uint8_t> &out_values) const;
 
+    // Same as GetEdgeStringFeature for an edge position returned by FindEdge.
+    void GetEdgeStringFeature(size_t edge, std::span<const snark::FeatureId> features,
+                              std::span<int64_t> out_dimensions, std::vector<uint8_t> &out_values) const;
+
     // Retrieve total number of neighbors with specified edge types and returns the total number
     // of such neighbors.
     size_t NeighborCount(uint64_t internal_node_id, std::span<const Type> edge_types) const;
@@ -73,19 +122,76 @@ struct Partition
                                std::span<Type> out_types, uint64_t &out_partition_count, NodeId default_node_id,
                                Type default_edge_type) const;
 
+    // Check if the node has an edge to destination with one of edge_types, edge_types are sorted.
+    bool HasEdge(uint64_t internal_node_id, NodeId destination, std::span<const Type> edge_types) const;
+
     Metadata GetMetadata() const;
 
   private:
     void ReadNodeMap(std::filesystem::path path, std::string suffix);
     void ReadNodeIndex(std::filesystem::path path, std::string suffix);
     void ReadEdges(std::filesystem::path path, std::string suffix);
-    void ReadNeighborsIndex(std::filesystem::path path, std::string suffix);
-    void ReadEdgeIndex(std::filesystem::path path, std::string suffix);
+    void ReadEdgeFeatures(std::filesystem::path path, std::string suffix);
+    std::vector<uint64_t> ReadNeighborsIndex(std::filesystem::path path, std::string suffix);
+    void ReadEdgeIndex(std::filesystem::path path, std::string suffix, std::vector<uint64_t> neighbors_index);
     void ReadNodeFeatures(std::filesystem::path path, std::string suffix);
     void ReadNodeFeaturesIndex(std::filesystem::path path, std::string suffix);
     void ReadNodeFeaturesData(std::filesystem::path path, std::string suffix);
     void ReadEdgeFeaturesIndex(std::filesystem::path path, std::string suffix);
     void ReadEdgeFeaturesData(std::filesystem::path path, std::string suffix);
+    void BuildAliasTables(size_t alias_threshold);
+    void BuildEdgeIndex(size_t edge_index_threshold);
+    void BuildEdgeTypeMasks();
+    void BuildFeatureColumns(std::span<const FeatureId> features);
+
+    // Write arrays built at load time to a shared index or map them from it, names start with the suffix.
+    void Publish(const SharedIndex &shared_index, const std::string &suffix) const;
+    void Attach(const SharedIndex &shared_index, const std::string &suffix);
+
+    // Append a sparse feature value stored in [data_offset, data_offset + stored_size) of storage to output.
+    void ReadSparseFeature(const BaseStorage<uint8_t> &storage, uint64_t data_offset, uint64_t stored_size,
+                           int64_t prefix, SparseFeatureBatch &output) const;
+
+    // Open a partition file for reading, file_name is used for remote storage.
+    std::shared_ptr<BaseStorage<uint8_t>> OpenFile(std::filesystem::path path, std::string suffix,
+                                                   open_file_ptr open_file, std::string file_name) const;
+
+    // Load indices from a file: mmap storage type maps the file, everything else is copied to memory.
+    std::span<const uint64_t> ReadIndexFile(std::filesystem::path path, std::string suffix, open_file_ptr open_file,
+                                            std::string file_name);
+
+    // Accessors for edge destinations and cumulative weights within runs of edges with the same source and type.
+    NodeId EdgeDestination(size_t position) const;
+    float EdgeWeightSum(size_t run_first, size_t position) const;
+
+    // Weight of an edge computed from cumulative weights of the run starting at run_first.
+    float EdgeWeight(size_t run_first, size_t position) const;
+
+    // Total weight of edges in a run.
+    float RunWeightSum(size_t run) const;
+
+    // Check a type in an edge type mask and find the run of a type present in the mask of a node.
+    static bool HasEdgeType(uint64_t mask, Type type);
+    size_t MaskedEdgeRun(uint64_t internal_id, uint64_t mask, Type type) const;
+
+    // Call func(first, last, run) for runs of the node with sorted edge_types in the order of types, edges of the
+    // run are in [first, last). Returns the number of edges in visited runs.
+    template <typename F> size_t ForEachTypeRun(uint64_t internal_id, std::span<const Type> edge_types, F func) const;
+
+    // Return first position in [first, last) with destination not less than value or last.
+    size_t FindEdgeDestination(size_t first, size_t last, NodeId value) const;
+
+    // Index of the run with edges of a type in m_edge_types or npos if the node doesn't have such edges.
+    size_t FindEdgeRun(uint64_t internal_src_node_id, Type type) const;
+
+    // Position of the first edge to destination in a run ending at last or npos. Searches start from the cursor,
+    // which is moved to the found position, so callers looking for increasing destinations skip searched edges.
+    size_t FindRunEdge(size_t run, size_t &cursor, size_t last, NodeId destination) const;
+
+    // Destinations and cumulative weights of a run of edges in [first, last). Short compressed runs are decoded
+    // into the buffer, empty spans are returned for long compressed runs to be searched in place.
+    std::span<const NodeId> RunDestinations(size_t first, size_t last, std::vector<NodeId> &buffer) const;
+    std::span<const float> RunWeightSums(size_t first, size_t last, std::vector<float> &buffer) const;
 
     void UniformSampleNeighborWithoutReplacement(int64_t seed, uint64_t internal_node_ids,
                                                  std::span<const Type> in_edge_types, uint64_t count,
@@ -106,26 +212,87 @@ struct Partition
 
     // Node features
     std::shared_ptr<BaseStorage<uint8_t>> m_node_features;
-    std::vector<uint64_t> m_node_index;
-    std::vector<uint64_t> m_node_feature_index;
+    std::span<const uint64_t> m_node_index;
+    std::span<const uint64_t> m_node_feature_index;
+
+    // Features of every node stored contiguously with the size of the largest stored value, shorter values are
+    // padded with 0s. Bit i of m_present is set if node i has a non empty value.
+    struct FeatureColumn
+    {
+        FeatureSize m_size = 0;
+        std::span<const uint8_t> m_values;
+        std::span<const uint64_t> m_present;
+
+        bool Present(uint64_t internal_node_id) const
+        {
+            return (m_present[internal_node_id / 64] >> (internal_node_id % 64)) & 1;
+        }
+    };
+    absl::flat_hash_map<FeatureId, FeatureColumn> m_feature_columns;
 
     // Edge features
     std::shared_ptr<BaseStorage<uint8_t>> m_edge_features;
-    std::vector<uint64_t> m_edge_feature_index;
-    std::vector<uint64_t> m_edge_feature_offset;
+    std::span<const uint64_t> m_edge_feature_index;
+    std::span<const uint64_t> m_edge_feature_offset;
 
     // Neighbor/edge indices
-    std::vector<Type> m_edge_types;
-    std::vector<uint64_t> m_edge_type_offset;
-    std::vector<NodeId> m_edge_destination;
-    std::vector<float> m_edge_weights;
+    std::span<const Type> m_edge_types;
+    std::span<const uint64_t> m_edge_type_offset;
+    std::span<const NodeId> m_edge_destination;
+    std::span<const float> m_edge_weights;
+    CompressedAdjacency m_compressed_edges;
+    bool m_use_compressed_edges = false;
+
+    // Bit t of m_edge_type_masks[i] is set if node i has edges of type t, then runs of a type are found
+    // without reading the types of the node runs. Masks are empty if a partition has types of 64 or more.
+    // Total weights of runs are kept in m_run_weight_sums for compressed edges to avoid decoding blocks.
+    std::span<const uint64_t> m_edge_type_masks;
+    std::span<const float> m_run_weight_sums;
 
-    std::vector<uint64_t> m_neighbors_index;
+    // Vose alias tables of long runs: m_alias_offsets maps a run to the offset of its table in m_alias_table.
+    // Sampling picks an edge i of the run uniformly and keeps it with the column probability or takes the column
+    // alias otherwise, positions are relative to the run start.
+    struct AliasColumn
+    {
+        float m_probability;
+        uint32_t m_alias;
+    };
+    absl::flat_hash_map<uint64_t, uint64_t> m_alias_offsets;
+    std::span<const AliasColumn> m_alias_table;
 
-    std::vector<Type> m_node_types;
+    // Position of the first edge with a destination in runs of at least m_edge_index_threshold edges, keyed by
+    // run and destination.
+    absl::flat_hash_map<std::pair<uint64_t, NodeId>, uint64_t> m_edge_index;
+    size_t m_edge_index_threshold = 0;
+
+    std::span<const uint64_t> m_neighbors_index;
+
+    std::span<const Type> m_node_types;
     Metadata m_metadata;
     PartitionStorageType m_storage_type;
+    std::shared_ptr<FeatureCache> m_feature_cache;
+
+    // Owners of memory referenced by spans above: either mapped files or vectors.
+    std::vector<std::shared_ptr<const void>> m_index_buffers;
+};
+
+// Loaded partitions are immutable and shared, so a reloaded graph reuses partitions with unchanged files.
+using PartitionList = std::vector<std::shared_ptr<const Partition>>;
+
+// Partition and position of an edge found by LocateEdges, m_edge is Partition::npos if the edge wasn't found.
+struct EdgeLocation
+{
+    uint32_t m_partition = 0;
+    size_t m_edge = Partition::npos;
 };
 
+// Find a batch of edges in partitions of their sources. records[i] is the node index record of the source of
+// edge i or Partition::npos for unknown sources, record partitions are partitions_indices[record + k] for k less
+// than counts[record]. Like per edge lookups, the first of the source partitions with the edge is taken.
+void LocateEdges(const PartitionList &partitions, std::span<const uint32_t> partitions_indices,
+                 std::span<const uint64_t> internal_indices, std::span<const uint32_t> counts,
+                 std::span<const uint64_t> records, std::span<const NodeId> destinations,
+                 std::span<const Type> types, std::span<EdgeLocation> out_locations);
+
 } // namespace snark
 #endif
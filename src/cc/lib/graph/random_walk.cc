@@ -0,0 +1,150 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "random_walk.h"
+
+#include <algorithm>
+
+#include "boost/random/uniform_real_distribution.hpp"
+
+namespace snark
+{
+
+Node2VecWalker::Node2VecWalker(const PartitionList &partitions, const NodeIndex &node_map,
+                               std::span<const uint32_t> partitions_indices,
+                               std::span<const uint64_t> internal_indices, std::span<const uint32_t> counts, float p,
+                               float q, std::span<const Type> edge_types)
+    : m_partitions(partitions), m_node_map(node_map), m_partitions_indices(partitions_indices),
+      m_internal_indices(internal_indices), m_counts(counts), m_edge_types(edge_types), m_return_weight(1.0f / p),
+      m_out_weight(1.0f / q)
+{
+}
+
+WalkStatus Node2VecWalker::Walk(uint64_t seed, size_t walk_length, size_t step, NodeId previous, NodeId current,
+                                std::span<const NodeId> previous_neighbors, std::vector<NodeId> &path,
+                                std::vector<NodeId> &last_neighbors) const
+{
+    auto index = m_node_map.Find(current);
+    if (index == NodeIndex::npos)
+    {
+        return WalkStatus::missing;
+    }
+
+    // Previous node of the first step might be stored elsewhere, use its neighbors from the caller then.
+    auto previous_index = NodeIndex::npos;
+    boost::random::uniform_real_distribution<float> toss(0, 1);
+    for (; step < walk_length; ++step)
+    {
+        Xoroshiro128PlusGenerator engine(seed + step);
+
+        // Return weight is a valid upper bound only if it is possible to go back.
+        float max_weight = std::max(1.0f, m_out_weight);
+        if (step > 0 && m_return_weight > max_weight && HasEdge(index, previous))
+        {
+            max_weight = m_return_weight;
+        }
+
+        NodeId next = 0;
+        while (true)
+        {
+            if (!SampleCandidate(engine, index, next))
+            {
+                return WalkStatus::finished;
+            }
+            if (step == 0)
+            {
+                break;
+            }
+
+            float weight = 1.0f;
+            if (next == previous)
+            {
+                weight = m_return_weight;
+            }
+            else if (NeedsPreviousNeighbors())
+            {
+                const bool close = previous_index == NodeIndex::npos
+                                       ? std::binary_search(std::begin(previous_neighbors),
+                                                            std::end(previous_neighbors), next)
+                                       : HasEdge(previous_index, next);
+                weight = close ? 1.0f : m_out_weight;
+            }
+            if (weight >= max_weight || toss(engine) * max_weight < weight)
+            {
+                break;
+            }
+        }
+
+        path.emplace_back(next);
+        previous = current;
+        previous_index = index;
+        current = next;
+        index = m_node_map.Find(next);
+        if (index == NodeIndex::npos)
+        {
+            if (step + 1 == walk_length)
+            {
+                return WalkStatus::finished;
+            }
+
+            last_neighbors.clear();
+            if (NeedsPreviousNeighbors())
+            {
+                Neighbors(previous_index, last_neighbors);
+            }
+            return WalkStatus::moved;
+        }
+    }
+
+    return WalkStatus::finished;
+}
+
+bool Node2VecWalker::NeedsPreviousNeighbors() const
+{
+    return m_out_weight != 1.0f;
+}
+
+bool Node2VecWalker::SampleCandidate(Xoroshiro128PlusGenerator &engine, uint64_t index, NodeId &candidate) const
+{
+    float total_weight = 0;
+    float weight = 0;
+    Type type = 0;
+    for (size_t partition = 0; partition < m_counts[index]; ++partition)
+    {
+        m_partitions[m_partitions_indices[index + partition]]->SampleNeighbor(
+            int64_t(engine()), m_internal_indices[index + partition], m_edge_types, 1, std::span(&candidate, 1),
+            std::span(&type, 1), std::span(&weight, 1), total_weight, candidate, 0, 0);
+    }
+
+    return total_weight > 0;
+}
+
+bool Node2VecWalker::HasEdge(uint64_t index, NodeId destination) const
+{
+    for (size_t partition = 0; partition < m_counts[index]; ++partition)
+    {
+        if (m_partitions[m_partitions_indices[index + partition]]->HasEdge(m_internal_indices[index + partition],
+                                                                           destination, m_edge_types))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Node2VecWalker::Neighbors(uint64_t index, std::vector<NodeId> &output) const
+{
+    std::vector<Type> types;
+    std::vector<float> weights;
+    for (size_t partition = 0; partition < m_counts[index]; ++partition)
+    {
+        m_partitions[m_partitions_indices[index + partition]]->FullNeighbor(m_internal_indices[index + partition],
+                                                                            m_edge_types, output, types, weights);
+    }
+
+    std::sort(std::begin(output), std::end(output));
+    output.erase(std::unique(std::begin(output), std::end(output)), std::end(output));
+}
+
+} // namespace snark
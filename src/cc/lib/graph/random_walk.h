@@ -0,0 +1,75 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_RANDOM_WALK_H
+#define SNARK_RANDOM_WALK_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "node_index.h"
+#include "partition.h"
+#include "types.h"
+#include "xoroshiro.h"
+
+namespace snark
+{
+
+enum class WalkStatus : uint32_t
+{
+    // Walk made all steps or reached a node without neighbors.
+    finished = 0,
+
+    // Walk moved to a node stored elsewhere.
+    moved = 1,
+
+    // Current node of the walk is not stored.
+    missing = 2
+};
+
+// Node2vec random walks over node records of a graph or a server shard. Candidates for the next step from node v
+// with previous node t are sampled proportionally to edge weights and accepted with probability
+// alpha(x) / max(alpha), where alpha is 1/p for x == t, 1 if x is a neighbor of t and 1/q otherwise, so neighbor
+// lists are never collected. Every step uses a generator seeded with the walk seed and the step number, so
+// walks are the same no matter how they are split between shards.
+class Node2VecWalker
+{
+  public:
+    // Edge types have to be sorted and unique.
+    Node2VecWalker(const PartitionList &partitions, const NodeIndex &node_map,
+                   std::span<const uint32_t> partitions_indices, std::span<const uint64_t> internal_indices,
+                   std::span<const uint32_t> counts, float p, float q, std::span<const Type> edge_types);
+
+    // Continue a walk from current node, made step steps so far, with previous node before it. Visited nodes are
+    // appended to path until the walk makes walk_length steps. previous_neighbors are sorted neighbors of the
+    // previous node, they are required if step > 0 and NeedsPreviousNeighbors() is true. If the walk moves to a
+    // node stored elsewhere, last_neighbors are set to neighbors of the node before it to continue the walk there.
+    WalkStatus Walk(uint64_t seed, size_t walk_length, size_t step, NodeId previous, NodeId current,
+                    std::span<const NodeId> previous_neighbors, std::vector<NodeId> &path,
+                    std::vector<NodeId> &last_neighbors) const;
+
+    // Neighbors of the previous node are used only if walks are biased to stay close to it.
+    bool NeedsPreviousNeighbors() const;
+
+  private:
+    // Sample a neighbor proportionally to edge weights, returns false if the node doesn't have neighbors.
+    bool SampleCandidate(Xoroshiro128PlusGenerator &engine, uint64_t index, NodeId &candidate) const;
+    bool HasEdge(uint64_t index, NodeId destination) const;
+    void Neighbors(uint64_t index, std::vector<NodeId> &output) const;
+
+    const PartitionList &m_partitions;
+    const NodeIndex &m_node_map;
+    std::span<const uint32_t> m_partitions_indices;
+    std::span<const uint64_t> m_internal_indices;
+    std::span<const uint32_t> m_counts;
+    std::span<const Type> m_edge_types;
+
+    // Unnormalized transition probabilities to return to the previous node and to move away from it.
+    float m_return_weight;
+    float m_out_weight;
+};
+
+} // namespace snark
+
+#endif // SNARK_RANDOM_WALK_H
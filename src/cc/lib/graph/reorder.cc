@@ -0,0 +1,324 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "reorder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+
+#include "absl/container/flat_hash_map.h"
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+
+namespace
+{
+using snark::NodeId;
+using snark::Type;
+
+// Record of node_{suffix}.map files.
+const size_t node_map_record_size = sizeof(NodeId) + sizeof(uint64_t) + sizeof(Type);
+
+// Record of edge_{suffix}.index files, feature offset is a position in the edge features index.
+struct EdgeRecord
+{
+    NodeId m_dst;
+    uint64_t m_feature_offset;
+    Type m_type;
+    float m_weight;
+};
+static_assert(sizeof(EdgeRecord) == sizeof(NodeId) + sizeof(uint64_t) + sizeof(Type) + sizeof(float));
+
+template <typename T> std::vector<T> read_file(const std::filesystem::path &path)
+{
+    std::ifstream input(path, std::ios::binary | std::ios::ate);
+    if (!input)
+    {
+        RAW_LOG_FATAL("Failed to open %s for reading", path.string().c_str());
+    }
+
+    std::vector<T> data(size_t(input.tellg()) / sizeof(T));
+    input.seekg(0);
+    if (!input.read(reinterpret_cast<char *>(data.data()), data.size() * sizeof(T)))
+    {
+        RAW_LOG_FATAL("Failed to read %s", path.string().c_str());
+    }
+
+    return data;
+}
+
+template <typename T> void write_file(const std::filesystem::path &path, const std::vector<T> &data)
+{
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(T)))
+    {
+        RAW_LOG_FATAL("Failed to write %s", path.string().c_str());
+    }
+}
+
+// Copy an index block [first, last) pointing into data with its data, rebasing offsets to the end of outputs.
+void copy_block(const std::vector<uint64_t> &index, const std::vector<uint8_t> &data, uint64_t first, uint64_t last,
+                std::vector<uint64_t> &out_index, std::vector<uint8_t> &out_data)
+{
+    const auto data_first = index[first];
+    const auto data_last = index[last];
+    for (auto entry = first; entry < last; ++entry)
+    {
+        out_index.emplace_back(index[entry] - data_first + out_data.size());
+    }
+
+    out_data.insert(std::end(out_data), std::begin(data) + data_first, std::begin(data) + data_last);
+}
+
+double average_gap(const std::vector<uint64_t> &sources, const std::vector<uint64_t> &destinations,
+                   const std::vector<uint64_t> &positions)
+{
+    if (sources.empty())
+    {
+        return 0;
+    }
+
+    double total = 0;
+    for (size_t edge = 0; edge < sources.size(); ++edge)
+    {
+        const auto src = positions[sources[edge]];
+        const auto dst = positions[destinations[edge]];
+        total += double(src > dst ? src - dst : dst - src);
+    }
+
+    return total / double(sources.size());
+}
+} // namespace
+
+namespace snark
+{
+
+std::vector<uint64_t> ComputeNodeOrder(NodeOrder order, const std::vector<uint64_t> &offsets,
+                                       const std::vector<uint64_t> &neighbors)
+{
+    const size_t count = offsets.empty() ? 0 : offsets.size() - 1;
+    std::vector<uint64_t> result(count);
+    std::iota(std::begin(result), std::end(result), 0);
+    const auto degree = [&offsets](uint64_t node) { return offsets[node + 1] - offsets[node]; };
+    const auto by_degree = [&degree](uint64_t left, uint64_t right) { return degree(left) < degree(right); };
+    if (order == NodeOrder::input)
+    {
+        return result;
+    }
+
+    if (order == NodeOrder::degree)
+    {
+        std::stable_sort(std::begin(result), std::end(result),
+                         [&degree](uint64_t left, uint64_t right) { return degree(left) > degree(right); });
+        return result;
+    }
+
+    // Every connected component is traversed from its node with the lowest degree, neighbors are queued in the
+    // order of increasing degree.
+    std::vector<uint64_t> starts = std::move(result);
+    std::stable_sort(std::begin(starts), std::end(starts), by_degree);
+    std::vector<bool> visited(count);
+    result.clear();
+    result.reserve(count);
+    for (auto start : starts)
+    {
+        if (visited[start])
+        {
+            continue;
+        }
+
+        visited[start] = true;
+        result.emplace_back(start);
+        for (size_t head = result.size() - 1; head < result.size(); ++head)
+        {
+            const auto node = result[head];
+            const auto first_new = result.size();
+            for (auto position = offsets[node]; position < offsets[node + 1]; ++position)
+            {
+                const auto neighbor = neighbors[position];
+                if (!visited[neighbor])
+                {
+                    visited[neighbor] = true;
+                    result.emplace_back(neighbor);
+                }
+            }
+
+            std::stable_sort(std::begin(result) + first_new, std::end(result), by_degree);
+        }
+    }
+
+    std::reverse(std::begin(result), std::end(result));
+    return result;
+}
+
+ReorderStats ReorderPartition(std::filesystem::path path, std::string suffix, NodeOrder order)
+{
+    const auto node_map_path = path / ("node_" + suffix + ".map");
+    const auto node_index_path = path / ("node_" + suffix + ".index");
+    const auto node_features_index_path = path / ("node_features_" + suffix + ".index");
+    const auto node_features_data_path = path / ("node_features_" + suffix + ".data");
+    const auto neighbors_index_path = path / ("neighbors_" + suffix + ".index");
+    const auto edge_index_path = path / ("edge_" + suffix + ".index");
+    const auto edge_features_index_path = path / ("edge_features_" + suffix + ".index");
+    const auto edge_features_data_path = path / ("edge_features_" + suffix + ".data");
+
+    const auto node_map = read_file<uint8_t>(node_map_path);
+    const size_t count = node_map.size() / node_map_record_size;
+    const auto neighbors_index = read_file<uint64_t>(neighbors_index_path);
+    const auto edges = read_file<EdgeRecord>(edge_index_path);
+    if (neighbors_index.size() != count + 1 || edges.size() != neighbors_index.back() + 1)
+    {
+        RAW_LOG_FATAL("Edges of partition %s don't match its nodes", suffix.c_str());
+    }
+
+    absl::flat_hash_map<NodeId, uint64_t> indices;
+    indices.reserve(count);
+    for (size_t node = 0; node < count; ++node)
+    {
+        NodeId id;
+        std::memcpy(&id, node_map.data() + node * node_map_record_size, sizeof(NodeId));
+        indices.emplace(id, node);
+    }
+
+    // Edges with both endpoints in the partition, stored in both directions for the traversal.
+    std::vector<uint64_t> sources;
+    std::vector<uint64_t> destinations;
+    std::vector<uint64_t> offsets(count + 1);
+    for (size_t node = 0; node < count; ++node)
+    {
+        for (auto edge = neighbors_index[node]; edge < neighbors_index[node + 1]; ++edge)
+        {
+            const auto it = indices.find(edges[edge].m_dst);
+            if (it != std::end(indices) && it->second != node)
+            {
+                sources.emplace_back(node);
+                destinations.emplace_back(it->second);
+                ++offsets[node + 1];
+                ++offsets[it->second + 1];
+            }
+        }
+    }
+
+    std::partial_sum(std::begin(offsets), std::end(offsets), std::begin(offsets));
+    std::vector<uint64_t> neighbors(offsets.back());
+    {
+        auto next = offsets;
+        for (size_t edge = 0; edge < sources.size(); ++edge)
+        {
+            neighbors[next[sources[edge]]++] = destinations[edge];
+            neighbors[next[destinations[edge]]++] = sources[edge];
+        }
+    }
+
+    const auto new_order = ComputeNodeOrder(order, offsets, neighbors);
+    std::vector<uint64_t> positions(count);
+    for (size_t position = 0; position < count; ++position)
+    {
+        positions[new_order[position]] = position;
+    }
+
+    ReorderStats stats{.m_local_edges = sources.size()};
+    {
+        std::vector<uint64_t> identity(count);
+        std::iota(std::begin(identity), std::end(identity), 0);
+        stats.m_gap_before = average_gap(sources, destinations, identity);
+        stats.m_gap_after = average_gap(sources, destinations, positions);
+    }
+
+    if (order == NodeOrder::input)
+    {
+        return stats;
+    }
+
+    {
+        std::vector<uint8_t> new_node_map(node_map.size());
+        for (size_t position = 0; position < count; ++position)
+        {
+            auto *record = new_node_map.data() + position * node_map_record_size;
+            std::memcpy(record, node_map.data() + new_order[position] * node_map_record_size, node_map_record_size);
+            const uint64_t index = position;
+            std::memcpy(record + sizeof(NodeId), &index, sizeof(index));
+        }
+
+        write_file(node_map_path, new_node_map);
+    }
+
+    // Features of a node occupy a contiguous block of the features index and data, so blocks are moved as a whole.
+    {
+        const auto node_index = read_file<uint64_t>(node_index_path);
+        const auto features_index = read_file<uint64_t>(node_features_index_path);
+        const auto features_data = read_file<uint8_t>(node_features_data_path);
+        if (node_index.size() != count + 1 || features_index.size() != node_index.back() + 1 ||
+            features_data.size() != features_index.back())
+        {
+            RAW_LOG_FATAL("Node features of partition %s don't match its nodes", suffix.c_str());
+        }
+
+        std::vector<uint64_t> new_node_index;
+        std::vector<uint64_t> new_features_index;
+        std::vector<uint8_t> new_features_data;
+        new_node_index.reserve(node_index.size());
+        new_features_index.reserve(features_index.size());
+        new_features_data.reserve(features_data.size());
+        for (auto node : new_order)
+        {
+            new_node_index.emplace_back(new_features_index.size());
+            copy_block(features_index, features_data, node_index[node], node_index[node + 1], new_features_index,
+                       new_features_data);
+        }
+
+        new_node_index.emplace_back(new_features_index.size());
+        new_features_index.emplace_back(new_features_data.size());
+        write_file(node_index_path, new_node_index);
+        write_file(node_features_index_path, new_features_index);
+        write_file(node_features_data_path, new_features_data);
+    }
+
+    {
+        const auto features_index = read_file<uint64_t>(edge_features_index_path);
+        const auto features_data = read_file<uint8_t>(edge_features_data_path);
+        if (features_index.size() != edges.back().m_feature_offset + 1 || features_data.size() != features_index.back())
+        {
+            RAW_LOG_FATAL("Edge features of partition %s don't match its edges", suffix.c_str());
+        }
+
+        std::vector<uint64_t> new_neighbors_index;
+        std::vector<EdgeRecord> new_edges;
+        std::vector<uint64_t> new_features_index;
+        std::vector<uint8_t> new_features_data;
+        new_neighbors_index.reserve(neighbors_index.size());
+        new_edges.reserve(edges.size());
+        new_features_index.reserve(features_index.size());
+        new_features_data.reserve(features_data.size());
+        for (auto node : new_order)
+        {
+            const auto first = neighbors_index[node];
+            const auto last = neighbors_index[node + 1];
+            const auto features_first = edges[first].m_feature_offset;
+            new_neighbors_index.emplace_back(new_edges.size());
+            for (auto edge = first; edge < last; ++edge)
+            {
+                auto &record = new_edges.emplace_back(edges[edge]);
+                record.m_feature_offset = record.m_feature_offset - features_first + new_features_index.size();
+            }
+
+            copy_block(features_index, features_data, features_first, edges[last].m_feature_offset,
+                       new_features_index, new_features_data);
+        }
+
+        new_neighbors_index.emplace_back(new_edges.size());
+        auto &sentinel = new_edges.emplace_back(edges.back());
+        sentinel.m_feature_offset = new_features_index.size();
+        new_features_index.emplace_back(new_features_data.size());
+        write_file(neighbors_index_path, new_neighbors_index);
+        write_file(edge_index_path, new_edges);
+        write_file(edge_features_index_path, new_features_index);
+        write_file(edge_features_data_path, new_features_data);
+    }
+
+    return stats;
+}
+
+} // namespace snark
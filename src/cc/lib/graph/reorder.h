@@ -0,0 +1,51 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_REORDER_H
+#define SNARK_REORDER_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace snark
+{
+
+// Order of nodes inside a partition. Internal node indices define where node features and edges are stored, so
+// placing connected nodes next to each other makes multi hop lookups touch fewer cache lines and pages.
+enum class NodeOrder : int32_t
+{
+    // Keep the order of the input files.
+    input = 0,
+
+    // Nodes with more edges inside the partition first, so frequently sampled hubs share pages.
+    degree = 1,
+
+    // Reverse Cuthill-McKee: breadth first traversal of the undirected graph formed by edges inside the partition,
+    // which keeps neighbors of every node in a narrow band of indices.
+    rcm = 2,
+};
+
+// Locality of a partition measured as the average distance between internal indices of edge endpoints, only edges
+// with both endpoints in the partition are counted.
+struct ReorderStats
+{
+    size_t m_local_edges = 0;
+    double m_gap_before = 0;
+    double m_gap_after = 0;
+};
+
+// Return new internal order of nodes as old indices. Edges are given as adjacency lists of old indices, every edge
+// has to be present in the lists of both endpoints.
+std::vector<uint64_t> ComputeNodeOrder(NodeOrder order, const std::vector<uint64_t> &offsets,
+                                       const std::vector<uint64_t> &neighbors);
+
+// Renumber nodes of a converted partition stored in path with files suffix (e.g. "0_0") and rewrite its node map,
+// node features and edges in the new order. Alias tables refer to original node ids and stay valid.
+ReorderStats ReorderPartition(std::filesystem::path path, std::string suffix, NodeOrder order);
+
+} // namespace snark
+#endif // SNARK_REORDER_H
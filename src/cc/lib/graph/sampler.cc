@@ -3,17 +3,22 @@
 
 #include "sampler.h"
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
 #include <iterator>
 #include <numeric>
+#include <optional>
 #include <random>
 #include <type_traits>
 
 #include "locator.h"
+#include "node_index.h"
+#include "parallel.h"
 #include "storage.h"
+#include "uniform.h"
 #include "xoroshiro.h"
 
 #include "absl/container/flat_hash_set.h"
@@ -23,6 +28,55 @@
 #include <glog/logging.h>
 #include <glog/raw_logging.h>
 
+namespace
+{
+// Number of alias records to read from storage at once.
+constexpr size_t alias_chunk_size = 1 << 16;
+
+std::shared_ptr<BaseStorage<uint8_t>> open_alias(const snark::Metadata &meta, snark::Type tp, size_t partition,
+                                                 snark::SamplerElement element)
+{
+    if (!is_hdfs_path(meta.m_path))
+    {
+        const auto open = element == snark::SamplerElement::Node ? snark::open_node_alias : snark::open_edge_alias;
+        return std::make_shared<DiskStorage<uint8_t>>(meta.m_path, partition, tp, open);
+    }
+
+    const std::string prefix = element == snark::SamplerElement::Node ? "node_" : "edge_";
+    auto full_path =
+        std::filesystem::path(meta.m_path) / (prefix + std::to_string(tp) + "_" + std::to_string(partition) + ".alias");
+    return std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), meta.m_config_path, meta.m_hdfs_read);
+}
+
+// Alias tables are stored as packed records of id_count node ids followed by a threshold. Records are read in
+// large chunks with a single storage call each and fields are copied out of a chunk to call func(ids, threshold).
+template <size_t id_count, typename Func> void read_alias_records(BaseStorage<uint8_t> &storage, Func func)
+{
+    constexpr size_t record_size = id_count * sizeof(snark::NodeId) + sizeof(float);
+    const size_t record_count = storage.size() / record_size;
+    auto file_ptr = storage.start();
+    std::vector<uint8_t> chunk(std::min(record_count, alias_chunk_size) * record_size);
+    std::array<snark::NodeId, id_count> ids;
+    float threshold;
+    for (size_t offset = 0; offset < record_count; offset += alias_chunk_size)
+    {
+        const size_t count = std::min(alias_chunk_size, record_count - offset);
+        if (count != storage.read(chunk.data(), record_size, count, file_ptr))
+        {
+            RAW_LOG_FATAL("Failed to read records from alias table");
+        }
+
+        const uint8_t *record = chunk.data();
+        for (size_t i = 0; i < count; ++i, record += record_size)
+        {
+            memcpy(ids.data(), record, sizeof(ids));
+            memcpy(&threshold, record + sizeof(ids), sizeof(float));
+            func(ids, threshold);
+        }
+    }
+}
+} // namespace
+
 namespace snark
 {
 
@@ -163,7 +217,9 @@ std::unique_ptr<Sampler> AbstractSamplerFactory<Partition, element>::Create(std:
                                                                             std::set<size_t> partition_indices)
 {
     std::vector<Type> types;
-    std::vector<std::shared_ptr<std::vector<Partition>>> partitions;
+    std::vector<TypePartitionsFuture> loaded;
+    std::vector<Type> missing;
+    std::vector<std::promise<TypePartitions>> promises;
     {
         std::lock_guard guard(m_mtx);
 
@@ -185,66 +241,88 @@ std::unique_ptr<Sampler> AbstractSamplerFactory<Partition, element>::Create(std:
                 continue;
             }
 
-            if (!m_types.contains(t))
+            // Publish futures for missing types, so concurrent requests wait for the same load.
+            auto it = m_types.find(t);
+            if (it == std::end(m_types))
             {
-                Read(t, partition_indices);
+                missing.emplace_back(t);
+                promises.emplace_back();
+                it = m_types.emplace(t, promises.back().get_future().share()).first;
             }
 
             types.emplace_back(t);
-            partitions.emplace_back(m_types[t]);
+            loaded.emplace_back(it->second);
+        }
+    }
+
+    // Alias tables are read without holding the lock.
+    if (!missing.empty())
+    {
+        try
+        {
+            auto partitions = Read(missing, partition_indices);
+            for (size_t i = 0; i < missing.size(); ++i)
+            {
+                promises[i].set_value(std::move(partitions[i]));
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard guard(m_mtx);
+            for (size_t i = 0; i < missing.size(); ++i)
+            {
+                m_types.erase(missing[i]);
+                promises[i].set_exception(std::current_exception());
+            }
+            throw;
         }
     }
 
+    std::vector<TypePartitions> partitions;
+    partitions.reserve(loaded.size());
+    for (auto &future : loaded)
+    {
+        partitions.emplace_back(future.get());
+    }
+
     return std::make_unique<SamplerImpl<Partition, element>>(std::move(types), std::move(partitions));
 }
 
 template <typename Partition, SamplerElement element>
-void AbstractSamplerFactory<Partition, element>::Read(Type type, const std::set<size_t> &partition_indices)
+std::vector<typename AbstractSamplerFactory<Partition, element>::TypePartitions> AbstractSamplerFactory<
+    Partition, element>::Read(const std::vector<Type> &types, const std::set<size_t> &partition_indices) const
 {
-    std::vector<Partition> res;
-    for (auto p : partition_indices)
-    {
-        res.emplace_back(m_metadata, type, p);
+    // Every partition of every type is loaded by a separate task.
+    const std::vector<size_t> partitions(std::begin(partition_indices), std::end(partition_indices));
+    std::vector<std::optional<Partition>> tables(types.size() * partitions.size());
+    parallel_for(tables.size(), [&](size_t index) {
+        tables[index].emplace(m_metadata, types[index / partitions.size()], partitions[index % partitions.size()]);
+    });
+
+    std::vector<TypePartitions> result;
+    result.reserve(types.size());
+    for (size_t type_index = 0; type_index < types.size(); ++type_index)
+    {
+        auto type_partitions = std::make_shared<std::vector<Partition>>();
+        type_partitions->reserve(partitions.size());
+        for (size_t p = 0; p < partitions.size(); ++p)
+        {
+            type_partitions->emplace_back(std::move(*tables[type_index * partitions.size() + p]));
+        }
+        result.emplace_back(std::move(type_partitions));
     }
 
-    m_types[type] = std::make_shared<std::vector<Partition>>(std::move(res));
+    return result;
 }
 
-WeightedNodeSamplerPartition::WeightedNodeSamplerPartition(Metadata meta, Type tp, size_t partition)
+WeightedNodeSamplerPartition::WeightedNodeSamplerPartition(const Metadata &meta, Type tp, size_t partition)
     : m_weight(meta.m_partition_node_weights[partition][tp])
 {
-    std::shared_ptr<BaseStorage<uint8_t>> node_weights;
-    if (!is_hdfs_path(meta.m_path))
-    {
-        node_weights = std::make_shared<DiskStorage<uint8_t>>(meta.m_path, partition, tp, open_node_alias);
-    }
-    else
-    {
-        auto full_path = std::filesystem::path(meta.m_path) /
-                         ("node_" + std::to_string(tp) + "_" + std::to_string(partition) + ".alias");
-        node_weights = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), meta.m_config_path);
-    }
-    auto node_weights_ptr = node_weights->start();
-    size_t record_size = node_weights->size() / (2 * sizeof(NodeId) + sizeof(float));
-
-    m_records.reserve(record_size);
-    for (size_t i = 0; i < record_size; ++i)
-    {
-        m_records.emplace_back();
-        auto &back = m_records.back();
-        if (1 != node_weights->read(&back.m_left, 8, 1, node_weights_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read node from alias table");
-        }
-        if (1 != node_weights->read(&back.m_right, 8, 1, node_weights_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read alias from alias table");
-        }
-        if (1 != node_weights->read(&back.m_threshold, 4, 1, node_weights_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read probability from alias table");
-        }
-    }
+    auto node_weights = open_alias(meta, tp, partition, SamplerElement::Node);
+    m_records.reserve(node_weights->size() / (2 * sizeof(NodeId) + sizeof(float)));
+    read_alias_records<2>(*node_weights, [this](const auto &ids, float threshold) {
+        m_records.emplace_back(WeightedNodeSamplerRecord{ids[0], ids[1], threshold});
+    });
 }
 
 WeightedNodeSamplerPartition::WeightedNodeSamplerPartition(std::vector<WeightedNodeSamplerRecord> records, float weight)
@@ -260,13 +338,27 @@ void WeightedNodeSamplerPartition::Sample(int64_t seed, std::span<NodeId> out) c
     }
 
     snark::Xoroshiro128PlusGenerator gen(seed);
-    boost::random::uniform_real_distribution<float> toss(0, 1.0f);
-    for (auto &n : out)
-    {
-        // Use toss mutliple times instead of uniform_int_distribution for
-        // performance reasons.
-        const auto &record = m_records[toss(gen) * m_records.size()];
-        n = toss(gen) < record.m_threshold ? record.m_left : record.m_right;
+    snark::UniformReals toss(gen);
+    std::array<size_t, snark::UniformReals::batch_size / 2> picks;
+    for (size_t first = 0; first < out.size(); first += picks.size())
+    {
+        // Every sample uses a pair of tosses: one to pick a record and another to select a node in it. Records
+        // of a batch are picked and prefetched before they are read to hide cache misses.
+        const size_t count = std::min(picks.size(), out.size() - first);
+        const auto tosses = toss.Next(2 * count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            // Use toss mutliple times instead of uniform_int_distribution for
+            // performance reasons.
+            picks[i] = tosses[2 * i] * m_records.size();
+            prefetch(&m_records[picks[i]]);
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto &record = m_records[picks[i]];
+            out[first + i] = tosses[2 * i + 1] < record.m_threshold ? record.m_left : record.m_right;
+        }
     }
 }
 
@@ -281,47 +373,22 @@ bool WeightedNodeSamplerPartition::Replacement() const
 }
 
 template <bool WithReplacement>
-UniformNodeSamplerPartition<WithReplacement>::UniformNodeSamplerPartition(Metadata meta, Type tp, size_t partition)
+UniformNodeSamplerPartition<WithReplacement>::UniformNodeSamplerPartition(const Metadata &meta, Type tp,
+                                                                          size_t partition)
 {
     absl::flat_hash_set<NodeId> node_set;
-    std::shared_ptr<BaseStorage<uint8_t>> node_weights;
-    if (!is_hdfs_path(meta.m_path))
-    {
-        node_weights = std::make_shared<DiskStorage<uint8_t>>(meta.m_path, partition, tp, open_node_alias);
-    }
-    else
-    {
-        auto full_path = std::filesystem::path(meta.m_path) /
-                         ("node_" + std::to_string(tp) + "_" + std::to_string(partition) + ".alias");
-        node_weights = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), meta.m_config_path);
-    }
-    auto node_weights_ptr = node_weights->start();
-    size_t record_size = node_weights->size() / (2 * sizeof(NodeId) + sizeof(float));
+    auto node_weights = open_alias(meta, tp, partition, SamplerElement::Node);
+    node_set.reserve(node_weights->size() / (2 * sizeof(NodeId) + sizeof(float)));
+    read_alias_records<2>(*node_weights, [&node_set](const auto &ids, float prob) {
+        node_set.insert(ids[0]);
 
-    m_records.reserve(record_size);
-    for (size_t i = 0; i < record_size; ++i)
-    {
-        NodeId node;
-        float prob;
-        if (1 != node_weights->read(&node, sizeof(NodeId), 1, node_weights_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read node from alias file");
-        }
-        node_set.insert(node);
-        if (1 != node_weights->read(&node, sizeof(NodeId), 1, node_weights_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read node from alias file");
-        }
-        if (1 != node_weights->read(&prob, sizeof(float), 1, node_weights_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read probability from alias table");
-        }
         // check for dummy node
         if (prob < 1.0)
         {
-            node_set.insert(node);
+            node_set.insert(ids[1]);
         }
-    }
+    });
+
     m_records.reserve(node_set.size());
     for (const auto &node : node_set)
     {
@@ -335,40 +402,14 @@ WeightedEdgeSamplerPartition::WeightedEdgeSamplerPartition(std::vector<WeightedE
 {
 }
 
-WeightedEdgeSamplerPartition::WeightedEdgeSamplerPartition(Metadata meta, Type tp, size_t partition)
+WeightedEdgeSamplerPartition::WeightedEdgeSamplerPartition(const Metadata &meta, Type tp, size_t partition)
     : m_weight(meta.m_partition_edge_weights[partition][tp])
 {
-    std::shared_ptr<BaseStorage<uint8_t>> edge_weights;
-    if (!is_hdfs_path(meta.m_path))
-    {
-        edge_weights = std::make_shared<DiskStorage<uint8_t>>(meta.m_path, partition, tp, open_edge_alias);
-    }
-    else
-    {
-        auto full_path = std::filesystem::path(meta.m_path) /
-                         ("edge_" + std::to_string(tp) + "_" + std::to_string(partition) + ".alias");
-        edge_weights = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), meta.m_config_path);
-    }
-    auto edge_weights_ptr = edge_weights->start();
-    size_t record_size = edge_weights->size() / (4 * sizeof(NodeId) + sizeof(float));
-
-    m_records.reserve(record_size);
-    for (size_t i = 0; i < record_size; ++i)
-    {
-        NodeId record[4];
-        if (4 != edge_weights->read(&record, sizeof(NodeId), 4, edge_weights_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read record from alias file");
-        }
-
-        float threshold;
-        if (1 != edge_weights->read(&threshold, sizeof(float), 1, edge_weights_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read threshold from edge alias table");
-        }
-
-        m_records.emplace_back(WeightedEdgeSamplerRecord{record[0], record[1], record[2], record[3], threshold});
-    }
+    auto edge_weights = open_alias(meta, tp, partition, SamplerElement::Edge);
+    m_records.reserve(edge_weights->size() / (4 * sizeof(NodeId) + sizeof(float)));
+    read_alias_records<4>(*edge_weights, [this](const auto &ids, float threshold) {
+        m_records.emplace_back(WeightedEdgeSamplerRecord{ids[0], ids[1], ids[2], ids[3], threshold});
+    });
 }
 
 void WeightedEdgeSamplerPartition::Sample(int64_t seed, std::span<NodeId> out_src, std::span<NodeId> out_dst) const
@@ -379,20 +420,32 @@ void WeightedEdgeSamplerPartition::Sample(int64_t seed, std::span<NodeId> out_sr
     }
 
     snark::Xoroshiro128PlusGenerator gen(seed);
-    boost::random::uniform_real_distribution<float> toss(0, 1.0f);
-    for (size_t i = 0; i < out_src.size(); ++i)
-    {
-        size_t pick = toss(gen) * m_records.size();
-        auto &record = m_records[pick];
-        if (toss(gen) < record.m_threshold)
+    snark::UniformReals toss(gen);
+    std::array<size_t, snark::UniformReals::batch_size / 2> picks;
+    for (size_t first = 0; first < out_src.size(); first += picks.size())
+    {
+        // Pick and prefetch records the same way as in WeightedNodeSamplerPartition::Sample.
+        const size_t count = std::min(picks.size(), out_src.size() - first);
+        const auto tosses = toss.Next(2 * count);
+        for (size_t i = 0; i < count; ++i)
         {
-            out_src[i] = record.m_left_src;
-            out_dst[i] = record.m_left_dst;
+            picks[i] = tosses[2 * i] * m_records.size();
+            prefetch(&m_records[picks[i]]);
         }
-        else
+
+        for (size_t i = 0; i < count; ++i)
         {
-            out_src[i] = record.m_right_src;
-            out_dst[i] = record.m_right_dst;
+            auto &record = m_records[picks[i]];
+            if (tosses[2 * i + 1] < record.m_threshold)
+            {
+                out_src[first + i] = record.m_left_src;
+                out_dst[first + i] = record.m_left_dst;
+            }
+            else
+            {
+                out_src[first + i] = record.m_right_src;
+                out_dst[first + i] = record.m_right_dst;
+            }
         }
     }
 }
@@ -442,7 +495,8 @@ void UniformNodeSamplerPartition<WithReplacement>::Sample(int64_t seed, std::spa
 }
 
 template <bool WithReplacement>
-UniformEdgeSamplerPartition<WithReplacement>::UniformEdgeSamplerPartition(Metadata meta, Type tp, size_t partition)
+UniformEdgeSamplerPartition<WithReplacement>::UniformEdgeSamplerPartition(const Metadata &meta, Type tp,
+                                                                          size_t partition)
 {
     struct pair_hash
     {
@@ -452,53 +506,17 @@ UniformEdgeSamplerPartition<WithReplacement>::UniformEdgeSamplerPartition(Metada
         }
     };
     absl::flat_hash_set<std::pair<NodeId, NodeId>, pair_hash> edge_set;
-    std::shared_ptr<BaseStorage<uint8_t>> edge_alias;
-    if (!is_hdfs_path(meta.m_path))
-    {
-        edge_alias = std::make_shared<DiskStorage<uint8_t>>(meta.m_path, partition, tp, open_edge_alias);
-    }
-    else
-    {
-        auto full_path = std::filesystem::path(meta.m_path) /
-                         ("edge_" + std::to_string(tp) + "_" + std::to_string(partition) + ".alias");
-        edge_alias = std::make_shared<HDFSStreamStorage<uint8_t>>(full_path.c_str(), meta.m_config_path);
-    }
-
-    auto edge_alias_ptr = edge_alias->start();
-    size_t record_size = edge_alias->size() / (4 * sizeof(NodeId) + sizeof(float));
-    for (size_t i = 0; i < record_size; ++i)
-    {
-        NodeId src, dst;
-        float prob;
-        if (1 != edge_alias->read(&src, sizeof(NodeId), 1, edge_alias_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read left edge source from alias file");
-        }
-        if (1 != edge_alias->read(&dst, sizeof(NodeId), 1, edge_alias_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read left edge destination from alias file");
-        }
-        edge_set.insert(std::make_pair(src, dst));
-
-        if (1 != edge_alias->read(&src, sizeof(NodeId), 1, edge_alias_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read right edge source from alias file");
-        }
-        if (1 != edge_alias->read(&dst, sizeof(NodeId), 1, edge_alias_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read right edge destination from alias file");
-        }
-        if (1 != edge_alias->read(&prob, sizeof(float), 1, edge_alias_ptr))
-        {
-            RAW_LOG_FATAL("Failed to read probability from edge alias file");
-        }
+    auto edge_alias = open_alias(meta, tp, partition, SamplerElement::Edge);
+    edge_set.reserve(edge_alias->size() / (4 * sizeof(NodeId) + sizeof(float)));
+    read_alias_records<4>(*edge_alias, [&edge_set](const auto &ids, float prob) {
+        edge_set.insert(std::make_pair(ids[0], ids[1]));
 
         // check for dummy edge
         if (prob < 1.0)
         {
-            edge_set.insert(std::make_pair(src, dst));
+            edge_set.insert(std::make_pair(ids[2], ids[3]));
         }
-    }
+    });
 
     m_src.reserve(edge_set.size());
     m_dst.reserve(edge_set.size());
@@ -639,18 +657,46 @@ void SampleWithReplacement(int64_t seed, std::vector<std::span<const NodeId>> po
     assert(population.size() == out.size());
 
     snark::Xoroshiro128PlusGenerator gen(seed);
-    boost::random::uniform_real_distribution<float> toss(0, 1);
+    snark::UniformReals toss(gen);
+    if (overwrite_rate < 1.0f)
+    {
+        for (size_t pos = 0; pos < out.front().size(); ++pos)
+        {
+            if (toss() > overwrite_rate)
+            {
+                continue;
+            }
+            const size_t pick = toss() * population.front().size();
+            for (size_t index = 0; index < out.size(); ++index)
+            {
+                out[index][pos] = population[index][pick];
+            }
+        }
+
+        return;
+    }
 
-    for (size_t pos = 0; pos < out.front().size(); ++pos)
+    // Every position is overwritten, so picks of a batch are known upfront and prefetched before they are read.
+    std::array<size_t, snark::UniformReals::batch_size> picks;
+    for (size_t first = 0; first < out.front().size(); first += picks.size())
     {
-        if (overwrite_rate < 1.0f && toss(gen) > overwrite_rate)
+        const size_t count = std::min(picks.size(), out.front().size() - first);
+        const auto tosses = toss.Next(count);
+        for (size_t i = 0; i < count; ++i)
         {
-            continue;
+            picks[i] = tosses[i] * population.front().size();
+            for (const auto &values : population)
+            {
+                prefetch(&values[picks[i]]);
+            }
         }
-        const size_t pick = toss(gen) * population.front().size();
+
         for (size_t index = 0; index < out.size(); ++index)
         {
-            out[index][pos] = population[index][pick];
+            for (size_t i = 0; i < count; ++i)
+            {
+                out[index][first + i] = population[index][picks[i]];
+            }
         }
     }
 }
@@ -5,6 +5,7 @@
 #define SNARK_SAMPLER_H
 
 #include <cstdlib>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -105,15 +106,20 @@ template <typename Partition, SamplerElement element = Node> class AbstractSampl
     std::unique_ptr<Sampler> Create(std::set<Type> tp, std::set<size_t> partitions) override;
 
   private:
-    void Read(Type type, const std::set<size_t> &partitions);
+    using TypePartitions = std::shared_ptr<std::vector<Partition>>;
+    using TypePartitionsFuture = std::shared_future<TypePartitions>;
+
+    // Load alias tables of all partitions of the types in parallel.
+    std::vector<TypePartitions> Read(const std::vector<Type> &types, const std::set<size_t> &partitions) const;
 
     Metadata m_metadata;
 
     // Types loaded in the sampler. We store them in shared_ptrs because
     // we want to load a type only once for any possible types permutations.
-    absl::flat_hash_map<Type, std::shared_ptr<std::vector<Partition>>> m_types;
+    // Futures are published before loading, so requests for a type being loaded wait for it.
+    absl::flat_hash_map<Type, TypePartitionsFuture> m_types;
 
-    // Synchronize loading of partitions inside the factory.
+    // Synchronize access to loaded types inside the factory, files are read without holding it.
     std::mutex m_mtx;
 };
 
@@ -131,7 +137,7 @@ class WeightedNodeSamplerPartition
     WeightedNodeSamplerPartition(const WeightedNodeSamplerPartition &) = default;
     WeightedNodeSamplerPartition(std::vector<WeightedNodeSamplerRecord> records, float weight);
 
-    WeightedNodeSamplerPartition(Metadata meta, Type tp, size_t partition);
+    WeightedNodeSamplerPartition(const Metadata &meta, Type tp, size_t partition);
 
     void Sample(int64_t seed, std::span<NodeId> out) const;
 
@@ -159,7 +165,7 @@ class WeightedEdgeSamplerPartition
     WeightedEdgeSamplerPartition(const WeightedEdgeSamplerPartition &) = default;
     WeightedEdgeSamplerPartition(std::vector<WeightedEdgeSamplerRecord> records, float weight);
 
-    WeightedEdgeSamplerPartition(Metadata meta, Type tp, size_t partition);
+    WeightedEdgeSamplerPartition(const Metadata &meta, Type tp, size_t partition);
 
     void Sample(int64_t seed, std::span<NodeId> out_src, std::span<NodeId> out_dst) const;
     float Weight() const;
@@ -176,7 +182,7 @@ template <bool WithReplacement> class UniformEdgeSamplerPartition
     UniformEdgeSamplerPartition(UniformEdgeSamplerPartition &&) = default;
     UniformEdgeSamplerPartition(const UniformEdgeSamplerPartition &) = default;
     explicit UniformEdgeSamplerPartition(std::vector<std::pair<NodeId, NodeId>> records);
-    UniformEdgeSamplerPartition(Metadata meta, Type tp, size_t partition);
+    UniformEdgeSamplerPartition(const Metadata &meta, Type tp, size_t partition);
 
     void Sample(int64_t seed, std::span<NodeId> out_src, std::span<NodeId> out_dst) const;
     float Weight() const;
@@ -194,7 +200,7 @@ template <bool WithReplacement> class UniformNodeSamplerPartition
     UniformNodeSamplerPartition(UniformNodeSamplerPartition &&) = default;
     UniformNodeSamplerPartition(const UniformNodeSamplerPartition &) = default;
     explicit UniformNodeSamplerPartition(std::vector<NodeId> records);
-    UniformNodeSamplerPartition(Metadata meta, Type tp, size_t partition);
+    UniformNodeSamplerPartition(const Metadata &meta, Type tp, size_t partition);
 
     void Sample(int64_t seed, std::span<NodeId> out) const;
     float Weight() const;
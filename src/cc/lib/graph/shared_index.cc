@@ -0,0 +1,87 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "shared_index.h"
+
+#include <fstream>
+#include <iterator>
+#include <system_error>
+
+#include "locator.h"
+
+#include <glog/logging.h>
+#include <glog/raw_logging.h>
+
+namespace snark
+{
+namespace
+{
+const std::string manifest_name = "manifest.txt";
+
+void replace_file(const std::filesystem::path &path, const void *data, size_t size)
+{
+    // Processes attached to the previous version of the file keep their mappings of the old inode.
+    auto temp_path = path;
+    temp_path += ".tmp";
+    {
+        std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+        if (!output.write(static_cast<const char *>(data), size))
+        {
+            RAW_LOG_FATAL("Failed to write %s", temp_path.string().c_str());
+        }
+    }
+
+    std::filesystem::rename(temp_path, path);
+}
+} // namespace
+
+SharedIndex::SharedIndex(std::filesystem::path directory, std::string key)
+    : m_directory(std::move(directory)), m_key(std::move(key))
+{
+    std::filesystem::create_directories(m_directory);
+    m_lock = open_file(m_directory / "lock", "ab");
+    platform_lock_file(m_lock);
+
+    std::ifstream manifest(m_directory / manifest_name, std::ios::binary);
+    if (manifest)
+    {
+        const std::string published((std::istreambuf_iterator<char>(manifest)), std::istreambuf_iterator<char>());
+        m_attached = published == m_key;
+    }
+    manifest.close();
+
+    if (!m_attached)
+    {
+        // Arrays of a different graph are going to be replaced, nobody should attach to a mix of them.
+        std::error_code error;
+        std::filesystem::remove(m_directory / manifest_name, error);
+    }
+}
+
+SharedIndex::~SharedIndex()
+{
+    fclose(m_lock);
+}
+
+bool SharedIndex::Attached() const
+{
+    return m_attached;
+}
+
+void SharedIndex::Commit()
+{
+    replace_file(m_directory / manifest_name, m_key.data(), m_key.size());
+    m_attached = true;
+}
+
+void SharedIndex::Write(const std::string &name, const void *data, size_t size) const
+{
+    if (m_attached)
+    {
+        RAW_LOG_FATAL("Shared index %s is already published", m_directory.string().c_str());
+    }
+
+    replace_file(m_directory / (name + ".bin"), data, size);
+}
+
+} // namespace snark
@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_SHARED_INDEX_H
+#define SNARK_SHARED_INDEX_H
+
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "storage.h"
+
+namespace snark
+{
+
+// Directory with arrays built while a graph is loaded, e.g. node index and edge lists, shared by processes on
+// the same host. The first process to lock the directory builds arrays and publishes them as flat files, processes
+// waiting for the lock find them complete and map them read only instead of building private copies. Placing the
+// directory on tmpfs like /dev/shm keeps arrays in shared memory.
+//
+// Published arrays are valid only for graphs with the same key, they are replaced if the key changes. Files are
+// written to temporary names and renamed, so processes using previous arrays keep their mappings.
+class SharedIndex
+{
+  public:
+    // Wait for an exclusive lock of the directory, the lock is held until the index is destroyed.
+    SharedIndex(std::filesystem::path directory, std::string key);
+    ~SharedIndex();
+
+    SharedIndex(const SharedIndex &) = delete;
+    SharedIndex &operator=(const SharedIndex &) = delete;
+
+    // True if the directory has complete arrays for the key, otherwise the caller has to publish them.
+    bool Attached() const;
+
+    // Write an array to the directory, safe to call from multiple threads for different names.
+    template <typename T> void Publish(const std::string &name, std::span<const T> values) const
+    {
+        Write(name, values.data(), values.size_bytes());
+    }
+
+    // Map a published array, owners keep the mapping alive.
+    template <typename T>
+    std::span<const T> Map(const std::string &name, std::vector<std::shared_ptr<const void>> &owners) const
+    {
+        auto storage = std::make_shared<MmapStorage<T>>(m_directory, name, &open_shared_array);
+        const auto data = storage->data();
+        owners.emplace_back(std::move(storage));
+        return data;
+    }
+
+    // Mark published arrays complete, called after every array is written.
+    void Commit();
+
+  private:
+    void Write(const std::string &name, const void *data, size_t size) const;
+
+    std::filesystem::path m_directory;
+    std::string m_key;
+    FILE *m_lock = nullptr;
+    bool m_attached = false;
+};
+
+// Keep an array built in memory alive with owners and return a view of it, so arrays built by a process and
+// mapped from a shared index are accessed the same way.
+template <typename T>
+std::span<const T> keep_buffer(std::vector<T> values, std::vector<std::shared_ptr<const void>> &owners)
+{
+    auto buffer = std::make_shared<std::vector<T>>(std::move(values));
+    const auto data = std::span<const T>(*buffer);
+    owners.emplace_back(std::move(buffer));
+    return data;
+}
+
+} // namespace snark
+
+#endif // SNARK_SHARED_INDEX_H
@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_SPARSE_FEATURES_H
+#define SNARK_SPARSE_FEATURES_H
+
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace snark
+{
+
+// Sparse features of a batch of nodes or edges in flat buffers. Feature i occupies
+// m_indices[m_indices_offsets[i], m_indices_offsets[i + 1]) and m_values[m_values_offsets[i], m_values_offsets[i + 1]).
+// Every value has m_dimensions[i] + 1 indices: position of the item in the batch followed by value coordinates.
+// Buffers keep their capacity between batches, so a batch reused for similar requests doesn't allocate memory.
+struct SparseFeatureBatch
+{
+    std::vector<int64_t> m_dimensions;
+    std::vector<int64_t> m_indices;
+    std::vector<uint8_t> m_values;
+    std::vector<size_t> m_indices_offsets;
+    std::vector<size_t> m_values_offsets;
+
+    // Start a new batch of feature_count features, features are filled in order and closed with EndFeature.
+    void Reset(size_t feature_count)
+    {
+        m_dimensions.assign(feature_count, 0);
+        m_indices.clear();
+        m_values.clear();
+        m_indices_offsets.assign(1, 0);
+        m_values_offsets.assign(1, 0);
+    }
+
+    void EndFeature()
+    {
+        assert(m_indices_offsets.size() <= m_dimensions.size());
+        m_indices_offsets.emplace_back(m_indices.size());
+        m_values_offsets.emplace_back(m_values.size());
+    }
+
+    // Index of the feature being filled.
+    size_t CurrentFeature() const
+    {
+        return m_indices_offsets.size() - 1;
+    }
+
+    size_t FeatureCount() const
+    {
+        return m_dimensions.size();
+    }
+
+    std::span<const int64_t> Indices(size_t feature) const
+    {
+        return std::span(m_indices).subspan(m_indices_offsets[feature],
+                                            m_indices_offsets[feature + 1] - m_indices_offsets[feature]);
+    }
+
+    std::span<const uint8_t> Values(size_t feature) const
+    {
+        return std::span(m_values).subspan(m_values_offsets[feature],
+                                           m_values_offsets[feature + 1] - m_values_offsets[feature]);
+    }
+
+    // Copy features to per feature vectors, replacing their content.
+    void CopyTo(std::span<int64_t> out_dimensions, std::vector<std::vector<int64_t>> &out_indices,
+                std::vector<std::vector<uint8_t>> &out_values) const
+    {
+        assert(out_dimensions.size() == FeatureCount());
+        for (size_t feature = 0; feature < FeatureCount(); ++feature)
+        {
+            out_dimensions[feature] = m_dimensions[feature];
+            const auto indices = Indices(feature);
+            const auto values = Values(feature);
+            out_indices[feature].assign(std::begin(indices), std::end(indices));
+            out_values[feature].assign(std::begin(values), std::end(values));
+        }
+    }
+
+    // Batch owned by the calling thread to reuse buffers between calls.
+    static SparseFeatureBatch &ThreadLocal()
+    {
+        thread_local SparseFeatureBatch batch;
+        return batch;
+    }
+};
+
+} // namespace snark
+#endif // SNARK_SPARSE_FEATURES_H
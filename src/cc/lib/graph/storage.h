@@ -4,11 +4,15 @@
 #ifndef SNARK_STORAGE_BASE_H
 #define SNARK_STORAGE_BASE_H
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <iterator>
+#include <memory>
 #include <span>
 #include <stdexcept>
 
+#include "feature_cache.h"
 #include "locator.h"
 #include "types.h"
 
@@ -50,6 +54,16 @@ template <typename T> struct BaseStorage
     virtual typename std::span<T>::iterator read(uint64_t offset, uint64_t size,
                                                  typename std::span<T>::iterator output_ptr,
                                                  std::shared_ptr<FilePtr> file_ptr) const = 0;
+
+    // Read a batch of ranges, offsets and sizes are in bytes. Ranges might be reordered.
+    virtual void read_batch(std::span<snark::FileRange> ranges) const
+    {
+        for (const auto &range : ranges)
+        {
+            auto output = std::span(reinterpret_cast<T *>(range.output), range.size / sizeof(T));
+            read(range.offset, output.size(), std::begin(output), nullptr);
+        }
+    }
 };
 
 template <typename T> struct MemoryStorage : BaseStorage<T>
@@ -114,22 +128,24 @@ template <typename T> struct HDFSStorage final : public MemoryStorage<T>
 {
   public:
     HDFSStorage(const char *hdfs_path, const std::string config_path, const std::string suffix,
-                const open_file_ptr open_file)
-        : MemoryStorage<T>(std::move(read_hdfs<T>(hdfs_path, config_path)))
+                const open_file_ptr open_file, HDFSReadOptions read_options = {})
+        : MemoryStorage<T>(std::move(read_hdfs<T>(hdfs_path, config_path, read_options)))
     {
     }
 
     HDFSStorage(const wchar_t *hdfs_path, const std::string config_path, const std::string suffix,
-                const open_file_ptr open_file)
+                const open_file_ptr open_file, HDFSReadOptions read_options = {})
     {
         RAW_LOG_FATAL("HDFS only supported on linux!");
     }
 };
 
+// Storage to read files from HDFS sequentially. Ranges of the file after the current position are fetched
+// concurrently in background.
 template <typename T> struct HDFSStreamStorage final : BaseStorage<T>
 {
   public:
-    HDFSStreamStorage(const char *hdfs_path, const std::string config_path)
+    HDFSStreamStorage(const char *hdfs_path, const std::string config_path, HDFSReadOptions read_options = {})
     {
         std::string data_path_str;
         std::string host_str;
@@ -142,18 +158,21 @@ template <typename T> struct HDFSStreamStorage final : BaseStorage<T>
         m_size = m_connection.get_file_size(data_path, host, port);
 
         m_file_ptr = m_connection.open_file(data_path);
-
-        m_buffer = static_cast<char *>(malloc(BUFFER_SIZE));
+        m_reader = std::make_unique<HDFSRangeReader>(m_size, read_options,
+                                                     [this](int64_t offset, int64_t size, void *output) {
+                                                         m_connection.pread(m_file_ptr, offset, size, output);
+                                                     });
     }
 
-    HDFSStreamStorage(const wchar_t *hdfs_path, const std::string config_path)
+    HDFSStreamStorage(const wchar_t *hdfs_path, const std::string config_path, HDFSReadOptions read_options = {})
     {
         RAW_LOG_FATAL("HDFS only supported on linux!");
     }
 
     ~HDFSStreamStorage()
     {
-        free(m_buffer);
+        // Wait for ranges fetched ahead before closing the file.
+        m_reader.reset();
         if (m_file_ptr != nullptr)
         {
             m_connection.close_file(m_file_ptr);
@@ -173,43 +192,15 @@ template <typename T> struct HDFSStreamStorage final : BaseStorage<T>
 
     std::shared_ptr<FilePtr> start() override
     {
-        m_buffer_offset = BUFFER_SIZE;
-        m_offset = 0;
+        m_reader->rewind();
         return std::make_shared<FilePtr>(nullptr);
     }
 
     size_t read(void *output, size_t size, size_t count, std::shared_ptr<FilePtr> file_ptr_temp) override
     {
-        size_t bytes = size * count;
-        size_t buffer_left = BUFFER_SIZE - m_buffer_offset;
-
-        if (bytes > static_cast<size_t>(BUFFER_SIZE))
-        {
-            memcpy(output, m_buffer + m_buffer_offset, buffer_left);
-            m_connection.read(m_file_ptr, bytes - buffer_left, static_cast<char *>(output) + buffer_left);
-            m_buffer_offset = BUFFER_SIZE;
-            m_offset += bytes - buffer_left;
-            return count;
-        }
-
-        if (m_offset == m_size && buffer_left < bytes)
+        if (!m_reader->read(size * count, output))
             throw std::out_of_range("Offset out of range!");
 
-        if (buffer_left < bytes)
-        {
-            memcpy(m_buffer, m_buffer + m_buffer_offset, buffer_left);
-            int64_t read_size = std::min(m_buffer_offset, m_size - m_offset);
-
-            if (read_size <= 0)
-                throw std::out_of_range("File closed unexpectedly!");
-
-            m_connection.read(m_file_ptr, read_size, m_buffer + buffer_left);
-            m_buffer_offset = 0;
-            m_offset += read_size;
-        }
-
-        memcpy(output, m_buffer + m_buffer_offset, bytes);
-        m_buffer_offset += bytes;
         return count;
     }
 
@@ -221,16 +212,14 @@ template <typename T> struct HDFSStreamStorage final : BaseStorage<T>
     }
 
   private:
-    const int64_t BUFFER_SIZE = 4096;
     HDFSConnection m_connection;
     hdfsFile_so m_file_ptr = nullptr;
     size_t m_size;
-
-    char *m_buffer;
-    size_t m_buffer_offset;
-    size_t m_offset;
+    std::unique_ptr<HDFSRangeReader> m_reader;
 };
 
+// Storage that reads data directly from disk. A single file descriptor is opened for the lifetime of the storage
+// and shared by all threads: positional reads don't move file position, so lookups don't need to reopen or seek.
 template <typename T> struct DiskStorage final : BaseStorage<T>
 {
   public:
@@ -242,12 +231,10 @@ template <typename T> struct DiskStorage final : BaseStorage<T>
         if (open_file == nullptr)
             return;
 
-        auto file_ptr = m_open_file(m_path, m_suffix);
+        m_file_ptr = m_open_file(m_path, m_suffix);
 
-        snark::platform_fseek(file_ptr, 0L, SEEK_END);
-        m_size = snark::platform_ftell(file_ptr);
-
-        fclose(file_ptr);
+        snark::platform_fseek(m_file_ptr, 0L, SEEK_END);
+        m_size = snark::platform_ftell(m_file_ptr);
     }
 
     DiskStorage(std::filesystem::path path, size_t partition, snark::Type type, open_alias_file_ptr open_file)
@@ -259,11 +246,21 @@ template <typename T> struct DiskStorage final : BaseStorage<T>
         if (open_file == nullptr)
             return;
 
-        auto file_ptr = m_open_alias_file(m_path, m_partition, m_type);
+        m_file_ptr = m_open_alias_file(m_path, m_partition, m_type);
 
-        snark::platform_fseek(file_ptr, 0L, SEEK_END);
-        m_size = snark::platform_ftell(file_ptr);
-        fclose(file_ptr);
+        snark::platform_fseek(m_file_ptr, 0L, SEEK_END);
+        m_size = snark::platform_ftell(m_file_ptr);
+    }
+
+    DiskStorage(const DiskStorage &) = delete;
+    DiskStorage &operator=(const DiskStorage &) = delete;
+
+    ~DiskStorage()
+    {
+        if (m_file_ptr != nullptr)
+        {
+            fclose(m_file_ptr);
+        }
     }
 
     size_t size() override
@@ -271,6 +268,7 @@ template <typename T> struct DiskStorage final : BaseStorage<T>
         return m_size;
     }
 
+    // Open a separate file for sequential reads with a buffered stream.
     std::shared_ptr<FilePtr> start() override
     {
         FILE *file_ptr;
@@ -293,25 +291,35 @@ template <typename T> struct DiskStorage final : BaseStorage<T>
         return fread(output, size, count, file_ptr);
     }
 
+    // Random access read, file_ptr is ignored and might be empty.
     typename std::span<T>::iterator read(uint64_t offset, uint64_t size, typename std::span<T>::iterator output_ptr,
-                                         std::shared_ptr<FilePtr> file_ptr_temp) const override
+                                         std::shared_ptr<FilePtr> file_ptr) const override
     {
-        FILE *file_ptr = **file_ptr_temp;
-
-        if (file_ptr == nullptr)
+        if (m_file_ptr == nullptr)
             throw std::out_of_range("File not open!");
-        if (feof(file_ptr))
-            throw std::out_of_range("File closed unexpectedly!");
         if (offset >= m_size)
             throw std::out_of_range("Offset out of range!");
 
-        snark::platform_fseek(file_ptr, offset, SEEK_SET);
-
-        output_ptr += fread(&(*output_ptr), sizeof(T), size, file_ptr);
+        output_ptr += snark::platform_pread(m_file_ptr, &(*output_ptr), sizeof(T) * size, offset) / sizeof(T);
 
         return output_ptr;
     }
 
+    // Sorted and adjacent ranges are merged into vectored reads to reduce number of system calls.
+    void read_batch(std::span<snark::FileRange> ranges) const override
+    {
+        if (m_file_ptr == nullptr)
+            throw std::out_of_range("File not open!");
+        for (const auto &range : ranges)
+        {
+            if (range.offset + range.size > m_size)
+                throw std::out_of_range("Offset out of range!");
+        }
+
+        if (!snark::platform_pread(m_file_ptr, ranges))
+            throw std::runtime_error("Failed to read data from disk!");
+    }
+
   private:
     std::filesystem::path m_path = "";
     std::string m_suffix = "";
@@ -319,7 +327,155 @@ template <typename T> struct DiskStorage final : BaseStorage<T>
     snark::Type m_type = 0;
     open_file_ptr m_open_file = nullptr;
     open_alias_file_ptr m_open_alias_file = nullptr;
+    FILE *m_file_ptr = nullptr;
     uint64_t m_size = 0;
 };
 
+// Read only storage backed by a memory mapped file. Pages are loaded on demand by the OS
+// and shared between all processes mapping the same file, so partitions are available
+// almost instantly and don't need a private copy of the data.
+template <typename T> struct MmapStorage final : BaseStorage<T>
+{
+  public:
+    MmapStorage(std::filesystem::path path, std::string suffix, open_file_ptr open_file)
+    {
+        if (open_file == nullptr)
+            return;
+
+        auto file_ptr = open_file(std::move(path), std::move(suffix));
+
+        snark::platform_fseek(file_ptr, 0L, SEEK_END);
+        m_size = snark::platform_ftell(file_ptr);
+
+        // Empty files can't be mapped.
+        if (m_size > 0)
+        {
+            m_data = static_cast<const T *>(snark::platform_mmap(file_ptr, m_size));
+        }
+
+        fclose(file_ptr);
+    }
+
+    MmapStorage(const MmapStorage &) = delete;
+    MmapStorage &operator=(const MmapStorage &) = delete;
+
+    ~MmapStorage()
+    {
+        if (m_data != nullptr)
+        {
+            snark::platform_munmap(m_data, m_size);
+        }
+    }
+
+    size_t size() override
+    {
+        return m_size / sizeof(T);
+    }
+
+    // Mapped memory is accessed directly, no need to open files.
+    std::shared_ptr<FilePtr> start() override
+    {
+        return nullptr;
+    }
+
+    // Sequential read from the beginning of the file, used only to load partitions.
+    size_t read(void *output, size_t size, size_t count, std::shared_ptr<FilePtr> file_ptr_temp) override
+    {
+        const size_t bytes = size * count;
+        if (m_offset + bytes > m_size)
+            throw std::out_of_range("Offset out of range!");
+
+        memcpy(output, reinterpret_cast<const uint8_t *>(m_data) + m_offset, bytes);
+        m_offset += bytes;
+        return count;
+    }
+
+    typename std::span<T>::iterator read(uint64_t offset, uint64_t size, typename std::span<T>::iterator output_ptr,
+                                         std::shared_ptr<FilePtr> file_ptr) const override
+    {
+        return std::copy_n(m_data + offset, size, output_ptr);
+    }
+
+    std::span<const T> data() const
+    {
+        return std::span(m_data, m_size / sizeof(T));
+    }
+
+  private:
+    const T *m_data = nullptr;
+    uint64_t m_size = 0;
+    uint64_t m_offset = 0;
+};
+
+// Storage decorator to serve random access reads from a shared feature cache before the underlying storage.
+template <typename T> struct CachedStorage final : BaseStorage<T>
+{
+  public:
+    CachedStorage(std::shared_ptr<BaseStorage<T>> storage, std::shared_ptr<snark::FeatureCache> cache)
+        : m_storage(std::move(storage)), m_cache(std::move(cache))
+    {
+    }
+
+    size_t size() override
+    {
+        return m_storage->size();
+    }
+
+    std::shared_ptr<FilePtr> start() override
+    {
+        return m_storage->start();
+    }
+
+    size_t read(void *output, size_t size, size_t count, std::shared_ptr<FilePtr> file_ptr_temp) override
+    {
+        return m_storage->read(output, size, count, std::move(file_ptr_temp));
+    }
+
+    typename std::span<T>::iterator read(uint64_t offset, uint64_t size, typename std::span<T>::iterator output_ptr,
+                                         std::shared_ptr<FilePtr> file_ptr) const override
+    {
+        if (size == 0)
+        {
+            return output_ptr;
+        }
+
+        auto output = std::span(reinterpret_cast<uint8_t *>(&(*output_ptr)), sizeof(T) * size);
+        if (m_cache->Get(m_storage.get(), offset, output))
+        {
+            return output_ptr + size;
+        }
+
+        auto result = m_storage->read(offset, size, output_ptr, std::move(file_ptr));
+        m_cache->Put(m_storage.get(), offset, output);
+        return result;
+    }
+
+    void read_batch(std::span<snark::FileRange> ranges) const override
+    {
+        std::vector<snark::FileRange> missing;
+        for (const auto &range : ranges)
+        {
+            if (!m_cache->Get(m_storage.get(), range.offset, std::span(range.output, range.size)))
+            {
+                missing.emplace_back(range);
+            }
+        }
+
+        if (missing.empty())
+        {
+            return;
+        }
+
+        m_storage->read_batch(missing);
+        for (const auto &range : missing)
+        {
+            m_cache->Put(m_storage.get(), range.offset, std::span(range.output, range.size));
+        }
+    }
+
+  private:
+    std::shared_ptr<BaseStorage<T>> m_storage;
+    std::shared_ptr<snark::FeatureCache> m_cache;
+};
+
 #endif
@@ -16,12 +16,14 @@ using FeatureSize = uint32_t;
 using FeatureMeta = std::pair<FeatureId, FeatureSize>;
 
 const int32_t PLACEHOLDER_NODE_TYPE = -1;
+const int32_t PLACEHOLDER_EDGE_TYPE = -1;
 
 // Enum ordering should match PyPartitionStorageType in py_graph.h.
 enum PartitionStorageType
 {
     memory,
     disk,
+    mmap,
 };
 
 } // namespace snark
@@ -0,0 +1,99 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "uniform.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+namespace
+{
+// Boost converts a raw number to float and divides it by 2^64, which is the same as multiplying by 2^-64.
+constexpr float raw_scale = 0x1p-64f;
+
+#if defined(__GNUC__)
+// Vector extensions are lowered to SSE2 on x86-64 and to NEON on ARM without extra compiler flags.
+typedef uint64_t u64x2 __attribute__((vector_size(16)));
+typedef double f64x2 __attribute__((vector_size(16)));
+
+// Convert 2 raw numbers to doubles rounded to odd: truncated to 53 bits with the last bit set if any of the dropped
+// bits were set. There are no vector instructions to convert unsigned 64 bit integers before AVX-512, but rounding
+// these doubles to floats gives the same result as rounding raw numbers directly.
+inline f64x2 round_to_odd(u64x2 raw)
+{
+    const u64x2 exponent = u64x2{} + 0x4330000000000000ull;
+    const f64x2 two_52 = f64x2{} + 0x1p52;
+
+    // Or-ing 32 bit halves into the mantissa of 2^52 converts them to doubles exactly.
+    const f64x2 high = ((f64x2)((raw >> 32) | exponent) - two_52) * 0x1p32;
+    const f64x2 low = (f64x2)((raw & 0xffffffffull) | exponent) - two_52;
+    const f64x2 sum = high + low;
+
+    // Error of the rounded sum, exact because high is larger than low.
+    const f64x2 error = (high - sum) + low;
+    u64x2 bits = (u64x2)sum;
+
+    // Comparisons return -1 for true, so rounded up sums step 1 ulp down before setting the last bit.
+    bits += (u64x2)(error < 0);
+    bits |= (u64x2)(error != 0) & 1;
+    return (f64x2)bits;
+}
+
+void convert(std::span<const uint64_t> raw, std::span<float> output)
+{
+    size_t index = 0;
+    for (; index + 2 <= raw.size(); index += 2)
+    {
+        u64x2 values;
+        std::memcpy(&values, raw.data() + index, sizeof(values));
+        const auto rounded = round_to_odd(values);
+        output[index] = float(rounded[0]) * raw_scale;
+        output[index + 1] = float(rounded[1]) * raw_scale;
+    }
+
+    for (; index < raw.size(); ++index)
+    {
+        output[index] = float(raw[index]) * raw_scale;
+    }
+}
+#else
+void convert(std::span<const uint64_t> raw, std::span<float> output)
+{
+    for (size_t index = 0; index < raw.size(); ++index)
+    {
+        output[index] = float(raw[index]) * raw_scale;
+    }
+}
+#endif
+} // namespace
+
+namespace snark
+{
+
+void uniform_reals(Xoroshiro128PlusGenerator &gen, std::span<float> output)
+{
+    std::array<uint64_t, UniformReals::batch_size> raw;
+    size_t filled = 0;
+    while (filled < output.size())
+    {
+        const auto batch = output.subspan(filled, std::min(raw.size(), output.size() - filled));
+        std::generate_n(std::begin(raw), batch.size(), std::ref(gen));
+        convert(std::span(raw).first(batch.size()), batch);
+
+        // Numbers rounded up to 1 are rejected by boost and replaced with the next ones.
+        filled += std::remove(std::begin(batch), std::end(batch), 1.0f) - std::begin(batch);
+    }
+}
+
+void UniformReals::Refill()
+{
+    std::copy(std::begin(m_values) + m_position, std::begin(m_values) + m_end, std::begin(m_values));
+    m_end -= m_position;
+    m_position = 0;
+    uniform_reals(m_gen, std::span(m_values).subspan(m_end));
+    m_end = m_values.size();
+}
+
+} // namespace snark
@@ -0,0 +1,69 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef SNARK_UNIFORM_H
+#define SNARK_UNIFORM_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <span>
+
+#include "xoroshiro.h"
+
+namespace snark
+{
+
+// Fill output with floats from [0, 1) equal to the ones boost::random::uniform_real_distribution<float>(0, 1)
+// returns for consecutive calls with the same generator. Raw numbers are converted to floats in SIMD registers,
+// which is ~3x faster than one by one.
+void uniform_reals(Xoroshiro128PlusGenerator &gen, std::span<float> output);
+
+// Stream of uniform floats drawn from a generator in batches. Samplers get exactly the same numbers as from
+// a uniform_real_distribution<float>(0, 1), so results for every seed stay the same. The generator is advanced
+// up to a batch ahead of the numbers consumed and shouldn't be used directly while the stream is alive.
+class UniformReals
+{
+  public:
+    static constexpr size_t batch_size = 64;
+
+    explicit UniformReals(Xoroshiro128PlusGenerator &gen) : m_gen(gen)
+    {
+    }
+
+    float operator()()
+    {
+        if (m_position == m_end)
+        {
+            Refill();
+        }
+
+        return m_values[m_position++];
+    }
+
+    // Next count numbers at once, count can't be larger than batch_size.
+    std::span<const float> Next(size_t count)
+    {
+        assert(count <= batch_size);
+        if (m_end - m_position < count)
+        {
+            Refill();
+        }
+
+        const auto result = std::span(m_values).subspan(m_position, count);
+        m_position += count;
+        return result;
+    }
+
+  private:
+    // Keep numbers not consumed yet at the start of the batch and draw the rest.
+    void Refill();
+
+    Xoroshiro128PlusGenerator &m_gen;
+    std::array<float, batch_size> m_values;
+    size_t m_position = 0;
+    size_t m_end = 0;
+};
+
+} // namespace snark
+#endif // SNARK_UNIFORM_H
@@ -4,16 +4,19 @@
 #include "py_graph.h"
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstdint>
 #include <exception>
 #include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <set>
 #include <span>
 #include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 #ifdef SNARK_PLATFORM_LINUX
@@ -22,7 +25,6 @@
 #endif
 
 #include "absl/container/flat_hash_map.h"
-#include "boost/random/uniform_real_distribution.hpp"
 
 #include <grpcpp/create_channel.h>
 // Use raw log to avoid possible initialization conflicts with glog from other libraries.
@@ -33,7 +35,8 @@
 #include "distributed/graph_engine.h"
 #include "distributed/graph_sampler.h"
 #include "graph/graph.h"
-#include "graph/xoroshiro.h"
+#include "graph/parallel.h"
+#include "graph/reorder.h"
 
 namespace deep_graph
 {
@@ -57,6 +60,27 @@ absl::flat_hash_map<SamplerType, snark::CreateSamplerRequest_Category> localToRe
     {UniformWithoutReplacement,
      snark::CreateSamplerRequest_Category::CreateSamplerRequest_Category_UNIFORM_WITHOUT_REPLACEMENT},
 };
+
+// Pass pointers to features in the batch for python to copy data from C++.
+void ReturnSparseFeatures(snark::SparseFeatureBatch &batch, GetSparseFeaturesCallback callback)
+{
+    const size_t features_size = batch.FeatureCount();
+    std::vector<const int64_t *> indices_ptrs(features_size);
+    std::vector<size_t> indices_sizes(features_size);
+    std::vector<const uint8_t *> data_ptrs(features_size);
+    std::vector<size_t> data_sizes(features_size);
+    for (size_t i = 0; i < features_size; ++i)
+    {
+        const auto indices = batch.Indices(i);
+        const auto data = batch.Values(i);
+        indices_ptrs[i] = indices.data();
+        indices_sizes[i] = indices.size();
+        data_ptrs[i] = data.data();
+        data_sizes[i] = data.size();
+    }
+
+    callback(indices_ptrs.data(), indices_sizes.data(), data_ptrs.data(), data_sizes.data(), batch.m_dimensions.data());
+}
 } // namespace
 
 struct GraphInternal
@@ -75,6 +99,11 @@ template <bool is_node> class RemoteSampler final : public snark::Sampler
     void Sample(int64_t seed, std::span<snark::Type> out_types, std::span<snark::NodeId> out_nodes, ...) const override;
     float Weight() const override;
 
+    // Same as Sample, but returns once the request is sent to a server.
+    std::shared_ptr<snark::ClientRequest> SampleAsync(int64_t seed, std::span<snark::Type> out_types,
+                                                      std::span<snark::NodeId> out_nodes,
+                                                      std::span<snark::NodeId> out_dst = {}) const;
+
   private:
     std::shared_ptr<snark::GRPCClient> m_client;
     uint64_t m_sampler_id;
@@ -107,6 +136,22 @@ void RemoteSampler<true>::Sample(int64_t seed, std::span<snark::Type> out_types,
     m_client->SampleNodes(seed, m_sampler_id, out_nodes, out_types);
 }
 
+template <>
+std::shared_ptr<snark::ClientRequest> RemoteSampler<false>::SampleAsync(int64_t seed, std::span<snark::Type> out_types,
+                                                                       std::span<snark::NodeId> out_nodes,
+                                                                       std::span<snark::NodeId> out_dst) const
+{
+    return m_client->SampleEdgesAsync(seed, m_sampler_id, out_nodes, out_types, out_dst);
+}
+
+template <>
+std::shared_ptr<snark::ClientRequest> RemoteSampler<true>::SampleAsync(int64_t seed, std::span<snark::Type> out_types,
+                                                                      std::span<snark::NodeId> out_nodes,
+                                                                      std::span<snark::NodeId>) const
+{
+    return m_client->SampleNodesAsync(seed, m_sampler_id, out_nodes, out_types);
+}
+
 template <bool is_node> float RemoteSampler<is_node>::Weight() const
 {
     // We are sampling from the whole graph, so it doesn't really matter what weight is it in the interface.
@@ -231,14 +276,29 @@ int32_t SampleEdges(PySampler *py_sampler, int64_t seed, size_t count, NodeID *o
 }
 
 int32_t CreateLocalGraph(PyGraph *py_graph, size_t count, uint32_t *partitions, const char *filename,
-                         PyPartitionStorageType storage_type_, const char *config_path)
+                         PyPartitionStorageType storage_type_, const char *config_path, const PyGraphOptions *options_)
 {
+    const HDFSReadOptions hdfs_defaults;
+    const auto options = ReadOptions(options_, PyGraphOptions{.size = sizeof(PyGraphOptions),
+                                                              .thread_count = 1,
+                                                              .min_chunk_size = 1024,
+                                                              .hdfs_buffer_size = size_t(hdfs_defaults.m_buffer_size),
+                                                              .hdfs_read_threads = hdfs_defaults.m_parallelism});
     snark::PartitionStorageType storage_type = static_cast<snark::PartitionStorageType>(storage_type_);
     py_graph->graph = std::make_unique<GraphInternal>();
     py_graph->graph->partitions = std::set<size_t>(partitions, partitions + count);
-    py_graph->graph->graph =
-        std::make_unique<snark::Graph>(std::string(filename), std::vector<uint32_t>(partitions, partitions + count),
-                                       storage_type, std::string(config_path));
+    py_graph->graph->graph = std::make_unique<snark::Graph>(
+        std::string(filename), std::vector<uint32_t>(partitions, partitions + count), storage_type,
+        std::string(config_path),
+        snark::FeatureCacheConfig{.m_capacity = options.feature_cache_size, .m_warm = options.warm_feature_cache},
+        options.compact_node_index, options.compressed_edges,
+        snark::ThreadPoolConfig{.m_thread_count = options.thread_count, .m_min_chunk_size = options.min_chunk_size},
+        options.alias_threshold,
+        std::vector<snark::FeatureId>(options.columnar_features,
+                                      options.columnar_features + options.columnar_feature_count),
+        std::string(options.shared_index == nullptr ? "" : options.shared_index), options.edge_index_threshold,
+        HDFSReadOptions{.m_buffer_size = int64_t(options.hdfs_buffer_size),
+                        .m_parallelism = options.hdfs_read_threads});
     py_graph->graph->node_sampler_factory[SamplerType::Weighted] =
         std::make_shared<snark::WeightedNodeSamplerFactory>(filename);
     py_graph->graph->node_sampler_factory[SamplerType::Uniform] =
@@ -262,10 +322,11 @@ int32_t CreateLocalGraph(PyGraph *py_graph, size_t count, uint32_t *partitions,
 }
 
 int32_t CreateRemoteClient(PyGraph *py_graph, const char *output_folder, const char **connection,
-                           size_t connection_count, const char *ssl_cert, size_t num_threads, size_t num_threads_per_cq)
+                           size_t connection_count, const char *ssl_cert, size_t num_threads, size_t num_threads_per_cq,
+                           const PyClientOptions *options_)
 {
+    const auto options = ReadOptions(options_, PyClientOptions{.size = sizeof(PyClientOptions)});
     py_graph->graph = std::make_unique<GraphInternal>();
-    std::vector<std::shared_ptr<grpc::Channel>> channels;
     auto creds = grpc::InsecureChannelCredentials();
     if (ssl_cert != nullptr && strlen(ssl_cert) > 0)
     {
@@ -275,14 +336,37 @@ int32_t CreateRemoteClient(PyGraph *py_graph, const char *output_folder, const c
     }
     grpc::ChannelArguments args;
     args.SetMaxReceiveMessageSize(-1);
-    for (size_t i = 0; i < connection_count; ++i)
+
+    // Without explicit replicas every connection is a separate shard.
+    std::vector<std::vector<std::shared_ptr<grpc::Channel>>> shards(options.shard_count == 0 ? connection_count
+                                                                                             : options.shard_count);
+    size_t connection_index = 0;
+    for (size_t shard = 0; shard < shards.size(); ++shard)
     {
-        channels.emplace_back(grpc::CreateCustomChannel(connection[i], creds, args));
+        const size_t replica_count = options.shard_count == 0 ? 1 : options.shard_replicas[shard];
+        for (size_t replica = 0; replica < replica_count; ++replica, ++connection_index)
+        {
+            shards[shard].emplace_back(grpc::CreateCustomChannel(connection[connection_index], creds, args));
+        }
     }
 
-    py_graph->graph->client =
-        std::make_unique<snark::GRPCClient>(std::move(channels), uint32_t(num_threads), uint32_t(num_threads_per_cq));
+    snark::ClientCallConfig call_config;
+    call_config.m_deadline = std::chrono::milliseconds(options.deadline_ms);
+    call_config.m_hedge_delay = std::chrono::microseconds(options.hedge_delay_us);
+    call_config.m_coalesce_window = std::chrono::microseconds(options.coalesce_window_us);
+    if (options.coalesce_max_nodes > 0)
+    {
+        call_config.m_coalesce_max_nodes = options.coalesce_max_nodes;
+    }
+    call_config.m_compress_sparse_features = options.compress_sparse_features;
+    call_config.m_feature_cache_size = options.feature_cache_size;
+    py_graph->graph->client = std::make_unique<snark::GRPCClient>(std::move(shards), uint32_t(num_threads),
+                                                                  uint32_t(num_threads_per_cq), call_config);
     py_graph->graph->client->WriteMetadata(output_folder);
+    if (options.route_nodes)
+    {
+        py_graph->graph->client->LoadNodeRoutes();
+    }
     return 0;
 }
 
@@ -332,7 +416,7 @@ int32_t GetNodeType(PyGraph *py_graph, NodeID *node_ids, size_t node_ids_size, T
 }
 
 int32_t GetNodeFeature(PyGraph *py_graph, NodeID *node_ids, size_t node_ids_size, Feature *features,
-                       size_t features_size, uint8_t *output, size_t output_size)
+                       size_t features_size, uint8_t *output, size_t output_size, int32_t encoding)
 {
     if (py_graph->graph == nullptr)
     {
@@ -352,7 +436,8 @@ int32_t GetNodeFeature(PyGraph *py_graph, NodeID *node_ids, size_t node_ids_size
     {
         py_graph->graph->client->GetNodeFeature(std::span(reinterpret_cast<snark::NodeId *>(node_ids), node_ids_size),
                                                 std::span(features_info),
-                                                std::span(reinterpret_cast<uint8_t *>(output), output_size));
+                                                std::span(reinterpret_cast<uint8_t *>(output), output_size),
+                                                snark::FeatureEncoding(encoding));
         return 0;
     }
     catch (const std::exception &e)
@@ -371,15 +456,13 @@ int32_t GetNodeSparseFeature(PyGraph *py_graph, NodeID *node_ids, size_t node_id
         return 1;
     }
 
-    std::vector<std::vector<int64_t>> indices(features_size);
-    std::vector<std::vector<uint8_t>> data(features_size);
-    std::vector<int64_t> dimensions(features_size);
-
+    // Batch buffers are reused by consecutive calls from the same thread.
+    auto &batch = snark::SparseFeatureBatch::ThreadLocal();
     if (py_graph->graph->graph)
     {
         py_graph->graph->graph->GetNodeSparseFeature(
             std::span(reinterpret_cast<snark::NodeId *>(node_ids), node_ids_size), std::span(features, features_size),
-            std::span(dimensions), indices, data);
+            batch);
     }
     else
     {
@@ -387,7 +470,7 @@ int32_t GetNodeSparseFeature(PyGraph *py_graph, NodeID *node_ids, size_t node_id
         {
             py_graph->graph->client->GetNodeSparseFeature(
                 std::span(reinterpret_cast<snark::NodeId *>(node_ids), node_ids_size),
-                std::span(features, features_size), std::span(dimensions), indices, data);
+                std::span(features, features_size), batch);
         }
         catch (const std::exception &e)
         {
@@ -396,21 +479,7 @@ int32_t GetNodeSparseFeature(PyGraph *py_graph, NodeID *node_ids, size_t node_id
         }
     }
 
-    // Pointers for python to copy data from C++.
-    std::vector<const int64_t *> indices_ptrs;
-    std::vector<size_t> indices_sizes;
-    std::vector<const uint8_t *> data_ptrs;
-    std::vector<size_t> data_sizes;
-
-    for (size_t i = 0; i < features_size; ++i)
-    {
-        indices_ptrs.emplace_back(indices[i].data());
-        indices_sizes.emplace_back(indices[i].size());
-        data_ptrs.emplace_back(data[i].data());
-        data_sizes.emplace_back(data[i].size());
-    }
-
-    callback(indices_ptrs.data(), indices_sizes.data(), data_ptrs.data(), data_sizes.data(), dimensions.data());
+    ReturnSparseFeatures(batch, callback);
     return 0;
 }
 
@@ -450,7 +519,8 @@ int32_t GetNodeStringFeature(PyGraph *py_graph, NodeID *node_ids, size_t node_id
 }
 
 int32_t GetEdgeFeature(PyGraph *py_graph, NodeID *edge_src_ids, NodeID *edge_dst_ids, Type *edge_types,
-                       size_t edges_size, Feature *features, size_t features_size, uint8_t *output, size_t output_size)
+                       size_t edges_size, Feature *features, size_t features_size, uint8_t *output, size_t output_size,
+                       int32_t encoding)
 {
     if (py_graph->graph == nullptr)
     {
@@ -473,7 +543,8 @@ int32_t GetEdgeFeature(PyGraph *py_graph, NodeID *edge_src_ids, NodeID *edge_dst
         py_graph->graph->client->GetEdgeFeature(std::span(reinterpret_cast<snark::NodeId *>(edge_src_ids), edges_size),
                                                 std::span(reinterpret_cast<snark::NodeId *>(edge_dst_ids), edges_size),
                                                 std::span(reinterpret_cast<snark::Type *>(edge_types), edges_size),
-                                                std::span(features_info), std::span(output, output_size));
+                                                std::span(features_info), std::span(output, output_size),
+                                                snark::FeatureEncoding(encoding));
         return 0;
     }
     catch (const std::exception &e)
@@ -493,25 +564,15 @@ int32_t GetEdgeSparseFeature(PyGraph *py_graph, NodeID *edge_src_ids, NodeID *ed
         return 1;
     }
 
-    std::vector<std::vector<int64_t>> indices(features_size);
-    std::vector<std::vector<uint8_t>> data(features_size);
-    std::vector<int64_t> dimensions(features_size);
-
-    // Pointers for python to copy data from C++.
-    std::vector<const int64_t *> indices_ptrs;
-    std::vector<size_t> indices_sizes;
-    std::vector<const uint8_t *> data_ptrs;
-    std::vector<size_t> data_sizes;
-
+    auto &batch = snark::SparseFeatureBatch::ThreadLocal();
     if (py_graph->graph->graph)
     {
         py_graph->graph->graph->GetEdgeSparseFeature(
             std::span(reinterpret_cast<snark::NodeId *>(edge_src_ids), edges_size),
             std::span(reinterpret_cast<snark::NodeId *>(edge_dst_ids), edges_size),
             std::span(reinterpret_cast<snark::Type *>(edge_types), edges_size), std::span(features, features_size),
-            std::span(dimensions), indices, data);
+            batch);
     }
-
     else
     {
         try
@@ -520,7 +581,7 @@ int32_t GetEdgeSparseFeature(PyGraph *py_graph, NodeID *edge_src_ids, NodeID *ed
                 std::span(reinterpret_cast<snark::NodeId *>(edge_src_ids), edges_size),
                 std::span(reinterpret_cast<snark::NodeId *>(edge_dst_ids), edges_size),
                 std::span(reinterpret_cast<snark::Type *>(edge_types), edges_size), std::span(features, features_size),
-                std::span(dimensions), indices, data);
+                batch);
         }
         catch (const std::exception &e)
         {
@@ -529,15 +590,7 @@ int32_t GetEdgeSparseFeature(PyGraph *py_graph, NodeID *edge_src_ids, NodeID *ed
         }
     }
 
-    for (size_t i = 0; i < features_size; ++i)
-    {
-        indices_ptrs.emplace_back(indices[i].data());
-        indices_sizes.emplace_back(indices[i].size());
-        data_ptrs.emplace_back(data[i].data());
-        data_sizes.emplace_back(data[i].size());
-    }
-
-    callback(indices_ptrs.data(), indices_sizes.data(), data_ptrs.data(), data_sizes.data(), dimensions.data());
+    ReturnSparseFeatures(batch, callback);
     return 0;
 }
 
@@ -760,6 +813,51 @@ int32_t UniformSampleNeighbor(PyGraph *py_graph, bool without_replacement, int64
     }
 }
 
+int32_t SampleSubgraph(PyGraph *py_graph, bool without_replacement, int64_t seed, NodeID *in_node_ids,
+                       size_t in_node_ids_size, uint32_t *fanouts, size_t fanouts_size, Type *in_edge_types,
+                       size_t in_edge_types_size, Feature *features, size_t features_size,
+                       SampleSubgraphCallback callback)
+{
+    if (py_graph->graph == nullptr)
+    {
+        RAW_LOG_ERROR("Internal graph is not initialized");
+        return 1;
+    }
+
+    auto features_info = ExtractFeatureInfo(features, features_size);
+    snark::Subgraph subgraph;
+    try
+    {
+        if (py_graph->graph->graph)
+        {
+            py_graph->graph->graph->SampleSubgraph(
+                without_replacement, seed, std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(fanouts, fanouts_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size),
+                std::span(features_info), subgraph);
+        }
+        else
+        {
+            py_graph->graph->client->SampleSubgraph(
+                without_replacement, seed, std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(fanouts, fanouts_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size),
+                std::span(features_info), subgraph);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        RAW_LOG_ERROR("Exception while sampling subgraph: %s", e.what());
+        return 1;
+    }
+
+    callback(reinterpret_cast<const NodeID *>(subgraph.m_nodes.data()), subgraph.m_hops.data(),
+             subgraph.m_nodes.size(), subgraph.m_edge_src.data(), subgraph.m_edge_dst.data(),
+             subgraph.m_edge_types.data(), subgraph.m_edge_types.size(), subgraph.m_features.data(),
+             subgraph.m_features.size());
+    return 0;
+}
+
 // Expected length of out_node_ids buffer is (walk_length + 1) * in_node_ids_size
 int32_t RandomWalk(PyGraph *py_graph, int64_t seed, float p, float q, NodeID default_node_id, NodeID *in_node_ids,
                    size_t in_node_ids_size, Type *in_edge_types, size_t in_edge_types_size, size_t walk_length,
@@ -770,134 +868,495 @@ int32_t RandomWalk(PyGraph *py_graph, int64_t seed, float p, float q, NodeID def
         RAW_LOG_ERROR("Internal graph is not initialized");
         return 1;
     }
+    if (!(p > 0) || !(q > 0))
+    {
+        RAW_LOG_ERROR("Random walk parameters p and q should be positive, got p = %f, q = %f", p, q);
+        return 1;
+    }
 
-    if (walk_length == 0)
+    const auto out_size = (walk_length + 1) * in_node_ids_size;
+    try
     {
-        std::copy_n(in_node_ids, in_node_ids_size, out_node_ids);
-        return 0;
+        if (py_graph->graph->graph)
+        {
+            py_graph->graph->graph->RandomWalk(
+                seed, p, q, default_node_id,
+                std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size), walk_length,
+                std::span(reinterpret_cast<snark::NodeId *>(out_node_ids), out_size));
+        }
+        else
+        {
+            py_graph->graph->client->RandomWalk(
+                seed, p, q, default_node_id,
+                std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size), walk_length,
+                std::span(reinterpret_cast<snark::NodeId *>(out_node_ids), out_size));
+        }
+    }
+    catch (const std::exception &e)
+    {
+        RAW_LOG_ERROR("Exception while generating random walks: %s", e.what());
+        return 1;
+    }
+
+    return 0;
+}
+
+// Expected length of out_node_ids buffer is count * in_node_ids_size
+int32_t NegativeSample(PyGraph *py_graph, int64_t seed, NodeID default_node_id, NodeID *in_node_ids,
+                       size_t in_node_ids_size, Type *in_edge_types, size_t in_edge_types_size, size_t count,
+                       NodeID *out_node_ids)
+{
+    if (py_graph->graph == nullptr)
+    {
+        RAW_LOG_ERROR("Internal graph is not initialized");
+        return 1;
     }
 
-    const bool distributed_setting = py_graph->graph->client != nullptr;
-    snark::Xoroshiro128PlusGenerator gen(seed);
-
-    // We use single precision everywhere, so in case we'll need a better accuracy we can replace float to double
-    // everywhere in this function.
-    boost::random::uniform_real_distribution<float> d(0, 1);
-    std::fill_n(out_node_ids, (walk_length + 1) * in_node_ids_size, default_node_id);
-    for (size_t index = 0; index < in_node_ids_size; ++index)
-    {
-        out_node_ids[index * (walk_length + 1)] = in_node_ids[index];
-    }
-
-    // Naming convention follows node2vec paper: t_nbs - neighbors of a parent node. We skip v_nbs
-    // for current node neighbors, for performance reasons: use less memory and deterministic traversal.
-    // Flat_hash_map iteration is random with the same data, but with different processes.
-    std::vector<absl::flat_hash_map<NodeID, float>> t_nbs(in_node_ids_size);
-
-    // Containers for current and pass nodes in the walk.
-    std::vector<NodeID> curr_nodes(in_node_ids, in_node_ids + in_node_ids_size);
-    std::vector<NodeID> past_nodes(in_node_ids, in_node_ids + in_node_ids_size);
-    std::vector<uint64_t> curr_counts(in_node_ids_size);
-
-    // Unnormalized transition probabilities to node x if the parent is t and current node is v:
-    //           / 1/p if d_{tx} = 0
-    // P[t, x] = |  1  if d_{tx} = 1
-    //           \ 1/q if d_{tx} = 2
-    std::vector<std::pair<NodeID, float>> transition_node_prob;
-    std::vector<NodeID> transition_nodes;
-    std::vector<float> transition_probs;
-    auto curr_out_nodes = out_node_ids;
-    std::vector<NodeID> neighbors;
-    std::vector<float> weights;
-    std::vector<Type> types;
-    for (size_t curr_step = 0; curr_step < walk_length; ++curr_step)
-    {
-        neighbors.resize(0);
-        weights.resize(0);
-        types.resize(0);
-        GetNeighborsInternal(py_graph, curr_nodes.data(), curr_nodes.size(), in_edge_types, in_edge_types_size,
-                             curr_counts.data(), neighbors, types, weights);
-        size_t nb_offset = 0;
-        for (size_t index = 0; index < in_node_ids_size; ++index)
+    try
+    {
+        if (py_graph->graph->graph)
         {
-            // Look up parent transitional probability via map to find edge weight.
-            auto parent = t_nbs[index].find(curr_nodes[index]);
-            if (parent != std::end(t_nbs[index]))
-            {
-                transition_node_prob.emplace_back(past_nodes[index], parent->second / p);
-            }
+            py_graph->graph->graph->NegativeSample(
+                seed, default_node_id, std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size), count,
+                std::span(reinterpret_cast<snark::NodeId *>(out_node_ids), count * in_node_ids_size));
+        }
+        else
+        {
+            py_graph->graph->client->NegativeSample(
+                seed, default_node_id, std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size), count,
+                std::span(reinterpret_cast<snark::NodeId *>(out_node_ids), count * in_node_ids_size));
+        }
+    }
+    catch (const std::exception &e)
+    {
+        RAW_LOG_ERROR("Exception while sampling negatives: %s", e.what());
+        return 1;
+    }
 
-            for (size_t nb_index = 0; nb_index < curr_counts[index]; ++nb_index, ++nb_offset)
-            {
-                const auto node = neighbors[nb_offset];
-                const auto weight = weights[nb_offset];
-                // Skip parent node, because it was added above.
-                if (node == past_nodes[index])
-                {
-                    continue;
-                }
-
-                // Found current neighbor in parents neighbors.
-                else if (t_nbs[index].find(node) != std::end(t_nbs[index]))
-                {
-                    transition_node_prob.emplace_back(node, weight);
-                }
-                // Explore current node neighborhood.
-                else
-                {
-                    transition_node_prob.emplace_back(node, weight / q);
-                }
-            }
+    return 0;
+}
+
+struct AsyncRequest
+{
+    enum class State
+    {
+        queued,
+        running,
+        done,
+        cancelled,
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_finished;
+    State m_state = State::queued;
+    int32_t m_status = 0;
+
+    // Requests to servers are cancelled through the client, local requests only while they are queued.
+    std::shared_ptr<snark::ClientRequest> m_call;
+};
 
-            if (transition_node_prob.empty())
+namespace
+{
+// Local requests run on graph thread pools, so dispatch threads mostly wait for them and there are enough of them to
+// keep several batches in flight. The pool is never destroyed to let requests finish during exit.
+snark::ThreadPool &dispatch_pool()
+{
+    static auto *pool = new snark::ThreadPool(std::max(8u, 2 * std::thread::hardware_concurrency()) + 1);
+    return *pool;
+}
+
+template <typename Call> int32_t submit_request(PyRequest *py_request, Call call)
+{
+    if (py_request == nullptr)
+    {
+        RAW_LOG_ERROR("Request is not initialized");
+        return 1;
+    }
+
+    auto request = std::make_shared<AsyncRequest>();
+    py_request->request = request;
+    dispatch_pool().Submit([request, call]() {
+        {
+            std::lock_guard lock(request->m_mutex);
+            if (request->m_state == AsyncRequest::State::cancelled)
             {
-                past_nodes[index] = curr_nodes[index];
-                curr_nodes[index] = default_node_id;
-                curr_out_nodes[index * (walk_length + 1) + curr_step + 1] = default_node_id;
-                continue;
+                return;
             }
+            request->m_state = AsyncRequest::State::running;
+        }
+
+        int32_t status = 1;
+        try
+        {
+            status = call();
+        }
+        catch (const std::exception &e)
+        {
+            RAW_LOG_ERROR("Exception in asynchronous request: %s", e.what());
+        }
 
-            // We need to sort the final neighbors list to get deterministic results, because in distributed setting
-            // shards can return results in random order.
-            if (distributed_setting)
+        {
+            std::lock_guard lock(request->m_mutex);
+            request->m_status = status;
+            request->m_state = AsyncRequest::State::done;
+        }
+        request->m_finished.notify_all();
+    });
+
+    return 0;
+}
+
+bool is_remote(PyGraph *py_graph)
+{
+    return py_graph->graph != nullptr && py_graph->graph->client != nullptr;
+}
+
+// Requests to servers are sent by the client right away and finish on its completion queue threads, so they don't
+// occupy dispatch threads while waiting for replies. State is kept alive until the request is done.
+template <typename Start>
+int32_t send_request(PyRequest *py_request, Start start, std::shared_ptr<const void> state = nullptr)
+{
+    if (py_request == nullptr)
+    {
+        RAW_LOG_ERROR("Request is not initialized");
+        return 1;
+    }
+
+    auto request = std::make_shared<AsyncRequest>();
+    py_request->request = request;
+    std::shared_ptr<snark::ClientRequest> call;
+    try
+    {
+        call = start();
+    }
+    catch (const std::exception &e)
+    {
+        RAW_LOG_ERROR("Exception in asynchronous request: %s", e.what());
+        std::lock_guard lock(request->m_mutex);
+        request->m_status = 1;
+        request->m_state = AsyncRequest::State::done;
+        return 0;
+    }
+
+    {
+        std::lock_guard lock(request->m_mutex);
+        request->m_call = call;
+        request->m_state = AsyncRequest::State::running;
+    }
+
+    // Callback runs once, the request doesn't keep the call after it is done to avoid a reference cycle.
+    call->OnDone([request, state = std::move(state)](std::exception_ptr error) {
+        std::shared_ptr<snark::ClientRequest> call;
+        {
+            std::lock_guard lock(request->m_mutex);
+            call = std::move(request->m_call);
+        }
+
+        const bool cancelled = error && call && call->Cancelled();
+        if (error && !cancelled)
+        {
+            try
             {
-                std::sort(std::begin(transition_node_prob), std::end(transition_node_prob));
+                std::rethrow_exception(error);
             }
-            transition_nodes.reserve(transition_node_prob.size());
-            transition_probs.reserve(transition_node_prob.size());
-
-            // Unfortunatelly we can't use distributions from the standard library here:
-            // 1. piecewise_constant_distribution uses real numbers to return as items,
-            // which might be not accurate for int64_t.
-            // 2. discrete_distribution is using integer weights, but we need floats here.
-            float total_weight = 0;
-            for (const auto &p : transition_node_prob)
+            catch (const std::exception &e)
             {
-                transition_nodes.emplace_back(p.first);
-                total_weight += p.second;
-                transition_probs.emplace_back(total_weight);
+                RAW_LOG_ERROR("Exception in asynchronous request: %s", e.what());
             }
+        }
 
-            const auto random_number = total_weight * d(gen);
-            auto offset = std::lower_bound(std::begin(transition_probs), std::end(transition_probs), random_number);
-            NodeID next_node = transition_nodes[offset - std::begin(transition_probs)];
-            past_nodes[index] = curr_nodes[index];
-            curr_nodes[index] = next_node;
-            curr_out_nodes[index * (walk_length + 1) + curr_step + 1] = next_node;
-            transition_nodes.resize(0);
-            transition_probs.resize(0);
-            transition_node_prob.resize(0);
-            t_nbs[index].clear();
-            t_nbs[index].reserve(curr_counts[index]);
-
-            // Return global index back to replace parent nodes.
-            nb_offset -= curr_counts[index];
-            for (size_t nb_index = 0; nb_index < curr_counts[index]; ++nb_index, ++nb_offset)
-            {
-                t_nbs[index].emplace(neighbors[nb_offset], weights[nb_offset]);
-            }
+        {
+            std::lock_guard lock(request->m_mutex);
+            request->m_status = error ? 1 : 0;
+            request->m_state = cancelled ? AsyncRequest::State::cancelled : AsyncRequest::State::done;
         }
+        request->m_finished.notify_all();
+    });
+
+    return 0;
+}
+
+template <bool is_node> const RemoteSampler<is_node> *remote_sampler(PySampler *py_sampler)
+{
+    return py_sampler->sampler == nullptr ? nullptr
+                                          : dynamic_cast<const RemoteSampler<is_node> *>(py_sampler->sampler.get());
+}
+} // namespace
+
+int32_t GetNodeTypeAsync(PyGraph *py_graph, NodeID *node_ids, size_t node_ids_size, Type *output, Type default_type,
+                         PyRequest *request)
+{
+    if (is_remote(py_graph))
+    {
+        return send_request(request, [=]() {
+            return py_graph->graph->client->GetNodeTypeAsync(
+                std::span(reinterpret_cast<snark::NodeId *>(node_ids), node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(output), node_ids_size), default_type);
+        });
+    }
+
+    return submit_request(request,
+                          [=]() { return GetNodeType(py_graph, node_ids, node_ids_size, output, default_type); });
+}
+
+int32_t GetNodeFeatureAsync(PyGraph *py_graph, NodeID *node_ids, size_t node_ids_size, Feature *features,
+                            size_t features_size, uint8_t *output, size_t output_size, int32_t encoding,
+                            PyRequest *request)
+{
+    if (is_remote(py_graph))
+    {
+        auto features_info =
+            std::make_shared<std::vector<snark::FeatureMeta>>(ExtractFeatureInfo(features, features_size));
+        return send_request(
+            request,
+            [=]() {
+                return py_graph->graph->client->GetNodeFeatureAsync(
+                    std::span(reinterpret_cast<snark::NodeId *>(node_ids), node_ids_size), std::span(*features_info),
+                    std::span(output, output_size), snark::FeatureEncoding(encoding));
+            },
+            features_info);
+    }
+
+    return submit_request(request, [=]() {
+        return GetNodeFeature(py_graph, node_ids, node_ids_size, features, features_size, output, output_size,
+                              encoding);
+    });
+}
+
+int32_t GetEdgeFeatureAsync(PyGraph *py_graph, NodeID *edge_src_ids, NodeID *edge_dst_ids, Type *edge_types,
+                            size_t edge_size, Feature *features, size_t features_size, uint8_t *output,
+                            size_t output_size, int32_t encoding, PyRequest *request)
+{
+    if (is_remote(py_graph))
+    {
+        auto features_info =
+            std::make_shared<std::vector<snark::FeatureMeta>>(ExtractFeatureInfo(features, features_size));
+        return send_request(
+            request,
+            [=]() {
+                return py_graph->graph->client->GetEdgeFeatureAsync(
+                    std::span(reinterpret_cast<snark::NodeId *>(edge_src_ids), edge_size),
+                    std::span(reinterpret_cast<snark::NodeId *>(edge_dst_ids), edge_size),
+                    std::span(reinterpret_cast<snark::Type *>(edge_types), edge_size), std::span(*features_info),
+                    std::span(output, output_size), snark::FeatureEncoding(encoding));
+            },
+            features_info);
+    }
+
+    return submit_request(request, [=]() {
+        return GetEdgeFeature(py_graph, edge_src_ids, edge_dst_ids, edge_types, edge_size, features, features_size,
+                              output, output_size, encoding);
+    });
+}
+
+int32_t NeighborCountAsync(PyGraph *py_graph, NodeID *in_node_ids, size_t in_node_ids_size, Type *in_edge_types,
+                           size_t in_edge_types_size, uint64_t *out_neighbor_counts, PyRequest *request)
+{
+    if (is_remote(py_graph))
+    {
+        return send_request(request, [=]() {
+            return py_graph->graph->client->NeighborCountAsync(
+                std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size),
+                std::span(out_neighbor_counts, in_node_ids_size));
+        });
+    }
+
+    return submit_request(request, [=]() {
+        return NeighborCount(py_graph, in_node_ids, in_node_ids_size, in_edge_types, in_edge_types_size,
+                             out_neighbor_counts);
+    });
+}
+
+int32_t WeightedSampleNeighborAsync(PyGraph *py_graph, int64_t seed, NodeID *in_node_ids, size_t in_node_ids_size,
+                                    Type *in_edge_types, size_t in_edge_types_size, size_t count,
+                                    NodeID *out_neighbor_ids, Type *out_types, float *out_weights,
+                                    NodeID default_node_id, float default_weight, Type default_edge_type,
+                                    PyRequest *request)
+{
+    if (is_remote(py_graph))
+    {
+        const auto out_size = count * in_node_ids_size;
+        return send_request(request, [=]() {
+            return py_graph->graph->client->WeightedSampleNeighborAsync(
+                seed, std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size), count,
+                std::span(reinterpret_cast<snark::NodeId *>(out_neighbor_ids), out_size),
+                std::span(reinterpret_cast<snark::Type *>(out_types), out_size),
+                std::span(reinterpret_cast<float *>(out_weights), out_size), default_node_id, default_weight,
+                default_edge_type);
+        });
+    }
+
+    return submit_request(request, [=]() {
+        return WeightedSampleNeighbor(py_graph, seed, in_node_ids, in_node_ids_size, in_edge_types,
+                                      in_edge_types_size, count, out_neighbor_ids, out_types, out_weights,
+                                      default_node_id, default_weight, default_edge_type);
+    });
+}
+
+int32_t UniformSampleNeighborAsync(PyGraph *py_graph, bool without_replacement, int64_t seed, NodeID *in_node_ids,
+                                   size_t in_node_ids_size, Type *in_edge_types, size_t in_edge_types_size,
+                                   size_t count, NodeID *out_neighbor_ids, Type *out_types, NodeID default_node_id,
+                                   Type default_edge_type, PyRequest *request)
+{
+    if (is_remote(py_graph))
+    {
+        const auto out_size = count * in_node_ids_size;
+        return send_request(request, [=]() {
+            return py_graph->graph->client->UniformSampleNeighborAsync(
+                without_replacement, seed, std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size), count,
+                std::span(reinterpret_cast<snark::NodeId *>(out_neighbor_ids), out_size),
+                std::span(reinterpret_cast<snark::Type *>(out_types), out_size), default_node_id, default_edge_type);
+        });
+    }
+
+    return submit_request(request, [=]() {
+        return UniformSampleNeighbor(py_graph, without_replacement, seed, in_node_ids, in_node_ids_size,
+                                     in_edge_types, in_edge_types_size, count, out_neighbor_ids, out_types,
+                                     default_node_id, default_edge_type);
+    });
+}
+
+int32_t RandomWalkAsync(PyGraph *py_graph, int64_t seed, float p, float q, NodeID default_node_id,
+                        NodeID *in_node_ids, size_t in_node_ids_size, Type *in_edge_types, size_t in_edge_types_size,
+                        size_t walk_length, NodeID *out_node_ids, PyRequest *request)
+{
+    // Parameters are validated by the synchronous version.
+    if (is_remote(py_graph) && p > 0 && q > 0)
+    {
+        const auto out_size = (walk_length + 1) * in_node_ids_size;
+        return send_request(request, [=]() {
+            return py_graph->graph->client->RandomWalkAsync(
+                seed, p, q, default_node_id,
+                std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size), walk_length,
+                std::span(reinterpret_cast<snark::NodeId *>(out_node_ids), out_size));
+        });
+    }
+
+    return submit_request(request, [=]() {
+        return RandomWalk(py_graph, seed, p, q, default_node_id, in_node_ids, in_node_ids_size, in_edge_types,
+                          in_edge_types_size, walk_length, out_node_ids);
+    });
+}
+
+int32_t NegativeSampleAsync(PyGraph *py_graph, int64_t seed, NodeID default_node_id, NodeID *in_node_ids,
+                            size_t in_node_ids_size, Type *in_edge_types, size_t in_edge_types_size, size_t count,
+                            NodeID *out_node_ids, PyRequest *request)
+{
+    if (is_remote(py_graph))
+    {
+        return send_request(request, [=]() {
+            return py_graph->graph->client->NegativeSampleAsync(
+                seed, default_node_id, std::span(reinterpret_cast<snark::NodeId *>(in_node_ids), in_node_ids_size),
+                std::span(reinterpret_cast<snark::Type *>(in_edge_types), in_edge_types_size), count,
+                std::span(reinterpret_cast<snark::NodeId *>(out_node_ids), count * in_node_ids_size));
+        });
     }
+
+    return submit_request(request, [=]() {
+        return NegativeSample(py_graph, seed, default_node_id, in_node_ids, in_node_ids_size, in_edge_types,
+                              in_edge_types_size, count, out_node_ids);
+    });
+}
+
+int32_t SampleNodesAsync(PySampler *py_sampler, int64_t seed, size_t count, NodeID *out_nodes, Type *out_types,
+                         PyRequest *request)
+{
+    if (auto sampler = remote_sampler<true>(py_sampler))
+    {
+        return send_request(request, [=]() {
+            return sampler->SampleAsync(seed, std::span(reinterpret_cast<snark::Type *>(out_types), count),
+                                        std::span(reinterpret_cast<snark::NodeId *>(out_nodes), count));
+        });
+    }
+
+    return submit_request(request, [=]() { return SampleNodes(py_sampler, seed, count, out_nodes, out_types); });
+}
+
+int32_t SampleEdgesAsync(PySampler *py_sampler, int64_t seed, size_t count, NodeID *out_src_id, NodeID *out_dst_id,
+                         Type *out_type, PyRequest *request)
+{
+    if (auto sampler = remote_sampler<false>(py_sampler))
+    {
+        return send_request(request, [=]() {
+            return sampler->SampleAsync(seed, std::span(reinterpret_cast<snark::Type *>(out_type), count),
+                                        std::span(reinterpret_cast<snark::NodeId *>(out_src_id), count),
+                                        std::span(reinterpret_cast<snark::NodeId *>(out_dst_id), count));
+        });
+    }
+
+    return submit_request(request,
+                          [=]() { return SampleEdges(py_sampler, seed, count, out_src_id, out_dst_id, out_type); });
+}
+
+int32_t PollRequest(PyRequest *py_request, bool *done)
+{
+    if (py_request->request == nullptr)
+    {
+        RAW_LOG_ERROR("Request is not initialized");
+        return 1;
+    }
+
+    std::lock_guard lock(py_request->request->m_mutex);
+    *done = py_request->request->m_state == AsyncRequest::State::done ||
+            py_request->request->m_state == AsyncRequest::State::cancelled;
+    return 0;
+}
+
+int32_t WaitRequest(PyRequest *py_request)
+{
+    if (py_request->request == nullptr)
+    {
+        RAW_LOG_ERROR("Request is not initialized");
+        return 1;
+    }
+
+    auto &request = *py_request->request;
+    std::unique_lock lock(request.m_mutex);
+    request.m_finished.wait(lock, [&request]() {
+        return request.m_state == AsyncRequest::State::done || request.m_state == AsyncRequest::State::cancelled;
+    });
+    return request.m_state == AsyncRequest::State::cancelled ? 1 : request.m_status;
+}
+
+int32_t CancelRequest(PyRequest *py_request, bool *cancelled)
+{
+    if (py_request->request == nullptr)
+    {
+        RAW_LOG_ERROR("Request is not initialized");
+        return 1;
+    }
+
+    auto &request = *py_request->request;
+    std::unique_lock lock(request.m_mutex);
+    if (request.m_state == AsyncRequest::State::queued)
+    {
+        request.m_state = AsyncRequest::State::cancelled;
+    }
+    else if (auto call = request.m_call)
+    {
+        // Cancelled calls finish on client threads, which need the lock to update the state.
+        lock.unlock();
+        call->Cancel();
+        lock.lock();
+    }
+    request.m_finished.wait(lock, [&request]() {
+        return request.m_state == AsyncRequest::State::done || request.m_state == AsyncRequest::State::cancelled;
+    });
+    *cancelled = request.m_state == AsyncRequest::State::cancelled;
+    return 0;
+}
+
+int32_t ResetRequest(PyRequest *py_request)
+{
+    py_request->request.reset();
     return 0;
 }
 
@@ -913,6 +1372,19 @@ int32_t ResetGraph(PyGraph *py_graph)
     return 0;
 }
 
+int32_t RefreshGraph(PyGraph *py_graph, const char *output_folder)
+{
+    if (!is_remote(py_graph))
+    {
+        RAW_LOG_ERROR("Only graphs connected to servers can be refreshed");
+        return 1;
+    }
+
+    py_graph->graph->client->Refresh();
+    py_graph->graph->client->WriteMetadata(output_folder);
+    return 0;
+}
+
 int32_t HDFSMoveMeta(const char *filename_src, const char *filename_dst, const char *config_path)
 {
     auto data = read_hdfs<char>(filename_src, config_path);
@@ -934,5 +1406,28 @@ int32_t HDFSMoveMeta(const char *filename_src, const char *filename_dst, const c
     return 0;
 }
 
+int32_t ReorderPartition(const char *path, const char *suffix, int32_t order, double *gap_before, double *gap_after)
+{
+    if (order < int32_t(snark::NodeOrder::input) || order > int32_t(snark::NodeOrder::rcm))
+    {
+        RAW_LOG_ERROR("Unknown node order %d", order);
+        return 1;
+    }
+
+    try
+    {
+        const auto stats = snark::ReorderPartition(path, suffix, snark::NodeOrder(order));
+        *gap_before = stats.m_gap_before;
+        *gap_after = stats.m_gap_after;
+    }
+    catch (const std::exception &e)
+    {
+        RAW_LOG_ERROR("Exception while reordering partition %s: %s", suffix, e.what());
+        return 1;
+    }
+
+    return 0;
+}
+
 } // namespace python
 } // namespace deep_graph
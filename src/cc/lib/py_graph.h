@@ -12,8 +12,10 @@
 #endif
 
 #ifdef __cplusplus
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 
 namespace snark
@@ -28,6 +30,7 @@ namespace python
 {
 
 struct GraphInternal;
+struct AsyncRequest;
 
 struct PyGraph
 {
@@ -41,11 +44,16 @@ struct PyServer
 {
     std::unique_ptr<snark::GRPCServer> server;
 };
+struct PyRequest
+{
+    std::shared_ptr<AsyncRequest> request;
+};
 
 enum PyPartitionStorageType // C interface to PartitionStoragetype in types.h
 {
     memory,
     disk,
+    mmap,
 };
 #else
 
@@ -57,10 +65,13 @@ typedef struct PySampler PySampler;
 
 typedef struct PyServer PyServer;
 
+typedef struct PyRequest PyRequest;
+
 enum PyPartitionStorageType // C interface to PartitionStoragetype in types.h
 {
     memory,
     disk,
+    mmap,
 };
 #endif
 
@@ -75,24 +86,94 @@ extern "C"
     typedef void (*GetNeighborsCallback)(const NodeID *, const float *, const Type *, size_t);
     typedef void (*GetSparseFeaturesCallback)(const int64_t **, size_t *, const uint8_t **, size_t *, int64_t *);
     typedef void (*GetStringFeaturesCallback)(size_t, const uint8_t *);
+    typedef void (*SampleSubgraphCallback)(const NodeID *, const uint32_t *, size_t, const uint64_t *,
+                                           const uint64_t *, const Type *, size_t, const uint8_t *, size_t);
+
+    // Options are passed in structs starting with their size, callers set it to sizeof of the struct. New fields are
+    // only appended, so fields unknown to callers built against older headers keep defaults. Null options use
+    // defaults for every field.
+    typedef struct PyGraphOptions
+    {
+        size_t size;
+        size_t feature_cache_size;
+        bool warm_feature_cache;
+        bool compact_node_index;
+        bool compressed_edges;
+        // Defaults to 1 thread processing batches in chunks of at least 1024 nodes.
+        size_t thread_count;
+        size_t min_chunk_size;
+        size_t alias_threshold;
+        const int32_t *columnar_features;
+        size_t columnar_feature_count;
+        const char *shared_index;
+        size_t edge_index_threshold;
+        // Files on HDFS are read in ranges of hdfs_buffer_size bytes with up to hdfs_read_threads ranges in flight
+        // per file, defaults to 4 MiB ranges and 4 reads.
+        size_t hdfs_buffer_size;
+        size_t hdfs_read_threads;
+    } PyGraphOptions;
+
+    typedef struct PyServerOptions
+    {
+        size_t size;
+        size_t feature_cache_size;
+        bool warm_feature_cache;
+        bool compact_node_index;
+        bool compressed_edges;
+        size_t alias_threshold;
+        size_t server_queues;
+        size_t server_threads;
+        // Defaults to 1 call of every method per queue.
+        size_t calls_per_method;
+        size_t worker_threads;
+        size_t method_count;
+        const char **method_names;
+        const size_t *method_calls;
+        const int32_t *columnar_features;
+        size_t columnar_feature_count;
+        bool numa;
+        size_t edge_index_threshold;
+        // Same as in PyGraphOptions.
+        size_t hdfs_buffer_size;
+        size_t hdfs_read_threads;
+    } PyServerOptions;
+
+    typedef struct PyClientOptions
+    {
+        size_t size;
+        bool route_nodes;
+        size_t deadline_ms;
+        size_t hedge_delay_us;
+        // Replicas of every shard in the order of connections, without them every connection is a separate shard.
+        const size_t *shard_replicas;
+        size_t shard_count;
+        size_t coalesce_window_us;
+        // 0 uses the default of snark::ClientCallConfig.
+        size_t coalesce_max_nodes;
+        bool compress_sparse_features;
+        size_t feature_cache_size;
+    } PyClientOptions;
 
     DEEPGNN_DLL extern int32_t CreateLocalGraph(PyGraph *graph, size_t count, uint32_t *partitions,
                                                 const char *filename, PyPartitionStorageType storage_type,
-                                                const char *config_path);
+                                                const char *config_path, const PyGraphOptions *options);
 
     DEEPGNN_DLL extern int32_t StartServer(PyServer *graph, size_t count, uint32_t *partitions, const char *filename,
                                            const char *host_name, const char *ssl_key, const char *ssl_cert,
                                            const char *ssl_root, const PyPartitionStorageType storage_type,
-                                           const char *config_path);
+                                           const char *config_path, const PyServerOptions *options);
 
     DEEPGNN_DLL extern int32_t CreateRemoteClient(PyGraph *graph, const char *output_folder, const char **connection,
                                                   size_t connection_count, const char *ssl_cert, size_t num_threads,
-                                                  size_t num_threads_per_cq);
+                                                  size_t num_threads_per_cq, const PyClientOptions *options);
 
     DEEPGNN_DLL extern int32_t GetNodeType(PyGraph *graph, NodeID *node_ids, size_t node_ids_size, Type *output,
                                            Type default_type);
+    // Encoding is snark::FeatureEncoding of features sent by servers, local graphs ignore it. Quantized encodings
+    // treat values as float32, so they have to be requested only if all features are float32 arrays.
     DEEPGNN_DLL extern int32_t GetNodeFeature(PyGraph *graph, NodeID *node_ids, size_t node_ids_size, Feature *features,
-                                              size_t features_size, uint8_t *output, size_t output_size);
+                                              size_t features_size, uint8_t *output, size_t output_size,
+                                              int32_t encoding);
     DEEPGNN_DLL extern int32_t GetNodeSparseFeature(PyGraph *graph, NodeID *node_ids, size_t node_ids_size,
                                                     Feature *features, size_t features_size,
                                                     GetSparseFeaturesCallback callback);
@@ -101,7 +182,8 @@ extern "C"
                                                     GetStringFeaturesCallback callback);
     DEEPGNN_DLL extern int32_t GetEdgeFeature(PyGraph *graph, NodeID *edge_src_ids, NodeID *edge_dst_ids,
                                               Type *edge_types, size_t edge_size, Feature *features,
-                                              size_t features_size, uint8_t *output, size_t output_size);
+                                              size_t features_size, uint8_t *output, size_t output_size,
+                                              int32_t encoding);
     DEEPGNN_DLL extern int32_t GetEdgeSparseFeature(PyGraph *graph, NodeID *edge_src_ids, NodeID *edge_dst_ids,
                                                     Type *edge_types, size_t edge_size, Feature *features,
                                                     size_t features_size, GetSparseFeaturesCallback callback);
@@ -124,10 +206,18 @@ extern "C"
                                                      NodeID *in_node_ids, size_t int_node_ids_size, Type *in_edge_types,
                                                      size_t in_edge_types_size, size_t count, NodeID *out_neighbor_ids,
                                                      Type *out_types, NodeID default_node_id, Type default_edge_type);
+    DEEPGNN_DLL extern int32_t SampleSubgraph(PyGraph *graph, bool without_replacement, int64_t seed,
+                                              NodeID *in_node_ids, size_t in_node_ids_size, uint32_t *fanouts,
+                                              size_t fanouts_size, Type *in_edge_types, size_t in_edge_types_size,
+                                              Feature *features, size_t features_size,
+                                              SampleSubgraphCallback callback);
 
     DEEPGNN_DLL extern int32_t RandomWalk(PyGraph *graph, int64_t seed, float p, float q, NodeID default_node_id,
                                           NodeID *in_node_ids, size_t in_node_ids_size, Type *in_edge_types,
                                           size_t in_edge_types_size, size_t walk_length, NodeID *out_node_ids);
+    DEEPGNN_DLL extern int32_t NegativeSample(PyGraph *graph, int64_t seed, NodeID default_node_id,
+                                              NodeID *in_node_ids, size_t in_node_ids_size, Type *in_edge_types,
+                                              size_t in_edge_types_size, size_t count, NodeID *out_node_ids);
     // TODO(alsamylk): sorted neighbors
 
     DEEPGNN_DLL extern int32_t CreateWeightedNodeSampler(PyGraph *graph, PySampler *node_sampler, size_t count,
@@ -152,14 +242,89 @@ extern "C"
 
     DEEPGNN_DLL extern int32_t ResetSampler(PySampler *sampler);
     DEEPGNN_DLL extern int32_t ResetGraph(PyGraph *graph);
+
+    // Drop client state derived from partitions of servers after they reload: cached features and node routes.
+    // Clients do it on their own after replies from reloaded servers, metadata of the reloaded servers is only
+    // written to output_folder here.
+    DEEPGNN_DLL extern int32_t RefreshGraph(PyGraph *graph, const char *output_folder);
     DEEPGNN_DLL extern int32_t ResetServer(PyServer *graph);
 
+    // Load partitions of a running server again, e.g. after delta partitions were added to the graph path, and
+    // write the number of completed reloads to version.
+    DEEPGNN_DLL extern int32_t ReloadServer(PyServer *graph, uint64_t *version);
+
+    // Asynchronous variants of the calls above return right after queueing a call on a background thread, the
+    // status of the call is returned by WaitRequest. Input and output buffers must stay alive until the request is
+    // finished or cancelled and graphs and samplers must outlive their requests.
+    DEEPGNN_DLL extern int32_t GetNodeTypeAsync(PyGraph *graph, NodeID *node_ids, size_t node_ids_size, Type *output,
+                                                Type default_type, PyRequest *request);
+    DEEPGNN_DLL extern int32_t GetNodeFeatureAsync(PyGraph *graph, NodeID *node_ids, size_t node_ids_size,
+                                                   Feature *features, size_t features_size, uint8_t *output,
+                                                   size_t output_size, int32_t encoding, PyRequest *request);
+    DEEPGNN_DLL extern int32_t GetEdgeFeatureAsync(PyGraph *graph, NodeID *edge_src_ids, NodeID *edge_dst_ids,
+                                                   Type *edge_types, size_t edge_size, Feature *features,
+                                                   size_t features_size, uint8_t *output, size_t output_size,
+                                                   int32_t encoding, PyRequest *request);
+    DEEPGNN_DLL extern int32_t NeighborCountAsync(PyGraph *graph, NodeID *in_node_ids, size_t in_node_ids_size,
+                                                  Type *in_edge_types, size_t in_edge_types_size,
+                                                  uint64_t *out_neighbor_counts, PyRequest *request);
+    DEEPGNN_DLL extern int32_t WeightedSampleNeighborAsync(PyGraph *graph, int64_t seed, NodeID *in_node_ids,
+                                                           size_t in_node_ids_size, Type *in_edge_types,
+                                                           size_t in_edge_types_size, size_t count,
+                                                           NodeID *out_neighbor_ids, Type *out_types,
+                                                           float *out_weights, NodeID default_node_id,
+                                                           float default_weight, Type default_edge_type,
+                                                           PyRequest *request);
+    DEEPGNN_DLL extern int32_t UniformSampleNeighborAsync(PyGraph *graph, bool without_replacement, int64_t seed,
+                                                          NodeID *in_node_ids, size_t in_node_ids_size,
+                                                          Type *in_edge_types, size_t in_edge_types_size, size_t count,
+                                                          NodeID *out_neighbor_ids, Type *out_types,
+                                                          NodeID default_node_id, Type default_edge_type,
+                                                          PyRequest *request);
+    DEEPGNN_DLL extern int32_t RandomWalkAsync(PyGraph *graph, int64_t seed, float p, float q, NodeID default_node_id,
+                                               NodeID *in_node_ids, size_t in_node_ids_size, Type *in_edge_types,
+                                               size_t in_edge_types_size, size_t walk_length, NodeID *out_node_ids,
+                                               PyRequest *request);
+    DEEPGNN_DLL extern int32_t NegativeSampleAsync(PyGraph *graph, int64_t seed, NodeID default_node_id,
+                                                   NodeID *in_node_ids, size_t in_node_ids_size, Type *in_edge_types,
+                                                   size_t in_edge_types_size, size_t count, NodeID *out_node_ids,
+                                                   PyRequest *request);
+    DEEPGNN_DLL extern int32_t SampleNodesAsync(PySampler *sampler, int64_t seed, size_t count, NodeID *out_nodes,
+                                                Type *out_types, PyRequest *request);
+    DEEPGNN_DLL extern int32_t SampleEdgesAsync(PySampler *sampler, int64_t seed, size_t count, NodeID *out_src_id,
+                                                NodeID *out_dst_id, Type *out_type, PyRequest *request);
+
+    // Check if a request is finished without blocking.
+    DEEPGNN_DLL extern int32_t PollRequest(PyRequest *request, bool *done);
+    // Block until a request is finished and return the status of the call, cancelled requests return 1.
+    DEEPGNN_DLL extern int32_t WaitRequest(PyRequest *request);
+    // Drop a request that hasn't started yet and cancel calls of distributed graphs in flight, running local requests
+    // are waited for. Buffers of the request can be released after the call, cancelled is set if the request didn't
+    // finish and outputs may be incomplete.
+    DEEPGNN_DLL extern int32_t CancelRequest(PyRequest *request, bool *cancelled);
+    DEEPGNN_DLL extern int32_t ResetRequest(PyRequest *request);
+
     DEEPGNN_DLL extern int32_t HDFSMoveMeta(const char *filename_src, const char *filename_dst,
                                             const char *config_path);
 
+    // Renumber nodes of a converted partition with files suffix for better locality, order is a snark::NodeOrder.
+    // Average index distances between endpoints of edges inside the partition are returned in gaps.
+    DEEPGNN_DLL extern int32_t ReorderPartition(const char *path, const char *suffix, int32_t order,
+                                                double *gap_before, double *gap_after);
+
 #ifdef __cplusplus
 }
 
+// Read options of a caller over defaults, fields past the size set by the caller keep their defaults.
+template <typename Options> Options ReadOptions(const Options *options, Options defaults)
+{
+    if (options != nullptr)
+    {
+        std::memcpy(&defaults, options, std::min(options->size, sizeof(Options)));
+    }
+    return defaults;
+}
+
 } // python
 } // deep_graph
 #endif
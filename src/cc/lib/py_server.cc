@@ -28,16 +28,50 @@ std::string safe_convert(const char *buffer)
 
 int32_t StartServer(PyServer *graph, size_t count, uint32_t *partitions, const char *filename, const char *host_name,
                     const char *ssl_key, const char *ssl_cert, const char *ssl_root,
-                    const PyPartitionStorageType storage_type_, const char *config_path)
+                    const PyPartitionStorageType storage_type_, const char *config_path,
+                    const PyServerOptions *options_)
 {
+    const HDFSReadOptions hdfs_defaults;
+    const auto options = ReadOptions(options_, PyServerOptions{.size = sizeof(PyServerOptions),
+                                                               .calls_per_method = 1,
+                                                               .hdfs_buffer_size = size_t(hdfs_defaults.m_buffer_size),
+                                                               .hdfs_read_threads = hdfs_defaults.m_parallelism});
     snark::PartitionStorageType storage_type = static_cast<snark::PartitionStorageType>(storage_type_);
+    snark::ServerThreadsConfig threads{.m_queue_count = options.server_queues,
+                                       .m_thread_count = options.server_threads,
+                                       .m_calls_per_method = options.calls_per_method,
+                                       .m_worker_count = options.worker_threads,
+                                       .m_numa = options.numa};
+    for (size_t method = 0; method < options.method_count; ++method)
+    {
+        threads.m_method_calls[safe_convert(options.method_names[method])] = options.method_calls[method];
+    }
     graph->server = std::make_unique<snark::GRPCServer>(
         std::make_shared<snark::GraphEngineServiceImpl>(
             safe_convert(filename), std::vector<uint32_t>(partitions, partitions + count),
-            static_cast<snark::PartitionStorageType>(storage_type), config_path),
+            static_cast<snark::PartitionStorageType>(storage_type), config_path,
+            snark::FeatureCacheConfig{.m_capacity = options.feature_cache_size, .m_warm = options.warm_feature_cache},
+            options.compact_node_index, options.compressed_edges, options.alias_threshold,
+            std::vector<snark::FeatureId>(options.columnar_features,
+                                          options.columnar_features + options.columnar_feature_count),
+            options.numa, options.edge_index_threshold,
+            HDFSReadOptions{.m_buffer_size = int64_t(options.hdfs_buffer_size),
+                            .m_parallelism = options.hdfs_read_threads}),
         std::make_shared<snark::GraphSamplerServiceImpl>(safe_convert(filename),
                                                          std::set<size_t>(partitions, partitions + count)),
-        safe_convert(host_name), safe_convert(ssl_key), safe_convert(ssl_cert), safe_convert(ssl_root));
+        safe_convert(host_name), safe_convert(ssl_key), safe_convert(ssl_cert), safe_convert(ssl_root),
+        std::move(threads));
+    return 0;
+}
+
+int32_t ReloadServer(PyServer *py_graph, uint64_t *version)
+{
+    if (!py_graph->server)
+    {
+        return 1;
+    }
+
+    *version = py_graph->server->Reload();
     return 0;
 }
 
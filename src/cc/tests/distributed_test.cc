@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 #include "src/cc/lib/distributed/client.h"
+#include "src/cc/lib/distributed/feature_encoding.h"
 #include "src/cc/lib/distributed/server.h"
 #include "src/cc/lib/graph/graph.h"
 #include "src/cc/lib/graph/partition.h"
@@ -11,15 +12,22 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <exception>
 #include <filesystem>
 #include <fstream>
+#include <limits>
+#include <map>
 #include <numeric>
 #include <random>
+#include <set>
 #include <span>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -102,6 +110,81 @@ TEST(DistributedTest, NodeFeaturesSingleServer)
     EXPECT_EQ(output, std::vector<float>({0, 1, 1, 2, 2, 3}));
 }
 
+TEST(DistributedTest, NodeFeaturesLatencyStats)
+{
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < num_nodes; n++)
+    {
+        std::vector<float> vals(fv_size);
+        std::iota(std::begin(vals), std::end(vals), float(n));
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = snark::NodeId(n), .m_type = 0, .m_weight = 1.0f, .m_float_features = {std::move(vals)}});
+    }
+
+    TempFolder path("NodeFeaturesLatencyStats");
+    auto partition = TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    snark::GRPCServer server(std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                                             snark::PartitionStorageType::memory, ""),
+                             {}, "localhost:0", "", "", "");
+    snark::GRPCClient c({server.InProcessChannel()}, 1, 1);
+
+    std::vector<snark::NodeId> input_nodes = {0, 1, 2, 1000};
+    std::vector<float> output(fv_size * input_nodes.size());
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+    const size_t request_count = 3;
+    for (size_t request = 0; request < request_count; ++request)
+    {
+        c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                         std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+    }
+
+    auto find_method = [](const snark::StatsReply &stats, const std::string &name) {
+        auto method = std::find_if(std::begin(stats.methods()), std::end(stats.methods()),
+                                   [&name](const auto &method) { return method.method() == name; });
+        EXPECT_NE(method, std::end(stats.methods()));
+        return *method;
+    };
+    auto stages = [](const snark::MethodStats &method) {
+        std::map<std::string, uint64_t> counts;
+        for (const auto &stage : method.stages())
+        {
+            counts[stage.stage()] = stage.latency().count();
+        }
+        return counts;
+    };
+
+    const auto server_stats = c.ServerStats();
+    ASSERT_EQ(server_stats.size(), 1);
+    ASSERT_EQ(server_stats[0].size(), 1);
+    const auto node_features = find_method(server_stats[0][0], "GetNodeFeatures");
+    EXPECT_EQ(node_features.requests(), request_count);
+    EXPECT_EQ(node_features.nodes(), request_count * input_nodes.size());
+    EXPECT_EQ(node_features.bytes(), request_count * 3 * sizeof(float) * fv_size);
+    EXPECT_EQ(node_features.reply_bytes(), node_features.bytes());
+    auto server_stages = stages(node_features);
+    // Process stage of the last request might be recorded after the client received a reply.
+    EXPECT_GE(server_stages["process"], request_count - 1);
+    EXPECT_EQ(server_stages["decode"], request_count);
+    EXPECT_EQ(server_stages["lookup"], request_count);
+    EXPECT_EQ(server_stages["read"], request_count);
+    EXPECT_EQ(server_stages["serialize"], request_count);
+    EXPECT_EQ(find_method(server_stats[0][0], "GetNodeTypes").requests(), 0);
+
+    snark::StatsReply server_side;
+    server.GetStats(server_side);
+    EXPECT_EQ(find_method(server_side, "GetStats").requests(), 1);
+
+    const auto client_stats = c.LatencyStats();
+    const auto client_features = find_method(client_stats, "/snark.GraphEngine/GetNodeFeatures");
+    EXPECT_EQ(client_features.requests(), request_count);
+    EXPECT_GT(client_features.bytes(), node_features.bytes());
+    const auto roundtrip = client_features.stages(0);
+    EXPECT_EQ(roundtrip.stage(), "roundtrip");
+    EXPECT_EQ(roundtrip.latency().count(), request_count);
+    EXPECT_GE(snark::latency_quantile(roundtrip.latency(), 0.99), snark::latency_quantile(roundtrip.latency(), 0.5));
+    EXPECT_GT(snark::latency_quantile(roundtrip.latency(), 0.5), 0);
+}
+
 TEST(DistributedTest, NodeStringFeaturesMultipleServers)
 {
     const size_t num_nodes = 4;
@@ -200,6 +283,43 @@ TEST(DistributedTest, NodeSparseFeaturesMultipleServers)
     EXPECT_EQ(dimensions, std::vector<int64_t>({0, 3}));
 }
 
+TEST(DistributedTest, NodeSparseFeaturesCompressedReplies)
+{
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < num_nodes; n++)
+    {
+        std::vector<int32_t> sparse = {1, 1, int32_t(n), 0, int32_t(n + 1)};
+        auto start = reinterpret_cast<float *>(sparse.data());
+        m.m_nodes.push_back(TestGraph::Node{.m_id = snark::NodeId(n),
+                                            .m_type = 0,
+                                            .m_weight = 1.0f,
+                                            .m_float_features = {std::vector<float>(start, start + sparse.size())}});
+    }
+
+    TempFolder path("NodeSparseFeaturesCompressedReplies");
+    TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    snark::GRPCServer server(std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                                             snark::PartitionStorageType::memory, ""),
+                             {}, "localhost:0", "", "", "");
+    snark::GRPCClient c({server.InProcessChannel()}, 1, 1, snark::ClientCallConfig{.m_compress_sparse_features = true});
+
+    std::vector<snark::NodeId> input_nodes = {3, 1000, 7};
+    std::vector<snark::FeatureId> features = {0};
+    std::vector<std::vector<uint8_t>> values(features.size());
+    std::vector<std::vector<int64_t>> indices(features.size());
+    std::vector<int64_t> dimensions(features.size());
+    c.GetNodeSparseFeature(std::span(input_nodes), std::span(features), std::span(dimensions), indices, values);
+    std::span res(reinterpret_cast<int32_t *>(values[0].data()), values[0].size() / 4);
+    EXPECT_EQ(std::vector<int32_t>(std::begin(res), std::end(res)), std::vector<int32_t>({4, 8}));
+    EXPECT_EQ(indices[0], std::vector<int64_t>({0, 3, 2, 7}));
+    EXPECT_EQ(dimensions, std::vector<int64_t>({1}));
+
+    std::vector<uint8_t> strings;
+    std::vector<int64_t> string_dimensions(input_nodes.size());
+    c.GetNodeStringFeature(std::span(input_nodes), std::span(features), std::span(string_dimensions), strings);
+    EXPECT_EQ(string_dimensions, std::vector<int64_t>({20, 0, 20}));
+}
+
 TEST(DistributedTest, NodeSparseFeaturesSingleServerMissingFeatures)
 {
     // indices - 17416, data - 1.0
@@ -438,6 +558,206 @@ TEST(DistributedTest, NodeFeaturesMultipleServers)
     EXPECT_EQ(output, std::vector<float>({0, 1, 11, 12, 22, 23}));
 }
 
+TEST(DistributedTest, NodeFeaturesConcurrentRequestsServerWorkers)
+{
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < num_nodes; n++)
+    {
+        std::vector<float> vals(fv_size);
+        std::iota(std::begin(vals), std::end(vals), float(n));
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = snark::NodeId(n), .m_type = 0, .m_weight = 1.0f, .m_float_features = {std::move(vals)}});
+    }
+
+    TempFolder path("NodeFeaturesConcurrentRequestsServerWorkers");
+    TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    snark::GRPCServer server(std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                                             snark::PartitionStorageType::memory, ""),
+                             {}, "localhost:0", "", "", "",
+                             snark::ServerThreadsConfig{.m_queue_count = 2,
+                                                        .m_thread_count = 3,
+                                                        .m_calls_per_method = 2,
+                                                        .m_method_calls = {{"GetNodeFeatures", 8}},
+                                                        .m_worker_count = 4});
+    snark::GRPCClient c({server.InProcessChannel()}, 4, 2);
+
+    std::vector<std::thread> threads;
+    std::vector<std::vector<float>> outputs(8);
+    for (size_t t = 0; t < outputs.size(); ++t)
+    {
+        threads.emplace_back([&c, &output = outputs[t], t]() {
+            for (size_t request = 0; request < 20; ++request)
+            {
+                std::vector<snark::NodeId> input_nodes = {snark::NodeId((t * 20 + request) % num_nodes), 1000};
+                output.assign(fv_size * input_nodes.size(), -2);
+                std::vector<snark::FeatureMeta> features = {
+                    {snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+                c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                                 std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+                const float node = float(input_nodes.front());
+                if (output != std::vector<float>({node, node + 1, 0, 0}))
+                {
+                    return;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t t = 0; t < outputs.size(); ++t)
+    {
+        const float node = float((t * 20 + 19) % num_nodes);
+        EXPECT_EQ(outputs[t], std::vector<float>({node, node + 1, 0, 0}));
+    }
+}
+
+TEST(DistributedTest, DestroyServerWithRequestsInFlight)
+{
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < num_nodes; n++)
+    {
+        std::vector<float> vals(fv_size);
+        std::iota(std::begin(vals), std::end(vals), float(n));
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = snark::NodeId(n), .m_type = 0, .m_weight = 1.0f, .m_float_features = {std::move(vals)}});
+    }
+
+    TempFolder path("DestroyServerWithRequestsInFlight");
+    TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    for (size_t worker_count : {0, 2})
+    {
+        auto server = std::make_unique<snark::GRPCServer>(
+            std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                            snark::PartitionStorageType::memory, ""),
+            nullptr, "localhost:0", "", "", "",
+            snark::ServerThreadsConfig{.m_queue_count = 2, .m_calls_per_method = 2, .m_worker_count = worker_count});
+        auto stub = snark::GraphEngine::NewStub(
+            grpc::CreateChannel("localhost:" + std::to_string(server->Port()), grpc::InsecureChannelCredentials()));
+
+        struct Call
+        {
+            grpc::ClientContext context;
+            snark::NodeFeaturesReply reply;
+            grpc::Status status;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<snark::NodeFeaturesReply>> reader;
+        };
+        grpc::CompletionQueue cq;
+        std::vector<Call> calls(200);
+        snark::NodeFeaturesRequest request;
+        for (snark::NodeId node = 0; node < snark::NodeId(num_nodes); ++node)
+        {
+            request.add_node_ids(node);
+        }
+        auto feature = request.add_features();
+        feature->set_id(0);
+        feature->set_size(sizeof(float) * fv_size);
+        for (auto &call : calls)
+        {
+            call.reader = stub->AsyncGetNodeFeatures(&call.context, request, &cq);
+            call.reader->Finish(&call.reply, &call.status, &call);
+        }
+
+        // Client queue is polled while the server is destroyed to let its channel read replies and close.
+        std::atomic<size_t> completed = 0;
+        std::atomic<size_t> succeeded = 0;
+        std::thread poller([&cq, &completed, &succeeded, count = calls.size()]() {
+            void *tag;
+            bool ok;
+            while (completed < count && cq.Next(&tag, &ok))
+            {
+                succeeded += static_cast<Call *>(tag)->status.ok() ? 1 : 0;
+                ++completed;
+            }
+        });
+
+        // Wait for the first reply to have the rest of requests in flight when the server is destroyed.
+        while (completed == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        server.reset();
+
+        // Requests are either served or failed, but all of them complete.
+        poller.join();
+        EXPECT_EQ(completed, calls.size());
+        EXPECT_GT(succeeded, 0);
+        cq.Shutdown();
+        void *tag;
+        bool ok;
+        EXPECT_FALSE(cq.Next(&tag, &ok));
+    }
+}
+
+TEST(DistributedTest, NodeFeaturesNumaServer)
+{
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < num_nodes; n++)
+    {
+        std::vector<float> vals(fv_size);
+        std::iota(std::begin(vals), std::end(vals), float(n));
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = snark::NodeId(n), .m_type = 0, .m_weight = 1.0f, .m_float_features = {std::move(vals)}});
+    }
+
+    TempFolder path("NodeFeaturesNumaServer");
+    TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    snark::GRPCServer server(std::make_shared<snark::GraphEngineServiceImpl>(
+                                 path.string(), std::vector<uint32_t>{0}, snark::PartitionStorageType::memory, "",
+                                 snark::FeatureCacheConfig{}, false, false, 0, std::vector<snark::FeatureId>{}, true),
+                             {}, "localhost:0", "", "", "",
+                             snark::ServerThreadsConfig{.m_queue_count = 1, .m_worker_count = 2, .m_numa = true});
+    snark::GRPCClient c({server.InProcessChannel()}, 1, 1);
+
+    std::vector<snark::NodeId> input_nodes = {3, 1000, 5};
+    std::vector<float> output(fv_size * input_nodes.size());
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+    c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                     std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+    EXPECT_EQ(output, std::vector<float>({3, 4, 0, 0, 5, 6}));
+}
+
+TEST(DistributedTest, NodeFeaturesCoalescedRequests)
+{
+    auto mocks = MockServers(10, "NodeFeaturesCoalescedRequests");
+
+    // Batch is sent only after all callers join it: every one of them adds 2 nodes and they all share a missing one.
+    const size_t caller_count = 4;
+    snark::GRPCClient c(std::move(mocks.first), 2, 1,
+                        snark::ClientCallConfig{.m_coalesce_window = std::chrono::seconds(60),
+                                                .m_coalesce_max_nodes = 2 * caller_count + 1});
+
+    std::vector<std::thread> threads;
+    std::vector<std::vector<float>> outputs(caller_count);
+    for (size_t t = 0; t < caller_count; ++t)
+    {
+        threads.emplace_back([&c, &output = outputs[t], t]() {
+            std::vector<snark::NodeId> input_nodes = {snark::NodeId(t * 10), 1000, snark::NodeId(t * 10 + 1)};
+            output.assign(fv_size * input_nodes.size(), -2);
+            std::vector<snark::FeatureMeta> features = {
+                {snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+            c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                             std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    for (size_t t = 0; t < caller_count; ++t)
+    {
+        const float node = float(t * 10);
+        EXPECT_EQ(outputs[t], std::vector<float>({node, node + 1, 0, 0, node + 1, node + 2}));
+    }
+
+    const auto stats = c.CallStats();
+    EXPECT_EQ(stats.m_coalesced, caller_count - 1);
+    EXPECT_EQ(stats.m_requests, 20);
+}
+
 TEST(DistributedTest, NodeTypeMultipleServers)
 {
     auto mocks = MockServers(10, "NodeTypeMultipleServers", 3);
@@ -448,6 +768,255 @@ TEST(DistributedTest, NodeTypeMultipleServers)
     EXPECT_EQ(types, std::vector<snark::Type>({0, 0, 2, 1, -1}));
 }
 
+TEST(DistributedTest, NodeTypeMultipleServersHedgedRequests)
+{
+    auto mocks = MockServers(10, "NodeTypeMultipleServersHedgedRequests", 3);
+    snark::GRPCClient c(std::move(mocks.first), 2, 1,
+                        snark::ClientCallConfig{.m_hedge_delay = std::chrono::microseconds(1)});
+    std::vector<snark::NodeId> input_nodes = {42, 0, 11, 22, 123};
+    for (size_t request = 0; request < 10; ++request)
+    {
+        std::vector<snark::Type> types(5, -2);
+        c.GetNodeType(std::span(input_nodes), std::span(types), -1);
+        EXPECT_EQ(types, std::vector<snark::Type>({0, 0, 2, 1, -1}));
+    }
+
+    // Shards have a single replica, so there is nowhere to send duplicate requests to.
+    const auto stats = c.CallStats();
+    EXPECT_EQ(stats.m_hedged, 0);
+    EXPECT_EQ(stats.m_hedge_wins, 0);
+    EXPECT_EQ(stats.m_requests, 10 * 20);
+    EXPECT_EQ(stats.m_failed, 0);
+    EXPECT_EQ(stats.m_outstanding, std::vector<size_t>(20, 0));
+}
+
+TEST(DistributedTest, NodeTypeHedgedRequestsDeadlineExceeded)
+{
+    // Server never accepts calls, so requests stay queued until the deadline.
+    snark::GraphEngine::AsyncService service;
+    grpc::ServerBuilder builder;
+    builder.RegisterService(&service);
+    auto queue = builder.AddCompletionQueue();
+    auto server = builder.BuildAndStart();
+
+    // Two channels to the same server act as replicas of a single shard.
+    snark::GRPCClient c(std::vector<std::vector<std::shared_ptr<grpc::Channel>>>{{
+                            server->InProcessChannel(grpc::ChannelArguments()),
+                            server->InProcessChannel(grpc::ChannelArguments()),
+                        }},
+                        1, 1,
+                        snark::ClientCallConfig{.m_deadline = std::chrono::milliseconds(50),
+                                                .m_hedge_delay = std::chrono::microseconds(1000)});
+    std::vector<snark::NodeId> input_nodes = {0, 1};
+    std::vector<snark::Type> types(2, -2);
+    EXPECT_THROW(c.GetNodeType(std::span(input_nodes), std::span(types), -1), std::runtime_error);
+
+    const auto stats = c.CallStats();
+    EXPECT_EQ(stats.m_requests, 2);
+    EXPECT_EQ(stats.m_hedged, 1);
+    EXPECT_EQ(stats.m_hedge_wins, 0);
+    EXPECT_EQ(stats.m_deadline_exceeded, 1);
+    EXPECT_EQ(stats.m_outstanding, std::vector<size_t>{0});
+
+    server->Shutdown();
+    queue->Shutdown();
+    void *tag;
+    bool ok;
+    while (queue->Next(&tag, &ok))
+    {
+    }
+}
+
+TEST(DistributedTest, NodeTypeSingleReplicaNotHedged)
+{
+    // Server never accepts calls, so the hedge delay passes long before the deadline.
+    snark::GraphEngine::AsyncService service;
+    grpc::ServerBuilder builder;
+    builder.RegisterService(&service);
+    auto queue = builder.AddCompletionQueue();
+    auto server = builder.BuildAndStart();
+
+    snark::GRPCClient c({server->InProcessChannel(grpc::ChannelArguments())}, 1, 1,
+                        snark::ClientCallConfig{.m_deadline = std::chrono::milliseconds(50),
+                                                .m_hedge_delay = std::chrono::microseconds(1000)});
+    std::vector<snark::NodeId> input_nodes = {0, 1};
+    std::vector<snark::Type> types(2, -2);
+    EXPECT_THROW(c.GetNodeType(std::span(input_nodes), std::span(types), -1), std::runtime_error);
+
+    const auto stats = c.CallStats();
+    EXPECT_EQ(stats.m_requests, 1);
+    EXPECT_EQ(stats.m_hedged, 0);
+    EXPECT_EQ(stats.m_deadline_exceeded, 1);
+    EXPECT_EQ(stats.m_outstanding, std::vector<size_t>{0});
+
+    server->Shutdown();
+    queue->Shutdown();
+    void *tag;
+    bool ok;
+    while (queue->Next(&tag, &ok))
+    {
+    }
+}
+
+TEST(DistributedTest, NodeTypeMultipleServersAsyncRequests)
+{
+    auto mocks = MockServers(10, "NodeTypeMultipleServersAsyncRequests", 3);
+    snark::GRPCClient c(std::move(mocks.first), 1, 1);
+    std::vector<snark::NodeId> input_nodes = {42, 0, 11, 22, 123};
+
+    // Requests in flight don't hold caller threads, so a single thread can keep many of them waiting for servers.
+    std::vector<std::vector<snark::Type>> types(32, std::vector<snark::Type>(5, -2));
+    std::vector<std::shared_ptr<snark::ClientRequest>> requests;
+    for (auto &output : types)
+    {
+        requests.emplace_back(c.GetNodeTypeAsync(std::span(input_nodes), std::span(output), -1));
+    }
+
+    for (size_t request = 0; request < requests.size(); ++request)
+    {
+        requests[request]->Wait();
+        EXPECT_TRUE(requests[request]->Done());
+        EXPECT_FALSE(requests[request]->Cancelled());
+        EXPECT_EQ(types[request], std::vector<snark::Type>({0, 0, 2, 1, -1}));
+    }
+}
+
+TEST(DistributedTest, CancelAsyncRequestsInFlight)
+{
+    // Server never accepts calls, so requests stay in flight until they are cancelled.
+    snark::GraphEngine::AsyncService service;
+    grpc::ServerBuilder builder;
+    builder.RegisterService(&service);
+    auto queue = builder.AddCompletionQueue();
+    auto server = builder.BuildAndStart();
+
+    snark::GRPCClient c({server->InProcessChannel(grpc::ChannelArguments())}, 1, 1);
+    std::vector<snark::NodeId> input_nodes = {0, 1};
+    std::vector<std::vector<snark::Type>> types(8, std::vector<snark::Type>(2, -2));
+    std::vector<std::shared_ptr<snark::ClientRequest>> requests;
+    for (auto &output : types)
+    {
+        requests.emplace_back(c.GetNodeTypeAsync(std::span(input_nodes), std::span(output), -1));
+    }
+
+    for (auto &request : requests)
+    {
+        EXPECT_FALSE(request->Done());
+        request->Cancel();
+    }
+
+    for (auto &request : requests)
+    {
+        EXPECT_THROW(request->Wait(), std::runtime_error);
+        EXPECT_TRUE(request->Cancelled());
+    }
+    EXPECT_EQ(c.CallStats().m_outstanding, std::vector<size_t>{0});
+
+    server->Shutdown();
+    queue->Shutdown();
+    void *tag;
+    bool ok;
+    while (queue->Next(&tag, &ok))
+    {
+    }
+}
+
+namespace
+{
+// Servers for a single partition of num_nodes nodes.
+std::vector<std::unique_ptr<snark::GRPCServer>> ReplicatedServers(size_t replica_count, const TempFolder &path)
+{
+    TestGraph::MemoryGraph m;
+    for (size_t n = 0; n < num_nodes; n++)
+    {
+        std::vector<float> vals(fv_size);
+        std::iota(std::begin(vals), std::end(vals), float(n));
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = snark::NodeId(n), .m_type = 0, .m_weight = 1.0f, .m_float_features = {std::move(vals)}});
+    }
+
+    TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    std::vector<std::unique_ptr<snark::GRPCServer>> servers;
+    for (size_t replica = 0; replica < replica_count; ++replica)
+    {
+        servers.emplace_back(std::make_unique<snark::GRPCServer>(
+            std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                            snark::PartitionStorageType::memory, ""),
+            std::shared_ptr<snark::GraphSamplerServiceImpl>{}, "localhost:0", "", "", ""));
+    }
+
+    return servers;
+}
+} // namespace
+
+TEST(DistributedTest, NodeFeaturesReplicatedShard)
+{
+    TempFolder path("NodeFeaturesReplicatedShard");
+    auto servers = ReplicatedServers(3, path);
+    std::vector<std::shared_ptr<grpc::Channel>> replicas;
+    for (auto &server : servers)
+    {
+        replicas.emplace_back(server->InProcessChannel());
+    }
+    snark::GRPCClient c(std::vector<std::vector<std::shared_ptr<grpc::Channel>>>{std::move(replicas)}, 4, 1);
+
+    std::vector<std::thread> threads;
+    std::vector<bool> matches(4, true);
+    for (size_t t = 0; t < matches.size(); ++t)
+    {
+        threads.emplace_back([&c, &matches, t]() {
+            for (size_t request = 0; request < 20; ++request)
+            {
+                std::vector<snark::NodeId> input_nodes = {snark::NodeId((t * 20 + request) % num_nodes)};
+                std::vector<float> output(fv_size, -2);
+                std::vector<snark::FeatureMeta> features = {
+                    {snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+                c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                                 std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+                const float node = float(input_nodes.front());
+                matches[t] = matches[t] && output == std::vector<float>({node, node + 1});
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(matches, std::vector<bool>(4, true));
+    const auto stats = c.CallStats();
+    EXPECT_EQ(stats.m_requests, 80);
+    EXPECT_EQ(stats.m_outstanding, std::vector<size_t>{0});
+}
+
+TEST(DistributedTest, NodeFeaturesReplicaFailover)
+{
+    TempFolder path("NodeFeaturesReplicaFailover");
+    auto servers = ReplicatedServers(1, path);
+
+    // Nothing listens on port 1, so requests to the first replica fail with unavailable status.
+    snark::GRPCClient c(std::vector<std::vector<std::shared_ptr<grpc::Channel>>>{{
+                            grpc::CreateChannel("localhost:1", grpc::InsecureChannelCredentials()),
+                            servers.front()->InProcessChannel(),
+                        }},
+                        1, 1);
+    for (size_t request = 0; request < 20; ++request)
+    {
+        std::vector<snark::NodeId> input_nodes = {snark::NodeId(request)};
+        std::vector<float> output(fv_size, -2);
+        std::vector<snark::FeatureMeta> features = {
+            {snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+        c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                         std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+        EXPECT_EQ(output, std::vector<float>({float(request), float(request + 1)}));
+    }
+
+    const auto stats = c.CallStats();
+    EXPECT_GE(stats.m_failovers, 1);
+    EXPECT_EQ(stats.m_failed, 0);
+    EXPECT_EQ(stats.m_outstanding, std::vector<size_t>{0});
+}
+
 TEST(DistributedTest, NodeFeaturesMultipleServersMissingFeatureId)
 {
     auto mocks = MockServers(10, "NodeFeaturesMultipleServersMissingFeatureId");
@@ -474,6 +1043,292 @@ TEST(DistributedTest, NodeFeaturesMultipleServersBackFillLargeRequestFeatureSize
     EXPECT_EQ(output, std::vector<float>({0, 1, 0, 0, 11, 12, 0, 0, 22, 23, 0, 0}));
 }
 
+TEST(DistributedTest, NodeFeaturesMultipleServersLargeFeatures)
+{
+    // Replies are much larger than transport slices, so feature values of a node might be split between them.
+    const size_t large_fv_size = 4099;
+    const size_t nodes_per_server = 64;
+    std::vector<TempFolder> paths;
+    std::vector<std::unique_ptr<snark::GRPCServer>> servers;
+    std::vector<std::shared_ptr<grpc::Channel>> channels;
+    for (size_t server = 0; server < 2; ++server)
+    {
+        TestGraph::MemoryGraph m;
+        for (size_t n = 0; n < nodes_per_server; ++n)
+        {
+            const size_t node = server * nodes_per_server + n;
+            std::vector<float> vals(large_fv_size);
+            std::iota(std::begin(vals), std::end(vals), float(node));
+            m.m_nodes.push_back(TestGraph::Node{.m_id = snark::NodeId(node),
+                                                .m_type = 0,
+                                                .m_weight = 1.0f,
+                                                .m_float_features = {std::move(vals)}});
+        }
+
+        paths.emplace_back("NodeFeaturesMultipleServersLargeFeatures_" + std::to_string(server));
+        TestGraph::convert(paths.back().path, "0_0", std::move(m), 1);
+        servers.emplace_back(std::make_unique<snark::GRPCServer>(
+            std::make_shared<snark::GraphEngineServiceImpl>(paths.back().string(), std::vector<uint32_t>{0},
+                                                            snark::PartitionStorageType::memory, ""),
+            std::shared_ptr<snark::GraphSamplerServiceImpl>{}, "localhost:0", "", "", ""));
+        channels.emplace_back(servers.back()->InProcessChannel());
+    }
+
+    snark::GRPCClient c(std::move(channels), 2, 1);
+    std::vector<snark::NodeId> input_nodes;
+    for (size_t n = 0; n < 2 * nodes_per_server; ++n)
+    {
+        input_nodes.emplace_back(snark::NodeId((n * 37) % (2 * nodes_per_server)));
+    }
+    input_nodes.emplace(std::begin(input_nodes) + 5, 1000);
+    input_nodes.emplace_back(3);
+
+    std::vector<float> output(large_fv_size * input_nodes.size(), -2);
+    std::vector<snark::FeatureMeta> features = {
+        {snark::FeatureId(0), snark::FeatureSize(sizeof(float) * large_fv_size)}};
+    c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                     std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+
+    std::vector<float> expected;
+    for (auto node : input_nodes)
+    {
+        const size_t first = expected.size();
+        expected.resize(first + large_fv_size, 0);
+        if (node < snark::NodeId(2 * nodes_per_server))
+        {
+            std::iota(std::begin(expected) + first, std::end(expected), float(node));
+        }
+    }
+    EXPECT_EQ(output, expected);
+}
+
+TEST(DistributedTest, FeatureEncodingRoundTrip)
+{
+    const float infinity = std::numeric_limits<float>::infinity();
+    std::vector<float> values = {0, 1, -2.5f, 65504, 1e-6f, 70000, -infinity, 0.1f};
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(sizeof(float) * 6)},
+                                                {snark::FeatureId(1), snark::FeatureSize(sizeof(float) * 2)}};
+    const std::span raw(reinterpret_cast<const uint8_t *>(values.data()), sizeof(float) * values.size());
+    auto round_trip = [&](snark::FeatureEncoding encoding) {
+        EXPECT_TRUE(snark::CanEncodeFeatures(encoding, features));
+        std::vector<uint8_t> encoded(snark::EncodedFeaturesSize(encoding, features));
+        snark::EncodeFeatures(encoding, features, raw, std::span(encoded));
+        std::vector<float> decoded(values.size(), -2);
+        snark::DecodeFeatures(encoding, features, std::span(encoded),
+                              std::span(reinterpret_cast<uint8_t *>(decoded.data()), sizeof(float) * decoded.size()));
+        return decoded;
+    };
+
+    EXPECT_EQ(round_trip(snark::FEATURE_ENCODING_RAW), values);
+
+    auto half = round_trip(snark::FEATURE_ENCODING_FLOAT16);
+    EXPECT_EQ(std::vector<float>(std::begin(half), std::begin(half) + 4), std::vector<float>({0, 1, -2.5f, 65504}));
+    // 1e-6 is a subnormal half: the closest one is 17 * 2^-24.
+    EXPECT_EQ(half[4], 17.0f / float(1 << 24));
+    EXPECT_EQ(half[5], infinity);
+    EXPECT_EQ(half[6], -infinity);
+    EXPECT_NEAR(half[7], 0.1f, 0.1f / 1024);
+
+    auto brain = round_trip(snark::FEATURE_ENCODING_BFLOAT16);
+    EXPECT_EQ(std::vector<float>(std::begin(brain), std::begin(brain) + 3), std::vector<float>({0, 1, -2.5f}));
+    for (size_t index = 3; index < 6; ++index)
+    {
+        EXPECT_NEAR(brain[index], values[index], values[index] / 128);
+    }
+    EXPECT_EQ(brain[6], -infinity);
+
+    // Every feature has its own scale, infinities don't affect it.
+    auto quantized = round_trip(snark::FEATURE_ENCODING_INT8);
+    for (size_t index = 0; index < 6; ++index)
+    {
+        EXPECT_NEAR(quantized[index], values[index], 70000.0f / 127 / 2);
+    }
+    EXPECT_EQ(quantized[6], -0.1f / 127 * 127);
+    EXPECT_NEAR(quantized[7], 0.1f, 0.1f / 127 / 2);
+
+    EXPECT_EQ(snark::EncodedFeaturesSize(snark::FEATURE_ENCODING_FLOAT16, features), values.size() * 2);
+    EXPECT_EQ(snark::EncodedFeaturesSize(snark::FEATURE_ENCODING_INT8, features), values.size() + 2 * sizeof(float));
+    std::vector<snark::FeatureMeta> bytes = {{snark::FeatureId(0), snark::FeatureSize(6)}};
+    EXPECT_FALSE(snark::CanEncodeFeatures(snark::FEATURE_ENCODING_INT8, bytes));
+    EXPECT_TRUE(snark::CanEncodeFeatures(snark::FEATURE_ENCODING_RAW, bytes));
+}
+
+TEST(DistributedTest, NodeFeaturesMultipleServersEncoded)
+{
+    auto mocks = MockServers(10, "NodeFeaturesMultipleServersEncoded");
+    snark::GRPCClient c(std::move(mocks.first), 1, 1);
+
+    // Missing nodes and features are still filled with zeros.
+    std::vector<snark::NodeId> input_nodes = {0, 11, 1000, 22, 99};
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)},
+                                                {snark::FeatureId(1), snark::FeatureSize(sizeof(float))}};
+    const std::vector<float> expected = {0, 1, 0, 11, 12, 0, 0, 0, 0, 22, 23, 0, 99, 100, 0};
+    for (auto encoding : {snark::FEATURE_ENCODING_FLOAT16, snark::FEATURE_ENCODING_BFLOAT16})
+    {
+        std::vector<float> output(expected.size(), -2);
+        c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                         std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()),
+                         encoding);
+        EXPECT_EQ(output, expected);
+    }
+
+    std::vector<float> output(expected.size(), -2);
+    c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                     std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()),
+                     snark::FEATURE_ENCODING_INT8);
+    for (size_t index = 0; index < expected.size(); ++index)
+    {
+        EXPECT_NEAR(output[index], expected[index], 100.0f / 127 / 2);
+    }
+    // Feature value 11 is quantized to 116 steps of 12 / 127.
+    EXPECT_NE(output[3], expected[3]);
+
+    // Byte features can't be quantized and are sent raw.
+    std::vector<snark::FeatureMeta> bytes = {{snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size + 2)}};
+    std::vector<uint8_t> raw(bytes[0].second * input_nodes.size(), 1);
+    c.GetNodeFeature(std::span(input_nodes), std::span(bytes), std::span(raw), snark::FEATURE_ENCODING_FLOAT16);
+    EXPECT_EQ(reinterpret_cast<float *>(raw.data() + bytes[0].second)[0], 11);
+    EXPECT_EQ(raw[2 * bytes[0].second], 0);
+}
+
+namespace
+{
+// Two servers with 4 nodes each, node n is connected to n + 1 by an edge with features {n, n / 3}.
+struct EdgeFeatureServers
+{
+    std::vector<TempFolder> m_paths;
+    std::vector<std::unique_ptr<snark::GRPCServer>> m_servers;
+    std::vector<std::shared_ptr<grpc::Channel>> m_channels;
+
+    explicit EdgeFeatureServers(const std::string &name)
+    {
+        for (size_t server = 0; server < 2; ++server)
+        {
+            TestGraph::MemoryGraph m;
+            for (size_t n = 0; n < 4; ++n)
+            {
+                const size_t node = server * 4 + n;
+                m.m_nodes.push_back(TestGraph::Node{
+                    .m_id = snark::NodeId(node),
+                    .m_type = 0,
+                    .m_weight = 1.0f,
+                    .m_neighbors = {TestGraph::NeighborRecord{node + 1, 0, 1.0f}},
+                    .m_edge_features = {{{float(node), float(node) / 3}}}});
+            }
+
+            m_paths.emplace_back(name + "_" + std::to_string(server));
+            TestGraph::convert(m_paths.back().path, "0_0", std::move(m), 1);
+            m_servers.emplace_back(std::make_unique<snark::GRPCServer>(
+                std::make_shared<snark::GraphEngineServiceImpl>(m_paths.back().string(), std::vector<uint32_t>{0},
+                                                                snark::PartitionStorageType::memory, ""),
+                std::shared_ptr<snark::GraphSamplerServiceImpl>{}, "localhost:0", "", "", ""));
+            m_channels.emplace_back(m_servers.back()->InProcessChannel());
+        }
+    }
+};
+} // namespace
+
+TEST(DistributedTest, EdgeFeaturesMultipleServersEncoded)
+{
+    EdgeFeatureServers servers("EdgeFeaturesMultipleServersEncoded");
+    snark::GRPCClient c(servers.m_channels, 1, 1);
+    std::vector<snark::NodeId> sources = {6, 1, 3, 2};
+    std::vector<snark::NodeId> destinations = {7, 2, 5, 3};
+    std::vector<snark::Type> types = {0, 0, 0, 0};
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(2 * sizeof(float))}};
+    std::vector<float> expected(2 * sources.size(), -2);
+    c.GetEdgeFeature(std::span(sources), std::span(destinations), std::span(types), std::span(features),
+                     std::span(reinterpret_cast<uint8_t *>(expected.data()), sizeof(float) * expected.size()));
+    EXPECT_EQ(expected, std::vector<float>({6, 2, 1, 1.0f / 3, 0, 0, 2, 2.0f / 3}));
+
+    for (auto [encoding, tolerance] : std::vector<std::pair<snark::FeatureEncoding, float>>{
+             {snark::FEATURE_ENCODING_FLOAT16, 2.0f / 1024},
+             {snark::FEATURE_ENCODING_BFLOAT16, 2.0f / 128},
+             {snark::FEATURE_ENCODING_INT8, 6.0f / 127 / 2}})
+    {
+        std::vector<float> output(expected.size(), -2);
+        c.GetEdgeFeature(std::span(sources), std::span(destinations), std::span(types), std::span(features),
+                         std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()),
+                         encoding);
+        for (size_t index = 0; index < expected.size(); ++index)
+        {
+            EXPECT_NEAR(output[index], expected[index], tolerance);
+        }
+    }
+}
+
+TEST(DistributedTest, NodeFeaturesClientFeatureCache)
+{
+    auto mocks = MockServers(10, "NodeFeaturesClientFeatureCache");
+    const size_t shard_count = mocks.first.size();
+    snark::GRPCClient c(std::move(mocks.first), 1, 1, snark::ClientCallConfig{.m_feature_cache_size = 1 << 20});
+
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+    auto fetch = [&c, &features](std::vector<snark::NodeId> input_nodes) {
+        std::vector<float> output(fv_size * input_nodes.size(), -2);
+        c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                         std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+        return output;
+    };
+
+    EXPECT_EQ(fetch({0, 11, 1000, 22}), std::vector<float>({0, 1, 11, 12, 0, 0, 22, 23}));
+    auto stats = c.CallStats();
+    EXPECT_EQ(stats.m_feature_cache_hits, 0);
+    EXPECT_EQ(stats.m_feature_cache_misses, 4);
+    EXPECT_EQ(stats.m_requests, shard_count);
+
+    // Missing nodes are cached as well, only the new node is requested from servers.
+    EXPECT_EQ(fetch({22, 1000, 33, 0}), std::vector<float>({22, 23, 0, 0, 33, 34, 0, 1}));
+    stats = c.CallStats();
+    EXPECT_EQ(stats.m_feature_cache_hits, 3);
+    EXPECT_EQ(stats.m_feature_cache_misses, 5);
+    EXPECT_EQ(stats.m_requests, 2 * shard_count);
+
+    EXPECT_EQ(fetch({33, 11}), std::vector<float>({33, 34, 11, 12}));
+    EXPECT_EQ(c.CallStats().m_requests, 2 * shard_count);
+
+    // Other feature sets and encodings are cached separately.
+    std::vector<float> output(fv_size, -2);
+    std::vector<snark::NodeId> input_nodes = {11};
+    c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                     std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()),
+                     snark::FEATURE_ENCODING_FLOAT16);
+    EXPECT_EQ(output, std::vector<float>({11, 12}));
+    features[0].second = sizeof(float);
+    output.assign(1, -2);
+    c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                     std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+    EXPECT_EQ(output, std::vector<float>({11}));
+    EXPECT_EQ(c.CallStats().m_requests, 4 * shard_count);
+}
+
+TEST(DistributedTest, EdgeFeaturesClientFeatureCache)
+{
+    EdgeFeatureServers servers("EdgeFeaturesClientFeatureCache");
+    snark::GRPCClient c(servers.m_channels, 1, 1, snark::ClientCallConfig{.m_feature_cache_size = 1 << 20});
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(2 * sizeof(float))}};
+    auto fetch = [&c, &features](std::vector<snark::NodeId> sources, std::vector<snark::NodeId> destinations,
+                                 std::vector<snark::Type> types) {
+        std::vector<float> output(2 * sources.size(), -2);
+        c.GetEdgeFeature(std::span(sources), std::span(destinations), std::span(types), std::span(features),
+                         std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+        return output;
+    };
+
+    EXPECT_EQ(fetch({6, 1, 3}, {7, 2, 5}, {0, 0, 0}), std::vector<float>({6, 2, 1, 1.0f / 3, 0, 0}));
+    EXPECT_EQ(c.CallStats().m_requests, 2);
+
+    // Edges with the same endpoints and other types are different edges.
+    EXPECT_EQ(fetch({1, 6, 1}, {2, 7, 2}, {0, 0, 1}), std::vector<float>({1, 1.0f / 3, 6, 2, 0, 0}));
+    auto stats = c.CallStats();
+    EXPECT_EQ(stats.m_feature_cache_hits, 2);
+    EXPECT_EQ(stats.m_feature_cache_misses, 4);
+    EXPECT_EQ(stats.m_requests, 4);
+
+    EXPECT_EQ(fetch({3, 1}, {5, 2}, {0, 1}), std::vector<float>({0, 0, 0, 0}));
+    EXPECT_EQ(c.CallStats().m_requests, 4);
+}
+
 std::pair<std::shared_ptr<snark::GRPCServer>, std::shared_ptr<snark::GRPCClient>> CreateSingleServerEnvironment(
     std::string name)
 {
@@ -538,6 +1393,31 @@ TEST(DistributedTest, UniformSampleNeighborsSingleServer)
     EXPECT_EQ(output_nodes, std::vector<snark::NodeId>({3, 3, 3, 5, 5, 6}));
 }
 
+TEST(DistributedTest, NodeIdsArePaged)
+{
+    auto env = CreateSingleServerEnvironment("NodeIdsArePaged");
+    auto stub = snark::GraphEngine::NewStub(env.first->InProcessChannel());
+    snark::NodeIdsRequest request;
+    request.set_limit(30);
+    std::vector<snark::NodeId> node_ids;
+    size_t pages = 0;
+    do
+    {
+        grpc::ClientContext context;
+        snark::NodeIdsReply reply;
+        ASSERT_TRUE(stub->GetNodeIds(&context, request, &reply).ok());
+        EXPECT_LE(reply.node_ids_size(), 30);
+        node_ids.insert(std::end(node_ids), std::begin(reply.node_ids()), std::end(reply.node_ids()));
+        request.set_offset(reply.next_offset());
+        ++pages;
+    } while (request.offset() != 0);
+
+    EXPECT_EQ(pages, 4);
+    std::vector<snark::NodeId> expected(100);
+    std::iota(std::begin(expected), std::end(expected), snark::NodeId(0));
+    EXPECT_EQ(node_ids, expected);
+}
+
 TEST(DistributedTest, UniformSampleNeighborsWithoutReplacementSingleServer)
 {
     auto env = CreateSingleServerEnvironment("UniformSampleNeighborsSingleServer");
@@ -570,6 +1450,7 @@ std::pair<ServerList, std::shared_ptr<snark::GRPCClient>> CreateMultiServerEnvir
             m.m_nodes.push_back(TestGraph::Node{.m_id = snark::NodeId(curr_node),
                                                 .m_type = 0,
                                                 .m_weight = 1.0f,
+                                                .m_float_features = {std::move(vals)},
                                                 .m_neighbors = {TestGraph::NeighborRecord{curr_node + 1, 0, 1.0f},
                                                                 TestGraph::NeighborRecord{curr_node + 2, 0, 2.0f},
                                                                 TestGraph::NeighborRecord{curr_node + 3, 0, 1.0f},
@@ -606,54 +1487,267 @@ TEST(DistributedTest, SampleNeighborsMultipleServers)
     EXPECT_EQ(output_weights, std::vector<float>({2, 2, 2, 1, 1, 2}));
 }
 
-TEST(DistributedTest, SampleNeighborsMultipleServersMissingNeighbors)
+TEST(DistributedTest, SampleNeighborsMultipleServersMissingNeighbors)
+{
+    auto environment = CreateMultiServerEnvironment("SampleNeighborsMultipleServersMissingNeighbors");
+    auto &c = *environment.second;
+
+    std::vector<snark::NodeId> input_nodes = {0, 55, 77};
+    std::vector<snark::Type> input_types = {1};
+    const size_t nb_count = 2;
+    std::vector<snark::NodeId> output_nodes(nb_count * input_nodes.size());
+    std::vector<float> output_weights(nb_count * input_nodes.size());
+    std::vector<snark::Type> output_types(nb_count * input_nodes.size(), -1);
+    c.WeightedSampleNeighbor(23, std::span(input_nodes), std::span(input_types), nb_count, std::span(output_nodes),
+                             std::span(output_types), std::span(output_weights), -1, 0.0f, -1);
+    EXPECT_EQ(output_types, std::vector<snark::Type>(6, -1));
+    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>(6, -1));
+    EXPECT_EQ(output_weights, std::vector<float>(6, 0));
+}
+
+TEST(DistributedTest, UniformSampleNeighborsMultipleServers)
+{
+    auto environment = CreateMultiServerEnvironment("UniformSampleNeighborsMultipleServers");
+    auto &c = *environment.second;
+
+    std::vector<snark::NodeId> input_nodes = {0, 55, 77};
+    std::vector<snark::Type> input_types = {0};
+    const size_t nb_count = 2;
+    std::vector<snark::NodeId> output_nodes(nb_count * input_nodes.size());
+    std::vector<snark::Type> output_types(nb_count * input_nodes.size(), -1);
+    c.UniformSampleNeighbor(false, 23, std::span(input_nodes), std::span(input_types), nb_count,
+                            std::span(output_nodes), std::span(output_types), -1, -1);
+    EXPECT_EQ(output_types, std::vector<snark::Type>({0, 0, 0, 0, 0, 0}));
+    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>({2, 2, 57, 56, 80, 81}));
+}
+
+TEST(DistributedTest, UniformSampleNeighborsWithoutReplacementMultipleServers)
+{
+    auto environment = CreateMultiServerEnvironment("UniformSampleNeighborsWithoutReplacementMultipleServers");
+    auto &c = *environment.second;
+
+    std::vector<snark::NodeId> input_nodes = {0, 55, 77};
+    std::vector<snark::Type> input_types = {0};
+    const size_t nb_count = 2;
+    std::vector<snark::NodeId> output_nodes(nb_count * input_nodes.size());
+    std::vector<snark::Type> output_types(nb_count * input_nodes.size(), -1);
+    c.UniformSampleNeighbor(true, 23, std::span(input_nodes), std::span(input_types), nb_count, std::span(output_nodes),
+                            std::span(output_types), -1, -1);
+    EXPECT_EQ(output_types, std::vector<snark::Type>({0, 0, 0, 0, 0, 0}));
+    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>({2, 4, 59, 57, 81, 79}));
+}
+
+TEST(DistributedTest, SampleNeighborsMultipleServersUnorderedDuplicateNodes)
+{
+    auto environment = CreateMultiServerEnvironment("SampleNeighborsMultipleServersUnorderedDuplicateNodes");
+    auto &c = *environment.second;
+
+    std::vector<snark::NodeId> input_nodes = {77, 0, 77, 55, 0};
+    std::vector<snark::Type> input_types = {0};
+    const size_t nb_count = 3;
+    std::vector<snark::NodeId> weighted_nodes(nb_count * input_nodes.size());
+    std::vector<float> weighted_weights(nb_count * input_nodes.size());
+    std::vector<snark::Type> weighted_types(nb_count * input_nodes.size(), -1);
+    c.WeightedSampleNeighbor(23, std::span(input_nodes), std::span(input_types), nb_count, std::span(weighted_nodes),
+                             std::span(weighted_types), std::span(weighted_weights), -1, 0.0f, -1);
+    std::vector<snark::NodeId> uniform_nodes(nb_count * input_nodes.size());
+    std::vector<snark::Type> uniform_types(nb_count * input_nodes.size(), -1);
+    c.UniformSampleNeighbor(false, 23, std::span(input_nodes), std::span(input_types), nb_count,
+                            std::span(uniform_nodes), std::span(uniform_types), -1, -1);
+
+    EXPECT_EQ(weighted_types, std::vector<snark::Type>(nb_count * input_nodes.size(), 0));
+    EXPECT_EQ(uniform_types, std::vector<snark::Type>(nb_count * input_nodes.size(), 0));
+    for (size_t i = 0; i < weighted_nodes.size(); ++i)
+    {
+        const auto node = input_nodes[i / nb_count];
+        EXPECT_GT(weighted_nodes[i], node);
+        EXPECT_LE(weighted_nodes[i], node + 4);
+        EXPECT_EQ(weighted_weights[i], (weighted_nodes[i] - node) % 2 == 0 ? 2.0f : 1.0f);
+        EXPECT_GT(uniform_nodes[i], node);
+        EXPECT_LE(uniform_nodes[i], node + 4);
+    }
+}
+
+TEST(DistributedTest, SampleSubgraphMultipleServers)
+{
+    auto environment = CreateMultiServerEnvironment("SampleSubgraphMultipleServers");
+    auto &c = *environment.second;
+
+    // Every node n is connected to n + 1, ..., n + 4 and sampling without replacement returns all neighbors.
+    std::vector<snark::NodeId> seeds = {0, 55, 3};
+    std::vector<uint32_t> fanouts = {4, 4};
+    std::vector<snark::Type> types = {0};
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+    std::map<snark::NodeId, uint32_t> expected_hops = {{0, 0}, {3, 0}, {55, 0}};
+    for (uint32_t hop = 0; hop < fanouts.size(); ++hop)
+    {
+        for (const auto &[node, node_hop] : std::map<snark::NodeId, uint32_t>(expected_hops))
+        {
+            for (snark::NodeId neighbor = node + 1; node_hop == hop && neighbor <= node + 4; ++neighbor)
+            {
+                expected_hops.emplace(neighbor, hop + 1);
+            }
+        }
+    }
+
+    for (bool routed : {false, true})
+    {
+        SCOPED_TRACE(routed);
+        if (routed)
+        {
+            c.LoadNodeRoutes();
+        }
+
+        snark::Subgraph subgraph;
+        c.SampleSubgraph(true, 23, std::span(seeds), std::span(fanouts), std::span(types), std::span(features),
+                         subgraph);
+        EXPECT_EQ(std::vector<snark::NodeId>(std::begin(subgraph.m_nodes), std::begin(subgraph.m_nodes) + 3), seeds);
+
+        std::map<snark::NodeId, uint32_t> hops;
+        for (size_t i = 0; i < subgraph.m_nodes.size(); ++i)
+        {
+            hops[subgraph.m_nodes[i]] = subgraph.m_hops[i];
+        }
+        EXPECT_EQ(hops, expected_hops);
+        EXPECT_EQ(subgraph.m_nodes.size(), expected_hops.size());
+
+        std::set<std::pair<snark::NodeId, snark::NodeId>> edges;
+        for (size_t i = 0; i < subgraph.m_edge_src.size(); ++i)
+        {
+            const auto src = subgraph.m_nodes[subgraph.m_edge_src[i]];
+            const auto dst = subgraph.m_nodes[subgraph.m_edge_dst[i]];
+            EXPECT_EQ(subgraph.m_edge_types[i], 0);
+            EXPECT_LT(expected_hops[src], fanouts.size());
+            EXPECT_TRUE(dst > src && dst <= src + 4);
+            edges.emplace(src, dst);
+        }
+        EXPECT_EQ(subgraph.m_edge_src.size(), 52);
+        EXPECT_EQ(edges.size(), 52);
+
+        std::span values(reinterpret_cast<const float *>(subgraph.m_features.data()),
+                         subgraph.m_features.size() / sizeof(float));
+        ASSERT_EQ(values.size(), fv_size * subgraph.m_nodes.size());
+        for (size_t i = 0; i < subgraph.m_nodes.size(); ++i)
+        {
+            EXPECT_EQ(values[fv_size * i], float(subgraph.m_nodes[i]));
+            EXPECT_EQ(values[fv_size * i + 1], float(subgraph.m_nodes[i] + 1));
+        }
+    }
+}
+
+TEST(DistributedTest, RandomWalkMultipleServers)
 {
-    auto environment = CreateMultiServerEnvironment("SampleNeighborsMultipleServersMissingNeighbors");
+    auto environment = CreateMultiServerEnvironment("RandomWalkMultipleServers");
     auto &c = *environment.second;
 
-    std::vector<snark::NodeId> input_nodes = {0, 55, 77};
-    std::vector<snark::Type> input_types = {1};
-    const size_t nb_count = 2;
-    std::vector<snark::NodeId> output_nodes(nb_count * input_nodes.size());
-    std::vector<float> output_weights(nb_count * input_nodes.size());
-    std::vector<snark::Type> output_types(nb_count * input_nodes.size(), -1);
-    c.WeightedSampleNeighbor(23, std::span(input_nodes), std::span(input_types), nb_count, std::span(output_nodes),
-                             std::span(output_types), std::span(output_weights), -1, 0.0f, -1);
-    EXPECT_EQ(output_types, std::vector<snark::Type>(6, -1));
-    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>(6, -1));
-    EXPECT_EQ(output_weights, std::vector<float>(6, 0));
+    // Local graph with the same nodes in a single partition makes the same walks.
+    TestGraph::MemoryGraph m;
+    for (snark::NodeId node = 0; node < snark::NodeId(num_nodes); ++node)
+    {
+        m.m_nodes.push_back(TestGraph::Node{.m_id = node,
+                                            .m_type = 0,
+                                            .m_weight = 1.0f,
+                                            .m_neighbors = {TestGraph::NeighborRecord{node + 1, 0, 1.0f},
+                                                            TestGraph::NeighborRecord{node + 2, 0, 2.0f},
+                                                            TestGraph::NeighborRecord{node + 3, 0, 1.0f},
+                                                            TestGraph::NeighborRecord{node + 4, 0, 2.0f}}});
+    }
+    TempFolder path("RandomWalkMultipleServersLocal");
+    TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "");
+
+    std::vector<snark::NodeId> nodes = {0, 55, 93, 8, 150};
+    std::vector<snark::Type> types = {0};
+    const size_t walk_length = 6;
+    for (bool routed : {false, true})
+    {
+        SCOPED_TRACE(routed);
+        if (routed)
+        {
+            c.LoadNodeRoutes();
+        }
+
+        // Walks with q = 1 move to other shards without neighbors of previous nodes.
+        for (auto [p, q] : {std::pair{2.0f, 0.5f}, std::pair{1.0f, 1.0f}, std::pair{0.25f, 4.0f}})
+        {
+            std::vector<snark::NodeId> expected(nodes.size() * (walk_length + 1));
+            g.RandomWalk(31, p, q, -1, std::span(nodes), std::span(types), walk_length, std::span(expected));
+            std::vector<snark::NodeId> walks(expected.size());
+            c.RandomWalk(31, p, q, -1, std::span(nodes), std::span(types), walk_length, std::span(walks));
+            EXPECT_EQ(walks, expected);
+            EXPECT_EQ(walks[walk_length + 1], 55);
+            EXPECT_EQ(walks[4 * (walk_length + 1) + 1], -1);
+        }
+    }
 }
 
-TEST(DistributedTest, UniformSampleNeighborsMultipleServers)
+TEST(DistributedTest, NegativeSampleMultipleServers)
 {
-    auto environment = CreateMultiServerEnvironment("UniformSampleNeighborsMultipleServers");
+    auto environment = CreateMultiServerEnvironment("NegativeSampleMultipleServers");
     auto &c = *environment.second;
 
-    std::vector<snark::NodeId> input_nodes = {0, 55, 77};
-    std::vector<snark::Type> input_types = {0};
-    const size_t nb_count = 2;
-    std::vector<snark::NodeId> output_nodes(nb_count * input_nodes.size());
-    std::vector<snark::Type> output_types(nb_count * input_nodes.size(), -1);
-    c.UniformSampleNeighbor(false, 23, std::span(input_nodes), std::span(input_types), nb_count,
-                            std::span(output_nodes), std::span(output_types), -1, -1);
-    EXPECT_EQ(output_types, std::vector<snark::Type>({0, 0, 0, 0, 0, 0}));
-    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>({2, 2, 57, 56, 80, 81}));
+    std::vector<snark::NodeId> nodes = {0, 55, 93, 8, 150, 55};
+    std::vector<snark::Type> types = {0};
+    const size_t count = 8;
+    for (bool routed : {false, true})
+    {
+        SCOPED_TRACE(routed);
+        if (routed)
+        {
+            c.LoadNodeRoutes();
+        }
+
+        std::vector<snark::NodeId> negatives(nodes.size() * count);
+        c.NegativeSample(19, -1, std::span(nodes), std::span(types), count, std::span(negatives));
+        std::set<snark::NodeId> seen;
+        for (size_t index = 0; index < negatives.size(); ++index)
+        {
+            const auto delta = negatives[index] - nodes[index / count];
+            EXPECT_TRUE(delta < 0 || delta > 4);
+            EXPECT_GE(negatives[index], 0);
+            EXPECT_LT(negatives[index], snark::NodeId(num_nodes));
+            seen.emplace(negatives[index]);
+        }
+
+        // Draws are spread over all servers.
+        EXPECT_GT(seen.size(), negatives.size() / 2);
+
+        std::vector<snark::NodeId> same_seed_negatives(negatives.size());
+        c.NegativeSample(19, -1, std::span(nodes), std::span(types), count, std::span(same_seed_negatives));
+        EXPECT_EQ(negatives, same_seed_negatives);
+    }
 }
 
-TEST(DistributedTest, UniformSampleNeighborsWithoutReplacementMultipleServers)
+TEST(DistributedTest, NegativeSampleChecksSourceShards)
 {
-    auto environment = CreateMultiServerEnvironment("UniformSampleNeighborsWithoutReplacementMultipleServers");
-    auto &c = *environment.second;
+    // Edges of node 0 are split between servers and every other node of the graph is its neighbor.
+    ServerList servers;
+    std::vector<std::shared_ptr<grpc::Channel>> channels;
+    for (snark::NodeId server = 0; server < 2; ++server)
+    {
+        TestGraph::MemoryGraph m;
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_neighbors = {TestGraph::NeighborRecord{server + 1, 0, 1.0f}}});
+        m.m_nodes.push_back(TestGraph::Node{.m_id = server + 1, .m_type = 0, .m_weight = 1.0f});
+        TempFolder path("NegativeSampleChecksSourceShards");
+        TestGraph::convert(path.path, "0_0", std::move(m), 1);
+        servers.emplace_back(std::make_shared<snark::GRPCServer>(
+            std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                            snark::PartitionStorageType::memory, ""),
+            std::shared_ptr<snark::GraphSamplerServiceImpl>{}, "localhost:0", "", "", ""));
+        channels.emplace_back(servers.back()->InProcessChannel());
+    }
 
-    std::vector<snark::NodeId> input_nodes = {0, 55, 77};
-    std::vector<snark::Type> input_types = {0};
-    const size_t nb_count = 2;
-    std::vector<snark::NodeId> output_nodes(nb_count * input_nodes.size());
-    std::vector<snark::Type> output_types(nb_count * input_nodes.size(), -1);
-    c.UniformSampleNeighbor(true, 23, std::span(input_nodes), std::span(input_types), nb_count, std::span(output_nodes),
-                            std::span(output_types), -1, -1);
-    EXPECT_EQ(output_types, std::vector<snark::Type>({0, 0, 0, 0, 0, 0}));
-    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>({2, 4, 59, 57, 81, 79}));
+    snark::GRPCClient c(std::move(channels), 1, 1);
+    std::vector<snark::NodeId> nodes = {0, 1};
+    std::vector<snark::Type> types = {0};
+    std::vector<snark::NodeId> negatives(nodes.size() * 4);
+    c.NegativeSample(5, -1, std::span(nodes), std::span(types), 4, std::span(negatives));
+    for (size_t index = 0; index < 4; ++index)
+    {
+        EXPECT_EQ(negatives[index], -1);
+        EXPECT_TRUE(negatives[4 + index] == 0 || negatives[4 + index] == 2);
+    }
 }
 
 TEST(DistributedTest, NeighborCountMultipleServers)
@@ -741,6 +1835,151 @@ TEST(DistributedTest, NeighborCountMismatchingOutputSize)
     EXPECT_EQ(output_counts, std::vector<uint64_t>({3, 0, 0, 0, 0, 0}));
 }
 
+TEST(DistributedTest, ReloadServerWithDeltaPartition)
+{
+    TestGraph::MemoryGraph m;
+    for (snark::NodeId n = 0; n < 10; ++n)
+    {
+        m.m_nodes.push_back(TestGraph::Node{.m_id = n, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{n + 1, 0, 1.0f}}});
+    }
+
+    TempFolder path("ReloadServerWithDeltaPartition");
+    TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    snark::GRPCServer server(std::make_shared<snark::GraphEngineServiceImpl>(path.string(), std::vector<uint32_t>{0},
+                                                                             snark::PartitionStorageType::memory, ""),
+                             std::make_shared<snark::GraphSamplerServiceImpl>(path.string(), std::set<size_t>{0}),
+                             "localhost:0", "", "", "");
+    snark::GRPCClient c({server.InProcessChannel()}, 1, 1);
+
+    std::vector<snark::NodeId> input_nodes = {0, 1, 42};
+    std::vector<snark::Type> input_types = {0};
+    std::vector<uint64_t> output_counts(input_nodes.size());
+    std::vector<snark::Type> output_types(input_nodes.size());
+    c.NeighborCount(std::span(input_nodes), std::span(input_types), std::span(output_counts));
+    c.GetNodeType(std::span(input_nodes), std::span(output_types), -1);
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({1, 1, 0}));
+    EXPECT_EQ(output_types, std::vector<snark::Type>({0, 0, -1}));
+
+    // Delta adds an edge to an existing node and a new node.
+    TestGraph::MemoryGraph delta;
+    delta.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{5, 0, 1.0f}}});
+    delta.m_nodes.push_back(TestGraph::Node{.m_id = 42, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{0, 0, 1.0f}}});
+    TestGraph::convert(path.path, "0_1", std::move(delta), 1);
+    EXPECT_EQ(server.Reload(), 1);
+
+    c.NeighborCount(std::span(input_nodes), std::span(input_types), std::span(output_counts));
+    c.GetNodeType(std::span(input_nodes), std::span(output_types), -1);
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({2, 1, 1}));
+    EXPECT_EQ(output_types, std::vector<snark::Type>({0, 0, 0}));
+    EXPECT_EQ(server.Reload(), 2);
+}
+
+TEST(DistributedTest, ReloadSharesUnchangedPartitions)
+{
+    TestGraph::MemoryGraph m;
+    for (snark::NodeId n = 0; n < 10; ++n)
+    {
+        m.m_nodes.push_back(TestGraph::Node{.m_id = n, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{n + 1, 0, 1.0f}}});
+    }
+
+    TempFolder path("ReloadSharesUnchangedPartitions");
+    TestGraph::convert(path.path, "0_0", std::move(m), 1);
+    const auto load = [&path](const snark::GraphEngineSnapshot *previous) {
+        return std::make_unique<snark::GraphEngineSnapshot>(path.string(), std::vector<uint32_t>{0},
+                                                            snark::PartitionStorageType::memory, "",
+                                                            snark::FeatureCacheConfig{}, false, false, 0,
+                                                            std::vector<snark::FeatureId>{}, false, 0,
+                                                            HDFSReadOptions{}, previous);
+    };
+    const auto neighbor_counts = [](const snark::GraphEngineSnapshot &snapshot) {
+        snark::GetNeighborsRequest request;
+        request.add_node_ids(0);
+        request.add_node_ids(42);
+        request.add_edge_types(0);
+        snark::GetNeighborCountsReply reply;
+        EXPECT_TRUE(snapshot.GetNeighborCounts(nullptr, &request, &reply).ok());
+        return std::vector<uint64_t>(std::begin(reply.neighbor_counts()), std::end(reply.neighbor_counts()));
+    };
+    auto base = load(nullptr);
+    EXPECT_EQ(base->ReusedPartitions(), 0);
+
+    TestGraph::MemoryGraph delta;
+    delta.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{5, 0, 1.0f}}});
+    delta.m_nodes.push_back(TestGraph::Node{.m_id = 42, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{0, 0, 1.0f}}});
+    TestGraph::convert(path.path, "0_1", std::move(delta), 1);
+    auto with_delta = load(base.get());
+    EXPECT_EQ(with_delta->ReusedPartitions(), 1);
+    EXPECT_EQ(neighbor_counts(*with_delta), std::vector<uint64_t>({2, 1}));
+
+    // Rewriting the delta without the edge of node 0 removes it, the base partition is still shared.
+    TestGraph::MemoryGraph rewritten;
+    rewritten.m_nodes.push_back(
+        TestGraph::Node{.m_id = 42, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{0, 0, 1.0f}, {1, 0, 1.0f}}});
+    TestGraph::convert(path.path, "0_1", std::move(rewritten), 1);
+    base.reset();
+    auto replaced = load(with_delta.get());
+    EXPECT_EQ(replaced->ReusedPartitions(), 1);
+    EXPECT_EQ(neighbor_counts(*replaced), std::vector<uint64_t>({1, 2}));
+    EXPECT_EQ(neighbor_counts(*with_delta), std::vector<uint64_t>({2, 1}));
+}
+
+TEST(DistributedTest, RefreshRoutesAfterReload)
+{
+    TempFolder path("RefreshRoutesAfterReload");
+    std::vector<std::unique_ptr<snark::GRPCServer>> servers;
+    std::vector<std::shared_ptr<grpc::Channel>> channels;
+    for (size_t shard = 0; shard < 2; ++shard)
+    {
+        TestGraph::MemoryGraph m;
+        for (snark::NodeId n = 5 * shard; n < snark::NodeId(5 * shard + 5); ++n)
+        {
+            m.m_nodes.push_back(
+                TestGraph::Node{.m_id = n, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{n + 1, 0, 1.0f}}});
+        }
+
+        const auto shard_path = path.path / std::to_string(shard);
+        std::filesystem::create_directories(shard_path);
+        TestGraph::convert(shard_path, "0_0", std::move(m), 1);
+        servers.emplace_back(std::make_unique<snark::GRPCServer>(
+            std::make_shared<snark::GraphEngineServiceImpl>(shard_path.string(), std::vector<uint32_t>{0},
+                                                            snark::PartitionStorageType::memory, ""),
+            nullptr, "localhost:0", "", "", ""));
+        channels.emplace_back(servers.back()->InProcessChannel());
+    }
+
+    snark::GRPCClient c(std::move(channels), 1, 1);
+    c.LoadNodeRoutes();
+    std::vector<snark::NodeId> input_nodes = {0};
+    std::vector<snark::Type> input_types = {0};
+    std::vector<uint64_t> output_counts(input_nodes.size());
+    c.NeighborCount(std::span(input_nodes), std::span(input_types), std::span(output_counts));
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({1}));
+
+    // A delta on the second shard adds a record of node 0, routes still send it only to the first shard.
+    TestGraph::MemoryGraph delta;
+    delta.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{7, 0, 1.0f}}});
+    TestGraph::convert(path.path / "1", "0_1", std::move(delta), 1);
+    servers[1]->Reload();
+    c.NeighborCount(std::span(input_nodes), std::span(input_types), std::span(output_counts));
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({1}));
+
+    c.Refresh();
+    c.NeighborCount(std::span(input_nodes), std::span(input_types), std::span(output_counts));
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({2}));
+
+    // Any reply of a reloaded server makes the client drop routes without a refresh.
+    TestGraph::MemoryGraph second_delta;
+    second_delta.m_nodes.push_back(
+        TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_neighbors{{9, 0, 1.0f}}});
+    TestGraph::convert(path.path / "1", "0_2", std::move(second_delta), 1);
+    servers[1]->Reload();
+    std::vector<snark::NodeId> second_shard_nodes = {7};
+    c.NeighborCount(std::span(second_shard_nodes), std::span(input_types), std::span(output_counts));
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({1}));
+    c.NeighborCount(std::span(input_nodes), std::span(input_types), std::span(output_counts));
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({3}));
+}
+
 TEST(DistributedTest, NeighborCountEmptyGraph)
 {
     const size_t num_servers = 2;
@@ -1002,6 +2241,141 @@ TEST(DistributedTest, NodeSparseFeaturesMultipleTypesNeighborsSpreadAcrossPartit
     EXPECT_EQ(std::vector<int64_t>({3}), dimensions);
 }
 
+TEST(DistributedTest, NodeRoutesMergeShardIds)
+{
+    // Shard pages may arrive unsorted with repeated ids after a reload.
+    snark::NodeRoutes routes({{9, 1, 5, 1}, {5, 7}, {}, {-3}});
+    EXPECT_FALSE(routes.Empty());
+    EXPECT_EQ(routes.Find(-3), 3);
+    EXPECT_EQ(routes.Find(1), 0);
+    EXPECT_EQ(routes.Find(5), snark::NodeRoutes::all_shards);
+    EXPECT_EQ(routes.Find(7), 1);
+    EXPECT_EQ(routes.Find(9), 0);
+    EXPECT_EQ(routes.Find(2), snark::NodeRoutes::all_shards);
+    EXPECT_EQ(routes.Find(10), snark::NodeRoutes::all_shards);
+    EXPECT_TRUE(snark::NodeRoutes({{}, {}}).Empty());
+}
+
+TEST(DistributedTest, NodeFeaturesMultipleServersRouted)
+{
+    auto mocks = MockServers(10, "NodeFeaturesMultipleServersRouted", 3);
+    snark::GRPCClient c(std::move(mocks.first), 1, 1);
+    c.LoadNodeRoutes();
+
+    std::vector<snark::NodeId> input_nodes = {22, 0, 123, 11};
+    std::vector<float> output(fv_size * input_nodes.size(), -2);
+    std::vector<snark::FeatureMeta> features = {{snark::FeatureId(0), snark::FeatureSize(sizeof(float) * fv_size)}};
+    c.GetNodeFeature(std::span(input_nodes), std::span(features),
+                     std::span(reinterpret_cast<uint8_t *>(output.data()), sizeof(float) * output.size()));
+    EXPECT_EQ(output, std::vector<float>({22, 23, 0, 1, 0, 0, 11, 12}));
+
+    std::vector<snark::Type> types(input_nodes.size(), -2);
+    c.GetNodeType(std::span(input_nodes), std::span(types), -1);
+    EXPECT_EQ(types, std::vector<snark::Type>({1, 0, -1, 2}));
+}
+
+TEST(DistributedTest, NeighborsMultipleServersRouted)
+{
+    auto environment = CreateMultiServerEnvironment("NeighborsMultipleServersRouted");
+    auto &c = *environment.second;
+    c.LoadNodeRoutes();
+
+    std::vector<snark::NodeId> input_nodes = {55, 100, 0};
+    std::vector<snark::Type> input_types = {0};
+    std::vector<uint64_t> output_counts(input_nodes.size());
+    c.NeighborCount(std::span(input_nodes), std::span(input_types), std::span(output_counts));
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({4, 0, 4}));
+
+    std::vector<snark::NodeId> output_nodes;
+    std::vector<snark::Type> output_types;
+    std::vector<float> output_weights;
+    std::fill(std::begin(output_counts), std::end(output_counts), 0);
+    c.FullNeighbor(std::span(input_nodes), std::span(input_types), output_nodes, output_types, output_weights,
+                   std::span(output_counts));
+    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>({56, 57, 58, 59, 1, 2, 3, 4}));
+    EXPECT_EQ(output_weights, std::vector<float>({1, 2, 1, 2, 1, 2, 1, 2}));
+    EXPECT_EQ(output_counts, std::vector<uint64_t>({4, 0, 4}));
+}
+
+TEST(DistributedTest, SampleNeighborsMultipleServersRouted)
+{
+    auto environment = CreateMultiServerEnvironment("SampleNeighborsMultipleServersRouted");
+    auto &c = *environment.second;
+    c.LoadNodeRoutes();
+
+    std::vector<snark::NodeId> input_nodes = {0, 55, 77};
+    std::vector<snark::Type> input_types = {0};
+    const size_t nb_count = 2;
+    std::vector<snark::NodeId> output_nodes(nb_count * input_nodes.size());
+    std::vector<float> output_weights(nb_count * input_nodes.size());
+    std::vector<snark::Type> output_types(nb_count * input_nodes.size(), -1);
+    c.WeightedSampleNeighbor(23, std::span(input_nodes), std::span(input_types), nb_count, std::span(output_nodes),
+                             std::span(output_types), std::span(output_weights), -1, 0.0f, -1);
+    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>({2, 2, 57, 56, 80, 81}));
+    EXPECT_EQ(output_weights, std::vector<float>({2, 2, 2, 1, 1, 2}));
+
+    std::fill(std::begin(output_types), std::end(output_types), -1);
+    c.UniformSampleNeighbor(false, 23, std::span(input_nodes), std::span(input_types), nb_count,
+                            std::span(output_nodes), std::span(output_types), -1, -1);
+    EXPECT_EQ(output_types, std::vector<snark::Type>(6, 0));
+    EXPECT_EQ(output_nodes, std::vector<snark::NodeId>({2, 2, 57, 56, 80, 81}));
+}
+
+TEST(DistributedTest, NodeStringFeaturesNeighborsSpreadAcrossPartitionsRouted)
+{
+    std::vector<std::vector<float>> f0 = {std::vector<float>{1.0f, 2.0f, 3.0f}};
+    std::vector<std::vector<float>> f1 = {std::vector<float>{4.0f, 5.0f, 6.0f}};
+    std::vector<std::vector<float>> f2 = {std::vector<float>{7.0f, 8.0f, 9.0f}};
+
+    auto environment = CreateMultiServerSplitFeaturesEnvironment(
+        "NodeStringFeaturesNeighborsSpreadAcrossPartitionsRouted", f0, f1, f2);
+    auto &c = *environment.second;
+    c.LoadNodeRoutes();
+
+    // 0 is stored only in the first server, 1 and 2 in both servers, 3 is non existant.
+    std::vector<snark::NodeId> nodes = {3, 2, 1, 0};
+    std::vector<uint8_t> output;
+    std::vector<int64_t> dimensions(4);
+    std::vector<snark::FeatureId> features = {0};
+    c.GetNodeStringFeature(std::span(nodes), std::span(features), std::span(dimensions), output);
+    std::span res(reinterpret_cast<float *>(output.data()), output.size() / sizeof(float));
+    EXPECT_EQ(std::vector<float>(std::begin(res), std::end(res)), std::vector<float>({7, 8, 9, 4, 5, 6, 1, 2, 3}));
+    EXPECT_EQ(dimensions, std::vector<int64_t>({0, 12, 12, 12}));
+}
+
+TEST(DistributedTest, NodeSparseFeaturesNeighborsSpreadAcrossPartitionsRouted)
+{
+    // indices - 1, 14, 20, data - 1
+    std::vector<int32_t> f0_data = {3, 3, 1, 0, 14, 0, 20, 0, 1};
+    // indices - 1, 13, 42, data - 1
+    std::vector<int32_t> f1_data = {3, 3, 1, 0, 13, 0, 42, 0, 1};
+    // indices - [3, 8, 9], [4, 3, 2] data - [5, 42]
+    std::vector<int32_t> f2_data = {6, 3, 3, 0, 8, 0, 9, 0, 4, 0, 3, 0, 2, 0, 5, 42};
+    auto start = reinterpret_cast<float *>(f0_data.data());
+    std::vector<std::vector<float>> f0 = {std::vector<float>(start, start + f0_data.size())};
+    start = reinterpret_cast<float *>(f1_data.data());
+    std::vector<std::vector<float>> f1 = {std::vector<float>(start, start + f1_data.size())};
+    start = reinterpret_cast<float *>(f2_data.data());
+    std::vector<std::vector<float>> f2 = {std::vector<float>(start, start + f2_data.size())};
+
+    auto environment = CreateMultiServerSplitFeaturesEnvironment(
+        "NodeSparseFeaturesNeighborsSpreadAcrossPartitionsRouted", f0, f1, f2);
+    auto &c = *environment.second;
+    c.LoadNodeRoutes();
+
+    std::vector<snark::NodeId> nodes = {3, 2, 0};
+    std::vector<snark::FeatureId> features = {0};
+    std::vector<std::vector<uint8_t>> data(features.size());
+    std::vector<std::vector<int64_t>> indices(features.size());
+    std::vector<int64_t> dimensions = {-1};
+
+    c.GetNodeSparseFeature(std::span(nodes), std::span(features), std::span(dimensions), indices, data);
+    EXPECT_EQ(std::vector<int64_t>({1, 3, 8, 9, 1, 4, 3, 2, 2, 1, 14, 20}), indices.front());
+    auto tmp = reinterpret_cast<int32_t *>(data.front().data());
+    EXPECT_EQ(std::vector<int32_t>({5, 42, 1}), std::vector<int32_t>(tmp, tmp + 3));
+    EXPECT_EQ(std::vector<int64_t>({3}), dimensions);
+}
+
 namespace
 {
 
@@ -1096,6 +2470,43 @@ TEST(DistributedTest, TestNodeSamplerSimple)
     EXPECT_EQ(output_types, std::vector<snark::Type>({0, 0, 0, 0, 0, 0, 0}));
 }
 
+TEST(DistributedTest, TestNodeSamplerReplicatedShards)
+{
+    SamplerData s(2, 4, 0, "DistributedTestNodeSamplerReplicatedShards");
+    std::vector<std::vector<std::shared_ptr<grpc::Channel>>> shards;
+    for (size_t shard = 0; shard < s.dir_holders.size(); ++shard)
+    {
+        s.servers.emplace_back(std::make_unique<snark::GRPCServer>(
+            std::shared_ptr<snark::GraphEngineServiceImpl>{},
+            std::make_shared<snark::GraphSamplerServiceImpl>(s.dir_holders[shard].string(), std::set<size_t>{0}),
+            "localhost:0", "", "", ""));
+
+        // Replica without a server to verify samplers are created on available replicas.
+        shards.push_back({grpc::CreateChannel("localhost:1", grpc::InsecureChannelCredentials()),
+                          s.servers[shard]->InProcessChannel(), s.servers.back()->InProcessChannel()});
+    }
+    snark::GRPCClient replicated(std::move(shards), 1, 1);
+
+    std::vector<snark::Type> input_type = {0};
+    auto sampler_id = s.client->CreateSampler(
+        false, snark::CreateSamplerRequest_Category::CreateSamplerRequest_Category_WEIGHTED, std::span(input_type));
+    auto replicated_sampler_id = replicated.CreateSampler(
+        false, snark::CreateSamplerRequest_Category::CreateSamplerRequest_Category_WEIGHTED, std::span(input_type));
+    for (int64_t seed = 0; seed < 10; ++seed)
+    {
+        std::vector<snark::NodeId> expected_nodes(7);
+        std::vector<snark::Type> expected_types(7, -1);
+        s.client->SampleNodes(seed, sampler_id, std::span(expected_nodes), std::span(expected_types));
+
+        std::vector<snark::NodeId> output_nodes(7);
+        std::vector<snark::Type> output_types(7, -1);
+        replicated.SampleNodes(seed, replicated_sampler_id, std::span(output_nodes), std::span(output_types));
+        EXPECT_EQ(output_nodes, expected_nodes);
+        EXPECT_EQ(output_types, expected_types);
+    }
+    EXPECT_EQ(replicated.CallStats().m_failed, 0);
+}
+
 TEST(DistributedTest, TestNodeSamplerStatisticalProperties)
 {
     const size_t num_servers = 3;
@@ -1184,6 +2595,70 @@ TEST(DistributedTest, TestEdgeSamplerStatisticalProperties)
     EXPECT_EQ(counts, std::vector<size_t>({195, 583, 810, 832, 809, 835, 862, 847, 849, 828, 847, 879, 628, 196}));
 }
 
+TEST(DistributedTest, TestNodeSampleStreamMatchesSampleNodes)
+{
+    SamplerData s(3, 8, 0, "DistributedTestNodeSampleStreamMatchesSampleNodes");
+    std::vector<snark::Type> input_type = {0};
+    auto sampler_id = s.client->CreateSampler(
+        false, snark::CreateSamplerRequest_Category::CreateSamplerRequest_Category_WEIGHTED, std::span(input_type));
+
+    const size_t batch_size = 5;
+    const size_t batches = 20;
+    auto stream_id = s.client->CreateSampleStream(7, sampler_id, false, batch_size, 2, batches);
+    std::vector<snark::NodeId> stream_nodes(batch_size), expected_nodes(batch_size);
+    std::vector<snark::Type> stream_types(batch_size, -1), expected_types(batch_size, -1);
+    for (size_t batch = 0; batch < batches; ++batch)
+    {
+        s.client->NextSampledNodes(stream_id, std::span(stream_nodes), std::span(stream_types));
+        s.client->SampleNodes(7 + batch, sampler_id, std::span(expected_nodes), std::span(expected_types));
+        EXPECT_EQ(stream_nodes, expected_nodes);
+        EXPECT_EQ(stream_types, expected_types);
+    }
+
+    EXPECT_THROW(s.client->NextSampledNodes(stream_id, std::span(stream_nodes), std::span(stream_types)),
+                 std::runtime_error);
+    s.client->CloseSampleStream(stream_id);
+    EXPECT_THROW(s.client->NextSampledNodes(stream_id, std::span(stream_nodes), std::span(stream_types)),
+                 std::invalid_argument);
+    EXPECT_THROW(s.client->NextSampledNodes(stream_id + 100, std::span(stream_nodes), std::span(stream_types)),
+                 std::invalid_argument);
+    EXPECT_THROW(s.client->CloseSampleStream(stream_id + 100), std::invalid_argument);
+
+    // Ids of closed streams are reused.
+    EXPECT_EQ(stream_id, s.client->CreateSampleStream(7, sampler_id, false, batch_size, 2, batches));
+    s.client->CloseSampleStream(stream_id);
+}
+
+TEST(DistributedTest, TestEdgeSampleStreamMatchesSampleEdges)
+{
+    SamplerData s(3, 0, 4, "DistributedTestEdgeSampleStreamMatchesSampleEdges");
+    std::vector<snark::Type> input_type = {0};
+    auto sampler_id = s.client->CreateSampler(
+        true, snark::CreateSamplerRequest_Category::CreateSamplerRequest_Category_WEIGHTED, std::span(input_type));
+
+    // Stream without a limit is cancelled by the client while servers are ahead of it.
+    const size_t batch_size = 4;
+    auto stream_id = s.client->CreateSampleStream(13, sampler_id, true, batch_size, 3);
+    std::vector<snark::NodeId> stream_src(batch_size), stream_dst(batch_size);
+    std::vector<snark::NodeId> expected_src(batch_size), expected_dst(batch_size);
+    std::vector<snark::Type> stream_types(batch_size, -1), expected_types(batch_size, -1);
+    for (size_t batch = 0; batch < 10; ++batch)
+    {
+        s.client->NextSampledEdges(stream_id, std::span(stream_src), std::span(stream_types), std::span(stream_dst));
+        s.client->SampleEdges(13 + batch, sampler_id, std::span(expected_src), std::span(expected_types),
+                              std::span(expected_dst));
+        EXPECT_EQ(stream_src, expected_src);
+        EXPECT_EQ(stream_dst, expected_dst);
+        EXPECT_EQ(stream_types, expected_types);
+    }
+
+    std::vector<snark::NodeId> short_output(batch_size - 1);
+    EXPECT_THROW(
+        s.client->NextSampledEdges(stream_id, std::span(short_output), std::span(stream_types), std::span(stream_dst)),
+        std::invalid_argument);
+    s.client->CloseSampleStream(stream_id);
+}
+
 TEST(DistributedTest, TestFetchNodeFeaturesFromOnlySamplerServer)
 {
     const size_t fv_size = 2;
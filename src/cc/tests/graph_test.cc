@@ -1,21 +1,38 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
+#include "src/cc/lib/graph/compressed_adjacency.h"
 #include "src/cc/lib/graph/graph.h"
+#include "src/cc/lib/graph/locator.h"
+#include "src/cc/lib/graph/node_index.h"
+#include "src/cc/lib/graph/numa.h"
+#include "src/cc/lib/graph/parallel.h"
 #include "src/cc/lib/graph/partition.h"
+#include "src/cc/lib/graph/reorder.h"
 #include "src/cc/lib/graph/sampler.h"
+#include "src/cc/lib/graph/uniform.h"
 #include "src/cc/lib/graph/xoroshiro.h"
 #include "src/cc/tests/mocks.h"
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <numeric>
+#include <set>
 #include <span>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #include "boost/random/uniform_int_distribution.hpp"
+#include "boost/random/uniform_real_distribution.hpp"
 #include "gtest/gtest.h"
 
 using WeightedNodePartitionList = std::vector<snark::WeightedNodeSamplerPartition>;
@@ -334,6 +351,79 @@ TEST(GraphTest, WeightSampleStatisticalProperties)
     EXPECT_EQ(*max_1, 714);
 }
 
+TEST(GraphTest, SamplerFactoriesLoadAliasTablesInChunks)
+{
+    TestGraph::MemoryGraph m;
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 10, .m_type = 1, .m_weight = 1.0f});
+    auto path = std::filesystem::temp_directory_path() / "sampler_alias_chunks";
+    std::filesystem::create_directories(path);
+    TestGraph::convert(path, "0_0", std::move(m), 2);
+
+    // Write records in the packed converter layout, type 1 spans several read chunks.
+    auto write_alias = [&path](snark::Type type, const std::vector<snark::WeightedNodeSamplerRecord> &records) {
+        std::ofstream alias(path / ("node_" + std::to_string(type) + "_0.alias"),
+                            std::ios_base::binary | std::ios_base::out);
+        for (const auto &record : records)
+        {
+            alias.write(reinterpret_cast<const char *>(&record.m_left), sizeof(snark::NodeId));
+            alias.write(reinterpret_cast<const char *>(&record.m_right), sizeof(snark::NodeId));
+            alias.write(reinterpret_cast<const char *>(&record.m_threshold), sizeof(float));
+        }
+    };
+    write_alias(0, {{0, 1, 0.5f}, {2, 3, 1.0f}});
+    const snark::NodeId type_1_count = 200000;
+    std::vector<snark::WeightedNodeSamplerRecord> type_1_records;
+    for (snark::NodeId i = 0; i < type_1_count; ++i)
+    {
+        type_1_records.emplace_back(snark::WeightedNodeSamplerRecord{10 + i, 10 + type_1_count + i, 1.0f});
+    }
+    write_alias(1, type_1_records);
+
+    snark::WeightedNodeSamplerFactory weighted(path.string());
+    snark::UniformNodeSamplerFactory uniform(path.string());
+    std::vector<std::unique_ptr<snark::Sampler>> samplers(4);
+    {
+        // Concurrent requests for the same types share a single load.
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < samplers.size(); ++i)
+        {
+            threads.emplace_back([&, i]() {
+                samplers[i] = i % 2 == 0 ? weighted.Create({0, 1}, {0}) : uniform.Create({1, 0}, {0});
+            });
+        }
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+    }
+
+    EXPECT_EQ(2.0f, samplers[0]->Weight());
+    EXPECT_EQ(2.0f, samplers[2]->Weight());
+    // Dummy alias of the last type 0 record and right aliases of type 1 are not sampled uniformly.
+    EXPECT_EQ(float(3 + type_1_count), samplers[1]->Weight());
+    EXPECT_EQ(float(3 + type_1_count), samplers[3]->Weight());
+
+    std::vector<snark::NodeId> nodes(1000, -1);
+    std::vector<snark::Type> types(nodes.size(), -1);
+    samplers[0]->Sample(13, std::span(types), std::span(nodes));
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        if (types[i] == 0)
+        {
+            EXPECT_LT(nodes[i], 3);
+        }
+        else
+        {
+            EXPECT_EQ(1, types[i]);
+            EXPECT_GE(nodes[i], 10);
+            EXPECT_LT(nodes[i], 10 + type_1_count);
+        }
+    }
+
+    std::filesystem::remove_all(path);
+}
+
 TEST_P(StorageTypeGraphTest, NodeTypesMultipleNodes)
 {
     TestGraph::MemoryGraph m;
@@ -431,6 +521,152 @@ TEST_P(StorageTypeGraphTest, NodeFeaturesMultipleNodesSingleFeatureMixedSizes)
     EXPECT_EQ(std::vector<float>(std::begin(short_res), std::end(short_res)), std::vector<float>({1, 2, 11, 12}));
 }
 
+TEST_P(StorageTypeGraphTest, NodeFeaturesMultipleFeaturesNodesOutOfOrder)
+{
+    TestGraph::MemoryGraph m;
+    std::vector<std::vector<float>> f1 = {std::vector<float>{1.0f, 2.0f}, std::vector<float>{3.0f}};
+    std::vector<std::vector<float>> f2 = {std::vector<float>{5.0f, 6.0f}, std::vector<float>{7.0f}};
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_float_features = f1});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 1, .m_type = 1, .m_weight = 1.0f, .m_float_features = f2});
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 2);
+    snark::Graph g(path.string(), std::vector<uint32_t>{0}, GetParam(), "");
+    std::vector<snark::NodeId> nodes = {1, 2, 0, 1};
+    std::vector<uint8_t> output(4 * 3 * 4);
+    std::vector<snark::FeatureMeta> features = {{1, 4}, {0, 8}};
+
+    g.GetNodeFeature(std::span(nodes), std::span(features), std::span(output));
+    std::span res(reinterpret_cast<float *>(output.data()), output.size() / 4);
+    EXPECT_EQ(std::vector<float>(std::begin(res), std::end(res)),
+              std::vector<float>({7, 5, 6, 0, 0, 0, 3, 1, 2, 7, 5, 6}));
+}
+
+TEST_P(StorageTypeGraphTest, NodeFeaturesColumnarMatchesRowLayout)
+{
+    // Feature 1 has mixed sizes, node 2 misses it and node 3 has no features at all.
+    TestGraph::MemoryGraph m;
+    m.m_nodes.push_back(TestGraph::Node{
+        .m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_float_features = {{1.0f, 2.0f}, {3.0f, 4.0f, 5.0f}, {6.0f}}});
+    m.m_nodes.push_back(
+        TestGraph::Node{.m_id = 1, .m_type = 1, .m_weight = 1.0f, .m_float_features = {{7.0f, 8.0f}, {9.0f}}});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 2, .m_type = 0, .m_weight = 1.0f, .m_float_features = {{10.0f}}});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 3, .m_type = 1, .m_weight = 1.0f});
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 2);
+    snark::Graph rows(path.string(), std::vector<uint32_t>{0}, GetParam(), "");
+    snark::Graph columns(path.string(), std::vector<uint32_t>{0}, GetParam(), "", {}, false, false, {}, 0, {1, 0, 7});
+
+    std::vector<snark::NodeId> nodes = {3, 1, 2, 0, 42, 1};
+    for (const auto &features : std::vector<std::vector<snark::FeatureMeta>>{
+             {{1, 12}}, {{1, 4}, {0, 8}}, {{0, 12}, {2, 4}, {1, 16}}, {{7, 4}, {1, 8}}})
+    {
+        size_t fv_size = 0;
+        for (const auto &feature : features)
+        {
+            fv_size += feature.second;
+        }
+
+        auto features_copy = features;
+        std::vector<uint8_t> expected(fv_size * nodes.size(), 0xff);
+        std::vector<uint8_t> output(fv_size * nodes.size(), 0xff);
+        rows.GetNodeFeature(std::span(nodes), std::span(features_copy), std::span(expected));
+        columns.GetNodeFeature(std::span(nodes), std::span(features_copy), std::span(output));
+        EXPECT_EQ(output, expected);
+    }
+
+    std::vector<uint8_t> output(4 * 3 * 2);
+    std::vector<snark::FeatureMeta> features = {{1, 12}};
+    columns.GetNodeFeature(std::span(nodes).subspan(2, 2), std::span(features), std::span(output));
+    std::span res(reinterpret_cast<float *>(output.data()), output.size() / 4);
+    EXPECT_EQ(std::vector<float>(std::begin(res), std::end(res)), std::vector<float>({0, 0, 0, 3, 4, 5}));
+}
+
+TEST(GraphTest, NodeFeaturesDiskFeatureCache)
+{
+    TestGraph::MemoryGraph m;
+    std::vector<std::vector<float>> f1 = {std::vector<float>{1.0f, 2.0f, 3.0f}};
+    std::vector<std::vector<float>> f2 = {std::vector<float>{5.0f, 6.0f}};
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_float_features = f1});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 1, .m_type = 0, .m_weight = 1.0f, .m_float_features = f2});
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::Graph g(path.string(), std::vector<uint32_t>{0}, snark::PartitionStorageType::disk, "",
+                   snark::FeatureCacheConfig{.m_capacity = 1 << 20});
+    std::vector<snark::NodeId> nodes = {0, 1};
+    std::vector<uint8_t> output(4 * 3 * 2);
+    std::vector<snark::FeatureMeta> features = {{0, 12}};
+
+    g.GetNodeFeature(std::span(nodes), std::span(features), std::span(output));
+    EXPECT_EQ(g.GetFeatureCache()->Hits(), 0);
+    EXPECT_EQ(g.GetFeatureCache()->Misses(), 2);
+
+    std::fill(std::begin(output), std::end(output), 0);
+    g.GetNodeFeature(std::span(nodes), std::span(features), std::span(output));
+    std::span res(reinterpret_cast<float *>(output.data()), output.size() / 4);
+    EXPECT_EQ(std::vector<float>(std::begin(res), std::end(res)), std::vector<float>({1, 2, 3, 5, 6, 0}));
+    EXPECT_EQ(g.GetFeatureCache()->Hits(), 2);
+    EXPECT_EQ(g.GetFeatureCache()->Misses(), 2);
+}
+
+TEST(GraphTest, NodeFeaturesWarmFeatureCache)
+{
+    TestGraph::MemoryGraph m;
+    std::vector<std::vector<float>> f1 = {std::vector<float>{1.0f, 2.0f, 3.0f}};
+    std::vector<std::vector<float>> f2 = {std::vector<float>{5.0f, 6.0f, 7.0f}};
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_float_features = f1});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 1, .m_type = 0, .m_weight = 1.0f, .m_float_features = f2});
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    {
+        // Node 1 is sampled 3 times more often than node 0.
+        std::ofstream alias(path / "node_0_0.alias", std::ios_base::binary | std::ios_base::out);
+        for (auto [left, right, threshold] : {std::tuple<snark::NodeId, snark::NodeId, float>{1, 0, 1.0f},
+                                              std::tuple<snark::NodeId, snark::NodeId, float>{0, 1, 0.5f}})
+        {
+            alias.write(reinterpret_cast<const char *>(&left), sizeof(left));
+            alias.write(reinterpret_cast<const char *>(&right), sizeof(right));
+            alias.write(reinterpret_cast<const char *>(&threshold), sizeof(threshold));
+        }
+    }
+
+    // Cache has space only for one node.
+    snark::Graph g(path.string(), std::vector<uint32_t>{0}, snark::PartitionStorageType::disk, "",
+                   snark::FeatureCacheConfig{.m_capacity = 100, .m_shard_count = 1, .m_warm = true});
+    std::filesystem::remove(path / "node_0_0.alias");
+    std::vector<snark::NodeId> nodes = {1};
+    std::vector<uint8_t> output(4 * 3);
+    std::vector<snark::FeatureMeta> features = {{0, 12}};
+
+    g.GetNodeFeature(std::span(nodes), std::span(features), std::span(output));
+    std::span res(reinterpret_cast<float *>(output.data()), output.size() / 4);
+    EXPECT_EQ(std::vector<float>(std::begin(res), std::end(res)), std::vector<float>({5, 6, 7}));
+    EXPECT_EQ(g.GetFeatureCache()->Hits(), 1);
+    // Loading node 1 during warm up is the only miss.
+    EXPECT_EQ(g.GetFeatureCache()->Misses(), 1);
+}
+
+TEST(GraphTest, FeatureCacheGrowingValuesStayWithinCapacity)
+{
+    // Every entry takes 64 bytes of bookkeeping, the shard fits two entries with 8 byte values.
+    snark::FeatureCache cache(150, 1);
+    const std::vector<uint8_t> small(8, 1);
+    const std::vector<uint8_t> large(20, 2);
+    const int storage = 0;
+    cache.Put(&storage, 0, std::span(small));
+    cache.Put(&storage, 1, std::span(small));
+    EXPECT_EQ(cache.Size(), 144);
+
+    // Replacing a value with a longer one evicts the other entry instead of growing past the capacity.
+    cache.Put(&storage, 0, std::span(large));
+    EXPECT_LE(cache.Size(), cache.Capacity());
+    EXPECT_EQ(cache.Size(), 84);
+    std::vector<uint8_t> output(large.size());
+    EXPECT_TRUE(cache.Get(&storage, 0, std::span(output)));
+    EXPECT_EQ(output, large);
+    std::vector<uint8_t> evicted(small.size());
+    EXPECT_FALSE(cache.Get(&storage, 1, std::span(evicted)));
+}
+
 TEST_P(StorageTypeGraphTest, NodeSparseFeaturesMultipleNodes)
 {
     TestGraph::MemoryGraph m;
@@ -527,6 +763,52 @@ TEST_P(StorageTypeGraphTest, NodeSparseFeaturesMissingFeature)
     EXPECT_EQ(std::vector<int64_t>({3}), dimensions);
 }
 
+TEST_P(StorageTypeGraphTest, NodeSparseFeaturesFlatBatch)
+{
+    TestGraph::MemoryGraph m;
+    // f_0: indices 2, data 4, f_1: indices - 1, 13, 42, data - 1
+    std::vector<int32_t> f1_1_data = {1, 1, 2, 0, 4};
+    std::vector<int32_t> f1_2_data = {3, 3, 1, 0, 13, 0, 42, 0, 1};
+    // f_1: indices - 3, 8, 9, data - 6
+    std::vector<int32_t> f2_2_data = {3, 3, 3, 0, 8, 0, 9, 0, 6};
+    auto start = reinterpret_cast<float *>(f1_1_data.data());
+    std::vector<std::vector<float>> f1 = {std::vector<float>(start, start + f1_1_data.size())};
+    start = reinterpret_cast<float *>(f1_2_data.data());
+    f1.emplace_back(start, start + f1_2_data.size());
+    start = reinterpret_cast<float *>(f2_2_data.data());
+    std::vector<std::vector<float>> f2 = {{}, std::vector<float>(start, start + f2_2_data.size())};
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_float_features = f1});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 1, .m_type = 1, .m_weight = 1.0f, .m_float_features = f2});
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 2);
+    snark::Graph g(path.string(), std::vector<uint32_t>{0}, GetParam(), "");
+    std::vector<snark::NodeId> nodes = {1, 42, 0};
+    std::vector<snark::FeatureId> features = {1, 0, 2};
+
+    snark::SparseFeatureBatch batch;
+    g.GetNodeSparseFeature(std::span(nodes), std::span(features), batch);
+    EXPECT_EQ(std::vector<int64_t>({3, 1, 0}), batch.m_dimensions);
+    EXPECT_EQ(std::vector<size_t>({0, 8, 10, 10}), batch.m_indices_offsets);
+    EXPECT_EQ(std::vector<size_t>({0, 8, 12, 12}), batch.m_values_offsets);
+    auto indices = batch.Indices(0);
+    EXPECT_EQ(std::vector<int64_t>({0, 3, 8, 9, 2, 1, 13, 42}), std::vector<int64_t>(indices.begin(), indices.end()));
+    indices = batch.Indices(1);
+    EXPECT_EQ(std::vector<int64_t>({2, 2}), std::vector<int64_t>(indices.begin(), indices.end()));
+    EXPECT_TRUE(batch.Indices(2).empty());
+    auto tmp = reinterpret_cast<const int32_t *>(batch.m_values.data());
+    EXPECT_EQ(std::vector<int32_t>({6, 1, 4}), std::vector<int32_t>(tmp, tmp + 3));
+
+    // Second batch replaces content of the first one without releasing memory.
+    const auto capacity = batch.m_indices.capacity();
+    nodes = {0};
+    features = {0};
+    g.GetNodeSparseFeature(std::span(nodes), std::span(features), batch);
+    EXPECT_EQ(std::vector<int64_t>({1}), batch.m_dimensions);
+    EXPECT_EQ(std::vector<int64_t>({0, 2}), batch.m_indices);
+    EXPECT_EQ(sizeof(int32_t), batch.Values(0).size());
+    EXPECT_EQ(capacity, batch.m_indices.capacity());
+}
+
 TEST_P(StorageTypeGraphTest, NodeSparseFeaturesDimensionsFill)
 {
     // indices - 17416, data - 1.0
@@ -1232,7 +1514,1003 @@ TEST(GraphTest, GetNodeTypesAcrossPartitions)
     EXPECT_EQ(std::vector<snark::Type>({0, 2, 1, 2, 2, -1}), types);
 }
 
+TEST(GraphTest, NodeIndexSparseIdsAcrossPartitions)
+{
+    for (bool compact : {false, true})
+    {
+        SCOPED_TRACE(compact ? "compact" : "hash");
+        std::vector<std::vector<snark::NodeId>> node_ids = {{42, -7, 1ll << 40, 3}, {3, 100, -7}};
+        std::vector<uint32_t> partitions_indices;
+        std::vector<uint64_t> internal_indices;
+        std::vector<uint32_t> counts;
+        snark::NodeIndex index(std::move(node_ids), partitions_indices, internal_indices, counts, compact);
+
+        EXPECT_EQ(index.Size(), 5);
+        EXPECT_EQ(partitions_indices, std::vector<uint32_t>({0, 1, 0, 1, 0, 1, 0}));
+        EXPECT_EQ(internal_indices, std::vector<uint64_t>({1, 2, 3, 0, 0, 1, 2}));
+        EXPECT_EQ(counts, std::vector<uint32_t>({2, 2, 2, 2, 1, 1, 1}));
+        EXPECT_EQ(index.Find(-7), 0);
+        EXPECT_EQ(index.Find(3), 2);
+        EXPECT_EQ(index.Find(42), 4);
+        EXPECT_EQ(index.Find(100), 5);
+        EXPECT_EQ(index.Find(1ll << 40), 6);
+        EXPECT_EQ(index.Find(0), snark::NodeIndex::npos);
+        EXPECT_EQ(index.Find(-8), snark::NodeIndex::npos);
+        EXPECT_EQ(index.Find((1ll << 40) + 1), snark::NodeIndex::npos);
+
+        std::vector<snark::NodeId> unique;
+        index.ForEach([&unique](snark::NodeId node) { unique.emplace_back(node); });
+        std::sort(std::begin(unique), std::end(unique));
+        EXPECT_EQ(unique, std::vector<snark::NodeId>({-7, 3, 42, 100, 1ll << 40}));
+    }
+}
+
+TEST(GraphTest, NodeIndexFewIdsSpanningFullRange)
+{
+    // Hashed ids of mixed sign make the id range wider than 2^63 with a single bucket target.
+    const snark::NodeId lowest = std::numeric_limits<snark::NodeId>::min();
+    const snark::NodeId highest = std::numeric_limits<snark::NodeId>::max();
+    std::vector<std::vector<snark::NodeId>> node_ids = {{highest, 5, lowest}};
+    std::vector<uint32_t> partitions_indices;
+    std::vector<uint64_t> internal_indices;
+    std::vector<uint32_t> counts;
+    snark::NodeIndex index(std::move(node_ids), partitions_indices, internal_indices, counts, true);
+
+    EXPECT_EQ(index.Find(lowest), 0);
+    EXPECT_EQ(index.Find(5), 1);
+    EXPECT_EQ(index.Find(highest), 2);
+    EXPECT_EQ(index.Find(-1), snark::NodeIndex::npos);
+    EXPECT_EQ(index.Find(highest - 1), snark::NodeIndex::npos);
+}
+
+TEST(GraphTest, NodeIndexBatchFindMatchesSingleLookups)
+{
+    for (bool compact : {false, true})
+    {
+        SCOPED_TRACE(compact ? "compact" : "hash");
+        std::vector<std::vector<snark::NodeId>> node_ids(2);
+        for (snark::NodeId node = 0; node < 1000; ++node)
+        {
+            node_ids[node % 2].emplace_back(node * 3);
+        }
+        node_ids[1].emplace_back(0);
+        std::vector<uint32_t> partitions_indices;
+        std::vector<uint64_t> internal_indices;
+        std::vector<uint32_t> counts;
+        snark::NodeIndex index(std::move(node_ids), partitions_indices, internal_indices, counts, compact);
+
+        // Batch is longer than the prefetch distance and has missing and out of range nodes.
+        std::vector<snark::NodeId> batch = {-5, 3000, 0};
+        boost::random::uniform_int_distribution<snark::NodeId> pick(-10, 3010);
+        snark::Xoroshiro128PlusGenerator gen(23);
+        std::generate_n(std::back_inserter(batch), 200, [&]() { return pick(gen); });
+        std::vector<uint64_t> positions(batch.size());
+        index.Find(batch, positions);
+        for (size_t i = 0; i < batch.size(); ++i)
+        {
+            EXPECT_EQ(index.Find(batch[i]), positions[i]);
+        }
+        EXPECT_EQ(positions[0], snark::NodeIndex::npos);
+        EXPECT_EQ(positions[1], snark::NodeIndex::npos);
+        EXPECT_EQ(positions[2], 0);
+    }
+}
+
+TEST(GraphTest, UniformRealsMatchBoostDistribution)
+{
+    // Seed 50210 draws a raw number rounded up to 1 at position 58, which boost rejects.
+    std::vector<int64_t> seeds(100);
+    std::iota(std::begin(seeds), std::end(seeds), 0);
+    seeds.emplace_back(50210);
+    for (auto seed : seeds)
+    {
+        SCOPED_TRACE(seed);
+        snark::Xoroshiro128PlusGenerator expected_gen(seed);
+        boost::random::uniform_real_distribution<float> toss(0, 1);
+        std::vector<float> expected(301);
+        std::generate(std::begin(expected), std::end(expected), [&]() { return toss(expected_gen); });
+
+        snark::Xoroshiro128PlusGenerator batch_gen(seed);
+        std::vector<float> batch(expected.size());
+        snark::uniform_reals(batch_gen, batch);
+        EXPECT_EQ(expected, batch);
+
+        // Streams mix single numbers and batches crossing refills.
+        snark::Xoroshiro128PlusGenerator stream_gen(seed);
+        snark::UniformReals stream(stream_gen);
+        std::vector<float> streamed;
+        while (streamed.size() + snark::UniformReals::batch_size <= expected.size())
+        {
+            streamed.emplace_back(stream());
+            const auto next = stream.Next(streamed.size() % snark::UniformReals::batch_size);
+            streamed.insert(std::end(streamed), std::begin(next), std::end(next));
+        }
+        expected.resize(streamed.size());
+        EXPECT_EQ(expected, streamed);
+    }
+}
+
+TEST(GraphTest, CompressedAdjacencyMatchesPlainEdges)
+{
+    snark::Xoroshiro128PlusGenerator gen(13);
+    boost::random::uniform_int_distribution<int64_t> gap(0, 1000);
+    std::vector<snark::NodeId> destinations;
+    std::vector<float> weight_sums;
+    std::vector<size_t> run_starts;
+    snark::CompressedAdjacency adjacency;
+
+    // Runs crossing block boundaries with constant, half precision and full precision weights.
+    const std::vector<size_t> run_sizes = {1, 63, 64, 65, 200, 3, 130};
+    for (size_t run = 0; run < run_sizes.size(); ++run)
+    {
+        run_starts.emplace_back(destinations.size());
+        snark::NodeId destination = run % 2 == 0 ? -(int64_t(1) << 40) : 5;
+        float sum = 0;
+        for (size_t i = 0; i < run_sizes[run]; ++i)
+        {
+            destination += gap(gen);
+            const float weight = run % 3 == 0 ? 1.0f : run % 3 == 1 ? float(1 + i % 4) / 4 : 0.1f * (i + 1);
+            sum += weight;
+            destinations.emplace_back(destination);
+            weight_sums.emplace_back(sum);
+            adjacency.Append(destination, weight, i == 0);
+        }
+    }
+    run_starts.emplace_back(destinations.size());
+    adjacency.Finish();
+    EXPECT_EQ(adjacency.Size(), destinations.size());
+
+    for (size_t run = 0; run + 1 < run_starts.size(); ++run)
+    {
+        const auto first = run_starts[run];
+        const auto last = run_starts[run + 1];
+        std::vector<snark::NodeId> run_destinations;
+        adjacency.Destinations(first, last, run_destinations);
+        EXPECT_EQ(run_destinations, std::vector<snark::NodeId>(std::begin(destinations) + first,
+                                                               std::begin(destinations) + last));
+        std::vector<float> run_weight_sums;
+        adjacency.WeightSums(first, last, run_weight_sums);
+        EXPECT_EQ(run_weight_sums,
+                  std::vector<float>(std::begin(weight_sums) + first, std::begin(weight_sums) + last));
+
+        for (size_t position = first; position < last; ++position)
+        {
+            EXPECT_EQ(adjacency.Destination(position), destinations[position]);
+            EXPECT_EQ(adjacency.WeightSum(first, position), weight_sums[position]);
+            for (auto value : {destinations[position] - 1, destinations[position], destinations[position] + 1})
+            {
+                const auto expected = std::lower_bound(std::begin(destinations) + first,
+                                                       std::begin(destinations) + last, value) -
+                                      std::begin(destinations);
+                EXPECT_EQ(adjacency.FindDestination(first, last, value), size_t(expected));
+            }
+            for (auto value : {weight_sums[position] - 0.05f, weight_sums[position], weight_sums[position] + 0.05f})
+            {
+                const auto expected =
+                    std::lower_bound(std::begin(weight_sums) + first, std::begin(weight_sums) + last, value) -
+                    std::begin(weight_sums);
+                float weight = -1;
+                EXPECT_EQ(adjacency.FindWeightSum(first, last, value, weight), size_t(expected));
+                if (size_t(expected) < last)
+                {
+                    EXPECT_EQ(weight, size_t(expected) == first
+                                          ? weight_sums[size_t(expected)]
+                                          : weight_sums[size_t(expected)] - weight_sums[size_t(expected) - 1]);
+                }
+            }
+        }
+    }
+}
+
+TEST(GraphTest, CompressedEdgesMatchUncompressed)
+{
+    TestGraph::MemoryGraph m;
+    for (snark::NodeId node = 0; node < 8; ++node)
+    {
+        std::vector<TestGraph::NeighborRecord> neighbors;
+        for (snark::Type type = 0; type < 2; ++type)
+        {
+            for (snark::NodeId nb = 0; nb < node * node * (type + 1) * 3; ++nb)
+            {
+                neighbors.emplace_back(nb * (node + 1), type, type == 0 ? 1.0f : 0.1f * ((nb + node) % 7 + 1));
+            }
+        }
+        m.m_nodes.push_back(TestGraph::Node{.m_id = node, .m_type = 0, .m_weight = 1.0f, .m_neighbors = neighbors});
+    }
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::Graph plain(path.string(), {0}, snark::PartitionStorageType::memory, "");
+    snark::Graph compressed(path.string(), {0}, snark::PartitionStorageType::memory, "", {}, false, true);
+
+    std::vector<snark::NodeId> nodes = {7, 0, 3, 5, 1, 6, 42};
+    std::vector<snark::Type> types = {0, 1};
+    std::vector<snark::NodeId> plain_nodes, compressed_nodes;
+    std::vector<snark::Type> plain_types, compressed_types;
+    std::vector<float> plain_weights, compressed_weights;
+    std::vector<uint64_t> plain_counts(nodes.size()), compressed_counts(nodes.size());
+    plain.FullNeighbor(std::span(nodes), std::span(types), plain_nodes, plain_types, plain_weights,
+                       std::span(plain_counts));
+    compressed.FullNeighbor(std::span(nodes), std::span(types), compressed_nodes, compressed_types,
+                            compressed_weights, std::span(compressed_counts));
+    EXPECT_EQ(plain_nodes, compressed_nodes);
+    EXPECT_EQ(plain_types, compressed_types);
+    EXPECT_EQ(plain_weights, compressed_weights);
+    EXPECT_EQ(plain_counts, compressed_counts);
+
+    const size_t count = 20;
+    const auto sample = [&](const snark::Graph &g, int64_t seed) {
+        std::vector<snark::NodeId> out_nodes(count * nodes.size());
+        std::vector<snark::Type> out_types(count * nodes.size());
+        std::vector<float> out_weights(count * nodes.size());
+        std::vector<float> total_weights(nodes.size());
+        g.SampleNeighbor(seed, std::span(nodes), std::span(types), count, std::span(out_nodes), std::span(out_types),
+                         std::span(out_weights), std::span(total_weights), -1, 0, -1);
+        std::vector<uint64_t> total_counts(nodes.size());
+        for (bool without_replacement : {false, true})
+        {
+            std::vector<snark::NodeId> uniform_nodes(count * nodes.size());
+            std::vector<snark::Type> uniform_types(count * nodes.size());
+            g.UniformSampleNeighbor(without_replacement, seed, std::span(nodes), std::span(types), count,
+                                    std::span(uniform_nodes), std::span(uniform_types), std::span(total_counts), -1,
+                                    -1);
+            out_nodes.insert(std::end(out_nodes), std::begin(uniform_nodes), std::end(uniform_nodes));
+            out_types.insert(std::end(out_types), std::begin(uniform_types), std::end(uniform_types));
+        }
+        return std::make_tuple(out_nodes, out_types, out_weights, total_weights);
+    };
+    for (int64_t seed = 1; seed < 5; ++seed)
+    {
+        EXPECT_EQ(sample(plain, seed), sample(compressed, seed));
+    }
+}
+
+TEST(GraphTest, AliasTablesNeighborSampleStatisticalProperties)
+{
+    // Node 0 has a long run of type 0 with weights 1..5 and a short run of type 1 without alias table.
+    TestGraph::MemoryGraph m;
+    std::vector<TestGraph::NeighborRecord> neighbors;
+    for (snark::NodeId nb = 1; nb <= 40; ++nb)
+    {
+        neighbors.emplace_back(nb, 0, float(nb % 5 + 1));
+    }
+    for (snark::NodeId nb = 41; nb <= 43; ++nb)
+    {
+        neighbors.emplace_back(nb, 1, 10.0f);
+    }
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_neighbors = neighbors});
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+
+    const float total_weight = 120.0f + 30.0f;
+    const size_t count = 300000;
+    std::vector<snark::NodeId> nodes = {0};
+    std::vector<snark::Type> types = {0, 1};
+    for (bool compressed_edges : {false, true})
+    {
+        snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "", {}, false, compressed_edges, {},
+                       8);
+        std::vector<snark::NodeId> out_nodes(count);
+        std::vector<snark::Type> out_types(count);
+        std::vector<float> out_weights(count);
+        std::vector<float> total_weights(1);
+        g.SampleNeighbor(13, std::span(nodes), std::span(types), count, std::span(out_nodes), std::span(out_types),
+                         std::span(out_weights), std::span(total_weights), -1, 0, -1);
+        EXPECT_FLOAT_EQ(total_weights[0], total_weight);
+
+        std::map<snark::NodeId, size_t> frequencies;
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto nb = out_nodes[i];
+            ASSERT_GE(nb, 1);
+            ASSERT_LE(nb, 43);
+            EXPECT_EQ(out_types[i], nb <= 40 ? 0 : 1);
+            EXPECT_EQ(out_weights[i], nb <= 40 ? float(nb % 5 + 1) : 10.0f);
+            ++frequencies[nb];
+        }
+        for (snark::NodeId nb = 1; nb <= 43; ++nb)
+        {
+            const double weight = nb <= 40 ? nb % 5 + 1 : 10.0;
+            EXPECT_NEAR(double(frequencies[nb]) / count, weight / total_weight, 0.002);
+        }
+    }
+}
+
+TEST(GraphTest, BatchedEdgeFeaturesMatchSingleLookups)
+{
+    // Hub node 0 has edges to even nodes in partition 0 and to odd nodes in partition 1, parallel edges to 8 have
+    // different features and the first one is returned.
+    TestGraph::MemoryGraph m1;
+    TestGraph::MemoryGraph m2;
+    TestGraph::Node hub0{.m_id = 0, .m_type = 0, .m_weight = 1.0f};
+    TestGraph::Node hub1{.m_id = 0, .m_type = 0, .m_weight = 1.0f};
+    for (snark::NodeId nb = 1; nb <= 200; ++nb)
+    {
+        auto &hub = nb % 2 == 0 ? hub0 : hub1;
+        for (int copy = 0; copy < (nb == 8 ? 2 : 1); ++copy)
+        {
+            hub.m_neighbors.emplace_back(nb, 0, 1.0f);
+            hub.m_edge_features.push_back({{float(nb * 10 + copy)}});
+        }
+    }
+    hub0.m_neighbors.emplace_back(1, 1, 1.0f);
+    hub0.m_edge_features.push_back({{-1.0f}});
+    m1.m_nodes.emplace_back(std::move(hub0));
+    m1.m_nodes.push_back(TestGraph::Node{.m_id = 1, .m_type = 0, .m_weight = 1.0f, .m_neighbors = {{0, 0, 1.0f}},
+                                         .m_edge_features = {{{5.0f}}}});
+    m2.m_nodes.emplace_back(std::move(hub1));
+    auto path = std::filesystem::temp_directory_path() / "batched_edge_features";
+    std::filesystem::create_directories(path);
+    TestGraph::convert(path, "0_0", std::move(m1), 1);
+    TestGraph::convert(path, "1_0", std::move(m2), 1);
+
+    std::vector<snark::NodeId> sources = {0, 0, 1, 0, 0, 0, 0, 42, 0, 0, 0, 1};
+    std::vector<snark::NodeId> destinations = {200, 3, 0, 8, 3, 201, 1, 0, 2, 1, 0, 7};
+    std::vector<snark::Type> types = {0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0};
+    const std::vector<float> expected = {2000, 30, 5, 80, 30, 0, -1, 0, 20, 10, 0, 0};
+    std::vector<snark::FeatureMeta> features = {{0, sizeof(float)}};
+    for (size_t edge_index_threshold : {0, 16})
+    {
+        for (bool compressed_edges : {false, true})
+        {
+            SCOPED_TRACE(edge_index_threshold);
+            SCOPED_TRACE(compressed_edges);
+            snark::Graph g(path.string(), {0, 1}, snark::PartitionStorageType::memory, "", {}, false,
+                           compressed_edges, {}, 0, {}, {}, edge_index_threshold);
+
+            std::vector<float> values(sources.size(), -100.0f);
+            g.GetEdgeFeature(sources, destinations, types, features,
+                             std::span(reinterpret_cast<uint8_t *>(values.data()), values.size() * sizeof(float)));
+            EXPECT_EQ(expected, values);
+
+            std::vector<snark::FeatureId> string_features = {0};
+            std::vector<int64_t> dimensions(sources.size());
+            std::vector<uint8_t> string_values;
+            g.GetEdgeStringFeature(sources, destinations, types, string_features, dimensions, string_values);
+            std::vector<float> found;
+            for (size_t edge = 0; edge < sources.size(); ++edge)
+            {
+                EXPECT_EQ(expected[edge] == 0 ? 0 : int64_t(sizeof(float)), dimensions[edge]);
+                if (expected[edge] != 0)
+                {
+                    found.emplace_back(expected[edge]);
+                }
+            }
+            const auto string_floats = reinterpret_cast<const float *>(string_values.data());
+            EXPECT_EQ(found,
+                      std::vector<float>(string_floats, string_floats + string_values.size() / sizeof(float)));
+        }
+    }
+
+    std::filesystem::remove_all(path);
+}
+
+TEST(GraphTest, EdgeTypeMasksMatchNeighborListScans)
+{
+    // An edge of type 64 in the second graph disables edge type masks, both graphs must return the same results.
+    const auto create = [](std::string name, bool large_type) {
+        TestGraph::MemoryGraph m;
+        for (snark::NodeId node = 0; node < 6; ++node)
+        {
+            std::vector<TestGraph::NeighborRecord> neighbors;
+            for (snark::Type type : {0, 2, 5})
+            {
+                for (snark::NodeId nb = 0; nb < (node + type) % 4; ++nb)
+                {
+                    neighbors.emplace_back(10 * nb + type, type, 0.5f + nb + type);
+                }
+            }
+            m.m_nodes.push_back(
+                TestGraph::Node{.m_id = node, .m_type = 0, .m_weight = 1.0f, .m_neighbors = neighbors});
+        }
+        if (large_type)
+        {
+            m.m_nodes.push_back(
+                TestGraph::Node{.m_id = 6, .m_type = 0, .m_weight = 1.0f, .m_neighbors = {{0, 64, 1.0f}}});
+        }
+        auto path = std::filesystem::temp_directory_path() / name;
+        std::filesystem::create_directories(path);
+        TestGraph::convert(path, "0_0", std::move(m), 1);
+        return path;
+    };
+    const auto masked_path = create("edge_type_masks", false);
+    const auto scanned_path = create("edge_type_scans", true);
+
+    const auto query = [](const std::filesystem::path &path, bool compressed_edges) {
+        snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "", {}, false, compressed_edges);
+        std::vector<snark::NodeId> nodes = {0, 1, 2, 3, 4, 5, 42};
+        std::vector<uint64_t> counts;
+        std::vector<snark::NodeId> neighbors;
+        std::vector<snark::Type> neighbor_types;
+        std::vector<float> weights;
+        std::vector<float> total_weights(nodes.size());
+        for (std::vector<snark::Type> types : std::vector<std::vector<snark::Type>>{{0}, {1, 2}, {0, 2, 5}, {5, 64}})
+        {
+            std::vector<uint64_t> type_counts(nodes.size());
+            g.NeighborCount(nodes, types, type_counts);
+            counts.insert(std::end(counts), std::begin(type_counts), std::end(type_counts));
+            g.FullNeighbor(nodes, types, neighbors, neighbor_types, weights, type_counts);
+
+            const size_t count = 5;
+            std::vector<snark::NodeId> sampled(count * nodes.size());
+            std::vector<snark::Type> sampled_types(count * nodes.size());
+            std::vector<float> sampled_weights(count * nodes.size());
+            g.SampleNeighbor(7, nodes, types, count, sampled, sampled_types, sampled_weights, total_weights, -1, 0,
+                             -1);
+            neighbors.insert(std::end(neighbors), std::begin(sampled), std::end(sampled));
+            weights.insert(std::end(weights), std::begin(total_weights), std::end(total_weights));
+            for (bool without_replacement : {false, true})
+            {
+                g.UniformSampleNeighbor(without_replacement, 7, nodes, types, count, sampled, sampled_types,
+                                        type_counts, -1, -1);
+                neighbors.insert(std::end(neighbors), std::begin(sampled), std::end(sampled));
+                counts.insert(std::end(counts), std::begin(type_counts), std::end(type_counts));
+            }
+        }
+        return std::make_tuple(counts, neighbors, neighbor_types, weights);
+    };
+    for (bool compressed_edges : {false, true})
+    {
+        SCOPED_TRACE(compressed_edges);
+        const auto expected = query(scanned_path, compressed_edges);
+        EXPECT_EQ(expected, query(masked_path, compressed_edges));
+        EXPECT_EQ(std::vector<uint64_t>({0, 1, 2, 3, 0, 1, 0}),
+                  std::vector<uint64_t>(std::begin(std::get<0>(expected)), std::begin(std::get<0>(expected)) + 7));
+    }
+
+    std::filesystem::remove_all(masked_path);
+    std::filesystem::remove_all(scanned_path);
+}
+
+TEST(GraphTest, SharedIndexGraphsMatchPrivateGraph)
+{
+    std::vector<TestGraph::MemoryGraph> graphs(2);
+    for (snark::NodeId node = 0; node < 60; ++node)
+    {
+        std::vector<TestGraph::NeighborRecord> neighbors;
+        for (snark::NodeId nb = 0; nb < node % 17; ++nb)
+        {
+            neighbors.emplace_back((node * 5 + nb * 7) % 70, snark::Type(nb % 2), float(nb % 3 + 1));
+        }
+        std::vector<std::vector<float>> features = {{float(node), float(-node)}};
+        graphs[node % 2].m_nodes.push_back(TestGraph::Node{
+            .m_id = node, .m_type = 0, .m_weight = 1.0f, .m_float_features = features, .m_neighbors = neighbors});
+    }
+    auto updated = graphs[0];
+    for (auto &node : updated.m_nodes)
+    {
+        node.m_float_features = {{float(node.m_id + 100), float(-node.m_id)}};
+    }
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(graphs[0]), 1);
+    TestGraph::convert(path, "1_0", std::move(graphs[1]), 1);
+    const auto shared_path = path / "shared_index";
+    std::filesystem::remove_all(shared_path);
+
+    const auto load = [&](size_t alias_threshold, std::string shared_index) {
+        return snark::Graph(path.string(), {0, 1}, snark::PartitionStorageType::memory, "", {}, false, false, {},
+                            alias_threshold, {0}, std::move(shared_index));
+    };
+    std::vector<snark::NodeId> nodes;
+    for (snark::NodeId node = 0; node < 80; ++node)
+    {
+        nodes.emplace_back((node * 13) % 75);
+    }
+    std::vector<snark::Type> types = {0, 1};
+    const size_t count = 5;
+    const auto query = [&](const snark::Graph &g) {
+        std::vector<snark::FeatureMeta> features = {{0, 2 * sizeof(float)}};
+        std::vector<uint8_t> node_features(nodes.size() * 2 * sizeof(float));
+        g.GetNodeFeature(std::span(nodes), std::span(features), std::span(node_features));
+        std::vector<snark::NodeId> out_nodes(count * nodes.size());
+        std::vector<snark::Type> out_types(count * nodes.size());
+        std::vector<float> out_weights(count * nodes.size());
+        std::vector<float> total_weights(nodes.size());
+        g.SampleNeighbor(23, std::span(nodes), std::span(types), count, std::span(out_nodes), std::span(out_types),
+                         std::span(out_weights), std::span(total_weights), -1, 0, -1);
+        std::vector<snark::NodeId> uniform_nodes(count * nodes.size());
+        std::vector<snark::Type> uniform_types(count * nodes.size());
+        std::vector<uint64_t> total_counts(nodes.size());
+        g.UniformSampleNeighbor(true, 23, std::span(nodes), std::span(types), count, std::span(uniform_nodes),
+                                std::span(uniform_types), std::span(total_counts), -1, -1);
+        return std::make_tuple(node_features, out_nodes, out_types, out_weights, total_weights, uniform_nodes,
+                               total_counts);
+    };
+
+    for (size_t alias_threshold : {4, 0})
+    {
+        SCOPED_TRACE(alias_threshold);
+        const auto expected = query(load(alias_threshold, ""));
+
+        // The first graph publishes arrays, the second one maps them without rewriting any files.
+        const auto publisher = load(alias_threshold, shared_path.string());
+        const auto published_time = std::filesystem::last_write_time(shared_path / "manifest.txt");
+        const auto attached = load(alias_threshold, shared_path.string());
+        EXPECT_EQ(std::filesystem::last_write_time(shared_path / "manifest.txt"), published_time);
+        EXPECT_EQ(query(publisher), expected);
+        EXPECT_EQ(query(attached), expected);
+    }
+
+    // Rewriting only feature files of a partition replaces published columnar features.
+    const auto stale = query(load(0, ""));
+    const auto updated_path = path / "shared_index_update";
+    std::filesystem::create_directories(updated_path);
+    TestGraph::convert(updated_path, "0_0", std::move(updated), 1);
+    for (const auto *name : {"node_features_0_0.index", "node_features_0_0.data"})
+    {
+        std::filesystem::copy_file(updated_path / name, path / name, std::filesystem::copy_options::overwrite_existing);
+    }
+    const auto expected = query(load(0, ""));
+    EXPECT_NE(std::get<0>(expected), std::get<0>(stale));
+    EXPECT_EQ(query(load(0, shared_path.string())), expected);
+    std::filesystem::remove_all(updated_path);
+}
+
 // Neighbor Count Tests
+TEST(GraphTest, ThreadPoolCoversAllChunks)
+{
+    snark::ThreadPool pool(4);
+    EXPECT_EQ(pool.Size(), 4);
+    std::vector<std::atomic<int>> visits(1000);
+    pool.ParallelFor(visits.size(), 7, [&visits](size_t begin, size_t end) {
+        EXPECT_EQ(begin % 7, 0);
+        EXPECT_LE(end - begin, 7);
+        for (size_t i = begin; i < end; ++i)
+        {
+            ++visits[i];
+        }
+    });
+    EXPECT_TRUE(std::all_of(std::begin(visits), std::end(visits), [](const auto &v) { return v == 1; }));
+
+    // Nested loops run on the calling threads if workers are busy.
+    std::atomic<size_t> total = 0;
+    pool.ParallelFor(8, 1, [&pool, &total](size_t, size_t) {
+        pool.ParallelFor(100, 10, [&total](size_t begin, size_t end) { total += end - begin; });
+    });
+    EXPECT_EQ(total, 800);
+
+    EXPECT_THROW(pool.ParallelFor(100, 1,
+                                  [](size_t begin, size_t) {
+                                      if (begin == 42)
+                                      {
+                                          throw std::runtime_error("chunk failed");
+                                      }
+                                  }),
+                 std::runtime_error);
+}
+
+TEST(GraphTest, ThreadPoolRunsSubmittedTasks)
+{
+    std::atomic<size_t> total = 0;
+    {
+        snark::ThreadPool pool(3);
+        for (size_t i = 0; i < 100; ++i)
+        {
+            pool.Submit([&total, i]() { total += i; });
+        }
+    }
+    EXPECT_EQ(total, 4950);
+
+    // Tasks run on the calling thread without workers.
+    snark::ThreadPool sequential(1);
+    const auto caller = std::this_thread::get_id();
+    std::thread::id runner;
+    sequential.Submit([&runner]() { runner = std::this_thread::get_id(); });
+    EXPECT_EQ(runner, caller);
+}
+
+TEST(GraphTest, ConcurrentRangeReadsMatchSerialReads)
+{
+    const auto path = std::filesystem::temp_directory_path() / "ConcurrentRangeReadsMatchSerialReads";
+    std::vector<uint8_t> data(1 << 16);
+    std::iota(std::begin(data), std::end(data), 0);
+    std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(data.data()), data.size());
+
+    // Adjacent, overlapping and scattered ranges in random order.
+    snark::Xoroshiro128PlusGenerator gen(13);
+    std::vector<std::pair<uint64_t, uint64_t>> parts = {{0, 16}, {16, 32}, {40, 8}, {44, 20}};
+    for (size_t i = 0; i < 200; ++i)
+    {
+        const uint64_t offset = gen() % (data.size() - 512);
+        parts.emplace_back(offset, 1 + gen() % 512);
+    }
+    std::shuffle(std::begin(parts), std::end(parts), gen);
+
+    auto file = snark::open_file(path, "rb");
+    for (size_t concurrent_reads : {size_t(1), size_t(4), snark::default_concurrent_reads})
+    {
+        std::vector<std::vector<uint8_t>> outputs;
+        std::vector<snark::FileRange> ranges;
+        for (const auto &[offset, size] : parts)
+        {
+            outputs.emplace_back(size);
+        }
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            ranges.push_back(
+                snark::FileRange{.offset = parts[i].first, .size = parts[i].second, .output = outputs[i].data()});
+        }
+        EXPECT_TRUE(snark::platform_pread(file, std::span(ranges), concurrent_reads));
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            EXPECT_TRUE(std::equal(std::begin(outputs[i]), std::end(outputs[i]), std::begin(data) + parts[i].first));
+        }
+
+        // Ranges past the end of the file are reported.
+        std::vector<uint8_t> tail(64);
+        std::vector<snark::FileRange> past_end = {
+            ranges.front(), {.offset = data.size() - 32, .size = 64, .output = tail.data()}};
+        EXPECT_FALSE(snark::platform_pread(file, std::span(past_end), concurrent_reads));
+    }
+    fclose(file);
+    std::filesystem::remove(path);
+}
+
+TEST(GraphTest, NumaNodesRunPinnedThreads)
+{
+    const auto nodes = snark::numa_nodes();
+    ASSERT_FALSE(nodes.empty());
+    std::set<size_t> cpus;
+    for (const auto &node : nodes)
+    {
+        EXPECT_FALSE(node.m_cpus.empty());
+        for (auto cpu : node.m_cpus)
+        {
+            EXPECT_TRUE(cpus.insert(cpu).second);
+        }
+    }
+
+    std::vector<size_t> calls(2 * nodes.size() + 1);
+    snark::numa_parallel_for(calls.size(), nodes, [&calls](size_t index) { ++calls[index]; });
+    EXPECT_EQ(calls, std::vector<size_t>(calls.size(), 1));
+
+    // Nodes run at most one thread per processor.
+    const std::vector<snark::NumaNode> single_cpu = {
+        {.m_id = nodes.front().m_id, .m_cpus = {nodes.front().m_cpus.front()}}};
+    std::set<std::thread::id> threads;
+    std::mutex threads_mutex;
+    snark::numa_parallel_for(8, single_cpu, [&threads, &threads_mutex](size_t) {
+        std::lock_guard lock(threads_mutex);
+        threads.insert(std::this_thread::get_id());
+    });
+    EXPECT_EQ(threads.size(), 1);
+    EXPECT_THROW(snark::numa_parallel_for(3, nodes,
+                                          [](size_t index) {
+                                              if (index == 1)
+                                              {
+                                                  throw std::runtime_error("load failed");
+                                              }
+                                          }),
+                 std::runtime_error);
+
+    // Workers call init before any task.
+    std::atomic<size_t> initialized = 0;
+    std::atomic<size_t> seen = 0;
+    {
+        snark::ThreadPool pool(3, [&initialized]() { ++initialized; });
+        for (size_t i = 0; i < 10; ++i)
+        {
+            pool.Submit([&initialized, &seen]() { seen += initialized > 0; });
+        }
+    }
+    EXPECT_EQ(initialized, 2);
+    EXPECT_EQ(seen, 10);
+}
+
+TEST(GraphTest, ThreadPoolMatchesSequentialGraph)
+{
+    TestGraph::MemoryGraph m;
+    for (snark::NodeId node = 0; node < 300; ++node)
+    {
+        std::vector<TestGraph::NeighborRecord> neighbors;
+        for (snark::NodeId nb = 0; nb < node % 13; ++nb)
+        {
+            neighbors.emplace_back((node * 7 + nb * 3) % 300, snark::Type(nb % 2), float(nb % 5 + 1));
+        }
+        std::vector<std::vector<float>> features = {{float(node), float(-node)}};
+        m.m_nodes.push_back(TestGraph::Node{
+            .m_id = node, .m_type = 0, .m_weight = 1.0f, .m_float_features = features, .m_neighbors = neighbors});
+    }
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::Graph sequential(path.string(), {0}, snark::PartitionStorageType::memory, "");
+    snark::Graph parallel(path.string(), {0}, snark::PartitionStorageType::memory, "", {}, false, false,
+                          snark::ThreadPoolConfig{.m_thread_count = 4, .m_min_chunk_size = 8});
+
+    std::vector<snark::NodeId> nodes;
+    for (snark::NodeId node = 0; node < 500; ++node)
+    {
+        nodes.emplace_back((node * 37) % 350);
+    }
+    std::vector<snark::Type> types = {0, 1};
+
+    std::vector<snark::FeatureMeta> features = {{0, 2 * sizeof(float)}};
+    std::vector<uint8_t> sequential_features(nodes.size() * 2 * sizeof(float));
+    std::vector<uint8_t> parallel_features(sequential_features.size());
+    sequential.GetNodeFeature(std::span(nodes), std::span(features), std::span(sequential_features));
+    parallel.GetNodeFeature(std::span(nodes), std::span(features), std::span(parallel_features));
+    EXPECT_EQ(sequential_features, parallel_features);
+
+    std::vector<uint64_t> sequential_counts(nodes.size()), parallel_counts(nodes.size());
+    sequential.NeighborCount(std::span(nodes), std::span(types), std::span(sequential_counts));
+    parallel.NeighborCount(std::span(nodes), std::span(types), std::span(parallel_counts));
+    EXPECT_EQ(sequential_counts, parallel_counts);
+
+    std::vector<snark::NodeId> sequential_ids = {-1}, parallel_ids = {-1};
+    std::vector<snark::Type> sequential_types = {-1}, parallel_types = {-1};
+    std::vector<float> sequential_weights = {-1}, parallel_weights = {-1};
+    std::fill(std::begin(sequential_counts), std::end(sequential_counts), 0);
+    std::fill(std::begin(parallel_counts), std::end(parallel_counts), 0);
+    sequential.FullNeighbor(std::span(nodes), std::span(types), sequential_ids, sequential_types, sequential_weights,
+                            std::span(sequential_counts));
+    parallel.FullNeighbor(std::span(nodes), std::span(types), parallel_ids, parallel_types, parallel_weights,
+                          std::span(parallel_counts));
+    EXPECT_EQ(sequential_ids, parallel_ids);
+    EXPECT_EQ(sequential_types, parallel_types);
+    EXPECT_EQ(sequential_weights, parallel_weights);
+    EXPECT_EQ(sequential_counts, parallel_counts);
+
+    const size_t count = 5;
+    const auto sample = [&](const snark::Graph &g) {
+        std::vector<snark::NodeId> out_nodes(count * nodes.size());
+        std::vector<snark::Type> out_types(count * nodes.size());
+        std::vector<float> out_weights(count * nodes.size());
+        std::vector<float> total_weights(nodes.size());
+        g.SampleNeighbor(17, std::span(nodes), std::span(types), count, std::span(out_nodes), std::span(out_types),
+                         std::span(out_weights), std::span(total_weights), -1, 0, -1);
+        for (bool without_replacement : {false, true})
+        {
+            std::vector<snark::NodeId> uniform_nodes(count * nodes.size());
+            std::vector<snark::Type> uniform_types(count * nodes.size());
+            std::vector<uint64_t> total_counts(nodes.size());
+            g.UniformSampleNeighbor(without_replacement, 17, std::span(nodes), std::span(types), count,
+                                    std::span(uniform_nodes), std::span(uniform_types), std::span(total_counts), -1,
+                                    -1);
+            out_nodes.insert(std::end(out_nodes), std::begin(uniform_nodes), std::end(uniform_nodes));
+            out_types.insert(std::end(out_types), std::begin(uniform_types), std::end(uniform_types));
+        }
+        return std::make_tuple(out_nodes, out_types, out_weights, total_weights);
+    };
+    EXPECT_EQ(sample(sequential), sample(parallel));
+
+    const size_t walk_length = 4;
+    std::vector<snark::NodeId> sequential_walks(nodes.size() * (walk_length + 1));
+    std::vector<snark::NodeId> parallel_walks(sequential_walks.size());
+    sequential.RandomWalk(17, 2.0f, 0.5f, -1, std::span(nodes), std::span(types), walk_length,
+                          std::span(sequential_walks));
+    parallel.RandomWalk(17, 2.0f, 0.5f, -1, std::span(nodes), std::span(types), walk_length,
+                        std::span(parallel_walks));
+    EXPECT_EQ(sequential_walks, parallel_walks);
+}
+
+TEST(GraphTest, SampleSubgraphMultipleHops)
+{
+    TestGraph::MemoryGraph m;
+    for (snark::NodeId node = 0; node < 20; ++node)
+    {
+        std::vector<std::vector<float>> features = {{float(node), float(node + 1)}};
+        m.m_nodes.push_back(TestGraph::Node{.m_id = node,
+                                            .m_type = 0,
+                                            .m_weight = 1.0f,
+                                            .m_float_features = features,
+                                            .m_neighbors = {TestGraph::NeighborRecord{node + 1, 0, 1.0f},
+                                                            TestGraph::NeighborRecord{node + 2, 0, 1.0f},
+                                                            TestGraph::NeighborRecord{node + 10, 1, 1.0f}}});
+    }
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "");
+
+    std::vector<snark::NodeId> seeds = {3, 0, 3, 42};
+    std::vector<uint32_t> fanouts = {2, 2};
+    std::vector<snark::Type> types = {0};
+    std::vector<snark::FeatureMeta> features = {{0, 2 * sizeof(float)}};
+    snark::Subgraph subgraph;
+    g.SampleSubgraph(true, 13, std::span(seeds), std::span(fanouts), std::span(types), std::span(features),
+                     subgraph);
+
+    ASSERT_EQ(subgraph.m_nodes.size(), 9);
+    EXPECT_EQ(std::vector<snark::NodeId>(std::begin(subgraph.m_nodes), std::begin(subgraph.m_nodes) + 3),
+              std::vector<snark::NodeId>({3, 0, 42}));
+    std::map<snark::NodeId, uint32_t> hops;
+    for (size_t i = 0; i < subgraph.m_nodes.size(); ++i)
+    {
+        hops[subgraph.m_nodes[i]] = subgraph.m_hops[i];
+    }
+    EXPECT_EQ(hops, (std::map<snark::NodeId, uint32_t>{
+                        {0, 0}, {1, 1}, {2, 1}, {3, 0}, {4, 1}, {5, 1}, {6, 2}, {7, 2}, {42, 0}}));
+
+    std::set<std::pair<snark::NodeId, snark::NodeId>> edges;
+    for (size_t i = 0; i < subgraph.m_edge_src.size(); ++i)
+    {
+        EXPECT_EQ(subgraph.m_edge_types[i], 0);
+        edges.emplace(subgraph.m_nodes[subgraph.m_edge_src[i]], subgraph.m_nodes[subgraph.m_edge_dst[i]]);
+    }
+    EXPECT_EQ(subgraph.m_edge_src.size(), 12);
+    const std::set<std::pair<snark::NodeId, snark::NodeId>> expected_edges = {
+        {3, 4}, {3, 5}, {0, 1}, {0, 2}, {4, 5}, {4, 6}, {5, 6}, {5, 7}, {1, 2}, {1, 3}, {2, 3}, {2, 4}};
+    EXPECT_EQ(edges, expected_edges);
+
+    ASSERT_EQ(subgraph.m_features.size(), subgraph.m_nodes.size() * 2 * sizeof(float));
+    std::span values(reinterpret_cast<const float *>(subgraph.m_features.data()), 2 * subgraph.m_nodes.size());
+    for (size_t i = 0; i < subgraph.m_nodes.size(); ++i)
+    {
+        const auto node = subgraph.m_nodes[i];
+        const float expected = node < 20 ? float(node) : 0;
+        EXPECT_EQ(values[2 * i], expected);
+        EXPECT_EQ(values[2 * i + 1], node < 20 ? expected + 1 : 0);
+    }
+}
+
+TEST(GraphTest, RandomWalkFollowsEdges)
+{
+    TestGraph::MemoryGraph m;
+    for (snark::NodeId node = 0; node < 20; ++node)
+    {
+        m.m_nodes.push_back(TestGraph::Node{.m_id = node,
+                                            .m_type = 0,
+                                            .m_weight = 1.0f,
+                                            .m_neighbors = {TestGraph::NeighborRecord{node + 1, 0, 1.0f},
+                                                            TestGraph::NeighborRecord{node + 2, 0, 2.0f},
+                                                            TestGraph::NeighborRecord{node + 10, 1, 1.0f}}});
+    }
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "");
+
+    std::vector<snark::NodeId> nodes = {0, 5, 17, 42};
+    std::vector<snark::Type> types = {0};
+    const size_t walk_length = 4;
+    std::vector<snark::NodeId> walks(nodes.size() * (walk_length + 1));
+    g.RandomWalk(7, 2.0f, 0.5f, -1, std::span(nodes), std::span(types), walk_length, std::span(walks));
+    for (size_t walk = 0; walk < nodes.size(); ++walk)
+    {
+        const auto *nodes_path = walks.data() + walk * (walk_length + 1);
+        EXPECT_EQ(nodes_path[0], nodes[walk]);
+        for (size_t step = 1; step <= walk_length; ++step)
+        {
+            // Walks stop after nodes missing in the graph.
+            if (nodes_path[step - 1] >= 20 || nodes_path[step - 1] == -1)
+            {
+                EXPECT_EQ(nodes_path[step], -1);
+                continue;
+            }
+
+            const auto delta = nodes_path[step] - nodes_path[step - 1];
+            EXPECT_TRUE(delta == 1 || delta == 2);
+        }
+    }
+    EXPECT_EQ(std::vector<snark::NodeId>(std::begin(walks) + 3 * (walk_length + 1), std::end(walks)),
+              std::vector<snark::NodeId>({42, -1, -1, -1, -1}));
+
+    std::vector<snark::NodeId> same_seed_walks(walks.size());
+    g.RandomWalk(7, 2.0f, 0.5f, -1, std::span(nodes), std::span(types), walk_length, std::span(same_seed_walks));
+    EXPECT_EQ(walks, same_seed_walks);
+
+    std::vector<snark::NodeId> short_walks(nodes.size());
+    g.RandomWalk(7, 2.0f, 0.5f, -1, std::span(nodes), std::span(types), 0, std::span(short_walks));
+    EXPECT_EQ(short_walks, nodes);
+}
+
+TEST(GraphTest, NegativeSampleSkipsNeighbors)
+{
+    TestGraph::MemoryGraph m;
+    for (snark::NodeId node = 0; node < 20; ++node)
+    {
+        m.m_nodes.push_back(TestGraph::Node{.m_id = node,
+                                            .m_type = 0,
+                                            .m_weight = 1.0f,
+                                            .m_neighbors = {TestGraph::NeighborRecord{node + 1, 0, 1.0f},
+                                                            TestGraph::NeighborRecord{node + 2, 0, 2.0f},
+                                                            TestGraph::NeighborRecord{node + 10, 1, 1.0f}}});
+    }
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "");
+
+    std::vector<snark::NodeId> nodes = {0, 5, 42};
+    const size_t count = 50;
+    for (auto types : {std::vector<snark::Type>{0}, std::vector<snark::Type>{1, 0}})
+    {
+        std::vector<snark::NodeId> negatives(nodes.size() * count);
+        g.NegativeSample(11, -1, std::span(nodes), std::span(types), count, std::span(negatives));
+        std::set<snark::NodeId> seen;
+        for (size_t index = 0; index < negatives.size(); ++index)
+        {
+            const auto source = nodes[index / count];
+            const auto negative = negatives[index];
+            EXPECT_NE(negative, source);
+            EXPECT_GE(negative, 0);
+            EXPECT_LT(negative, 20);
+            if (source < 20)
+            {
+                EXPECT_NE(negative, source + 1);
+                EXPECT_NE(negative, source + 2);
+                if (types.size() > 1)
+                {
+                    EXPECT_NE(negative, source + 10);
+                }
+            }
+            seen.emplace(negative);
+        }
+        EXPECT_GT(seen.size(), 15);
+
+        std::vector<snark::NodeId> same_seed_negatives(negatives.size());
+        g.NegativeSample(11, -1, std::span(nodes), std::span(types), count, std::span(same_seed_negatives));
+        EXPECT_EQ(negatives, same_seed_negatives);
+    }
+}
+
+TEST(GraphTest, NegativeSampleDenseNeighborhoods)
+{
+    // Node 0 is connected to every other node, node 1 only to node 2.
+    TestGraph::MemoryGraph m;
+    m.m_nodes.push_back(TestGraph::Node{
+        .m_id = 0,
+        .m_type = 0,
+        .m_weight = 1.0f,
+        .m_neighbors = {TestGraph::NeighborRecord{1, 0, 1.0f}, TestGraph::NeighborRecord{2, 0, 1.0f}}});
+    m.m_nodes.push_back(TestGraph::Node{
+        .m_id = 1, .m_type = 0, .m_weight = 1.0f, .m_neighbors = {TestGraph::NeighborRecord{2, 0, 1.0f}}});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 2, .m_type = 0, .m_weight = 1.0f});
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "");
+
+    std::vector<snark::Type> types = {0};
+    std::vector<snark::NodeId> nodes = {0, 1};
+    std::vector<snark::NodeId> negatives(nodes.size() * 5);
+    g.NegativeSample(3, -1, std::span(nodes), std::span(types), 5, std::span(negatives));
+    EXPECT_EQ(negatives, std::vector<snark::NodeId>({-1, -1, -1, -1, -1, 0, 0, 0, 0, 0}));
+}
+
+TEST(GraphTest, RandomWalkStatisticalProperties)
+{
+    // Undirected graph 0 - 1, 0 - 2, 1 - 2, 1 - 3 with weight 2 for 1 - 3.
+    TestGraph::MemoryGraph m;
+    m.m_nodes.push_back(TestGraph::Node{
+        .m_id = 0,
+        .m_type = 0,
+        .m_weight = 1.0f,
+        .m_neighbors = {TestGraph::NeighborRecord{1, 0, 1.0f}, TestGraph::NeighborRecord{2, 0, 1.0f}}});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 1,
+                                        .m_type = 0,
+                                        .m_weight = 1.0f,
+                                        .m_neighbors = {TestGraph::NeighborRecord{0, 0, 1.0f},
+                                                        TestGraph::NeighborRecord{2, 0, 1.0f},
+                                                        TestGraph::NeighborRecord{3, 0, 2.0f}}});
+    m.m_nodes.push_back(TestGraph::Node{
+        .m_id = 2,
+        .m_type = 0,
+        .m_weight = 1.0f,
+        .m_neighbors = {TestGraph::NeighborRecord{0, 0, 1.0f}, TestGraph::NeighborRecord{1, 0, 1.0f}}});
+    m.m_nodes.push_back(TestGraph::Node{
+        .m_id = 3, .m_type = 0, .m_weight = 1.0f, .m_neighbors = {TestGraph::NeighborRecord{1, 0, 2.0f}}});
+    auto path = std::filesystem::temp_directory_path();
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+    snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "");
+
+    const size_t walk_count = 20000;
+    std::vector<snark::NodeId> nodes(walk_count, 0);
+    std::vector<snark::Type> types = {0};
+    std::vector<snark::NodeId> walks(3 * walk_count);
+    g.RandomWalk(23, 2.0f, 0.5f, -1, std::span(nodes), std::span(types), 2, std::span(walks));
+    std::map<std::pair<snark::NodeId, snark::NodeId>, size_t> counts;
+    for (size_t walk = 0; walk < walk_count; ++walk)
+    {
+        ++counts[{walks[3 * walk + 1], walks[3 * walk + 2]}];
+    }
+
+    // Unnormalized probabilities are w/p to return to 0, w for neighbors of 0 and w/q otherwise.
+    const std::map<std::pair<snark::NodeId, snark::NodeId>, double> expected = {
+        {{1, 0}, 0.5 * 0.5 / 5.5}, {{1, 2}, 0.5 * 1.0 / 5.5}, {{1, 3}, 0.5 * 4.0 / 5.5},
+        {{2, 0}, 0.5 * 0.5 / 1.5}, {{2, 1}, 0.5 * 1.0 / 1.5}};
+    EXPECT_EQ(counts.size(), expected.size());
+    for (const auto &[edge, probability] : expected)
+    {
+        EXPECT_NEAR(double(counts[edge]) / walk_count, probability, 0.015);
+    }
+}
+
 TEST(GraphTest, GetNeigborCountSinglePartition)
 {
     TestGraph::MemoryGraph m1;
@@ -1405,4 +2683,88 @@ TEST(GraphTest, GetNeigborCountMultiplePartitions)
 }
 
 INSTANTIATE_TEST_SUITE_P(StorageTypeGroup, StorageTypeGraphTest,
-                         testing::Values(snark::PartitionStorageType::memory, snark::PartitionStorageType::disk));
+                         testing::Values(snark::PartitionStorageType::memory, snark::PartitionStorageType::disk,
+                                         snark::PartitionStorageType::mmap));
+
+TEST(GraphTest, ReorderPartitionKeepsGraphAndImprovesLocality)
+{
+    // Ring of nodes in shuffled input order, node 0 has extra edges across the ring and to a node outside of the
+    // partition.
+    const snark::NodeId count = 64;
+    std::vector<snark::NodeId> input_order(count);
+    std::iota(std::begin(input_order), std::end(input_order), 0);
+    snark::Xoroshiro128PlusGenerator gen(7);
+    std::shuffle(std::begin(input_order), std::end(input_order), gen);
+    TestGraph::MemoryGraph m;
+    for (auto id : input_order)
+    {
+        std::vector<snark::NodeId> neighbors = {(id + 1) % count, (id + count - 1) % count};
+        if (id == 0)
+        {
+            neighbors.insert(std::end(neighbors), {16, 32, 1000});
+        }
+        std::sort(std::begin(neighbors), std::end(neighbors));
+        TestGraph::Node node{.m_id = id, .m_type = 0, .m_weight = 1.0f, .m_float_features = {{float(id), -float(id)}}};
+        for (auto neighbor : neighbors)
+        {
+            node.m_neighbors.emplace_back(neighbor, 0, float(neighbor + 1));
+            node.m_edge_features.push_back({{float(id * 10000 + neighbor)}});
+        }
+        m.m_nodes.emplace_back(std::move(node));
+    }
+
+    auto path = std::filesystem::temp_directory_path() / "reorder_partition";
+    std::filesystem::create_directories(path);
+    TestGraph::convert(path, "0_0", std::move(m), 1);
+
+    auto query = [&path, count]() {
+        snark::Graph g(path.string(), {0}, snark::PartitionStorageType::memory, "");
+        std::vector<snark::NodeId> ids(count);
+        std::iota(std::begin(ids), std::end(ids), 0);
+        std::vector<snark::FeatureMeta> node_features = {{0, 2 * sizeof(float)}};
+        std::vector<float> features(2 * count);
+        g.GetNodeFeature(ids, node_features,
+                         std::span(reinterpret_cast<uint8_t *>(features.data()), features.size() * sizeof(float)));
+
+        std::vector<snark::Type> edge_types = {0};
+        std::vector<snark::NodeId> neighbors;
+        std::vector<snark::Type> neighbor_types;
+        std::vector<float> weights;
+        std::vector<uint64_t> counts(count);
+        g.FullNeighbor(ids, edge_types, neighbors, neighbor_types, weights, counts);
+
+        std::vector<snark::NodeId> sources;
+        for (snark::NodeId id = 0; id < count; ++id)
+        {
+            sources.insert(std::end(sources), counts[id], id);
+        }
+        std::vector<snark::FeatureMeta> edge_features = {{0, sizeof(float)}};
+        std::vector<float> edge_values(neighbors.size());
+        auto edge_output =
+            std::span(reinterpret_cast<uint8_t *>(edge_values.data()), edge_values.size() * sizeof(float));
+        g.GetEdgeFeature(sources, neighbors, neighbor_types, edge_features, edge_output);
+        return std::make_tuple(features, neighbors, weights, counts, edge_values);
+    };
+
+    const auto expected = query();
+    EXPECT_EQ(1000, std::get<1>(expected)[4]);
+    EXPECT_EQ(10000.0f, std::get<4>(expected)[5]);
+
+    const auto rcm = snark::ReorderPartition(path, "0_0", snark::NodeOrder::rcm);
+    EXPECT_EQ(2 * count + 2, rcm.m_local_edges);
+    EXPECT_GT(rcm.m_gap_before, 4 * rcm.m_gap_after);
+    EXPECT_EQ(expected, query());
+
+    // Node 0 has the most edges inside the partition and goes first.
+    const auto degree = snark::ReorderPartition(path, "0_0", snark::NodeOrder::degree);
+    EXPECT_DOUBLE_EQ(rcm.m_gap_after, degree.m_gap_before);
+    EXPECT_EQ(expected, query());
+    {
+        std::ifstream node_map(path / "node_0_0.map", std::ios_base::binary);
+        snark::NodeId first;
+        node_map.read(reinterpret_cast<char *>(&first), sizeof(first));
+        EXPECT_EQ(0, first);
+    }
+
+    std::filesystem::remove_all(path);
+}
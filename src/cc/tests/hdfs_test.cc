@@ -3,10 +3,13 @@
 
 #include "include/hdfs.h"
 #include "src/cc/lib/graph/graph.h"
+#include "src/cc/lib/graph/hdfs_wrap.h"
 #include "src/cc/lib/graph/partition.h"
 #include "src/cc/lib/graph/sampler.h"
 #include "src/cc/tests/mocks.h"
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
 #include <filesystem>
 #include <sstream>
@@ -213,3 +216,80 @@ TEST(HDFSTest, IsHDFSTest)
     EXPECT_EQ(is_hdfs_path("/path/to"), false);
     EXPECT_EQ(is_hdfs_path("path/to"), false);
 }
+
+TEST(HDFSTest, NodeFeatureSmallParallelRanges)
+{
+    auto temp_path = std::filesystem::temp_directory_path() / "hdfs_test_temp";
+    std::string config_path = "src/cc/tests/core-site.xml";
+    std::filesystem::create_directory(temp_path);
+    TestGraph::MemoryGraph m;
+    std::vector<std::vector<float>> f1 = {std::vector<float>{1.0f, 2.0f, 3.0f}};
+    std::vector<std::vector<float>> f2 = {std::vector<float>{5.0f, 6.0f, 7.0f}};
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 0, .m_type = 0, .m_weight = 1.0f, .m_float_features = f1});
+    m.m_nodes.push_back(TestGraph::Node{.m_id = 1, .m_type = 1, .m_weight = 1.0f, .m_float_features = f2});
+    TestGraph::convert(temp_path, "0_0", std::move(m), 3);
+
+    std::filesystem::path hdfs_path = std::string("file://") + temp_path.string();
+    set_hdfs_env(temp_path, config_path);
+
+    // Ranges are smaller than records, so every file is read in many concurrent ranges.
+    snark::Graph g(hdfs_path.string(), std::vector<uint32_t>{0}, snark::PartitionStorageType::memory, config_path,
+                   {}, false, false, {}, 0, {}, {}, 0, HDFSReadOptions{.m_buffer_size = 5, .m_parallelism = 3});
+
+    std::vector<snark::NodeId> nodes = {0, 1};
+    std::vector<uint8_t> output(4 * 3 * 2);
+    std::vector<snark::FeatureMeta> features = {{0, 12}};
+    g.GetNodeFeature(std::span(nodes), std::span(features), std::span(output));
+    std::span res(reinterpret_cast<float *>(output.data()), output.size() / sizeof(float));
+    EXPECT_EQ(std::vector<float>(std::begin(res), std::end(res)), std::vector<float>({1, 2, 3, 5, 6, 7}));
+}
+
+TEST(HDFSTest, RangeReaderMatchesFile)
+{
+    std::vector<char> file(1000);
+    for (size_t i = 0; i < file.size(); ++i)
+    {
+        file[i] = char(i % 251);
+    }
+    std::atomic<size_t> fetches = 0;
+    auto fetch = [&file, &fetches](int64_t offset, int64_t size, void *output) {
+        ASSERT_LE(offset + size, file.size());
+        std::copy_n(std::begin(file) + offset, size, static_cast<char *>(output));
+        ++fetches;
+    };
+
+    for (int64_t buffer_size : {1, 7, 64, 1000, 4096})
+    {
+        SCOPED_TRACE(buffer_size);
+        HDFSRangeReader reader(file.size(), HDFSReadOptions{.m_buffer_size = buffer_size, .m_parallelism = 4}, fetch);
+        std::vector<char> all(file.size());
+        fetches = 0;
+        reader.read_all(all.data());
+        EXPECT_EQ(file, all);
+        EXPECT_EQ(fetches, (file.size() + buffer_size - 1) / buffer_size);
+
+        // Sequential reads of different sizes cross range boundaries.
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            reader.rewind();
+            std::vector<char> streamed;
+            for (size_t size = 1;; ++size)
+            {
+                std::vector<char> chunk(size);
+                if (!reader.read(size, chunk.data()))
+                {
+                    break;
+                }
+                streamed.insert(std::end(streamed), std::begin(chunk), std::end(chunk));
+            }
+
+            ASSERT_LT(file.size() - streamed.size(), 45);
+            std::vector<char> tail(file.size() - streamed.size());
+            EXPECT_TRUE(reader.read(tail.size(), tail.data()));
+            streamed.insert(std::end(streamed), std::begin(tail), std::end(tail));
+            EXPECT_EQ(file, streamed);
+            char extra;
+            EXPECT_FALSE(reader.read(1, &extra));
+        }
+    }
+}
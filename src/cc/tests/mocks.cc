@@ -62,7 +62,7 @@ snark::Partition convert(std::filesystem::path path, std::string suffix, MemoryG
             auto &e = edge_index[edge_pos];
             auto dst = std::get<0>(e);
             edge_index_out.write(reinterpret_cast<const char *>(&dst), sizeof(snark::NodeId));
-            uint64_t feature_offset = edge_feature_index_out.tellp();
+            uint64_t feature_offset = uint64_t(edge_feature_index_out.tellp()) / sizeof(uint64_t);
             edge_index_out.write(reinterpret_cast<const char *>(&feature_offset), sizeof(uint64_t));
             for (size_t feature_pos = 0; !edge_features.empty() && feature_pos < edge_features[edge_pos].size();
                  ++feature_pos)
@@ -80,10 +80,11 @@ snark::Partition convert(std::filesystem::path path, std::string suffix, MemoryG
         int64_t dst = -1;
         edge_index_out.write(reinterpret_cast<const char *>(&dst), sizeof(snark::NodeId));
 
+        // Last edge record points to the closing entry of the feature index, like in the python converter.
+        uint64_t feature_index_offset = uint64_t(edge_feature_index_out.tellp()) / sizeof(uint64_t);
+        edge_index_out.write(reinterpret_cast<const char *>(&feature_index_offset), sizeof(uint64_t));
         uint64_t feature_data_offset = edge_feature_data_out.tellp();
         edge_feature_index_out.write(reinterpret_cast<const char *>(&feature_data_offset), sizeof(uint64_t));
-        uint64_t feature_index_offset = edge_feature_index_out.tellp();
-        edge_index_out.write(reinterpret_cast<const char *>(&feature_index_offset), sizeof(uint64_t));
         int32_t type = -1;
         edge_index_out.write(reinterpret_cast<const char *>(&type), sizeof(snark::Type));
         float weight = 1;
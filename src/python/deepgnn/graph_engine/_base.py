@@ -121,6 +121,24 @@ class Graph:
         """
         raise NotImplementedError
 
+    def negative_sample(
+        self,
+        node_ids: np.ndarray,
+        edge_types: Union[int, np.ndarray],
+        count: int,
+        default_node: int = -1,
+    ) -> np.ndarray:
+        """
+        Sample negatives for link prediction drawn uniformly from nodes of the graph.
+
+        node_ids -- source nodes
+        edge_types -- types of edges connecting sources to nodes that can't be negatives
+        count -- number of negatives per source node
+        default_node -- default node id for negatives not found within a bounded number of draws
+        Returns negatives with the shape [len(node_ids), count]
+        """
+        raise NotImplementedError
+
     def neighbors(
         self, nodes: np.ndarray, edge_types: Union[int, np.ndarray]
     ) -> Tuple[np.ndarray, np.ndarray, np.ndarray, np.ndarray]:
@@ -2,6 +2,8 @@
 # Licensed under the MIT License.
 
 """Clients to work with a graph in local and distributed mode."""
+from collections import deque
+import copy
 from datetime import datetime
 import random
 import os
@@ -21,8 +23,19 @@ from ctypes import (
     c_uint8,
     c_size_t,
     c_uint32,
+    sizeof,
+)
+from typing import (
+    Any,
+    Callable,
+    Deque,
+    Iterable,
+    Iterator,
+    List,
+    Tuple,
+    Union,
+    Optional,
 )
-from typing import Any, List, Tuple, Union, Optional
 from enum import IntEnum
 
 import numpy as np
@@ -36,6 +49,41 @@ class _DEEP_GRAPH(Structure):
     _fields_: List[Any] = []
 
 
+# Options structs match PyGraphOptions and PyClientOptions in py_graph.h, new fields are only appended.
+class _GRAPH_OPTIONS(Structure):
+    _fields_: List[Any] = [
+        ("size", c_size_t),
+        ("feature_cache_size", c_size_t),
+        ("warm_feature_cache", c_bool),
+        ("compact_node_index", c_bool),
+        ("compressed_edges", c_bool),
+        ("thread_count", c_size_t),
+        ("min_chunk_size", c_size_t),
+        ("alias_threshold", c_size_t),
+        ("columnar_features", POINTER(c_int32)),
+        ("columnar_feature_count", c_size_t),
+        ("shared_index", c_char_p),
+        ("edge_index_threshold", c_size_t),
+        ("hdfs_buffer_size", c_size_t),
+        ("hdfs_read_threads", c_size_t),
+    ]
+
+
+class _CLIENT_OPTIONS(Structure):
+    _fields_: List[Any] = [
+        ("size", c_size_t),
+        ("route_nodes", c_bool),
+        ("deadline_ms", c_size_t),
+        ("hedge_delay_us", c_size_t),
+        ("shard_replicas", POINTER(c_size_t)),
+        ("shard_count", c_size_t),
+        ("coalesce_window_us", c_size_t),
+        ("coalesce_max_nodes", c_size_t),
+        ("compress_sparse_features", c_bool),
+        ("feature_cache_size", c_size_t),
+    ]
+
+
 class _ErrCallback:
     def __init__(self, method: str):
         self.method = method
@@ -52,6 +100,7 @@ class PartitionStorageType(IntEnum):
 
     memory = 0
     disk = 1
+    mmap = 2
 
 
 # Define our own classes to copy data from C to Python runtime.
@@ -75,6 +124,65 @@ _NEIGHBORS_CALLBACKFUNC = CFUNCTYPE(
 )
 
 
+class _SubgraphCallback:
+    def __init__(self, dtype, feature_len):
+        self.dtype = dtype
+        self.feature_len = feature_len
+        self.node_ids = np.empty(0, dtype=np.int64)
+        self.hops = np.empty(0, dtype=np.uint32)
+        self.edges = np.empty((0, 2), dtype=np.uint64)
+        self.edge_types = np.empty(0, dtype=np.int32)
+        self.features = np.empty((0, feature_len), dtype=dtype)
+
+    def __call__(
+        self,
+        nodes,
+        hops,
+        node_count,
+        edge_src,
+        edge_dst,
+        edge_types,
+        edge_count,
+        features,
+        features_size,
+    ):
+        if node_count == 0:
+            return
+
+        self.node_ids = np.copy(np.ctypeslib.as_array(nodes, [node_count]))
+        self.hops = np.copy(np.ctypeslib.as_array(hops, [node_count]))
+        if edge_count > 0:
+            self.edges = np.stack(
+                [
+                    np.ctypeslib.as_array(edge_src, [edge_count]),
+                    np.ctypeslib.as_array(edge_dst, [edge_count]),
+                ],
+                axis=1,
+            )
+            self.edge_types = np.copy(np.ctypeslib.as_array(edge_types, [edge_count]))
+        if features_size > 0:
+            self.features = (
+                np.ctypeslib.as_array(features, [features_size])
+                .view(self.dtype)
+                .reshape((node_count, self.feature_len))
+                .copy()
+            )
+
+
+_SUBGRAPH_CALLBACKFUNC = CFUNCTYPE(
+    None,
+    POINTER(c_int64),
+    POINTER(c_uint32),
+    c_size_t,
+    POINTER(c_uint64),
+    POINTER(c_uint64),
+    POINTER(c_int32),
+    c_size_t,
+    POINTER(c_uint8),
+    c_size_t,
+)
+
+
 class _SparseFeatureCallback:
     def __init__(self, dtype, feature_len):
         self.indices = []
@@ -142,9 +250,183 @@ def _make_sorted_list(input: Union[int, List[int]]) -> List[int]:
     return sorted(list(set(input)))
 
 
+class AsyncRequest:
+    """Graph query running on a background thread, created with submit."""
+
+    def __init__(self, lib, func, args: Tuple):
+        """Queue a call of an asynchronous C function."""
+        self.lib = lib
+        self.request_ = _DEEP_GRAPH()
+        # Buffers passed to the C function must stay alive until the request finishes.
+        self._args = args
+        self._result: Any = None
+        func(*args, byref(self.request_))
+        self._status: Optional[int] = None
+
+    def done(self) -> bool:
+        """Check if the request is finished without blocking."""
+        if self._status is not None:
+            return True
+        done = c_bool(False)
+        self.lib.PollRequest(self.request_, byref(done))
+        return done.value
+
+    def wait(self) -> Any:
+        """Block until the request is finished.
+
+        Returns:
+            Output of the method passed to submit.
+        """
+        if self._status is None:
+            self._status = self.lib.WaitRequest(self.request_)
+            self._release()
+        if self._status != 0:
+            raise Exception("Failed to finish asynchronous request")
+        return self._result
+
+    def cancel(self) -> bool:
+        """Drop the request if it hasn't started yet or cancel its calls to servers, otherwise wait for it to finish.
+
+        Returns:
+            bool: True if the request didn't finish and outputs may be incomplete.
+        """
+        if self._status is not None:
+            return False
+        cancelled = c_bool(False)
+        self.lib.CancelRequest(self.request_, byref(cancelled))
+        self._status = 1 if cancelled.value else self.lib.WaitRequest(self.request_)
+        self._release()
+        return cancelled.value
+
+    def _release(self):
+        self.lib.ResetRequest(self.request_)
+        self._args = None
+
+    def __del__(self):
+        """Make sure the request doesn't write to released buffers."""
+        if getattr(self, "_status", 0) is None:
+            self.cancel()
+
+
+class _AsyncLib:
+    """Replace C calls of graph and sampler methods with their asynchronous variants."""
+
+    def __init__(self, lib):
+        self.lib = lib
+        self.request: Optional[AsyncRequest] = None
+
+    def __getattr__(self, name: str):
+        if not hasattr(self.lib, name + "Async"):
+            raise ValueError(f"{name} can't be called asynchronously")
+        func = getattr(self.lib, name + "Async")
+        if func.argtypes is None:
+            func.argtypes = list(getattr(self.lib, name).argtypes) + [
+                POINTER(_DEEP_GRAPH)
+            ]
+            func.restype = c_int32
+            func.errcheck = _ErrCallback(f"queue {name}")  # type: ignore
+
+        def call(*args):
+            assert self.request is None, "Only one C function can be called"
+            self.request = AsyncRequest(self.lib, func, args)
+            return 0
+
+        return call
+
+
+_REQUEST_FUNCTIONS_DESCRIBED = False
+
+
+def _describe_request_functions(lib):
+    global _REQUEST_FUNCTIONS_DESCRIBED
+    if _REQUEST_FUNCTIONS_DESCRIBED:
+        return
+    lib.PollRequest.argtypes = [POINTER(_DEEP_GRAPH), POINTER(c_bool)]
+    lib.PollRequest.restype = c_int32
+    lib.PollRequest.errcheck = _ErrCallback("poll request")  # type: ignore
+    lib.WaitRequest.argtypes = [POINTER(_DEEP_GRAPH)]
+    lib.WaitRequest.restype = c_int32
+    lib.CancelRequest.argtypes = [POINTER(_DEEP_GRAPH), POINTER(c_bool)]
+    lib.CancelRequest.restype = c_int32
+    lib.CancelRequest.errcheck = _ErrCallback("cancel request")  # type: ignore
+    lib.ResetRequest.argtypes = [POINTER(_DEEP_GRAPH)]
+    lib.ResetRequest.restype = c_int32
+    lib.ResetRequest.errcheck = _ErrCallback("reset request")  # type: ignore
+    _REQUEST_FUNCTIONS_DESCRIBED = True
+
+
+def submit(method: Callable, *args, **kwargs) -> AsyncRequest:
+    """Run a graph or sampler query on a background thread without blocking the caller.
+
+    Args:
+        method (Callable): MemoryGraph, DistributedGraph, NodeSampler or EdgeSampler method returning dense arrays:
+            node_types, node_features, edge_features, neighbor_counts, weighted_sample_neighbors,
+            uniform_sample_neighbors, random_walk, negative_sample or sample, e.g. graph.node_features.
+        args, kwargs: arguments of the method.
+
+    Returns:
+        AsyncRequest: request returning the output of the method from wait.
+    """
+    owner = method.__self__  # type: ignore
+    view = copy.copy(owner)
+    view.lib = _AsyncLib(owner.lib)
+    result = getattr(view, method.__name__)(*args, **kwargs)
+    request = view.lib.request
+    assert request is not None, f"{method.__name__} doesn't call the graph"
+    request._result = result
+    return request
+
+
+def _map_requests(requests: Any, func: Callable) -> Any:
+    if isinstance(requests, AsyncRequest):
+        return func(requests)
+    if isinstance(requests, dict):
+        return {key: _map_requests(value, func) for key, value in requests.items()}
+    if isinstance(requests, (list, tuple)):
+        return type(requests)(_map_requests(value, func) for value in requests)
+    return requests
+
+
+def prefetch(
+    batches: Iterable[Any], query: Callable[[Any], Any], depth: int = 2
+) -> Iterator[Tuple[Any, Any]]:
+    """Queue graph queries of upcoming batches while the current batch is processed.
+
+    Args:
+        batches (Iterable[Any]): inputs of queries, e.g. arrays of node ids.
+        query (Callable[[Any], Any]): function creating requests for a batch with submit, it can return a request or
+            a tuple, list or dict of them.
+        depth (int, default=2): number of batches with queued requests ahead of the one yielded.
+
+    Yields:
+        Tuple[Any, Any]: a batch and outputs of its requests in the same structure as returned by query.
+    """
+    pending: Deque[Tuple[Any, Any]] = deque()
+    try:
+        for batch in batches:
+            pending.append((batch, query(batch)))
+            if len(pending) > depth:
+                batch, requests = pending.popleft()
+                yield batch, _map_requests(requests, AsyncRequest.wait)
+        while pending:
+            batch, requests = pending.popleft()
+            yield batch, _map_requests(requests, AsyncRequest.wait)
+    finally:
+        # Consumers might stop early, queued requests are dropped then.
+        for _, requests in pending:
+            _map_requests(requests, AsyncRequest.cancel)
+
+
+# Encodings of float32 dense features sent by servers, values match snark.FeatureEncoding.
+_FEATURE_ENCODINGS = {"raw": 0, "float16": 1, "bfloat16": 2, "int8": 3}
+
+
 class MemoryGraph:
     """Graph stored fully in memory."""
 
+    # Local graphs always read raw feature values.
+    _float_encoding = 0
+
     def __init__(
         self,
         path: str,
@@ -152,6 +434,18 @@ class MemoryGraph:
         storage_type: PartitionStorageType = PartitionStorageType.memory,
         config_path: str = "",
         stream: bool = False,
+        feature_cache_size: int = 0,
+        warm_feature_cache: bool = False,
+        compact_node_index: bool = False,
+        compressed_edges: bool = False,
+        thread_count: int = 1,
+        min_chunk_size: int = 1024,
+        alias_threshold: int = 0,
+        columnar_features: List[int] = None,
+        shared_index: str = "",
+        edge_index_threshold: int = 0,
+        hdfs_buffer_size: int = 4 << 20,
+        hdfs_read_threads: int = 4,
     ):
         """Load graph to memory.
 
@@ -164,6 +458,18 @@ class MemoryGraph:
             config_path (str, optional): Path to folder with configuration files.
             stream (bool, default=False): If remote path is given: by default, download files first then load,
                 if stream = True and libhdfs present, stream data directly to memory -- see docs/advanced/hdfs.md for setup and usage.
+            feature_cache_size (int, default=0): Memory budget in bytes to cache features read from disk storage, 0 disables cache.
+            warm_feature_cache (bool, default=False): Fill feature cache with nodes with highest sampling weights during loading.
+            compact_node_index (bool, default=False): Use sorted node index with less memory and slower lookups instead of hash map.
+            compressed_edges (bool, default=False): Keep edge destinations and weights compressed in memory, reduces memory at the cost of slower neighbor lookups.
+            thread_count (int, default=1): Number of threads to split large batches of nodes between, results are the same for any number of threads.
+            min_chunk_size (int, default=1024): Minimum number of nodes processed by a thread at once.
+            alias_threshold (int, default=0): Sample weighted neighbors of nodes with at least this many edges of a type with alias tables, uses more memory for faster sampling. 0 disables alias tables.
+            columnar_features (List[int], optional): Dense node feature ids to copy into per feature arrays at load time, speeds up gathers of a few features out of many at the cost of memory for every node.
+            shared_index (str, optional): Directory to share node index and edge lists built at load time with other processes on the host, e.g. under /dev/shm. The first process publishes them and the others map them read only. Shared graphs use compact node index, compressed edges and HDFS graphs are not shared.
+            edge_index_threshold (int, default=0): Find edges of nodes with at least this many edges of a type in hash tables of destinations, uses more memory for faster edge feature lookups of hub nodes. 0 disables edge indexes.
+            hdfs_buffer_size (int, default=4194304): Size of ranges in bytes read concurrently from HDFS files.
+            hdfs_read_threads (int, default=4): Number of ranges read concurrently and kept in memory for every streamed HDFS file, partition files are loaded concurrently.
         """
         self.seed = datetime.now()
         self.path = GraphPath(path) if stream else download_graph_data(path, partitions)
@@ -179,6 +485,7 @@ class MemoryGraph:
             c_char_p,
             c_int32,
             c_char_p,
+            POINTER(_GRAPH_OPTIONS),
         ]
 
         self.lib.CreateLocalGraph.errcheck = _ErrCallback(  # type: ignore
@@ -186,6 +493,25 @@ class MemoryGraph:
         )
         PartitionArray = c_uint32 * len(partitions)
         partitions_array = PartitionArray(*partitions)
+        columnar_features = columnar_features or []
+        ColumnarFeatures = c_int32 * len(columnar_features)
+        columnar_features_array = ColumnarFeatures(*columnar_features)
+        options = _GRAPH_OPTIONS(
+            size=sizeof(_GRAPH_OPTIONS),
+            feature_cache_size=feature_cache_size,
+            warm_feature_cache=warm_feature_cache,
+            compact_node_index=compact_node_index,
+            compressed_edges=compressed_edges,
+            thread_count=thread_count,
+            min_chunk_size=min_chunk_size,
+            alias_threshold=alias_threshold,
+            columnar_features=columnar_features_array,
+            columnar_feature_count=len(columnar_features),
+            shared_index=bytes(shared_index, "utf-8"),
+            edge_index_threshold=edge_index_threshold,
+            hdfs_buffer_size=hdfs_buffer_size,
+            hdfs_read_threads=hdfs_read_threads,
+        )
         self.lib.CreateLocalGraph(
             byref(self.g_),
             c_size_t(len(partitions)),
@@ -193,6 +519,7 @@ class MemoryGraph:
             c_char_p(bytes(self.path.name, "utf-8")),
             c_int32(storage_type),
             c_char_p(bytes(config_path, "utf-8")),
+            byref(options),
         )
         self._describe_clib_functions()
 
@@ -200,6 +527,7 @@ class MemoryGraph:
     # * describing C functions is not thread safe even if values are the same.
     # * assign argtypes and error callbacks once instead of inside relevant methods.
     def _describe_clib_functions(self):
+        _describe_request_functions(self.lib)
         self.lib.GetNodeFeature.argtypes = [
             POINTER(_DEEP_GRAPH),
             POINTER(c_int64),
@@ -208,6 +536,7 @@ class MemoryGraph:
             c_size_t,
             POINTER(c_uint8),
             c_size_t,
+            c_int32,
         ]
         self.lib.GetNodeFeature.restype = c_int32
         self.lib.GetNodeFeature.errcheck = _ErrCallback(  # type: ignore
@@ -224,6 +553,7 @@ class MemoryGraph:
             c_size_t,
             POINTER(c_uint8),
             c_size_t,
+            c_int32,
         ]
         self.lib.GetEdgeFeature.restype = c_int32
         self.lib.GetEdgeFeature.errcheck = _ErrCallback(  # type: ignore
@@ -349,6 +679,25 @@ class MemoryGraph:
             "sample neighbors with uniform distribution"
         )
 
+        self.lib.SampleSubgraph.argtypes = [
+            POINTER(_DEEP_GRAPH),
+            c_bool,
+            c_int64,
+            POINTER(c_int64),
+            c_size_t,
+            POINTER(c_uint32),
+            c_size_t,
+            POINTER(c_int32),
+            c_size_t,
+            POINTER(c_int32),
+            c_size_t,
+            _SUBGRAPH_CALLBACKFUNC,
+        ]
+        self.lib.SampleSubgraph.restype = c_int32
+        self.lib.SampleSubgraph.errcheck = _ErrCallback(  # type: ignore
+            "sample subgraph"
+        )
+
         self.lib.ResetGraph.argtypes = [POINTER(_DEEP_GRAPH)]
         self.lib.ResetGraph.restype = c_int32
         self.lib.ResetGraph.errcheck = _ErrCallback("reset graph")  # type: ignore
@@ -369,6 +718,22 @@ class MemoryGraph:
         self.lib.RandomWalk.restype = c_int32
         self.lib.RandomWalk.errcheck = _ErrCallback("random walk")  # type: ignore
 
+        self.lib.NegativeSample.argtypes = [
+            POINTER(_DEEP_GRAPH),
+            c_int64,
+            c_int64,
+            POINTER(c_int64),
+            c_size_t,
+            POINTER(c_int32),
+            c_size_t,
+            c_size_t,
+            POINTER(c_int64),
+        ]
+        self.lib.NegativeSample.restype = c_int32
+        self.lib.NegativeSample.errcheck = _ErrCallback(  # type: ignore
+            "negative sampling"
+        )
+
         self.lib.GetNodeType.argtypes = [
             POINTER(_DEEP_GRAPH),
             POINTER(c_int64),
@@ -409,6 +774,7 @@ class MemoryGraph:
             c_size_t(len(features_in_bytes)),
             result.ctypes.data_as(POINTER(c_uint8)),
             c_size_t(result.nbytes),
+            c_int32(self._float_encoding if result.dtype == np.float32 else 0),
         )
 
         return result
@@ -520,6 +886,7 @@ class MemoryGraph:
             c_size_t(len(features)),
             result.ctypes.data_as(POINTER(c_uint8)),
             c_size_t(result.nbytes),
+            c_int32(self._float_encoding if result.dtype == np.float32 else 0),
         )
 
         return result
@@ -776,6 +1143,64 @@ class MemoryGraph:
 
         return result_nodes, result_types
 
+    def sample_subgraph(
+        self,
+        without_replacement: bool,
+        seeds: np.ndarray,
+        fanouts: List[int],
+        edge_types: Union[List[int], int],
+        features: Optional[np.ndarray] = None,
+        dtype: np.dtype = np.float32,
+        seed: Optional[int] = None,
+    ) -> Tuple[np.ndarray, np.ndarray, np.ndarray, np.ndarray, np.ndarray]:
+        """Sample a multi-hop neighborhood of seed nodes in a single call.
+
+        Nodes reached in h hops are expanded once with fanouts[h] uniformly sampled neighbors.
+        Distributed graphs expand hops on servers storing the nodes, instead of a request per hop.
+
+        Args:
+            without_replacement (bool): flag to replace selected neighbors from the population pool.
+            seeds (np.array): list of nodes to start sampling from.
+            fanouts (List[int]): number of neighbors to sample at every hop.
+            edge_types (Union[List[int], int]): types of edges for neighbors selection.
+            features (np.array, optional): list of node feature ids and sizes to fetch: [[feature_0, size_0], ...].
+            dtype (np.dtype, optional): feature types to extract. Defaults to np.float32.
+            seed (int, optional): Seed value for random samplers. Defaults to random.getrandbits(64).
+
+        Returns:
+            Tuple[np.ndarray, np.ndarray, np.ndarray, np.ndarray, np.ndarray]: unique node ids with seeds first,
+            number of hops to reach every node, sampled edges as [source, destination] positions in node ids,
+            edge types and node features with the shape [len(node ids), sum of feature sizes].
+        """
+        seeds = np.array(seeds, dtype=np.int64)
+        fanouts_arr = np.array(fanouts, dtype=np.uint32)
+        edge_types = _make_sorted_list(edge_types)
+        TypeArray = c_int32 * len(edge_types)
+        etypes_arr = TypeArray(*edge_types)
+        features = np.array(
+            features if features is not None else np.empty((0, 2)), dtype=np.int32
+        )
+        features_in_bytes = features.copy()
+        features_in_bytes *= (1, np.dtype(dtype).itemsize)
+
+        py_cb = _SubgraphCallback(dtype, int(features[:, 1].sum()))
+        self.lib.SampleSubgraph(
+            self.g_,
+            c_bool(without_replacement),
+            c_int64(seed if seed is not None else random.getrandbits(64)),
+            seeds.ctypes.data_as(POINTER(c_int64)),
+            c_size_t(seeds.size),
+            fanouts_arr.ctypes.data_as(POINTER(c_uint32)),
+            c_size_t(fanouts_arr.size),
+            etypes_arr,
+            c_size_t(len(edge_types)),
+            features_in_bytes.ctypes.data_as(POINTER(c_int32)),
+            c_size_t(len(features_in_bytes)),
+            _SUBGRAPH_CALLBACKFUNC(py_cb),
+        )
+
+        return py_cb.node_ids, py_cb.hops, py_cb.edges, py_cb.edge_types, py_cb.features
+
     def reset(self):
         """Reset graph and unload it from memory."""
         self.lib.ResetGraph(self.g_)
@@ -844,6 +1269,44 @@ class MemoryGraph:
 
         return result_nodes
 
+    def negative_sample(
+        self,
+        node_ids: np.ndarray,
+        edge_types: Union[List[int], int],
+        count: int,
+        default_node: int = -1,
+        seed: Optional[int] = None,
+    ) -> np.ndarray:
+        """
+        Sample negatives for link prediction, they are drawn uniformly from nodes of the graph by the graph engine.
+
+        node_ids: source nodes
+        edge_types (Union[List[int], int]): types of edges connecting sources to nodes that can't be negatives.
+        count: number of negatives per source node
+        default_node: default node id for negatives not found within a bounded number of draws
+        seed: seed to feed random generator
+        Returns negatives for every source node, they are neither sources nor their neighbors
+        """
+        node_ids = np.array(node_ids, dtype=np.int64)
+        edge_types = _make_sorted_list(edge_types)
+
+        TypeArray = c_int32 * len(edge_types)
+        etypes_arr = TypeArray(*edge_types)
+        result_nodes = np.empty((len(node_ids), count), dtype=np.int64)
+        self.lib.NegativeSample(
+            self.g_,
+            c_int64(random.getrandbits(64) if seed is None else seed),
+            c_int64(default_node),
+            node_ids.ctypes.data_as(POINTER(c_int64)),
+            c_size_t(node_ids.size),
+            etypes_arr,
+            c_size_t(len(edge_types)),
+            c_size_t(count),
+            result_nodes.ctypes.data_as(POINTER(c_int64)),
+        )
+
+        return result_nodes
+
     def node_types(self, nodes: np.ndarray, default_type: int) -> np.ndarray:
         """Retrieve node types.
 
@@ -872,18 +1335,48 @@ class DistributedGraph(MemoryGraph):
 
     def __init__(
         self,
-        servers: List[str],
+        servers: List[Union[str, List[str]]],
         ssl_cert: str = None,
         num_threads: int = None,
         num_cq_per_thread: int = None,
+        route_nodes: bool = False,
+        deadline_ms: int = 0,
+        hedge_delay_us: int = 0,
+        coalesce_window_us: int = 0,
+        coalesce_max_nodes: int = 4096,
+        feature_encoding: str = "raw",
+        compress_sparse_features: bool = False,
+        feature_cache_size: int = 0,
     ):
         """Create a client to work with a graph in a distributed mode.
 
         Args:
-            servers (List[str]): List of server hostnames to connect to.
+            servers (List[Union[str, List[str]]]): List of server hostnames to connect to. Every item is a shard,
+                lists are replicas of a shard serving the same partitions and requests are balanced between them.
             ssl_cert (str, optional): Certificates to use for connection if needed. Defaults to None.
+            route_nodes (bool, optional): Send requests only to servers storing the nodes. Routes take ~10 bytes per node of the graph. Defaults to False.
+            deadline_ms (int, optional): Fail requests not answered by a server in this time, 0 waits indefinitely.
+                Defaults to 0.
+            hedge_delay_us (int, optional): Send a duplicate request to another replica if a server doesn't reply in
+                this time, use values close to the 95th percentile of request latency. Shards with a single replica are
+                never hedged. 0 disables hedging. Defaults to 0.
+            coalesce_window_us (int, optional): Merge node feature lookups from concurrent threads with the same
+                features arriving within this time into one request. 0 disables coalescing. Defaults to 0.
+            coalesce_max_nodes (int, optional): Send merged lookups once they have this many unique nodes.
+                Defaults to 4096.
+            feature_encoding (str, optional): Encoding of float32 dense features sent by servers: "raw", "float16",
+                "bfloat16" or "int8" with a scale per feature. Values are decoded back to float32. Defaults to "raw".
+            compress_sparse_features (bool, optional): Compress replies with sparse and string features with gzip.
+                Defaults to False.
+            feature_cache_size (int, optional): Memory budget in bytes to cache dense node and edge features on the
+                client, only features missing from the cache are requested from servers. 0 disables cache.
+                Defaults to 0.
         """
         assert len(servers) > 0
+        assert (
+            feature_encoding in _FEATURE_ENCODINGS
+        ), f"Unknown feature encoding {feature_encoding}, expected one of {list(_FEATURE_ENCODINGS)}"
+        self._float_encoding = _FEATURE_ENCODINGS[feature_encoding]
         self.g_ = _DEEP_GRAPH()
         self.lib = _get_c_lib()
 
@@ -895,13 +1388,22 @@ class DistributedGraph(MemoryGraph):
             c_char_p,
             c_size_t,
             c_size_t,
+            POINTER(_CLIENT_OPTIONS),
         ]
 
-        ServersArray = c_char_p * len(servers)
+        shards = [[s] if isinstance(s, str) else list(s) for s in servers]
+        assert all(len(replicas) > 0 for replicas in shards)
+        hosts = [host for replicas in shards for host in replicas]
+        ServersArray = c_char_p * len(hosts)
         pointers = ServersArray()
-        for i, path in enumerate(servers):
+        for i, path in enumerate(hosts):
             pointers[i] = c_char_p(bytes(path, "utf-8"))
 
+        # Without replicas every host is a separate shard.
+        replicated = any(len(replicas) > 1 for replicas in shards)
+        ReplicasArray = c_size_t * len(shards)
+        shard_replicas = ReplicasArray(*[len(replicas) for replicas in shards])
+
         self.lib.CreateRemoteClient.errcheck = _ErrCallback(  # type: ignore
             "initialize remote client"
         )
@@ -913,6 +1415,18 @@ class DistributedGraph(MemoryGraph):
         if num_cq_per_thread is None:
             num_cq_per_thread = 1
 
+        options = _CLIENT_OPTIONS(
+            size=sizeof(_CLIENT_OPTIONS),
+            route_nodes=route_nodes,
+            deadline_ms=deadline_ms,
+            hedge_delay_us=hedge_delay_us,
+            shard_replicas=shard_replicas if replicated else None,
+            shard_count=len(shards) if replicated else 0,
+            coalesce_window_us=coalesce_window_us,
+            coalesce_max_nodes=coalesce_max_nodes,
+            compress_sparse_features=compress_sparse_features,
+            feature_cache_size=feature_cache_size,
+        )
         with tempfile.TemporaryDirectory() as meta_dir:
             self.lib.CreateRemoteClient(
                 byref(self.g_),
@@ -922,6 +1436,7 @@ class DistributedGraph(MemoryGraph):
                 c_char_p(bytes(ssl_cert, "utf-8")) if ssl_cert is not None else None,
                 c_size_t(num_threads),
                 c_size_t(num_cq_per_thread),
+                byref(options),
             )
             self.meta = Meta(meta_dir)
             # Keep an empty object to avoid ifs
@@ -929,6 +1444,19 @@ class DistributedGraph(MemoryGraph):
 
         super()._describe_clib_functions()
 
+    def refresh(self):
+        """Drop cached features, node routes and metadata after servers reloaded their partitions.
+
+        Clients drop cached features and node routes on their own once replies show a server reloaded, refresh
+        also updates metadata and fetches routes before returning. Safe to call while other requests are in flight.
+        """
+        self.lib.RefreshGraph.argtypes = [POINTER(_DEEP_GRAPH), c_char_p]
+        self.lib.RefreshGraph.restype = c_int32
+        self.lib.RefreshGraph.errcheck = _ErrCallback("refresh graph")  # type: ignore
+        with tempfile.TemporaryDirectory() as meta_dir:
+            self.lib.RefreshGraph(byref(self.g_), c_char_p(bytes(str(meta_dir), "utf-8")))
+            self.meta = Meta(meta_dir)
+
 
 class NodeSampler:
     """Sampler to fetch nodes from a graph."""
@@ -2,14 +2,17 @@
 # Licensed under the MIT License.
 
 """Conversion functions to internal binary format."""
-from typing import Optional
+from ctypes import byref, c_char_p, c_double, c_int32
+from typing import Optional, Tuple
 import multiprocessing as mp
 import math
 from operator import add
 import fsspec
+import fsspec.implementations.local
 from deepgnn import get_logger
 from deepgnn.graph_engine._adl_reader import TextFileIterator
 from deepgnn.graph_engine._base import get_fs
+from deepgnn.graph_engine.snark._lib import _get_c_lib
 from deepgnn.graph_engine.snark.decoders import DecoderType, JsonDecoder
 from deepgnn.graph_engine.snark.converter.writers import BinaryWriter
 from deepgnn.graph_engine.snark.dispatcher import (
@@ -18,6 +21,37 @@ from deepgnn.graph_engine.snark.dispatcher import (
 )
 from deepgnn.graph_engine.snark.meta import BINARY_DATA_VERSION
 
+# Values of snark::NodeOrder in reorder.h.
+_NODE_ORDERS = {"input": 0, "degree": 1, "rcm": 2}
+
+
+def reorder_partition(folder: str, partition: int, order: str) -> Tuple[float, float]:
+    """Renumber nodes of a converted partition to store neighbors close to each other.
+
+    Args:
+        folder: local directory with binary files of the partition.
+        partition: partition id.
+        order: "degree" puts nodes with more edges first, "rcm" uses reverse Cuthill-McKee order.
+
+    Returns:
+        Average distances between internal indices of neighbors inside the partition before and after reordering.
+    """
+    if order not in _NODE_ORDERS:
+        raise ValueError(f"Unknown node order {order}, supported: {list(_NODE_ORDERS)}")
+
+    before = c_double()
+    after = c_double()
+    result = _get_c_lib().ReorderPartition(
+        c_char_p(bytes(folder, "utf-8")),
+        c_char_p(bytes(f"{partition}_0", "utf-8")),
+        c_int32(_NODE_ORDERS[order]),
+        byref(before),
+        byref(after),
+    )
+    if result != 0:
+        raise Exception(f"Failed to reorder partition {partition}")
+    return before.value, after.value
+
 
 class MultiWorkersConverter:
     """Distributed converter implementation."""
@@ -39,6 +73,7 @@ class MultiWorkersConverter:
         skip_edge_sampler: bool = False,
         file_iterator: Optional[TextFileIterator] = None,
         debug: bool = False,
+        node_order: Optional[str] = None,
     ):
         """Run multi worker converter in multi process.
 
@@ -61,6 +96,7 @@ class MultiWorkersConverter:
             skip_edge_sampler(bool): skip generation of edge alias tables.
             file_iterator(TextFileIterator): Iterator to yield lines of the input text file.
             debug(bool, False): Enable debug mode to disable multiprocessing and see error messages, forces worker_count=1, paritition_count=1.
+            node_order(str, None): renumber nodes inside partitions after conversion for better locality, "degree" or "rcm", see reorder_partition.
         """
         if decoder is None:
             decoder = JsonDecoder()  # type: ignore
@@ -76,6 +112,17 @@ class MultiWorkersConverter:
         self.thread_count = thread_count
         self.dispatcher = dispatcher
         self.file_iterator = file_iterator
+        self.node_order = node_order
+        if node_order is not None:
+            if node_order not in _NODE_ORDERS:
+                raise ValueError(
+                    f"Unknown node order {node_order}, supported: {list(_NODE_ORDERS)}"
+                )
+            output_fs, _ = get_fs(output_dir)
+            if not isinstance(
+                output_fs, fsspec.implementations.local.LocalFileSystem
+            ):
+                raise ValueError("Nodes can be reordered only in local output folders.")
 
         self.fs, _ = get_fs(graph_path)
 
@@ -202,6 +249,16 @@ class MultiWorkersConverter:
             for count in edge_count_per_type:
                 mtxt.writelines([str(count), "\n"])
 
+        if self.node_order is not None:
+            for p in partitions:
+                partition_id = p["id"] if isinstance(p, dict) else 0
+                before, after = reorder_partition(
+                    self.output_dir, partition_id, self.node_order
+                )
+                get_logger().info(
+                    f"partition {partition_id} reordered in {self.node_order} order, average neighbor distance: {before:.2f} -> {after:.2f}"
+                )
+
 
 if __name__ == "__main__":
     # import here for special usage of the module.
@@ -243,6 +300,13 @@ if __name__ == "__main__":
         default=False,
         help="Skip generation of edge alias tables for edge sampling",
     )
+    parser.add_argument(
+        "--node_order",
+        type=str,
+        default=None,
+        choices=["degree", "rcm"],
+        help="Renumber nodes inside partitions to store neighbors close to each other",
+    )
     args = parser.parse_args()
 
     decoder = getattr(decoders, f"{args.type.capitalize()}Decoder")()
@@ -258,5 +322,6 @@ if __name__ == "__main__":
         decoder=decoder,
         skip_node_sampler=args.skip_node_sampler,
         skip_edge_sampler=args.skip_edge_sampler,
+        node_order=args.node_order,
     )
     c.convert()
@@ -2,7 +2,7 @@
 # Licensed under the MIT License.
 
 """Snark districuted client implementation."""
-from typing import List, Dict
+from typing import List, Dict, Union
 import tempfile
 
 import deepgnn.graph_engine.snark.client as client
@@ -15,11 +15,30 @@ from deepgnn.graph_engine.snark.meta import download_meta
 class Client(ge_snark.Client):
     """Distributed client."""
 
-    def __init__(self, servers: List[str], ssl_cert: str = None):
+    def __init__(
+        self,
+        servers: List[Union[str, List[str]]],
+        ssl_cert: str = None,
+        deadline_ms: int = 0,
+        hedge_delay_us: int = 0,
+        coalesce_window_us: int = 0,
+        feature_encoding: str = "raw",
+        compress_sparse_features: bool = False,
+        feature_cache_size: int = 0,
+    ):
         """Init snark client to wrapper around ctypes API of distributed graph."""
         self.logger = get_logger()
         self.logger.info(f"servers: {servers}. SSL: {ssl_cert}")
-        self.graph = client.DistributedGraph(servers, ssl_cert)
+        self.graph = client.DistributedGraph(
+            servers,
+            ssl_cert,
+            deadline_ms=deadline_ms,
+            hedge_delay_us=hedge_delay_us,
+            coalesce_window_us=coalesce_window_us,
+            feature_encoding=feature_encoding,
+            compress_sparse_features=compress_sparse_features,
+            feature_cache_size=feature_cache_size,
+        )
         self.node_samplers: Dict[str, client.NodeSampler] = {}
         self.edge_samplers: Dict[str, client.EdgeSampler] = {}
         self.logger.info(
@@ -42,6 +61,18 @@ class Server:
         storage_type: client.PartitionStorageType = client.PartitionStorageType.memory,
         config_path: str = "",
         stream: bool = False,
+        feature_cache_size: int = 0,
+        warm_feature_cache: bool = False,
+        compact_node_index: bool = False,
+        compressed_edges: bool = False,
+        alias_threshold: int = 0,
+        server_queues: int = 0,
+        server_threads: int = 0,
+        calls_per_method: int = 1,
+        worker_threads: int = 0,
+        method_calls: Dict[str, int] = None,
+        columnar_features: List[int] = None,
+        numa: bool = False,
     ):
         """Init snark server."""
         temp_dir = tempfile.TemporaryDirectory()
@@ -72,6 +103,18 @@ class Server:
             storage_type,
             config_path,
             stream,  # type: ignore
+            feature_cache_size,
+            warm_feature_cache,
+            compact_node_index,
+            compressed_edges,
+            alias_threshold,
+            server_queues,
+            server_threads,
+            calls_per_method,
+            worker_threads,
+            method_calls,
+            columnar_features,
+            numa,
         )
 
     def reset(self):
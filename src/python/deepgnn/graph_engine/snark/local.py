@@ -29,6 +29,18 @@ class Client(Graph):
         storage_type: client.PartitionStorageType = client.PartitionStorageType.memory,
         config_path: str = "",
         stream: bool = False,
+        feature_cache_size: int = 0,
+        warm_feature_cache: bool = False,
+        compact_node_index: bool = False,
+        compressed_edges: bool = False,
+        thread_count: int = 1,
+        min_chunk_size: int = 1024,
+        alias_threshold: int = 0,
+        columnar_features: List[int] = None,
+        shared_index: str = "",
+        edge_index_threshold: int = 0,
+        hdfs_buffer_size: int = 4 << 20,
+        hdfs_read_threads: int = 4,
     ):
         """Provide a convenient wrapper around ctypes API of native graph."""
         self.logger = get_logger()
@@ -39,7 +51,23 @@ class Client(Graph):
             f"Graph data path: {path}. Partitions {partitions}. Storage type {storage_type}. Config path {config_path}. Stream {stream}."
         )
         self.graph = client.MemoryGraph(
-            path, partitions, storage_type, config_path, stream
+            path,
+            partitions,
+            storage_type,
+            config_path,
+            stream,
+            feature_cache_size,
+            warm_feature_cache,
+            compact_node_index,
+            compressed_edges,
+            thread_count,
+            min_chunk_size,
+            alias_threshold,
+            columnar_features,
+            shared_index,
+            edge_index_threshold,
+            hdfs_buffer_size,
+            hdfs_read_threads,
         )
         self.node_samplers: Dict[str, client.NodeSampler] = {}
         self.edge_samplers: Dict[str, client.EdgeSampler] = {}
@@ -173,6 +201,22 @@ class Client(Graph):
             seed=random.getrandbits(64),
         )
 
+    def negative_sample(
+        self,
+        node_ids: np.ndarray,
+        edge_types: Union[int, np.ndarray],
+        count: int,
+        default_node: int = -1,
+    ) -> np.ndarray:
+        """Sample negatives that are neither source nodes nor their neighbors."""
+        return self.graph.negative_sample(
+            node_ids,
+            self.__check_types(edge_types),
+            count,
+            default_node,
+            seed=random.getrandbits(64),
+        )
+
     def neighbors(
         self, nodes: np.ndarray, edge_types: Union[int, np.ndarray]
     ) -> Tuple[np.ndarray, np.ndarray, np.ndarray, np.ndarray]:
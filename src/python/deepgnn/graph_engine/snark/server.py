@@ -3,7 +3,18 @@
 
 """Stanalone graph engine server."""
 from datetime import datetime
-from ctypes import POINTER, Structure, byref, c_char_p, c_size_t, c_uint32, c_int32
+from ctypes import (
+    POINTER,
+    Structure,
+    byref,
+    c_bool,
+    c_char_p,
+    c_size_t,
+    c_uint32,
+    c_uint64,
+    c_int32,
+    sizeof,
+)
 from typing import Any, Dict, List
 
 from deepgnn.graph_engine.snark._lib import _get_c_lib
@@ -16,6 +27,31 @@ class _SERVER(Structure):
     _fields_: List[Any] = []
 
 
+# Matches PyServerOptions in py_graph.h, new fields are only appended.
+class _SERVER_OPTIONS(Structure):
+    _fields_: List[Any] = [
+        ("size", c_size_t),
+        ("feature_cache_size", c_size_t),
+        ("warm_feature_cache", c_bool),
+        ("compact_node_index", c_bool),
+        ("compressed_edges", c_bool),
+        ("alias_threshold", c_size_t),
+        ("server_queues", c_size_t),
+        ("server_threads", c_size_t),
+        ("calls_per_method", c_size_t),
+        ("worker_threads", c_size_t),
+        ("method_count", c_size_t),
+        ("method_names", POINTER(c_char_p)),
+        ("method_calls", POINTER(c_size_t)),
+        ("columnar_features", POINTER(c_int32)),
+        ("columnar_feature_count", c_size_t),
+        ("numa", c_bool),
+        ("edge_index_threshold", c_size_t),
+        ("hdfs_buffer_size", c_size_t),
+        ("hdfs_read_threads", c_size_t),
+    ]
+
+
 class _ErrCallback:
     def __init__(self, method: str):
         self.method = method
@@ -39,6 +75,21 @@ class Server:
         storage_type: PartitionStorageType = PartitionStorageType.memory,
         config_path: str = "",
         stream: bool = False,
+        feature_cache_size: int = 0,
+        warm_feature_cache: bool = False,
+        compact_node_index: bool = False,
+        compressed_edges: bool = False,
+        alias_threshold: int = 0,
+        server_queues: int = 0,
+        server_threads: int = 0,
+        calls_per_method: int = 1,
+        worker_threads: int = 0,
+        method_calls: Dict[str, int] = None,
+        columnar_features: List[int] = None,
+        numa: bool = False,
+        edge_index_threshold: int = 0,
+        hdfs_buffer_size: int = 4 << 20,
+        hdfs_read_threads: int = 4,
     ):
         """Create server and start it.
 
@@ -53,6 +104,21 @@ class Server:
             config_path (str, optional): Path to folder with configuration files.
             stream (bool, default=False): If remote path is given: by default, download files first then load,
                 if stream = True and libhdfs present, stream data directly to memory.
+            feature_cache_size (int, default=0): Memory budget in bytes to cache features read from disk storage, 0 disables cache.
+            warm_feature_cache (bool, default=False): Fill feature cache with nodes with highest sampling weights during loading.
+            compact_node_index (bool, default=False): Use sorted node index with less memory and slower lookups instead of hash map.
+            compressed_edges (bool, default=False): Keep edge destinations and weights compressed in memory, reduces memory at the cost of slower neighbor lookups.
+            alias_threshold (int, default=0): Sample weighted neighbors of nodes with at least this many edges of a type with alias tables, uses more memory for faster sampling. 0 disables alias tables.
+            server_queues (int, default=0): Number of gRPC completion queues, 0 creates one per CPU core.
+            server_threads (int, default=0): Number of threads polling completion queues, at least one per queue.
+            calls_per_method (int, default=1): Requests of every method each queue processes concurrently.
+            worker_threads (int, default=0): Threads to process requests separately from polling threads, 0 processes requests on polling threads.
+            method_calls (Dict[str, int], optional): Per method overrides of calls_per_method, e.g. {"GetNodeFeatures": 8}.
+            columnar_features (List[int], optional): Dense node feature ids to copy into per feature arrays at load time, speeds up gathers of a few features out of many at the cost of memory for every node.
+            numa (bool, default=False): Place partitions loaded in memory on NUMA nodes of the host and pin server threads to nodes, so requests are processed by cores close to their queues and workers. With worker_threads workers of a node also read node features of partitions on the node.
+            edge_index_threshold (int, default=0): Find edges of nodes with at least this many edges of a type in hash tables of destinations, uses more memory for faster edge feature lookups of hub nodes. 0 disables edge indexes.
+            hdfs_buffer_size (int, default=4194304): Size of ranges in bytes read concurrently from HDFS files.
+            hdfs_read_threads (int, default=4): Number of ranges read concurrently and kept in memory for every streamed HDFS file, partition files are loaded concurrently.
         """
         if (
             data_path.startswith("hdfs://")
@@ -81,6 +147,7 @@ class Server:
             c_char_p,
             c_int32,
             c_char_p,
+            POINTER(_SERVER_OPTIONS),
         ]
 
         self.lib.StartServer.errcheck = _ErrCallback("start server")  # type: ignore
@@ -95,6 +162,36 @@ class Server:
             ssl_cert = c_char_p(bytes(ssl_config["ssl_cert"], "utf-8"))
             ssl_root = c_char_p(bytes(ssl_config["ssl_root"], "utf-8"))
 
+        method_calls = method_calls or {}
+        MethodNames = c_char_p * len(method_calls)
+        MethodCalls = c_size_t * len(method_calls)
+        method_names = MethodNames(*[bytes(name, "utf-8") for name in method_calls])
+        method_counts = MethodCalls(*method_calls.values())
+        columnar_features = columnar_features or []
+        ColumnarFeatures = c_int32 * len(columnar_features)
+        columnar_features_array = ColumnarFeatures(*columnar_features)
+        options = _SERVER_OPTIONS(
+            size=sizeof(_SERVER_OPTIONS),
+            feature_cache_size=feature_cache_size,
+            warm_feature_cache=warm_feature_cache,
+            compact_node_index=compact_node_index,
+            compressed_edges=compressed_edges,
+            alias_threshold=alias_threshold,
+            server_queues=server_queues,
+            server_threads=server_threads,
+            calls_per_method=calls_per_method,
+            worker_threads=worker_threads,
+            method_count=len(method_calls),
+            method_names=method_names,
+            method_calls=method_counts,
+            columnar_features=columnar_features_array,
+            columnar_feature_count=len(columnar_features),
+            numa=numa,
+            edge_index_threshold=edge_index_threshold,
+            hdfs_buffer_size=hdfs_buffer_size,
+            hdfs_read_threads=hdfs_read_threads,
+        )
+
         self.lib.StartServer(
             byref(self.s_),
             len(partitions),
@@ -106,8 +203,27 @@ class Server:
             ssl_root,
             c_int32(storage_type),
             c_char_p(bytes(config_path, "utf-8")),
+            byref(options),
         )
 
+    def reload(self) -> int:
+        """Load partitions from the data path again and serve them without a restart.
+
+        Delta partitions with new suffixes, e.g. files of a partition ``0_1`` next to partition ``0``, add edges to
+        existing nodes, partitions with unchanged files are kept and not loaded again. Requests in flight finish with
+        the partitions they started with. Clients see the new version in replies, drop cached features and send
+        requests to all servers until node routes are fetched again. ``DistributedGraph.refresh`` updates metadata.
+
+        Returns:
+            Number of completed reloads.
+        """
+        self.lib.ReloadServer.argtypes = [POINTER(_SERVER), POINTER(c_uint64)]
+        self.lib.ReloadServer.restype = c_int32
+        self.lib.ReloadServer.errcheck = _ErrCallback("reload server")  # type: ignore
+        version = c_uint64()
+        self.lib.ReloadServer(byref(self.s_), byref(version))
+        return version.value
+
     def reset(self):
         """Reset server and stop serving."""
         self.lib.ResetServer.argtypes = [POINTER(_SERVER)]
@@ -134,6 +250,14 @@ if __name__ == "__main__":
             return []
         return [int(x) for x in v.split(",")]
 
+    def _str2dict_int(v):
+        if isinstance(v, dict):
+            return v
+        if v == "":
+            return {}
+        pairs = [item.split(":") for item in v.split(",")]
+        return {name: int(count) for name, count in pairs}
+
     parser = argparse.ArgumentParser(
         formatter_class=argparse.ArgumentDefaultsHelpFormatter, allow_abbrev=False
     )
@@ -176,6 +300,96 @@ if __name__ == "__main__":
         default=False,
         help="If ADL data path, stream directly to memory or download to disk first.",
     )
+    parser.add_argument(
+        "--feature_cache_size",
+        type=int,
+        default=0,
+        help="Memory budget in bytes to cache features read from disk storage.",
+    )
+    parser.add_argument(
+        "--warm_feature_cache",
+        action="store_true",
+        default=False,
+        help="Fill feature cache with nodes with highest sampling weights on start.",
+    )
+    parser.add_argument(
+        "--compact_node_index",
+        action="store_true",
+        default=False,
+        help="Use sorted node index with less memory and slower lookups.",
+    )
+    parser.add_argument(
+        "--compressed_edges",
+        action="store_true",
+        default=False,
+        help="Keep edge destinations and weights compressed in memory.",
+    )
+    parser.add_argument(
+        "--alias_threshold",
+        type=int,
+        default=0,
+        help="Sample neighbors of nodes with at least this many edges of a type with alias tables.",
+    )
+    parser.add_argument(
+        "--server_queues",
+        type=int,
+        default=0,
+        help="Number of gRPC completion queues, 0 creates one per CPU core.",
+    )
+    parser.add_argument(
+        "--server_threads",
+        type=int,
+        default=0,
+        help="Number of threads polling completion queues.",
+    )
+    parser.add_argument(
+        "--calls_per_method",
+        type=int,
+        default=1,
+        help="Requests of every method each completion queue processes concurrently.",
+    )
+    parser.add_argument(
+        "--worker_threads",
+        type=int,
+        default=0,
+        help="Threads to process requests separately from polling threads.",
+    )
+    parser.add_argument(
+        "--method_calls",
+        type=_str2dict_int,
+        default={},
+        help="Per method overrides of calls_per_method, e.g. GetNodeFeatures:8,Sample:2.",
+    )
+    parser.add_argument(
+        "--columnar_features",
+        type=_str2list_int,
+        default=[],
+        help="Dense node feature ids to store in per feature arrays, e.g. 0,3.",
+    )
+    parser.add_argument(
+        "--numa",
+        action="store_true",
+        default=False,
+        help="Place partitions and pin server threads to NUMA nodes.",
+    )
+    parser.add_argument(
+        "--edge_index_threshold",
+        type=int,
+        default=0,
+        help="Find edges of nodes with at least this many edges of a type in hash tables.",
+    )
+    parser.add_argument(
+        "--hdfs_buffer_size",
+        type=int,
+        default=4 << 20,
+        help="Size of ranges in bytes read concurrently from HDFS files.",
+    )
+    parser.add_argument(
+        "--hdfs_read_threads",
+        type=int,
+        default=4,
+        help="Number of ranges read concurrently for every HDFS file.",
+    )
 
     args, _ = parser.parse_known_args()
     if args.server_group is not None:
@@ -195,6 +409,21 @@ if __name__ == "__main__":
         storage_type=args.storage_type,
         config_path=args.config_path,
         stream=args.stream,
+        feature_cache_size=args.feature_cache_size,
+        warm_feature_cache=args.warm_feature_cache,
+        compact_node_index=args.compact_node_index,
+        compressed_edges=args.compressed_edges,
+        alias_threshold=args.alias_threshold,
+        server_queues=args.server_queues,
+        server_threads=args.server_threads,
+        calls_per_method=args.calls_per_method,
+        worker_threads=args.worker_threads,
+        method_calls=args.method_calls,
+        columnar_features=args.columnar_features,
+        numa=args.numa,
+        edge_index_threshold=args.edge_index_threshold,
+        hdfs_buffer_size=args.hdfs_buffer_size,
+        hdfs_read_threads=args.hdfs_read_threads,
     )
     logger.info("Server started...")
     try:
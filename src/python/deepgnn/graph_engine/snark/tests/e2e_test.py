@@ -215,6 +215,36 @@ def test_multiple_node_features_graph_single_partition(
     npt.assert_almost_equal(v, [[1, 0, -0.03, -0.04], [1, 1, -0.05, -0.06]])
 
 
+def test_converter_node_order_keeps_graph(default_triangle_graph):
+    output = tempfile.TemporaryDirectory()
+    data_name = triangle_graph_json(output.name)
+    convert.MultiWorkersConverter(
+        graph_path=data_name,
+        partition_count=1,
+        output_dir=output.name,
+        decoder=JsonDecoder(),
+        node_order="rcm",
+    ).convert()
+
+    with open(os.path.join(output.name, "node_0_0.map"), "rb") as nm:
+        node_map = nm.read()
+    ids = [int.from_bytes(node_map[i : i + 8], sys.byteorder) for i in (0, 20, 40)]
+    assert ids == [5, 0, 9]
+
+    expected = client.MemoryGraph(default_triangle_graph, [0])
+    reordered = client.MemoryGraph(output.name, [0])
+    nodes = np.array([9, 0, 5], dtype=np.int64)
+    features = np.array([[0, 2], [1, 2]], dtype=np.int32)
+    npt.assert_equal(
+        reordered.node_features(nodes, features, np.float32),
+        expected.node_features(nodes, features, np.float32),
+    )
+    for actual, wanted in zip(
+        reordered.neighbors(nodes, [0, 1]), expected.neighbors(nodes, [0, 1])
+    ):
+        npt.assert_equal(actual, wanted)
+
+
 @pytest.mark.parametrize(
     "storage_type",
     [client.PartitionStorageType.memory, client.PartitionStorageType.disk],
@@ -353,6 +383,28 @@ def test_memory_graph_node_types(multi_partition_graph_data, storage_type):
     npt.assert_equal(types, np.array([0, 2, 1], dtype=np.int32))
 
 
+@pytest.mark.parametrize("multi_partition_graph_data", param, indirect=True)
+def test_memory_graph_shared_index(multi_partition_graph_data):
+    shared_index = tempfile.TemporaryDirectory()
+    graphs = [
+        client.MemoryGraph(
+            multi_partition_graph_data, [0, 1], shared_index=shared_index.name
+        )
+        for _ in range(2)
+    ]
+    assert os.path.exists(os.path.join(shared_index.name, "manifest.txt"))
+    for cl in graphs:
+        types = cl.node_types(np.array([9, 5, 0], dtype=np.int64), -2)
+        npt.assert_equal(types, np.array([0, 2, 1], dtype=np.int32))
+        node_ids, weights, edge_types, result_counts = cl.neighbors(
+            np.array([9, 0], dtype=np.int64),
+            np.array([0, 1, 2], dtype=np.int32),
+        )
+        npt.assert_equal(node_ids, np.array([0, 5], dtype=np.int64))
+        npt.assert_almost_equal(weights, np.array([0.5, 1.0], dtype=np.float32))
+        npt.assert_equal(result_counts, np.array([1, 1], dtype=np.int64))
+
+
 @pytest.mark.parametrize(
     "storage_type",
     [client.PartitionStorageType.memory, client.PartitionStorageType.disk],
@@ -416,6 +468,55 @@ def test_multithreaded_calls(multi_partition_graph_data, storage_type):
     [t.join() for t in thread_list]
 
 
+@pytest.mark.parametrize("multi_partition_graph_data", param, indirect=True)
+def test_async_requests(multi_partition_graph_data):
+    cl = client.MemoryGraph(multi_partition_graph_data, [0, 1])
+    features = client.submit(
+        cl.node_features,
+        np.array([9, 0], dtype=np.int64),
+        features=np.array([[1, 2]], dtype=np.int32),
+        dtype=np.float32,
+    )
+    types = client.submit(cl.node_types, [0, 9, 42], default_type=-1)
+    npt.assert_array_almost_equal(features.wait(), [[-0.01, -0.02], [-0.03, -0.04]])
+    assert features.done()
+    npt.assert_array_equal(types.wait(), cl.node_types([0, 9, 42], default_type=-1))
+
+    ns = client.NodeSampler(cl, [2])
+    nodes, node_types = client.submit(ns.sample, size=3, seed=1).wait()
+    npt.assert_array_equal(nodes, [5, 5, 5])
+    npt.assert_array_equal(node_types, [2, 2, 2])
+
+    with pytest.raises(ValueError):
+        client.submit(cl.neighbors, [0], 0)
+
+
+@pytest.mark.parametrize("multi_partition_graph_data", param, indirect=True)
+def test_prefetch_batches(multi_partition_graph_data):
+    cl = client.MemoryGraph(multi_partition_graph_data, [0, 1])
+    batches = [[0], [9], [0, 9]] * 3
+
+    def query(nodes):
+        return {
+            "features": client.submit(cl.node_features, nodes, [[1, 2]], np.float32),
+            "counts": client.submit(cl.neighbor_counts, nodes, [0, 1]),
+        }
+
+    fetched = 0
+    for nodes, values in client.prefetch(batches, query, depth=3):
+        npt.assert_array_equal(
+            values["features"], cl.node_features(nodes, [[1, 2]], np.float32)
+        )
+        npt.assert_array_equal(values["counts"], cl.neighbor_counts(nodes, [0, 1]))
+        fetched += 1
+    assert fetched == len(batches)
+
+    # Requests of batches left unread are cancelled.
+    stream = client.prefetch(batches, query, depth=2)
+    next(stream)
+    stream.close()
+
+
 @pytest.mark.parametrize(
     "storage_type",
     [client.PartitionStorageType.memory, client.PartitionStorageType.disk],
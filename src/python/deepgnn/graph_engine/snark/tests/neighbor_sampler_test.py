@@ -192,6 +192,25 @@ def test_full_neighbor_graph_multiple_partitions(multi_partition_graph_data):
     npt.assert_array_equal(counts, [0, 1, 1])
 
 
+def test_sample_subgraph_graph_multiple_partitions(multi_partition_graph_data):
+    g = client.MemoryGraph(multi_partition_graph_data, [0, 1])
+    nodes, hops, edges, types, features = g.sample_subgraph(
+        without_replacement=True,
+        seeds=np.array([9], dtype=np.int64),
+        fanouts=[1, 1],
+        edge_types=[0, 1],
+        features=[[1, 2]],
+        seed=1,
+    )
+    npt.assert_array_equal(nodes, [9, 0, 5])
+    npt.assert_array_equal(hops, [0, 1, 2])
+    npt.assert_array_equal(edges, [[0, 1], [1, 2]])
+    npt.assert_array_equal(types, [0, 1])
+    npt.assert_array_almost_equal(
+        features, [[-0.01, -0.02], [-0.03, -0.04], [-0.05, -0.06]]
+    )
+
+
 def test_full_neighbor_graph_single_partition(multi_partition_graph_data):
     g = client.MemoryGraph(multi_partition_graph_data, [1])
     node_ids, weights, types, counts = g.neighbors(
@@ -87,6 +87,46 @@ def binary_karate_club_data():
         yield workdir
 
 
+def karate_club_neighbors():
+    raw = nx.karate_club_graph()
+    return {node + 1: {nb + 1 for nb in raw.neighbors(node)} for node in raw.nodes()}
+
+
+def assert_walks_follow_edges(walks, node_ids):
+    neighbors = karate_club_neighbors()
+    for walk, start in zip(walks, node_ids):
+        assert walk[0] == start
+        for parent, node in zip(walk[:-1], walk[1:]):
+            assert node in neighbors[parent]
+
+
+def node2vec_step_probabilities(neighbors, start, walk_len, p, q):
+    # Exact distribution of nodes visited at every step by walks over edges with unit weights.
+    states = {(None, start): 1.0}
+    result = []
+    for _ in range(walk_len):
+        next_states: dict = {}
+        for (parent, node), probability in states.items():
+            weights = {}
+            for nb in neighbors[node]:
+                if parent is None or nb in neighbors[parent]:
+                    weights[nb] = 1.0
+                else:
+                    weights[nb] = 1.0 / q
+                if nb == parent:
+                    weights[nb] = 1.0 / p
+            total = sum(weights.values())
+            for nb, weight in weights.items():
+                key = (node, nb)
+                next_states[key] = next_states.get(key, 0) + probability * weight / total
+        states = next_states
+        step: dict = {}
+        for (_, node), probability in states.items():
+            step[node] = step.get(node, 0) + probability
+        result.append(step)
+    return result
+
+
 def test_karate_club_random_walk_memory(binary_karate_club_data):
     cl = client.MemoryGraph(binary_karate_club_data, [0, 1])
     walks = cl.random_walk(
@@ -98,7 +138,17 @@ def test_karate_club_random_walk_memory(binary_karate_club_data):
         seed=1,
     )
 
-    npt.assert_equal(walks, [[1, 6, 11, 5], [7, 17, 6, 1], [15, 33, 31, 9]])
+    assert walks.shape == (3, 4)
+    assert_walks_follow_edges(walks, [1, 7, 15])
+    same_seed_walks = cl.random_walk(
+        node_ids=np.array([1, 7, 15], dtype=np.int64),
+        edge_types=0,
+        walk_len=3,
+        p=2,
+        q=0.5,
+        seed=1,
+    )
+    npt.assert_equal(walks, same_seed_walks)
 
 
 def test_karate_club_random_walk_missing_connections(binary_karate_club_data):
@@ -138,10 +188,11 @@ def test_karate_club_random_walk_no_repetition_in_default_values(
 def test_karate_club_random_walk_statistical(binary_karate_club_data):
     cl = client.MemoryGraph(binary_karate_club_data, [0, 1])
     walk_len = 3
-    minibatch_size = 10
-    actual_counts = [{} for _ in range(walk_len)]
+    minibatch_size = 1000
+    iterations = 100
+    actual_counts: List[dict] = [{} for _ in range(walk_len)]
     random.seed(27)
-    for _ in range(10000):
+    for _ in range(iterations):
         walks = cl.random_walk(
             node_ids=np.ones(minibatch_size, dtype=np.int64),
             edge_types=0,
@@ -158,91 +209,16 @@ def test_karate_club_random_walk_statistical(binary_karate_club_data):
                     actual_counts[step][curr_node] = 0
                 actual_counts[step][curr_node] += 1
 
-    expected_counts = [
-        {
-            18: 6390,
-            12: 6236,
-            2: 6201,
-            14: 6319,
-            13: 6263,
-            9: 6227,
-            5: 6302,
-            3: 6148,
-            6: 6286,
-            11: 6300,
-            7: 6318,
-            8: 6330,
-            32: 6267,
-            4: 6165,
-            20: 6217,
-            22: 6031,
-        },
-        {
-            2: 14624,
-            1: 20658,
-            22: 663,
-            3: 5541,
-            4: 8217,
-            31: 2929,
-            34: 8680,
-            7: 3995,
-            11: 3858,
-            17: 5557,
-            5: 3945,
-            8: 2179,
-            25: 1130,
-            33: 3832,
-            14: 2237,
-            6: 3946,
-            28: 915,
-            18: 654,
-            29: 2092,
-            10: 920,
-            26: 1176,
-            13: 1122,
-            9: 469,
-            20: 661,
-        },
-        {
-            22: 3002,
-            5: 3288,
-            2: 5170,
-            33: 1930,
-            1: 8975,
-            9: 3245,
-            27: 553,
-            7: 6885,
-            20: 3541,
-            34: 4111,
-            3: 6619,
-            6: 6895,
-            17: 2458,
-            14: 5671,
-            28: 1920,
-            4: 4323,
-            16: 963,
-            13: 2596,
-            23: 870,
-            12: 1102,
-            8: 4821,
-            19: 958,
-            18: 2886,
-            24: 1879,
-            21: 909,
-            10: 1181,
-            32: 3047,
-            11: 3322,
-            29: 1198,
-            31: 2937,
-            15: 898,
-            25: 611,
-            26: 326,
-            30: 910,
-        },
-    ]
-    for step in range(len(expected_counts)):
-        for node, count in expected_counts[step].items():
-            assert actual_counts[step][node] == count
+    expected = node2vec_step_probabilities(
+        karate_club_neighbors(), 1, walk_len, p=2, q=0.5
+    )
+    total = minibatch_size * iterations
+    for step in range(walk_len):
+        assert set(actual_counts[step]).issubset(expected[step])
+        for node, probability in expected[step].items():
+            deviation = np.sqrt(total * probability * (1 - probability))
+            actual = actual_counts[step].get(node, 0)
+            assert abs(actual - total * probability) <= 5 * deviation + 1
 
 
 def test_karate_club_random_walk_single_server(binary_karate_club_data):
@@ -257,7 +233,16 @@ def test_karate_club_random_walk_single_server(binary_karate_club_data):
         seed=2,
     )
 
-    npt.assert_equal(walks, [[1, 7, 1, 4], [7, 5, 11, 6], [15, 34, 27, 34]])
+    memory_walks = client.MemoryGraph(binary_karate_club_data, [0, 1]).random_walk(
+        node_ids=np.array([1, 7, 15], dtype=np.int64),
+        edge_types=0,
+        walk_len=3,
+        p=2,
+        q=0.5,
+        seed=2,
+    )
+    npt.assert_equal(walks, memory_walks)
+    assert_walks_follow_edges(walks, [1, 7, 15])
     s.reset()
 
 
@@ -274,7 +259,17 @@ def test_karate_club_random_walk_multiple_servers(binary_karate_club_data):
         seed=3,
     )
 
-    npt.assert_equal(walks, [[1, 20, 34, 32], [7, 5, 11, 1], [15, 34, 32, 1]])
+    # Walks are handed between servers and match walks over a graph with both partitions.
+    memory_walks = client.MemoryGraph(binary_karate_club_data, [0, 1]).random_walk(
+        node_ids=np.array([1, 7, 15], dtype=np.int64),
+        edge_types=0,
+        walk_len=3,
+        p=2,
+        q=0.5,
+        seed=3,
+    )
+    npt.assert_equal(walks, memory_walks)
+    assert_walks_follow_edges(walks, [1, 7, 15])
     s1.reset()
     s2.reset()
 